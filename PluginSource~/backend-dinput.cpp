@@ -0,0 +1,288 @@
+#include "pch.h"
+#include "backend.h"
+#include "util.h"
+
+#ifdef _WIN32
+#include <cfgmgr32.h>
+#include <mutex>
+
+// GUID_DEVINTERFACE_HID, wheels arrive and leave as HID interfaces.
+static const GUID s_hidInterfaceGuid = { 0x4D1E55B2, 0xF16F, 0x11CF, { 0x88, 0xCB, 0x00, 0x11, 0x11, 0x00, 0x00, 0x30 } };
+
+/**
+ * Thin wrappers around the DirectInput 8 COM interfaces.
+ */
+class DirectInputEffect : public FFBEffect
+{
+public:
+   DirectInputEffect(LPDIRECTINPUTEFFECT pEffect) : m_pEffect(pEffect) {}
+
+   ~DirectInputEffect()
+   {
+      m_pEffect->Stop();
+      m_pEffect->Release();
+   }
+
+   HRESULT SetParameters(const DIEFFECT* effect, DWORD flags)
+   {
+      return m_pEffect->SetParameters(effect, flags);
+   }
+
+   HRESULT Start(DWORD iterations, DWORD flags)
+   {
+      return m_pEffect->Start(iterations, flags);
+   }
+
+   HRESULT Stop()
+   {
+      return m_pEffect->Stop();
+   }
+
+   HRESULT Download()
+   {
+      return m_pEffect->Download();
+   }
+
+private:
+   LPDIRECTINPUTEFFECT m_pEffect;
+};
+
+class DirectInputDevice : public FFBDevice
+{
+public:
+   DirectInputDevice(LPDIRECTINPUTDEVICE8 pDevice) : m_pDevice(pDevice) {}
+
+   ~DirectInputDevice()
+   {
+      m_pDevice->Unacquire();
+      m_pDevice->Release();
+   }
+
+   HRESULT EnumAxes(LPDIENUMDEVICEOBJECTSCALLBACK callback, void* context)
+   {
+      return m_pDevice->EnumObjects(callback, context, DIDFT_AXIS);
+   }
+
+   HRESULT CreateEffect(REFGUID effectType, const DIEFFECT* effect, FFBEffect** ppEffect)
+   {
+      LPDIRECTINPUTEFFECT pEffect;
+      HRESULT hr = m_pDevice->CreateEffect(effectType, effect, &pEffect, NULL);
+      if (SUCCEEDED(hr))
+      {
+         *ppEffect = new DirectInputEffect(pEffect);
+      }
+      return hr;
+   }
+
+   HRESULT GetEffectInfo(REFGUID effectType, DIEFFECTINFO* info)
+   {
+      return m_pDevice->GetEffectInfo(info, effectType);
+   }
+
+   DWORD GetEffectLimit()
+   {
+      // DirectInput does not report it, CreateEffect fails with
+      // DIERR_DEVICEFULL once the device runs out of effect memory.
+      return 0;
+   }
+
+   HRESULT SetProperty(REFGUID property, const DIPROPHEADER* header)
+   {
+      if (&property == &DIPROP_BUFFERSIZE)
+      {
+         // Only set while the device is not acquired.
+         m_pDevice->Unacquire();
+         HRESULT hr = m_pDevice->SetProperty(property, header);
+         HRESULT hrAcquire = m_pDevice->Acquire();
+         return FAILED(hr) ? hr : hrAcquire;
+      }
+      return m_pDevice->SetProperty(property, header);
+   }
+
+   HRESULT GetState(DIJOYSTATE* state)
+   {
+      HRESULT hr = Poll();
+      if (FAILED(hr))
+      {
+         return hr;
+      }
+      return m_pDevice->GetDeviceState(sizeof(DIJOYSTATE), state);
+   }
+
+   HRESULT GetDeviceData(DIDEVICEOBJECTDATA* data, DWORD* count)
+   {
+      HRESULT hr = Poll();
+      if (FAILED(hr))
+      {
+         *count = 0;
+         return hr;
+      }
+      return m_pDevice->GetDeviceData(sizeof(DIDEVICEOBJECTDATA), data, count, 0);
+   }
+
+   DWORD GetDataTime()
+   {
+      // DirectInput stamps buffered data with the system tick count.
+      return GetTickCount();
+   }
+
+private:
+   HRESULT Poll()
+   {
+      HRESULT hr = m_pDevice->Poll();
+      if (hr == DIERR_INPUTLOST || hr == DIERR_NOTACQUIRED)
+      {
+         m_pDevice->Acquire();
+         hr = m_pDevice->Poll();
+      }
+      return hr;
+   }
+
+   LPDIRECTINPUTDEVICE8 m_pDevice;
+};
+
+class DirectInputBackend : public FFBBackend
+{
+public:
+   DirectInputBackend(LPDIRECTINPUT8 pDI) :
+      m_pDI(pDI),
+      m_hNotify(NULL),
+      m_deviceChangeCallback(NULL),
+      m_pDeviceChangeContext(NULL)
+   {
+   }
+
+   ~DirectInputBackend()
+   {
+      SetDeviceChangeCallback(NULL, NULL);
+      m_pDI->Release();
+   }
+
+   HRESULT EnumDevices(LPDIENUMDEVICESCALLBACK callback, void* context)
+   {
+      // The device monitor enumerates from its own thread.
+      std::lock_guard<std::mutex> lock(m_enumLock);
+      return m_pDI->EnumDevices(
+         DI8DEVCLASS_GAMECTRL,
+         callback,
+         context,
+         DIEDFL_ATTACHEDONLY | DIEDFL_FORCEFEEDBACK
+      );
+   }
+
+   HRESULT CreateDevice(REFGUID guidInstance, FFBDevice** ppDevice)
+   {
+      LPDIRECTINPUTDEVICE8 pDevice;
+
+      std::unique_lock<std::mutex> lock(m_enumLock);
+      HRESULT hr = m_pDI->CreateDevice(guidInstance, &pDevice, NULL);
+      lock.unlock();
+      if (FAILED(hr))
+      {
+         return hr;
+      }
+
+      // Not sure if this is necessary.
+      if (FAILED(hr = pDevice->SetDataFormat(&c_dfDIJoystick)))
+      {
+         pDevice->Release();
+         return hr;
+      }
+
+      // Find the main window associated with this process.
+      HWND hWnd = FindMainWindow(GetCurrentProcessId());
+      // Set the cooperative level to let DInput know how this device should
+      // interact with the system and with other DInput applications.
+      // Exclusive access is required in order to perform force feedback.
+      if (FAILED(hr = pDevice->SetCooperativeLevel(hWnd, DISCL_EXCLUSIVE | DISCL_BACKGROUND)))
+      {
+         pDevice->Release();
+         return hr;
+      }
+
+      if (FAILED(hr = pDevice->Acquire()))
+      {
+         pDevice->Release();
+         return hr;
+      }
+
+      *ppDevice = new DirectInputDevice(pDevice);
+      return S_OK;
+   }
+
+   void SetDeviceChangeCallback(DeviceChangeCallback callback, void* context)
+   {
+      if (m_hNotify != NULL)
+      {
+         // Waits for a callback in progress to return.
+         CM_Unregister_Notification(m_hNotify);
+         m_hNotify = NULL;
+      }
+      m_deviceChangeCallback = callback;
+      m_pDeviceChangeContext = context;
+      if (callback == NULL)
+      {
+         return;
+      }
+
+      CM_NOTIFY_FILTER filter;
+      ZeroMemory(&filter, sizeof(filter));
+      filter.cbSize = sizeof(filter);
+      filter.FilterType = CM_NOTIFY_FILTER_TYPE_DEVICEINTERFACE;
+      filter.u.DeviceInterface.ClassGuid = s_hidInterfaceGuid;
+      if (CM_Register_Notification(&filter, this, _cbDeviceInterfaceChange, &m_hNotify) != CR_SUCCESS)
+      {
+         // Changes are then only noticed by the monitor's periodic scan.
+         m_hNotify = NULL;
+      }
+   }
+
+private:
+   static DWORD CALLBACK _cbDeviceInterfaceChange(HCMNOTIFICATION hNotify, PVOID context,
+      CM_NOTIFY_ACTION action, PCM_NOTIFY_EVENT_DATA eventData, DWORD eventDataSize)
+   {
+      DirectInputBackend* pBackend = (DirectInputBackend*)context;
+      if (action == CM_NOTIFY_ACTION_DEVICEINTERFACEARRIVAL || action == CM_NOTIFY_ACTION_DEVICEINTERFACEREMOVAL)
+      {
+         pBackend->m_deviceChangeCallback(pBackend->m_pDeviceChangeContext);
+      }
+      return ERROR_SUCCESS;
+   }
+
+   LPDIRECTINPUT8 m_pDI;
+   std::mutex m_enumLock;
+
+   HCMNOTIFICATION m_hNotify;
+   DeviceChangeCallback m_deviceChangeCallback;
+   void* m_pDeviceChangeContext;
+};
+
+/**
+ * This initializes the DirectInput 8 interface.
+ */
+HRESULT CreateDirectInputBackend(FFBBackend** /*ppBackend*/)
+{
+   LPDIRECTINPUT8 pDI;
+   HRESULT hr = DirectInput8Create(
+      GetModuleHandle(NULL),
+      DIRECTINPUT_VERSION,
+      IID_IDirectInput8,
+      (void**)&pDI,
+      NULL
+   );
+   if (SUCCEEDED(hr))
+   {
+      *ppBackend = new DirectInputBackend(pDI);
+   }
+   return hr;
+}
+
+#else
+
+HRESULT CreateDirectInputBackend(FFBBackend** /*ppBackend*/)
+{
+   // DirectInput only exists on Windows.
+   return E_NOTIMPL;
+}
+
+#endif
@@ -0,0 +1,1317 @@
+#include "pch.h"
+#include "backend.h"
+#include "unity-ffb.h"
+#include "util.h"
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <thread>
+
+/**
+ * The simulated backend models one or more force feedback wheels entirely
+ * in-process. It is deterministic: every driver call costs exactly the
+ * configured latency and updates are dropped on a fixed schedule, so the
+ * plugin can be regression tested and benchmarked without hardware.
+ */
+
+static const int SIM_MAX_AXES = 6;
+
+static SimulatedDeviceConfig s_simConfig = {
+   1,                // deviceCount
+   1,                // axisCount
+   DI_FFNOMINALMAX,  // maxForce
+   1,                // forceResolution
+   0,                // latencyMicroseconds
+   0,                // dropEveryN
+   0,                // physicsStepMicroseconds
+   0,                // maxEffects
+   0,                // enumerationMicroseconds
+   0,                // downloadMicroseconds
+   0,                // sampleBytesPerMillisecond
+   0                 // firmwareUpdateHz
+};
+
+// Wheel physics: full force accelerates the rim from center to a stop in
+// roughly 100ms, viscous losses slow it down.
+static const double SIM_AXIS_MIN = 0.0;
+static const double SIM_AXIS_MAX = 65535.0;
+static const double SIM_ACCELERATION_PER_FORCE = 650.0;
+static const double SIM_VISCOUS_DAMPING = 4.0;
+static const double SIM_MAX_SUBSTEP = 0.0001;
+static const double SIM_TWO_PI = 6.283185307179586;
+
+static const GUID s_simAxisGuids[SIM_MAX_AXES] = {
+   GUID_XAxis, GUID_YAxis, GUID_ZAxis, GUID_RxAxis, GUID_RyAxis, GUID_RzAxis
+};
+static const DWORD s_simAxisOffsets[SIM_MAX_AXES] = {
+   DIJOFS_X, DIJOFS_Y, DIJOFS_Z, DIJOFS_RX, DIJOFS_RY, DIJOFS_RZ
+};
+static const wchar_t* s_simAxisNames[SIM_MAX_AXES] = {
+   L"X Axis", L"Y Axis", L"Z Axis", L"X Rotation", L"Y Rotation", L"Z Rotation"
+};
+
+/**
+ * Busy-wait rather than sleep so the modelled latency is exact.
+ */
+static void SimulateLatency(DWORD microseconds)
+{
+   if (microseconds == 0)
+   {
+      return;
+   }
+   auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(microseconds);
+   while (std::chrono::steady_clock::now() < until)
+   {
+   }
+}
+
+/**
+ * Enumerating is slow because the driver waits on the device, not because
+ * it is busy, so this sleeps.
+ */
+static void SimulateEnumeration(DWORD microseconds)
+{
+   if (microseconds != 0)
+   {
+      std::this_thread::sleep_for(std::chrono::microseconds(microseconds));
+   }
+}
+
+static GUID SimulatedInstanceGuid(int index)
+{
+   GUID guid = { 0x5F0FFB00 + (uint32_t)index, 0x0000, 0x0000, { 0x53, 0x49, 0x4D, 0x57, 0x48, 0x45, 0x45, 0x4C } };
+   return guid;
+}
+
+static const GUID s_simProductGuid = { 0x5F0FFBFF, 0x0000, 0x0000, { 0x53, 0x49, 0x4D, 0x57, 0x48, 0x45, 0x45, 0x4C } };
+
+static bool IsPeriodicGuid(REFGUID effectType)
+{
+   return effectType == GUID_Square || effectType == GUID_Sine || effectType == GUID_Triangle
+      || effectType == GUID_SawtoothUp || effectType == GUID_SawtoothDown;
+}
+
+class SimulatedEffect;
+
+/**
+ * State of one physical wheel. Outlives the FFBDevice objects created
+ * for it so the state can be inspected after the device is freed.
+ */
+struct SimulatedWheel
+{
+   std::mutex lock;
+   // Detached wheels are not enumerated. Attaching again starts a new
+   // generation, devices and effects of an older one stay lost like they
+   // do on a real unplug.
+   bool attached;
+   DWORD generation;
+   SimulatedDeviceConfig config;
+   SimulatedDeviceState state;
+   std::vector<SimulatedEffect*> effects;
+   double position[SIM_MAX_AXES];
+   double velocity[SIM_MAX_AXES];
+   std::chrono::steady_clock::time_point lastStep;
+   BYTE buttons[32];
+   // Changes waiting for GetDeviceData, once DIPROP_BUFFERSIZE turned
+   // buffering on. A full buffer drops new changes, like DirectInput.
+   DWORD inputBufferSize;
+   std::vector<DIDEVICEOBJECTDATA> inputBuffer;
+   bool bInputOverflow;
+   DWORD inputSequence;
+   // When the firmware is done with the last update it was sent.
+   std::chrono::steady_clock::time_point firmwareFree;
+
+   void Render();
+   void WaitForFirmware();
+   void RenderForce(int64_t elapsedUs, LONG* force) const;
+   void Step();
+   void BufferInput(DWORD offset, DWORD data);
+   DWORD DownloadedEffects() const;
+   bool IsLost(DWORD createdGeneration) const { return !attached || generation != createdGeneration; }
+};
+
+class SimulatedEffect : public FFBEffect
+{
+public:
+   SimulatedEffect(SimulatedWheel* pWheel, DWORD generation, REFGUID effectType) :
+      m_pWheel(pWheel),
+      m_dwGeneration(generation),
+      m_guidType(effectType),
+      m_bRunning(false),
+      m_bDownloaded(false),
+      m_bModified(false)
+   {
+      m_params.gain = DI_FFNOMINALMAX;
+      m_params.duration = INFINITE;
+      m_params.hasEnvelope = false;
+      m_params.channels = 1;
+      m_params.samplePeriod = 1;
+   }
+
+   ~SimulatedEffect()
+   {
+      std::lock_guard<std::mutex> lock(m_pWheel->lock);
+      if (m_bDownloaded && !m_pWheel->IsLost(m_dwGeneration))
+      {
+         // Unloading it from the wheel's memory is a round trip too.
+         SimulateLatency(m_pWheel->config.latencyMicroseconds);
+      }
+      auto& effects = m_pWheel->effects;
+      for (size_t i = 0; i < effects.size(); i++)
+      {
+         if (effects[i] == this)
+         {
+            effects.erase(effects.begin() + i);
+            break;
+         }
+      }
+      m_pWheel->Render();
+   }
+
+   HRESULT SetParameters(const DIEFFECT* effect, DWORD flags)
+   {
+      std::lock_guard<std::mutex> lock(m_pWheel->lock);
+      if ((flags & DIEP_NODOWNLOAD) != 0)
+      {
+         // Only the host's copy changes, nothing is sent to the wheel.
+         if (m_pWheel->IsLost(m_dwGeneration))
+         {
+            return DIERR_INPUTLOST;
+         }
+         HRESULT hr = Apply(effect, flags);
+         if (SUCCEEDED(hr))
+         {
+            m_bModified = true;
+         }
+         return hr;
+      }
+
+      SimulateLatency(m_pWheel->config.latencyMicroseconds);
+      if (m_pWheel->IsLost(m_dwGeneration))
+      {
+         return DIERR_INPUTLOST;
+      }
+      m_pWheel->WaitForFirmware();
+
+      SimulatedDeviceState& state = m_pWheel->state;
+      state.setParametersCalls++;
+      DWORD dropEveryN = m_pWheel->config.dropEveryN;
+      if (dropEveryN != 0 && state.setParametersCalls % dropEveryN == 0)
+      {
+         // Firmware acknowledged the update but never applied it.
+         state.droppedUpdates++;
+         return DI_OK;
+      }
+
+      HRESULT hr = Apply(effect, flags);
+      if (SUCCEEDED(hr))
+      {
+         // The update carries the changes held back with DIEP_NODOWNLOAD
+         // too, an effect that was never downloaded is downloaded whole.
+         hr = DownloadLocked();
+      }
+      if (SUCCEEDED(hr))
+      {
+         bool bNewSamples = m_guidType == GUID_CustomForce && (flags & DIEP_TYPESPECIFICPARAMS) != 0;
+         if (bNewSamples)
+         {
+            DWORD bytesPerMillisecond = m_pWheel->config.sampleBytesPerMillisecond;
+            size_t sampleCount = m_downloaded.samples.size();
+            if (bytesPerMillisecond != 0)
+            {
+               SimulateLatency((DWORD)(sampleCount * sizeof(LONG) * 1000 / bytesPerMillisecond));
+            }
+            state.samplesReceived += (DWORD)sampleCount;
+         }
+         if ((flags & DIEP_START) != 0)
+         {
+            m_bRunning = true;
+            state.startCalls++;
+         }
+         if ((flags & DIEP_START) != 0 || bNewSamples)
+         {
+            // New samples play from the first one.
+            m_tStarted = std::chrono::steady_clock::now();
+         }
+         m_pWheel->Render();
+      }
+      return hr;
+   }
+
+   HRESULT Start(DWORD /*iterations*/, DWORD /*flags*/)
+   {
+      std::lock_guard<std::mutex> lock(m_pWheel->lock);
+      SimulateLatency(m_pWheel->config.latencyMicroseconds);
+      if (m_pWheel->IsLost(m_dwGeneration))
+      {
+         return DIERR_INPUTLOST;
+      }
+      if (!m_bDownloaded || m_bModified)
+      {
+         HRESULT hr = DownloadLocked();
+         if (FAILED(hr))
+         {
+            return hr;
+         }
+      }
+      m_pWheel->state.startCalls++;
+      m_bRunning = true;
+      m_tStarted = std::chrono::steady_clock::now();
+      m_pWheel->Render();
+      return DI_OK;
+   }
+
+   HRESULT Stop()
+   {
+      std::lock_guard<std::mutex> lock(m_pWheel->lock);
+      SimulateLatency(m_pWheel->config.latencyMicroseconds);
+      if (m_pWheel->IsLost(m_dwGeneration))
+      {
+         return DIERR_INPUTLOST;
+      }
+      m_pWheel->state.stopCalls++;
+      m_bRunning = false;
+      m_pWheel->Render();
+      return DI_OK;
+   }
+
+   HRESULT Download()
+   {
+      std::lock_guard<std::mutex> lock(m_pWheel->lock);
+      SimulateLatency(m_pWheel->config.latencyMicroseconds);
+      if (m_pWheel->IsLost(m_dwGeneration))
+      {
+         return DIERR_INPUTLOST;
+      }
+      if (m_bDownloaded && !m_bModified)
+      {
+         return DI_OK;
+      }
+      HRESULT hr = DownloadLocked();
+      if (SUCCEEDED(hr))
+      {
+         m_pWheel->Render();
+      }
+      return hr;
+   }
+
+   /**
+    * Send the host's parameters to the wheel. The first download writes
+    * the whole effect into the wheel's memory, which only holds maxEffects
+    * effects; later ones ride along with the call that sends them. Called
+    * with the wheel locked.
+    */
+   HRESULT DownloadLocked()
+   {
+      if (!m_bDownloaded)
+      {
+         DWORD maxEffects = m_pWheel->config.maxEffects;
+         if (maxEffects != 0 && m_pWheel->DownloadedEffects() >= maxEffects)
+         {
+            return DIERR_DEVICEFULL;
+         }
+         SimulateLatency(m_pWheel->config.downloadMicroseconds);
+         m_pWheel->state.downloads++;
+      }
+      m_downloaded = m_params;
+      m_bDownloaded = true;
+      m_bModified = false;
+      return DI_OK;
+   }
+
+   /**
+    * Copy the parameters selected by flags. Called with the wheel locked.
+    */
+   HRESULT Apply(const DIEFFECT* effect, DWORD flags)
+   {
+      if (effect == NULL || effect->dwSize != sizeof(DIEFFECT))
+      {
+         return DIERR_INVALIDPARAM;
+      }
+      if ((flags & DIEP_DURATION) != 0)
+      {
+         if (m_guidType == GUID_RampForce && effect->dwDuration == INFINITE)
+         {
+            // Like the driver, a ramp has to end.
+            return DIERR_INVALIDPARAM;
+         }
+         m_params.duration = effect->dwDuration;
+      }
+      if ((flags & DIEP_GAIN) != 0)
+      {
+         m_params.gain = effect->dwGain;
+      }
+      if ((flags & DIEP_ENVELOPE) != 0)
+      {
+         if (effect->lpEnvelope != NULL && effect->lpEnvelope->dwSize != sizeof(DIENVELOPE))
+         {
+            return DIERR_INVALIDPARAM;
+         }
+         m_params.hasEnvelope = effect->lpEnvelope != NULL;
+         if (m_params.hasEnvelope)
+         {
+            m_params.envelope = *effect->lpEnvelope;
+         }
+      }
+      if ((flags & DIEP_DIRECTION) != 0)
+      {
+         if (effect->cAxes > SIM_MAX_AXES || effect->rglDirection == NULL)
+         {
+            return DIERR_INVALIDPARAM;
+         }
+         m_params.directions.assign(effect->rglDirection, effect->rglDirection + effect->cAxes);
+      }
+      if ((flags & DIEP_TYPESPECIFICPARAMS) != 0)
+      {
+         if (effect->cbTypeSpecificParams > 0 && effect->lpvTypeSpecificParams == NULL)
+         {
+            return DIERR_INVALIDPARAM;
+         }
+         if (m_guidType == GUID_CustomForce)
+         {
+            // The samples are copied out of the caller's buffer, like the
+            // driver does.
+            const DICUSTOMFORCE* customForce = (const DICUSTOMFORCE*)effect->lpvTypeSpecificParams;
+            if (effect->cbTypeSpecificParams < sizeof(DICUSTOMFORCE) || customForce->cChannels == 0
+               || customForce->cChannels > SIM_MAX_AXES || customForce->cSamples == 0
+               || customForce->cSamples % customForce->cChannels != 0 || customForce->rglForceData == NULL)
+            {
+               return DIERR_INVALIDPARAM;
+            }
+            m_params.channels = customForce->cChannels;
+            m_params.samplePeriod = customForce->dwSamplePeriod != 0 ? customForce->dwSamplePeriod : 1;
+            m_params.samples.assign(customForce->rglForceData, customForce->rglForceData + customForce->cSamples);
+         }
+         const BYTE* params = (const BYTE*)effect->lpvTypeSpecificParams;
+         m_params.typeSpecificParams.assign(params, params + effect->cbTypeSpecificParams);
+      }
+      return DI_OK;
+   }
+
+   /**
+    * Add this effect's contribution to the per axis output force, with the
+    * parameters last downloaded, elapsedUs after it was started (negative
+    * for the time since it really was). Only constant and ramp forces,
+    * the periodic waveforms and custom forces produce output without a
+    * modelled position.
+    */
+   void Render(LONG* output, int axisCount, int64_t elapsedUs) const
+   {
+      const std::vector<BYTE>& typeSpecificParams = m_downloaded.typeSpecificParams;
+      if (!m_bRunning || !m_bDownloaded || m_pWheel->IsLost(m_dwGeneration))
+      {
+         return;
+      }
+      double magnitude;
+      if (m_guidType == GUID_ConstantForce && typeSpecificParams.size() >= sizeof(DICONSTANTFORCE))
+      {
+         magnitude = ((const DICONSTANTFORCE*)&typeSpecificParams[0])->lMagnitude;
+      }
+      else if (m_guidType == GUID_RampForce && typeSpecificParams.size() >= sizeof(DIRAMPFORCE))
+      {
+         if (elapsedUs < 0)
+         {
+            elapsedUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_tStarted).count();
+         }
+         // From lStart to lEnd over the duration, nothing after it.
+         const DIRAMPFORCE* ramp = (const DIRAMPFORCE*)&typeSpecificParams[0];
+         DWORD duration = m_downloaded.duration;
+         if (duration == 0 || duration == INFINITE || elapsedUs >= (int64_t)duration)
+         {
+            return;
+         }
+         magnitude = ramp->lStart + (double)(ramp->lEnd - ramp->lStart) * elapsedUs / duration;
+      }
+      else if (IsPeriodicGuid(m_guidType) && typeSpecificParams.size() >= sizeof(DIPERIODIC))
+      {
+         if (elapsedUs < 0)
+         {
+            elapsedUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_tStarted).count();
+         }
+         magnitude = PeriodicForce(elapsedUs);
+      }
+      else if (m_guidType == GUID_CustomForce && !m_downloaded.samples.empty())
+      {
+         if (elapsedUs < 0)
+         {
+            elapsedUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_tStarted).count();
+         }
+         const LONG* sample = CustomForceSample(elapsedUs);
+         if (sample == NULL)
+         {
+            return;
+         }
+         DWORD channels = m_downloaded.channels;
+         if (channels > 1)
+         {
+            // A channel per axis, the directions do not apply.
+            for (int i = 0; i < axisCount && i < (int)channels; i++)
+            {
+               output[i] += (LONG)((double)sample[i] * m_downloaded.gain / DI_FFNOMINALMAX);
+            }
+            return;
+         }
+         magnitude = sample[0];
+      }
+      else
+      {
+         return;
+      }
+      magnitude = magnitude * m_downloaded.gain / DI_FFNOMINALMAX;
+
+      // Cartesian directions, a single axis (or no direction) just uses the sign.
+      const std::vector<LONG>& directions = m_downloaded.directions;
+      double length = 0;
+      for (LONG direction : directions)
+      {
+         length += (double)direction * direction;
+      }
+      length = sqrt(length);
+      for (int i = 0; i < axisCount; i++)
+      {
+         double component = 1.0;
+         if (length > 0)
+         {
+            component = i < (int)directions.size() ? directions[i] / length : 0.0;
+         }
+         else if (i > 0)
+         {
+            component = 0.0;
+         }
+         output[i] += (LONG)(magnitude * component);
+      }
+   }
+
+   /**
+    * The waveform elapsedUs into playing it: the offset plus the wave at
+    * the magnitude the envelope has reached, nothing once the duration is
+    * over.
+    */
+   double PeriodicForce(int64_t elapsedUs) const
+   {
+      const DIPERIODIC* wave = (const DIPERIODIC*)&m_downloaded.typeSpecificParams[0];
+      DWORD duration = m_downloaded.duration;
+      if (duration != INFINITE && elapsedUs >= (int64_t)duration)
+      {
+         return 0.0;
+      }
+
+      double position = wave->dwPhase / 36000.0;
+      if (wave->dwPeriod > 0)
+      {
+         position += (double)elapsedUs / wave->dwPeriod;
+      }
+      position -= floor(position);
+      double value;
+      if (m_guidType == GUID_Sine)
+      {
+         value = sin(SIM_TWO_PI * position);
+      }
+      else if (m_guidType == GUID_Square)
+      {
+         value = position < 0.5 ? 1.0 : -1.0;
+      }
+      else if (m_guidType == GUID_Triangle)
+      {
+         value = position < 0.25 ? 4.0 * position : (position < 0.75 ? 2.0 - 4.0 * position : 4.0 * position - 4.0);
+      }
+      else if (m_guidType == GUID_SawtoothUp)
+      {
+         value = 2.0 * position - 1.0;
+      }
+      else
+      {
+         value = 1.0 - 2.0 * position;
+      }
+
+      double level = wave->dwMagnitude;
+      if (m_downloaded.hasEnvelope)
+      {
+         const DIENVELOPE& envelope = m_downloaded.envelope;
+         int64_t fadeStart = duration != INFINITE ? (int64_t)duration - (int64_t)envelope.dwFadeTime : INT64_MAX;
+         if (elapsedUs < (int64_t)envelope.dwAttackTime)
+         {
+            level = envelope.dwAttackLevel + (level - envelope.dwAttackLevel) * elapsedUs / envelope.dwAttackTime;
+         }
+         else if (envelope.dwFadeTime > 0 && elapsedUs > fadeStart)
+         {
+            level += (envelope.dwFadeLevel - level) * (elapsedUs - fadeStart) / envelope.dwFadeTime;
+         }
+      }
+      return wave->lOffset + level * value;
+   }
+
+   /**
+    * The channels of the sample playing elapsedUs after the samples
+    * arrived, they repeat until the duration is over. NULL after that.
+    */
+   const LONG* CustomForceSample(int64_t elapsedUs) const
+   {
+      DWORD duration = m_downloaded.duration;
+      if (duration != INFINITE && elapsedUs >= (int64_t)duration)
+      {
+         return NULL;
+      }
+      size_t frames = m_downloaded.samples.size() / m_downloaded.channels;
+      size_t frame = (size_t)(elapsedUs / m_downloaded.samplePeriod) % frames;
+      return &m_downloaded.samples[frame * m_downloaded.channels];
+   }
+
+   SimulatedWheel* m_pWheel;
+   DWORD m_dwGeneration;
+   GUID m_guidType;
+   bool m_bRunning;
+   // Last start, where a periodic waveform and its envelope begin, or the
+   // last custom force samples received.
+   std::chrono::steady_clock::time_point m_tStarted;
+
+   struct Parameters {
+      DWORD duration;
+      DWORD gain;
+      bool hasEnvelope;
+      DIENVELOPE envelope;
+      std::vector<LONG> directions;
+      std::vector<BYTE> typeSpecificParams;
+      // A custom force's samples, copied from its DICUSTOMFORCE.
+      DWORD channels;
+      DWORD samplePeriod;
+      std::vector<LONG> samples;
+   };
+   // Set by SetParameters, and what the wheel plays since the last
+   // download.
+   Parameters m_params;
+   Parameters m_downloaded;
+   bool m_bDownloaded;
+   // m_params changed with DIEP_NODOWNLOAD since the last download.
+   bool m_bModified;
+};
+
+/**
+ * Effects holding a place in the wheel's memory. Called with the wheel
+ * locked.
+ */
+DWORD SimulatedWheel::DownloadedEffects() const
+{
+   DWORD count = 0;
+   for (SimulatedEffect* effect : effects)
+   {
+      if (effect->m_bDownloaded)
+      {
+         count++;
+      }
+   }
+   return count;
+}
+
+/**
+ * Hold an update until the firmware took the one before it, each takes
+ * 1 / firmwareUpdateHz to process. Called with the wheel locked.
+ */
+void SimulatedWheel::WaitForFirmware()
+{
+   if (config.firmwareUpdateHz == 0)
+   {
+      return;
+   }
+   auto now = std::chrono::steady_clock::now();
+   while (now < firmwareFree)
+   {
+      now = std::chrono::steady_clock::now();
+   }
+   firmwareFree = now + std::chrono::nanoseconds(1000000000LL / config.firmwareUpdateHz);
+}
+
+/**
+ * Recompute the force the motor is producing. Called with the wheel locked.
+ */
+void SimulatedWheel::Render()
+{
+   RenderForce(-1, state.outputForce);
+}
+
+/**
+ * The force the motor produces elapsedUs after every effect was started,
+ * or now for a negative elapsedUs. Called with the wheel locked.
+ */
+void SimulatedWheel::RenderForce(int64_t elapsedUs, LONG* force) const
+{
+   LONG output[SIM_MAX_AXES] = { 0 };
+   for (SimulatedEffect* effect : effects)
+   {
+      effect->Render(output, config.axisCount, elapsedUs);
+   }
+   LONG maxForce = (LONG)config.maxForce;
+   for (int i = 0; i < SIM_MAX_AXES; i++)
+   {
+      force[i] = output[i] > maxForce ? maxForce : (output[i] < -maxForce ? -maxForce : output[i]);
+   }
+}
+
+/**
+ * Advance the rim(s) under the force currently produced by the motor.
+ * Called with the wheel locked.
+ */
+void SimulatedWheel::Step()
+{
+   // Periodic effects change the force without any call.
+   Render();
+   std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+   double dt = config.physicsStepMicroseconds / 1000000.0;
+   if (config.physicsStepMicroseconds == 0)
+   {
+      dt = std::chrono::duration<double>(now - lastStep).count();
+   }
+   lastStep = now;
+   if (dt > 0.1)
+   {
+      dt = 0.1;
+   }
+
+   while (dt > 0)
+   {
+      double step = dt < SIM_MAX_SUBSTEP ? dt : SIM_MAX_SUBSTEP;
+      dt -= step;
+      for (int i = 0; i < config.axisCount; i++)
+      {
+         double acceleration = state.outputForce[i] * SIM_ACCELERATION_PER_FORCE - velocity[i] * SIM_VISCOUS_DAMPING;
+         velocity[i] += acceleration * step;
+         position[i] += velocity[i] * step;
+         if (position[i] < SIM_AXIS_MIN || position[i] > SIM_AXIS_MAX)
+         {
+            position[i] = position[i] < SIM_AXIS_MIN ? SIM_AXIS_MIN : SIM_AXIS_MAX;
+            velocity[i] = 0;
+         }
+      }
+   }
+   for (int i = 0; i < SIM_MAX_AXES; i++)
+   {
+      LONG moved = (LONG)position[i];
+      if (moved != state.axisPosition[i])
+      {
+         state.axisPosition[i] = moved;
+         BufferInput(s_simAxisOffsets[i], (DWORD)moved);
+      }
+   }
+}
+
+static DWORD SimulatedDataTime()
+{
+   return (DWORD)std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Buffer a change of an axis or button for GetDeviceData, time stamped on
+ * the GetDataTime clock. Called with the wheel locked.
+ */
+void SimulatedWheel::BufferInput(DWORD offset, DWORD data)
+{
+   if (inputBufferSize == 0)
+   {
+      return;
+   }
+   if (inputBuffer.size() >= inputBufferSize)
+   {
+      bInputOverflow = true;
+      return;
+   }
+   DIDEVICEOBJECTDATA change = { offset, data, SimulatedDataTime(), ++inputSequence, 0 };
+   inputBuffer.push_back(change);
+}
+
+class SimulatedDevice : public FFBDevice
+{
+public:
+   SimulatedDevice(SimulatedWheel* pWheel, DWORD generation) : m_pWheel(pWheel), m_dwGeneration(generation) {}
+
+   HRESULT EnumAxes(LPDIENUMDEVICEOBJECTSCALLBACK callback, void* context)
+   {
+      int axisCount;
+      DWORD enumerationMicroseconds;
+      DIDEVICEOBJECTINSTANCE doi;
+      {
+         std::lock_guard<std::mutex> lock(m_pWheel->lock);
+         if (m_pWheel->IsLost(m_dwGeneration))
+         {
+            return DIERR_INPUTLOST;
+         }
+         axisCount = m_pWheel->config.axisCount;
+         enumerationMicroseconds = m_pWheel->config.enumerationMicroseconds;
+         ZeroMemory(&doi, sizeof(doi));
+         doi.dwSize = sizeof(doi);
+         doi.dwFlags = DIDOI_FFACTUATOR;
+         doi.dwFFMaxForce = m_pWheel->config.maxForce;
+         doi.dwFFForceResolution = m_pWheel->config.forceResolution;
+         doi.wUsagePage = 0x01;
+      }
+      SimulateEnumeration(enumerationMicroseconds);
+      for (int i = 0; i < axisCount; i++)
+      {
+         doi.guidType = s_simAxisGuids[i];
+         doi.dwOfs = s_simAxisOffsets[i];
+         doi.dwType = DIDFT_ABSAXIS | DIDFT_FFACTUATOR | DIDFT_MAKEINSTANCE(i);
+         doi.wUsage = (WORD)(0x30 + i);
+         wcsncpy(doi.tszName, s_simAxisNames[i], MAX_PATH - 1);
+         if (callback(&doi, context) == DIENUM_STOP)
+         {
+            break;
+         }
+      }
+      return DI_OK;
+   }
+
+   HRESULT CreateEffect(REFGUID effectType, const DIEFFECT* effect, FFBEffect** ppEffect)
+   {
+      if (ppEffect == NULL)
+      {
+         return E_POINTER;
+      }
+      SimulatedEffect* pEffect = new SimulatedEffect(m_pWheel, m_dwGeneration, effectType);
+      HRESULT hr = effect != NULL ? pEffect->Apply(effect, DIEP_ALLPARAMS) : DI_OK;
+      if (FAILED(hr))
+      {
+         delete pEffect;
+         return hr;
+      }
+
+      std::unique_lock<std::mutex> lock(m_pWheel->lock);
+      // Without parameters the effect is only created on the host.
+      if (effect != NULL)
+      {
+         SimulateLatency(m_pWheel->config.latencyMicroseconds);
+      }
+      hr = m_pWheel->IsLost(m_dwGeneration) ? DIERR_INPUTLOST : DI_OK;
+      if (SUCCEEDED(hr) && effect != NULL)
+      {
+         hr = pEffect->DownloadLocked();
+      }
+      if (FAILED(hr))
+      {
+         // The effect was never added to the wheel, deleting it locks again.
+         lock.unlock();
+         delete pEffect;
+         return hr;
+      }
+      m_pWheel->effects.push_back(pEffect);
+      m_pWheel->state.effectsCreated++;
+      *ppEffect = pEffect;
+      return DI_OK;
+   }
+
+   HRESULT GetEffectInfo(REFGUID effectType, DIEFFECTINFO* info)
+   {
+      if (info == NULL)
+      {
+         return E_POINTER;
+      }
+      DWORD enumerationMicroseconds;
+      {
+         std::lock_guard<std::mutex> lock(m_pWheel->lock);
+         if (m_pWheel->IsLost(m_dwGeneration))
+         {
+            return DIERR_INPUTLOST;
+         }
+         enumerationMicroseconds = m_pWheel->config.enumerationMicroseconds;
+      }
+      SimulateEnumeration(enumerationMicroseconds);
+
+      // The effects SimulatedEffect renders.
+      DWORD type;
+      const wchar_t* name;
+      if (effectType == GUID_ConstantForce)
+      {
+         type = DIEFT_CONSTANTFORCE;
+         name = L"Constant Force";
+      }
+      else if (effectType == GUID_RampForce)
+      {
+         type = DIEFT_RAMPFORCE;
+         name = L"Ramp Force";
+      }
+      else if (IsPeriodicGuid(effectType))
+      {
+         type = DIEFT_PERIODIC;
+         name = L"Periodic";
+      }
+      else if (effectType == GUID_CustomForce)
+      {
+         type = DIEFT_CUSTOMFORCE;
+         name = L"Custom Force";
+      }
+      else if (effectType == GUID_Spring || effectType == GUID_Damper
+         || effectType == GUID_Inertia || effectType == GUID_Friction)
+      {
+         type = DIEFT_CONDITION;
+         name = L"Condition";
+      }
+      else
+      {
+         return DIERR_DEVICENOTREG;
+      }
+      ZeroMemory(info, sizeof(*info));
+      info->dwSize = sizeof(*info);
+      info->guid = effectType;
+      info->dwEffType = type;
+      info->dwStaticParams = DIEP_ALLPARAMS;
+      info->dwDynamicParams = DIEP_ALLPARAMS;
+      wcsncpy(info->tszName, name, MAX_PATH - 1);
+      return DI_OK;
+   }
+
+   DWORD GetEffectLimit()
+   {
+      std::lock_guard<std::mutex> lock(m_pWheel->lock);
+      return m_pWheel->config.maxEffects;
+   }
+
+   HRESULT SetProperty(REFGUID property, const DIPROPHEADER* header)
+   {
+      std::lock_guard<std::mutex> lock(m_pWheel->lock);
+      SimulateLatency(m_pWheel->config.latencyMicroseconds);
+      if (m_pWheel->IsLost(m_dwGeneration))
+      {
+         return DIERR_INPUTLOST;
+      }
+      if (&property == &DIPROP_AUTOCENTER)
+      {
+         m_pWheel->state.autoCenter = ((const DIPROPDWORD*)header)->dwData == DIPROPAUTOCENTER_ON;
+         return DI_OK;
+      }
+      if (&property == &DIPROP_BUFFERSIZE)
+      {
+         // Changing the size flushes the buffer, as reacquiring does.
+         m_pWheel->inputBufferSize = ((const DIPROPDWORD*)header)->dwData;
+         m_pWheel->inputBuffer.clear();
+         m_pWheel->inputBuffer.reserve(m_pWheel->inputBufferSize);
+         m_pWheel->bInputOverflow = false;
+         return DI_OK;
+      }
+      return DIERR_UNSUPPORTED;
+   }
+
+   HRESULT GetState(DIJOYSTATE* state)
+   {
+      std::lock_guard<std::mutex> lock(m_pWheel->lock);
+      SimulateLatency(m_pWheel->config.latencyMicroseconds);
+      if (m_pWheel->IsLost(m_dwGeneration))
+      {
+         return DIERR_INPUTLOST;
+      }
+      m_pWheel->Step();
+      ZeroMemory(state, sizeof(DIJOYSTATE));
+      LONG* axes = &state->lX;
+      for (int i = 0; i < m_pWheel->config.axisCount; i++)
+      {
+         axes[i] = m_pWheel->state.axisPosition[i];
+      }
+      memcpy(state->rgbButtons, m_pWheel->buttons, sizeof(state->rgbButtons));
+      return DI_OK;
+   }
+
+   HRESULT GetDeviceData(DIDEVICEOBJECTDATA* data, DWORD* count)
+   {
+      std::lock_guard<std::mutex> lock(m_pWheel->lock);
+      SimulateLatency(m_pWheel->config.latencyMicroseconds);
+      if (m_pWheel->IsLost(m_dwGeneration))
+      {
+         *count = 0;
+         return DIERR_INPUTLOST;
+      }
+      if (m_pWheel->inputBufferSize == 0)
+      {
+         *count = 0;
+         return DIERR_NOTBUFFERED;
+      }
+      m_pWheel->Step();
+      std::vector<DIDEVICEOBJECTDATA>& buffer = m_pWheel->inputBuffer;
+      DWORD taken = *count < (DWORD)buffer.size() ? *count : (DWORD)buffer.size();
+      if (taken > 0)
+      {
+         memcpy(data, &buffer[0], sizeof(DIDEVICEOBJECTDATA) * taken);
+         buffer.erase(buffer.begin(), buffer.begin() + taken);
+      }
+      *count = taken;
+      HRESULT hr = m_pWheel->bInputOverflow ? DI_BUFFEROVERFLOW : DI_OK;
+      m_pWheel->bInputOverflow = false;
+      return hr;
+   }
+
+   DWORD GetDataTime()
+   {
+      return SimulatedDataTime();
+   }
+
+private:
+   SimulatedWheel* m_pWheel;
+   DWORD m_dwGeneration;
+};
+
+class SimulatedBackend;
+static SimulatedBackend* s_pSimBackend = NULL;
+static std::mutex s_simLock;
+
+class SimulatedBackend : public FFBBackend
+{
+public:
+   SimulatedBackend(const SimulatedDeviceConfig& config) :
+      m_deviceChangeCallback(NULL),
+      m_pDeviceChangeContext(NULL)
+   {
+      for (int i = 0; i < config.deviceCount; i++)
+      {
+         SimulatedWheel* pWheel = new SimulatedWheel();
+         pWheel->attached = true;
+         pWheel->generation = 0;
+         pWheel->config = config;
+         ZeroMemory(&pWheel->state, sizeof(pWheel->state));
+         pWheel->state.autoCenter = TRUE;
+         for (int axis = 0; axis < SIM_MAX_AXES; axis++)
+         {
+            pWheel->position[axis] = (SIM_AXIS_MIN + SIM_AXIS_MAX) / 2;
+            pWheel->velocity[axis] = 0;
+            pWheel->state.axisPosition[axis] = (LONG)pWheel->position[axis];
+         }
+         pWheel->lastStep = std::chrono::steady_clock::now();
+         ZeroMemory(pWheel->buttons, sizeof(pWheel->buttons));
+         pWheel->inputBufferSize = 0;
+         pWheel->bInputOverflow = false;
+         pWheel->inputSequence = 0;
+         m_vWheels.push_back(pWheel);
+      }
+   }
+
+   ~SimulatedBackend()
+   {
+      {
+         std::lock_guard<std::mutex> lock(s_simLock);
+         if (s_pSimBackend == this)
+         {
+            s_pSimBackend = NULL;
+         }
+      }
+      for (SimulatedWheel* pWheel : m_vWheels)
+      {
+         delete pWheel;
+      }
+   }
+
+   HRESULT EnumDevices(LPDIENUMDEVICESCALLBACK callback, void* context)
+   {
+      DIDEVICEINSTANCE inst;
+      if (!m_vWheels.empty())
+      {
+         DWORD enumerationMicroseconds;
+         {
+            std::lock_guard<std::mutex> lock(m_vWheels[0]->lock);
+            enumerationMicroseconds = m_vWheels[0]->config.enumerationMicroseconds;
+         }
+         SimulateEnumeration(enumerationMicroseconds);
+      }
+      for (int i = 0; i < (int)m_vWheels.size(); i++)
+      {
+         {
+            std::lock_guard<std::mutex> lock(m_vWheels[i]->lock);
+            if (!m_vWheels[i]->attached)
+            {
+               continue;
+            }
+         }
+         SimulateLatency(m_vWheels[i]->config.latencyMicroseconds);
+         ZeroMemory(&inst, sizeof(inst));
+         inst.dwSize = sizeof(inst);
+         inst.guidInstance = SimulatedInstanceGuid(i);
+         inst.guidProduct = s_simProductGuid;
+         inst.dwDevType = DI8DEVTYPE_DRIVING;
+         swprintf(inst.tszInstanceName, MAX_PATH, L"Simulated Wheel %d", i + 1);
+         swprintf(inst.tszProductName, MAX_PATH, L"Simulated Wheel");
+         if (callback(&inst, context) == DIENUM_STOP)
+         {
+            break;
+         }
+      }
+      return DI_OK;
+   }
+
+   HRESULT CreateDevice(REFGUID guidInstance, FFBDevice** ppDevice)
+   {
+      for (int i = 0; i < (int)m_vWheels.size(); i++)
+      {
+         if (SimulatedInstanceGuid(i) == guidInstance)
+         {
+            std::lock_guard<std::mutex> lock(m_vWheels[i]->lock);
+            if (!m_vWheels[i]->attached)
+            {
+               return DIERR_DEVICENOTREG;
+            }
+            SimulateLatency(m_vWheels[i]->config.latencyMicroseconds);
+            *ppDevice = new SimulatedDevice(m_vWheels[i], m_vWheels[i]->generation);
+            return DI_OK;
+         }
+      }
+      return DIERR_DEVICENOTREG;
+   }
+
+   SimulatedWheel* GetWheel(int index)
+   {
+      if (index < 0 || index >= (int)m_vWheels.size())
+      {
+         return NULL;
+      }
+      return m_vWheels[index];
+   }
+
+   void SetDeviceChangeCallback(DeviceChangeCallback callback, void* context)
+   {
+      std::lock_guard<std::mutex> lock(m_deviceChangeLock);
+      m_deviceChangeCallback = callback;
+      m_pDeviceChangeContext = context;
+   }
+
+   void NotifyDeviceChange()
+   {
+      std::lock_guard<std::mutex> lock(m_deviceChangeLock);
+      if (m_deviceChangeCallback != NULL)
+      {
+         m_deviceChangeCallback(m_pDeviceChangeContext);
+      }
+   }
+
+private:
+   std::vector<SimulatedWheel*> m_vWheels;
+
+   std::mutex m_deviceChangeLock;
+   DeviceChangeCallback m_deviceChangeCallback;
+   void* m_pDeviceChangeContext;
+};
+
+HRESULT CreateSimulatedBackend(FFBBackend** ppBackend)
+{
+   std::lock_guard<std::mutex> lock(s_simLock);
+   s_pSimBackend = new SimulatedBackend(s_simConfig);
+   *ppBackend = s_pSimBackend;
+   return S_OK;
+}
+
+/**
+ * Configure the wheel(s) modelled by the simulated backend. The device and
+ * axis counts and the effect limit take effect on the next StartDirectInput,
+ * latency, enumeration and download delays and drop behaviour also apply to
+ * already created wheels.
+ */
+HRESULT ConfigureSimulatedDevice(const SimulatedDeviceConfig* config)
+{
+   if (config == NULL)
+   {
+      return E_POINTER;
+   }
+   if (config->deviceCount < 1 || config->axisCount < 1 || config->axisCount > SIM_MAX_AXES
+      || config->maxForce == 0 || config->maxForce > DI_FFNOMINALMAX)
+   {
+      return E_INVALIDARG;
+   }
+
+   std::lock_guard<std::mutex> lock(s_simLock);
+   s_simConfig = *config;
+   if (s_pSimBackend != NULL)
+   {
+      for (int i = 0; SimulatedWheel* pWheel = s_pSimBackend->GetWheel(i); i++)
+      {
+         std::lock_guard<std::mutex> wheelLock(pWheel->lock);
+         pWheel->config.latencyMicroseconds = config->latencyMicroseconds;
+         pWheel->config.dropEveryN = config->dropEveryN;
+         pWheel->config.physicsStepMicroseconds = config->physicsStepMicroseconds;
+         pWheel->config.enumerationMicroseconds = config->enumerationMicroseconds;
+         pWheel->config.downloadMicroseconds = config->downloadMicroseconds;
+         pWheel->config.sampleBytesPerMillisecond = config->sampleBytesPerMillisecond;
+         pWheel->config.firmwareUpdateHz = config->firmwareUpdateHz;
+      }
+   }
+   return S_OK;
+}
+
+/**
+ * Read back what the simulated wheel at deviceIndex (enumeration order)
+ * has received and the force it is currently producing.
+ */
+HRESULT GetSimulatedDeviceState(int deviceIndex, SimulatedDeviceState* state)
+{
+   if (state == NULL)
+   {
+      return E_POINTER;
+   }
+
+   std::lock_guard<std::mutex> lock(s_simLock);
+   if (s_pSimBackend == NULL)
+   {
+      return E_FAIL;
+   }
+   SimulatedWheel* pWheel = s_pSimBackend->GetWheel(deviceIndex);
+   if (pWheel == NULL)
+   {
+      return E_BOUNDS;
+   }
+   std::lock_guard<std::mutex> wheelLock(pWheel->lock);
+   pWheel->Render();
+   *state = pWheel->state;
+   return S_OK;
+}
+
+/**
+ * The force the simulated wheel at deviceIndex produces elapsedMicroseconds
+ * after its effects were started, as if they all were started at once.
+ * force receives one value per axis, to check the waveforms the wheel plays
+ * without depending on when they were really started.
+ */
+HRESULT RenderSimulatedDeviceForce(int deviceIndex, DWORD elapsedMicroseconds, LONG* force)
+{
+   if (force == NULL)
+   {
+      return E_POINTER;
+   }
+
+   std::lock_guard<std::mutex> lock(s_simLock);
+   if (s_pSimBackend == NULL)
+   {
+      return E_FAIL;
+   }
+   SimulatedWheel* pWheel = s_pSimBackend->GetWheel(deviceIndex);
+   if (pWheel == NULL)
+   {
+      return E_BOUNDS;
+   }
+   std::lock_guard<std::mutex> wheelLock(pWheel->lock);
+   LONG output[SIM_MAX_AXES];
+   pWheel->RenderForce(elapsedMicroseconds, output);
+   memcpy(force, output, sizeof(LONG) * pWheel->config.axisCount);
+   return S_OK;
+}
+
+/**
+ * Move a simulated axis, e.g. to model the driver turning the wheel.
+ * The rim is left at rest at the new position.
+ */
+HRESULT SetSimulatedAxisPosition(int deviceIndex, int axis, LONG position)
+{
+   std::lock_guard<std::mutex> lock(s_simLock);
+   if (s_pSimBackend == NULL)
+   {
+      return E_FAIL;
+   }
+   SimulatedWheel* pWheel = s_pSimBackend->GetWheel(deviceIndex);
+   if (pWheel == NULL || axis < 0 || axis >= SIM_MAX_AXES || position < SIM_AXIS_MIN || position > SIM_AXIS_MAX)
+   {
+      return E_BOUNDS;
+   }
+   std::lock_guard<std::mutex> wheelLock(pWheel->lock);
+   pWheel->position[axis] = position;
+   pWheel->velocity[axis] = 0;
+   if (pWheel->state.axisPosition[axis] != position)
+   {
+      pWheel->state.axisPosition[axis] = position;
+      pWheel->BufferInput(s_simAxisOffsets[axis], (DWORD)position);
+   }
+   return S_OK;
+}
+
+/**
+ * Press or release a simulated button, e.g. a paddle shifter.
+ */
+HRESULT SetSimulatedButton(int deviceIndex, int button, bool pressed)
+{
+   std::lock_guard<std::mutex> lock(s_simLock);
+   if (s_pSimBackend == NULL)
+   {
+      return E_FAIL;
+   }
+   SimulatedWheel* pWheel = s_pSimBackend->GetWheel(deviceIndex);
+   if (pWheel == NULL || button < 0 || button >= 32)
+   {
+      return E_BOUNDS;
+   }
+   std::lock_guard<std::mutex> wheelLock(pWheel->lock);
+   BYTE value = pressed ? 0x80 : 0;
+   if (pWheel->buttons[button] != value)
+   {
+      pWheel->buttons[button] = value;
+      pWheel->BufferInput(DIJOFS_BUTTON(button), value);
+   }
+   return S_OK;
+}
+
+/**
+ * Give one simulated wheel its own driver latency, e.g. to model a slow
+ * device next to a fast one. Reset by the next ConfigureSimulatedDevice.
+ */
+HRESULT SetSimulatedDeviceLatency(int deviceIndex, DWORD latencyMicroseconds)
+{
+   std::lock_guard<std::mutex> lock(s_simLock);
+   if (s_pSimBackend == NULL)
+   {
+      return E_FAIL;
+   }
+   SimulatedWheel* pWheel = s_pSimBackend->GetWheel(deviceIndex);
+   if (pWheel == NULL)
+   {
+      return E_BOUNDS;
+   }
+   std::lock_guard<std::mutex> wheelLock(pWheel->lock);
+   pWheel->config.latencyMicroseconds = latencyMicroseconds;
+   return S_OK;
+}
+
+/**
+ * Give one simulated wheel its own firmwareUpdateHz, e.g. to model a wheel
+ * that takes fewer updates than the others. Reset by the next
+ * ConfigureSimulatedDevice.
+ */
+HRESULT SetSimulatedDeviceFirmwareRate(int deviceIndex, DWORD updateHz)
+{
+   std::lock_guard<std::mutex> lock(s_simLock);
+   if (s_pSimBackend == NULL)
+   {
+      return E_FAIL;
+   }
+   SimulatedWheel* pWheel = s_pSimBackend->GetWheel(deviceIndex);
+   if (pWheel == NULL)
+   {
+      return E_BOUNDS;
+   }
+   std::lock_guard<std::mutex> wheelLock(pWheel->lock);
+   pWheel->config.firmwareUpdateHz = updateHz;
+   return S_OK;
+}
+
+/**
+ * Plug a simulated wheel in or out, e.g. to script hot-plugging. A detached
+ * wheel is no longer enumerated and everything created for it fails with
+ * DIERR_INPUTLOST, also after it is attached again.
+ */
+HRESULT SetSimulatedDeviceAttached(int deviceIndex, bool attached)
+{
+   std::lock_guard<std::mutex> lock(s_simLock);
+   if (s_pSimBackend == NULL)
+   {
+      return E_FAIL;
+   }
+   SimulatedWheel* pWheel = s_pSimBackend->GetWheel(deviceIndex);
+   if (pWheel == NULL)
+   {
+      return E_BOUNDS;
+   }
+   {
+      std::lock_guard<std::mutex> wheelLock(pWheel->lock);
+      if (pWheel->attached == attached)
+      {
+         return S_FALSE;
+      }
+      pWheel->attached = attached;
+      if (attached)
+      {
+         pWheel->generation++;
+      }
+      // Lost effects no longer produce force.
+      pWheel->Render();
+   }
+   s_pSimBackend->NotifyDeviceChange();
+   return S_OK;
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include "pch.h"
+
+/**
+ * Backends hide the API used to talk to force feedback hardware from the
+ * exported functions. The DirectInput backend drives real devices on
+ * Windows, the simulated backend models a wheel in-process so the plugin
+ * can be run and measured without hardware (and on other platforms).
+ *
+ * The interfaces deliberately mirror the subset of IDirectInput8,
+ * IDirectInputDevice8 and IDirectInputEffect the plugin uses, and take the
+ * same DirectInput structures.
+ */
+
+class FFBEffect
+{
+public:
+   virtual ~FFBEffect() {}
+
+   virtual HRESULT SetParameters(const DIEFFECT* effect, DWORD flags) = 0;
+   virtual HRESULT Start(DWORD iterations, DWORD flags) = 0;
+   virtual HRESULT Stop() = 0;
+
+   /**
+    * Download the effect into the device's memory, with the parameters
+    * set with DIEP_NODOWNLOAD since. Start downloads it as well.
+    */
+   virtual HRESULT Download() = 0;
+};
+
+class FFBDevice
+{
+public:
+   virtual ~FFBDevice() {}
+
+   virtual HRESULT EnumAxes(LPDIENUMDEVICEOBJECTSCALLBACK callback, void* context) = 0;
+
+   /**
+    * Create an effect and download it. Without effect parameters nothing
+    * reaches the device until they are set and it is downloaded.
+    */
+   virtual HRESULT CreateEffect(REFGUID effectType, const DIEFFECT* effect, FFBEffect** ppEffect) = 0;
+
+   /**
+    * Whether the device can play effectType, fails if it cannot.
+    */
+   virtual HRESULT GetEffectInfo(REFGUID effectType, DIEFFECTINFO* info) = 0;
+
+   /**
+    * How many effects the device can hold at once, 0 if unknown.
+    */
+   virtual DWORD GetEffectLimit() = 0;
+   virtual HRESULT SetProperty(REFGUID property, const DIPROPHEADER* header) = 0;
+
+   /**
+    * Poll the device and read its current state (c_dfDIJoystick format).
+    */
+   virtual HRESULT GetState(DIJOYSTATE* state) = 0;
+
+   /**
+    * Poll the device and take up to *count buffered changes, oldest first,
+    * *count is set to how many were taken. DI_BUFFEROVERFLOW if the device
+    * lost changes since the last call. Buffering is enabled by setting
+    * DIPROP_BUFFERSIZE.
+    */
+   virtual HRESULT GetDeviceData(DIDEVICEOBJECTDATA* data, DWORD* count) = 0;
+
+   /**
+    * Now on the millisecond clock GetDeviceData's timestamps are on.
+    */
+   virtual DWORD GetDataTime() = 0;
+};
+
+typedef void (*DeviceChangeCallback)(void* context);
+
+class FFBBackend
+{
+public:
+   virtual ~FFBBackend() {}
+
+   /**
+    * May also be called from the device monitor thread, concurrently with
+    * the game thread.
+    */
+   virtual HRESULT EnumDevices(LPDIENUMDEVICESCALLBACK callback, void* context) = 0;
+
+   /**
+    * Create, configure and acquire the device with the given instance guid.
+    * Exclusive access is required in order to perform force feedback.
+    */
+   virtual HRESULT CreateDevice(REFGUID guidInstance, FFBDevice** ppDevice) = 0;
+
+   /**
+    * Register a function called, from any thread, when devices may have
+    * been attached or removed. NULL unregisters it, once this returns the
+    * old callback is no longer running. Backends that cannot detect changes
+    * never call it.
+    */
+   virtual void SetDeviceChangeCallback(DeviceChangeCallback callback, void* context) = 0;
+};
+
+HRESULT CreateDirectInputBackend(FFBBackend** ppBackend);
+HRESULT CreateSimulatedBackend(FFBBackend** ppBackend);
@@ -0,0 +1,111 @@
+#pragma once
+#include "pch.h"
+#include "unity-ffb.h"
+#include <atomic>
+#include <string.h>
+
+/**
+ * The shared memory region a force source in another process, e.g. a
+ * vehicle model running its own physics loop, writes and AttachFFBBridge
+ * reads: one FFBBridgeLayout. The writer creates the region, fills in the
+ * header and then publishes frames without a lock (WriteBridgeFrame):
+ * frameSequence is odd while a frame is written and even once it is
+ * complete, a reader that sees it odd or changed around its copy retries
+ * (ReadBridgeFrame). heartbeat is advanced every writer tick, frame or
+ * not, so a reader can tell a writer holding its force from a dead one.
+ *
+ * Both sides run on the same machine, native byte order. A change to the
+ * layout needs a new version, a reader ignores regions of another version.
+ */
+#define FFB_BRIDGE_MAGIC      0x42424646   // "FFBB"
+#define FFB_BRIDGE_VERSION    1
+// Copies ReadBridgeFrame tries before it gives up until the next read.
+#define FFB_BRIDGE_READ_ATTEMPTS   4
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+   "The bridge counters are shared between processes");
+
+struct FFBBridgeFrame {
+   // Per axis, in DirectInput units like a keyframe.
+   float force[MAX_FFB_AXES];
+};
+
+struct FFBBridgeLayout {
+   uint32_t magic;
+   uint32_t version;
+   // sizeof(FFBBridgeLayout) of the writer.
+   uint32_t size;
+   uint32_t reserved;
+   // Kept on their own cache lines, the writer stores them at its rate.
+   alignas(64) std::atomic<uint32_t> frameSequence;
+   FFBBridgeFrame frame;
+   alignas(64) std::atomic<uint64_t> heartbeat;
+};
+
+static inline bool IsValidBridge(const FFBBridgeLayout* layout)
+{
+   return layout->magic == FFB_BRIDGE_MAGIC && layout->version == FFB_BRIDGE_VERSION
+      && layout->size >= sizeof(FFBBridgeLayout);
+}
+
+/**
+ * Set up a region just created, before the first frame. The header goes
+ * out last so a reader never takes a half written region for valid.
+ */
+static inline void InitBridge(FFBBridgeLayout* layout)
+{
+   layout->magic = 0;
+   std::atomic_thread_fence(std::memory_order_release);
+   memset(&layout->frame, 0, sizeof(layout->frame));
+   layout->version = FFB_BRIDGE_VERSION;
+   layout->size = sizeof(FFBBridgeLayout);
+   layout->reserved = 0;
+   std::atomic_thread_fence(std::memory_order_release);
+   layout->magic = FFB_BRIDGE_MAGIC;
+}
+
+/**
+ * Publish a frame and a heartbeat. Only one writer.
+ */
+static inline void WriteBridgeFrame(FFBBridgeLayout* layout, const FFBBridgeFrame& frame)
+{
+   uint32_t sequence = layout->frameSequence.load(std::memory_order_relaxed);
+   layout->frameSequence.store(sequence + 1, std::memory_order_relaxed);
+   std::atomic_thread_fence(std::memory_order_release);
+   memcpy(&layout->frame, &frame, sizeof(frame));
+   layout->frameSequence.store(sequence + 2, std::memory_order_release);
+   layout->heartbeat.fetch_add(1, std::memory_order_release);
+}
+
+/**
+ * Tell readers the writer is alive without a new frame, its last frame
+ * still holds.
+ */
+static inline void WriteBridgeHeartbeat(FFBBridgeLayout* layout)
+{
+   layout->heartbeat.fetch_add(1, std::memory_order_release);
+}
+
+/**
+ * Copy the latest complete frame and its sequence number, false if every
+ * attempt caught the writer mid frame. torn counts those attempts.
+ */
+static inline bool ReadBridgeFrame(const FFBBridgeLayout* layout, FFBBridgeFrame& frame, uint32_t& sequence, DWORD& torn)
+{
+   for (int attempt = 0; attempt < FFB_BRIDGE_READ_ATTEMPTS; attempt++)
+   {
+      uint32_t before = layout->frameSequence.load(std::memory_order_acquire);
+      if ((before & 1) == 0)
+      {
+         memcpy(&frame, (const void*)&layout->frame, sizeof(frame));
+         std::atomic_thread_fence(std::memory_order_acquire);
+         if (layout->frameSequence.load(std::memory_order_relaxed) == before)
+         {
+            sequence = before;
+            return true;
+         }
+      }
+      torn++;
+   }
+   return false;
+}
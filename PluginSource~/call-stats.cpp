@@ -0,0 +1,119 @@
+#include "pch.h"
+#include "call-stats.h"
+#include <chrono>
+#include <thread>
+
+#ifndef UNITYFFB_NO_STATS
+
+CallStats g_callStats[FFB_STAT_CALL_COUNT];
+
+typedef std::chrono::steady_clock StatClock;
+
+// Where the tick rate is measured from.
+static const uint64_t s_originTicks = StatTicks();
+static const StatClock::time_point s_originTime = StatClock::now();
+
+double StatNanosecondsPerTick()
+{
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+   // A short baseline would make the rate inaccurate.
+   std::this_thread::sleep_until(s_originTime + std::chrono::milliseconds(10));
+   uint64_t ticks = StatTicks() - s_originTicks;
+   double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(StatClock::now() - s_originTime).count();
+   return ticks > 0 ? ns / ticks : 1.0;
+#else
+   return 1.0;
+#endif
+}
+
+// floor(log2(ticks)), 0 for 0.
+static inline int HistogramBucket(uint64_t ticks)
+{
+#ifdef _MSC_VER
+   unsigned long bucket;
+   _BitScanReverse64(&bucket, ticks | 1);
+#else
+   int bucket = 63 - __builtin_clzll(ticks | 1);
+#endif
+   return (int)bucket < FFB_STAT_BUCKETS ? (int)bucket : FFB_STAT_BUCKETS - 1;
+}
+
+CallStats::CallStats()
+{
+   Reset();
+}
+
+void CallStats::Record(HRESULT hr, uint64_t ticks)
+{
+   m_histogram[HistogramBucket(ticks)].fetch_add(1, std::memory_order_relaxed);
+   m_totalTicks.fetch_add(ticks, std::memory_order_relaxed);
+   uint64_t max = m_maxTicks.load(std::memory_order_relaxed);
+   while (ticks > max && !m_maxTicks.compare_exchange_weak(max, ticks, std::memory_order_relaxed))
+   {
+   }
+   if (FAILED(hr))
+   {
+      RecordFailure(hr);
+   }
+}
+
+void CallStats::RecordFailure(HRESULT hr)
+{
+   m_failures.fetch_add(1, std::memory_order_relaxed);
+   for (int i = 0; i < FFB_STAT_RESULTS; i++)
+   {
+      HRESULT result = m_results[i].load(std::memory_order_relaxed);
+      if (result == S_OK && m_results[i].compare_exchange_strong(result, hr, std::memory_order_relaxed))
+      {
+         result = hr;
+      }
+      if (result == hr)
+      {
+         m_resultCounts[i].fetch_add(1, std::memory_order_relaxed);
+         return;
+      }
+   }
+   m_otherFailures.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * Copy the counters. Not a consistent snapshot while calls are recorded,
+ * each counter is exact but they may be from slightly different moments.
+ */
+void CallStats::Read(FFBCallStats& stats, double nanosecondsPerTick) const
+{
+   stats.calls = 0;
+   for (int i = 0; i < FFB_STAT_BUCKETS; i++)
+   {
+      stats.histogram[i] = m_histogram[i].load(std::memory_order_relaxed);
+      stats.calls += stats.histogram[i];
+   }
+   stats.totalNanoseconds = (uint64_t)(m_totalTicks.load(std::memory_order_relaxed) * nanosecondsPerTick);
+   stats.maxNanoseconds = (uint64_t)(m_maxTicks.load(std::memory_order_relaxed) * nanosecondsPerTick);
+   stats.failures = m_failures.load(std::memory_order_relaxed);
+   stats.otherFailures = m_otherFailures.load(std::memory_order_relaxed);
+   for (int i = 0; i < FFB_STAT_RESULTS; i++)
+   {
+      stats.results[i].result = m_results[i].load(std::memory_order_relaxed);
+      stats.results[i].count = m_resultCounts[i].load(std::memory_order_relaxed);
+   }
+}
+
+void CallStats::Reset()
+{
+   for (int i = 0; i < FFB_STAT_BUCKETS; i++)
+   {
+      m_histogram[i] = 0;
+   }
+   m_totalTicks = 0;
+   m_maxTicks = 0;
+   m_failures = 0;
+   m_otherFailures = 0;
+   for (int i = 0; i < FFB_STAT_RESULTS; i++)
+   {
+      m_results[i] = S_OK;
+      m_resultCounts[i] = 0;
+   }
+}
+
+#endif
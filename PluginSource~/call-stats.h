@@ -0,0 +1,85 @@
+#pragma once
+#include "pch.h"
+#include "unity-ffb.h"
+#include <atomic>
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+/**
+ * Always on call statistics: a count, a log2 latency histogram and failure
+ * counts by HRESULT for every exported function and driver call listed in
+ * FFBStatCalls. Recording reads the time stamp counter twice and makes two
+ * relaxed atomic increments, so any thread can record without locking.
+ *
+ * Define UNITYFFB_NO_STATS to compile the instrumentation out entirely,
+ * FFB_STAT_CALL then evaluates to the bare call.
+ */
+#ifndef UNITYFFB_NO_STATS
+
+/**
+ * The clock calls are timed with. The time stamp counter where there is
+ * one, it is several times cheaper to read than the OS clocks, otherwise
+ * nanoseconds.
+ */
+inline uint64_t StatTicks()
+{
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+   return __rdtsc();
+#else
+   return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Measured against the OS clock since the plugin was loaded.
+double StatNanosecondsPerTick();
+
+class CallStats
+{
+public:
+   CallStats();
+
+   void Record(HRESULT hr, uint64_t ticks);
+   void Read(FFBCallStats& stats, double nanosecondsPerTick) const;
+   void Reset();
+
+private:
+   void RecordFailure(HRESULT hr);
+
+   // The call count is the histogram's sum.
+   std::atomic<uint32_t> m_histogram[FFB_STAT_BUCKETS];
+   std::atomic<uint64_t> m_totalTicks;
+   std::atomic<uint64_t> m_maxTicks;
+   std::atomic<uint32_t> m_failures;
+   std::atomic<uint32_t> m_otherFailures;
+   // A result slot is claimed by the first failure with its HRESULT.
+   std::atomic<HRESULT> m_results[FFB_STAT_RESULTS];
+   std::atomic<uint32_t> m_resultCounts[FFB_STAT_RESULTS];
+};
+
+extern CallStats g_callStats[FFB_STAT_CALL_COUNT];
+
+template <typename Call>
+inline HRESULT TimeCall(FFBStatCalls::Type call, Call run)
+{
+   uint64_t start = StatTicks();
+   HRESULT hr = run();
+   g_callStats[call].Record(hr, StatTicks() - start);
+   return hr;
+}
+
+/**
+ * Time a call returning an HRESULT and count its result, evaluates to it.
+ */
+#define FFB_STAT_CALL(call, expr)   TimeCall(call, [&]() -> HRESULT { return (expr); })
+
+#else
+
+#define FFB_STAT_CALL(call, expr)   (expr)
+
+#endif
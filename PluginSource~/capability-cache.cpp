@@ -0,0 +1,436 @@
+#include "pch.h"
+#include "capability-cache.h"
+#include "call-stats.h"
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+static_assert(sizeof(FFBCapabilityCacheHeader) == 24, "FFBCapabilityCacheHeader is part of the file format");
+
+// Update latency is only rewritten when it moved by more than this share,
+// so measuring it every session does not rewrite the file every session.
+static const float LATENCY_TOLERANCE = 0.2f;
+
+static uint32_t Fnv1a(const BYTE* data, size_t bytes)
+{
+   uint32_t hash = 2166136261u;
+   for (size_t i = 0; i < bytes; i++)
+   {
+      hash = (hash ^ data[i]) * 16777619u;
+   }
+   return hash;
+}
+
+const char* SnapshotString(const FFBEnumSnapshot* snapshot, DWORD offset)
+{
+   return (const char*)snapshot + snapshot->stringOffset + offset;
+}
+
+static const FFBCapabilityRecord* CapabilityRecordAt(const FFBEnumSnapshot* cache, DWORD index)
+{
+   return (const FFBCapabilityRecord*)((const BYTE*)cache + cache->recordOffset + index * cache->recordSize);
+}
+
+const FFBCapabilityRecord* FindCapabilityRecord(const FFBEnumSnapshot* cache, REFGUID guidInstance)
+{
+   if (cache == NULL)
+   {
+      return NULL;
+   }
+   for (DWORD i = 0; i < cache->recordCount; i++)
+   {
+      const FFBCapabilityRecord* record = CapabilityRecordAt(cache, i);
+      if (record->guidInstance == guidInstance)
+      {
+         return record;
+      }
+   }
+   return NULL;
+}
+
+void AddCachedDevices(const FFBEnumSnapshot* cache, EnumSnapshot<FFBDeviceRecord>& devices)
+{
+   for (DWORD i = 0; cache != NULL && i < cache->recordCount; i++)
+   {
+      const FFBCapabilityRecord* record = CapabilityRecordAt(cache, i);
+      FFBDeviceRecord& device = devices.Add();
+      device.guidInstance = record->guidInstance;
+      device.guidProduct = record->guidProduct;
+      device.deviceType = record->deviceType;
+      device.instanceName = devices.AddString(SnapshotString(cache, record->instanceName));
+      device.productName = devices.AddString(SnapshotString(cache, record->productName));
+   }
+}
+
+CapabilityCache::CapabilityCache() :
+   m_pSnapshot(NULL),
+   m_bLoaded(false),
+   m_loadMilliseconds(0),
+   m_bDirty(false),
+   m_hrSave(S_OK),
+   m_nHits(0),
+   m_nMisses(0),
+   m_pCheckBackend(NULL),
+   m_bDeviceCheckDone(false),
+   m_hrDeviceCheck(S_OK),
+   m_bDevicesChanged(false)
+{
+}
+
+CapabilityCache::~CapabilityCache()
+{
+   StopDeviceCheck();
+}
+
+HRESULT CapabilityCache::Open(LPCSTR path)
+{
+   if (path == NULL)
+   {
+      return E_POINTER;
+   }
+   m_path = path;
+   Clock::time_point start = Clock::now();
+   m_bLoaded = Load();
+   m_loadMilliseconds = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+   return m_bLoaded ? S_OK : S_FALSE;
+}
+
+/**
+ * Map the file and check it thoroughly enough that reading any record or
+ * string of it cannot go past its end.
+ */
+bool CapabilityCache::Load()
+{
+   m_pSnapshot = NULL;
+   if (!m_file.Open(m_path.c_str()))
+   {
+      return false;
+   }
+
+   FFBCapabilityCacheHeader header;
+   const BYTE* pData = m_file.Data();
+   size_t size = m_file.Size();
+   bool valid = size >= sizeof(header) + sizeof(FFBEnumSnapshot);
+   if (valid)
+   {
+      memcpy(&header, pData, sizeof(header));
+      valid = header.magic == FFB_CAPABILITY_CACHE_MAGIC
+         && header.version == FFB_CAPABILITY_CACHE_VERSION
+         && header.recordSize == sizeof(FFBCapabilityRecord)
+         && header.snapshotSize == size - sizeof(header)
+         && header.checksum == Fnv1a(pData + sizeof(header), header.snapshotSize);
+   }
+
+   const FFBEnumSnapshot* snapshot = (const FFBEnumSnapshot*)(pData + sizeof(header));
+   if (valid)
+   {
+      valid = snapshot->size == header.snapshotSize
+         && snapshot->recordSize == sizeof(FFBCapabilityRecord)
+         && snapshot->recordOffset >= sizeof(FFBEnumSnapshot)
+         && snapshot->recordOffset <= snapshot->size
+         && snapshot->recordCount <= (snapshot->size - snapshot->recordOffset) / snapshot->recordSize
+         && snapshot->stringOffset >= snapshot->recordOffset + snapshot->recordCount * snapshot->recordSize
+         && snapshot->stringOffset <= snapshot->size
+         && snapshot->stringBytes == snapshot->size - snapshot->stringOffset
+         && (snapshot->stringBytes == 0 || SnapshotString(snapshot, 0)[snapshot->stringBytes - 1] == 0);
+   }
+   for (DWORD i = 0; valid && i < snapshot->recordCount; i++)
+   {
+      const FFBCapabilityRecord* record = CapabilityRecordAt(snapshot, i);
+      valid = record->axisCount <= MAX_FFB_AXES
+         && record->instanceName < snapshot->stringBytes
+         && record->productName < snapshot->stringBytes;
+      for (DWORD axis = 0; valid && axis < record->axisCount; axis++)
+      {
+         valid = record->axes[axis].name < snapshot->stringBytes;
+      }
+   }
+
+   if (!valid)
+   {
+      m_file.Close();
+      return false;
+   }
+   m_pSnapshot = snapshot;
+   return true;
+}
+
+const FFBCapabilityRecord* CapabilityCache::Find(REFGUID guidInstance) const
+{
+   return FindCapabilityRecord(m_pSnapshot, guidInstance);
+}
+
+const CapabilityEntry* CapabilityCache::FindUpdate(REFGUID guidInstance) const
+{
+   for (const CapabilityEntry& entry : m_vUpdates)
+   {
+      if (entry.record.guidInstance == guidInstance)
+      {
+         return &entry;
+      }
+   }
+   return NULL;
+}
+
+bool CapabilityCache::IsRemoved(REFGUID guidInstance) const
+{
+   for (const GUID& removed : m_vRemoved)
+   {
+      if (removed == guidInstance)
+      {
+         return true;
+      }
+   }
+   return false;
+}
+
+bool CapabilityCache::Matches(const CapabilityEntry& entry, const FFBCapabilityRecord& record) const
+{
+   const FFBCapabilityRecord& updated = entry.record;
+   if (updated.guidProduct != record.guidProduct
+      || updated.deviceType != record.deviceType
+      || updated.effectTypes != record.effectTypes
+      || updated.maxEffects != record.maxEffects
+      || updated.axisCount != record.axisCount
+      || entry.instanceName != SnapshotString(m_pSnapshot, record.instanceName)
+      || entry.productName != SnapshotString(m_pSnapshot, record.productName))
+   {
+      return false;
+   }
+   for (DWORD i = 0; i < record.axisCount; i++)
+   {
+      if (memcmp(&updated.axes[i], &record.axes[i], offsetof(FFBAxisRecord, name)) != 0
+         || entry.axisNames[i] != SnapshotString(m_pSnapshot, record.axes[i].name))
+      {
+         return false;
+      }
+   }
+   float latency = record.updateLatencyMicroseconds;
+   return fabsf(updated.updateLatencyMicroseconds - latency) <= latency * LATENCY_TOLERANCE;
+}
+
+void CapabilityCache::Update(const CapabilityEntry& entry)
+{
+   const GUID& guidInstance = entry.record.guidInstance;
+   for (size_t i = 0; i < m_vRemoved.size(); i++)
+   {
+      if (m_vRemoved[i] == guidInstance)
+      {
+         // It was opened, so it is attached after all.
+         m_vRemoved.erase(m_vRemoved.begin() + i);
+         break;
+      }
+   }
+
+   const FFBCapabilityRecord* cached = Find(guidInstance);
+   for (CapabilityEntry& update : m_vUpdates)
+   {
+      if (update.record.guidInstance == guidInstance)
+      {
+         update = entry;
+         m_bDirty = true;
+         return;
+      }
+   }
+   if (cached != NULL && Matches(entry, *cached))
+   {
+      return;
+   }
+   m_vUpdates.push_back(entry);
+   m_bDirty = true;
+}
+
+void CapabilityCache::CountOpen(bool hit)
+{
+   if (hit)
+   {
+      m_nHits++;
+   }
+   else
+   {
+      m_nMisses++;
+   }
+}
+
+static HRESULT WriteCacheFile(const std::string& path, const FFBCapabilityCacheHeader& header, const FFBEnumSnapshot* snapshot)
+{
+   FILE* pFile;
+#ifdef _MSC_VER
+   if (fopen_s(&pFile, path.c_str(), "wb") != 0)
+   {
+      pFile = NULL;
+   }
+#else
+   pFile = fopen(path.c_str(), "wb");
+#endif
+   if (pFile == NULL)
+   {
+      return E_FAIL;
+   }
+   bool written = fwrite(&header, sizeof(header), 1, pFile) == 1
+      && fwrite(snapshot, snapshot->size, 1, pFile) == 1;
+   written = fclose(pFile) == 0 && written;
+   return written ? S_OK : E_FAIL;
+}
+
+HRESULT CapabilityCache::Save()
+{
+   CollectDeviceCheck();
+   if (!m_bDirty)
+   {
+      return S_FALSE;
+   }
+
+   // The devices updated this session, then the cached ones that were not.
+   EnumSnapshot<FFBCapabilityRecord> snapshot;
+   snapshot.Begin();
+   for (const CapabilityEntry& entry : m_vUpdates)
+   {
+      FFBCapabilityRecord& record = snapshot.Add();
+      record = entry.record;
+      record.instanceName = snapshot.AddString(entry.instanceName.c_str());
+      record.productName = snapshot.AddString(entry.productName.c_str());
+      for (DWORD i = 0; i < record.axisCount; i++)
+      {
+         record.axes[i].name = snapshot.AddString(entry.axisNames[i].c_str());
+      }
+   }
+   for (DWORD i = 0; m_pSnapshot != NULL && i < m_pSnapshot->recordCount; i++)
+   {
+      const FFBCapabilityRecord* cached = CapabilityRecordAt(m_pSnapshot, i);
+      if (FindUpdate(cached->guidInstance) != NULL || IsRemoved(cached->guidInstance))
+      {
+         continue;
+      }
+      FFBCapabilityRecord& record = snapshot.Add();
+      record = *cached;
+      record.instanceName = snapshot.AddString(SnapshotString(m_pSnapshot, cached->instanceName));
+      record.productName = snapshot.AddString(SnapshotString(m_pSnapshot, cached->productName));
+      for (DWORD axis = 0; axis < record.axisCount; axis++)
+      {
+         record.axes[axis].name = snapshot.AddString(SnapshotString(m_pSnapshot, cached->axes[axis].name));
+      }
+   }
+   const FFBEnumSnapshot* pSnapshot = snapshot.Finish();
+
+   FFBCapabilityCacheHeader header;
+   header.magic = FFB_CAPABILITY_CACHE_MAGIC;
+   header.version = FFB_CAPABILITY_CACHE_VERSION;
+   header.recordSize = sizeof(FFBCapabilityRecord);
+   header.snapshotSize = pSnapshot->size;
+   header.checksum = Fnv1a((const BYTE*)pSnapshot, pSnapshot->size);
+   header.reserved = 0;
+
+   // Written aside and renamed over the old file, so a crash halfway never
+   // leaves half a cache. The old one has to be unmapped to be replaced.
+   std::string temporary = m_path + ".tmp";
+   m_hrSave = WriteCacheFile(temporary, header, pSnapshot);
+   if (SUCCEEDED(m_hrSave))
+   {
+      m_pSnapshot = NULL;
+      m_file.Close();
+#ifdef _WIN32
+      m_hrSave = MoveFileExA(temporary.c_str(), m_path.c_str(), MOVEFILE_REPLACE_EXISTING) ? S_OK : E_FAIL;
+#else
+      m_hrSave = rename(temporary.c_str(), m_path.c_str()) == 0 ? S_OK : E_FAIL;
+#endif
+      m_bLoaded = Load();
+   }
+   if (FAILED(m_hrSave))
+   {
+      remove(temporary.c_str());
+      return m_hrSave;
+   }
+   m_vUpdates.clear();
+   m_vRemoved.clear();
+   m_bDirty = false;
+   return S_OK;
+}
+
+void CapabilityCache::StartDeviceCheck(FFBBackend* pBackend)
+{
+   if (m_deviceCheck.joinable())
+   {
+      return;
+   }
+   m_pCheckBackend = pBackend;
+   m_bDeviceCheckDone = false;
+   m_deviceCheck = std::thread(&CapabilityCache::CheckDevices, this);
+}
+
+void CapabilityCache::StopDeviceCheck()
+{
+   if (m_deviceCheck.joinable())
+   {
+      m_deviceCheck.join();
+   }
+   CollectDeviceCheck();
+}
+
+void CapabilityCache::CheckDevices()
+{
+   m_checkedDevices.Begin();
+   m_hrDeviceCheck = FFB_STAT_CALL(FFBStatCalls::Type::DriverEnumDevices, m_pCheckBackend->EnumDevices(_cbEnumFFBDevices, &m_checkedDevices));
+   m_bDeviceCheckDone.store(true, std::memory_order_release);
+}
+
+/**
+ * Once the device check finished, drop the cached devices it did not find
+ * and note whether there are devices the cache does not know.
+ */
+void CapabilityCache::CollectDeviceCheck()
+{
+   if (!m_bDeviceCheckDone.load(std::memory_order_acquire))
+   {
+      return;
+   }
+   if (m_deviceCheck.joinable())
+   {
+      m_deviceCheck.join();
+   }
+   m_bDeviceCheckDone = false;
+   if (FAILED(m_hrDeviceCheck))
+   {
+      return;
+   }
+
+   DWORD cachedCount = m_pSnapshot != NULL ? m_pSnapshot->recordCount : 0;
+   for (DWORD i = 0; i < cachedCount; i++)
+   {
+      const GUID& guidInstance = CapabilityRecordAt(m_pSnapshot, i)->guidInstance;
+      bool attached = false;
+      for (DWORD device = 0; device < m_checkedDevices.Count() && !attached; device++)
+      {
+         attached = m_checkedDevices[device].guidInstance == guidInstance;
+      }
+      if (!attached && !IsRemoved(guidInstance) && FindUpdate(guidInstance) == NULL)
+      {
+         m_vRemoved.push_back(guidInstance);
+         m_bDevicesChanged = true;
+         m_bDirty = true;
+      }
+   }
+   for (DWORD device = 0; device < m_checkedDevices.Count(); device++)
+   {
+      if (Find(m_checkedDevices[device].guidInstance) == NULL)
+      {
+         m_bDevicesChanged = true;
+      }
+   }
+}
+
+void CapabilityCache::GetStatus(FFBCapabilityCacheStatus& status)
+{
+   CollectDeviceCheck();
+   ZeroMemory(&status, sizeof(status));
+   status.enabled = TRUE;
+   status.loaded = m_bLoaded;
+   status.deviceCount = m_pSnapshot != NULL ? m_pSnapshot->recordCount : 0;
+   status.hits = m_nHits;
+   status.misses = m_nMisses;
+   status.devicesChanged = m_bDevicesChanged;
+   status.dirty = m_bDirty;
+   status.saveResult = m_hrSave;
+   status.loadMilliseconds = m_loadMilliseconds;
+}
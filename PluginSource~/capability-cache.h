@@ -0,0 +1,147 @@
+#pragma once
+#include "pch.h"
+#include "unity-ffb.h"
+#include "backend.h"
+#include "enum-snapshot.h"
+#include "mapped-file.h"
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#define FFB_CAPABILITY_CACHE_MAGIC    0x43424646   // "FFBC"
+#define FFB_CAPABILITY_CACHE_VERSION  1
+
+/**
+ * Start of a capability cache file, followed by an FFBEnumSnapshot of
+ * FFBCapabilityRecord's. A change to FFBCapabilityRecord or FFBAxisRecord
+ * needs a new version, files of another version are ignored and replaced
+ * on the next save.
+ */
+struct FFBCapabilityCacheHeader {
+   uint32_t magic;
+   uint32_t version;
+   uint32_t recordSize;
+   // Bytes of the snapshot after the header.
+   uint32_t snapshotSize;
+   // FNV-1a of the snapshot, a file cut short or damaged is ignored.
+   uint32_t checksum;
+   uint32_t reserved;
+};
+
+/**
+ * A device's capabilities with its strings, what the cache is updated with.
+ * The string offsets of the record are not used.
+ */
+struct CapabilityEntry {
+   FFBCapabilityRecord record;
+   std::string instanceName;
+   std::string productName;
+   std::string axisNames[MAX_FFB_AXES];
+};
+
+/**
+ * The record of guidInstance in a cache snapshot, NULL if there is none.
+ */
+const FFBCapabilityRecord* FindCapabilityRecord(const FFBEnumSnapshot* cache, REFGUID guidInstance);
+const char* SnapshotString(const FFBEnumSnapshot* snapshot, DWORD offset);
+
+/**
+ * Add the devices of a cache snapshot to an enumeration, as if they had
+ * been enumerated.
+ */
+void AddCachedDevices(const FFBEnumSnapshot* cache, EnumSnapshot<FFBDeviceRecord>& devices);
+
+/**
+ * Keeps what enumerating and probing a device found on disk, so the next
+ * start can skip it: the devices, their axes, the effect types they play,
+ * how many effects they hold and how long an update takes.
+ *
+ * The file is mapped and read in place, loading it costs a page fault or
+ * two. What is loaded is trusted at first and checked in the background:
+ * StartDeviceCheck enumerates the devices for real, and every device opened
+ * from the cache checks its own axes and effects (see FFBDeviceContext).
+ * Devices that differ or are gone are updated in the file on the next
+ * Save.
+ *
+ * Game thread only, apart from the device check's own thread.
+ */
+class CapabilityCache
+{
+public:
+   CapabilityCache();
+   ~CapabilityCache();
+
+   /**
+    * Map the file at path. S_FALSE if it does not exist or is not a valid
+    * cache, it is then written from scratch by Save.
+    */
+   HRESULT Open(LPCSTR path);
+
+   /**
+    * Write the file if anything changed since it was loaded, S_FALSE if
+    * nothing did. Remaps it, pointers into the old snapshot are invalid
+    * afterwards.
+    */
+   HRESULT Save();
+
+   /**
+    * The cached devices, NULL if nothing was loaded. Points into the mapped
+    * file, valid until the next Save.
+    */
+   const FFBEnumSnapshot* GetSnapshot() const { return m_pSnapshot; }
+   const FFBCapabilityRecord* Find(REFGUID guidInstance) const;
+
+   /**
+    * Replace what is cached for the entry's device, if it changed.
+    */
+   void Update(const CapabilityEntry& entry);
+
+   /**
+    * Count a device opened with (hit) or without its cached capabilities.
+    */
+   void CountOpen(bool hit);
+
+   /**
+    * Enumerate the devices on a thread of their own to find cached ones
+    * that are gone, after an enumeration was answered from the cache. The
+    * backend must outlive the check, StopDeviceCheck waits for it.
+    */
+   void StartDeviceCheck(FFBBackend* pBackend);
+   void StopDeviceCheck();
+
+   void GetStatus(FFBCapabilityCacheStatus& status);
+
+private:
+   typedef std::chrono::steady_clock Clock;
+
+   bool Load();
+   bool Matches(const CapabilityEntry& entry, const FFBCapabilityRecord& record) const;
+   bool IsRemoved(REFGUID guidInstance) const;
+   const CapabilityEntry* FindUpdate(REFGUID guidInstance) const;
+   void CheckDevices();
+   void CollectDeviceCheck();
+
+   std::string m_path;
+   MappedFile m_file;
+   const FFBEnumSnapshot* m_pSnapshot;
+   bool m_bLoaded;
+   float m_loadMilliseconds;
+
+   // Written by the next Save.
+   std::vector<CapabilityEntry> m_vUpdates;
+   std::vector<GUID> m_vRemoved;
+   bool m_bDirty;
+   HRESULT m_hrSave;
+
+   DWORD m_nHits;
+   DWORD m_nMisses;
+
+   // The check's thread owns these until m_bDeviceCheckDone.
+   FFBBackend* m_pCheckBackend;
+   std::thread m_deviceCheck;
+   std::atomic<bool> m_bDeviceCheckDone;
+   EnumSnapshot<FFBDeviceRecord> m_checkedDevices;
+   HRESULT m_hrDeviceCheck;
+   bool m_bDevicesChanged;
+};
@@ -0,0 +1,2651 @@
+#include "pch.h"
+#include "device-context.h"
+#include "util.h"
+#include "call-stats.h"
+#include <algorithm>
+#include <stddef.h>
+
+std::atomic<uint32_t> g_nCallsReceived(0);
+std::atomic<uint32_t> g_nCallsForwarded(0);
+std::atomic<uint32_t> g_nParameterBytesSent(0);
+
+// Period a periodic effect is created with, before its first update.
+static const DWORD DEFAULT_PERIOD_MICROSECONDS = 50000;
+
+// Duration a ramp is created with, it cannot have none.
+static const DWORD DEFAULT_RAMP_MICROSECONDS = 1000000;
+
+// What a CustomForce effect is created with and what the device is left
+// holding as far as the plugin knows once a chunk was uploaded: the
+// caller's samples are not kept, so Restore brings the effect back silent.
+static LONG s_customForceSilence[1] = { 0 };
+static const DICUSTOMFORCE s_silentCustomForce = { 1, 1000, 1, s_customForceSilence };
+
+static bool IsConditionEffect(Effects::Type effectType)
+{
+   return IsEffectKind(effectType, EffectKinds::Type::Condition);
+}
+
+static bool IsPeriodicEffect(Effects::Type effectType)
+{
+   return IsEffectKind(effectType, EffectKinds::Type::Periodic);
+}
+
+FFBDeviceContext::FFBDeviceContext(FFBDevice* pDevice, REFGUID guidInstance) :
+   m_pDevice(pDevice),
+   m_guidInstance(guidInstance),
+   m_bLost(false),
+   m_nAutoCenter(-1),
+   m_effects(DEFAULT_EFFECT_CAPACITY),
+   m_effectSlots(0),
+   m_nPoolHits(0),
+   m_nPoolMisses(0),
+   m_nPoolRecycled(0),
+   m_nEffectsCreated(0),
+   m_createMicrosecondsSum(0),
+   m_maxCreateMicroseconds(0),
+   m_poolFillMilliseconds(0),
+   m_lForceResolution(1),
+   m_bAxesCached(false),
+   m_bCapabilityCheckDone(false),
+   m_hrCapabilityCheck(S_OK),
+   m_nSetParameters(0),
+   m_nLatencySamples(0),
+   m_latencySumUs(0),
+   m_bSynthEnabled(false),
+   m_bSynthStepped(false),
+   m_bDspEnabled(false),
+   m_bDspPrimed(false),
+   m_bKeyframesEnabled(false),
+   m_bKeyframesPrimed(false),
+   m_bMixerEnabled(false),
+   m_bMixerPrimed(false),
+   m_bBridgeAttached(false),
+   m_bGovernedTick(false),
+   m_dwInputBufferSize(0)
+{
+   ZeroMemory(m_hTypeEffects, sizeof(m_hTypeEffects));
+   ZeroMemory(&m_poolConfig, sizeof(m_poolConfig));
+   ZeroMemory(&m_gameForce, sizeof(m_gameForce));
+   ZeroMemory(&m_capabilities, sizeof(m_capabilities));
+   ZeroMemory(&m_checkedCapabilities, sizeof(m_checkedCapabilities));
+   ZeroMemory(&m_deviceRecord, sizeof(m_deviceRecord));
+   DWORD limit = pDevice->GetEffectLimit();
+   if (limit != 0 && limit < (DWORD)DEFAULT_EFFECT_CAPACITY)
+   {
+      m_effects.SetCapacity(limit);
+   }
+   m_effectSlots.Grow(m_effects.Capacity());
+}
+
+/**
+ * Clean up the Force Feedback device and any effects. The input and output
+ * threads are stopped first, which flushes the last published targets.
+ */
+FFBDeviceContext::~FFBDeviceContext()
+{
+   if (m_capabilityCheck.joinable())
+   {
+      m_capabilityCheck.join();
+   }
+   StopInputCapture();
+   StopOutputThread();
+   std::lock_guard<std::mutex> lock(m_effectLock);
+   for (uint32_t i = 0; i < m_effects.Size(); i++) {
+      EffectSlot* pSlot = m_effects.At(i);
+      if (pSlot->pEffect != NULL) {
+         delete pSlot->pEffect;
+      }
+      m_effectSlots.Release(pSlot);
+   }
+   ReleaseEffectPool();
+   SAFE_DELETE(m_pDevice);
+}
+
+static BOOL CALLBACK _cbEnumFFBAxes(const DIDEVICEOBJECTINSTANCE* pdidoi, void* pContext)
+{
+   if ((pdidoi->dwFlags & DIDOI_FFACTUATOR) != 0)
+   {
+      EnumSnapshot<FFBAxisRecord>* snapshot = (EnumSnapshot<FFBAxisRecord>*)pContext;
+
+      FFBAxisRecord& axis = snapshot->Add();
+      axis.guidType = pdidoi->guidType;
+      axis.joystateOffset = GuidToDIJOFS(pdidoi->guidType);
+      axis.offset = pdidoi->dwOfs;
+      axis.type = pdidoi->dwType;
+      axis.flags = pdidoi->dwFlags;
+      axis.ffMaxForce = pdidoi->dwFFMaxForce;
+      axis.ffForceResolution = pdidoi->dwFFForceResolution;
+      axis.collectionNumber = pdidoi->wCollectionNumber;
+      axis.designatorIndex = pdidoi->wDesignatorIndex;
+      axis.usagePage = pdidoi->wUsagePage;
+      axis.usage = pdidoi->wUsage;
+      axis.dimension = pdidoi->dwDimension;
+      axis.exponent = pdidoi->wExponent;
+      axis.reportId = pdidoi->wReportId;
+      axis.name = snapshot->AddString(pdidoi->tszName);
+   }
+
+   return DIENUM_CONTINUE;
+}
+
+/**
+ * Enumerate the Force Feedback Axes of the device into one blittable
+ * snapshot (see FFBEnumSnapshot). For a steering wheel, there's typically
+ * only 1 axis. Effects are created on the axes of the last enumeration.
+ *
+ * The axes of a device opened from the capability cache are not
+ * enumerated, nor those of a device the capability check is probing
+ * anyway: its result is waited for instead.
+ */
+const FFBEnumSnapshot* FFBDeviceContext::EnumerateAxisSnapshot()
+{
+   bool probing = m_capabilityCheck.joinable() && !m_bAxesCached;
+   CollectCapabilityCheck(probing);
+   if (m_bAxesCached || (probing && SUCCEEDED(m_hrCapabilityCheck)))
+   {
+      return m_axisSnapshot.Get();
+   }
+
+   std::lock_guard<std::mutex> lock(m_effectLock);
+   m_axisSnapshot.Begin();
+   FFB_STAT_CALL(FFBStatCalls::Type::DriverEnumAxes, m_pDevice->EnumAxes(_cbEnumFFBAxes, (void*)&m_axisSnapshot));
+   UpdateForceResolution();
+   return m_axisSnapshot.Finish();
+}
+
+/**
+ * Take the smallest force step from the axes, m_effectLock must be held.
+ */
+void FFBDeviceContext::UpdateForceResolution()
+{
+   m_lForceResolution = 1;
+   for (DWORD i = 0; i < m_axisSnapshot.Count(); i++)
+   {
+      DWORD resolution = m_axisSnapshot[i].ffForceResolution;
+      if (resolution > (DWORD)m_lForceResolution && resolution < DI_FFNOMINALMAX)
+      {
+         m_lForceResolution = (LONG)resolution;
+      }
+   }
+}
+
+/**
+ * This function will return info about Force Feedback Axes associated with
+ * the device, as DeviceAxisInfo's pointing into the axis snapshot.
+ */
+DeviceAxisInfo* FFBDeviceContext::EnumerateAxes(int& axisCount)
+{
+   EnumerateAxisSnapshot();
+
+   axisCount = AxisCount();
+   m_vDeviceAxes.resize(axisCount);
+   m_vAxisGuids.resize(axisCount);
+   for (int i = 0; i < axisCount; i++)
+   {
+      const FFBAxisRecord& axis = m_axisSnapshot[i];
+      DeviceAxisInfo& dai = m_vDeviceAxes[i];
+
+      formatGuid(axis.guidType, m_vAxisGuids[i].text);
+      dai.guidType = m_vAxisGuids[i].text;
+      dai.name = (LPSTR)m_axisSnapshot.String(axis.name);
+      dai.offset = axis.offset;
+      dai.type = axis.type;
+      dai.flags = axis.flags;
+      dai.ffMaxForce = axis.ffMaxForce;
+      dai.ffForceResolution = axis.ffForceResolution;
+      dai.collectionNumber = axis.collectionNumber;
+      dai.designatorIndex = axis.designatorIndex;
+      dai.usagePage = axis.usagePage;
+      dai.usage = axis.usage;
+      dai.dimension = axis.dimension;
+      dai.exponent = axis.exponent;
+      dai.reportId = axis.reportId;
+   }
+   return axisCount > 0 ? &m_vDeviceAxes[0] : NULL;
+}
+
+/**
+ * The DirectInput effect GUID of an effect type, GUID_NULL for values
+ * that are none.
+ */
+static GUID EffectGuid(Effects::Type effectType)
+{
+   return effectType >= 0 && effectType < EFFECT_TYPE_COUNT ? *EFFECT_TYPES[effectType].guid : GUID_NULL;
+}
+
+void FFBDeviceContext::SetDeviceRecord(const FFBDeviceRecord& device, const char* instanceName, const char* productName)
+{
+   m_deviceRecord = device;
+   m_sInstanceName = instanceName;
+   m_sProductName = productName;
+}
+
+bool FFBDeviceContext::UseCapabilityCache(const FFBEnumSnapshot* cache)
+{
+   const FFBCapabilityRecord* record = FindCapabilityRecord(cache, m_guidInstance);
+   // Another product behind the same instance is a different device.
+   bool bHit = record != NULL && record->guidProduct == m_deviceRecord.guidProduct;
+   if (bHit)
+   {
+      SeedCapabilities(cache, *record);
+   }
+   if (!m_capabilityCheck.joinable())
+   {
+      m_bCapabilityCheckDone.store(false, std::memory_order_relaxed);
+      m_capabilityCheck = std::thread([this]() { CheckCapabilities(); });
+   }
+   return bHit;
+}
+
+void FFBDeviceContext::SeedCapabilities(const FFBEnumSnapshot* cache, const FFBCapabilityRecord& record)
+{
+   {
+      std::lock_guard<std::mutex> lock(m_effectLock);
+      m_axisSnapshot.Begin();
+      for (DWORD i = 0; i < record.axisCount && i < MAX_FFB_AXES; i++)
+      {
+         FFBAxisRecord& axis = m_axisSnapshot.Add();
+         axis = record.axes[i];
+         axis.name = m_axisSnapshot.AddString(SnapshotString(cache, record.axes[i].name));
+      }
+      m_axisSnapshot.Finish();
+      UpdateForceResolution();
+   }
+   m_bAxesCached = true;
+   m_capabilities.effectTypes = record.effectTypes;
+   m_capabilities.maxEffects = record.maxEffects;
+   m_capabilities.axisCount = m_axisSnapshot.Count();
+   m_capabilities.updateLatencyMicroseconds = record.updateLatencyMicroseconds;
+   m_capabilities.source = FFBCapabilitySources::Type::Cache;
+}
+
+/**
+ * Probe the device's axes and effect types, on the capability check's
+ * thread or, when nothing else knows them, on the caller's.
+ */
+void FFBDeviceContext::CheckCapabilities()
+{
+   FFBDeviceCapabilities& checked = m_checkedCapabilities;
+   ZeroMemory(&checked, sizeof(checked));
+   m_checkedAxes.Begin();
+   HRESULT hr = FFB_STAT_CALL(FFBStatCalls::Type::DriverEnumAxes, m_pDevice->EnumAxes(_cbEnumFFBAxes, (void*)&m_checkedAxes));
+   m_checkedAxes.Finish();
+   if (SUCCEEDED(hr))
+   {
+      for (int type = Effects::Type::ConstantForce; type <= Effects::Type::CustomForce; type++)
+      {
+         GUID guidEffect = EffectGuid((Effects::Type)type);
+         DIEFFECTINFO info;
+         info.dwSize = sizeof(info);
+         if (guidEffect != GUID_NULL && SUCCEEDED(m_pDevice->GetEffectInfo(guidEffect, &info)))
+         {
+            checked.effectTypes |= 1u << type;
+         }
+      }
+      checked.maxEffects = m_pDevice->GetEffectLimit();
+      checked.axisCount = m_checkedAxes.Count();
+   }
+   m_hrCapabilityCheck = hr;
+   m_bCapabilityCheckDone.store(true, std::memory_order_release);
+}
+
+/**
+ * Take over the result of the capability check once it finished, or wait
+ * for it.
+ */
+void FFBDeviceContext::CollectCapabilityCheck(bool wait)
+{
+   if (!m_capabilityCheck.joinable()
+      || (!wait && !m_bCapabilityCheckDone.load(std::memory_order_acquire)))
+   {
+      return;
+   }
+   m_capabilityCheck.join();
+   ApplyCapabilityCheck();
+}
+
+static bool SameAxes(const EnumSnapshot<FFBAxisRecord>& a, const EnumSnapshot<FFBAxisRecord>& b)
+{
+   if (a.Count() != b.Count())
+   {
+      return false;
+   }
+   for (DWORD i = 0; i < a.Count(); i++)
+   {
+      if (memcmp(&a[i], &b[i], offsetof(FFBAxisRecord, name)) != 0
+         || strcmp(a.String(a[i].name), b.String(b[i].name)) != 0)
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
+/**
+ * A failed check changes nothing. Otherwise cached capabilities are
+ * confirmed, or replaced by the device's when they differ: effects created
+ * since stay on the axes they were created on, those created from now on
+ * use the device's.
+ */
+void FFBDeviceContext::ApplyCapabilityCheck()
+{
+   if (FAILED(m_hrCapabilityCheck))
+   {
+      return;
+   }
+   FFBCapabilitySources::Type source = FFBCapabilitySources::Type::Device;
+   if (m_capabilities.source == FFBCapabilitySources::Type::Cache)
+   {
+      bool bSame = m_checkedCapabilities.effectTypes == m_capabilities.effectTypes
+         && m_checkedCapabilities.maxEffects == m_capabilities.maxEffects
+         && SameAxes(m_checkedAxes, m_axisSnapshot);
+      source = bSame ? FFBCapabilitySources::Type::Validated : FFBCapabilitySources::Type::Refreshed;
+   }
+   if (source != FFBCapabilitySources::Type::Validated)
+   {
+      std::lock_guard<std::mutex> lock(m_effectLock);
+      m_axisSnapshot = m_checkedAxes;
+      UpdateForceResolution();
+   }
+   float latency = m_capabilities.updateLatencyMicroseconds;
+   m_capabilities = m_checkedCapabilities;
+   m_capabilities.updateLatencyMicroseconds = latency;
+   m_capabilities.source = source;
+}
+
+FFBCapabilitySources::Type FFBDeviceContext::PollCapabilities()
+{
+   CollectCapabilityCheck(false);
+   return m_capabilities.source;
+}
+
+/**
+ * Mean of the sampled SetParameters timings, what was cached until there
+ * are any.
+ */
+float FFBDeviceContext::UpdateLatency() const
+{
+   uint32_t samples = m_nLatencySamples.load(std::memory_order_relaxed);
+   if (samples == 0)
+   {
+      return m_capabilities.updateLatencyMicroseconds;
+   }
+   return (float)m_latencySumUs.load(std::memory_order_relaxed) / samples;
+}
+
+HRESULT FFBDeviceContext::GetCapabilities(FFBDeviceCapabilities& capabilities)
+{
+   CollectCapabilityCheck(m_capabilities.source != FFBCapabilitySources::Type::Cache);
+   if (m_capabilities.source == FFBCapabilitySources::Type::None)
+   {
+      CheckCapabilities();
+      ApplyCapabilityCheck();
+      if (FAILED(m_hrCapabilityCheck))
+      {
+         return m_hrCapabilityCheck;
+      }
+   }
+   capabilities = m_capabilities;
+   capabilities.axisCount = AxisCount();
+   capabilities.updateLatencyMicroseconds = UpdateLatency();
+   return S_OK;
+}
+
+HRESULT FFBDeviceContext::DescribeCapabilities(CapabilityEntry& entry)
+{
+   CollectCapabilityCheck(true);
+   if (m_capabilities.source == FFBCapabilitySources::Type::None || m_deviceRecord.guidInstance != m_guidInstance)
+   {
+      return S_FALSE;
+   }
+
+   FFBCapabilityRecord& record = entry.record;
+   ZeroMemory(&record, sizeof(record));
+   record.guidInstance = m_guidInstance;
+   record.guidProduct = m_deviceRecord.guidProduct;
+   record.deviceType = m_deviceRecord.deviceType;
+   record.effectTypes = m_capabilities.effectTypes;
+   record.maxEffects = m_capabilities.maxEffects;
+   record.updateLatencyMicroseconds = UpdateLatency();
+   record.axisCount = std::min(m_axisSnapshot.Count(), (DWORD)MAX_FFB_AXES);
+   for (DWORD i = 0; i < record.axisCount; i++)
+   {
+      record.axes[i] = m_axisSnapshot[i];
+      record.axes[i].name = 0;
+      entry.axisNames[i] = m_axisSnapshot.String(m_axisSnapshot[i].name);
+   }
+   entry.instanceName = m_sInstanceName;
+   entry.productName = m_sProductName;
+   return S_OK;
+}
+
+/**
+ * Change how many effects the device can hold at once (32 by default). The
+ * capacity is limited to what the device reports it can hold, S_FALSE is
+ * returned when it was. Fails with E_BOUNDS if more effects than that
+ * already exist.
+ */
+HRESULT FFBDeviceContext::SetEffectCapacity(int capacity)
+{
+   if (capacity < 1 || capacity > (int)SlotMap<EffectSlot*>::MAX_CAPACITY)
+   {
+      return E_INVALIDARG;
+   }
+   HRESULT hr = S_OK;
+   DWORD limit = m_pDevice->GetEffectLimit();
+   if (limit != 0 && (DWORD)capacity > limit)
+   {
+      capacity = (int)limit;
+      hr = S_FALSE;
+   }
+
+   std::lock_guard<std::mutex> lock(m_effectLock);
+   if (!m_effects.SetCapacity((uint32_t)capacity))
+   {
+      return E_BOUNDS;
+   }
+   return hr;
+}
+
+EffectSlot* FFBDeviceContext::GetSlot(FFBEffectHandle effect)
+{
+   EffectSlot** ppSlot = m_effects.Get(effect);
+   return ppSlot != NULL ? *ppSlot : NULL;
+}
+
+/**
+ * A slot for a new effect, the arena grows by as many slots as it has, up
+ * to the effect capacity, when every slot is in use. NULL if it cannot.
+ */
+EffectSlot* FFBDeviceContext::AcquireSlot()
+{
+   EffectSlot* pSlot = m_effectSlots.Acquire();
+   if (pSlot == NULL && m_effectSlots.Capacity() < m_effects.Capacity())
+   {
+      uint32_t count = std::min(m_effectSlots.Capacity(), m_effects.Capacity() - m_effectSlots.Capacity());
+      if (m_effectSlots.Grow(std::max(count, 1u)))
+      {
+         pSlot = m_effectSlots.Acquire();
+      }
+   }
+   return pSlot;
+}
+
+EffectSlot* FFBDeviceContext::GetTypeSlot(Effects::Type effectType)
+{
+   if (effectType < 0 || effectType >= EFFECT_TYPE_COUNT)
+   {
+      return NULL;
+   }
+   return GetSlot(m_hTypeEffects[effectType]);
+}
+
+/**
+ * Add a Force Feedback Effect to the device.
+ * Only one effect of each type can be added this way, use CreateEffect to
+ * have several.
+ */
+HRESULT FFBDeviceContext::AddEffect(Effects::Type effectType)
+{
+   if (GetTypeSlot(effectType) != NULL)
+   {
+      // You cannot add an effect that is already added.
+      return E_ABORT;
+   }
+   FFBEffectHandle effect;
+   return CreateEffect(effectType, &effect);
+}
+
+/**
+ * Create an effect of any Effects::Type and return a handle to it. Any
+ * number of effects of a type can be created, up to the effect capacity.
+ * Fails with DIERR_DEVICEFULL when the device is full.
+ *
+ * While force synthesis is enabled condition effects are not created on
+ * the device, they are evaluated by the plugin instead.
+ */
+HRESULT FFBDeviceContext::CreateEffect(Effects::Type effectType, FFBEffectHandle* effect)
+{
+   if (effect == NULL)
+   {
+      return E_POINTER;
+   }
+   if (effectType < 0 || effectType >= EFFECT_TYPE_COUNT)
+   {
+      return E_INVALIDARG;
+   }
+
+   int axisCount = EffectAxisCount();
+   if (axisCount == 0)
+   {
+      // Must run EnumerateAxes first.
+      return E_BOUNDS;
+   }
+   if (m_effects.Size() >= m_effects.Capacity())
+   {
+      return DIERR_DEVICEFULL;
+   }
+
+   if (m_bSynthEnabled && IsConditionEffect(effectType) && GetTypeSlot(effectType) != NULL)
+   {
+      // The synthesizer models one effect of each type.
+      return E_ABORT;
+   }
+   EffectSlot* pSlot = AcquireSlot();
+   if (pSlot == NULL)
+   {
+      return E_OUTOFMEMORY;
+   }
+   pSlot->type = effectType;
+
+   if (m_bSynthEnabled && IsConditionEffect(effectType))
+   {
+      std::lock_guard<std::mutex> lock(m_effectLock);
+      *effect = m_effects.Insert(pSlot);
+      m_hTypeEffects[effectType] = *effect;
+      m_synth.SetGain(effectType, DI_FFNOMINALMAX);
+      m_synth.SetEnabled(effectType, true);
+      return S_OK;
+   }
+
+   InitEffectSlot(pSlot, axisCount);
+   DIEFFECT& di = pSlot->effect;
+   GUID guidType = EffectGuid(effectType);
+
+   // A pooled effect holds the same neutral parameters as di, starting it
+   // below is its only driver call.
+   HRESULT hr = S_OK;
+   pSlot->pEffect = m_bLost ? NULL : TakePooledEffect(effectType, axisCount);
+   if (pSlot->pEffect == NULL)
+   {
+      int64_t startUs = KeyframeClockUs();
+      hr = FFB_STAT_CALL(FFBStatCalls::Type::DriverCreateEffect, m_pDevice->CreateEffect(guidType, &di, &pSlot->pEffect));
+      if (SUCCEEDED(hr))
+      {
+         CountEffectCreated((float)(KeyframeClockUs() - startUs));
+      }
+   }
+   if (FAILED(hr))
+   {
+      m_effectSlots.Release(pSlot);
+      return hr;
+   }
+
+   std::lock_guard<std::mutex> lock(m_effectLock);
+   *effect = m_effects.Insert(pSlot);
+   if (GetTypeSlot(effectType) == NULL)
+   {
+      m_hTypeEffects[effectType] = *effect;
+   }
+   ResetAppliedEffectState(pSlot->applied);
+   RecordAppliedEffectParameters(pSlot->applied, di, DIEP_ALLPARAMS);
+   pSlot->applied.running = SUCCEEDED(FFB_STAT_CALL(FFBStatCalls::Type::DriverStart, pSlot->pEffect->Start(1, 0)));
+   return S_OK;
+}
+
+/**
+ * Stop and release an effect. Its handle, and any copy of it, is invalid
+ * afterwards. If the type based functions addressed it, they address
+ * another effect of its type from now on, if one is left.
+ */
+HRESULT FFBDeviceContext::DestroyEffect(FFBEffectHandle effect)
+{
+   std::lock_guard<std::mutex> lock(m_effectLock);
+   EffectSlot* pSlot = GetSlot(effect);
+   if (pSlot == NULL)
+   {
+      return E_HANDLE;
+   }
+
+   if (pSlot->pEffect == NULL)
+   {
+      DICONDITION none[MAX_FFB_AXES] = {};
+      m_synth.SetEnabled(pSlot->type, false);
+      m_synth.SetConditions(pSlot->type, none, MAX_FFB_AXES);
+   }
+   m_effects.Remove(effect);
+   if (m_hTypeEffects[pSlot->type] == effect)
+   {
+      m_hTypeEffects[pSlot->type] = 0;
+      for (uint32_t i = 0; i < m_effects.Size(); i++)
+      {
+         if (m_effects.At(i)->type == pSlot->type)
+         {
+            m_hTypeEffects[pSlot->type] = m_effects.HandleAt(i);
+            break;
+         }
+      }
+   }
+   if (!RecycleEffect(pSlot))
+   {
+      delete pSlot->pEffect;
+   }
+   m_effectSlots.Release(pSlot);
+   return S_OK;
+}
+
+/**
+ * Set up a slot's axes, directions and parameters for a new effect of its
+ * type on axisCount axes, with no force.
+ */
+void FFBDeviceContext::InitEffectSlot(EffectSlot* pSlot, int axisCount)
+{
+   // Populate the rgdwAxes value using data
+   // from the Axis enumeration.
+   // This should make it so it can support up to 6 axes.
+   for (int i = 0; i < axisCount; i++)
+   {
+      pSlot->axes[i] = m_axisSnapshot[i].joystateOffset;
+      pSlot->directions[i] = 0;
+   }
+   ZeroMemory(&pSlot->params, sizeof(pSlot->params));
+
+   const EffectTypeInfo& info = EFFECT_TYPES[pSlot->type];
+   DIEFFECT& di = pSlot->effect;
+   di.dwSize = sizeof(DIEFFECT);
+   di.dwFlags = DIEFF_CARTESIAN | DIEFF_OBJECTOFFSETS;
+   di.dwDuration = info.kind == EffectKinds::Type::Ramp ? DEFAULT_RAMP_MICROSECONDS : INFINITE;
+   di.dwSamplePeriod = 0;
+   di.dwGain = DI_FFNOMINALMAX;
+   di.dwTriggerButton = DIEB_NOTRIGGER;
+   di.dwTriggerRepeatInterval = 0;
+   di.cAxes = axisCount;
+   di.rgdwAxes = pSlot->axes;
+   di.rglDirection = pSlot->directions;
+   di.lpEnvelope = NULL;
+   di.cbTypeSpecificParams = info.perAxis ? info.driverParamsSize * axisCount : info.driverParamsSize;
+   di.lpvTypeSpecificParams = &pSlot->params;
+   di.dwStartDelay = 0;
+
+   if (info.kind == EffectKinds::Type::Periodic)
+   {
+      pSlot->params.periodic.dwPeriod = DEFAULT_PERIOD_MICROSECONDS;
+   }
+   else if (info.kind == EffectKinds::Type::Custom)
+   {
+      pSlot->params.customForce = s_silentCustomForce;
+   }
+}
+
+/**
+ * Only ConstantForce, the periodic and the condition effects can be
+ * pooled.
+ */
+HRESULT FFBDeviceContext::ValidateEffectPool(const FFBEffectPoolConfig& config)
+{
+   for (int type = 0; type < EFFECT_TYPE_COUNT; type++)
+   {
+      int count = config.effectsPerType[type];
+      if (count < 0 || count > (int)SlotMap<EffectSlot*>::MAX_CAPACITY
+         || (count > 0 && type != Effects::Type::ConstantForce
+            && !IsConditionEffect((Effects::Type)type) && !IsPeriodicEffect((Effects::Type)type)))
+      {
+         return E_INVALIDARG;
+      }
+   }
+   return S_OK;
+}
+
+/**
+ * Configure the effect pool and bring it to its new size: up to
+ * config.effectsPerType effects of each type are created for CreateEffect
+ * to hand out, pooled effects beyond that are released. S_FALSE if the
+ * device could not hold them all, the pool keeps the ones that fit.
+ */
+HRESULT FFBDeviceContext::FillEffectPool(const FFBEffectPoolConfig& config)
+{
+   HRESULT hr = ValidateEffectPool(config);
+   if (FAILED(hr))
+   {
+      return hr;
+   }
+   bool pooled = false;
+   for (int type = 0; type < EFFECT_TYPE_COUNT; type++)
+   {
+      pooled = pooled || config.effectsPerType[type] > 0;
+   }
+   if (pooled && AxisCount() == 0)
+   {
+      EnumerateAxisSnapshot();
+      if (AxisCount() == 0)
+      {
+         return E_BOUNDS;
+      }
+   }
+   m_poolConfig = config;
+   return FillEffectPool();
+}
+
+/**
+ * Bring every pool to its configured size on the current device. The
+ * missing effects are created with neutral parameters and DIEP_NODOWNLOAD,
+ * which costs no device traffic, then downloaded back to back. The first
+ * effect the device has no room for ends the fill.
+ */
+HRESULT FFBDeviceContext::FillEffectPool()
+{
+   struct PendingEffect {
+      Effects::Type type;
+      FFBEffect* pEffect;
+      float createMicroseconds;
+   };
+   std::vector<PendingEffect> vPending;
+   int64_t fillStartUs = KeyframeClockUs();
+   int axisCount = EffectAxisCount();
+   EffectSlot neutral = {};
+   EffectSlot* pNeutral = &neutral;
+   HRESULT hr = S_OK;
+   for (int type = 0; type < EFFECT_TYPE_COUNT && SUCCEEDED(hr); type++)
+   {
+      std::vector<PooledEffect>& pool = m_vEffectPool[type];
+      size_t size = (size_t)m_poolConfig.effectsPerType[type];
+      while (pool.size() > size)
+      {
+         delete pool.back().pEffect;
+         pool.pop_back();
+      }
+
+      pNeutral->type = (Effects::Type)type;
+      InitEffectSlot(pNeutral, axisCount);
+      for (size_t i = pool.size(); i < size; i++)
+      {
+         int64_t startUs = KeyframeClockUs();
+         FFBEffect* pEffect = NULL;
+         hr = FFB_STAT_CALL(FFBStatCalls::Type::DriverCreateEffect, m_pDevice->CreateEffect(EffectGuid(pNeutral->type), NULL, &pEffect));
+         if (SUCCEEDED(hr))
+         {
+            hr = pEffect->SetParameters(&pNeutral->effect, DIEP_ALLPARAMS | DIEP_NODOWNLOAD);
+            if (FAILED(hr))
+            {
+               delete pEffect;
+            }
+         }
+         if (FAILED(hr))
+         {
+            break;
+         }
+         PendingEffect pending = { pNeutral->type, pEffect, (float)(KeyframeClockUs() - startUs) };
+         vPending.push_back(pending);
+      }
+   }
+
+   HRESULT hrDownload = S_OK;
+   for (PendingEffect& pending : vPending)
+   {
+      if (FAILED(hrDownload))
+      {
+         delete pending.pEffect;
+         continue;
+      }
+      int64_t startUs = KeyframeClockUs();
+      hrDownload = FFB_STAT_CALL(FFBStatCalls::Type::DriverDownload, pending.pEffect->Download());
+      if (FAILED(hrDownload))
+      {
+         delete pending.pEffect;
+         continue;
+      }
+      CountEffectCreated(pending.createMicroseconds + (float)(KeyframeClockUs() - startUs));
+      PooledEffect pooled = { pending.pEffect, axisCount };
+      m_vEffectPool[pending.type].push_back(pooled);
+   }
+   m_poolFillMilliseconds = (float)(KeyframeClockUs() - fillStartUs) / 1000.0f;
+
+   if (SUCCEEDED(hr))
+   {
+      hr = hrDownload;
+   }
+   return hr == DIERR_DEVICEFULL ? S_FALSE : hr;
+}
+
+/**
+ * A pooled effect of the type created on axisCount axes, NULL if none is
+ * left. Counts a hit, or a miss if the type is pooled.
+ */
+FFBEffect* FFBDeviceContext::TakePooledEffect(Effects::Type effectType, int axisCount)
+{
+   if (m_poolConfig.effectsPerType[effectType] == 0)
+   {
+      return NULL;
+   }
+   std::vector<PooledEffect>& pool = m_vEffectPool[effectType];
+   for (size_t i = pool.size(); i-- > 0;)
+   {
+      if (pool[i].axisCount == axisCount)
+      {
+         FFBEffect* pEffect = pool[i].pEffect;
+         pool.erase(pool.begin() + i);
+         m_nPoolHits++;
+         return pEffect;
+      }
+   }
+   m_nPoolMisses++;
+   return NULL;
+}
+
+/**
+ * Put the effect of a destroyed slot back into the pool if the pool of its
+ * type has room. It is stopped and its parameters are reset to neutral on
+ * the host only, the Start that hands it out again downloads them. False
+ * if the effect is to be released instead.
+ */
+bool FFBDeviceContext::RecycleEffect(EffectSlot* pSlot)
+{
+   Effects::Type effectType = pSlot->type;
+   std::vector<PooledEffect>& pool = m_vEffectPool[effectType];
+   if (pSlot->pEffect == NULL || m_bLost || pool.size() >= (size_t)m_poolConfig.effectsPerType[effectType])
+   {
+      return false;
+   }
+   if (pSlot->applied.running
+      && FAILED(FFB_STAT_CALL(FFBStatCalls::Type::DriverStop, pSlot->pEffect->Stop())))
+   {
+      return false;
+   }
+
+   int axisCount = (int)pSlot->effect.cAxes;
+   InitEffectSlot(pSlot, axisCount);
+   DWORD flags = DIEP_GAIN | DIEP_NODOWNLOAD | EFFECT_TYPES[effectType].parameterFlags;
+   if (FAILED(pSlot->pEffect->SetParameters(&pSlot->effect, flags)))
+   {
+      return false;
+   }
+   PooledEffect pooled = { pSlot->pEffect, axisCount };
+   pool.push_back(pooled);
+   m_nPoolRecycled++;
+   return true;
+}
+
+/**
+ * Release every pooled effect, before the device they were created on.
+ */
+void FFBDeviceContext::ReleaseEffectPool()
+{
+   for (int type = 0; type < EFFECT_TYPE_COUNT; type++)
+   {
+      for (PooledEffect& pooled : m_vEffectPool[type])
+      {
+         delete pooled.pEffect;
+      }
+      m_vEffectPool[type].clear();
+   }
+}
+
+void FFBDeviceContext::CountEffectCreated(float microseconds)
+{
+   m_nEffectsCreated++;
+   m_createMicrosecondsSum += microseconds;
+   m_maxCreateMicroseconds = std::max(m_maxCreateMicroseconds, microseconds);
+}
+
+void FFBDeviceContext::GetMemoryStats(FFBMemoryStats& stats) const
+{
+   stats.effectSlots = m_effectSlots.Capacity();
+   stats.effectSlotsInUse = m_effectSlots.InUse();
+   stats.effectSlotsHighWater = m_effectSlots.HighWater();
+   stats.arenaBlocks = m_effectSlots.BlockCount();
+   stats.arenaBytes = (DWORD)m_effectSlots.Bytes();
+}
+
+void FFBDeviceContext::GetEffectPoolStats(FFBEffectPoolStats& stats) const
+{
+   ZeroMemory(&stats, sizeof(stats));
+   for (int type = 0; type < EFFECT_TYPE_COUNT; type++)
+   {
+      stats.available[type] = (DWORD)m_vEffectPool[type].size();
+   }
+   stats.hits = m_nPoolHits;
+   stats.misses = m_nPoolMisses;
+   stats.recycled = m_nPoolRecycled;
+   stats.created = m_nEffectsCreated;
+   stats.meanCreateMicroseconds = m_nEffectsCreated > 0 ? (float)(m_createMicrosecondsSum / m_nEffectsCreated) : 0.0f;
+   stats.maxCreateMicroseconds = m_maxCreateMicroseconds;
+   stats.fillMilliseconds = m_poolFillMilliseconds;
+}
+
+/**
+ * Remove a force feedback effect by type.
+ */
+HRESULT FFBDeviceContext::RemoveEffect(Effects::Type effectType)
+{
+   if (GetTypeSlot(effectType) == NULL)
+   {
+      return E_FAIL;
+   }
+   return DestroyEffect(m_hTypeEffects[effectType]);
+}
+
+/**
+ * This will start all force feedback effects.
+ */
+void FFBDeviceContext::StartAllEffects()
+{
+   std::lock_guard<std::mutex> lock(m_effectLock);
+   for (uint32_t i = 0; i < m_effects.Size(); i++) {
+      EffectSlot* pSlot = m_effects.At(i);
+      if (pSlot->pEffect != NULL) {
+         pSlot->applied.running = SUCCEEDED(FFB_STAT_CALL(FFBStatCalls::Type::DriverStart, pSlot->pEffect->Start(1, 0)));
+      }
+      else {
+         m_synth.SetEnabled(pSlot->type, true);
+      }
+   }
+}
+
+/**
+ * This will stop all force feedback effects.
+ */
+void FFBDeviceContext::StopAllEffects()
+{
+   std::lock_guard<std::mutex> lock(m_effectLock);
+   for (uint32_t i = 0; i < m_effects.Size(); i++) {
+      EffectSlot* pSlot = m_effects.At(i);
+      if (pSlot->pEffect != NULL) {
+         FFB_STAT_CALL(FFBStatCalls::Type::DriverStop, pSlot->pEffect->Stop());
+         pSlot->applied.running = false;
+      }
+      else {
+         m_synth.SetEnabled(pSlot->type, false);
+      }
+   }
+}
+
+/**
+ * Whether an effect of the type is reachable by type and if it is running,
+ * for describing the device to a recording started after it was set up.
+ */
+bool FFBDeviceContext::GetTypeEffectState(Effects::Type effectType, bool& running)
+{
+   std::lock_guard<std::mutex> lock(m_effectLock);
+   EffectSlot* pSlot = GetTypeSlot(effectType);
+   if (pSlot == NULL)
+   {
+      return false;
+   }
+   running = pSlot->pEffect != NULL ? pSlot->applied.running : m_synth.IsEnabled(effectType);
+   return true;
+}
+
+HRESULT FFBDeviceContext::StartEffect(FFBEffectHandle effect)
+{
+   std::lock_guard<std::mutex> lock(m_effectLock);
+   EffectSlot* pSlot = GetSlot(effect);
+   if (pSlot == NULL)
+   {
+      return E_HANDLE;
+   }
+   if (pSlot->pEffect == NULL)
+   {
+      m_synth.SetEnabled(pSlot->type, true);
+      return S_OK;
+   }
+   HRESULT hr = FFB_STAT_CALL(FFBStatCalls::Type::DriverStart, pSlot->pEffect->Start(1, 0));
+   pSlot->applied.running = SUCCEEDED(hr);
+   return hr;
+}
+
+HRESULT FFBDeviceContext::StopEffect(FFBEffectHandle effect)
+{
+   std::lock_guard<std::mutex> lock(m_effectLock);
+   EffectSlot* pSlot = GetSlot(effect);
+   if (pSlot == NULL)
+   {
+      return E_HANDLE;
+   }
+   if (pSlot->pEffect == NULL)
+   {
+      m_synth.SetEnabled(pSlot->type, false);
+      return S_OK;
+   }
+   pSlot->applied.running = false;
+   return FFB_STAT_CALL(FFBStatCalls::Type::DriverStop, pSlot->pEffect->Stop());
+}
+
+/**
+ * Update the gain for the specified effect.
+ *
+ * Takes gainPercent value between 0 - 1 and multiplies with
+ * DI_FFNOMINALMAX (10000)
+ */
+HRESULT FFBDeviceContext::UpdateEffectGain(Effects::Type effectType, float gainPercent)
+{
+   EffectSlot* pSlot = GetTypeSlot(effectType);
+   return pSlot != NULL ? UpdateGain(pSlot, gainPercent) : E_FAIL;
+}
+
+HRESULT FFBDeviceContext::SetEffectGain(FFBEffectHandle effect, float gainPercent)
+{
+   EffectSlot* pSlot = GetSlot(effect);
+   return pSlot != NULL ? UpdateGain(pSlot, gainPercent) : E_HANDLE;
+}
+
+HRESULT FFBDeviceContext::UpdateGain(EffectSlot* pSlot, float gainPercent)
+{
+   std::lock_guard<std::mutex> lock(m_effectLock);
+   DWORD gain = (DWORD)(clamp(gainPercent, 0.0, 1.0) * DI_FFNOMINALMAX);
+   if (pSlot->pEffect == NULL)
+   {
+      m_synth.SetGain(pSlot->type, gain);
+      m_synth.SetEnabled(pSlot->type, true);
+      return S_OK;
+   }
+
+   DIEFFECT effect = pSlot->effect;
+   effect.dwSize = sizeof(DIEFFECT);
+   effect.dwGain = gain;
+
+   return SetEffectParameters(pSlot, effect, DIEP_GAIN | DIEP_START);
+}
+
+/**
+ * Update the Constant Force Effect.
+ *
+ * Magnitude is the magnitude of the force on all axes.
+ * Directions is an array of directions for each axis on the device.
+ * The size of the array must match the number of axes on the device.
+ *
+ * While the force output thread is running this only publishes the new
+ * target, the output thread sends it on its next tick.
+ */
+HRESULT FFBDeviceContext::UpdateConstantForce(LONG magnitude, const LONG* directions)
+{
+   EffectSlot* pSlot = GetTypeSlot(Effects::Type::ConstantForce);
+   return pSlot != NULL ? UpdateConstantForce(pSlot, magnitude, directions) : E_FAIL;
+}
+
+HRESULT FFBDeviceContext::UpdateEffectConstantForce(FFBEffectHandle effect, LONG magnitude, const LONG* directions)
+{
+   EffectSlot* pSlot = GetSlot(effect);
+   if (pSlot == NULL)
+   {
+      return E_HANDLE;
+   }
+   if (pSlot->type != Effects::Type::ConstantForce || directions == NULL)
+   {
+      return E_INVALIDARG;
+   }
+   return UpdateConstantForce(pSlot, magnitude, directions);
+}
+
+/**
+ * Copy the entries of an effect's effectAxes axes from an array holding
+ * one per axis the device reports: an effect stays on the axes it was
+ * created on, even once the capability check changes them, and those the
+ * device no longer reports get zero.
+ */
+template <typename T>
+static void CopyEffectAxes(T* to, const T* from, int effectAxes, int deviceAxes)
+{
+   int count = std::min(effectAxes, deviceAxes);
+   memcpy(to, from, sizeof(T) * count);
+   memset(to + count, 0, sizeof(T) * (effectAxes - count));
+}
+
+HRESULT FFBDeviceContext::UpdateConstantForce(EffectSlot* pSlot, LONG magnitude, const LONG* directions)
+{
+   int axisCount = (int)pSlot->effect.cAxes;
+   LONG effectDirections[MAX_FFB_AXES];
+   CopyEffectAxes(effectDirections, directions, axisCount, EffectAxisCount());
+   if (!m_outputThread.IsRunning())
+   {
+      return ApplyConstantForce(pSlot, magnitude, effectDirections);
+   }
+
+   EffectTarget target;
+   target.flags = ConstantForceTraits::parameterFlags;
+   target.params.constantForce.magnitude = magnitude;
+   for (int i = 0; i < axisCount; i++) {
+      target.params.constantForce.directions[i] = effectDirections[i];
+   }
+   pSlot->target.Write(target);
+   return S_OK;
+}
+
+HRESULT FFBDeviceContext::ApplyConstantForce(EffectSlot* pSlot, LONG magnitude, const LONG* directions)
+{
+   DICONSTANTFORCE constantForce;
+
+   int axisCount = (int)pSlot->effect.cAxes;
+
+   constantForce.lMagnitude = magnitude;
+
+   DIEFFECT effect = pSlot->effect;
+   for (int i = 0; i < axisCount; i++) {
+      effect.rglDirection[i] = directions[i];
+   }
+   effect.cbTypeSpecificParams = sizeof(DICONSTANTFORCE);
+   effect.lpvTypeSpecificParams = &constantForce;
+
+   return SetEffectParameters(pSlot, effect, DIEP_DIRECTION | DIEP_TYPESPECIFICPARAMS | DIEP_START);
+}
+
+/**
+ * Updates a condition effect (Spring, Damper, Inertia or Friction). You
+ * must pass an array of conditions that's size matches the number of axes
+ * on the device.
+ *
+ * Like UpdateConstantForce, only publishes the target while the force
+ * output thread is running. Synthesized effects are handed straight to the
+ * synthesizer, which picks them up on its next step.
+ */
+HRESULT FFBDeviceContext::UpdateCondition(Effects::Type effectType, const DICONDITION* conditions)
+{
+   if (!IsConditionEffect(effectType) || conditions == NULL)
+   {
+      return E_INVALIDARG;
+   }
+   EffectSlot* pSlot = GetTypeSlot(effectType);
+   return pSlot != NULL ? UpdateCondition(pSlot, conditions) : E_FAIL;
+}
+
+HRESULT FFBDeviceContext::UpdateEffectCondition(FFBEffectHandle effect, const DICONDITION* conditions)
+{
+   EffectSlot* pSlot = GetSlot(effect);
+   if (pSlot == NULL)
+   {
+      return E_HANDLE;
+   }
+   if (!IsConditionEffect(pSlot->type) || conditions == NULL)
+   {
+      return E_INVALIDARG;
+   }
+   return UpdateCondition(pSlot, conditions);
+}
+
+HRESULT FFBDeviceContext::UpdateCondition(EffectSlot* pSlot, const DICONDITION* conditions)
+{
+   // The synthesizer steps the axes the device reports now.
+   if (pSlot->pEffect == NULL)
+   {
+      m_synth.SetConditions(pSlot->type, conditions, EffectAxisCount());
+      return S_OK;
+   }
+   int axisCount = (int)pSlot->effect.cAxes;
+   DICONDITION effectConditions[MAX_FFB_AXES];
+   CopyEffectAxes(effectConditions, conditions, axisCount, EffectAxisCount());
+   if (!m_outputThread.IsRunning())
+   {
+      return ApplyCondition(pSlot, effectConditions);
+   }
+
+   EffectTarget target;
+   target.flags = ConditionTraits::parameterFlags;
+   for (int i = 0; i < axisCount; i++) {
+      target.params.condition.conditions[i] = effectConditions[i];
+   }
+   pSlot->target.Write(target);
+   return S_OK;
+}
+
+HRESULT FFBDeviceContext::ApplyCondition(EffectSlot* pSlot, const DICONDITION* conditions)
+{
+   int axisCount = (int)pSlot->effect.cAxes;
+
+   DIEFFECT effect = pSlot->effect;
+   effect.cbTypeSpecificParams = sizeof(DICONDITION) * axisCount;
+   for (int i = 0; i < axisCount; i++) {
+      ((DICONDITION*)effect.lpvTypeSpecificParams)[i].lOffset = conditions[i].lOffset;
+      ((DICONDITION*)effect.lpvTypeSpecificParams)[i].lPositiveCoefficient = conditions[i].lPositiveCoefficient;
+      ((DICONDITION*)effect.lpvTypeSpecificParams)[i].lNegativeCoefficient = conditions[i].lNegativeCoefficient;
+      ((DICONDITION*)effect.lpvTypeSpecificParams)[i].dwPositiveSaturation = conditions[i].dwPositiveSaturation;
+      ((DICONDITION*)effect.lpvTypeSpecificParams)[i].dwNegativeSaturation = conditions[i].dwNegativeSaturation;
+      ((DICONDITION*)effect.lpvTypeSpecificParams)[i].lDeadBand = conditions[i].lDeadBand;
+   }
+
+   // Conditions have no meaningful direction, only the conditions change.
+   return SetEffectParameters(pSlot, effect, DIEP_TYPESPECIFICPARAMS | DIEP_START);
+}
+
+/**
+ * Updates a periodic effect (Square, Sine, Triangle, SawtoothUp or
+ * SawtoothDown). The device generates the waveform and applies the
+ * envelope itself, so an effect only needs an update when its parameters
+ * change; only the fields that differ from what the device last accepted
+ * are sent. Directions must hold one entry per axis, like
+ * UpdateConstantForce's.
+ *
+ * A finite effect plays once from its first update, later updates change
+ * it without playing it again, StartEffect does. Like UpdateConstantForce,
+ * only publishes the target while the force output thread is running.
+ */
+HRESULT FFBDeviceContext::UpdatePeriodic(Effects::Type effectType, const FFBPeriodicEffect* periodic, const LONG* directions)
+{
+   if (!IsPeriodicEffect(effectType) || periodic == NULL || directions == NULL)
+   {
+      return E_INVALIDARG;
+   }
+   EffectSlot* pSlot = GetTypeSlot(effectType);
+   return pSlot != NULL ? UpdatePeriodic(pSlot, *periodic, directions) : E_FAIL;
+}
+
+HRESULT FFBDeviceContext::UpdateEffectPeriodic(FFBEffectHandle effect, const FFBPeriodicEffect* periodic, const LONG* directions)
+{
+   EffectSlot* pSlot = GetSlot(effect);
+   if (pSlot == NULL)
+   {
+      return E_HANDLE;
+   }
+   if (!IsPeriodicEffect(pSlot->type) || periodic == NULL || directions == NULL)
+   {
+      return E_INVALIDARG;
+   }
+   return UpdatePeriodic(pSlot, *periodic, directions);
+}
+
+HRESULT FFBDeviceContext::UpdatePeriodic(EffectSlot* pSlot, const FFBPeriodicEffect& periodic, const LONG* directions)
+{
+   HRESULT hr = ValidatePeriodic(periodic);
+   if (FAILED(hr))
+   {
+      return hr;
+   }
+   int axisCount = (int)pSlot->effect.cAxes;
+   LONG effectDirections[MAX_FFB_AXES];
+   CopyEffectAxes(effectDirections, directions, axisCount, EffectAxisCount());
+   if (!m_outputThread.IsRunning())
+   {
+      return ApplyPeriodic(pSlot, periodic, effectDirections);
+   }
+
+   EffectTarget target;
+   target.flags = PeriodicTraits::parameterFlags;
+   target.params.periodic.effect = periodic;
+   for (int i = 0; i < axisCount; i++) {
+      target.params.periodic.directions[i] = effectDirections[i];
+   }
+   pSlot->target.Write(target);
+   return S_OK;
+}
+
+HRESULT FFBDeviceContext::ApplyPeriodic(EffectSlot* pSlot, const FFBPeriodicEffect& periodic, const LONG* directions)
+{
+   DIPERIODIC params;
+   DIENVELOPE envelope;
+
+   int axisCount = (int)pSlot->effect.cAxes;
+
+   DIEFFECT effect = pSlot->effect;
+   for (int i = 0; i < axisCount; i++) {
+      effect.rglDirection[i] = directions[i];
+   }
+   SetPeriodicParameters(effect, periodic, params, envelope);
+
+   return SetEffectParameters(pSlot, effect, DIEP_DURATION | DIEP_DIRECTION | DIEP_ENVELOPE | DIEP_TYPESPECIFICPARAMS | DIEP_START);
+}
+
+/**
+ * Plays a chunk of samples on a CustomForce effect. The samples are not
+ * copied by the plugin, the driver reads them straight from the caller's
+ * buffer when the chunk is uploaded; every chunk is uploaded whole and
+ * plays from its first sample, repeating unless it has a duration.
+ *
+ * Without the force output thread the chunk is uploaded before returning.
+ * With it, the chunk is uploaded by the output thread once the chunk
+ * before it has played through, so it must stay untouched until
+ * GetCustomForceStats reports no pending chunk. Only one chunk waits at a
+ * time, E_PENDING while one does: a double-buffering caller fills one
+ * buffer while the other plays.
+ */
+HRESULT FFBDeviceContext::UpdateCustomForce(const FFBCustomForce* customForce, const LONG* directions)
+{
+   if (customForce == NULL || directions == NULL)
+   {
+      return E_INVALIDARG;
+   }
+   EffectSlot* pSlot = GetTypeSlot(Effects::Type::CustomForce);
+   return pSlot != NULL ? UpdateCustomForce(pSlot, *customForce, directions, CustomForceTraits::parameterFlags) : E_FAIL;
+}
+
+HRESULT FFBDeviceContext::UpdateEffectCustomForce(FFBEffectHandle effect, const FFBCustomForce* customForce, const LONG* directions)
+{
+   EffectSlot* pSlot = GetSlot(effect);
+   if (pSlot == NULL)
+   {
+      return E_HANDLE;
+   }
+   if (pSlot->type != Effects::Type::CustomForce || customForce == NULL || directions == NULL)
+   {
+      return E_INVALIDARG;
+   }
+   return UpdateCustomForce(pSlot, *customForce, directions, CustomForceTraits::parameterFlags);
+}
+
+HRESULT FFBDeviceContext::UpdateCustomForce(EffectSlot* pSlot, const FFBCustomForce& customForce, const LONG* directions, DWORD flags)
+{
+   int axisCount = (int)pSlot->effect.cAxes;
+   HRESULT hr = ValidateCustomForce(customForce, std::min(axisCount, EffectAxisCount()));
+   if (FAILED(hr))
+   {
+      return hr;
+   }
+   LONG effectDirections[MAX_FFB_AXES];
+   CopyEffectAxes(effectDirections, directions, axisCount, EffectAxisCount());
+   std::unique_lock<std::mutex> lock(m_effectLock, std::defer_lock);
+   bool bQueued = m_outputThread.IsRunning();
+   if (bQueued)
+   {
+      lock.lock();
+   }
+   CustomForceStream& stream = pSlot->stream;
+   if (stream.bPending)
+   {
+      return E_PENDING;
+   }
+   if (stream.playingEndUs != 0 && KeyframeClockUs() > stream.playingEndUs)
+   {
+      stream.stats.underruns++;
+   }
+   stream.stats.chunksSubmitted++;
+   if (!bQueued)
+   {
+      return ApplyCustomForce(pSlot, customForce, effectDirections, flags);
+   }
+
+   stream.pending = customForce;
+   for (int i = 0; i < axisCount; i++) {
+      stream.directions[i] = effectDirections[i];
+   }
+   stream.flags = flags;
+   stream.bPending = true;
+   return S_OK;
+}
+
+/**
+ * Upload a chunk, timed, along with the other fields selected by flags.
+ * The applied state is left holding the silent table rather than a
+ * pointer to the caller's samples, so every chunk counts as a change and
+ * nothing refers to the samples afterwards.
+ */
+HRESULT FFBDeviceContext::ApplyCustomForce(EffectSlot* pSlot, const FFBCustomForce& customForce, const LONG* directions, DWORD flags)
+{
+   DICUSTOMFORCE params;
+   params.cChannels = customForce.channels;
+   params.dwSamplePeriod = customForce.samplePeriod;
+   params.cSamples = customForce.channels * customForce.sampleCount;
+   params.rglForceData = (LPLONG)customForce.samples;
+
+   int axisCount = (int)pSlot->effect.cAxes;
+
+   DIEFFECT effect = pSlot->effect;
+   for (int i = 0; i < axisCount; i++) {
+      effect.rglDirection[i] = directions[i];
+   }
+   effect.dwDuration = customForce.duration == 0 ? INFINITE : customForce.duration;
+   effect.cbTypeSpecificParams = sizeof(DICUSTOMFORCE);
+   effect.lpvTypeSpecificParams = &params;
+
+   CustomForceStream& stream = pSlot->stream;
+   int64_t startUs = KeyframeClockUs();
+   HRESULT hr = SetEffectParameters(pSlot, effect, flags | DIEP_TYPESPECIFICPARAMS | DIEP_START);
+   int64_t endUs = KeyframeClockUs();
+   if (FAILED(hr))
+   {
+      return hr;
+   }
+
+   float uploadMicroseconds = (float)(endUs - startUs);
+   stream.uploadMicrosecondsSum += uploadMicroseconds;
+   stream.stats.maxUploadMicroseconds = std::max(stream.stats.maxUploadMicroseconds, uploadMicroseconds);
+   stream.stats.chunksUploaded++;
+   stream.stats.samplesUploaded += params.cSamples;
+   stream.playingEndUs = endUs + (int64_t)customForce.sampleCount * customForce.samplePeriod;
+   g_nParameterBytesSent.fetch_add(params.cSamples * sizeof(LONG), std::memory_order_relaxed);
+
+   AppliedEffectState& applied = pSlot->applied;
+   applied.cbTypeSpecificParams = sizeof(DICUSTOMFORCE);
+   memcpy(applied.typeSpecificParams, &s_silentCustomForce, sizeof(DICUSTOMFORCE));
+   return hr;
+}
+
+/**
+ * Upload the chunk waiting on pSlot once the one playing is through, or
+ * right away with flush. Output thread, with m_effectLock held.
+ */
+void FFBDeviceContext::UploadPendingCustomForce(EffectSlot* pSlot, bool flush)
+{
+   CustomForceStream& stream = pSlot->stream;
+   if (!stream.bPending || (!flush && KeyframeClockUs() < stream.playingEndUs))
+   {
+      return;
+   }
+   stream.bPending = false;
+   m_outputThread.CountUpdate(ApplyCustomForce(pSlot, stream.pending, stream.directions, stream.flags));
+}
+
+HRESULT FFBDeviceContext::GetCustomForceStats(FFBEffectHandle effect, FFBCustomForceStats& stats)
+{
+   std::lock_guard<std::mutex> lock(m_effectLock);
+   EffectSlot* pSlot = GetSlot(effect);
+   if (pSlot == NULL)
+   {
+      return E_HANDLE;
+   }
+   if (pSlot->type != Effects::Type::CustomForce)
+   {
+      return E_INVALIDARG;
+   }
+   const CustomForceStream& stream = pSlot->stream;
+   stats = stream.stats;
+   stats.pendingChunks = stream.bPending ? 1 : 0;
+   stats.meanUploadMicroseconds = stats.chunksUploaded != 0 ? (float)(stream.uploadMicrosecondsSum / stats.chunksUploaded) : 0.0f;
+   return S_OK;
+}
+
+/**
+ * Update an effect of any type from the parameters of its kind:
+ * FFBConstantForceParams, FFBRampForceParams, FFBPeriodicParams,
+ * FFBConditionParams or FFBCustomForceParams. Only the DIEP_* fields in
+ * flags are sent, all the type covers when 0; a flag the type has no
+ * parameter for is E_INVALIDARG. Otherwise it does what the type's own
+ * update does, and publishes the target while the force output thread is
+ * running. Targets published within one tick keep the newest, with its
+ * flags: a field the newest leaves out keeps what the device last got.
+ */
+HRESULT FFBDeviceContext::UpdateEffect(Effects::Type effectType, const void* params, DWORD flags)
+{
+   if (params == NULL)
+   {
+      return E_INVALIDARG;
+   }
+   EffectSlot* pSlot = GetTypeSlot(effectType);
+   return pSlot != NULL ? (this->*s_typedEffects[effectType].update)(pSlot, params, flags) : E_FAIL;
+}
+
+HRESULT FFBDeviceContext::UpdateFFBEffect(FFBEffectHandle effect, const void* params, DWORD flags)
+{
+   EffectSlot* pSlot = GetSlot(effect);
+   if (pSlot == NULL)
+   {
+      return E_HANDLE;
+   }
+   if (params == NULL)
+   {
+      return E_INVALIDARG;
+   }
+   return (this->*s_typedEffects[pSlot->type].update)(pSlot, params, flags);
+}
+
+bool FFBDeviceContext::GetEffectType(FFBEffectHandle effect, Effects::Type& effectType)
+{
+   EffectSlot* pSlot = GetSlot(effect);
+   if (pSlot == NULL)
+   {
+      return false;
+   }
+   effectType = pSlot->type;
+   return true;
+}
+
+template <Effects::Type T>
+HRESULT FFBDeviceContext::UpdateTyped(EffectSlot* pSlot, const void* params, DWORD flags)
+{
+   typedef EffectTraits<T> Traits;
+   const typename Traits::Params& typed = *(const typename Traits::Params*)params;
+   if ((flags & ~Traits::parameterFlags) != 0)
+   {
+      return E_INVALIDARG;
+   }
+   flags = flags != 0 ? flags : Traits::parameterFlags;
+   if constexpr (Traits::kind == EffectKinds::Type::Custom)
+   {
+      // Chunks wait in the effect's stream rather than its target.
+      return UpdateCustomForce(pSlot, typed.customForce, typed.directions, flags);
+   }
+   else
+   {
+      int axisCount = EffectAxisCount();
+      HRESULT hr = Traits::Validate(typed, axisCount);
+      if (FAILED(hr))
+      {
+         return hr;
+      }
+      if constexpr (Traits::kind == EffectKinds::Type::Condition)
+      {
+         if (pSlot->pEffect == NULL)
+         {
+            m_synth.SetConditions(pSlot->type, typed.conditions, axisCount);
+            return S_OK;
+         }
+      }
+      if (!m_outputThread.IsRunning())
+      {
+         return ApplyTyped<T>(pSlot, typed, flags);
+      }
+
+      EffectTarget target;
+      target.flags = flags;
+      Traits::Of(target.params) = typed;
+      pSlot->target.Write(target);
+      return S_OK;
+   }
+}
+
+template <Effects::Type T>
+HRESULT FFBDeviceContext::ApplyTyped(EffectSlot* pSlot, const typename EffectTraits<T>::Params& params, DWORD flags)
+{
+   typedef EffectTraits<T> Traits;
+   if constexpr (Traits::kind == EffectKinds::Type::Custom)
+   {
+      return ApplyCustomForce(pSlot, params.customForce, params.directions, flags);
+   }
+   else
+   {
+      typename Traits::DriverParams driver[Traits::driverCount];
+      DIENVELOPE envelope;
+      // The parameters hold MAX_FFB_AXES entries, the effect's axes among them.
+      int axisCount = (int)pSlot->effect.cAxes;
+
+      DIEFFECT effect = pSlot->effect;
+      Traits::Fill(effect, params, axisCount, driver, envelope);
+      return SetEffectParameters(pSlot, effect, flags | DIEP_START);
+   }
+}
+
+template <Effects::Type T>
+HRESULT FFBDeviceContext::ApplyTarget(EffectSlot* pSlot, const EffectTarget& target)
+{
+   return ApplyTyped<T>(pSlot, EffectTraits<T>::Of(target.params), target.flags);
+}
+
+const std::array<FFBDeviceContext::TypedEffect, EFFECT_TYPE_COUNT> FFBDeviceContext::s_typedEffects =
+   FFBDeviceContext::TypedEffects(std::make_integer_sequence<int, EFFECT_TYPE_COUNT>());
+
+/**
+ * Send an update to the driver, reduced to the fields that changed since
+ * the last update that was applied. Skips the driver call entirely when
+ * nothing changed (or only by less than the force resolution) and never
+ * restarts an effect that is already running.
+ */
+HRESULT FFBDeviceContext::SetEffectParameters(EffectSlot* pSlot, const DIEFFECT& effect, DWORD flags)
+{
+   g_nCallsReceived.fetch_add(1, std::memory_order_relaxed);
+
+   AppliedEffectState& applied = pSlot->applied;
+   DWORD changed = ChangedEffectParameters(applied, effect, flags, m_lForceResolution);
+   if (changed == 0)
+   {
+      return S_OK;
+   }
+
+   bool bSampled = m_nSetParameters.fetch_add(1, std::memory_order_relaxed) % LATENCY_SAMPLE_INTERVAL == 0;
+   bool bTimed = bSampled || m_bGovernedTick;
+   int64_t startUs = bTimed ? KeyframeClockUs() : 0;
+   HRESULT hr = FFB_STAT_CALL(FFBStatCalls::Type::DriverSetParameters, pSlot->pEffect->SetParameters(&effect, changed));
+   int64_t latencyUs = bTimed ? KeyframeClockUs() - startUs : 0;
+   g_nCallsForwarded.fetch_add(1, std::memory_order_relaxed);
+   if (m_bGovernedTick)
+   {
+      m_governor.Observe(hr, latencyUs);
+   }
+   if (SUCCEEDED(hr))
+   {
+      if (bSampled)
+      {
+         m_latencySumUs.fetch_add((uint64_t)latencyUs, std::memory_order_relaxed);
+         m_nLatencySamples.fetch_add(1, std::memory_order_relaxed);
+      }
+      g_nParameterBytesSent.fetch_add(EffectParameterBytes(effect, changed), std::memory_order_relaxed);
+      RecordAppliedEffectParameters(applied, effect, changed);
+   }
+   return hr;
+}
+
+/**
+ * Everything a batch wants to change on one effect, merged in submission
+ * order so the last write to each field wins.
+ */
+struct PendingEffectUpdate {
+   DWORD flags;
+   DWORD gain;
+   LONG magnitude;
+   LONG directions[MAX_FFB_AXES];
+   DICONDITION conditions[MAX_FFB_AXES];
+   FFBPeriodicEffect periodic;
+   bool stop;
+   HRESULT hr;
+};
+
+// Must match the layout of FFBCommand in UnityFFBTypes.cs.
+static_assert(sizeof(FFBCommand) == 8 + sizeof(DICONDITION) * MAX_FFB_AXES, "FFBCommand layout changed");
+
+/**
+ * Apply a batch of effect commands in one call. Commands are validated,
+ * merged per effect (last write wins, DIEP_* flags are or'ed together) and
+ * each touched effect gets at most one SetParameters call.
+ *
+ * results must hold commandCount entries (or be NULL), each receives
+ * E_INVALIDARG for malformed commands, E_FAIL if the effect was not added
+ * and otherwise the result of the driver call the command was merged into.
+ * Returns S_OK if every command succeeded, else the first failure.
+ */
+HRESULT FFBDeviceContext::SubmitCommands(const FFBCommand* commands, int commandCount, HRESULT* results)
+{
+   if (commandCount < 0 || (commandCount > 0 && commands == NULL))
+   {
+      return E_INVALIDARG;
+   }
+
+   PendingEffectUpdate pending[EFFECT_TYPE_COUNT];
+   ZeroMemory(pending, sizeof(pending));
+   int axisCount = EffectAxisCount();
+
+   HRESULT hrBatch = S_OK;
+   for (int i = 0; i < commandCount; i++)
+   {
+      const FFBCommand& command = commands[i];
+      HRESULT hr = S_OK;
+      if (command.effectType < 0 || command.effectType >= EFFECT_TYPE_COUNT)
+      {
+         hr = E_INVALIDARG;
+      }
+      else if (GetTypeSlot(command.effectType) == NULL)
+      {
+         hr = E_FAIL;
+      }
+      else
+      {
+         PendingEffectUpdate& update = pending[command.effectType];
+         switch (command.command)
+         {
+         case FFBCommands::Type::UpdateConstantForce:
+            if (command.effectType != Effects::Type::ConstantForce)
+            {
+               hr = E_INVALIDARG;
+               break;
+            }
+            update.flags |= DIEP_DIRECTION | DIEP_TYPESPECIFICPARAMS;
+            update.magnitude = command.constantForce.magnitude;
+            memcpy(update.directions, command.constantForce.directions, sizeof(LONG) * axisCount);
+            break;
+         case FFBCommands::Type::UpdateSpring:
+         case FFBCommands::Type::UpdateCondition:
+            if (command.command == FFBCommands::Type::UpdateSpring
+               ? command.effectType != Effects::Type::Spring
+               : !IsConditionEffect(command.effectType))
+            {
+               hr = E_INVALIDARG;
+               break;
+            }
+            update.flags |= DIEP_TYPESPECIFICPARAMS;
+            memcpy(update.conditions, command.conditions, sizeof(DICONDITION) * axisCount);
+            break;
+         case FFBCommands::Type::UpdatePeriodic:
+            if (!IsPeriodicEffect(command.effectType))
+            {
+               hr = E_INVALIDARG;
+               break;
+            }
+            hr = ValidatePeriodic(command.periodic.effect);
+            if (FAILED(hr))
+            {
+               break;
+            }
+            update.flags |= DIEP_DURATION | DIEP_DIRECTION | DIEP_ENVELOPE | DIEP_TYPESPECIFICPARAMS;
+            update.periodic = command.periodic.effect;
+            memcpy(update.directions, command.periodic.directions, sizeof(LONG) * axisCount);
+            break;
+         case FFBCommands::Type::SetGain:
+            update.flags |= DIEP_GAIN;
+            update.gain = (DWORD)(clamp(command.gainPercent, 0.0, 1.0) * DI_FFNOMINALMAX);
+            break;
+         case FFBCommands::Type::Start:
+            update.flags |= DIEP_START;
+            update.stop = false;
+            break;
+         case FFBCommands::Type::Stop:
+            update.flags &= ~DIEP_START;
+            update.stop = true;
+            break;
+         default:
+            hr = E_INVALIDARG;
+            break;
+         }
+      }
+      if (results != NULL)
+      {
+         results[i] = hr;
+      }
+      if (FAILED(hr) && SUCCEEDED(hrBatch))
+      {
+         hrBatch = hr;
+      }
+   }
+
+   {
+      std::lock_guard<std::mutex> lock(m_effectLock);
+      bool bPublish = m_outputThread.IsRunning();
+      for (int type = 0; type < EFFECT_TYPE_COUNT; type++)
+      {
+         PendingEffectUpdate& update = pending[type];
+         if (update.flags == 0 && !update.stop)
+         {
+            continue;
+         }
+         Effects::Type effectType = (Effects::Type)type;
+         EffectSlot* pSlot = GetTypeSlot(effectType);
+         FFBEffect* pEffect = pSlot->pEffect;
+         if (pEffect == NULL)
+         {
+            // Synthesized condition effect, nothing goes to the device.
+            if ((update.flags & DIEP_TYPESPECIFICPARAMS) != 0)
+            {
+               m_synth.SetConditions(effectType, update.conditions, axisCount);
+            }
+            if ((update.flags & DIEP_GAIN) != 0)
+            {
+               m_synth.SetGain(effectType, update.gain);
+            }
+            if (update.stop || (update.flags & DIEP_START) != 0)
+            {
+               m_synth.SetEnabled(effectType, !update.stop);
+            }
+            update.hr = S_OK;
+            continue;
+         }
+         DIEFFECT effect = pSlot->effect;
+         DICONSTANTFORCE constantForce;
+         DIPERIODIC periodic;
+         DIENVELOPE envelope;
+
+         // The output thread owns sending force targets while it runs.
+         if (bPublish && (update.flags & DIEP_TYPESPECIFICPARAMS) != 0)
+         {
+            EffectTarget target;
+            target.flags = EFFECT_TYPES[effectType].parameterFlags;
+            if (effectType == Effects::Type::ConstantForce)
+            {
+               target.params.constantForce.magnitude = update.magnitude;
+               memcpy(target.params.constantForce.directions, update.directions, sizeof(target.params.constantForce.directions));
+            }
+            else if (IsPeriodicEffect(effectType))
+            {
+               target.params.periodic.effect = update.periodic;
+               memcpy(target.params.periodic.directions, update.directions, sizeof(target.params.periodic.directions));
+            }
+            else
+            {
+               memcpy(target.params.condition.conditions, update.conditions, sizeof(target.params.condition.conditions));
+            }
+            pSlot->target.Write(target);
+            update.flags &= ~(DIEP_DURATION | DIEP_DIRECTION | DIEP_ENVELOPE | DIEP_TYPESPECIFICPARAMS);
+         }
+
+         // The pending update holds the device's axes, zero beyond them.
+         int effectAxes = (int)effect.cAxes;
+         effect.dwGain = update.gain;
+         if ((update.flags & DIEP_DIRECTION) != 0)
+         {
+            memcpy(effect.rglDirection, update.directions, sizeof(LONG) * effectAxes);
+         }
+         if ((update.flags & DIEP_TYPESPECIFICPARAMS) != 0)
+         {
+            if (effectType == Effects::Type::ConstantForce)
+            {
+               constantForce.lMagnitude = update.magnitude;
+               effect.cbTypeSpecificParams = sizeof(DICONSTANTFORCE);
+               effect.lpvTypeSpecificParams = &constantForce;
+            }
+            else if (IsPeriodicEffect(effectType))
+            {
+               SetPeriodicParameters(effect, update.periodic, periodic, envelope);
+            }
+            else
+            {
+               effect.cbTypeSpecificParams = sizeof(DICONDITION) * effectAxes;
+               memcpy(effect.lpvTypeSpecificParams, update.conditions, sizeof(DICONDITION) * effectAxes);
+            }
+         }
+
+         update.hr = S_OK;
+         if (update.flags != 0)
+         {
+            update.hr = SetEffectParameters(pSlot, effect, update.flags);
+         }
+         if (update.stop && SUCCEEDED(update.hr))
+         {
+            update.hr = FFB_STAT_CALL(FFBStatCalls::Type::DriverStop, pEffect->Stop());
+            pSlot->applied.running = false;
+         }
+      }
+   }
+
+   for (int i = 0; results != NULL && i < commandCount; i++)
+   {
+      if (SUCCEEDED(results[i]))
+      {
+         results[i] = pending[commands[i].effectType].hr;
+      }
+   }
+   for (int type = 0; type < EFFECT_TYPE_COUNT && SUCCEEDED(hrBatch); type++)
+   {
+      hrBatch = pending[type].hr;
+   }
+
+   return hrBatch;
+}
+
+/**
+ * Toggle the auto centering spring for the device.
+ */
+HRESULT FFBDeviceContext::SetAutoCenter(bool autoCenter)
+{
+   DIPROPDWORD dipdw;
+   dipdw.diph.dwSize = sizeof(DIPROPDWORD);
+   dipdw.diph.dwHeaderSize = sizeof(DIPROPHEADER);
+   dipdw.diph.dwObj = 0;
+   dipdw.diph.dwHow = DIPH_DEVICE;
+   dipdw.dwData = autoCenter ? DIPROPAUTOCENTER_ON : DIPROPAUTOCENTER_OFF;
+
+   m_nAutoCenter = autoCenter ? 1 : 0;
+   return FFB_STAT_CALL(FFBStatCalls::Type::DriverSetProperty, m_pDevice->SetProperty(DIPROP_AUTOCENTER, &dipdw.diph));
+}
+
+/**
+ * Switch to a new device for the same wheel after it was unplugged and
+ * attached again: every effect is recreated with the parameters the old
+ * device last accepted, effects that were running are started and the
+ * auto center setting is reapplied and the effect pool is filled again.
+ * Takes ownership of pDevice.
+ *
+ * All or nothing, if an effect cannot be recreated the new device is
+ * released and the device stays lost.
+ */
+HRESULT FFBDeviceContext::Restore(FFBDevice* pDevice)
+{
+   // A running capability check still uses the old device.
+   if (m_capabilityCheck.joinable())
+   {
+      m_capabilityCheck.join();
+   }
+   std::lock_guard<std::mutex> lock(m_effectLock);
+   std::vector<FFBEffect*> vRestored(m_effects.Size(), NULL);
+   HRESULT hr = S_OK;
+   for (uint32_t i = 0; i < m_effects.Size() && SUCCEEDED(hr); i++)
+   {
+      EffectSlot* pSlot = m_effects.At(i);
+      const AppliedEffectState& applied = pSlot->applied;
+      if (pSlot->pEffect == NULL)
+      {
+         // Synthesized, there is nothing on the device.
+         continue;
+      }
+
+      DIEFFECT effect = pSlot->effect;
+      effect.dwDuration = applied.duration;
+      effect.dwGain = applied.gain;
+      effect.cAxes = applied.cAxes;
+      pSlot->envelope = applied.envelope;
+      effect.lpEnvelope = applied.hasEnvelope ? &pSlot->envelope : NULL;
+      memcpy(effect.rglDirection, applied.directions, sizeof(LONG) * applied.cAxes);
+      memcpy(&pSlot->params, applied.typeSpecificParams, applied.cbTypeSpecificParams);
+      effect.cbTypeSpecificParams = applied.cbTypeSpecificParams;
+      effect.lpvTypeSpecificParams = &pSlot->params;
+      hr = FFB_STAT_CALL(FFBStatCalls::Type::DriverCreateEffect, pDevice->CreateEffect(EffectGuid(pSlot->type), &effect, &vRestored[i]));
+   }
+   if (FAILED(hr))
+   {
+      for (FFBEffect* pEffect : vRestored)
+      {
+         delete pEffect;
+      }
+      delete pDevice;
+      return hr;
+   }
+
+   // The old effects go before the device they were created on.
+   for (uint32_t i = 0; i < m_effects.Size(); i++)
+   {
+      EffectSlot* pSlot = m_effects.At(i);
+      if (pSlot->pEffect != NULL)
+      {
+         delete pSlot->pEffect;
+         pSlot->pEffect = vRestored[i];
+         if (pSlot->applied.running)
+         {
+            pSlot->applied.running = SUCCEEDED(FFB_STAT_CALL(FFBStatCalls::Type::DriverStart, pSlot->pEffect->Start(1, 0)));
+         }
+      }
+   }
+   ReleaseEffectPool();
+   delete m_pDevice;
+   m_pDevice = pDevice;
+   m_bLost = false;
+   m_bSynthStepped = false;
+   FillEffectPool();
+
+   if (m_nAutoCenter >= 0)
+   {
+      SetAutoCenter(m_nAutoCenter != 0);
+   }
+   if (m_dwInputBufferSize != 0)
+   {
+      SetInputBufferSize(m_dwInputBufferSize);
+   }
+   return S_OK;
+}
+
+/**
+ * Start a native thread that sends force updates to the device at rateHz,
+ * decoupled from the rate UpdateConstantForce/UpdateCondition are called
+ * at. Effects may be added before or after.
+ */
+HRESULT FFBDeviceContext::StartOutputThread(int rateHz)
+{
+   if (!m_outputThread.IsRunning())
+   {
+      // The force sent before the thread ran is the game's own, what the
+      // output thread falls back to until the game sends another.
+      std::lock_guard<std::mutex> lock(m_effectLock);
+      EffectSlot* pSlot = GetTypeSlot(Effects::Type::ConstantForce);
+      if (pSlot != NULL && pSlot->applied.valid && pSlot->applied.cbTypeSpecificParams == sizeof(DICONSTANTFORCE))
+      {
+         m_gameForce.magnitude = ((const DICONSTANTFORCE*)pSlot->applied.typeSpecificParams)->lMagnitude;
+         memcpy(m_gameForce.directions, pSlot->applied.directions, sizeof(m_gameForce.directions));
+      }
+   }
+   return m_outputThread.Start(rateHz, [this]() { OutputTick(); });
+}
+
+/**
+ * Stop the force output thread. Updates are sent synchronously again, the
+ * last published targets and custom force chunks are flushed so they are
+ * not lost and no caller's samples are still read afterwards.
+ */
+void FFBDeviceContext::StopOutputThread()
+{
+   if (m_outputThread.IsRunning())
+   {
+      m_outputThread.Stop();
+      OutputTick();
+      std::lock_guard<std::mutex> lock(m_effectLock);
+      for (uint32_t i = 0; i < m_effects.Size(); i++)
+      {
+         EffectSlot* pSlot = m_effects.At(i);
+         if (pSlot->type == Effects::Type::CustomForce)
+         {
+            UploadPendingCustomForce(pSlot, true);
+         }
+      }
+   }
+}
+
+/**
+ * Change the rate of the force output thread, takes effect on the next tick.
+ */
+HRESULT FFBDeviceContext::SetOutputRate(int rateHz)
+{
+   return m_outputThread.SetRate(rateHz);
+}
+
+void FFBDeviceContext::GetOutputStats(ForceOutputStats& stats) const
+{
+   m_outputThread.GetStats(stats);
+}
+
+void FFBDeviceContext::ResetOutputStats()
+{
+   m_outputThread.ResetStats();
+}
+
+/**
+ * Start capturing the device's input into its ring (see InputCapture),
+ * restarting a capture already running. A device that cannot buffer its
+ * input is polled instead, S_FALSE then.
+ */
+HRESULT FFBDeviceContext::StartInputCapture(const FFBInputCaptureConfig& config)
+{
+   HRESULT hr = InputCapture::Validate(config);
+   if (FAILED(hr))
+   {
+      return hr;
+   }
+   StopInputCapture();
+
+   FFBInputModes::Type mode = config.mode;
+   if (mode == FFBInputModes::Type::Buffered)
+   {
+      std::lock_guard<std::mutex> lock(m_effectLock);
+      if (FAILED(SetInputBufferSize(config.bufferSize)))
+      {
+         mode = FFBInputModes::Type::Polled;
+      }
+   }
+   m_input.Begin(mode);
+   hr = m_inputThread.Start(config.rateHz, [this]() { InputTick(); });
+   if (FAILED(hr))
+   {
+      return hr;
+   }
+   return mode == config.mode ? S_OK : S_FALSE;
+}
+
+/**
+ * Stop the input capture thread and the device's buffering. The ring keeps
+ * the records not read yet.
+ */
+void FFBDeviceContext::StopInputCapture()
+{
+   if (m_inputThread.IsRunning())
+   {
+      m_inputThread.Stop();
+   }
+   std::lock_guard<std::mutex> lock(m_effectLock);
+   if (m_dwInputBufferSize != 0)
+   {
+      SetInputBufferSize(0);
+   }
+}
+
+/**
+ * Called with m_effectLock held.
+ */
+HRESULT FFBDeviceContext::SetInputBufferSize(DWORD bufferSize)
+{
+   DIPROPDWORD dipdw;
+   dipdw.diph.dwSize = sizeof(DIPROPDWORD);
+   dipdw.diph.dwHeaderSize = sizeof(DIPROPHEADER);
+   dipdw.diph.dwObj = 0;
+   dipdw.diph.dwHow = DIPH_DEVICE;
+   dipdw.dwData = bufferSize;
+
+   HRESULT hr = FFB_STAT_CALL(FFBStatCalls::Type::DriverSetProperty, m_pDevice->SetProperty(DIPROP_BUFFERSIZE, &dipdw.diph));
+   m_dwInputBufferSize = SUCCEEDED(hr) ? bufferSize : 0;
+   return hr;
+}
+
+/**
+ * One read of the input capture thread.
+ */
+void FFBDeviceContext::InputTick()
+{
+   std::lock_guard<std::mutex> lock(m_effectLock);
+   m_input.Capture(m_pDevice);
+}
+
+/**
+ * Split a constant force into its force on each axis, the same way the
+ * device resolves cartesian directions.
+ */
+static void ResolveForce(LONG magnitude, const LONG* directions, int axisCount, float* force)
+{
+   double length = 0;
+   for (int i = 0; i < axisCount; i++)
+   {
+      length += (double)directions[i] * directions[i];
+   }
+   length = sqrt(length);
+   for (int i = 0; i < axisCount; i++)
+   {
+      double component = i == 0 ? 1.0 : 0.0;
+      if (length > 0)
+      {
+         component = directions[i] / length;
+      }
+      force[i] = (float)(magnitude * component);
+   }
+}
+
+/**
+ * The constant force for a force on each axis. Without any force the
+ * directions are left at fallbackDirections.
+ */
+static void ComposeForce(const float* force, int axisCount, const LONG* fallbackDirections, LONG& magnitude, LONG* directions)
+{
+   if (axisCount == 1)
+   {
+      // A single axis keeps a fixed direction and a signed magnitude, so
+      // only the magnitude changes from tick to tick.
+      magnitude = (LONG)clamp(force[0], -DI_FFNOMINALMAX, DI_FFNOMINALMAX);
+      directions[0] = DI_FFNOMINALMAX;
+      return;
+   }
+   double total = 0;
+   for (int i = 0; i < axisCount; i++)
+   {
+      total += (double)force[i] * force[i];
+   }
+   total = sqrt(total);
+   magnitude = (LONG)clamp(total, 0, DI_FFNOMINALMAX);
+   for (int i = 0; i < axisCount; i++)
+   {
+      directions[i] = total > 0 ? (LONG)(force[i] / total * DI_FFNOMINALMAX) : fallbackDirections[i];
+   }
+}
+
+/**
+ * One tick of the force output thread, sends whatever targets were
+ * published since the previous tick.
+ */
+void FFBDeviceContext::OutputTick()
+{
+   EffectTarget target;
+
+   std::lock_guard<std::mutex> lock(m_effectLock);
+   m_bGovernedTick = m_governor.IsEnabled() && m_outputThread.IsRunning();
+   int64_t startUs = m_bGovernedTick ? KeyframeClockUs() : 0;
+   EffectSlot* pForceSlot = GetTypeSlot(Effects::Type::ConstantForce);
+   bool bShaped = pForceSlot != NULL && (m_bSynthEnabled || m_bDspEnabled || m_bKeyframesEnabled || m_bMixerEnabled || m_bBridgeAttached);
+   for (uint32_t i = 0; i < m_effects.Size(); i++)
+   {
+      EffectSlot* pSlot = m_effects.At(i);
+      if (pSlot->type == Effects::Type::CustomForce)
+      {
+         UploadPendingCustomForce(pSlot, false);
+         continue;
+      }
+      if (!pSlot->target.Read(target))
+      {
+         continue;
+      }
+      if (pSlot == pForceSlot)
+      {
+         const FFBConstantForceParams& force = target.params.constantForce;
+         if ((target.flags & DIEP_TYPESPECIFICPARAMS) != 0)
+         {
+            m_gameForce.magnitude = force.magnitude;
+         }
+         if ((target.flags & DIEP_DIRECTION) != 0)
+         {
+            memcpy(m_gameForce.directions, force.directions, sizeof(m_gameForce.directions));
+         }
+         if (bShaped)
+         {
+            // Sent below once synthesized and conditioned.
+            continue;
+         }
+      }
+      m_outputThread.CountUpdate((this->*s_typedEffects[pSlot->type].applyTarget)(pSlot, target));
+   }
+   if (bShaped)
+   {
+      ShapeForce(pForceSlot);
+   }
+   if (m_bGovernedTick)
+   {
+      m_bGovernedTick = false;
+      int rateHz = m_outputThread.GetRate();
+      int newRateHz = m_governor.EndTick(startUs, KeyframeClockUs(), rateHz);
+      if (newRateHz != rateHz)
+      {
+         m_outputThread.SetRate(newRateHz);
+      }
+   }
+}
+
+/**
+ * Build the force of every axis from the bridge, the game's keyframes or
+ * its constant force plus the synthesized conditions and the force
+ * layers, run it through the DSP chain and send it through pSlot. Called
+ * with m_effectLock held.
+ */
+void FFBDeviceContext::ShapeForce(EffectSlot* pSlot)
+{
+   int axisCount = EffectAxisCount();
+
+   float force[MAX_FFB_AXES] = { 0 };
+   if (m_bSynthEnabled && !SynthesizeForce(axisCount, force))
+   {
+      return;
+   }
+   if (m_bMixerEnabled)
+   {
+      if (!m_bMixerPrimed)
+      {
+         m_mixer.Reset();
+         m_bMixerPrimed = true;
+      }
+      m_mixer.Mix(KeyframeClockUs(), axisCount, force);
+   }
+
+   // The game's force comes from the bridge while its writer is alive,
+   // otherwise from its keyframes once there are any.
+   float game[MAX_FFB_AXES] = { 0 };
+   bool bBridged = m_bBridgeAttached && m_bridge.Sample(KeyframeClockUs(), axisCount, game);
+   bool bKeyframed = false;
+   if (m_bKeyframesEnabled && !bBridged)
+   {
+      if (!m_bKeyframesPrimed)
+      {
+         m_keyframes.Reset();
+         m_bKeyframesPrimed = true;
+      }
+      bKeyframed = m_keyframes.Sample(KeyframeClockUs(), axisCount, game);
+   }
+   if (!bBridged && !bKeyframed)
+   {
+      ResolveForce(m_gameForce.magnitude, m_gameForce.directions, axisCount, game);
+   }
+   for (int i = 0; i < axisCount; i++)
+   {
+      force[i] += game[i];
+   }
+
+   if (m_bDspEnabled)
+   {
+      if (!m_bDspPrimed)
+      {
+         m_dsp.Reset();
+         m_bDspPrimed = true;
+      }
+      m_dsp.Process(force, axisCount, (float)m_outputThread.GetRate(), force);
+   }
+
+   LONG magnitude;
+   LONG directions[MAX_FFB_AXES] = { 0 };
+   ComposeForce(force, axisCount, m_gameForce.directions, magnitude, directions);
+   m_outputThread.CountUpdate(ApplyConstantForce(pSlot, magnitude, directions));
+   if (bKeyframed)
+   {
+      m_keyframes.Applied(KeyframeClockUs());
+   }
+}
+
+/**
+ * Read the wheel position and step the software condition effects, their
+ * force is added to force. Called with m_effectLock held, false if the
+ * position could not be read.
+ */
+bool FFBDeviceContext::SynthesizeForce(int axisCount, float* force)
+{
+   DIJOYSTATE state;
+   HRESULT hr = FFB_STAT_CALL(FFBStatCalls::Type::DriverGetState, m_pDevice->GetState(&state));
+   if (FAILED(hr))
+   {
+      m_outputThread.CountUpdate(hr);
+      return false;
+   }
+
+   LONG positions[MAX_FFB_AXES] = { 0 };
+   for (int i = 0; i < axisCount; i++)
+   {
+      // The force feedback axes are among lX .. lRz, addressed by offset.
+      DWORD offset = m_axisSnapshot[i].offset;
+      if (offset + sizeof(LONG) <= sizeof(LONG) * MAX_FFB_AXES)
+      {
+         positions[i] = *(const LONG*)((const BYTE*)&state + offset);
+      }
+   }
+
+   // Real elapsed time, bounded so a stall does not blow up the estimates.
+   auto now = std::chrono::steady_clock::now();
+   float dt = 0.001f;
+   if (m_bSynthStepped)
+   {
+      dt = std::chrono::duration<float>(now - m_tLastSynthStep).count();
+      dt = clamp(dt, 0.0001f, 0.05f);
+   }
+   m_tLastSynthStep = now;
+   m_bSynthStepped = true;
+
+   m_synth.Step(positions, axisCount, dt, force);
+   return true;
+}
+
+/**
+ * Evaluate condition effects (spring, damper, inertia, friction) in the
+ * plugin from the polled wheel position instead of on the device. Fails
+ * with E_ABORT if a condition effect was already created on the device.
+ */
+HRESULT FFBDeviceContext::EnableSynthesis(const ForceSynthConfig* config)
+{
+   if (config != NULL && (config->velocityCutoffHz <= 0 || config->accelerationCutoffHz <= 0
+      || config->velocityFullScale <= 0 || config->accelerationFullScale <= 0
+      || config->frictionVelocityThreshold <= 0))
+   {
+      return E_INVALIDARG;
+   }
+
+   std::lock_guard<std::mutex> lock(m_effectLock);
+   for (uint32_t i = 0; i < m_effects.Size(); i++)
+   {
+      EffectSlot* pSlot = m_effects.At(i);
+      if (pSlot->pEffect != NULL && IsConditionEffect(pSlot->type))
+      {
+         return E_ABORT;
+      }
+   }
+   if (config != NULL)
+   {
+      m_synth.Configure(*config);
+   }
+   m_synth.Reset();
+   m_bSynthStepped = false;
+   m_bSynthEnabled = true;
+   return S_OK;
+}
+
+void FFBDeviceContext::DisableSynthesis()
+{
+   std::lock_guard<std::mutex> lock(m_effectLock);
+   if (!m_bSynthEnabled)
+   {
+      return;
+   }
+   m_bSynthEnabled = false;
+   RestoreGameForce();
+}
+
+void FFBDeviceContext::GetSynthState(ForceSynthState& state)
+{
+   m_synth.GetState(state);
+}
+
+/**
+ * Set the DSP chain of one axis, or of every axis when axis is -1, and
+ * start conditioning the constant force. A NULL config bypasses the axis.
+ */
+HRESULT FFBDeviceContext::ConfigureDsp(int axis, const ForceDspConfig* config)
+{
+   if (axis < -1 || axis >= AxisCount() || axis >= MAX_FFB_AXES)
+   {
+      return E_INVALIDARG;
+   }
+   if (config != NULL && FAILED(ForceDsp::Validate(*config)))
+   {
+      return E_INVALIDARG;
+   }
+
+   std::lock_guard<std::mutex> lock(m_effectLock);
+   m_dsp.Configure(axis, config);
+   m_bDspEnabled = true;
+   return S_OK;
+}
+
+void FFBDeviceContext::DisableDsp()
+{
+   std::lock_guard<std::mutex> lock(m_effectLock);
+   if (!m_bDspEnabled)
+   {
+      return;
+   }
+   m_bDspEnabled = false;
+   m_bDspPrimed = false;
+   m_dsp.Configure(-1, NULL);
+   RestoreGameForce();
+}
+
+bool FFBDeviceContext::GetDspConfig(int axis, ForceDspConfig& config) const
+{
+   if (!m_dsp.IsConfigured(axis))
+   {
+      return false;
+   }
+   m_dsp.GetConfig(axis, config);
+   return true;
+}
+
+void FFBDeviceContext::GetDspState(ForceDspState& state)
+{
+   m_dsp.GetState(state);
+}
+
+/**
+ * Take the game's force from keyframes submitted with SubmitKeyframes,
+ * resampled to the output rate. config may be NULL for the defaults.
+ */
+HRESULT FFBDeviceContext::EnableKeyframes(const FFBKeyframeConfig* config)
+{
+   FFBKeyframeConfig defaults;
+   if (config == NULL)
+   {
+      KeyframeResampler::DefaultConfig(defaults);
+      config = &defaults;
+   }
+   if (FAILED(KeyframeResampler::Validate(*config)))
+   {
+      return E_INVALIDARG;
+   }
+
+   std::lock_guard<std::mutex> lock(m_effectLock);
+   m_keyframes.Configure(*config);
+   m_bKeyframesPrimed = false;
+   m_bKeyframesEnabled = true;
+   return S_OK;
+}
+
+void FFBDeviceContext::DisableKeyframes()
+{
+   std::lock_guard<std::mutex> lock(m_effectLock);
+   if (!m_bKeyframesEnabled)
+   {
+      return;
+   }
+   m_bKeyframesEnabled = false;
+   RestoreGameForce();
+}
+
+/**
+ * Queue keyframes for the output thread. While it is stopped the newest
+ * keyframe is applied right away instead. S_FALSE if some were dropped
+ * because the queue was full or they were not newer than the previous one.
+ */
+HRESULT FFBDeviceContext::SubmitKeyframes(const FFBForceKeyframe* keyframes, int keyframeCount)
+{
+   if (keyframes == NULL || keyframeCount < 0)
+   {
+      return E_INVALIDARG;
+   }
+   if (!m_bKeyframesEnabled)
+   {
+      return E_ABORT;
+   }
+   EffectSlot* pSlot = GetTypeSlot(Effects::Type::ConstantForce);
+   if (pSlot == NULL)
+   {
+      return E_FAIL;
+   }
+   if (keyframeCount == 0)
+   {
+      return S_OK;
+   }
+   if (!m_outputThread.IsRunning())
+   {
+      LONG magnitude;
+      LONG directions[MAX_FFB_AXES] = { 0 };
+      ComposeForce(keyframes[keyframeCount - 1].force, EffectAxisCount(), pSlot->directions, magnitude, directions);
+      return ApplyConstantForce(pSlot, magnitude, directions);
+   }
+
+   HRESULT hr = S_OK;
+   int64_t now = KeyframeClockUs();
+   for (int i = 0; i < keyframeCount; i++)
+   {
+      if (!m_keyframes.Submit(keyframes[i], now))
+      {
+         hr = S_FALSE;
+      }
+   }
+   return hr;
+}
+
+void FFBDeviceContext::GetKeyframeStats(FFBKeyframeStats& stats) const
+{
+   m_keyframes.GetStats(stats);
+}
+
+/**
+ * Set the headroom and ducking speed of the force layers, NULL for the
+ * defaults.
+ */
+HRESULT FFBDeviceContext::ConfigureMixer(const FFBForceMixerConfig* config)
+{
+   FFBForceMixerConfig defaults;
+   if (config == NULL)
+   {
+      ForceMixer::DefaultConfig(defaults);
+      config = &defaults;
+   }
+   if (FAILED(ForceMixer::Validate(*config)))
+   {
+      return E_INVALIDARG;
+   }
+   m_mixer.Configure(*config);
+   return S_OK;
+}
+
+/**
+ * Add a force layer, the first one starts mixing the layers into the
+ * constant force on the output thread.
+ */
+HRESULT FFBDeviceContext::CreateForceLayer(LPCSTR name, const FFBForceLayerConfig* config, FFBForceLayerHandle* layer)
+{
+   if (config == NULL)
+   {
+      return E_POINTER;
+   }
+   std::lock_guard<std::mutex> lock(m_effectLock);
+   HRESULT hr = m_mixer.CreateLayer(name, *config, layer);
+   if (SUCCEEDED(hr) && !m_bMixerEnabled)
+   {
+      m_bMixerPrimed = false;
+      m_bMixerEnabled = true;
+   }
+   return hr;
+}
+
+HRESULT FFBDeviceContext::FindForceLayer(LPCSTR name, FFBForceLayerHandle* layer) const
+{
+   return m_mixer.FindLayer(name, layer);
+}
+
+HRESULT FFBDeviceContext::ConfigureForceLayer(FFBForceLayerHandle layer, const FFBForceLayerConfig* config)
+{
+   if (config == NULL)
+   {
+      return E_POINTER;
+   }
+   return m_mixer.ConfigureLayer(layer, *config);
+}
+
+/**
+ * Set the force of a layer, one entry per axis. Takes no lock, the layer
+ * is handed to the output thread on its own.
+ */
+HRESULT FFBDeviceContext::UpdateForceLayer(FFBForceLayerHandle layer, const float* force)
+{
+   return m_mixer.UpdateLayer(layer, force, AxisCount());
+}
+
+/**
+ * Remove a force layer, once none are left the game's own force is sent
+ * again.
+ */
+HRESULT FFBDeviceContext::DestroyForceLayer(FFBForceLayerHandle layer)
+{
+   std::lock_guard<std::mutex> lock(m_effectLock);
+   HRESULT hr = m_mixer.DestroyLayer(layer);
+   if (SUCCEEDED(hr) && m_mixer.LayerCount() == 0)
+   {
+      m_bMixerEnabled = false;
+      RestoreGameForce();
+   }
+   return hr;
+}
+
+HRESULT FFBDeviceContext::GetForceLayerState(FFBForceLayerHandle layer, FFBForceLayerState& state)
+{
+   return m_mixer.GetLayerState(layer, state);
+}
+
+void FFBDeviceContext::GetMixerState(FFBForceMixerState& state)
+{
+   m_mixer.GetState(state);
+}
+
+/**
+ * Read the force another process publishes in the shared memory region
+ * name (see bridge-format.h) on the output thread. The region does not
+ * have to exist yet. config may be NULL for the defaults.
+ */
+HRESULT FFBDeviceContext::AttachBridge(LPCSTR name, const FFBBridgeConfig* config)
+{
+   FFBBridgeConfig defaults;
+   if (config == NULL)
+   {
+      ForceBridge::DefaultConfig(defaults);
+      config = &defaults;
+   }
+   if (FAILED(ForceBridge::Validate(name, *config)))
+   {
+      return E_INVALIDARG;
+   }
+
+   std::lock_guard<std::mutex> lock(m_effectLock);
+   m_bridge.Attach(name, *config);
+   m_bBridgeAttached = true;
+   return S_OK;
+}
+
+void FFBDeviceContext::DetachBridge()
+{
+   std::lock_guard<std::mutex> lock(m_effectLock);
+   if (!m_bBridgeAttached)
+   {
+      return;
+   }
+   m_bridge.Detach();
+   m_bBridgeAttached = false;
+   RestoreGameForce();
+}
+
+void FFBDeviceContext::GetBridgeStats(FFBBridgeStats& stats)
+{
+   std::lock_guard<std::mutex> lock(m_effectLock);
+   m_bridge.GetStats(KeyframeClockUs(), stats);
+}
+
+/**
+ * Let the output thread's rate follow how fast the device takes updates,
+ * starting from the rate it runs at, moved into the configured range by
+ * its next tick. NULL config for the defaults.
+ */
+HRESULT FFBDeviceContext::EnableRateGovernor(const FFBRateGovernorConfig* config)
+{
+   FFBRateGovernorConfig defaults;
+   if (config == NULL)
+   {
+      RateGovernor::DefaultConfig(defaults);
+      config = &defaults;
+   }
+   if (FAILED(RateGovernor::Validate(*config)))
+   {
+      return E_INVALIDARG;
+   }
+
+   std::lock_guard<std::mutex> lock(m_effectLock);
+   m_governor.Enable(*config);
+   return S_OK;
+}
+
+/**
+ * Stop adapting, the output rate stays where the governor left it.
+ */
+void FFBDeviceContext::DisableRateGovernor()
+{
+   std::lock_guard<std::mutex> lock(m_effectLock);
+   m_governor.Disable();
+}
+
+void FFBDeviceContext::GetRateGovernorStats(FFBRateGovernorStats& stats)
+{
+   std::lock_guard<std::mutex> lock(m_effectLock);
+   m_governor.GetStats(stats);
+   stats.rateHz = m_outputThread.GetRate();
+}
+
+/**
+ * Send the game's own constant force again once nothing shapes it any
+ * more. Called with m_effectLock held.
+ */
+void FFBDeviceContext::RestoreGameForce()
+{
+   if (m_bSynthEnabled || m_bDspEnabled || m_bKeyframesEnabled || m_bMixerEnabled || m_bBridgeAttached)
+   {
+      return;
+   }
+   EffectSlot* pSlot = GetTypeSlot(Effects::Type::ConstantForce);
+   if (pSlot != NULL)
+   {
+      ApplyConstantForce(pSlot, m_gameForce.magnitude, m_gameForce.directions);
+   }
+}
@@ -0,0 +1,448 @@
+#pragma once
+#include "pch.h"
+#include "unity-ffb.h"
+#include "backend.h"
+#include "effect-state.h"
+#include "effect-traits.h"
+#include "output-thread.h"
+#include "triple-buffer.h"
+#include "synth.h"
+#include "force-dsp.h"
+#include "keyframes.h"
+#include "force-mixer.h"
+#include "slot-map.h"
+#include "fixed-pool.h"
+#include "enum-snapshot.h"
+#include "capability-cache.h"
+#include "input-capture.h"
+#include "force-bridge.h"
+#include "rate-governor.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+
+static const int EFFECT_TYPE_COUNT = Effects::Type::CustomForce + 1;
+static_assert(EFFECT_TYPE_COUNT == FFB_EFFECT_TYPE_COUNT, "FFB_EFFECT_TYPE_COUNT must match Effects::Type");
+
+// Effects a device holds unless SetEffectCapacity says otherwise.
+static const int DEFAULT_EFFECT_CAPACITY = 32;
+
+// Every Nth SetParameters is timed to measure the update latency.
+static const uint32_t LATENCY_SAMPLE_INTERVAL = 16;
+
+/**
+ * Latest target published by the Update* functions for one effect while
+ * the force output thread is running: the parameters of the effect's type
+ * and the DIEP_* fields of them to send.
+ */
+struct EffectTarget {
+   DWORD flags;
+   EffectParams params;
+};
+
+/**
+ * Chunks of a CustomForce effect on their way to the device. While the
+ * force output thread is running a chunk waits here, samples unread, until
+ * the chunk before it has played out, so the caller can fill one buffer
+ * while the other plays. Guarded by m_effectLock.
+ */
+struct CustomForceStream {
+   FFBCustomForce pending;
+   LONG directions[MAX_FFB_AXES];
+   DWORD flags;
+   bool bPending;
+   // When the chunk last uploaded finishes its first pass, 0 before the
+   // first upload.
+   int64_t playingEndUs;
+   double uploadMicrosecondsSum;
+   FFBCustomForceStats stats;
+};
+
+/**
+ * One effect on the device. effect points into the slot's own axis,
+ * direction and parameter storage.
+ */
+struct EffectSlot {
+   Effects::Type type;
+   // NULL while the effect is synthesized instead of created on the device.
+   FFBEffect* pEffect;
+   DIEFFECT effect;
+   DWORD axes[MAX_FFB_AXES];
+   LONG directions[MAX_FFB_AXES];
+   union {
+      DICONSTANTFORCE constantForce;
+      DIRAMPFORCE rampForce;
+      DICONDITION conditions[MAX_FFB_AXES];
+      DIPERIODIC periodic;
+      DICUSTOMFORCE customForce;
+   } params;
+   DIENVELOPE envelope;
+   AppliedEffectState applied;
+   TripleBuffer<EffectTarget> target;
+   CustomForceStream stream;
+};
+
+// Effect updates received/forwarded, summed over all devices.
+extern std::atomic<uint32_t> g_nCallsReceived;
+extern std::atomic<uint32_t> g_nCallsForwarded;
+extern std::atomic<uint32_t> g_nParameterBytesSent;
+
+/**
+ * Everything that belongs to one open force feedback device: its axes,
+ * effects, force output thread and force synthesizer. Devices share no
+ * state, each has its own output thread so a slow device cannot delay the
+ * updates of another.
+ *
+ * Effects are addressed by handle, any number of effects of each type can
+ * exist up to the effect capacity. The first effect created of each type
+ * is also reachable by type, which is what the type based functions
+ * (UpdateConstantForce, UpdateCondition, SubmitCommands, ...) address.
+ * When it is destroyed another effect of the type, if any, takes its
+ * place.
+ *
+ * Methods are called from the game thread, except OutputTick which runs on
+ * the device's output thread. m_effectLock guards the effect table between
+ * the two, lookups from the game thread need no lock as only it changes
+ * the table.
+ */
+class FFBDeviceContext
+{
+public:
+   FFBDeviceContext(FFBDevice* pDevice, REFGUID guidInstance);
+   ~FFBDeviceContext();
+
+   const GUID& GetInstanceGuid() const { return m_guidInstance; }
+
+   // Set while the device is unplugged, until Restore succeeds.
+   bool IsLost() const { return m_bLost; }
+   void MarkLost() { m_bLost = true; }
+   HRESULT Restore(FFBDevice* pDevice);
+
+   // Axes found by the last EnumerateAxes, what direction and condition
+   // arrays passed in must hold.
+   int AxisCount() const { return (int)m_axisSnapshot.Count(); }
+   // Axes effects are created on, what the slot's direction and condition
+   // arrays hold: AxisCount up to MAX_FFB_AXES.
+   int EffectAxisCount() const { return AxisCount() < MAX_FFB_AXES ? AxisCount() : MAX_FFB_AXES; }
+   const FFBEnumSnapshot* EnumerateAxisSnapshot();
+   DeviceAxisInfo* EnumerateAxes(int& axisCount);
+
+   /**
+    * How the device was enumerated, what DescribeCapabilities reports it
+    * as.
+    */
+   void SetDeviceRecord(const FFBDeviceRecord& device, const char* instanceName, const char* productName);
+   /**
+    * Take the axes and capabilities from the device's record in the cache
+    * and check them against the device in the background, or, if it has
+    * none, probe the device in the background. True if it had a record.
+    */
+   bool UseCapabilityCache(const FFBEnumSnapshot* cache);
+   /**
+    * Blocks until the device was probed unless its capabilities came from
+    * the cache.
+    */
+   HRESULT GetCapabilities(FFBDeviceCapabilities& capabilities);
+   // Where the capabilities came from, picks up a finished check without
+   // waiting for one still running.
+   FFBCapabilitySources::Type PollCapabilities();
+   // S_FALSE if there is nothing worth caching yet.
+   HRESULT DescribeCapabilities(CapabilityEntry& entry);
+   HRESULT AddEffect(Effects::Type effectType);
+   HRESULT RemoveEffect(Effects::Type effectType);
+   void StartAllEffects();
+   void StopAllEffects();
+   HRESULT UpdateEffectGain(Effects::Type effectType, float gainPercent);
+   HRESULT UpdateConstantForce(LONG magnitude, const LONG* directions);
+   HRESULT UpdateCondition(Effects::Type effectType, const DICONDITION* conditions);
+   HRESULT UpdatePeriodic(Effects::Type effectType, const FFBPeriodicEffect* periodic, const LONG* directions);
+   HRESULT UpdateCustomForce(const FFBCustomForce* customForce, const LONG* directions);
+   HRESULT UpdateEffect(Effects::Type effectType, const void* params, DWORD flags);
+   HRESULT SubmitCommands(const FFBCommand* commands, int commandCount, HRESULT* results);
+   HRESULT SetAutoCenter(bool autoCenter);
+   // Last SetAutoCenter, -1 if never set.
+   int GetAutoCenter() const { return m_nAutoCenter; }
+
+   HRESULT SetEffectCapacity(int capacity);
+   HRESULT CreateEffect(Effects::Type effectType, FFBEffectHandle* effect);
+   HRESULT DestroyEffect(FFBEffectHandle effect);
+   HRESULT UpdateEffectConstantForce(FFBEffectHandle effect, LONG magnitude, const LONG* directions);
+   HRESULT UpdateEffectCondition(FFBEffectHandle effect, const DICONDITION* conditions);
+   HRESULT UpdateEffectPeriodic(FFBEffectHandle effect, const FFBPeriodicEffect* periodic, const LONG* directions);
+   HRESULT UpdateEffectCustomForce(FFBEffectHandle effect, const FFBCustomForce* customForce, const LONG* directions);
+   HRESULT UpdateFFBEffect(FFBEffectHandle effect, const void* params, DWORD flags);
+   // False if there is no such effect.
+   bool GetEffectType(FFBEffectHandle effect, Effects::Type& effectType);
+   HRESULT GetCustomForceStats(FFBEffectHandle effect, FFBCustomForceStats& stats);
+   HRESULT SetEffectGain(FFBEffectHandle effect, float gainPercent);
+   HRESULT StartEffect(FFBEffectHandle effect);
+   HRESULT StopEffect(FFBEffectHandle effect);
+
+   /**
+    * Create effects up front for CreateEffect to hand out, see m_vEffectPool.
+    * Enumerates the axes if that was not done yet.
+    */
+   static HRESULT ValidateEffectPool(const FFBEffectPoolConfig& config);
+   HRESULT FillEffectPool(const FFBEffectPoolConfig& config);
+   void GetEffectPoolStats(FFBEffectPoolStats& stats) const;
+   void GetMemoryStats(FFBMemoryStats& stats) const;
+
+   HRESULT StartOutputThread(int rateHz);
+   void StopOutputThread();
+   HRESULT SetOutputRate(int rateHz);
+   void GetOutputStats(ForceOutputStats& stats) const;
+   void ResetOutputStats();
+
+   HRESULT EnableSynthesis(const ForceSynthConfig* config);
+   void DisableSynthesis();
+   bool IsSynthEnabled() const { return m_bSynthEnabled; }
+   bool GetTypeEffectState(Effects::Type effectType, bool& running);
+   void GetSynthState(ForceSynthState& state);
+
+   HRESULT ConfigureDsp(int axis, const ForceDspConfig* config);
+   void DisableDsp();
+   bool IsDspEnabled() const { return m_bDspEnabled; }
+   // False if the axis is bypassed.
+   bool GetDspConfig(int axis, ForceDspConfig& config) const;
+   void GetDspState(ForceDspState& state);
+
+   HRESULT EnableKeyframes(const FFBKeyframeConfig* config);
+   void DisableKeyframes();
+   bool IsKeyframesEnabled() const { return m_bKeyframesEnabled; }
+   const FFBKeyframeConfig& GetKeyframeConfig() const { return m_keyframes.GetConfig(); }
+   HRESULT SubmitKeyframes(const FFBForceKeyframe* keyframes, int keyframeCount);
+   void GetKeyframeStats(FFBKeyframeStats& stats) const;
+
+   HRESULT ConfigureMixer(const FFBForceMixerConfig* config);
+   const FFBForceMixerConfig& GetMixerConfig() const { return m_mixer.GetConfig(); }
+   HRESULT CreateForceLayer(LPCSTR name, const FFBForceLayerConfig* config, FFBForceLayerHandle* layer);
+   HRESULT FindForceLayer(LPCSTR name, FFBForceLayerHandle* layer) const;
+   HRESULT ConfigureForceLayer(FFBForceLayerHandle layer, const FFBForceLayerConfig* config);
+   HRESULT UpdateForceLayer(FFBForceLayerHandle layer, const float* force);
+   HRESULT DestroyForceLayer(FFBForceLayerHandle layer);
+   int ForceLayerCount() const { return m_mixer.LayerCount(); }
+   FFBForceLayerHandle ForceLayerAt(int position, LPCSTR& name, FFBForceLayerConfig& config) const { return m_mixer.LayerAt(position, name, config); }
+   HRESULT GetForceLayerState(FFBForceLayerHandle layer, FFBForceLayerState& state);
+   void GetMixerState(FFBForceMixerState& state);
+
+   HRESULT StartInputCapture(const FFBInputCaptureConfig& config);
+   void StopInputCapture();
+   void GetInputRing(FFBInputRing& ring) { m_input.GetRing(ring); }
+   void GetInputCaptureStats(FFBInputCaptureStats& stats) const { m_input.GetStats(stats); }
+
+   HRESULT AttachBridge(LPCSTR name, const FFBBridgeConfig* config);
+   void DetachBridge();
+   void GetBridgeStats(FFBBridgeStats& stats);
+
+   HRESULT EnableRateGovernor(const FFBRateGovernorConfig* config);
+   void DisableRateGovernor();
+   void GetRateGovernorStats(FFBRateGovernorStats& stats);
+
+private:
+   EffectSlot* GetSlot(FFBEffectHandle effect);
+   EffectSlot* GetTypeSlot(Effects::Type effectType);
+   EffectSlot* AcquireSlot();
+   void InitEffectSlot(EffectSlot* pSlot, int axisCount);
+   HRESULT FillEffectPool();
+   FFBEffect* TakePooledEffect(Effects::Type effectType, int axisCount);
+   bool RecycleEffect(EffectSlot* pSlot);
+   void ReleaseEffectPool();
+   void CountEffectCreated(float microseconds);
+   HRESULT UpdateConstantForce(EffectSlot* pSlot, LONG magnitude, const LONG* directions);
+   HRESULT UpdateCondition(EffectSlot* pSlot, const DICONDITION* conditions);
+   HRESULT UpdatePeriodic(EffectSlot* pSlot, const FFBPeriodicEffect& periodic, const LONG* directions);
+   HRESULT UpdateCustomForce(EffectSlot* pSlot, const FFBCustomForce& customForce, const LONG* directions, DWORD flags);
+   HRESULT UpdateGain(EffectSlot* pSlot, float gainPercent);
+   HRESULT ApplyConstantForce(EffectSlot* pSlot, LONG magnitude, const LONG* directions);
+   HRESULT ApplyCondition(EffectSlot* pSlot, const DICONDITION* conditions);
+   HRESULT ApplyPeriodic(EffectSlot* pSlot, const FFBPeriodicEffect& periodic, const LONG* directions);
+   HRESULT ApplyCustomForce(EffectSlot* pSlot, const FFBCustomForce& customForce, const LONG* directions, DWORD flags);
+
+   /**
+    * The update of every effect type, instantiated from its EffectTraits:
+    * UpdateTyped checks and publishes or applies the type's parameters,
+    * ApplyTyped sends them, ApplyTarget sends a published target. Reached
+    * through s_typedEffects by type, so choosing the code for a type is a
+    * single indirect call.
+    */
+   typedef HRESULT (FFBDeviceContext::*TypedUpdateFn)(EffectSlot* pSlot, const void* params, DWORD flags);
+   typedef HRESULT (FFBDeviceContext::*TypedTargetFn)(EffectSlot* pSlot, const EffectTarget& target);
+   struct TypedEffect {
+      TypedUpdateFn update;
+      TypedTargetFn applyTarget;
+   };
+   template <Effects::Type T> HRESULT UpdateTyped(EffectSlot* pSlot, const void* params, DWORD flags);
+   template <Effects::Type T> HRESULT ApplyTyped(EffectSlot* pSlot, const typename EffectTraits<T>::Params& params, DWORD flags);
+   template <Effects::Type T> HRESULT ApplyTarget(EffectSlot* pSlot, const EffectTarget& target);
+   template <int... T>
+   static constexpr std::array<TypedEffect, sizeof...(T)> TypedEffects(std::integer_sequence<int, T...>)
+   {
+      return {{ { &FFBDeviceContext::UpdateTyped<(Effects::Type)T>, &FFBDeviceContext::ApplyTarget<(Effects::Type)T> }... }};
+   }
+   static const std::array<TypedEffect, EFFECT_TYPE_COUNT> s_typedEffects;
+   void UploadPendingCustomForce(EffectSlot* pSlot, bool flush);
+   HRESULT SetEffectParameters(EffectSlot* pSlot, const DIEFFECT& effect, DWORD flags);
+   void OutputTick();
+   void InputTick();
+   HRESULT SetInputBufferSize(DWORD bufferSize);
+   void ShapeForce(EffectSlot* pSlot);
+   bool SynthesizeForce(int axisCount, float* force);
+   void RestoreGameForce();
+   void UpdateForceResolution();
+   void SeedCapabilities(const FFBEnumSnapshot* cache, const FFBCapabilityRecord& record);
+   void CheckCapabilities();
+   void CollectCapabilityCheck(bool wait);
+   void ApplyCapabilityCheck();
+   float UpdateLatency() const;
+
+   FFBDevice* m_pDevice;
+   GUID m_guidInstance;
+   bool m_bLost;
+   // Last SetAutoCenter, reapplied by Restore. -1 if never set.
+   int m_nAutoCenter;
+
+   EnumSnapshot<FFBAxisRecord> m_axisSnapshot;
+   // DeviceAxisInfo view of the snapshot for EnumerateAxes.
+   std::vector<DeviceAxisInfo> m_vDeviceAxes;
+   std::vector<GuidText> m_vAxisGuids;
+   SlotMap<EffectSlot*> m_effects;
+   /**
+    * The storage of every effect, device lifetime. Grows when more effects
+    * exist at once than ever before, so creating and destroying effects
+    * allocates nothing once the device held as many. Game thread only.
+    */
+   FixedPool<EffectSlot> m_effectSlots;
+   // The effect of each type the type based functions address, 0 if none.
+   FFBEffectHandle m_hTypeEffects[EFFECT_TYPE_COUNT];
+
+   /**
+    * Effects created and downloaded ahead of time, by type, so creating an
+    * effect costs no driver round trip but the Start. Destroyed effects are
+    * stopped and reset to neutral parameters without a download and go
+    * back into the pool, up to its configured size; the reset is downloaded
+    * by the Start that hands the effect out again. Game thread only.
+    */
+   struct PooledEffect {
+      FFBEffect* pEffect;
+      // Axes it was created with, it only serves effects on as many.
+      int axisCount;
+   };
+   FFBEffectPoolConfig m_poolConfig;
+   std::vector<PooledEffect> m_vEffectPool[EFFECT_TYPE_COUNT];
+   DWORD m_nPoolHits;
+   DWORD m_nPoolMisses;
+   DWORD m_nPoolRecycled;
+   DWORD m_nEffectsCreated;
+   double m_createMicrosecondsSum;
+   float m_maxCreateMicroseconds;
+   float m_poolFillMilliseconds;
+
+   // Smallest force step the device's actuators can render.
+   LONG m_lForceResolution;
+
+   /**
+    * What the device can do. With the capability cache the axes and
+    * capabilities of a cached device are used as they are, a thread checks
+    * them against the device meanwhile and the game thread takes the result
+    * over once it finished. Without a cached record the thread just probes.
+    */
+   FFBDeviceCapabilities m_capabilities;
+   FFBDeviceRecord m_deviceRecord;
+   std::string m_sInstanceName;
+   std::string m_sProductName;
+   // EnumerateAxes returns the cached axes instead of enumerating.
+   bool m_bAxesCached;
+   std::thread m_capabilityCheck;
+   std::atomic<bool> m_bCapabilityCheckDone;
+   // Owned by the check's thread until m_bCapabilityCheckDone.
+   HRESULT m_hrCapabilityCheck;
+   EnumSnapshot<FFBAxisRecord> m_checkedAxes;
+   FFBDeviceCapabilities m_checkedCapabilities;
+   // Sampled SetParameters timings.
+   std::atomic<uint32_t> m_nSetParameters;
+   std::atomic<uint32_t> m_nLatencySamples;
+   std::atomic<uint64_t> m_latencySumUs;
+
+   OutputThread m_outputThread;
+   std::mutex m_effectLock;
+
+   /**
+    * Software condition effects. While enabled, condition effects added to
+    * the device are evaluated by m_synth on the output thread and mixed
+    * into the constant force instead of being created on the device. These
+    * effects have a NULL FFBEffect, only one of each type can exist.
+    */
+   ForceSynth m_synth;
+   std::atomic<bool> m_bSynthEnabled;
+   // Output thread only: when the last step ran.
+   std::chrono::steady_clock::time_point m_tLastSynthStep;
+   bool m_bSynthStepped;
+
+   /**
+    * Conditioning of the constant force. While enabled the output thread
+    * runs the force of every axis, synthesized or not, through m_dsp
+    * before sending it.
+    */
+   ForceDsp m_dsp;
+   std::atomic<bool> m_bDspEnabled;
+   // Output thread only: false until the history was cleared after the
+   // chain was enabled.
+   bool m_bDspPrimed;
+
+   /**
+    * The game's force as timestamped keyframes. While enabled and once
+    * keyframes arrived, the output thread resamples them instead of using
+    * the constant force the game sent.
+    */
+   KeyframeResampler m_keyframes;
+   std::atomic<bool> m_bKeyframesEnabled;
+   // Output thread only: false until the resampler was reset after being
+   // enabled.
+   bool m_bKeyframesPrimed;
+
+   /**
+    * Force layers mixed into the constant force. Enabled while any layer
+    * exists, their mix is added to the synthesized force before the
+    * game's own force.
+    */
+   ForceMixer m_mixer;
+   std::atomic<bool> m_bMixerEnabled;
+   // Output thread only: false until the layers were silenced after the
+   // mixer was enabled.
+   bool m_bMixerPrimed;
+
+   /**
+    * The game's force from another process. While attached and its writer
+    * is alive, the output thread uses the force it publishes instead of
+    * the game's keyframes or constant force.
+    */
+   ForceBridge m_bridge;
+   std::atomic<bool> m_bBridgeAttached;
+
+   /**
+    * Adapts the output rate to how fast the device takes updates, fed
+    * every SetParameters of the output thread while enabled.
+    */
+   RateGovernor m_governor;
+   // True during an output tick the governor times.
+   bool m_bGovernedTick;
+
+   /**
+    * Input capture on a thread of its own, so reading the device never
+    * waits for a force update to go out. It reads the device under
+    * m_effectLock, like the output thread.
+    */
+   OutputThread m_inputThread;
+   InputCapture m_input;
+   // DIPROP_BUFFERSIZE of buffered capture, reapplied by Restore. 0 while
+   // the device does not buffer.
+   DWORD m_dwInputBufferSize;
+
+   // Output thread only: the game's latest constant force for the first
+   // constant force effect, the force synthesis and the DSP chain start
+   // from.
+   FFBConstantForceParams m_gameForce;
+};
@@ -0,0 +1,156 @@
+#include "pch.h"
+#include "device-monitor.h"
+#include "call-stats.h"
+#include <chrono>
+#include <utility>
+
+DeviceMonitor::DeviceMonitor(FFBBackend* pBackend) :
+   m_pBackend(pBackend),
+   m_dwIntervalMs(0),
+   m_bStop(false),
+   m_bScanRequested(false),
+   m_nDroppedEvents(0)
+{
+}
+
+DeviceMonitor::~DeviceMonitor()
+{
+   Stop();
+}
+
+/**
+ * Start the monitor thread, rescanning at least every intervalMs. Fails
+ * with E_ABORT if it is already running.
+ */
+HRESULT DeviceMonitor::Start(DWORD intervalMs)
+{
+   if (intervalMs < MIN_INTERVAL_MS)
+   {
+      return E_INVALIDARG;
+   }
+   if (IsRunning())
+   {
+      return E_ABORT;
+   }
+   m_dwIntervalMs = intervalMs;
+   m_bStop = false;
+   m_bScanRequested = false;
+   // Report everything attached as added again.
+   m_previous.Begin();
+   m_pBackend->SetDeviceChangeCallback(_cbDeviceChange, this);
+   m_thread = std::thread(&DeviceMonitor::Run, this);
+   return S_OK;
+}
+
+/**
+ * Stop the monitor thread. Events already queued can still be polled.
+ */
+void DeviceMonitor::Stop()
+{
+   if (!IsRunning())
+   {
+      return;
+   }
+   m_pBackend->SetDeviceChangeCallback(NULL, NULL);
+   {
+      std::lock_guard<std::mutex> lock(m_wakeLock);
+      m_bStop = true;
+   }
+   m_wake.notify_one();
+   m_thread.join();
+}
+
+void DeviceMonitor::RequestScan()
+{
+   {
+      std::lock_guard<std::mutex> lock(m_wakeLock);
+      m_bScanRequested = true;
+   }
+   m_wake.notify_one();
+}
+
+void DeviceMonitor::_cbDeviceChange(void* context)
+{
+   ((DeviceMonitor*)context)->RequestScan();
+}
+
+void DeviceMonitor::Run()
+{
+   std::unique_lock<std::mutex> lock(m_wakeLock);
+   while (!m_bStop)
+   {
+      m_bScanRequested = false;
+      lock.unlock();
+      Scan();
+      lock.lock();
+      m_wake.wait_for(lock, std::chrono::milliseconds(m_dwIntervalMs), [this]() { return m_bStop || m_bScanRequested; });
+   }
+}
+
+static int FindDevice(const EnumSnapshot<FFBDeviceRecord>& snapshot, REFGUID guidInstance)
+{
+   for (DWORD i = 0; i < snapshot.Count(); i++)
+   {
+      if (snapshot[i].guidInstance == guidInstance)
+      {
+         return (int)i;
+      }
+   }
+   return -1;
+}
+
+/**
+ * Enumerate and queue the differences to the previous scan. Device lists
+ * are a handful of entries, so matching them up linearly is cheapest.
+ */
+void DeviceMonitor::Scan()
+{
+   m_current.Begin();
+   if (FAILED(FFB_STAT_CALL(FFBStatCalls::Type::DriverEnumDevices, m_pBackend->EnumDevices(_cbEnumFFBDevices, &m_current))))
+   {
+      // Keep the previous list, the next scan diffs against it.
+      return;
+   }
+
+   for (DWORD i = 0; i < m_current.Count(); i++)
+   {
+      const FFBDeviceRecord& device = m_current[i];
+      int previous = FindDevice(m_previous, device.guidInstance);
+      if (previous < 0)
+      {
+         Publish(FFBDeviceEvents::Type::Added, device);
+         continue;
+      }
+      const FFBDeviceRecord& before = m_previous[previous];
+      if (before.guidProduct != device.guidProduct || before.deviceType != device.deviceType
+         || strcmp(m_previous.String(before.instanceName), m_current.String(device.instanceName)) != 0
+         || strcmp(m_previous.String(before.productName), m_current.String(device.productName)) != 0)
+      {
+         Publish(FFBDeviceEvents::Type::Changed, device);
+      }
+   }
+   for (DWORD i = 0; i < m_previous.Count(); i++)
+   {
+      if (FindDevice(m_current, m_previous[i].guidInstance) < 0)
+      {
+         Publish(FFBDeviceEvents::Type::Removed, m_previous[i]);
+      }
+   }
+
+   std::swap(m_previous, m_current);
+}
+
+void DeviceMonitor::Publish(FFBDeviceEvents::Type type, const FFBDeviceRecord& device)
+{
+   FFBDeviceEvent event;
+   ZeroMemory(&event, sizeof(event));
+   event.type = type;
+   event.deviceType = device.deviceType;
+   event.guidInstance = device.guidInstance;
+   event.guidProduct = device.guidProduct;
+   event.result = S_OK;
+   if (!m_events.Push(event))
+   {
+      m_nDroppedEvents.fetch_add(1, std::memory_order_relaxed);
+   }
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include "pch.h"
+#include "unity-ffb.h"
+#include "backend.h"
+#include "enum-snapshot.h"
+#include "spsc-queue.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/**
+ * Watches for force feedback devices being attached or removed. A thread
+ * re-enumerates whenever the backend reports a change (and every interval
+ * in case it cannot), diffs the result against the previous enumeration by
+ * instance GUID and queues an event per device added, removed or changed.
+ *
+ * The game thread takes events with Poll, which never blocks. The first
+ * scan after Start reports every attached device as added.
+ */
+class DeviceMonitor
+{
+public:
+   static const DWORD MIN_INTERVAL_MS = 10;
+   static const uint32_t EVENT_CAPACITY = 64;
+
+   DeviceMonitor(FFBBackend* pBackend);
+   ~DeviceMonitor();
+
+   HRESULT Start(DWORD intervalMs);
+   void Stop();
+   bool IsRunning() const { return m_thread.joinable(); }
+
+   /**
+    * Rescan now instead of at the next interval. Any thread.
+    */
+   void RequestScan();
+
+   /**
+    * Take the next event, false if there is none. Game thread only.
+    */
+   bool Poll(FFBDeviceEvent& event) { return m_events.Pop(event); }
+
+   // Events lost because the game did not poll them in time.
+   uint32_t GetDroppedEvents() const { return m_nDroppedEvents.load(std::memory_order_relaxed); }
+
+private:
+   static void _cbDeviceChange(void* context);
+   void Run();
+   void Scan();
+   void Publish(FFBDeviceEvents::Type type, const FFBDeviceRecord& device);
+
+   FFBBackend* m_pBackend;
+   std::thread m_thread;
+   DWORD m_dwIntervalMs;
+
+   std::mutex m_wakeLock;
+   std::condition_variable m_wake;
+   bool m_bStop;
+   bool m_bScanRequested;
+
+   // Monitor thread only.
+   EnumSnapshot<FFBDeviceRecord> m_previous;
+   EnumSnapshot<FFBDeviceRecord> m_current;
+
+   SpscQueue<FFBDeviceEvent, EVENT_CAPACITY> m_events;
+   std::atomic<uint32_t> m_nDroppedEvents;
+};
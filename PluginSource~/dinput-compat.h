@@ -0,0 +1,352 @@
+#pragma once
+
+/**
+ * Minimal definitions of the Win32 and DirectInput 8 types, constants and
+ * GUIDs the plugin uses, so it can be built on platforms without the
+ * Windows SDK. Only the simulated backend is available in such a build.
+ *
+ * Layouts and values match dinput.h so the exported API (and the C# side)
+ * are the same on every platform.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+typedef int32_t           LONG;
+typedef uint32_t          DWORD;
+typedef uint16_t          WORD;
+typedef uint8_t           BYTE;
+typedef int               BOOL;
+typedef LONG              HRESULT;
+typedef wchar_t           WCHAR;
+typedef char*             LPSTR;
+typedef const char*       LPCSTR;
+typedef void*             LPVOID;
+typedef DWORD*            LPDWORD;
+typedef LONG*             LPLONG;
+typedef uintptr_t         UINT_PTR;
+
+#define TRUE              1
+#define FALSE             0
+#define CALLBACK
+#define MAX_PATH          260
+#define INFINITE          0xFFFFFFFF
+
+#define ZeroMemory(p, n)  memset((p), 0, (n))
+
+#define SUCCEEDED(hr)     (((HRESULT)(hr)) >= 0)
+#define FAILED(hr)        (((HRESULT)(hr)) < 0)
+
+#define S_OK              ((HRESULT)0x00000000L)
+#define S_FALSE           ((HRESULT)0x00000001L)
+#define E_NOTIMPL         ((HRESULT)0x80004001L)
+#define E_POINTER         ((HRESULT)0x80004003L)
+#define E_ABORT           ((HRESULT)0x80004004L)
+#define E_FAIL            ((HRESULT)0x80004005L)
+#define E_PENDING         ((HRESULT)0x8000000AL)
+#define E_BOUNDS          ((HRESULT)0x8000000BL)
+#define E_HANDLE          ((HRESULT)0x80070006L)
+#define E_OUTOFMEMORY     ((HRESULT)0x8007000EL)
+#define E_INVALIDARG      ((HRESULT)0x80070057L)
+
+typedef struct _GUID {
+   uint32_t Data1;
+   uint16_t Data2;
+   uint16_t Data3;
+   uint8_t  Data4[8];
+} GUID;
+
+typedef const GUID& REFGUID;
+
+inline bool operator==(const GUID& a, const GUID& b)
+{
+   return memcmp(&a, &b, sizeof(GUID)) == 0;
+}
+
+inline bool operator!=(const GUID& a, const GUID& b)
+{
+   return !(a == b);
+}
+
+static const GUID GUID_NULL = { 0, 0, 0, { 0, 0, 0, 0, 0, 0, 0, 0 } };
+
+/**
+ * DirectInput result codes.
+ */
+#define DI_OK                    S_OK
+#define DI_NOEFFECT              S_FALSE
+#define DI_BUFFEROVERFLOW        S_FALSE
+#define DI_DOWNLOADSKIPPED       ((HRESULT)0x00000003L)
+#define DI_EFFECTRESTARTED       ((HRESULT)0x00000004L)
+#define DI_TRUNCATED             ((HRESULT)0x00000008L)
+#define DIERR_INVALIDPARAM       E_INVALIDARG
+#define DIERR_UNSUPPORTED        E_NOTIMPL
+#define DIERR_NOTACQUIRED        ((HRESULT)0x8007000CL)
+#define DIERR_NOTINITIALIZED     ((HRESULT)0x80070015L)
+#define DIERR_INPUTLOST          ((HRESULT)0x8007001EL)
+#define DIERR_DEVICENOTREG       ((HRESULT)0x80040154L)
+#define DIERR_DEVICEFULL         ((HRESULT)0x80040201L)
+#define DIERR_NOTDOWNLOADED      ((HRESULT)0x80040203L)
+#define DIERR_INCOMPLETEEFFECT   ((HRESULT)0x80040206L)
+#define DIERR_NOTBUFFERED        ((HRESULT)0x80040207L)
+#define DIERR_EFFECTPLAYING      ((HRESULT)0x80040208L)
+
+/**
+ * Enumeration, cooperative level and device type constants.
+ */
+#define DIENUM_STOP              0
+#define DIENUM_CONTINUE          1
+
+#define DI8DEVCLASS_GAMECTRL     4
+#define DI8DEVTYPE_DRIVING       0x16
+
+#define DIEDFL_ATTACHEDONLY      0x00000001
+#define DIEDFL_FORCEFEEDBACK     0x00000100
+
+#define DISCL_EXCLUSIVE          0x00000001
+#define DISCL_NONEXCLUSIVE       0x00000002
+#define DISCL_FOREGROUND         0x00000004
+#define DISCL_BACKGROUND         0x00000008
+
+#define DIDFT_RELAXIS            0x00000001
+#define DIDFT_ABSAXIS            0x00000002
+#define DIDFT_AXIS               0x00000003
+#define DIDFT_BUTTON             0x0000000C
+#define DIDFT_FFACTUATOR         0x01000000
+#define DIDFT_MAKEINSTANCE(n)    ((WORD)(n) << 8)
+
+#define DIDOI_FFACTUATOR         0x00000001
+
+/**
+ * Effect constants.
+ */
+#define DI_FFNOMINALMAX          10000
+#define DI_SECONDS               1000000
+#define DI_DEGREES               100
+
+#define DIEFF_OBJECTIDS          0x00000001
+#define DIEFF_OBJECTOFFSETS      0x00000002
+#define DIEFF_CARTESIAN          0x00000010
+#define DIEFF_POLAR              0x00000020
+#define DIEFF_SPHERICAL          0x00000040
+
+#define DIEB_NOTRIGGER           0xFFFFFFFF
+
+#define DIEP_DURATION            0x00000001
+#define DIEP_SAMPLEPERIOD        0x00000002
+#define DIEP_GAIN                0x00000004
+#define DIEP_TRIGGERBUTTON       0x00000008
+#define DIEP_TRIGGERREPEATINTERVAL 0x00000010
+#define DIEP_AXES                0x00000020
+#define DIEP_DIRECTION           0x00000040
+#define DIEP_ENVELOPE            0x00000080
+#define DIEP_TYPESPECIFICPARAMS  0x00000100
+#define DIEP_STARTDELAY          0x00000200
+#define DIEP_ALLPARAMS_DX5       0x000001FF
+#define DIEP_ALLPARAMS           0x000003FF
+#define DIEP_START               0x20000000
+#define DIEP_NORESTART           0x40000000
+#define DIEP_NODOWNLOAD          0x80000000
+
+#define DIES_SOLO                0x00000001
+#define DIES_NODOWNLOAD          0x80000000
+
+#define DIEFT_CONSTANTFORCE      0x00000001
+#define DIEFT_RAMPFORCE          0x00000002
+#define DIEFT_PERIODIC           0x00000003
+#define DIEFT_CONDITION          0x00000004
+#define DIEFT_CUSTOMFORCE        0x00000005
+
+typedef struct DIENVELOPE {
+   DWORD dwSize;
+   DWORD dwAttackLevel;
+   DWORD dwAttackTime;
+   DWORD dwFadeLevel;
+   DWORD dwFadeTime;
+} DIENVELOPE, *LPDIENVELOPE;
+
+typedef struct DIEFFECT {
+   DWORD dwSize;
+   DWORD dwFlags;
+   DWORD dwDuration;
+   DWORD dwSamplePeriod;
+   DWORD dwGain;
+   DWORD dwTriggerButton;
+   DWORD dwTriggerRepeatInterval;
+   DWORD cAxes;
+   LPDWORD rgdwAxes;
+   LPLONG rglDirection;
+   LPDIENVELOPE lpEnvelope;
+   DWORD cbTypeSpecificParams;
+   LPVOID lpvTypeSpecificParams;
+   DWORD dwStartDelay;
+} DIEFFECT, *LPDIEFFECT;
+typedef const DIEFFECT* LPCDIEFFECT;
+
+typedef struct DICONSTANTFORCE {
+   LONG lMagnitude;
+} DICONSTANTFORCE, *LPDICONSTANTFORCE;
+
+typedef struct DIRAMPFORCE {
+   LONG lStart;
+   LONG lEnd;
+} DIRAMPFORCE, *LPDIRAMPFORCE;
+
+typedef struct DIPERIODIC {
+   DWORD dwMagnitude;
+   LONG lOffset;
+   DWORD dwPhase;
+   DWORD dwPeriod;
+} DIPERIODIC, *LPDIPERIODIC;
+
+typedef struct DICONDITION {
+   LONG lOffset;
+   LONG lPositiveCoefficient;
+   LONG lNegativeCoefficient;
+   DWORD dwPositiveSaturation;
+   DWORD dwNegativeSaturation;
+   LONG lDeadBand;
+} DICONDITION, *LPDICONDITION;
+
+typedef struct DICUSTOMFORCE {
+   DWORD cChannels;
+   DWORD dwSamplePeriod;
+   DWORD cSamples;
+   LPLONG rglForceData;
+} DICUSTOMFORCE, *LPDICUSTOMFORCE;
+
+/**
+ * Properties. Like dinput.h, the predefined property GUIDs are small
+ * integers cast to GUID pointers and are compared by address.
+ */
+typedef struct DIPROPHEADER {
+   DWORD dwSize;
+   DWORD dwHeaderSize;
+   DWORD dwObj;
+   DWORD dwHow;
+} DIPROPHEADER, *LPDIPROPHEADER;
+typedef const DIPROPHEADER* LPCDIPROPHEADER;
+
+typedef struct DIPROPDWORD {
+   DIPROPHEADER diph;
+   DWORD dwData;
+} DIPROPDWORD, *LPDIPROPDWORD;
+
+#define MAKEDIPROP(prop)         (*(const GUID *)(prop))
+#define DIPROP_BUFFERSIZE        MAKEDIPROP(1)
+#define DIPROP_AXISMODE          MAKEDIPROP(2)
+#define DIPROP_RANGE             MAKEDIPROP(4)
+#define DIPROP_DEADZONE          MAKEDIPROP(5)
+#define DIPROP_FFGAIN            MAKEDIPROP(7)
+#define DIPROP_AUTOCENTER        MAKEDIPROP(9)
+
+#define DIPH_DEVICE              0
+#define DIPH_BYOFFSET            1
+
+#define DIPROPAUTOCENTER_OFF     0
+#define DIPROPAUTOCENTER_ON      1
+
+/**
+ * Device state, matching c_dfDIJoystick.
+ */
+typedef struct DIJOYSTATE {
+   LONG lX;
+   LONG lY;
+   LONG lZ;
+   LONG lRx;
+   LONG lRy;
+   LONG lRz;
+   LONG rglSlider[2];
+   DWORD rgdwPOV[4];
+   BYTE rgbButtons[32];
+} DIJOYSTATE, *LPDIJOYSTATE;
+
+#define DIJOFS_X                 0
+#define DIJOFS_Y                 4
+#define DIJOFS_Z                 8
+#define DIJOFS_RX                12
+#define DIJOFS_RY                16
+#define DIJOFS_RZ                20
+#define DIJOFS_SLIDER(n)         (24 + (n) * 4)
+#define DIJOFS_POV(n)            (32 + (n) * 4)
+#define DIJOFS_BUTTON(n)         (48 + (n))
+
+typedef struct DIDEVICEOBJECTDATA {
+   DWORD dwOfs;
+   DWORD dwData;
+   DWORD dwTimeStamp;
+   DWORD dwSequence;
+   UINT_PTR uAppData;
+} DIDEVICEOBJECTDATA, *LPDIDEVICEOBJECTDATA;
+
+typedef struct DIDEVICEINSTANCE {
+   DWORD dwSize;
+   GUID guidInstance;
+   GUID guidProduct;
+   DWORD dwDevType;
+   WCHAR tszInstanceName[MAX_PATH];
+   WCHAR tszProductName[MAX_PATH];
+   GUID guidFFDriver;
+   WORD wUsagePage;
+   WORD wUsage;
+} DIDEVICEINSTANCE, *LPDIDEVICEINSTANCE;
+typedef const DIDEVICEINSTANCE* LPCDIDEVICEINSTANCE;
+
+typedef struct DIDEVICEOBJECTINSTANCE {
+   DWORD dwSize;
+   GUID guidType;
+   DWORD dwOfs;
+   DWORD dwType;
+   DWORD dwFlags;
+   WCHAR tszName[MAX_PATH];
+   DWORD dwFFMaxForce;
+   DWORD dwFFForceResolution;
+   WORD wCollectionNumber;
+   WORD wDesignatorIndex;
+   WORD wUsagePage;
+   WORD wUsage;
+   DWORD dwDimension;
+   WORD wExponent;
+   WORD wReportId;
+} DIDEVICEOBJECTINSTANCE, *LPDIDEVICEOBJECTINSTANCE;
+typedef const DIDEVICEOBJECTINSTANCE* LPCDIDEVICEOBJECTINSTANCE;
+
+typedef struct DIEFFECTINFO {
+   DWORD dwSize;
+   GUID guid;
+   DWORD dwEffType;
+   DWORD dwStaticParams;
+   DWORD dwDynamicParams;
+   WCHAR tszName[MAX_PATH];
+} DIEFFECTINFO, *LPDIEFFECTINFO;
+
+typedef BOOL (CALLBACK *LPDIENUMDEVICESCALLBACK)(LPCDIDEVICEINSTANCE, LPVOID);
+typedef BOOL (CALLBACK *LPDIENUMDEVICEOBJECTSCALLBACK)(LPCDIDEVICEOBJECTINSTANCE, LPVOID);
+
+/**
+ * Axis and effect GUIDs, same values as dxguid.lib.
+ */
+#define UNITYFFB_DI_AXIS_GUID(d1) \
+   { d1, 0xC9F3, 0x11CF, { 0xBF, 0xC7, 0x44, 0x45, 0x53, 0x54, 0x00, 0x00 } }
+#define UNITYFFB_DI_EFFECT_GUID(d1) \
+   { d1, 0x8E33, 0x11D0, { 0x9A, 0xD0, 0x00, 0xA0, 0xC9, 0xA0, 0x6E, 0x35 } }
+
+static const GUID GUID_XAxis         = UNITYFFB_DI_AXIS_GUID(0xA36D02E0);
+static const GUID GUID_YAxis         = UNITYFFB_DI_AXIS_GUID(0xA36D02E1);
+static const GUID GUID_ZAxis         = UNITYFFB_DI_AXIS_GUID(0xA36D02E2);
+static const GUID GUID_RxAxis        = UNITYFFB_DI_AXIS_GUID(0xA36D02F4);
+static const GUID GUID_RyAxis        = UNITYFFB_DI_AXIS_GUID(0xA36D02F5);
+static const GUID GUID_RzAxis        = UNITYFFB_DI_AXIS_GUID(0xA36D02E3);
+
+static const GUID GUID_ConstantForce = UNITYFFB_DI_EFFECT_GUID(0x13541C20);
+static const GUID GUID_RampForce     = UNITYFFB_DI_EFFECT_GUID(0x13541C21);
+static const GUID GUID_Square        = UNITYFFB_DI_EFFECT_GUID(0x13541C22);
+static const GUID GUID_Sine          = UNITYFFB_DI_EFFECT_GUID(0x13541C23);
+static const GUID GUID_Triangle      = UNITYFFB_DI_EFFECT_GUID(0x13541C24);
+static const GUID GUID_SawtoothUp    = UNITYFFB_DI_EFFECT_GUID(0x13541C25);
+static const GUID GUID_SawtoothDown  = UNITYFFB_DI_EFFECT_GUID(0x13541C26);
+static const GUID GUID_Spring        = UNITYFFB_DI_EFFECT_GUID(0x13541C27);
+static const GUID GUID_Damper        = UNITYFFB_DI_EFFECT_GUID(0x13541C28);
+static const GUID GUID_Inertia       = UNITYFFB_DI_EFFECT_GUID(0x13541C29);
+static const GUID GUID_Friction      = UNITYFFB_DI_EFFECT_GUID(0x13541C2A);
+static const GUID GUID_CustomForce   = UNITYFFB_DI_EFFECT_GUID(0x13541C2B);
@@ -0,0 +1,152 @@
+#include "pch.h"
+#include "effect-state.h"
+
+void ResetAppliedEffectState(AppliedEffectState& applied)
+{
+   ZeroMemory(&applied, sizeof(AppliedEffectState));
+}
+
+/**
+ * Returns the subset of flags whose fields differ from what was last
+ * applied. A constant force magnitude that moved by less than the axis
+ * force resolution counts as unchanged, the device could not render the
+ * difference anyway. DIEP_START is dropped while the effect is running.
+ */
+DWORD ChangedEffectParameters(const AppliedEffectState& applied, const DIEFFECT& effect, DWORD flags, LONG forceResolution)
+{
+   if (!applied.valid)
+   {
+      return flags;
+   }
+
+   DWORD changed = flags & ~(DIEP_DURATION | DIEP_GAIN | DIEP_DIRECTION | DIEP_ENVELOPE | DIEP_TYPESPECIFICPARAMS | DIEP_START);
+
+   if ((flags & DIEP_DURATION) != 0 && effect.dwDuration != applied.duration)
+   {
+      changed |= DIEP_DURATION;
+   }
+
+   if ((flags & DIEP_GAIN) != 0 && effect.dwGain != applied.gain)
+   {
+      changed |= DIEP_GAIN;
+   }
+
+   if ((flags & DIEP_DIRECTION) != 0)
+   {
+      if (effect.cAxes != applied.cAxes
+         || memcmp(effect.rglDirection, applied.directions, sizeof(LONG) * effect.cAxes) != 0)
+      {
+         changed |= DIEP_DIRECTION;
+      }
+   }
+
+   if ((flags & DIEP_ENVELOPE) != 0)
+   {
+      bool hasEnvelope = effect.lpEnvelope != NULL;
+      if (hasEnvelope != applied.hasEnvelope
+         || (hasEnvelope && memcmp(effect.lpEnvelope, &applied.envelope, sizeof(DIENVELOPE)) != 0))
+      {
+         changed |= DIEP_ENVELOPE;
+      }
+   }
+
+   if ((flags & DIEP_TYPESPECIFICPARAMS) != 0)
+   {
+      if (effect.cbTypeSpecificParams != applied.cbTypeSpecificParams)
+      {
+         changed |= DIEP_TYPESPECIFICPARAMS;
+      }
+      else if (effect.cbTypeSpecificParams == sizeof(DICONSTANTFORCE))
+      {
+         LONG magnitude = ((const DICONSTANTFORCE*)effect.lpvTypeSpecificParams)->lMagnitude;
+         LONG appliedMagnitude = ((const DICONSTANTFORCE*)applied.typeSpecificParams)->lMagnitude;
+         LONG delta = magnitude > appliedMagnitude ? magnitude - appliedMagnitude : appliedMagnitude - magnitude;
+         if (delta != 0 && delta >= forceResolution)
+         {
+            changed |= DIEP_TYPESPECIFICPARAMS;
+         }
+      }
+      else if (memcmp(effect.lpvTypeSpecificParams, applied.typeSpecificParams, effect.cbTypeSpecificParams) != 0)
+      {
+         changed |= DIEP_TYPESPECIFICPARAMS;
+      }
+   }
+
+   if ((flags & DIEP_START) != 0 && !applied.running)
+   {
+      changed |= DIEP_START;
+   }
+
+   return changed;
+}
+
+/**
+ * Remember the fields selected by flags after the driver accepted them.
+ */
+void RecordAppliedEffectParameters(AppliedEffectState& applied, const DIEFFECT& effect, DWORD flags)
+{
+   if ((flags & DIEP_DURATION) != 0)
+   {
+      applied.duration = effect.dwDuration;
+   }
+   if ((flags & DIEP_GAIN) != 0)
+   {
+      applied.gain = effect.dwGain;
+   }
+   if ((flags & DIEP_ENVELOPE) != 0)
+   {
+      applied.hasEnvelope = effect.lpEnvelope != NULL;
+      if (applied.hasEnvelope)
+      {
+         applied.envelope = *effect.lpEnvelope;
+      }
+   }
+   if ((flags & DIEP_DIRECTION) != 0 && effect.cAxes <= MAX_FFB_AXES)
+   {
+      applied.cAxes = effect.cAxes;
+      memcpy(applied.directions, effect.rglDirection, sizeof(LONG) * effect.cAxes);
+   }
+   if ((flags & DIEP_TYPESPECIFICPARAMS) != 0 && effect.cbTypeSpecificParams <= sizeof(applied.typeSpecificParams))
+   {
+      applied.cbTypeSpecificParams = effect.cbTypeSpecificParams;
+      memcpy(applied.typeSpecificParams, effect.lpvTypeSpecificParams, effect.cbTypeSpecificParams);
+   }
+   if ((flags & DIEP_START) != 0)
+   {
+      applied.running = true;
+   }
+   applied.valid = true;
+}
+
+/**
+ * Size of the parameter data an update with these flags sends.
+ */
+DWORD EffectParameterBytes(const DIEFFECT& effect, DWORD flags)
+{
+   DWORD bytes = 0;
+   if ((flags & DIEP_DURATION) != 0)
+   {
+      bytes += sizeof(DWORD);
+   }
+   if ((flags & DIEP_SAMPLEPERIOD) != 0)
+   {
+      bytes += sizeof(DWORD);
+   }
+   if ((flags & DIEP_GAIN) != 0)
+   {
+      bytes += sizeof(DWORD);
+   }
+   if ((flags & DIEP_DIRECTION) != 0)
+   {
+      bytes += sizeof(LONG) * effect.cAxes;
+   }
+   if ((flags & DIEP_ENVELOPE) != 0 && effect.lpEnvelope != NULL)
+   {
+      bytes += sizeof(DIENVELOPE);
+   }
+   if ((flags & DIEP_TYPESPECIFICPARAMS) != 0)
+   {
+      bytes += effect.cbTypeSpecificParams;
+   }
+   return bytes;
+}
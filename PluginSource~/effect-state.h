@@ -0,0 +1,26 @@
+#pragma once
+#include "pch.h"
+#include "unity-ffb.h"
+
+/**
+ * The parameters last accepted by the driver for one effect. Used to work
+ * out which DIEP_* fields an update actually changes, so unchanged fields
+ * (and updates that change nothing) never reach the device.
+ */
+struct AppliedEffectState {
+   bool valid;
+   bool running;
+   DWORD gain;
+   DWORD cAxes;
+   LONG directions[MAX_FFB_AXES];
+   DWORD cbTypeSpecificParams;
+   BYTE typeSpecificParams[sizeof(DICONDITION) * MAX_FFB_AXES];
+   DWORD duration;
+   bool hasEnvelope;
+   DIENVELOPE envelope;
+};
+
+void ResetAppliedEffectState(AppliedEffectState& applied);
+DWORD ChangedEffectParameters(const AppliedEffectState& applied, const DIEFFECT& effect, DWORD flags, LONG forceResolution);
+void RecordAppliedEffectParameters(AppliedEffectState& applied, const DIEFFECT& effect, DWORD flags);
+DWORD EffectParameterBytes(const DIEFFECT& effect, DWORD flags);
@@ -0,0 +1,267 @@
+#pragma once
+#include "pch.h"
+#include "unity-ffb.h"
+#include <array>
+#include <utility>
+
+/**
+ * Everything that depends on an effect's type, known at compile time: the
+ * DirectInput effect it is created as, the parameters UpdateEffect takes
+ * for it, the driver structure they become and the DIEP_* fields they
+ * cover. The types of one kind share their traits and only differ in the
+ * GUID.
+ *
+ * Code written once against EffectTraits<T> is instantiated for every type
+ * (see FFBDeviceContext::UpdateTyped), code that only knows the type at
+ * run time looks it up in EFFECT_TYPES, which is built from the same
+ * traits.
+ */
+struct EffectKinds {
+   typedef enum {
+      Constant = 0,
+      Ramp = 1,
+      Periodic = 2,
+      Condition = 3,
+      Custom = 4
+   } Type;
+};
+
+/**
+ * Any effect's UpdateEffect parameters, what an effect's target holds.
+ */
+union EffectParams {
+   FFBConstantForceParams constantForce;
+   FFBRampForceParams rampForce;
+   FFBPeriodicParams periodic;
+   FFBConditionParams condition;
+   FFBCustomForceParams customForce;
+};
+
+/**
+ * E_INVALIDARG unless every level is within DI_FFNOMINALMAX and the phase
+ * within a full cycle.
+ */
+inline HRESULT ValidatePeriodic(const FFBPeriodicEffect& periodic)
+{
+   const DIPERIODIC& wave = periodic.periodic;
+   const DIENVELOPE& envelope = periodic.envelope;
+   if (wave.dwMagnitude > DI_FFNOMINALMAX
+      || wave.lOffset > DI_FFNOMINALMAX || wave.lOffset < -DI_FFNOMINALMAX
+      || wave.dwPhase >= 36000
+      || envelope.dwAttackLevel > DI_FFNOMINALMAX || envelope.dwFadeLevel > DI_FFNOMINALMAX)
+   {
+      return E_INVALIDARG;
+   }
+   return S_OK;
+}
+
+/**
+ * E_INVALIDARG unless there are samples, one channel or one per axis and a
+ * sample period.
+ */
+inline HRESULT ValidateCustomForce(const FFBCustomForce& customForce, int axisCount)
+{
+   if (customForce.samples == NULL || customForce.channels == 0 || customForce.channels > (DWORD)axisCount
+      || customForce.sampleCount == 0 || customForce.samplePeriod == 0)
+   {
+      return E_INVALIDARG;
+   }
+   return S_OK;
+}
+
+/**
+ * Point effect at a periodic effect's parameters, copied into params and
+ * envelope. The envelope is left out when it has no attack and no fade.
+ */
+inline void SetPeriodicParameters(DIEFFECT& effect, const FFBPeriodicEffect& periodic, DIPERIODIC& params, DIENVELOPE& envelope)
+{
+   params = periodic.periodic;
+   envelope = periodic.envelope;
+   envelope.dwSize = sizeof(DIENVELOPE);
+   effect.dwDuration = periodic.duration == 0 ? INFINITE : periodic.duration;
+   effect.lpEnvelope = envelope.dwAttackTime != 0 || envelope.dwFadeTime != 0 ? &envelope : NULL;
+   effect.cbTypeSpecificParams = sizeof(DIPERIODIC);
+   effect.lpvTypeSpecificParams = &params;
+}
+
+inline void SetDirections(DIEFFECT& effect, const LONG* directions, int axisCount)
+{
+   for (int i = 0; i < axisCount; i++)
+   {
+      effect.rglDirection[i] = directions[i];
+   }
+}
+
+/**
+ * The traits of each kind. DriverParams is what the driver gets,
+ * driverCount of them; Fill points effect, a copy of the effect's DIEFFECT
+ * for axisCount axes, at params, converted into driver and envelope.
+ */
+struct ConstantForceTraits {
+   typedef FFBConstantForceParams Params;
+   typedef DICONSTANTFORCE DriverParams;
+   static constexpr EffectKinds::Type kind = EffectKinds::Type::Constant;
+   static constexpr int driverCount = 1;
+   static constexpr DWORD parameterFlags = DIEP_DIRECTION | DIEP_TYPESPECIFICPARAMS;
+
+   static HRESULT Validate(const Params&, int) { return S_OK; }
+   static void Fill(DIEFFECT& effect, const Params& params, int axisCount, DriverParams* driver, DIENVELOPE&)
+   {
+      driver->lMagnitude = params.magnitude;
+      SetDirections(effect, params.directions, axisCount);
+      effect.cbTypeSpecificParams = sizeof(DICONSTANTFORCE);
+      effect.lpvTypeSpecificParams = driver;
+   }
+   static Params& Of(EffectParams& params) { return params.constantForce; }
+   static const Params& Of(const EffectParams& params) { return params.constantForce; }
+};
+
+struct RampForceTraits {
+   typedef FFBRampForceParams Params;
+   typedef DIRAMPFORCE DriverParams;
+   static constexpr EffectKinds::Type kind = EffectKinds::Type::Ramp;
+   static constexpr int driverCount = 1;
+   static constexpr DWORD parameterFlags = DIEP_DURATION | DIEP_DIRECTION | DIEP_TYPESPECIFICPARAMS;
+
+   static HRESULT Validate(const Params& params, int)
+   {
+      const DIRAMPFORCE& ramp = params.ramp;
+      if (ramp.lStart > DI_FFNOMINALMAX || ramp.lStart < -DI_FFNOMINALMAX
+         || ramp.lEnd > DI_FFNOMINALMAX || ramp.lEnd < -DI_FFNOMINALMAX
+         || params.duration == 0 || params.duration == INFINITE)
+      {
+         return E_INVALIDARG;
+      }
+      return S_OK;
+   }
+   static void Fill(DIEFFECT& effect, const Params& params, int axisCount, DriverParams* driver, DIENVELOPE&)
+   {
+      *driver = params.ramp;
+      SetDirections(effect, params.directions, axisCount);
+      effect.dwDuration = params.duration;
+      effect.cbTypeSpecificParams = sizeof(DIRAMPFORCE);
+      effect.lpvTypeSpecificParams = driver;
+   }
+   static Params& Of(EffectParams& params) { return params.rampForce; }
+   static const Params& Of(const EffectParams& params) { return params.rampForce; }
+};
+
+struct PeriodicTraits {
+   typedef FFBPeriodicParams Params;
+   typedef DIPERIODIC DriverParams;
+   static constexpr EffectKinds::Type kind = EffectKinds::Type::Periodic;
+   static constexpr int driverCount = 1;
+   static constexpr DWORD parameterFlags = DIEP_DURATION | DIEP_DIRECTION | DIEP_ENVELOPE | DIEP_TYPESPECIFICPARAMS;
+
+   static HRESULT Validate(const Params& params, int) { return ValidatePeriodic(params.effect); }
+   static void Fill(DIEFFECT& effect, const Params& params, int axisCount, DriverParams* driver, DIENVELOPE& envelope)
+   {
+      SetDirections(effect, params.directions, axisCount);
+      SetPeriodicParameters(effect, params.effect, *driver, envelope);
+   }
+   static Params& Of(EffectParams& params) { return params.periodic; }
+   static const Params& Of(const EffectParams& params) { return params.periodic; }
+};
+
+struct ConditionTraits {
+   typedef FFBConditionParams Params;
+   typedef DICONDITION DriverParams;
+   static constexpr EffectKinds::Type kind = EffectKinds::Type::Condition;
+   static constexpr int driverCount = MAX_FFB_AXES;
+   // Conditions have no meaningful direction.
+   static constexpr DWORD parameterFlags = DIEP_TYPESPECIFICPARAMS;
+
+   static HRESULT Validate(const Params&, int) { return S_OK; }
+   static void Fill(DIEFFECT& effect, const Params& params, int axisCount, DriverParams* driver, DIENVELOPE&)
+   {
+      memcpy(driver, params.conditions, sizeof(DICONDITION) * axisCount);
+      effect.cbTypeSpecificParams = sizeof(DICONDITION) * axisCount;
+      effect.lpvTypeSpecificParams = driver;
+   }
+   static Params& Of(EffectParams& params) { return params.condition; }
+   static const Params& Of(const EffectParams& params) { return params.condition; }
+};
+
+struct CustomForceTraits {
+   typedef FFBCustomForceParams Params;
+   typedef DICUSTOMFORCE DriverParams;
+   static constexpr EffectKinds::Type kind = EffectKinds::Type::Custom;
+   static constexpr int driverCount = 1;
+   static constexpr DWORD parameterFlags = DIEP_DURATION | DIEP_DIRECTION | DIEP_TYPESPECIFICPARAMS;
+
+   static HRESULT Validate(const Params& params, int axisCount) { return ValidateCustomForce(params.customForce, axisCount); }
+   static void Fill(DIEFFECT& effect, const Params& params, int axisCount, DriverParams* driver, DIENVELOPE&)
+   {
+      const FFBCustomForce& customForce = params.customForce;
+      driver->cChannels = customForce.channels;
+      driver->dwSamplePeriod = customForce.samplePeriod;
+      driver->cSamples = customForce.channels * customForce.sampleCount;
+      driver->rglForceData = (LPLONG)customForce.samples;
+      SetDirections(effect, params.directions, axisCount);
+      effect.dwDuration = customForce.duration == 0 ? INFINITE : customForce.duration;
+      effect.cbTypeSpecificParams = sizeof(DICUSTOMFORCE);
+      effect.lpvTypeSpecificParams = driver;
+   }
+   static Params& Of(EffectParams& params) { return params.customForce; }
+   static const Params& Of(const EffectParams& params) { return params.customForce; }
+};
+
+template <Effects::Type T> struct EffectTraits;
+
+#define UNITYFFB_EFFECT_TRAITS(type, base, guidType) \
+   template <> struct EffectTraits<Effects::Type::type> : base { static constexpr const GUID* guid = &guidType; }
+
+UNITYFFB_EFFECT_TRAITS(ConstantForce, ConstantForceTraits, GUID_ConstantForce);
+UNITYFFB_EFFECT_TRAITS(RampForce, RampForceTraits, GUID_RampForce);
+UNITYFFB_EFFECT_TRAITS(Square, PeriodicTraits, GUID_Square);
+UNITYFFB_EFFECT_TRAITS(Sine, PeriodicTraits, GUID_Sine);
+UNITYFFB_EFFECT_TRAITS(Triangle, PeriodicTraits, GUID_Triangle);
+UNITYFFB_EFFECT_TRAITS(SawtoothUp, PeriodicTraits, GUID_SawtoothUp);
+UNITYFFB_EFFECT_TRAITS(SawtoothDown, PeriodicTraits, GUID_SawtoothDown);
+UNITYFFB_EFFECT_TRAITS(Spring, ConditionTraits, GUID_Spring);
+UNITYFFB_EFFECT_TRAITS(Damper, ConditionTraits, GUID_Damper);
+UNITYFFB_EFFECT_TRAITS(Inertia, ConditionTraits, GUID_Inertia);
+UNITYFFB_EFFECT_TRAITS(Friction, ConditionTraits, GUID_Friction);
+UNITYFFB_EFFECT_TRAITS(CustomForce, CustomForceTraits, GUID_CustomForce);
+
+#undef UNITYFFB_EFFECT_TRAITS
+
+/**
+ * The traits of a type as data, for code that only knows the type at run
+ * time.
+ */
+struct EffectTypeInfo {
+   const GUID* guid;
+   EffectKinds::Type kind;
+   // Size of the caller's parameters and of one driver structure, there is
+   // one of those per axis if perAxis.
+   DWORD paramsSize;
+   DWORD driverParamsSize;
+   bool perAxis;
+   DWORD parameterFlags;
+};
+
+template <Effects::Type T>
+constexpr EffectTypeInfo DescribeEffectType()
+{
+   typedef EffectTraits<T> Traits;
+   return { Traits::guid, Traits::kind, sizeof(typename Traits::Params), sizeof(typename Traits::DriverParams),
+      Traits::driverCount > 1, Traits::parameterFlags };
+}
+
+template <int... T>
+constexpr std::array<EffectTypeInfo, sizeof...(T)> DescribeEffectTypes(std::integer_sequence<int, T...>)
+{
+   return {{ DescribeEffectType<(Effects::Type)T>()... }};
+}
+
+static constexpr std::array<EffectTypeInfo, FFB_EFFECT_TYPE_COUNT> EFFECT_TYPES =
+   DescribeEffectTypes(std::make_integer_sequence<int, FFB_EFFECT_TYPE_COUNT>());
+
+static_assert(EFFECT_TYPES[Effects::Type::Spring].perAxis && !EFFECT_TYPES[Effects::Type::Sine].perAxis, "EFFECT_TYPES out of order");
+static_assert(EFFECT_TYPES[Effects::Type::CustomForce].kind == EffectKinds::Type::Custom, "EFFECT_TYPES out of order");
+
+inline bool IsEffectKind(Effects::Type effectType, EffectKinds::Type kind)
+{
+   return effectType >= 0 && effectType < FFB_EFFECT_TYPE_COUNT && EFFECT_TYPES[effectType].kind == kind;
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include "pch.h"
+#include "unity-ffb.h"
+#include "util.h"
+#include <string.h>
+
+/**
+ * Builds an FFBEnumSnapshot of Record: records and their strings are
+ * collected while enumerating and Finish packs them behind the header into
+ * one buffer. All buffers keep their capacity between enumerations, so
+ * enumerating again allocates nothing unless there are more records (or
+ * longer names) than before. Release frees everything at once.
+ */
+template <typename Record>
+class EnumSnapshot
+{
+public:
+   /**
+    * Drop the previous snapshot and start collecting a new one.
+    */
+   void Begin()
+   {
+      m_records.clear();
+      m_strings.clear();
+      m_buffer.clear();
+   }
+
+   /**
+    * Append a zeroed record, the reference is valid until the next Add.
+    */
+   Record& Add()
+   {
+      m_records.push_back(Record());
+      return m_records.back();
+   }
+
+   /**
+    * Copy s into the string pool as UTF-8 and return its offset.
+    */
+   DWORD AddString(const WCHAR* s)
+   {
+      DWORD offset = (DWORD)m_strings.size();
+      appendUTF8(s, m_strings);
+      return offset;
+   }
+
+   /**
+    * Copy s, already UTF-8, into the string pool and return its offset.
+    */
+   DWORD AddString(const char* s)
+   {
+      DWORD offset = (DWORD)m_strings.size();
+      m_strings.insert(m_strings.end(), s, s + strlen(s) + 1);
+      return offset;
+   }
+
+   const FFBEnumSnapshot* Finish()
+   {
+      FFBEnumSnapshot header;
+      header.recordCount = (DWORD)m_records.size();
+      header.recordSize = sizeof(Record);
+      header.recordOffset = Align(sizeof(FFBEnumSnapshot));
+      header.stringOffset = Align(header.recordOffset + header.recordCount * header.recordSize);
+      header.stringBytes = (DWORD)m_strings.size();
+      header.size = header.stringOffset + header.stringBytes;
+
+      m_buffer.resize(Align(header.size) / sizeof(uint64_t));
+      BYTE* pBuffer = (BYTE*)&m_buffer[0];
+      memcpy(pBuffer, &header, sizeof(header));
+      if (header.recordCount > 0)
+      {
+         memcpy(pBuffer + header.recordOffset, &m_records[0], header.recordCount * header.recordSize);
+      }
+      if (header.stringBytes > 0)
+      {
+         memcpy(pBuffer + header.stringOffset, &m_strings[0], header.stringBytes);
+      }
+      return Get();
+   }
+
+   void Release()
+   {
+      std::vector<Record>().swap(m_records);
+      std::vector<char>().swap(m_strings);
+      std::vector<uint64_t>().swap(m_buffer);
+   }
+
+   /**
+    * The finished snapshot, NULL before Finish.
+    */
+   const FFBEnumSnapshot* Get() const
+   {
+      return m_buffer.empty() ? NULL : (const FFBEnumSnapshot*)&m_buffer[0];
+   }
+
+   DWORD Count() const { return (DWORD)m_records.size(); }
+   const Record& operator[](DWORD index) const { return m_records[index]; }
+   const char* String(DWORD offset) const { return &m_strings[offset]; }
+
+private:
+   // Keeps the records and the pool 8 byte aligned within the buffer.
+   static DWORD Align(size_t size)
+   {
+      return (DWORD)((size + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1));
+   }
+
+   std::vector<Record> m_records;
+   std::vector<char> m_strings;
+   std::vector<uint64_t> m_buffer;
+};
@@ -0,0 +1,112 @@
+#pragma once
+#include <stdint.h>
+#include <new>
+#include <vector>
+
+/**
+ * Storage for objects of T that never moves: objects are carved from
+ * blocks allocated by Grow and kept on a free list when released, so
+ * acquiring and releasing them allocates nothing once the pool is large
+ * enough. Blocks are only freed with the pool, all at once; objects still
+ * acquired then are not destroyed.
+ *
+ * Not thread safe.
+ */
+template <typename T>
+class FixedPool
+{
+public:
+   explicit FixedPool(uint32_t capacity) :
+      m_pFree(NULL),
+      m_capacity(0),
+      m_nInUse(0),
+      m_nHighWater(0),
+      m_nBytes(0)
+   {
+      Grow(capacity);
+   }
+
+   ~FixedPool()
+   {
+      for (Node* pBlock : m_vBlocks)
+      {
+         ::operator delete(pBlock, std::align_val_t(alignof(Node)));
+      }
+   }
+
+   FixedPool(const FixedPool&) = delete;
+   FixedPool& operator=(const FixedPool&) = delete;
+
+   /**
+    * Add a block of count objects. False if it could not be allocated.
+    */
+   bool Grow(uint32_t count)
+   {
+      if (count == 0)
+      {
+         return true;
+      }
+      Node* pBlock = (Node*)::operator new(sizeof(Node) * count, std::align_val_t(alignof(Node)), std::nothrow);
+      if (pBlock == NULL)
+      {
+         return false;
+      }
+      m_vBlocks.push_back(pBlock);
+      for (uint32_t i = count; i-- > 0;)
+      {
+         pBlock[i].pNext = m_pFree;
+         m_pFree = &pBlock[i];
+      }
+      m_capacity += count;
+      m_nBytes += sizeof(Node) * count;
+      return true;
+   }
+
+   /**
+    * A value initialized object, NULL when every object is in use.
+    */
+   T* Acquire()
+   {
+      if (m_pFree == NULL)
+      {
+         return NULL;
+      }
+      Node* pNode = m_pFree;
+      m_pFree = pNode->pNext;
+      m_nInUse++;
+      m_nHighWater = m_nInUse > m_nHighWater ? m_nInUse : m_nHighWater;
+      return new (pNode->storage) T();
+   }
+
+   void Release(T* pObject)
+   {
+      if (pObject == NULL)
+      {
+         return;
+      }
+      pObject->~T();
+      Node* pNode = reinterpret_cast<Node*>(pObject);
+      pNode->pNext = m_pFree;
+      m_pFree = pNode;
+      m_nInUse--;
+   }
+
+   uint32_t Capacity() const { return m_capacity; }
+   uint32_t InUse() const { return m_nInUse; }
+   uint32_t HighWater() const { return m_nHighWater; }
+   uint32_t BlockCount() const { return (uint32_t)m_vBlocks.size(); }
+   size_t Bytes() const { return m_nBytes; }
+
+private:
+   union Node {
+      Node* pNext;
+      alignas(T) unsigned char storage[sizeof(T)];
+   };
+
+   Node* m_pFree;
+   std::vector<Node*> m_vBlocks;
+   uint32_t m_capacity;
+   uint32_t m_nInUse;
+   uint32_t m_nHighWater;
+   size_t m_nBytes;
+};
@@ -0,0 +1,179 @@
+#include "pch.h"
+#include "force-bridge.h"
+#include <string.h>
+
+// Longest staleMs and reopenMs accepted, a minute.
+static const float BRIDGE_MAX_MS = 60000.0f;
+
+ForceBridge::ForceBridge() :
+   m_state(FFBBridgeStates::Type::Detached),
+   m_pLayout(NULL),
+   m_openedUs(0),
+   m_heartbeat(0),
+   m_aliveUs(0),
+   m_sequence(0),
+   m_nApplied(0),
+   m_nSkipped(0),
+   m_nTorn(0),
+   m_nStale(0),
+   m_nOpens(0)
+{
+   m_name[0] = '\0';
+   DefaultConfig(m_config);
+   ZeroMemory(&m_frame, sizeof(m_frame));
+}
+
+void ForceBridge::DefaultConfig(FFBBridgeConfig& config)
+{
+   config.staleMs = 100;
+   config.reopenMs = 500;
+}
+
+HRESULT ForceBridge::Validate(LPCSTR name, const FFBBridgeConfig& config)
+{
+   if (name == NULL || name[0] == '\0' || strlen(name) >= FFB_BRIDGE_NAME)
+   {
+      return E_INVALIDARG;
+   }
+   if (!(config.staleMs > 0 && config.staleMs <= BRIDGE_MAX_MS) || !(config.reopenMs > 0 && config.reopenMs <= BRIDGE_MAX_MS))
+   {
+      return E_INVALIDARG;
+   }
+   return S_OK;
+}
+
+/**
+ * Start reading the region name. It is opened by the next Sample, it does
+ * not have to exist yet.
+ */
+void ForceBridge::Attach(LPCSTR name, const FFBBridgeConfig& config)
+{
+   Close();
+   strncpy(m_name, name, FFB_BRIDGE_NAME - 1);
+   m_name[FFB_BRIDGE_NAME - 1] = '\0';
+   m_config = config;
+   m_state = FFBBridgeStates::Type::Waiting;
+   m_openedUs = 0;
+   m_aliveUs = 0;
+   m_nApplied = 0;
+   m_nSkipped = 0;
+   m_nTorn = 0;
+   m_nStale = 0;
+   m_nOpens = 0;
+}
+
+void ForceBridge::Detach()
+{
+   Close();
+   m_state = FFBBridgeStates::Type::Detached;
+}
+
+bool ForceBridge::Open(int64_t nowUs)
+{
+   m_openedUs = nowUs;
+   if (!m_region.Open(m_name, sizeof(FFBBridgeLayout)))
+   {
+      return false;
+   }
+   m_pLayout = (const FFBBridgeLayout*)m_region.Data();
+   if (!IsValidBridge(m_pLayout))
+   {
+      Close();
+      return false;
+   }
+   m_nOpens++;
+   // Live once the heartbeat moves, a region left behind by a writer
+   // that is gone never is.
+   m_heartbeat = m_pLayout->heartbeat.load(std::memory_order_acquire);
+   m_aliveUs = m_aliveUs != 0 ? m_aliveUs : nowUs;
+   m_sequence = 0;
+   return true;
+}
+
+void ForceBridge::Close()
+{
+   m_region.Close();
+   m_pLayout = NULL;
+}
+
+bool ForceBridge::Sample(int64_t nowUs, int axisCount, float* force)
+{
+   if (m_state == FFBBridgeStates::Type::Detached)
+   {
+      return false;
+   }
+   int64_t staleUs = (int64_t)(m_config.staleMs * 1000);
+   int64_t reopenUs = (int64_t)(m_config.reopenMs * 1000);
+   if (m_pLayout == NULL && (nowUs - m_openedUs < reopenUs || !Open(nowUs)))
+   {
+      return false;
+   }
+   if (!IsValidBridge(m_pLayout))
+   {
+      // The writer is setting the region up again.
+      Close();
+      m_state = m_state == FFBBridgeStates::Type::Live ? FFBBridgeStates::Type::Stale : m_state;
+      return false;
+   }
+
+   uint64_t heartbeat = m_pLayout->heartbeat.load(std::memory_order_acquire);
+   if (heartbeat != m_heartbeat)
+   {
+      m_heartbeat = heartbeat;
+      m_aliveUs = nowUs;
+      m_state = FFBBridgeStates::Type::Live;
+   }
+   else if (nowUs - m_aliveUs > staleUs)
+   {
+      if (m_state == FFBBridgeStates::Type::Live)
+      {
+         m_state = FFBBridgeStates::Type::Stale;
+         m_nStale++;
+      }
+      // A restarted writer may have made a new region under the name.
+      if (nowUs - m_openedUs >= reopenUs)
+      {
+         Close();
+      }
+      return false;
+   }
+   if (m_state != FFBBridgeStates::Type::Live)
+   {
+      return false;
+   }
+
+   FFBBridgeFrame frame;
+   uint32_t sequence;
+   if (ReadBridgeFrame(m_pLayout, frame, sequence, m_nTorn) && sequence != m_sequence)
+   {
+      // Two steps a frame.
+      if (m_sequence != 0 && sequence - m_sequence > 2)
+      {
+         m_nSkipped += (sequence - m_sequence) / 2 - 1;
+      }
+      m_sequence = sequence;
+      m_frame = frame;
+      m_nApplied++;
+   }
+   if (m_sequence == 0)
+   {
+      // Alive but no frame yet.
+      return false;
+   }
+   for (int i = 0; i < axisCount; i++)
+   {
+      force[i] = m_frame.force[i];
+   }
+   return true;
+}
+
+void ForceBridge::GetStats(int64_t nowUs, FFBBridgeStats& stats) const
+{
+   stats.state = m_state;
+   stats.framesApplied = m_nApplied;
+   stats.framesSkipped = m_nSkipped;
+   stats.tornReads = m_nTorn;
+   stats.staleCount = m_nStale;
+   stats.opens = m_nOpens;
+   stats.sinceHeartbeatMs = m_state != FFBBridgeStates::Type::Detached && m_aliveUs != 0 ? (nowUs - m_aliveUs) / 1000.0f : 0;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "pch.h"
+#include "unity-ffb.h"
+#include "bridge-format.h"
+#include "shared-memory.h"
+
+/**
+ * Reads the force another process publishes in a bridge region (see
+ * bridge-format.h) on the output thread, so a physics loop outside Unity
+ * drives the device at its own rate without going through the game
+ * thread.
+ *
+ * The writer's force is used while its heartbeat keeps advancing. Once it
+ * stands still for staleMs the game's force takes over again, and the
+ * region is opened anew every reopenMs until a writer is back, the same
+ * one or a restarted one with a new region.
+ *
+ * Attach, Detach and GetStats are called from the game thread and Sample
+ * from the output thread, all with the device's effect lock held.
+ */
+class ForceBridge
+{
+public:
+   ForceBridge();
+
+   static void DefaultConfig(FFBBridgeConfig& config);
+   static HRESULT Validate(LPCSTR name, const FFBBridgeConfig& config);
+
+   void Attach(LPCSTR name, const FFBBridgeConfig& config);
+   void Detach();
+
+   /**
+    * The writer's force on every axis at nowUs (GetFFBClockMicroseconds),
+    * false while there is none that is fresh.
+    */
+   bool Sample(int64_t nowUs, int axisCount, float* force);
+
+   void GetStats(int64_t nowUs, FFBBridgeStats& stats) const;
+
+private:
+   bool Open(int64_t nowUs);
+   void Close();
+
+   char m_name[FFB_BRIDGE_NAME];
+   FFBBridgeConfig m_config;
+   FFBBridgeStates::Type m_state;
+   SharedMemory m_region;
+   // NULL while the region is not open.
+   const FFBBridgeLayout* m_pLayout;
+   int64_t m_openedUs;
+   // Last heartbeat seen and when it last advanced.
+   uint64_t m_heartbeat;
+   int64_t m_aliveUs;
+   // Last frame read, held until the next one.
+   FFBBridgeFrame m_frame;
+   uint32_t m_sequence;
+
+   uint64_t m_nApplied;
+   uint64_t m_nSkipped;
+   DWORD m_nTorn;
+   DWORD m_nStale;
+   DWORD m_nOpens;
+};
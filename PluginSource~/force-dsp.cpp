@@ -0,0 +1,263 @@
+#include "pch.h"
+#include "force-dsp.h"
+#include <algorithm>
+#include <math.h>
+
+static const double DSP_PI = 3.14159265358979323846;
+// Stands in for "no limit" so bypassed lanes run the same code.
+static const float DSP_UNLIMITED = 1e30f;
+// Filter state this small is flushed to 0 before it becomes denormal.
+static const float DSP_DENORMAL_FLOOR = 1e-15f;
+
+static inline bool IsValidParameter(float value)
+{
+   return value >= 0 && value < DSP_UNLIMITED;
+}
+
+template <typename Biquad>
+static void SetPassthrough(Biquad& f, int lane)
+{
+   f.b0[lane] = 1.0f;
+   f.b1[lane] = 0.0f;
+   f.b2[lane] = 0.0f;
+   f.a1[lane] = 0.0f;
+   f.a2[lane] = 0.0f;
+}
+
+/**
+ * Low pass or notch coefficients from the Audio EQ Cookbook (bilinear
+ * transform, cutoff prewarped), computed in double and normalized by a0.
+ */
+template <typename Biquad>
+static void SetFilter(Biquad& f, int lane, bool notch, float hz, float q, float sampleRateHz)
+{
+   if (hz <= 0 || hz >= sampleRateHz * 0.5f)
+   {
+      SetPassthrough(f, lane);
+      return;
+   }
+   double w0 = 2.0 * DSP_PI * hz / sampleRateHz;
+   double cosW0 = cos(w0);
+   double alpha = sin(w0) / (2.0 * q);
+   double a0 = 1.0 + alpha;
+   double b0, b1, b2;
+   if (notch)
+   {
+      b0 = 1.0;
+      b1 = -2.0 * cosW0;
+      b2 = 1.0;
+   }
+   else
+   {
+      b0 = (1.0 - cosW0) * 0.5;
+      b1 = 1.0 - cosW0;
+      b2 = b0;
+   }
+   f.b0[lane] = (float)(b0 / a0);
+   f.b1[lane] = (float)(b1 / a0);
+   f.b2[lane] = (float)(b2 / a0);
+   f.a1[lane] = (float)(-2.0 * cosW0 / a0);
+   f.a2[lane] = (float)((1.0 - alpha) / a0);
+}
+
+template <typename Biquad>
+static inline void RunBiquad(Biquad& f, float* x)
+{
+   for (int i = 0; i < DSP_LANES; i++)
+   {
+      float y = f.b0[i] * x[i] + f.z1[i];
+      float z1 = f.b1[i] * x[i] - f.a1[i] * y + f.z2[i];
+      float z2 = f.b2[i] * x[i] - f.a2[i] * y;
+      f.z1[i] = fabsf(z1) < DSP_DENORMAL_FLOOR ? 0.0f : z1;
+      f.z2[i] = fabsf(z2) < DSP_DENORMAL_FLOOR ? 0.0f : z2;
+      x[i] = y;
+   }
+}
+
+ForceDsp::ForceDsp()
+{
+   ZeroMemory(&m_settings, sizeof(m_settings));
+   ZeroMemory(&m_active, sizeof(m_active));
+   ZeroMemory(&m_lowPass, sizeof(m_lowPass));
+   ZeroMemory(&m_notch, sizeof(m_notch));
+   ZeroMemory(&m_dynamics, sizeof(m_dynamics));
+   ZeroMemory(m_dwClipped, sizeof(m_dwClipped));
+   ZeroMemory(&m_state, sizeof(m_state));
+   ZeroMemory(&m_published, sizeof(m_published));
+   m_dwSamples = 0;
+   UpdateCoefficients(1000.0f);
+}
+
+/**
+ * E_INVALIDARG if a parameter is negative, not a number or a compressor
+ * ratio is below 1.
+ */
+HRESULT ForceDsp::Validate(const ForceDspConfig& config)
+{
+   if (!IsValidParameter(config.lowPassHz) || !IsValidParameter(config.lowPassQ)
+      || !IsValidParameter(config.notchHz) || !IsValidParameter(config.notchQ)
+      || !IsValidParameter(config.compressorThreshold) || !IsValidParameter(config.compressorRatio)
+      || !IsValidParameter(config.kneeWidth) || !IsValidParameter(config.slewRate))
+   {
+      return E_INVALIDARG;
+   }
+   if (config.compressorRatio != 0 && config.compressorRatio < 1)
+   {
+      return E_INVALIDARG;
+   }
+   return S_OK;
+}
+
+void ForceDsp::Configure(int axis, const ForceDspConfig* config)
+{
+   for (int i = 0; i < MAX_FFB_AXES; i++)
+   {
+      if (axis != -1 && axis != i)
+      {
+         continue;
+      }
+      m_settings.enabled[i] = config != NULL;
+      if (config != NULL)
+      {
+         m_settings.config[i] = *config;
+      }
+      else
+      {
+         ZeroMemory(&m_settings.config[i], sizeof(ForceDspConfig));
+      }
+   }
+   m_tbSettings.Write(m_settings);
+}
+
+bool ForceDsp::IsConfigured(int axis) const
+{
+   return axis >= 0 && axis < MAX_FFB_AXES && m_settings.enabled[axis];
+}
+
+void ForceDsp::GetConfig(int axis, ForceDspConfig& config) const
+{
+   config = m_settings.config[axis];
+}
+
+/**
+ * Forget the history, the next sample starts from rest. Clip counts are
+ * kept.
+ */
+void ForceDsp::Reset()
+{
+   ZeroMemory(m_lowPass.z1, sizeof(m_lowPass.z1));
+   ZeroMemory(m_lowPass.z2, sizeof(m_lowPass.z2));
+   ZeroMemory(m_notch.z1, sizeof(m_notch.z1));
+   ZeroMemory(m_notch.z2, sizeof(m_notch.z2));
+   ZeroMemory(m_dynamics.previous, sizeof(m_dynamics.previous));
+}
+
+/**
+ * Unpack the settings to lanes, once per change of settings or rate
+ * rather than every sample.
+ */
+void ForceDsp::UpdateCoefficients(float sampleRateHz)
+{
+   m_fSampleRateHz = sampleRateHz;
+   for (int i = 0; i < DSP_LANES; i++)
+   {
+      bool enabled = i < MAX_FFB_AXES && m_active.enabled[i];
+      ForceDspConfig config;
+      ZeroMemory(&config, sizeof(config));
+      if (enabled)
+      {
+         config = m_active.config[i];
+      }
+      SetFilter(m_lowPass, i, false, config.lowPassHz, config.lowPassQ > 0 ? config.lowPassQ : 0.70710678f, sampleRateHz);
+      SetFilter(m_notch, i, true, config.notchHz, config.notchQ > 0 ? config.notchQ : 2.0f, sampleRateHz);
+
+      if (config.compressorRatio > 1)
+      {
+         m_dynamics.threshold[i] = config.compressorThreshold;
+         // A width of 0 is a hard knee, kept just wide enough to divide by.
+         m_dynamics.kneeWidth[i] = std::max(config.kneeWidth, 1.0f);
+         m_dynamics.slope[i] = 1.0f / config.compressorRatio - 1.0f;
+      }
+      else
+      {
+         m_dynamics.threshold[i] = DSP_UNLIMITED;
+         m_dynamics.kneeWidth[i] = 1.0f;
+         m_dynamics.slope[i] = 0.0f;
+      }
+      m_dynamics.maxStep[i] = config.slewRate > 0 ? config.slewRate / sampleRateHz : DSP_UNLIMITED;
+   }
+}
+
+void ForceDsp::Process(const float* input, int axisCount, float sampleRateHz, float* output)
+{
+   ForceDspSettings settings;
+   bool changed = m_tbSettings.Read(settings);
+   if (changed)
+   {
+      m_active = settings;
+   }
+   if (changed || sampleRateHz != m_fSampleRateHz)
+   {
+      UpdateCoefficients(sampleRateHz);
+   }
+   if (axisCount > MAX_FFB_AXES)
+   {
+      axisCount = MAX_FFB_AXES;
+   }
+
+   alignas(32) float x[DSP_LANES];
+   for (int i = 0; i < DSP_LANES; i++)
+   {
+      x[i] = i < axisCount ? input[i] : 0.0f;
+   }
+   for (int i = 0; i < axisCount; i++)
+   {
+      m_state.input[i] = input[i];
+   }
+
+   RunBiquad(m_lowPass, x);
+   RunBiquad(m_notch, x);
+
+   Dynamics& d = m_dynamics;
+   for (int i = 0; i < DSP_LANES; i++)
+   {
+      // Soft knee in the linear domain: the slope changes from 1 to 1 /
+      // ratio along a parabola across the knee, so the curve and its slope
+      // are continuous.
+      float level = fabsf(x[i]);
+      float over = level - d.threshold[i];
+      float half = d.kneeWidth[i] * 0.5f;
+      float knee = std::min(std::max(over + half, 0.0f), d.kneeWidth[i]);
+      float reduction = knee * knee / (2.0f * d.kneeWidth[i]) + std::max(over - half, 0.0f);
+      float compressed = level + d.slope[i] * reduction;
+      x[i] = x[i] < 0 ? -compressed : compressed;
+
+      float step = std::min(std::max(x[i] - d.previous[i], -d.maxStep[i]), d.maxStep[i]);
+      x[i] = d.previous[i] + step;
+      d.previous[i] = x[i];
+
+      float limit = (float)DI_FFNOMINALMAX;
+      m_dwClipped[i] += fabsf(x[i]) > limit ? 1 : 0;
+      x[i] = std::min(std::max(x[i], -limit), limit);
+   }
+
+   for (int i = 0; i < axisCount; i++)
+   {
+      output[i] = x[i];
+      m_state.output[i] = x[i];
+      m_state.clippedSamples[i] = m_dwClipped[i];
+   }
+   m_state.axisCount = axisCount;
+   m_state.samples = ++m_dwSamples;
+   m_state.sampleRateHz = sampleRateHz;
+   m_tbState.Write(m_state);
+}
+
+/**
+ * Latest sample and clip counts, readable from the game thread.
+ */
+void ForceDsp::GetState(ForceDspState& state)
+{
+   m_tbState.Read(m_published);
+   state = m_published;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include "pch.h"
+#include "unity-ffb.h"
+#include "triple-buffer.h"
+
+// Axes are processed in fixed width lanes so the kernels vectorise.
+#define DSP_LANES    8
+
+struct ForceDspSettings {
+   bool enabled[MAX_FFB_AXES];
+   ForceDspConfig config[MAX_FFB_AXES];
+};
+
+/**
+ * Conditions the force of each axis before it is sent to the device: a
+ * low pass and a notch filter to take out harshness and the resonance of
+ * the wheel, a soft knee compressor, a slew rate limit, then a hard clip
+ * to DI_FFNOMINALMAX that is counted.
+ *
+ * Settings are changed from the game thread and picked up by the output
+ * thread through a triple buffer, Process is only called by the output
+ * thread.
+ */
+class ForceDsp
+{
+public:
+   ForceDsp();
+
+   static HRESULT Validate(const ForceDspConfig& config);
+
+   /**
+    * Set the chain of one axis, or every axis when axis is -1. A NULL
+    * config bypasses the axis, its force is only clipped.
+    */
+   void Configure(int axis, const ForceDspConfig* config);
+   bool IsConfigured(int axis) const;
+   void GetConfig(int axis, ForceDspConfig& config) const;
+
+   /**
+    * Clear the filter and slew history, output thread only.
+    */
+   void Reset();
+
+   /**
+    * Run one sample per axis through the chain. input and output may be
+    * the same array.
+    */
+   void Process(const float* input, int axisCount, float sampleRateHz, float* output);
+
+   void GetState(ForceDspState& state);
+
+private:
+   void UpdateCoefficients(float sampleRateHz);
+
+   // Owned by the game thread.
+   ForceDspSettings m_settings;
+   TripleBuffer<ForceDspSettings> m_tbSettings;
+
+   // Owned by the output thread. Biquads run in transposed direct form II,
+   // a bypassed one passes its input through.
+   struct alignas(32) Biquad {
+      float b0[DSP_LANES];
+      float b1[DSP_LANES];
+      float b2[DSP_LANES];
+      float a1[DSP_LANES];
+      float a2[DSP_LANES];
+      float z1[DSP_LANES];
+      float z2[DSP_LANES];
+   };
+   struct alignas(32) Dynamics {
+      float threshold[DSP_LANES];
+      float kneeWidth[DSP_LANES];
+      // 1 / ratio - 1, the change in slope above the threshold.
+      float slope[DSP_LANES];
+      // Largest change per sample.
+      float maxStep[DSP_LANES];
+      float previous[DSP_LANES];
+   };
+   ForceDspSettings m_active;
+   float m_fSampleRateHz;
+   Biquad m_lowPass;
+   Biquad m_notch;
+   Dynamics m_dynamics;
+   DWORD m_dwSamples;
+   DWORD m_dwClipped[DSP_LANES];
+
+   TripleBuffer<ForceDspState> m_tbState;
+   ForceDspState m_state;
+
+   // Last state seen by the game thread.
+   ForceDspState m_published;
+};
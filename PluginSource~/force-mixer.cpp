@@ -0,0 +1,447 @@
+#include "pch.h"
+#include "force-mixer.h"
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+// Longest envelope or ducking time accepted, an hour.
+static const float MIXER_MAX_MS = 3600000.0f;
+// Longest step between two mixes, so a stall does not skip envelopes.
+static const int64_t MIXER_MAX_STEP_US = 50000;
+
+static inline bool IsValidTime(float ms)
+{
+   return ms >= 0 && ms <= MIXER_MAX_MS;
+}
+
+static inline bool IsValidPercent(float percent)
+{
+   return percent >= 0 && percent <= 100;
+}
+
+/**
+ * How far a one pole smoother moves towards its target in dt seconds.
+ */
+static inline float SmoothingCoefficient(float ms, float dt)
+{
+   return ms > 0 ? 1.0f - expf(-dt * 1000.0f / ms) : 1.0f;
+}
+
+ForceMixer::ForceMixer() :
+   m_handles(FFB_MAX_FORCE_LAYERS)
+{
+   ZeroMemory(&m_settings, sizeof(m_settings));
+   ZeroMemory(m_names, sizeof(m_names));
+   ZeroMemory(&m_active, sizeof(m_active));
+   ZeroMemory(m_layers, sizeof(m_layers));
+   ZeroMemory(&m_state, sizeof(m_state));
+   ZeroMemory(&m_published, sizeof(m_published));
+   DefaultConfig(m_settings.config);
+   m_active.config = m_settings.config;
+   m_bMixed = false;
+   m_lastMixUs = 0;
+}
+
+void ForceMixer::DefaultConfig(FFBForceMixerConfig& config)
+{
+   config.headroomPercent = 10.0f;
+   config.duckAttackMs = 10.0f;
+   config.duckReleaseMs = 150.0f;
+}
+
+HRESULT ForceMixer::Validate(const FFBForceMixerConfig& config)
+{
+   if (!(config.headroomPercent >= 0 && config.headroomPercent < 100)
+      || !IsValidTime(config.duckAttackMs) || !IsValidTime(config.duckReleaseMs))
+   {
+      return E_INVALIDARG;
+   }
+   return S_OK;
+}
+
+HRESULT ForceMixer::Validate(const FFBForceLayerConfig& config)
+{
+   if (!IsValidPercent(config.gainPercent) || !IsValidPercent(config.duckPercent)
+      || !IsValidTime(config.attackMs) || !IsValidTime(config.lifetimeMs) || !IsValidTime(config.decayMs))
+   {
+      return E_INVALIDARG;
+   }
+   return S_OK;
+}
+
+void ForceMixer::Configure(const FFBForceMixerConfig& config)
+{
+   m_settings.config = config;
+   Publish();
+}
+
+const int* ForceMixer::GetSlot(FFBForceLayerHandle layer) const
+{
+   return m_handles.Get(layer);
+}
+
+/**
+ * Sort the live layers by priority and hand the settings to the output
+ * thread.
+ */
+void ForceMixer::Publish()
+{
+   int count = 0;
+   for (uint32_t i = 0; i < m_handles.Size(); i++)
+   {
+      m_settings.order[count++] = (uint8_t)m_handles.At(i);
+   }
+   const ForceLayerSettings* layers = m_settings.layers;
+   std::sort(m_settings.order, m_settings.order + count, [layers](uint8_t a, uint8_t b)
+   {
+      if (layers[a].config.priority != layers[b].config.priority)
+      {
+         return layers[a].config.priority > layers[b].config.priority;
+      }
+      return a < b;
+   });
+   m_settings.layerCount = count;
+   m_tbSettings.Write(m_settings);
+}
+
+/**
+ * Add a layer, silent until its first update. name must be unique on the
+ * device and shorter than FFB_FORCE_LAYER_NAME. Fails with E_ABORT if a
+ * layer already has the name, E_OUTOFMEMORY when FFB_MAX_FORCE_LAYERS
+ * exist.
+ */
+HRESULT ForceMixer::CreateLayer(LPCSTR name, const FFBForceLayerConfig& config, FFBForceLayerHandle* layer)
+{
+   if (name == NULL || layer == NULL)
+   {
+      return E_POINTER;
+   }
+   size_t length = strlen(name);
+   if (length == 0 || length >= FFB_FORCE_LAYER_NAME || FAILED(Validate(config)))
+   {
+      return E_INVALIDARG;
+   }
+   FFBForceLayerHandle existing;
+   if (SUCCEEDED(FindLayer(name, &existing)))
+   {
+      return E_ABORT;
+   }
+
+   int slot = -1;
+   for (int i = 0; i < FFB_MAX_FORCE_LAYERS && slot < 0; i++)
+   {
+      if (!m_settings.layers[i].live)
+      {
+         slot = i;
+      }
+   }
+   FFBForceLayerHandle handle = slot >= 0 ? m_handles.Insert(slot) : 0;
+   if (handle == 0)
+   {
+      return E_OUTOFMEMORY;
+   }
+   ForceLayerSettings& settings = m_settings.layers[slot];
+   settings.config = config;
+   settings.generation++;
+   settings.live = true;
+   memcpy(m_names[slot], name, length + 1);
+   Publish();
+   *layer = handle;
+   return S_OK;
+}
+
+HRESULT ForceMixer::FindLayer(LPCSTR name, FFBForceLayerHandle* layer) const
+{
+   if (name == NULL || layer == NULL)
+   {
+      return E_POINTER;
+   }
+   for (uint32_t i = 0; i < m_handles.Size(); i++)
+   {
+      if (strncmp(m_names[m_handles.At(i)], name, FFB_FORCE_LAYER_NAME) == 0)
+      {
+         *layer = m_handles.HandleAt(i);
+         return S_OK;
+      }
+   }
+   return E_FAIL;
+}
+
+HRESULT ForceMixer::ConfigureLayer(FFBForceLayerHandle layer, const FFBForceLayerConfig& config)
+{
+   const int* pSlot = GetSlot(layer);
+   if (pSlot == NULL)
+   {
+      return E_HANDLE;
+   }
+   if (FAILED(Validate(config)))
+   {
+      return E_INVALIDARG;
+   }
+   m_settings.layers[*pSlot].config = config;
+   Publish();
+   return S_OK;
+}
+
+/**
+ * Set the force of the layer on each axis, in DirectInput units, and
+ * restart its lifetime. Goes to the output thread through the layer's own
+ * triple buffer.
+ */
+HRESULT ForceMixer::UpdateLayer(FFBForceLayerHandle layer, const float* force, int axisCount)
+{
+   const int* pSlot = GetSlot(layer);
+   if (pSlot == NULL)
+   {
+      return E_HANDLE;
+   }
+   if (force == NULL)
+   {
+      return E_POINTER;
+   }
+   ForceLayerTarget target;
+   ZeroMemory(&target, sizeof(target));
+   target.generation = m_settings.layers[*pSlot].generation;
+   for (int i = 0; i < axisCount && i < MAX_FFB_AXES; i++)
+   {
+      target.force[i] = force[i];
+   }
+   m_targets[*pSlot].Write(target);
+   return S_OK;
+}
+
+/**
+ * Remove the layer at once, without decaying.
+ */
+HRESULT ForceMixer::DestroyLayer(FFBForceLayerHandle layer)
+{
+   const int* pSlot = GetSlot(layer);
+   if (pSlot == NULL)
+   {
+      return E_HANDLE;
+   }
+   int slot = *pSlot;
+   m_handles.Remove(layer);
+   m_settings.layers[slot].live = false;
+   m_names[slot][0] = '\0';
+   Publish();
+   return S_OK;
+}
+
+FFBForceLayerHandle ForceMixer::LayerAt(int position, LPCSTR& name, FFBForceLayerConfig& config) const
+{
+   int slot = m_handles.At(position);
+   name = m_names[slot];
+   config = m_settings.layers[slot].config;
+   return m_handles.HandleAt(position);
+}
+
+void ForceMixer::Reset()
+{
+   for (int i = 0; i < FFB_MAX_FORCE_LAYERS; i++)
+   {
+      m_layers[i].sounding = false;
+      m_layers[i].envelope = 0.0f;
+      m_layers[i].duckGain = 1.0f;
+   }
+   m_bMixed = false;
+}
+
+void ForceMixer::Mix(int64_t nowUs, int axisCount, float* force)
+{
+   ForceMixerSettings settings;
+   if (m_tbSettings.Read(settings))
+   {
+      m_active = settings;
+   }
+   if (axisCount > MAX_FFB_AXES)
+   {
+      axisCount = MAX_FFB_AXES;
+   }
+
+   int64_t stepUs = m_bMixed ? std::min(std::max(nowUs - m_lastMixUs, (int64_t)0), MIXER_MAX_STEP_US) : 1000;
+   float dt = stepUs / 1000000.0f;
+   m_lastMixUs = nowUs;
+   m_bMixed = true;
+
+   const FFBForceMixerConfig& config = m_active.config;
+   float duckAttack = SmoothingCoefficient(config.duckAttackMs, dt);
+   float duckRelease = SmoothingCoefficient(config.duckReleaseMs, dt);
+   float ceiling = (float)DI_FFNOMINALMAX * (1.0f - config.headroomPercent / 100.0f);
+   float room = (float)DI_FFNOMINALMAX - ceiling;
+
+   float sum[MAX_FFB_AXES] = { 0 };
+   // Strongest ducking from the layers above the current priority, and
+   // from the ones at it so far.
+   float duckAbove = 0.0f;
+   float duckGroup = 0.0f;
+   int active = 0;
+   bool squeezed = false;
+   int count = m_active.layerCount;
+   int start = 0;
+   while (start < count)
+   {
+      int priority = m_active.layers[m_active.order[start]].config.priority;
+      duckAbove = std::max(duckAbove, duckGroup);
+      duckGroup = 0.0f;
+
+      float group[MAX_FFB_AXES] = { 0 };
+      int end = start;
+      for (; end < count && m_active.layers[m_active.order[end]].config.priority == priority; end++)
+      {
+         int slot = m_active.order[end];
+         const ForceLayerSettings& layerSettings = m_active.layers[slot];
+         const FFBForceLayerConfig& layerConfig = layerSettings.config;
+         Layer& layer = m_layers[slot];
+
+         ForceLayerTarget target;
+         if (m_targets[slot].Read(target))
+         {
+            layer.target = target;
+            layer.bFreshTarget = true;
+         }
+         if (layer.generation != layerSettings.generation)
+         {
+            // A new layer in the slot.
+            layer.generation = layerSettings.generation;
+            layer.sounding = false;
+            layer.envelope = 0.0f;
+            layer.duckGain = 1.0f;
+            ZeroMemory(layer.force, sizeof(layer.force));
+         }
+         if (layer.bFreshTarget && (int32_t)(layer.target.generation - layer.generation) <= 0)
+         {
+            // Older targets are of the slot's previous layer.
+            if (layer.target.generation == layer.generation)
+            {
+               memcpy(layer.force, layer.target.force, sizeof(layer.force));
+               layer.sounding = true;
+               layer.updatedUs = nowUs;
+            }
+            layer.bFreshTarget = false;
+         }
+
+         if (layer.sounding)
+         {
+            bool held = layerConfig.lifetimeMs == 0 || nowUs - layer.updatedUs < (int64_t)(layerConfig.lifetimeMs * 1000.0f);
+            if (held)
+            {
+               layer.envelope = layerConfig.attackMs > 0 ? std::min(layer.envelope + dt * 1000.0f / layerConfig.attackMs, 1.0f) : 1.0f;
+            }
+            else
+            {
+               layer.envelope = layerConfig.decayMs > 0 ? layer.envelope - dt * 1000.0f / layerConfig.decayMs : 0.0f;
+               if (layer.envelope <= 0)
+               {
+                  layer.envelope = 0.0f;
+                  layer.sounding = false;
+               }
+            }
+         }
+
+         float duckTarget = 1.0f - duckAbove;
+         layer.duckGain += (duckTarget - layer.duckGain) * (duckTarget < layer.duckGain ? duckAttack : duckRelease);
+
+         ForceLayerMix& mix = m_state.layers[slot];
+         float scale = layerConfig.gainPercent / 100.0f * layer.envelope * layer.duckGain;
+         float peak = 0.0f;
+         for (int i = 0; i < axisCount; i++)
+         {
+            mix.output[i] = layer.force[i] * scale;
+            group[i] += mix.output[i];
+            peak = std::max(peak, fabsf(mix.output[i]));
+         }
+         // The layer ducks the ones below in proportion to its force.
+         duckGroup = std::max(duckGroup, layerConfig.duckPercent / 100.0f * std::min(peak / (float)DI_FFNOMINALMAX, 1.0f));
+         mix.generation = layer.generation;
+         mix.envelope = layer.envelope;
+         mix.duckGain = layer.duckGain;
+         active += layer.sounding ? 1 : 0;
+      }
+
+      // The highest priority keeps all of its force, each priority below
+      // gets what room is left under the ceiling, the same share on every
+      // axis so its direction is kept.
+      float fit = 1.0f;
+      for (int i = 0; start > 0 && i < axisCount; i++)
+      {
+         if (group[i] != 0)
+         {
+            float bound = group[i] > 0 ? ceiling : -ceiling;
+            fit = std::min(fit, std::max((bound - sum[i]) / group[i], 0.0f));
+         }
+      }
+      for (int i = 0; i < axisCount; i++)
+      {
+         sum[i] += group[i] * fit;
+      }
+      for (int k = start; k < end; k++)
+      {
+         ForceLayerMix& mix = m_state.layers[m_active.order[k]];
+         mix.headroomGain = fit;
+         for (int i = 0; fit < 1.0f && i < axisCount; i++)
+         {
+            mix.output[i] *= fit;
+         }
+      }
+      squeezed = squeezed || fit < 1.0f;
+      start = end;
+   }
+
+   // Above the ceiling the force saturates softly into the headroom, the
+   // slope is continuous at the ceiling.
+   bool saturated = false;
+   for (int i = 0; i < axisCount; i++)
+   {
+      float level = fabsf(sum[i]);
+      if (level > ceiling)
+      {
+         saturated = true;
+         level = room > 0 ? ceiling + room * tanhf((level - ceiling) / room) : ceiling;
+         sum[i] = sum[i] < 0 ? -level : level;
+      }
+      force[i] += sum[i];
+      m_state.mixer.output[i] = sum[i];
+   }
+
+   m_state.mixer.layerCount = count;
+   m_state.mixer.activeLayers = active;
+   m_state.mixer.ticks++;
+   m_state.mixer.squeezedTicks += squeezed ? 1 : 0;
+   m_state.mixer.saturatedTicks += saturated ? 1 : 0;
+   m_tbState.Write(m_state);
+}
+
+/**
+ * The layer as of the last mix, readable from the game thread.
+ */
+HRESULT ForceMixer::GetLayerState(FFBForceLayerHandle layer, FFBForceLayerState& state)
+{
+   const int* pSlot = GetSlot(layer);
+   if (pSlot == NULL)
+   {
+      return E_HANDLE;
+   }
+   m_tbState.Read(m_published);
+   ZeroMemory(&state, sizeof(state));
+   memcpy(state.name, m_names[*pSlot], sizeof(state.name));
+   state.priority = m_settings.layers[*pSlot].config.priority;
+   state.duckGain = 1.0f;
+   state.headroomGain = 1.0f;
+   const ForceLayerMix& mix = m_published.layers[*pSlot];
+   if (mix.generation == m_settings.layers[*pSlot].generation)
+   {
+      state.envelope = mix.envelope;
+      state.duckGain = mix.duckGain;
+      state.headroomGain = mix.headroomGain;
+      memcpy(state.output, mix.output, sizeof(state.output));
+   }
+   return S_OK;
+}
+
+void ForceMixer::GetState(FFBForceMixerState& state)
+{
+   m_tbState.Read(m_published);
+   state = m_published.mixer;
+   state.layerCount = LayerCount();
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include "pch.h"
+#include "unity-ffb.h"
+#include "slot-map.h"
+#include "triple-buffer.h"
+
+struct ForceLayerSettings {
+   FFBForceLayerConfig config;
+   // Changes every time the slot gets a new layer, so the output thread
+   // starts it from silence and ignores the force of the slot's previous
+   // layer.
+   uint32_t generation;
+   bool live;
+};
+
+struct ForceMixerSettings {
+   FFBForceMixerConfig config;
+   int layerCount;
+   // Slots of the live layers, highest priority first.
+   uint8_t order[FFB_MAX_FORCE_LAYERS];
+   ForceLayerSettings layers[FFB_MAX_FORCE_LAYERS];
+};
+
+struct ForceLayerTarget {
+   uint32_t generation;
+   float force[MAX_FFB_AXES];
+};
+
+struct ForceLayerMix {
+   // Of the layer the slot held when it was mixed.
+   uint32_t generation;
+   float envelope;
+   float duckGain;
+   float headroomGain;
+   float output[MAX_FFB_AXES];
+};
+
+struct ForceMixerPublished {
+   FFBForceMixerState mixer;
+   ForceLayerMix layers[FFB_MAX_FORCE_LAYERS];
+};
+
+/**
+ * Mixes the force of named layers, each owned by one game system, into a
+ * force per axis: every layer is scaled by its gain and envelope, ducked
+ * by the layers of higher priority, then the layers are summed highest
+ * priority first with the lower ones turned down to fit under the
+ * headroom, and the sum saturates softly into the headroom.
+ *
+ * Layers are created, configured and updated from the game thread, Mix is
+ * only called by the output thread. Each layer has its own triple buffer,
+ * so updating one layer takes no lock and never waits for the output
+ * thread or touches another layer.
+ */
+class ForceMixer
+{
+public:
+   ForceMixer();
+
+   static void DefaultConfig(FFBForceMixerConfig& config);
+   static HRESULT Validate(const FFBForceMixerConfig& config);
+   static HRESULT Validate(const FFBForceLayerConfig& config);
+
+   // Game thread only.
+   void Configure(const FFBForceMixerConfig& config);
+   const FFBForceMixerConfig& GetConfig() const { return m_settings.config; }
+   HRESULT CreateLayer(LPCSTR name, const FFBForceLayerConfig& config, FFBForceLayerHandle* layer);
+   HRESULT FindLayer(LPCSTR name, FFBForceLayerHandle* layer) const;
+   HRESULT ConfigureLayer(FFBForceLayerHandle layer, const FFBForceLayerConfig& config);
+   HRESULT UpdateLayer(FFBForceLayerHandle layer, const float* force, int axisCount);
+   HRESULT DestroyLayer(FFBForceLayerHandle layer);
+   int LayerCount() const { return (int)m_handles.Size(); }
+   // The layer at position in no particular order, to describe them.
+   FFBForceLayerHandle LayerAt(int position, LPCSTR& name, FFBForceLayerConfig& config) const;
+
+   /**
+    * Silence every layer, output thread only.
+    */
+   void Reset();
+
+   /**
+    * Add the mix at nowUs (GetFFBClockMicroseconds) to force. Output thread
+    * only.
+    */
+   void Mix(int64_t nowUs, int axisCount, float* force);
+
+   HRESULT GetLayerState(FFBForceLayerHandle layer, FFBForceLayerState& state);
+   void GetState(FFBForceMixerState& state);
+
+private:
+   const int* GetSlot(FFBForceLayerHandle layer) const;
+   void Publish();
+
+   // Owned by the game thread. The handles resolve to slots of the fixed
+   // arrays below, which never move.
+   SlotMap<int> m_handles;
+   ForceMixerSettings m_settings;
+   char m_names[FFB_MAX_FORCE_LAYERS][FFB_FORCE_LAYER_NAME];
+   TripleBuffer<ForceMixerSettings> m_tbSettings;
+   TripleBuffer<ForceLayerTarget> m_targets[FFB_MAX_FORCE_LAYERS];
+
+   // Owned by the output thread.
+   struct Layer {
+      uint32_t generation;
+      // Last target read, it may be for a layer the settings do not have
+      // yet.
+      ForceLayerTarget target;
+      bool bFreshTarget;
+      float force[MAX_FFB_AXES];
+      bool sounding;
+      int64_t updatedUs;
+      float envelope;
+      float duckGain;
+   };
+   ForceMixerSettings m_active;
+   Layer m_layers[FFB_MAX_FORCE_LAYERS];
+   bool m_bMixed;
+   int64_t m_lastMixUs;
+
+   TripleBuffer<ForceMixerPublished> m_tbState;
+   ForceMixerPublished m_state;
+
+   // Last state seen by the game thread.
+   ForceMixerPublished m_published;
+};
@@ -1,13 +1,22 @@
 #pragma once
 
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN             // Exclude rarely-used stuff from Windows headers
 // Windows Header Files
 #include <windows.h>
+#endif
 #include <vector>
 #include <string>
 #include <map>
 
 #define DIRECTINPUT_VERSION 0x0800
 
+#ifdef _WIN32
 #include <dinput.h>
-#include <math.h>
\ No newline at end of file
+#else
+// No Windows SDK, only the simulated backend can be built.
+#include "dinput-compat.h"
+#endif
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
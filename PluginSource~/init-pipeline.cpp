@@ -0,0 +1,294 @@
+#include "pch.h"
+#include "init-pipeline.h"
+#include "device-context.h"
+#include "call-stats.h"
+#include "capability-cache.h"
+
+InitPipeline::InitPipeline() :
+   m_eBackendType(Backends::Type::Simulated),
+   m_bCancel(false),
+   m_pBackend(NULL),
+   m_pContext(NULL),
+   m_iDevice(0),
+   m_guidDevice(GUID_NULL),
+   m_bUseCache(false),
+   m_bCachedDevices(false),
+   m_bCacheHit(false)
+{
+   ZeroMemory(&m_config, sizeof(m_config));
+   ZeroMemory(&m_status, sizeof(m_status));
+   m_status.state = FFBInitStates::Type::Idle;
+}
+
+/**
+ * Cancels a pipeline still running at its next stage, and releases
+ * whatever was not adopted.
+ */
+InitPipeline::~InitPipeline()
+{
+   m_bCancel = true;
+   if (m_thread.joinable())
+   {
+      m_thread.join();
+   }
+   // The device before the backend it belongs to.
+   SAFE_DELETE(m_pContext);
+   SAFE_DELETE(m_pBackend);
+}
+
+HRESULT InitPipeline::Start(Backends::Type backendType, const FFBInitConfig& config, const CapabilityCache* pCache,
+   const FFBEffectPoolConfig& effectPool)
+{
+   if (config.effectCount < 0 || config.effectCount > MAX_FFB_INIT_EFFECTS)
+   {
+      return E_INVALIDARG;
+   }
+   if (m_thread.joinable())
+   {
+      return E_ABORT;
+   }
+   m_eBackendType = backendType;
+   m_config = config;
+   m_effectPool = effectPool;
+   m_bUseCache = pCache != NULL;
+   m_cache.clear();
+   const FFBEnumSnapshot* cache = pCache != NULL ? pCache->GetSnapshot() : NULL;
+   if (cache != NULL)
+   {
+      m_cache.resize((cache->size + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+      memcpy(&m_cache[0], cache, cache->size);
+   }
+   m_bCachedDevices = false;
+   m_bCacheHit = false;
+   ZeroMemory(&m_status, sizeof(m_status));
+   m_status.state = FFBInitStates::Type::Running;
+   m_thread = std::thread(&InitPipeline::Run, this);
+   return S_OK;
+}
+
+bool InitPipeline::IsRunning()
+{
+   std::lock_guard<std::mutex> lock(m_statusLock);
+   return m_status.state == FFBInitStates::Type::Running;
+}
+
+void InitPipeline::GetStatus(FFBInitStatus& status)
+{
+   std::lock_guard<std::mutex> lock(m_statusLock);
+   status = m_status;
+}
+
+void InitPipeline::Adopt(FFBBackend** ppBackend, FFBDeviceContext** ppContext)
+{
+   *ppBackend = NULL;
+   *ppContext = NULL;
+   if (IsRunning())
+   {
+      return;
+   }
+   if (m_thread.joinable())
+   {
+      m_thread.join();
+   }
+   *ppBackend = m_pBackend;
+   *ppContext = m_pContext;
+   m_pBackend = NULL;
+   m_pContext = NULL;
+}
+
+/**
+ * Record the handle the adopted device was given, for GetStatus.
+ */
+void InitPipeline::SetDevice(FFBDeviceHandle device)
+{
+   std::lock_guard<std::mutex> lock(m_statusLock);
+   m_status.device = device;
+}
+
+void InitPipeline::Run()
+{
+   Clock::time_point start = Clock::now();
+   HRESULT hr = RunStages();
+   if (FAILED(hr))
+   {
+      // Keep the backend, the game may still enumerate with it.
+      SAFE_DELETE(m_pContext);
+   }
+
+   std::lock_guard<std::mutex> lock(m_statusLock);
+   m_status.state = SUCCEEDED(hr) ? FFBInitStates::Type::Succeeded : FFBInitStates::Type::Failed;
+   m_status.result = hr;
+   m_status.totalMilliseconds = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+}
+
+/**
+ * Run one stage unless the pipeline was cancelled, and time it.
+ */
+HRESULT InitPipeline::RunStage(FFBInitStages::Type stage, const std::function<HRESULT()>& run)
+{
+   if (m_bCancel)
+   {
+      return E_ABORT;
+   }
+   {
+      std::lock_guard<std::mutex> lock(m_statusLock);
+      m_status.stage = stage;
+   }
+
+   Clock::time_point start = Clock::now();
+   HRESULT hr = run();
+   float elapsed = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+
+   std::lock_guard<std::mutex> lock(m_statusLock);
+   m_status.stageMilliseconds[stage] = elapsed;
+   if (SUCCEEDED(hr))
+   {
+      m_status.stagesCompleted++;
+   }
+   return hr;
+}
+
+HRESULT InitPipeline::RunStages()
+{
+   HRESULT hr;
+   if (FAILED(hr = RunStage(FFBInitStages::Type::StartBackend, [this]() {
+      if (m_eBackendType == Backends::Type::Simulated)
+      {
+         return CreateSimulatedBackend(&m_pBackend);
+      }
+      return CreateDirectInputBackend(&m_pBackend);
+   })))
+   {
+      return hr;
+   }
+
+   if (FAILED(hr = RunStage(FFBInitStages::Type::EnumerateDevices, [this]() {
+      const FFBEnumSnapshot* cache = GetCache();
+      HRESULT stageHr = EnumerateDevices(cache != NULL && cache->recordCount > 0);
+      if (FAILED(stageHr) && m_bCachedDevices)
+      {
+         // None of the cached devices fits the selection.
+         stageHr = EnumerateDevices(false);
+      }
+      return stageHr;
+   })))
+   {
+      return hr;
+   }
+
+   if (FAILED(hr = RunStage(FFBInitStages::Type::OpenDevice, [this]() {
+      HRESULT stageHr = OpenDevice();
+      if (FAILED(stageHr) && m_bCachedDevices && SUCCEEDED(stageHr = EnumerateDevices(false)))
+      {
+         // The cached device is gone, open what is attached.
+         stageHr = OpenDevice();
+      }
+      return stageHr;
+   })))
+   {
+      return hr;
+   }
+
+   if (FAILED(hr = RunStage(FFBInitStages::Type::SetAutoCenter, [this]() {
+      return m_config.autoCenter >= 0 ? m_pContext->SetAutoCenter(m_config.autoCenter != 0) : S_OK;
+   })))
+   {
+      return hr;
+   }
+
+   if (FAILED(hr = RunStage(FFBInitStages::Type::EnumerateAxes, [this]() {
+      m_pContext->EnumerateAxisSnapshot();
+      return S_OK;
+   })))
+   {
+      return hr;
+   }
+
+   return RunStage(FFBInitStages::Type::AddEffects, [this]() {
+      HRESULT stageHr;
+      if (m_config.synthesizeConditions && FAILED(stageHr = m_pContext->EnableSynthesis(NULL)))
+      {
+         return stageHr;
+      }
+      if (FAILED(stageHr = m_pContext->FillEffectPool(m_effectPool)))
+      {
+         return stageHr;
+      }
+      for (int i = 0; i < m_config.effectCount; i++)
+      {
+         if (FAILED(stageHr = m_pContext->AddEffect(m_config.effects[i])))
+         {
+            return stageHr;
+         }
+      }
+      if (m_config.startEffects)
+      {
+         m_pContext->StartAllEffects();
+      }
+      return S_OK;
+   });
+}
+
+const FFBEnumSnapshot* InitPipeline::GetCache() const
+{
+   return m_cache.empty() ? NULL : (const FFBEnumSnapshot*)&m_cache[0];
+}
+
+/**
+ * Enumerate the devices, or take them from the cache, and select one.
+ */
+HRESULT InitPipeline::EnumerateDevices(bool fromCache)
+{
+   HRESULT hr = S_OK;
+   m_bCachedDevices = fromCache;
+   m_devices.Begin();
+   if (fromCache)
+   {
+      AddCachedDevices(GetCache(), m_devices);
+   }
+   else
+   {
+      hr = FFB_STAT_CALL(FFBStatCalls::Type::DriverEnumDevices, m_pBackend->EnumDevices(_cbEnumFFBDevices, &m_devices));
+   }
+   m_devices.Finish();
+   return FAILED(hr) ? hr : SelectDevice();
+}
+
+HRESULT InitPipeline::OpenDevice()
+{
+   FFBDevice* pDevice;
+   HRESULT hr = FFB_STAT_CALL(FFBStatCalls::Type::DriverCreateDevice, m_pBackend->CreateDevice(m_guidDevice, &pDevice));
+   if (FAILED(hr))
+   {
+      return hr;
+   }
+   m_pContext = new FFBDeviceContext(pDevice, m_guidDevice);
+   if (m_bUseCache)
+   {
+      const FFBDeviceRecord& device = m_devices[m_iDevice];
+      m_pContext->SetDeviceRecord(device, m_devices.String(device.instanceName), m_devices.String(device.productName));
+      m_bCacheHit = m_pContext->UseCapabilityCache(GetCache());
+   }
+   return S_OK;
+}
+
+/**
+ * Pick the device to open from the enumeration according to the
+ * configured policy.
+ */
+HRESULT InitPipeline::SelectDevice()
+{
+   for (DWORD i = 0; i < m_devices.Count(); i++)
+   {
+      const FFBDeviceRecord& device = m_devices[i];
+      if (m_config.deviceSelection == FFBInitDeviceSelection::Type::First
+         || (m_config.deviceSelection == FFBInitDeviceSelection::Type::Instance && device.guidInstance == m_config.guid)
+         || (m_config.deviceSelection == FFBInitDeviceSelection::Type::Product && device.guidProduct == m_config.guid))
+      {
+         m_iDevice = i;
+         m_guidDevice = device.guidInstance;
+         return S_OK;
+      }
+   }
+   return DIERR_DEVICENOTREG;
+}
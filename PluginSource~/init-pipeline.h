@@ -0,0 +1,87 @@
+#pragma once
+#include "pch.h"
+#include "unity-ffb.h"
+#include "backend.h"
+#include "enum-snapshot.h"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+class FFBDeviceContext;
+class CapabilityCache;
+
+/**
+ * Runs the start up sequence UnityFFB runs in Awake (start the backend,
+ * enumerate, open a device, set auto center, enumerate its axes and add
+ * effects) on a worker thread, so none of it stalls the game. Each stage
+ * is timed.
+ *
+ * The worker builds a backend and device of its own and touches no global
+ * state. Once it finished the game thread takes them over with Adopt.
+ *
+ * With a capability cache the devices are taken from the cache instead of
+ * enumerated, and the device opened with its cached axes and capabilities.
+ * If the cached device cannot be opened the devices are enumerated after
+ * all.
+ */
+class InitPipeline
+{
+public:
+   InitPipeline();
+   ~InitPipeline();
+
+   /**
+    * The pipeline works on a copy of the cache's snapshot, pCache may be
+    * NULL. The device's effect pool is filled before the effects are added.
+    */
+   HRESULT Start(Backends::Type backendType, const FFBInitConfig& config, const CapabilityCache* pCache,
+      const FFBEffectPoolConfig& effectPool);
+   bool IsRunning();
+   void GetStatus(FFBInitStatus& status);
+
+   /**
+    * Take over the backend and, if it was opened, the device once the
+    * pipeline finished. Each is handed out once. Game thread only.
+    */
+   void Adopt(FFBBackend** ppBackend, FFBDeviceContext** ppContext);
+   void SetDevice(FFBDeviceHandle device);
+
+   // Valid once adopted: the devices came from the cache, and the opened
+   // device had a cached record.
+   bool UsedCachedDevices() const { return m_bCachedDevices; }
+   bool CacheHit() const { return m_bCacheHit; }
+
+private:
+   typedef std::chrono::steady_clock Clock;
+
+   void Run();
+   HRESULT RunStages();
+   HRESULT RunStage(FFBInitStages::Type stage, const std::function<HRESULT()>& run);
+   HRESULT EnumerateDevices(bool fromCache);
+   HRESULT SelectDevice();
+   HRESULT OpenDevice();
+   const FFBEnumSnapshot* GetCache() const;
+
+   Backends::Type m_eBackendType;
+   FFBInitConfig m_config;
+   FFBEffectPoolConfig m_effectPool;
+   std::thread m_thread;
+   std::atomic<bool> m_bCancel;
+
+   std::mutex m_statusLock;
+   FFBInitStatus m_status;
+
+   // Worker thread until finished, then the game thread's to adopt.
+   FFBBackend* m_pBackend;
+   FFBDeviceContext* m_pContext;
+   EnumSnapshot<FFBDeviceRecord> m_devices;
+   DWORD m_iDevice;
+   GUID m_guidDevice;
+
+   bool m_bUseCache;
+   std::vector<uint64_t> m_cache;
+   bool m_bCachedDevices;
+   bool m_bCacheHit;
+};
@@ -0,0 +1,226 @@
+#include "pch.h"
+#include "input-capture.h"
+#include "keyframes.h"
+#include "output-thread.h"
+#include <string.h>
+
+// Largest DIPROP_BUFFERSIZE accepted.
+static const DWORD INPUT_MAX_BUFFER_SIZE = 65536;
+
+static const int INPUT_AXES = 6;
+static const int INPUT_SLIDERS = 2;
+static const int INPUT_POVS = 4;
+static const int INPUT_BUTTONS = 32;
+
+InputCapture::InputCapture() :
+   m_mode(FFBInputModes::Type::Buffered),
+   m_bPolled(false),
+   m_sequence(0),
+   m_nReads(0),
+   m_nFailedReads(0),
+   m_nDeviceOverflows(0),
+   m_nPublished(0),
+   m_nDropped(0),
+   m_delaySumUs(0),
+   m_maxDelayUs(0)
+{
+   ZeroMemory(m_data, sizeof(m_data));
+   ZeroMemory(&m_lastState, sizeof(m_lastState));
+}
+
+HRESULT InputCapture::Validate(const FFBInputCaptureConfig& config)
+{
+   if (config.mode != FFBInputModes::Type::Buffered && config.mode != FFBInputModes::Type::Polled)
+   {
+      return E_INVALIDARG;
+   }
+   if (config.rateHz < OutputThread::MIN_RATE_HZ || config.rateHz > OutputThread::MAX_RATE_HZ)
+   {
+      return E_INVALIDARG;
+   }
+   if (config.mode == FFBInputModes::Type::Buffered && (config.bufferSize == 0 || config.bufferSize > INPUT_MAX_BUFFER_SIZE))
+   {
+      return E_INVALIDARG;
+   }
+   return S_OK;
+}
+
+void InputCapture::Begin(FFBInputModes::Type mode)
+{
+   m_mode = mode;
+   m_bPolled = false;
+   m_nReads = 0;
+   m_nFailedReads = 0;
+   m_nDeviceOverflows = 0;
+   m_nPublished = 0;
+   m_nDropped = 0;
+   m_delaySumUs = 0;
+   m_maxDelayUs = 0;
+}
+
+void InputCapture::Capture(FFBDevice* pDevice)
+{
+   if (m_mode == FFBInputModes::Type::Buffered)
+   {
+      CaptureBuffered(pDevice);
+   }
+   else
+   {
+      CapturePolled(pDevice);
+   }
+}
+
+/**
+ * Drain the device buffer, oldest change first. The device stamps changes
+ * on its own millisecond clock, they are moved onto ours by how long ago
+ * they were stamped.
+ */
+void InputCapture::CaptureBuffered(FFBDevice* pDevice)
+{
+   DWORD count;
+   do
+   {
+      count = INPUT_READ_BATCH;
+      HRESULT hr = pDevice->GetDeviceData(m_data, &count);
+      DWORD dataTime = pDevice->GetDataTime();
+      int64_t nowUs = KeyframeClockUs();
+      m_nReads.fetch_add(1, std::memory_order_relaxed);
+      if (FAILED(hr))
+      {
+         m_nFailedReads.fetch_add(1, std::memory_order_relaxed);
+         return;
+      }
+      if (hr == DI_BUFFEROVERFLOW)
+      {
+         m_nDeviceOverflows.fetch_add(1, std::memory_order_relaxed);
+      }
+      for (DWORD i = 0; i < count; i++)
+      {
+         const DIDEVICEOBJECTDATA& data = m_data[i];
+         // A stamp ahead of the clock is taken as now.
+         DWORD ageMs = dataTime - data.dwTimeStamp;
+         int64_t timeUs = ageMs < 0x80000000 ? nowUs - (int64_t)ageMs * 1000 : nowUs;
+         DWORD offset = data.dwOfs;
+         if (offset < (DWORD)DIJOFS_SLIDER(0))
+         {
+            Publish(FFBInputKinds::Type::Axis, offset / sizeof(LONG), (LONG)data.dwData, timeUs, nowUs);
+         }
+         else if (offset < (DWORD)DIJOFS_POV(0))
+         {
+            Publish(FFBInputKinds::Type::Axis, INPUT_AXES + (offset - DIJOFS_SLIDER(0)) / sizeof(LONG), (LONG)data.dwData, timeUs, nowUs);
+         }
+         else if (offset < (DWORD)DIJOFS_BUTTON(0))
+         {
+            Publish(FFBInputKinds::Type::Pov, (offset - DIJOFS_POV(0)) / sizeof(DWORD), (LONG)data.dwData, timeUs, nowUs);
+         }
+         else if (offset < (DWORD)DIJOFS_BUTTON(INPUT_BUTTONS))
+         {
+            Publish(FFBInputKinds::Type::Button, offset - DIJOFS_BUTTON(0), (data.dwData & 0x80) != 0 ? 1 : 0, timeUs, nowUs);
+         }
+      }
+   } while (count == INPUT_READ_BATCH);
+}
+
+/**
+ * Read the state and publish what differs from the last one, stamped with
+ * when the poll was made.
+ */
+void InputCapture::CapturePolled(FFBDevice* pDevice)
+{
+   DIJOYSTATE state;
+   int64_t pollUs = KeyframeClockUs();
+   HRESULT hr = pDevice->GetState(&state);
+   int64_t nowUs = KeyframeClockUs();
+   m_nReads.fetch_add(1, std::memory_order_relaxed);
+   if (FAILED(hr))
+   {
+      m_nFailedReads.fetch_add(1, std::memory_order_relaxed);
+      return;
+   }
+   if (!m_bPolled)
+   {
+      m_lastState = state;
+      m_bPolled = true;
+      return;
+   }
+   const LONG* axes = &state.lX;
+   const LONG* lastAxes = &m_lastState.lX;
+   for (int i = 0; i < INPUT_AXES; i++)
+   {
+      if (axes[i] != lastAxes[i])
+      {
+         Publish(FFBInputKinds::Type::Axis, i, axes[i], pollUs, nowUs);
+      }
+   }
+   for (int i = 0; i < INPUT_SLIDERS; i++)
+   {
+      if (state.rglSlider[i] != m_lastState.rglSlider[i])
+      {
+         Publish(FFBInputKinds::Type::Axis, INPUT_AXES + i, state.rglSlider[i], pollUs, nowUs);
+      }
+   }
+   for (int i = 0; i < INPUT_POVS; i++)
+   {
+      if (state.rgdwPOV[i] != m_lastState.rgdwPOV[i])
+      {
+         Publish(FFBInputKinds::Type::Pov, i, (LONG)state.rgdwPOV[i], pollUs, nowUs);
+      }
+   }
+   for (int i = 0; i < INPUT_BUTTONS; i++)
+   {
+      if ((state.rgbButtons[i] & 0x80) != (m_lastState.rgbButtons[i] & 0x80))
+      {
+         Publish(FFBInputKinds::Type::Button, i, (state.rgbButtons[i] & 0x80) != 0 ? 1 : 0, pollUs, nowUs);
+      }
+   }
+   m_lastState = state;
+}
+
+void InputCapture::Publish(FFBInputKinds::Type kind, int index, LONG value, int64_t timeUs, int64_t nowUs)
+{
+   // Every change takes a sequence number, dropped or not, so the reader
+   // can tell it missed some.
+   uint32_t sequence = m_sequence++;
+   FFBInputRecord* pRecord = m_ring.Reserve();
+   if (pRecord == NULL)
+   {
+      m_nDropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+   }
+   uint32_t delayUs = nowUs > timeUs ? (uint32_t)(nowUs - timeUs) : 0;
+   pRecord->timeUs = timeUs;
+   pRecord->captureDelayUs = delayUs;
+   pRecord->sequence = sequence;
+   pRecord->kind = (uint16_t)kind;
+   pRecord->index = (uint16_t)index;
+   pRecord->value = value;
+   m_ring.Commit();
+
+   m_nPublished.fetch_add(1, std::memory_order_relaxed);
+   m_delaySumUs.fetch_add(delayUs, std::memory_order_relaxed);
+   if (delayUs > m_maxDelayUs.load(std::memory_order_relaxed))
+   {
+      m_maxDelayUs.store(delayUs, std::memory_order_relaxed);
+   }
+}
+
+void InputCapture::GetRing(FFBInputRing& ring)
+{
+   ring.records = m_ring.Items();
+   ring.writeIndex = (const volatile uint32_t*)&m_ring.Tail();
+   ring.readIndex = (volatile uint32_t*)&m_ring.Head();
+   ring.capacity = FFB_INPUT_RING_CAPACITY;
+   ring.recordSize = sizeof(FFBInputRecord);
+}
+
+void InputCapture::GetStats(FFBInputCaptureStats& stats) const
+{
+   stats.mode = m_mode;
+   stats.reads = m_nReads.load(std::memory_order_relaxed);
+   stats.failedReads = m_nFailedReads.load(std::memory_order_relaxed);
+   stats.deviceOverflows = m_nDeviceOverflows.load(std::memory_order_relaxed);
+   stats.recordsPublished = m_nPublished.load(std::memory_order_relaxed);
+   stats.droppedRecords = m_nDropped.load(std::memory_order_relaxed);
+   stats.meanCaptureDelayMicroseconds = stats.recordsPublished > 0 ? (float)((double)m_delaySumUs.load(std::memory_order_relaxed) / stats.recordsPublished) : 0;
+   stats.maxCaptureDelayMicroseconds = (float)m_maxDelayUs.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "pch.h"
+#include "unity-ffb.h"
+#include "backend.h"
+#include "spsc-queue.h"
+#include <atomic>
+
+// Changes read from the device buffer per GetDeviceData call.
+static const DWORD INPUT_READ_BATCH = 64;
+
+/**
+ * Captures a device's input on the device's input thread into a single
+ * producer / single consumer ring of time stamped records, which the game
+ * reads in place every frame (see FFBInputRing) without a call into the
+ * plugin or a copy.
+ *
+ * Buffered, the device keeps every change with its time until it is read,
+ * so no change between two reads is missed and each is stamped with when
+ * it happened rather than when it was read. Polled, the state is read and
+ * compared to the last one, changes between two polls are seen as one and
+ * stamped with the poll.
+ *
+ * A full ring drops the newest records, the game sees the gap in their
+ * sequence numbers.
+ */
+class InputCapture
+{
+public:
+   InputCapture();
+
+   static HRESULT Validate(const FFBInputCaptureConfig& config);
+
+   /**
+    * Start over in mode, with the capture stopped. The ring keeps what was
+    * published and not read yet.
+    */
+   void Begin(FFBInputModes::Type mode);
+   FFBInputModes::Type GetMode() const { return m_mode; }
+
+   /**
+    * Read the device and publish its changes. Input thread only.
+    */
+   void Capture(FFBDevice* pDevice);
+
+   void GetRing(FFBInputRing& ring);
+   void GetStats(FFBInputCaptureStats& stats) const;
+
+private:
+   void CaptureBuffered(FFBDevice* pDevice);
+   void CapturePolled(FFBDevice* pDevice);
+   void Publish(FFBInputKinds::Type kind, int index, LONG value, int64_t timeUs, int64_t nowUs);
+
+   SpscQueue<FFBInputRecord, FFB_INPUT_RING_CAPACITY> m_ring;
+   FFBInputModes::Type m_mode;
+
+   // Input thread only.
+   DIDEVICEOBJECTDATA m_data[INPUT_READ_BATCH];
+   DIJOYSTATE m_lastState;
+   // False until the first poll, which only sets m_lastState.
+   bool m_bPolled;
+   uint32_t m_sequence;
+
+   std::atomic<uint32_t> m_nReads;
+   std::atomic<uint32_t> m_nFailedReads;
+   std::atomic<uint32_t> m_nDeviceOverflows;
+   std::atomic<uint64_t> m_nPublished;
+   std::atomic<uint32_t> m_nDropped;
+   std::atomic<uint64_t> m_delaySumUs;
+   std::atomic<uint32_t> m_maxDelayUs;
+};
@@ -0,0 +1,410 @@
+#include "pch.h"
+#include "keyframes.h"
+#include <algorithm>
+#include <limits>
+#include <math.h>
+#include <string.h>
+
+// Bounds of the keyframe interval estimate.
+static const int64_t MIN_INTERVAL_US = 1000;
+static const int64_t MAX_INTERVAL_US = 100000;
+
+KeyframeResampler::KeyframeResampler() :
+   m_lastSubmittedUs(0),
+   m_epoch(0),
+   m_activeEpoch(0),
+   m_nSubmitted(0),
+   m_nDropped(0),
+   m_nLate(0),
+   m_nUnderruns(0),
+   m_latencySumUs(0),
+   m_nLatencies(0),
+   m_latencyMaxUs(0),
+   m_leadSumUs(0),
+   m_nLeads(0),
+   m_leadMinUs(std::numeric_limits<int64_t>::max())
+{
+   DefaultConfig(m_gameConfig);
+   m_config = m_gameConfig;
+   Reset();
+}
+
+void KeyframeResampler::DefaultConfig(FFBKeyframeConfig& config)
+{
+   config.mode = FFBKeyframeModes::Type::Hermite;
+   // A 50 Hz physics step plus some jitter.
+   config.delayMs = 25.0f;
+   config.lookaheadMs = 1.0f;
+   config.maxExtrapolationMs = 25.0f;
+}
+
+HRESULT KeyframeResampler::Validate(const FFBKeyframeConfig& config)
+{
+   if (config.mode != FFBKeyframeModes::Type::Hermite && config.mode != FFBKeyframeModes::Type::Extrapolate)
+   {
+      return E_INVALIDARG;
+   }
+   // Negated comparisons also catch NaN.
+   if (!(config.delayMs >= 0 && config.delayMs <= 1000) || !(config.lookaheadMs >= 0 && config.lookaheadMs <= 1000)
+      || !(config.maxExtrapolationMs >= 0 && config.maxExtrapolationMs <= 1000))
+   {
+      return E_INVALIDARG;
+   }
+   return S_OK;
+}
+
+void KeyframeResampler::Configure(const FFBKeyframeConfig& config)
+{
+   m_gameConfig = config;
+   m_lastSubmittedUs = 0;
+   m_epoch.fetch_add(1, std::memory_order_release);
+   m_tbConfig.Write(config);
+}
+
+bool KeyframeResampler::Submit(const FFBForceKeyframe& keyframe, int64_t nowUs)
+{
+   QueuedKeyframe* pItem = NULL;
+   int64_t timeUs = keyframe.timeUs != 0 ? keyframe.timeUs : nowUs;
+   // Interpolation needs increasing times.
+   if (timeUs > m_lastSubmittedUs)
+   {
+      pItem = m_queue.Reserve();
+   }
+   if (pItem == NULL)
+   {
+      m_nDropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+   }
+   pItem->keyframe = keyframe;
+   pItem->keyframe.timeUs = timeUs;
+   pItem->submitUs = nowUs;
+   pItem->epoch = m_epoch.load(std::memory_order_relaxed);
+   m_queue.Commit();
+   m_lastSubmittedUs = timeUs;
+   m_nSubmitted.fetch_add(1, std::memory_order_relaxed);
+   return true;
+}
+
+void KeyframeResampler::Reset()
+{
+   m_activeEpoch = m_epoch.load(std::memory_order_acquire);
+   m_tbConfig.Read(m_config);
+   m_nKeys = 0;
+   m_intervalUs = 20000;
+   m_bHaveOutput = false;
+   m_lastRenderUs = 0;
+   ZeroMemory(m_output, sizeof(m_output));
+   ZeroMemory(m_outputSlope, sizeof(m_outputSlope));
+   ZeroMemory(m_blend, sizeof(m_blend));
+   m_blendStartUs = 0;
+   m_blendUs = 1;
+   m_nPending = 0;
+}
+
+bool KeyframeResampler::Sample(int64_t nowUs, int axisCount, float* force)
+{
+   m_tbConfig.Read(m_config);
+   uint32_t epoch = m_epoch.load(std::memory_order_acquire);
+   if (epoch != m_activeEpoch)
+   {
+      // Reconfigured: start over with the keyframes submitted since.
+      Reset();
+   }
+   if (axisCount > MAX_FFB_AXES)
+   {
+      axisCount = MAX_FFB_AXES;
+   }
+
+   bool hermite = m_config.mode == FFBKeyframeModes::Type::Hermite;
+   int64_t renderUs = hermite ? nowUs - (int64_t)(m_config.delayMs * 1000) : nowUs + (int64_t)(m_config.lookaheadMs * 1000);
+
+   m_nPending = 0;
+   QueuedKeyframe item;
+   while (m_queue.Pop(item))
+   {
+      if (item.epoch == m_activeEpoch)
+      {
+         Accept(item, renderUs, axisCount);
+      }
+   }
+   if (m_nKeys == 0)
+   {
+      return false;
+   }
+
+   if (hermite)
+   {
+      Interpolate(renderUs, axisCount, force);
+   }
+   else
+   {
+      Extrapolate(renderUs, axisCount, force);
+   }
+
+   float dt = (float)(renderUs - m_lastRenderUs) * 1e-6f;
+   for (int i = 0; i < axisCount; i++)
+   {
+      m_outputSlope[i] = m_bHaveOutput && dt > 0 ? (force[i] - m_output[i]) / dt : 0.0f;
+      m_output[i] = force[i];
+   }
+   m_lastRenderUs = renderUs;
+   m_bHaveOutput = true;
+   return true;
+}
+
+void KeyframeResampler::Accept(const QueuedKeyframe& item, int64_t renderUs, int axisCount)
+{
+   const FFBForceKeyframe& keyframe = item.keyframe;
+   int64_t lead = keyframe.timeUs - renderUs;
+   m_leadSumUs.fetch_add(lead, std::memory_order_relaxed);
+   m_nLeads.fetch_add(1, std::memory_order_relaxed);
+   if (lead < m_leadMinUs.load(std::memory_order_relaxed))
+   {
+      m_leadMinUs.store(lead, std::memory_order_relaxed);
+   }
+   if (m_nPending < (int)(sizeof(m_pendingUs) / sizeof(m_pendingUs[0])))
+   {
+      m_pendingUs[m_nPending++] = item.submitUs;
+   }
+
+   Key key;
+   ZeroMemory(&key, sizeof(key));
+   key.timeUs = keyframe.timeUs;
+   key.hasDerivative = keyframe.hasDerivative != FALSE;
+   for (int i = 0; i < axisCount; i++)
+   {
+      key.value[i] = keyframe.force[i];
+      key.derivative[i] = keyframe.derivative[i];
+   }
+
+   if (m_nKeys > 0)
+   {
+      int64_t spacing = key.timeUs - m_keys[m_nKeys - 1].timeUs;
+      if (spacing > 0)
+      {
+         m_intervalUs += (std::min(std::max(spacing, MIN_INTERVAL_US), MAX_INTERVAL_US) - m_intervalUs) / 8;
+      }
+   }
+
+   bool hermite = m_config.mode == FFBKeyframeModes::Type::Hermite;
+   // Late: its time was already rendered, or it comes before a late
+   // keyframe that was moved ahead. Interpolating to it would jump, so the
+   // force eases from where it is to the keyframe over one interval.
+   if (hermite && m_bHaveOutput && (key.timeUs <= renderUs || (m_nKeys > 0 && key.timeUs <= m_keys[m_nKeys - 1].timeUs)))
+   {
+      m_nLate.fetch_add(1, std::memory_order_relaxed);
+      Key from;
+      ZeroMemory(&from, sizeof(from));
+      from.timeUs = m_lastRenderUs;
+      from.hasDerivative = true;
+      memcpy(from.value, m_output, sizeof(from.value));
+      memcpy(from.derivative, m_outputSlope, sizeof(from.derivative));
+      m_nKeys = 0;
+      Push(from);
+      key.timeUs = std::max(key.timeUs, m_lastRenderUs + m_intervalUs);
+   }
+   Push(key);
+
+   if (!hermite && m_bHaveOutput)
+   {
+      // Blend from what was being output to the new prediction.
+      float predicted[MAX_FFB_AXES];
+      ZeroMemory(m_blend, sizeof(m_blend));
+      Extrapolate(m_lastRenderUs, axisCount, predicted);
+      for (int i = 0; i < axisCount; i++)
+      {
+         m_blend[i] = m_output[i] - predicted[i];
+      }
+      m_blendStartUs = m_lastRenderUs;
+      m_blendUs = m_intervalUs;
+   }
+}
+
+void KeyframeResampler::Push(const Key& key)
+{
+   // Extrapolation only looks at the last two.
+   int keep = m_config.mode == FFBKeyframeModes::Type::Hermite ? HISTORY : 2;
+   if (m_nKeys >= keep)
+   {
+      Drop(m_nKeys - keep + 1);
+   }
+   m_keys[m_nKeys++] = key;
+}
+
+void KeyframeResampler::Drop(int count)
+{
+   memmove(&m_keys[0], &m_keys[count], sizeof(Key) * (m_nKeys - count));
+   m_nKeys -= count;
+}
+
+/**
+ * Slope at a keyframe: its derivative if it has one, otherwise the
+ * harmonic mean of the slopes to its neighbours, 0 at a turning point.
+ */
+float KeyframeResampler::Tangent(int index, int axis) const
+{
+   const Key& key = m_keys[index];
+   if (key.hasDerivative)
+   {
+      return key.derivative[axis];
+   }
+   bool hasBefore = index > 0;
+   bool hasAfter = index + 1 < m_nKeys;
+   float before = 0;
+   float after = 0;
+   if (hasBefore)
+   {
+      const Key& previous = m_keys[index - 1];
+      before = (key.value[axis] - previous.value[axis]) / ((key.timeUs - previous.timeUs) * 1e-6f);
+   }
+   if (hasAfter)
+   {
+      const Key& next = m_keys[index + 1];
+      after = (next.value[axis] - key.value[axis]) / ((next.timeUs - key.timeUs) * 1e-6f);
+   }
+   if (hasBefore && hasAfter)
+   {
+      return before * after <= 0 ? 0.0f : 2.0f * before * after / (before + after);
+   }
+   return hasBefore ? before : after;
+}
+
+/**
+ * Cubic Hermite between the keyframes around renderUs. Each tangent is
+ * limited to 0 .. 3 times the slope of the segment (Fritsch-Carlson), so
+ * the curve stays between the two keyframes even when their derivatives
+ * disagree with them. Outside the keyframes the nearest one is held.
+ */
+void KeyframeResampler::Interpolate(int64_t renderUs, int axisCount, float* force)
+{
+   if (renderUs <= m_keys[0].timeUs)
+   {
+      memcpy(force, m_keys[0].value, sizeof(float) * axisCount);
+      return;
+   }
+   if (renderUs >= m_keys[m_nKeys - 1].timeUs)
+   {
+      m_nUnderruns.fetch_add(1, std::memory_order_relaxed);
+      memcpy(force, m_keys[m_nKeys - 1].value, sizeof(float) * axisCount);
+      return;
+   }
+   // Keep the keyframe before the segment, for the tangent at its start.
+   int passed = 0;
+   while (passed + 2 < m_nKeys && m_keys[passed + 2].timeUs <= renderUs)
+   {
+      passed++;
+   }
+   if (passed > 0)
+   {
+      Drop(passed);
+   }
+   int k = 0;
+   while (m_keys[k + 1].timeUs <= renderUs)
+   {
+      k++;
+   }
+   const Key& a = m_keys[k];
+   const Key& b = m_keys[k + 1];
+   float dt = (b.timeUs - a.timeUs) * 1e-6f;
+   float s = (float)(renderUs - a.timeUs) / (float)(b.timeUs - a.timeUs);
+   float s2 = s * s;
+   float s3 = s2 * s;
+   float h00 = 2 * s3 - 3 * s2 + 1;
+   float h10 = s3 - 2 * s2 + s;
+   float h01 = -2 * s3 + 3 * s2;
+   float h11 = s3 - s2;
+   for (int i = 0; i < axisCount; i++)
+   {
+      float secant = (b.value[i] - a.value[i]) / dt;
+      float limit = 3.0f * fabsf(secant);
+      float m0 = Tangent(k, i);
+      float m1 = Tangent(k + 1, i);
+      m0 = m0 * secant <= 0 ? 0.0f : std::min(std::max(m0, -limit), limit);
+      m1 = m1 * secant <= 0 ? 0.0f : std::min(std::max(m1, -limit), limit);
+      force[i] = h00 * a.value[i] + h10 * dt * m0 + h01 * b.value[i] + h11 * dt * m1;
+   }
+}
+
+/**
+ * Linear prediction from the newest keyframe, along its derivative or the
+ * slope from the keyframe before it. Limited to maxExtrapolationMs past
+ * the keyframe and, without a derivative, to the size of the last step.
+ */
+void KeyframeResampler::Extrapolate(int64_t renderUs, int axisCount, float* force)
+{
+   const Key& newest = m_keys[m_nKeys - 1];
+   const Key* pPrevious = m_nKeys > 1 ? &m_keys[m_nKeys - 2] : NULL;
+   if (renderUs < newest.timeUs && pPrevious != NULL)
+   {
+      // Ahead of the prediction point, between the last two keyframes.
+      float s = (float)(renderUs - pPrevious->timeUs) / (float)(newest.timeUs - pPrevious->timeUs);
+      s = std::max(s, 0.0f);
+      for (int i = 0; i < axisCount; i++)
+      {
+         force[i] = pPrevious->value[i] + s * (newest.value[i] - pPrevious->value[i]);
+      }
+   }
+   else
+   {
+      int64_t maxUs = (int64_t)(m_config.maxExtrapolationMs * 1000);
+      float ahead = (float)std::min(std::max(renderUs - newest.timeUs, (int64_t)0), maxUs) * 1e-6f;
+      for (int i = 0; i < axisCount; i++)
+      {
+         float step;
+         if (newest.hasDerivative)
+         {
+            step = newest.derivative[i] * ahead;
+         }
+         else if (pPrevious != NULL)
+         {
+            float last = newest.value[i] - pPrevious->value[i];
+            step = last / ((newest.timeUs - pPrevious->timeUs) * 1e-6f) * ahead;
+            step = std::min(std::max(step, -fabsf(last)), fabsf(last));
+         }
+         else
+         {
+            step = 0;
+         }
+         force[i] = newest.value[i] + step;
+      }
+   }
+
+   float weight = 1.0f - (float)(renderUs - m_blendStartUs) / (float)m_blendUs;
+   if (weight > 0)
+   {
+      weight = std::min(weight, 1.0f);
+      for (int i = 0; i < axisCount; i++)
+      {
+         force[i] += m_blend[i] * weight;
+      }
+   }
+}
+
+void KeyframeResampler::Applied(int64_t nowUs)
+{
+   for (int i = 0; i < m_nPending; i++)
+   {
+      int64_t latency = nowUs - m_pendingUs[i];
+      m_latencySumUs.fetch_add((uint64_t)latency, std::memory_order_relaxed);
+      m_nLatencies.fetch_add(1, std::memory_order_relaxed);
+      if (latency > m_latencyMaxUs.load(std::memory_order_relaxed))
+      {
+         m_latencyMaxUs.store(latency, std::memory_order_relaxed);
+      }
+   }
+   m_nPending = 0;
+}
+
+void KeyframeResampler::GetStats(FFBKeyframeStats& stats) const
+{
+   stats.submitted = m_nSubmitted.load(std::memory_order_relaxed);
+   stats.dropped = m_nDropped.load(std::memory_order_relaxed);
+   stats.late = m_nLate.load(std::memory_order_relaxed);
+   stats.underruns = m_nUnderruns.load(std::memory_order_relaxed);
+   uint32_t latencies = m_nLatencies.load(std::memory_order_relaxed);
+   stats.meanLatencyMicroseconds = latencies > 0 ? (float)m_latencySumUs.load(std::memory_order_relaxed) / latencies : 0.0f;
+   stats.maxLatencyMicroseconds = (float)m_latencyMaxUs.load(std::memory_order_relaxed);
+   uint32_t leads = m_nLeads.load(std::memory_order_relaxed);
+   stats.meanLeadMicroseconds = leads > 0 ? (float)m_leadSumUs.load(std::memory_order_relaxed) / leads : 0.0f;
+   stats.minLeadMicroseconds = leads > 0 ? (float)m_leadMinUs.load(std::memory_order_relaxed) : 0.0f;
+}
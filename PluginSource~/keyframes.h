@@ -0,0 +1,135 @@
+#pragma once
+#include "pch.h"
+#include "unity-ffb.h"
+#include "spsc-queue.h"
+#include "triple-buffer.h"
+#include <atomic>
+#include <chrono>
+
+/**
+ * The GetFFBClockMicroseconds clock keyframes are timed on.
+ */
+static inline int64_t KeyframeClockUs()
+{
+   return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct QueuedKeyframe {
+   FFBForceKeyframe keyframe;
+   int64_t submitUs;
+   // Configure call it was submitted after, older ones are stale.
+   uint32_t epoch;
+};
+
+/**
+ * Turns the force keyframes the game submits at its physics rate into a
+ * force every output tick, instead of holding each value until the next
+ * one arrives.
+ *
+ * Hermite mode renders a little in the past, between two keyframes, with
+ * tangents limited so the force never leaves the range of the keyframes
+ * around it. A keyframe that arrives after its time was rendered is eased
+ * into from the force being output. Extrapolate mode predicts ahead of now
+ * from the newest keyframe, bounded in time and by the last step, and
+ * blends from the old prediction to the new one when a keyframe arrives.
+ *
+ * Keyframes are submitted from the game thread and picked up by the output
+ * thread through a queue, Sample is only called by the output thread.
+ */
+class KeyframeResampler
+{
+public:
+   static const uint32_t CAPACITY = 64;
+   // Keyframes ahead of the rendered time that can be held, more are
+   // dropped oldest first.
+   static const int HISTORY = 32;
+
+   KeyframeResampler();
+
+   static void DefaultConfig(FFBKeyframeConfig& config);
+   static HRESULT Validate(const FFBKeyframeConfig& config);
+
+   /**
+    * Set the mode and drop the keyframes queued so far. Game thread only.
+    */
+   void Configure(const FFBKeyframeConfig& config);
+   const FFBKeyframeConfig& GetConfig() const { return m_gameConfig; }
+
+   /**
+    * Queue a keyframe, false if it was dropped. Game thread only.
+    */
+   bool Submit(const FFBForceKeyframe& keyframe, int64_t nowUs);
+
+   /**
+    * Forget the keyframes and the force output so far, output thread only.
+    */
+   void Reset();
+
+   /**
+    * The force per axis at nowUs, false while there is no keyframe yet.
+    * Output thread only.
+    */
+   bool Sample(int64_t nowUs, int axisCount, float* force);
+
+   /**
+    * Called once the force from Sample was sent, to measure the latency of
+    * the keyframes it picked up.
+    */
+   void Applied(int64_t nowUs);
+
+   void GetStats(FFBKeyframeStats& stats) const;
+
+private:
+   struct Key {
+      int64_t timeUs;
+      bool hasDerivative;
+      float value[MAX_FFB_AXES];
+      // Units per second.
+      float derivative[MAX_FFB_AXES];
+   };
+
+   void Accept(const QueuedKeyframe& item, int64_t renderUs, int axisCount);
+   void Push(const Key& key);
+   void Drop(int count);
+   float Tangent(int index, int axis) const;
+   void Interpolate(int64_t renderUs, int axisCount, float* force);
+   void Extrapolate(int64_t renderUs, int axisCount, float* force);
+
+   // Owned by the game thread.
+   FFBKeyframeConfig m_gameConfig;
+   int64_t m_lastSubmittedUs;
+   std::atomic<uint32_t> m_epoch;
+   TripleBuffer<FFBKeyframeConfig> m_tbConfig;
+   SpscQueue<QueuedKeyframe, CAPACITY> m_queue;
+
+   // Owned by the output thread.
+   FFBKeyframeConfig m_config;
+   uint32_t m_activeEpoch;
+   Key m_keys[HISTORY];
+   int m_nKeys;
+   // Spacing of the keyframes, smoothed.
+   int64_t m_intervalUs;
+   bool m_bHaveOutput;
+   int64_t m_lastRenderUs;
+   float m_output[MAX_FFB_AXES];
+   float m_outputSlope[MAX_FFB_AXES];
+   // Extrapolate: what is left of the jump to the new prediction.
+   float m_blend[MAX_FFB_AXES];
+   int64_t m_blendStartUs;
+   int64_t m_blendUs;
+   // Submit times of the keyframes picked up by the last Sample.
+   int64_t m_pendingUs[8];
+   int m_nPending;
+
+   std::atomic<uint32_t> m_nSubmitted;
+   std::atomic<uint32_t> m_nDropped;
+   std::atomic<uint32_t> m_nLate;
+   std::atomic<uint32_t> m_nUnderruns;
+   std::atomic<uint64_t> m_latencySumUs;
+   std::atomic<uint32_t> m_nLatencies;
+   std::atomic<int64_t> m_latencyMaxUs;
+   std::atomic<int64_t> m_leadSumUs;
+   std::atomic<uint32_t> m_nLeads;
+   std::atomic<int64_t> m_leadMinUs;
+};
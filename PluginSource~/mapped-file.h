@@ -0,0 +1,127 @@
+#pragma once
+#include "pch.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * A read only view of a whole file, so it can be parsed in place without
+ * reading it into a buffer first. Pages are only read from disk once they
+ * are touched.
+ */
+class MappedFile
+{
+public:
+   MappedFile() : m_pData(NULL), m_size(0)
+   {
+#ifdef _WIN32
+      m_hFile = INVALID_HANDLE_VALUE;
+      m_hMapping = NULL;
+#endif
+   }
+
+   ~MappedFile()
+   {
+      Close();
+   }
+
+   /**
+    * Map the file at path, false if it does not exist, is empty or cannot
+    * be mapped. Pass sequential when it is read front to back once.
+    */
+   bool Open(const char* path, bool sequential = false)
+   {
+      Close();
+#ifdef _WIN32
+      m_hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+         sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL, NULL);
+      LARGE_INTEGER size;
+      if (m_hFile == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_hFile, &size) || size.QuadPart == 0)
+      {
+         Close();
+         return false;
+      }
+      m_size = (size_t)size.QuadPart;
+      m_hMapping = CreateFileMappingA(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+      if (m_hMapping == NULL)
+      {
+         Close();
+         return false;
+      }
+      m_pData = (const BYTE*)MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+#else
+      int fd = open(path, O_RDONLY);
+      struct stat st;
+      if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0)
+      {
+         if (fd >= 0)
+         {
+            close(fd);
+         }
+         return false;
+      }
+      m_size = (size_t)st.st_size;
+      void* data = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      // The mapping keeps the file open.
+      close(fd);
+      m_pData = data != MAP_FAILED ? (const BYTE*)data : NULL;
+      if (m_pData != NULL && sequential)
+      {
+         madvise(data, m_size, MADV_SEQUENTIAL);
+      }
+#endif
+      if (m_pData == NULL)
+      {
+         Close();
+         return false;
+      }
+      return true;
+   }
+
+   /**
+    * Unmap the file, e.g. before replacing it. Data is NULL afterwards.
+    */
+   void Close()
+   {
+#ifdef _WIN32
+      if (m_pData != NULL)
+      {
+         UnmapViewOfFile(m_pData);
+      }
+      if (m_hMapping != NULL)
+      {
+         CloseHandle(m_hMapping);
+         m_hMapping = NULL;
+      }
+      if (m_hFile != INVALID_HANDLE_VALUE)
+      {
+         CloseHandle(m_hFile);
+         m_hFile = INVALID_HANDLE_VALUE;
+      }
+#else
+      if (m_pData != NULL)
+      {
+         munmap((void*)m_pData, m_size);
+      }
+#endif
+      m_pData = NULL;
+      m_size = 0;
+   }
+
+   const BYTE* Data() const { return m_pData; }
+   size_t Size() const { return m_size; }
+
+private:
+   MappedFile(const MappedFile&);
+   MappedFile& operator=(const MappedFile&);
+
+   const BYTE* m_pData;
+   size_t m_size;
+#ifdef _WIN32
+   HANDLE m_hFile;
+   HANDLE m_hMapping;
+#endif
+};
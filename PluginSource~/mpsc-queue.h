@@ -0,0 +1,101 @@
+#pragma once
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * Lock-free bounded multiple producer / single consumer queue. Capacity
+ * must be a power of two. Any number of threads may Push at once, Push
+ * fails rather than blocks when the queue is full; Pop fails when it is
+ * empty.
+ *
+ * Each cell carries a sequence number: producers claim a cell by moving
+ * the tail with a compare and swap, fill it, then publish it by bumping
+ * its sequence, so items from one producer are popped in the order that
+ * producer pushed them. A producer preempted between claiming a cell and
+ * publishing it holds back the items behind it until it resumes, the
+ * consumer sees the queue as empty meanwhile.
+ */
+template <typename T, uint32_t Capacity>
+class MpscQueue
+{
+   static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+   // The items are zeroed so pushing never faults their pages in.
+   MpscQueue() : m_tail(0), m_head(0), m_cells()
+   {
+      for (uint32_t i = 0; i < Capacity; i++)
+      {
+         m_cells[i].sequence.store(i, std::memory_order_relaxed);
+      }
+   }
+
+   /**
+    * Any thread may push.
+    */
+   bool Push(const T& value)
+   {
+      uint32_t tail = m_tail.load(std::memory_order_relaxed);
+      for (;;)
+      {
+         Cell& cell = m_cells[tail & (Capacity - 1)];
+         uint32_t sequence = cell.sequence.load(std::memory_order_acquire);
+         int32_t diff = (int32_t)(sequence - tail);
+         if (diff == 0)
+         {
+            // The cell is free, claim it unless another producer did first.
+            if (m_tail.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed))
+            {
+               cell.value = value;
+               cell.sequence.store(tail + 1, std::memory_order_release);
+               return true;
+            }
+         }
+         else if (diff < 0)
+         {
+            // Still holds the item from a lap ago, the queue is full.
+            return false;
+         }
+         else
+         {
+            tail = m_tail.load(std::memory_order_relaxed);
+         }
+      }
+   }
+
+   /**
+    * Only one thread may pop.
+    */
+   bool Pop(T& value)
+   {
+      Cell& cell = m_cells[m_head & (Capacity - 1)];
+      if (cell.sequence.load(std::memory_order_acquire) != m_head + 1)
+      {
+         return false;
+      }
+      value = cell.value;
+      cell.sequence.store(m_head + Capacity, std::memory_order_release);
+      m_head++;
+      return true;
+   }
+
+   /**
+    * Items pushed and not popped yet, only exact while nothing is pushing.
+    * Only the popping thread.
+    */
+   uint32_t Size() const
+   {
+      return m_tail.load(std::memory_order_relaxed) - m_head;
+   }
+
+private:
+   struct Cell {
+      std::atomic<uint32_t> sequence;
+      T value;
+   };
+
+   // Kept on separate cache lines so the two sides do not contend.
+   alignas(64) std::atomic<uint32_t> m_tail;
+   alignas(64) uint32_t m_head;
+   alignas(64) Cell m_cells[Capacity];
+};
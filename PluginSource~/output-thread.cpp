@@ -0,0 +1,173 @@
+#include "pch.h"
+#include "output-thread.h"
+#include "unity-ffb.h"
+#include <chrono>
+
+#ifdef _WIN32
+#include <timeapi.h>
+#endif
+
+typedef std::chrono::steady_clock OutputClock;
+
+// Sleeping is only accurate to roughly this much, the rest is spun.
+static const std::chrono::microseconds SPIN_MARGIN(200);
+
+OutputThread::OutputThread() :
+   m_bRunning(false),
+   m_rateHz(0),
+   m_ticks(0),
+   m_overruns(0),
+   m_updatesApplied(0),
+   m_updatesFailed(0),
+   m_jitterSumNs(0),
+   m_jitterMaxNs(0),
+   m_bResetStats(false)
+{
+}
+
+OutputThread::~OutputThread()
+{
+   Stop();
+}
+
+/**
+ * Start calling tick rateHz times per second. Fails with E_ABORT if the
+ * thread is already running.
+ */
+HRESULT OutputThread::Start(int rateHz, std::function<void()> tick)
+{
+   if (rateHz < MIN_RATE_HZ || rateHz > MAX_RATE_HZ)
+   {
+      return E_INVALIDARG;
+   }
+   if (IsRunning())
+   {
+      return E_ABORT;
+   }
+   m_tick = tick;
+   m_rateHz.store(rateHz);
+   ResetStats();
+   m_bRunning.store(true, std::memory_order_release);
+   m_thread = std::thread(&OutputThread::Run, this);
+   return S_OK;
+}
+
+void OutputThread::Stop()
+{
+   m_bRunning.store(false, std::memory_order_release);
+   if (m_thread.joinable())
+   {
+      m_thread.join();
+   }
+}
+
+HRESULT OutputThread::SetRate(int rateHz)
+{
+   if (rateHz < MIN_RATE_HZ || rateHz > MAX_RATE_HZ)
+   {
+      return E_INVALIDARG;
+   }
+   m_rateHz.store(rateHz);
+   return S_OK;
+}
+
+void OutputThread::CountUpdate(HRESULT hr)
+{
+   if (FAILED(hr))
+   {
+      m_updatesFailed.fetch_add(1, std::memory_order_relaxed);
+   }
+   else
+   {
+      m_updatesApplied.fetch_add(1, std::memory_order_relaxed);
+   }
+}
+
+void OutputThread::GetStats(ForceOutputStats& stats) const
+{
+   stats.running = IsRunning();
+   stats.rateHz = m_rateHz.load();
+   stats.ticks = m_ticks.load();
+   stats.overruns = m_overruns.load();
+   stats.updatesApplied = m_updatesApplied.load();
+   stats.updatesFailed = m_updatesFailed.load();
+   stats.meanJitterMicroseconds = stats.ticks > 0 ? (float)(m_jitterSumNs.load() / 1000.0 / stats.ticks) : 0.0f;
+   stats.maxJitterMicroseconds = (float)(m_jitterMaxNs.load() / 1000.0);
+}
+
+/**
+ * Counters are owned by the output thread, so while it runs the reset is
+ * only requested and done at the start of its next tick.
+ */
+void OutputThread::ResetStats()
+{
+   if (IsRunning())
+   {
+      m_bResetStats.store(true);
+      return;
+   }
+   m_ticks = 0;
+   m_overruns = 0;
+   m_updatesApplied = 0;
+   m_updatesFailed = 0;
+   m_jitterSumNs = 0;
+   m_jitterMaxNs = 0;
+}
+
+void OutputThread::Run()
+{
+#ifdef _WIN32
+   // Default timer resolution is 15.6ms, far too coarse to sleep on.
+   timeBeginPeriod(1);
+   SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+#endif
+
+   OutputClock::time_point deadline = OutputClock::now();
+   while (m_bRunning.load(std::memory_order_acquire))
+   {
+      OutputClock::duration period = std::chrono::nanoseconds(1000000000LL / m_rateHz.load());
+      deadline += period;
+
+      OutputClock::time_point now = OutputClock::now();
+      if (deadline - now > SPIN_MARGIN)
+      {
+         std::this_thread::sleep_until(deadline - SPIN_MARGIN);
+      }
+      while ((now = OutputClock::now()) < deadline)
+      {
+      }
+
+      if (m_bResetStats.exchange(false))
+      {
+         m_ticks = 0;
+         m_overruns = 0;
+         m_updatesApplied = 0;
+         m_updatesFailed = 0;
+         m_jitterSumNs = 0;
+         m_jitterMaxNs = 0;
+      }
+
+      uint64_t jitterNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(now - deadline).count();
+      m_jitterSumNs.store(m_jitterSumNs.load(std::memory_order_relaxed) + jitterNs, std::memory_order_relaxed);
+      if (jitterNs > m_jitterMaxNs.load(std::memory_order_relaxed))
+      {
+         m_jitterMaxNs.store(jitterNs, std::memory_order_relaxed);
+      }
+
+      m_tick();
+      m_ticks.fetch_add(1, std::memory_order_relaxed);
+
+      // If the tick ran past the next deadline skip the missed periods
+      // instead of bursting to catch up.
+      now = OutputClock::now();
+      if (now >= deadline + period)
+      {
+         m_overruns.fetch_add(1, std::memory_order_relaxed);
+         deadline = now;
+      }
+   }
+
+#ifdef _WIN32
+   timeEndPeriod(1);
+#endif
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "pch.h"
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+struct ForceOutputStats;
+
+/**
+ * Runs a tick function at a fixed rate on its own thread, independent of
+ * Unity's FixedUpdate. Waits with a coarse sleep followed by a short spin
+ * so the period holds at kHz rates, and records jitter and overruns.
+ */
+class OutputThread
+{
+public:
+   static const int MIN_RATE_HZ = 10;
+   static const int MAX_RATE_HZ = 4000;
+
+   OutputThread();
+   ~OutputThread();
+
+   HRESULT Start(int rateHz, std::function<void()> tick);
+   void Stop();
+   HRESULT SetRate(int rateHz);
+   bool IsRunning() const { return m_bRunning.load(std::memory_order_acquire); }
+   int GetRate() const { return m_rateHz.load(std::memory_order_relaxed); }
+
+   void GetStats(ForceOutputStats& stats) const;
+   void ResetStats();
+
+   /**
+    * Called by the tick function to count driver calls it made.
+    */
+   void CountUpdate(HRESULT hr);
+
+private:
+   void Run();
+
+   std::thread m_thread;
+   std::function<void()> m_tick;
+   std::atomic<bool> m_bRunning;
+   std::atomic<int> m_rateHz;
+
+   std::atomic<uint32_t> m_ticks;
+   std::atomic<uint32_t> m_overruns;
+   std::atomic<uint32_t> m_updatesApplied;
+   std::atomic<uint32_t> m_updatesFailed;
+   std::atomic<uint64_t> m_jitterSumNs;
+   std::atomic<uint64_t> m_jitterMaxNs;
+   std::atomic<bool> m_bResetStats;
+};
@@ -0,0 +1,244 @@
+#include "pch.h"
+#include "rate-governor.h"
+#include "output-thread.h"
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Longest windowMs accepted, ten seconds.
+static const float GOVERNOR_MAX_WINDOW_MS = 10000.0f;
+static const float GOVERNOR_MIN_WINDOW_MS = 10.0f;
+
+// Ticks of a window that may be slow or overrun before the device counts
+// as saturated, one in this many. A single one is more likely the thread
+// being preempted than the device.
+static const DWORD GOVERNOR_SLOW_TICK_TOLERANCE = 20;
+
+// floor(log2(us)) * 4 plus the next two bits below it, 0 for 0.
+static inline int LatencyBucket(int64_t us, int bucketCount)
+{
+   uint64_t value = (uint64_t)(us > 0 ? us : 0);
+#ifdef _MSC_VER
+   unsigned long msb;
+   _BitScanReverse64(&msb, value | 1);
+#else
+   int msb = 63 - __builtin_clzll(value | 1);
+#endif
+   int bucket = (int)msb * 4 + (int)(((value << 2) >> msb) & 3);
+   return bucket < bucketCount ? bucket : bucketCount - 1;
+}
+
+// The upper end of a LatencyBucket.
+static inline float LatencyBucketEnd(int bucket)
+{
+   return (float)(5 + bucket % 4) * (float)(1ULL << (bucket / 4)) / 4.0f;
+}
+
+RateGovernor::RateGovernor() :
+   m_bEnabled(false)
+{
+   DefaultConfig(m_config);
+   Reset();
+}
+
+void RateGovernor::DefaultConfig(FFBRateGovernorConfig& config)
+{
+   config.floorHz = 100;
+   config.ceilingHz = 1000;
+   config.increaseHz = 50;
+   config.decreaseFactor = 0.75f;
+   config.busyPercent = 50;
+   config.windowMs = 100;
+}
+
+HRESULT RateGovernor::Validate(const FFBRateGovernorConfig& config)
+{
+   if (config.floorHz < OutputThread::MIN_RATE_HZ || config.ceilingHz > OutputThread::MAX_RATE_HZ
+      || config.floorHz > config.ceilingHz || config.increaseHz <= 0)
+   {
+      return E_INVALIDARG;
+   }
+   if (!(config.decreaseFactor > 0 && config.decreaseFactor < 1) || !(config.busyPercent > 0 && config.busyPercent <= 100)
+      || !(config.windowMs >= GOVERNOR_MIN_WINDOW_MS && config.windowMs <= GOVERNOR_MAX_WINDOW_MS))
+   {
+      return E_INVALIDARG;
+   }
+   return S_OK;
+}
+
+/**
+ * Start adapting from the rate the output thread has, with statistics
+ * starting over.
+ */
+void RateGovernor::Enable(const FFBRateGovernorConfig& config)
+{
+   m_config = config;
+   m_bEnabled = true;
+   Reset();
+}
+
+void RateGovernor::Disable()
+{
+   m_bEnabled = false;
+}
+
+void RateGovernor::Reset()
+{
+   m_windowStartUs = 0;
+   m_windowBusyUs = 0;
+   m_windowTicks = 0;
+   m_windowSlowTicks = 0;
+   m_windowOverruns = 0;
+   m_windowUpdates = 0;
+   m_windowErrors = 0;
+   m_tickBusyUs = 0;
+   m_busyPercent = 0;
+   ZeroMemory(m_histogram, sizeof(m_histogram));
+   m_maxUs = 0;
+   m_nUpdates = 0;
+   m_nErrors = 0;
+   m_nIncreases = 0;
+   m_nDecreases = 0;
+   m_lastEvent = FFBRateEvents::Type::None;
+   m_lastEventFromHz = 0;
+   m_lastEventToHz = 0;
+   m_lastEventUs = 0;
+}
+
+void RateGovernor::Observe(HRESULT hr, int64_t latencyUs)
+{
+   m_histogram[LatencyBucket(latencyUs, LATENCY_BUCKETS)]++;
+   m_maxUs = latencyUs > m_maxUs ? latencyUs : m_maxUs;
+   m_nUpdates++;
+   m_tickBusyUs += latencyUs;
+   m_windowBusyUs += latencyUs;
+   m_windowUpdates++;
+   if (FAILED(hr))
+   {
+      m_nErrors++;
+      m_windowErrors++;
+   }
+}
+
+int RateGovernor::EndTick(int64_t startUs, int64_t nowUs, int rateHz)
+{
+   if (rateHz < m_config.floorHz || rateHz > m_config.ceilingHz)
+   {
+      // Set outside the range, by SetForceOutputRate or before the
+      // governor was enabled.
+      return rateHz < m_config.floorHz ? m_config.floorHz : m_config.ceilingHz;
+   }
+   if (m_windowStartUs == 0)
+   {
+      m_windowStartUs = startUs;
+   }
+   // A device that takes updates slower than they are sent makes every
+   // call wait a little longer than the one before, well before ticks
+   // overrun.
+   m_windowTicks++;
+   if (m_tickBusyUs * rateHz > (int64_t)(m_config.busyPercent * 10000))
+   {
+      m_windowSlowTicks++;
+   }
+   if ((nowUs - startUs) * rateHz > 1000000)
+   {
+      m_windowOverruns++;
+   }
+   m_tickBusyUs = 0;
+   int64_t windowUs = nowUs - m_windowStartUs;
+   if (windowUs < (int64_t)(m_config.windowMs * 1000))
+   {
+      return rateHz;
+   }
+
+   m_busyPercent = windowUs > 0 ? (float)(m_windowBusyUs * 100.0 / windowUs) : 0;
+   FFBRateEvents::Type event = FFBRateEvents::Type::None;
+   int newRateHz = rateHz;
+   if (m_windowErrors > 0)
+   {
+      event = FFBRateEvents::Type::Errors;
+   }
+   else if (m_windowOverruns * GOVERNOR_SLOW_TICK_TOLERANCE > m_windowTicks)
+   {
+      event = FFBRateEvents::Type::Overrun;
+   }
+   else if (m_windowSlowTicks * GOVERNOR_SLOW_TICK_TOLERANCE > m_windowTicks)
+   {
+      event = FFBRateEvents::Type::Busy;
+   }
+   else if (m_windowUpdates > 0 && rateHz < m_config.ceilingHz)
+   {
+      // Only a window that sent updates shows the device keeps up, an
+      // idle one says nothing.
+      event = FFBRateEvents::Type::Increase;
+      newRateHz = rateHz + m_config.increaseHz;
+   }
+   if (event != FFBRateEvents::Type::None && event != FFBRateEvents::Type::Increase)
+   {
+      newRateHz = (int)(rateHz * m_config.decreaseFactor);
+   }
+   newRateHz = newRateHz < m_config.floorHz ? m_config.floorHz : newRateHz;
+   newRateHz = newRateHz > m_config.ceilingHz ? m_config.ceilingHz : newRateHz;
+   if (newRateHz != rateHz)
+   {
+      if (newRateHz > rateHz)
+      {
+         m_nIncreases++;
+      }
+      else
+      {
+         m_nDecreases++;
+      }
+      m_lastEvent = event;
+      m_lastEventFromHz = rateHz;
+      m_lastEventToHz = newRateHz;
+      m_lastEventUs = nowUs;
+   }
+
+   m_windowStartUs = nowUs;
+   m_windowBusyUs = 0;
+   m_windowTicks = 0;
+   m_windowSlowTicks = 0;
+   m_windowOverruns = 0;
+   m_windowUpdates = 0;
+   m_windowErrors = 0;
+   return newRateHz;
+}
+
+float RateGovernor::Percentile(float fraction) const
+{
+   if (m_nUpdates == 0)
+   {
+      return 0;
+   }
+   uint64_t rank = (uint64_t)(fraction * m_nUpdates);
+   uint64_t count = 0;
+   for (int i = 0; i < LATENCY_BUCKETS; i++)
+   {
+      count += m_histogram[i];
+      if (count > rank)
+      {
+         float end = LatencyBucketEnd(i);
+         return end < (float)m_maxUs ? end : (float)m_maxUs;
+      }
+   }
+   return (float)m_maxUs;
+}
+
+void RateGovernor::GetStats(FFBRateGovernorStats& stats) const
+{
+   stats.enabled = m_bEnabled;
+   stats.updates = m_nUpdates;
+   stats.errors = m_nErrors;
+   stats.increases = m_nIncreases;
+   stats.decreases = m_nDecreases;
+   stats.busyPercent = m_busyPercent;
+   stats.p50Microseconds = Percentile(0.50f);
+   stats.p95Microseconds = Percentile(0.95f);
+   stats.p99Microseconds = Percentile(0.99f);
+   stats.maxMicroseconds = (float)m_maxUs;
+   stats.lastEvent = m_lastEvent;
+   stats.lastEventFromHz = m_lastEventFromHz;
+   stats.lastEventToHz = m_lastEventToHz;
+   stats.lastEventTimeUs = m_lastEventUs;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include "pch.h"
+#include "unity-ffb.h"
+
+/**
+ * Adapts the output thread's rate to what the device keeps up with,
+ * additive increase and multiplicative decrease like TCP congestion
+ * control. Every driver call the output thread makes is timed; after each
+ * window the rate goes down by decreaseFactor if calls failed or ticks
+ * spent more than busyPercent of their period in driver calls, and up by
+ * increaseHz otherwise, within floorHz - ceilingHz. A slow wheel then
+ * saws around the rate its firmware takes, a fast one stays at the
+ * ceiling. Updates published in between are coalesced to the newest by
+ * the effect targets, so a lower rate only ever drops stale values.
+ *
+ * Called from the output thread and the game thread with the device's
+ * effect lock held.
+ */
+class RateGovernor
+{
+public:
+   RateGovernor();
+
+   static void DefaultConfig(FFBRateGovernorConfig& config);
+   static HRESULT Validate(const FFBRateGovernorConfig& config);
+
+   void Enable(const FFBRateGovernorConfig& config);
+   void Disable();
+   bool IsEnabled() const { return m_bEnabled; }
+   const FFBRateGovernorConfig& GetConfig() const { return m_config; }
+
+   /**
+    * A driver call of the output thread, its result and how long it took.
+    */
+   void Observe(HRESULT hr, int64_t latencyUs);
+
+   /**
+    * End of an output tick run at rateHz from startUs until nowUs
+    * (GetFFBClockMicroseconds). The rate to run at from now on, rateHz
+    * while it stays.
+    */
+   int EndTick(int64_t startUs, int64_t nowUs, int rateHz);
+
+   // All but the rate, which is the output thread's.
+   void GetStats(FFBRateGovernorStats& stats) const;
+
+private:
+   // Quarter octaves of microseconds, the last one holds everything from
+   // 2^23 us (8s) up.
+   static const int LATENCY_BUCKETS = 96;
+
+   void Reset();
+   float Percentile(float fraction) const;
+
+   FFBRateGovernorConfig m_config;
+   bool m_bEnabled;
+
+   // The current window. Starts with the first tick after Enable.
+   int64_t m_windowStartUs;
+   int64_t m_windowBusyUs;
+   DWORD m_windowTicks;
+   // Ticks whose driver calls took more than busyPercent of the period.
+   DWORD m_windowSlowTicks;
+   DWORD m_windowOverruns;
+   DWORD m_windowUpdates;
+   DWORD m_windowErrors;
+   int64_t m_tickBusyUs;
+   // Share of the last window spent in driver calls.
+   float m_busyPercent;
+
+   DWORD m_histogram[LATENCY_BUCKETS];
+   int64_t m_maxUs;
+   uint64_t m_nUpdates;
+   DWORD m_nErrors;
+   DWORD m_nIncreases;
+   DWORD m_nDecreases;
+   FFBRateEvents::Type m_lastEvent;
+   int m_lastEventFromHz;
+   int m_lastEventToHz;
+   int64_t m_lastEventUs;
+};
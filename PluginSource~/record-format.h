@@ -0,0 +1,139 @@
+#pragma once
+#include "pch.h"
+#include "unity-ffb.h"
+
+/**
+ * The file StartFFBRecording writes and ffb-replay reads: an
+ * FFBRecordFileHeader followed by records back to back, each an
+ * FFBRecordHeader and payloadBytes of payload. Records are not padded,
+ * copy a header out before reading it. Little endian.
+ */
+#define FFB_RECORD_MAGIC      0x52424646   // "FFBR"
+#define FFB_RECORD_VERSION    1
+// The largest payload: a condition for every axis behind a command or an
+// FFBRecordEffectUpdate.
+#define FFB_RECORD_MAX_PAYLOAD   (2 * sizeof(DWORD) + sizeof(DICONDITION) * MAX_FFB_AXES)
+
+/**
+ * The call a record is for. Calls through the single device exports are
+ * recorded as the Device* call they make on the default device.
+ */
+struct FFBRecordCalls {
+   typedef enum {
+      // payload: the device's instance GUID, device: the handle it got.
+      OpenDevice = 0,
+      CloseDevice = 1,
+      // arg: the effect type.
+      AddEffect = 2,
+      RemoveEffect = 3,
+      // arg: the effect type, payload: the FFBEffectHandle created.
+      CreateEffect = 4,
+      // arg: the effect handle.
+      DestroyEffect = 5,
+      // arg: the effect type or handle, payload: the magnitude and a
+      // direction per axis.
+      UpdateConstantForce = 6,
+      UpdateEffectConstantForce = 7,
+      // arg: the effect type or handle, payload: a DICONDITION per axis.
+      UpdateCondition = 8,
+      UpdateEffectCondition = 9,
+      // arg: the effect type or handle, payload: the gain as a float.
+      UpdateGain = 10,
+      SetEffectGain = 11,
+      // arg: the effect handle.
+      StartEffect = 12,
+      StopEffect = 13,
+      StartAllEffects = 14,
+      StopAllEffects = 15,
+      // arg: 1 to enable, 0 to disable.
+      SetAutoCenter = 16,
+      // One command of a batch. arg: the commands following it in the
+      // batch, payload: the start of the FFBCommand, up to the end of the
+      // parameters of its command for the device's axes.
+      SubmitCommand = 17,
+      // arg: the rate in Hz.
+      StartOutputThread = 18,
+      StopOutputThread = 19,
+      SetOutputRate = 20,
+      // payload: the ForceSynthConfig, empty for the defaults.
+      EnableSynthesis = 21,
+      DisableSynthesis = 22,
+      // arg: the capacity.
+      SetEffectCapacity = 23,
+      // arg: the axis, 0xFFFFFFFF for all, payload: the ForceDspConfig,
+      // empty to bypass.
+      ConfigureForceDsp = 24,
+      DisableForceDsp = 25,
+      // payload: the FFBKeyframeConfig, empty for the defaults.
+      EnableForceKeyframes = 26,
+      DisableForceKeyframes = 27,
+      // One keyframe of a SubmitForceKeyframes call. payload: the
+      // FFBForceKeyframe, its timeUs relative to the call (0 stays 0).
+      SubmitForceKeyframe = 28,
+      // payload: the FFBForceMixerConfig, empty for the defaults.
+      ConfigureForceMixer = 29,
+      // arg: the layer handle created, payload: FFBRecordForceLayer.
+      CreateForceLayer = 30,
+      // arg: the layer handle, payload: the FFBForceLayerConfig.
+      ConfigureForceLayer = 31,
+      // arg: the layer handle, payload: a float per axis.
+      UpdateForceLayer = 32,
+      // arg: the layer handle.
+      DestroyForceLayer = 33,
+      // arg: the effect type or handle, payload: the FFBPeriodicEffect and
+      // a direction per axis.
+      UpdatePeriodic = 34,
+      UpdateEffectPeriodic = 35,
+      // arg: CustomForce or the effect handle, payload: FFBRecordCustomForce
+      // and a direction per axis. The samples are not recorded.
+      UpdateCustomForce = 36,
+      UpdateEffectCustomForce = 37,
+      // arg: the effect type or handle, payload: FFBRecordEffectUpdate and
+      // the parameters of the effect's kind, whole. A CustomForce has
+      // FFBRecordCustomForce and a direction for every axis instead.
+      UpdateEffect = 38,
+      UpdateFFBEffect = 39
+   } Type;
+};
+
+#define FFB_RECORD_CALL_COUNT 40
+
+struct FFBRecordEffectUpdate {
+   uint32_t effectType;
+   uint32_t flags;
+};
+
+/**
+ * An FFBCustomForce without its samples, replay plays silence of the same
+ * shape so the uploads cost what they did.
+ */
+struct FFBRecordCustomForce {
+   DWORD channels;
+   DWORD sampleCount;
+   DWORD samplePeriod;
+   DWORD duration;
+};
+
+struct FFBRecordForceLayer {
+   FFBForceLayerConfig config;
+   char name[FFB_FORCE_LAYER_NAME];
+};
+
+struct FFBRecordFileHeader {
+   uint32_t magic;
+   uint32_t version;
+   uint32_t headerSize;
+   uint32_t recordHeaderSize;
+   // When recording started, in nanoseconds since 1970 UTC.
+   int64_t startTime;
+};
+
+struct FFBRecordHeader {
+   // When the call returned, in nanoseconds since recording started.
+   uint64_t timestamp;
+   uint16_t call;
+   uint16_t payloadBytes;
+   FFBDeviceHandle device;
+   HRESULT result;
+   uint32_t arg;
+};
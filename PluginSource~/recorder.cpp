@@ -0,0 +1,186 @@
+#include "pch.h"
+#include "recorder.h"
+#include <string.h>
+
+static_assert(sizeof(FFBRecordHeader) == 24, "FFBRecordHeader is part of the file format");
+
+Recorder::Recorder() :
+   m_pFile(NULL),
+   m_bRecording(false),
+   m_bStop(false),
+   m_nRecordsWritten(0),
+   m_nRecordsDropped(0),
+   m_nBytesWritten(0),
+   m_hrWrite(S_OK)
+{
+}
+
+Recorder::~Recorder()
+{
+   Stop();
+}
+
+/**
+ * Create the file at path, replacing it, and start recording into it.
+ * Fails with E_ABORT if already recording.
+ */
+HRESULT Recorder::Start(LPCSTR path)
+{
+   if (path == NULL)
+   {
+      return E_POINTER;
+   }
+   if (m_bRecording)
+   {
+      return E_ABORT;
+   }
+#ifdef _MSC_VER
+   if (fopen_s(&m_pFile, path, "wb") != 0)
+   {
+      m_pFile = NULL;
+   }
+#else
+   m_pFile = fopen(path, "wb");
+#endif
+   if (m_pFile == NULL)
+   {
+      return E_FAIL;
+   }
+   // Flushed every interval anyway, no need for small writes in between.
+   setvbuf(m_pFile, NULL, _IOFBF, 64 * 1024);
+
+   m_nRecordsWritten = 0;
+   m_nRecordsDropped = 0;
+   m_nBytesWritten = 0;
+   m_hrWrite = S_OK;
+
+   FFBRecordFileHeader header;
+   header.magic = FFB_RECORD_MAGIC;
+   header.version = FFB_RECORD_VERSION;
+   header.headerSize = sizeof(FFBRecordFileHeader);
+   header.recordHeaderSize = sizeof(FFBRecordHeader);
+   header.startTime = (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+   m_tStart = Clock::now();
+   Write(&header, sizeof(header));
+
+   m_bStop = false;
+   m_bRecording = true;
+   m_thread = std::thread(&Recorder::Run, this);
+   return S_OK;
+}
+
+/**
+ * Stop recording, everything queued so far is written before the file is
+ * closed.
+ */
+void Recorder::Stop()
+{
+   if (!m_bRecording)
+   {
+      return;
+   }
+   {
+      std::lock_guard<std::mutex> lock(m_wakeLock);
+      m_bStop = true;
+   }
+   m_wake.notify_one();
+   m_thread.join();
+   fclose(m_pFile);
+   m_pFile = NULL;
+   m_bRecording = false;
+}
+
+void Recorder::Record(FFBRecordCalls::Type call, FFBDeviceHandle device, HRESULT result, uint32_t arg, const void* payload, size_t payloadBytes)
+{
+   RecordEntry* pEntry = m_entries.Reserve();
+   if (pEntry == NULL)
+   {
+      m_nRecordsDropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+   }
+   if (payload == NULL)
+   {
+      payloadBytes = 0;
+   }
+   else if (payloadBytes > FFB_RECORD_MAX_PAYLOAD)
+   {
+      payloadBytes = FFB_RECORD_MAX_PAYLOAD;
+   }
+   pEntry->header.timestamp = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - m_tStart).count();
+   pEntry->header.call = (uint16_t)call;
+   pEntry->header.payloadBytes = (uint16_t)payloadBytes;
+   pEntry->header.device = device;
+   pEntry->header.result = result;
+   pEntry->header.arg = arg;
+   if (payloadBytes > 0)
+   {
+      memcpy(pEntry->payload, payload, payloadBytes);
+   }
+   m_entries.Commit();
+}
+
+void Recorder::GetStats(FFBRecorderStats& stats) const
+{
+   stats.recording = m_bRecording ? TRUE : FALSE;
+   stats.recordsWritten = m_nRecordsWritten.load(std::memory_order_relaxed);
+   stats.recordsDropped = m_nRecordsDropped.load(std::memory_order_relaxed);
+   stats.writeResult = m_hrWrite.load(std::memory_order_relaxed);
+   stats.bytesWritten = m_nBytesWritten.load(std::memory_order_relaxed);
+}
+
+void Recorder::Run()
+{
+   std::unique_lock<std::mutex> lock(m_wakeLock);
+   while (!m_bStop)
+   {
+      lock.unlock();
+      Drain();
+      lock.lock();
+      m_wake.wait_for(lock, std::chrono::milliseconds(FLUSH_INTERVAL_MS), [this]() { return m_bStop; });
+   }
+   lock.unlock();
+   Drain();
+}
+
+/**
+ * Append everything queued and flush it, so a crash loses at most the
+ * last interval.
+ */
+void Recorder::Drain()
+{
+   RecordEntry entry;
+   bool wrote = false;
+   while (m_entries.Pop(entry))
+   {
+      Write(&entry.header, sizeof(entry.header));
+      Write(entry.payload, entry.header.payloadBytes);
+      if (SUCCEEDED(m_hrWrite.load(std::memory_order_relaxed)))
+      {
+         m_nRecordsWritten.fetch_add(1, std::memory_order_relaxed);
+      }
+      wrote = true;
+   }
+   if (wrote && fflush(m_pFile) != 0)
+   {
+      m_hrWrite = E_FAIL;
+   }
+}
+
+/**
+ * Stops writing at the first error, a record cut in half would make the
+ * rest of the file unreadable.
+ */
+void Recorder::Write(const void* data, size_t bytes)
+{
+   if (bytes == 0 || FAILED(m_hrWrite.load(std::memory_order_relaxed)))
+   {
+      return;
+   }
+   if (fwrite(data, 1, bytes, m_pFile) != bytes)
+   {
+      m_hrWrite = E_FAIL;
+      return;
+   }
+   m_nBytesWritten.fetch_add(bytes, std::memory_order_relaxed);
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "pch.h"
+#include "unity-ffb.h"
+#include "record-format.h"
+#include "spsc-queue.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+struct RecordEntry {
+   FFBRecordHeader header;
+   BYTE payload[FFB_RECORD_MAX_PAYLOAD];
+};
+
+/**
+ * Captures the calls made to the exported API into a file ffb-replay can
+ * play back (see record-format.h). The game thread only copies each
+ * record into a preallocated ring, a writer thread appends them to the
+ * file every FLUSH_INTERVAL_MS. Records are dropped, never waited for,
+ * when the writer falls behind by more than CAPACITY records.
+ */
+class Recorder
+{
+public:
+   static const uint32_t CAPACITY = 4096;
+   static constexpr DWORD FLUSH_INTERVAL_MS = 10;
+
+   Recorder();
+   ~Recorder();
+
+   HRESULT Start(LPCSTR path);
+   void Stop();
+   bool IsRecording() const { return m_bRecording; }
+
+   /**
+    * Queue a record, payloadBytes are cut to FFB_RECORD_MAX_PAYLOAD. Game
+    * thread only.
+    */
+   void Record(FFBRecordCalls::Type call, FFBDeviceHandle device, HRESULT result, uint32_t arg, const void* payload, size_t payloadBytes);
+
+   void GetStats(FFBRecorderStats& stats) const;
+
+private:
+   typedef std::chrono::steady_clock Clock;
+
+   void Run();
+   void Drain();
+   void Write(const void* data, size_t bytes);
+
+   FILE* m_pFile;
+   bool m_bRecording;
+   Clock::time_point m_tStart;
+   std::thread m_thread;
+
+   std::mutex m_wakeLock;
+   std::condition_variable m_wake;
+   bool m_bStop;
+
+   std::atomic<uint32_t> m_nRecordsWritten;
+   std::atomic<uint32_t> m_nRecordsDropped;
+   std::atomic<uint64_t> m_nBytesWritten;
+   std::atomic<HRESULT> m_hrWrite;
+
+   SpscQueue<RecordEntry, CAPACITY> m_entries;
+};
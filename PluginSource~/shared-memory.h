@@ -0,0 +1,160 @@
+#pragma once
+#include "pch.h"
+#include <string>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * A named region of memory shared with other processes on the machine.
+ * One side creates it and writes, the others open it read only. On POSIX
+ * the name gets a leading '/' if it has none, and the creator removes the
+ * name when it closes the region, processes that have it open keep their
+ * view.
+ */
+class SharedMemory
+{
+public:
+   SharedMemory() : m_pData(NULL), m_size(0), m_bOwner(false)
+   {
+#ifdef _WIN32
+      m_hMapping = NULL;
+#endif
+   }
+
+   ~SharedMemory()
+   {
+      Close();
+   }
+
+   /**
+    * Create the region, or open it for writing if it exists, of at least
+    * size bytes. A new region is zeroed.
+    */
+   bool Create(const char* name, size_t size)
+   {
+      Close();
+#ifdef _WIN32
+      m_hMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, (DWORD)size, name);
+      if (m_hMapping == NULL)
+      {
+         return false;
+      }
+      m_pData = (BYTE*)MapViewOfFile(m_hMapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+#else
+      m_name = PosixName(name);
+      int fd = shm_open(m_name.c_str(), O_RDWR | O_CREAT, 0600);
+      struct stat st;
+      if (fd < 0 || fstat(fd, &st) != 0 || ((size_t)st.st_size < size && ftruncate(fd, (off_t)size) != 0))
+      {
+         if (fd >= 0)
+         {
+            close(fd);
+         }
+         return false;
+      }
+      void* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      close(fd);
+      m_pData = data != MAP_FAILED ? (BYTE*)data : NULL;
+#endif
+      m_size = size;
+      m_bOwner = true;
+      if (m_pData == NULL)
+      {
+         Close();
+         return false;
+      }
+      return true;
+   }
+
+   /**
+    * Open an existing region read only, false if there is none or it is
+    * smaller than size.
+    */
+   bool Open(const char* name, size_t size)
+   {
+      Close();
+#ifdef _WIN32
+      m_hMapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+      if (m_hMapping == NULL)
+      {
+         return false;
+      }
+      // Fails for a region smaller than size.
+      m_pData = (BYTE*)MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, size);
+#else
+      int fd = shm_open(PosixName(name).c_str(), O_RDONLY, 0);
+      struct stat st;
+      if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < size)
+      {
+         if (fd >= 0)
+         {
+            close(fd);
+         }
+         return false;
+      }
+      void* data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+      close(fd);
+      m_pData = data != MAP_FAILED ? (BYTE*)data : NULL;
+#endif
+      m_size = size;
+      if (m_pData == NULL)
+      {
+         Close();
+         return false;
+      }
+      return true;
+   }
+
+   void Close()
+   {
+#ifdef _WIN32
+      if (m_pData != NULL)
+      {
+         UnmapViewOfFile(m_pData);
+      }
+      if (m_hMapping != NULL)
+      {
+         CloseHandle(m_hMapping);
+         m_hMapping = NULL;
+      }
+#else
+      if (m_pData != NULL)
+      {
+         munmap(m_pData, m_size);
+      }
+      if (m_bOwner && !m_name.empty())
+      {
+         shm_unlink(m_name.c_str());
+      }
+      m_name.clear();
+#endif
+      m_pData = NULL;
+      m_size = 0;
+      m_bOwner = false;
+   }
+
+   BYTE* Data() const { return m_pData; }
+   size_t Size() const { return m_size; }
+
+private:
+   SharedMemory(const SharedMemory&);
+   SharedMemory& operator=(const SharedMemory&);
+
+#ifndef _WIN32
+   static std::string PosixName(const char* name)
+   {
+      return name[0] == '/' ? std::string(name) : "/" + std::string(name);
+   }
+
+   std::string m_name;
+#else
+   HANDLE m_hMapping;
+#endif
+   BYTE* m_pData;
+   size_t m_size;
+   bool m_bOwner;
+};
@@ -0,0 +1,155 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Fixed capacity slot map: values are stored densely (so iterating them
+ * touches only live entries) and addressed through handles that carry a
+ * generation, so a handle to a removed value never resolves to whatever
+ * reused its slot. Insert, Remove and Get are O(1).
+ *
+ * Handles are never 0. The low 16 bits hold the slot index + 1, the high
+ * 16 bits the slot's generation.
+ */
+template <typename T>
+class SlotMap
+{
+public:
+   typedef uint32_t Handle;
+
+   static const uint32_t MAX_CAPACITY = 0xFFFF;
+
+   explicit SlotMap(uint32_t capacity) : m_capacity(0)
+   {
+      SetCapacity(capacity);
+   }
+
+   /**
+    * Change how many values can be stored. Fails if more values than that
+    * are already stored.
+    */
+   bool SetCapacity(uint32_t capacity)
+   {
+      if (capacity > MAX_CAPACITY || capacity < Size())
+      {
+         return false;
+      }
+      m_capacity = capacity;
+      m_slots.reserve(capacity);
+      m_values.reserve(capacity);
+      m_valueSlots.reserve(capacity);
+      m_freeSlots.reserve(capacity);
+      return true;
+   }
+
+   uint32_t Capacity() const { return m_capacity; }
+   uint32_t Size() const { return (uint32_t)m_values.size(); }
+
+   /**
+    * Store a value, returns its handle or 0 when the map is full.
+    */
+   Handle Insert(const T& value)
+   {
+      if (Size() >= m_capacity)
+      {
+         return 0;
+      }
+      uint32_t index;
+      if (!m_freeSlots.empty())
+      {
+         index = m_freeSlots.back();
+         m_freeSlots.pop_back();
+      }
+      else
+      {
+         index = (uint32_t)m_slots.size();
+         Slot slot = { 1, 0 };
+         m_slots.push_back(slot);
+      }
+      m_slots[index].value = Size();
+      m_values.push_back(value);
+      m_valueSlots.push_back(index);
+      return MakeHandle(index, m_slots[index].generation);
+   }
+
+   /**
+    * Remove the value, the last value moves into its place.
+    */
+   bool Remove(Handle handle)
+   {
+      if (Get(handle) == NULL)
+      {
+         return false;
+      }
+      uint32_t index = (handle & 0xFFFF) - 1;
+      Slot& slot = m_slots[index];
+      uint32_t last = Size() - 1;
+      if (slot.value != last)
+      {
+         m_values[slot.value] = m_values[last];
+         m_valueSlots[slot.value] = m_valueSlots[last];
+         m_slots[m_valueSlots[last]].value = slot.value;
+      }
+      m_values.pop_back();
+      m_valueSlots.pop_back();
+
+      // Generation 0 would allow a 0 handle.
+      slot.generation = slot.generation == 0xFFFF ? 1 : slot.generation + 1;
+      slot.value = FREE;
+      m_freeSlots.push_back(index);
+      return true;
+   }
+
+   /**
+    * The value for handle, NULL if it was removed or never existed. A free
+    * slot already carries the generation its next value gets, so only an
+    * occupied slot can match.
+    */
+   T* Get(Handle handle)
+   {
+      uint32_t index = (handle & 0xFFFF) - 1;
+      if (index >= m_slots.size() || m_slots[index].value == FREE || m_slots[index].generation != (handle >> 16))
+      {
+         return NULL;
+      }
+      return &m_values[m_slots[index].value];
+   }
+
+   const T* Get(Handle handle) const
+   {
+      return const_cast<SlotMap*>(this)->Get(handle);
+   }
+
+   /**
+    * Dense access to the stored values, in no particular order.
+    */
+   T& At(uint32_t position) { return m_values[position]; }
+   const T& At(uint32_t position) const { return m_values[position]; }
+   Handle HandleAt(uint32_t position) const
+   {
+      uint32_t index = m_valueSlots[position];
+      return MakeHandle(index, m_slots[index].generation);
+   }
+
+private:
+   // Slot value of a free slot.
+   static const uint32_t FREE = 0xFFFFFFFF;
+
+   struct Slot {
+      uint32_t generation;
+      // Position of the slot's value in m_values, FREE if it holds none.
+      uint32_t value;
+   };
+
+   static Handle MakeHandle(uint32_t index, uint32_t generation)
+   {
+      return (generation << 16) | (index + 1);
+   }
+
+   uint32_t m_capacity;
+   std::vector<Slot> m_slots;
+   std::vector<T> m_values;
+   std::vector<uint32_t> m_valueSlots;
+   std::vector<uint32_t> m_freeSlots;
+};
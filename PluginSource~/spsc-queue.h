@@ -0,0 +1,87 @@
+#pragma once
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * Lock-free bounded single producer / single consumer queue. Capacity must
+ * be a power of two. Push fails rather than blocks when the queue is full,
+ * Pop fails when it is empty; neither side ever waits on the other.
+ */
+template <typename T, uint32_t Capacity>
+class SpscQueue
+{
+   static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+   static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "Indices are shared as plain 32 bit integers");
+
+public:
+   // The items are zeroed so pushing never faults their pages in.
+   SpscQueue() : m_head(0), m_tail(0), m_items()
+   {
+   }
+
+   /**
+    * Only one thread may push.
+    */
+   bool Push(const T& value)
+   {
+      T* pItem = Reserve();
+      if (pItem == NULL)
+      {
+         return false;
+      }
+      *pItem = value;
+      Commit();
+      return true;
+   }
+
+   /**
+    * Push in place, for items too large to copy twice: the slot to fill,
+    * NULL when the queue is full. The consumer sees it once Commit is
+    * called. Only the pushing thread.
+    */
+   T* Reserve()
+   {
+      uint32_t tail = m_tail.load(std::memory_order_relaxed);
+      if (tail - m_head.load(std::memory_order_acquire) == Capacity)
+      {
+         return NULL;
+      }
+      return &m_items[tail & (Capacity - 1)];
+   }
+
+   void Commit()
+   {
+      m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+   }
+
+   /**
+    * Only one thread may pop.
+    */
+   bool Pop(T& value)
+   {
+      uint32_t head = m_head.load(std::memory_order_relaxed);
+      if (head == m_tail.load(std::memory_order_acquire))
+      {
+         return false;
+      }
+      value = m_items[head & (Capacity - 1)];
+      m_head.store(head + 1, std::memory_order_release);
+      return true;
+   }
+
+   /**
+    * The queue's memory, for a consumer that reads the items in place
+    * instead of calling Pop, e.g. from managed code: items from Head up to
+    * Tail are ready, the consumer advances Head once it is done with them.
+    * The indices only ever grow and wrap at 2^32.
+    */
+   const T* Items() const { return m_items; }
+   std::atomic<uint32_t>& Head() { return m_head; }
+   const std::atomic<uint32_t>& Tail() const { return m_tail; }
+
+private:
+   // Kept on separate cache lines so the two sides do not contend.
+   alignas(64) std::atomic<uint32_t> m_head;
+   alignas(64) std::atomic<uint32_t> m_tail;
+   alignas(64) T m_items[Capacity];
+};
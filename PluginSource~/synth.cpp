@@ -0,0 +1,237 @@
+#include "pch.h"
+#include "synth.h"
+#include <algorithm>
+
+// c_dfDIJoystick axis range, mapped to -10000 .. 10000 around its center.
+static const float SYNTH_AXIS_CENTER = 32767.5f;
+static const float SYNTH_AXIS_TO_NOMINAL = DI_FFNOMINALMAX / 32767.5f;
+static const float SYNTH_PI = 3.14159265f;
+
+static int ConditionIndex(Effects::Type effectType)
+{
+   switch (effectType)
+   {
+   case Effects::Type::Spring:
+      return 0;
+   case Effects::Type::Damper:
+      return 1;
+   case Effects::Type::Inertia:
+      return 2;
+   case Effects::Type::Friction:
+      return 3;
+   default:
+      return -1;
+   }
+}
+
+/**
+ * DirectInput condition model evaluated on all lanes at once: no force
+ * inside offset +- deadband, outside it the distance times the coefficient
+ * for that side, limited by the saturation for that side. Branch free so
+ * the compiler can keep it in vector registers.
+ */
+template <typename Condition>
+static inline void EvaluateCondition(const Condition& c, const float* metric, float* force)
+{
+   for (int i = 0; i < SYNTH_LANES; i++)
+   {
+      float above = std::max(metric[i] - (c.offset[i] + c.deadband[i]), 0.0f);
+      float below = std::min(metric[i] - (c.offset[i] - c.deadband[i]), 0.0f);
+      float positive = c.positiveCoefficient[i] * above * (1.0f / DI_FFNOMINALMAX);
+      float negative = c.negativeCoefficient[i] * below * (1.0f / DI_FFNOMINALMAX);
+      positive = std::min(std::max(positive, -c.positiveSaturation[i]), c.positiveSaturation[i]);
+      negative = std::min(std::max(negative, -c.negativeSaturation[i]), c.negativeSaturation[i]);
+      // The condition resists the metric, so the force opposes it.
+      force[i] -= positive + negative;
+   }
+}
+
+ForceSynth::ForceSynth()
+{
+   ForceSynthConfig config;
+   config.velocityCutoffHz = 30.0f;
+   config.accelerationCutoffHz = 15.0f;
+   config.velocityFullScale = 40000.0f;
+   config.accelerationFullScale = 800000.0f;
+   config.frictionVelocityThreshold = 200.0f;
+   m_config = config;
+   ZeroMemory(m_bEnabled, sizeof(m_bEnabled));
+   ZeroMemory(m_condition, sizeof(m_condition));
+   ClearConditions();
+   Reset();
+}
+
+/**
+ * Disable all conditions, the output thread sees it on its next step.
+ */
+void ForceSynth::ClearConditions()
+{
+   ZeroMemory(&m_conditions, sizeof(m_conditions));
+   for (int c = 0; c < SYNTH_CONDITION_COUNT; c++)
+   {
+      m_conditions.gain[c] = DI_FFNOMINALMAX;
+   }
+   m_tbConditions.Write(m_conditions);
+}
+
+void ForceSynth::Configure(const ForceSynthConfig& config)
+{
+   m_config = config;
+}
+
+/**
+ * Forget the motion history, the next Step starts estimating from scratch.
+ */
+void ForceSynth::Reset()
+{
+   ZeroMemory(&m_axes, sizeof(m_axes));
+   ZeroMemory(&m_state, sizeof(m_state));
+   ZeroMemory(&m_published, sizeof(m_published));
+   m_bPrimed = false;
+   m_dwSteps = 0;
+}
+
+bool ForceSynth::IsSynthesized(Effects::Type effectType) const
+{
+   int index = ConditionIndex(effectType);
+   return index >= 0 && m_conditions.enabled[index];
+}
+
+void ForceSynth::SetEnabled(Effects::Type effectType, bool enabled)
+{
+   int index = ConditionIndex(effectType);
+   if (index < 0)
+   {
+      return;
+   }
+   m_conditions.enabled[index] = enabled;
+   m_tbConditions.Write(m_conditions);
+}
+
+bool ForceSynth::IsEnabled(Effects::Type effectType) const
+{
+   int index = ConditionIndex(effectType);
+   return index >= 0 && m_conditions.enabled[index];
+}
+
+void ForceSynth::SetGain(Effects::Type effectType, DWORD gain)
+{
+   int index = ConditionIndex(effectType);
+   if (index < 0)
+   {
+      return;
+   }
+   m_conditions.gain[index] = gain;
+   m_tbConditions.Write(m_conditions);
+}
+
+void ForceSynth::SetConditions(Effects::Type effectType, const DICONDITION* conditions, int axisCount)
+{
+   int index = ConditionIndex(effectType);
+   if (index < 0)
+   {
+      return;
+   }
+   for (int i = 0; i < axisCount && i < MAX_FFB_AXES; i++)
+   {
+      m_conditions.conditions[index][i] = conditions[i];
+   }
+   m_tbConditions.Write(m_conditions);
+}
+
+void ForceSynth::Step(const LONG* positions, int axisCount, float dt, float* force)
+{
+   SynthConditionSet set;
+   if (m_tbConditions.Read(set))
+   {
+      // Unpack to lanes once per change rather than every step.
+      for (int c = 0; c < SYNTH_CONDITION_COUNT; c++)
+      {
+         m_bEnabled[c] = set.enabled[c];
+         Condition& condition = m_condition[c];
+         ZeroMemory(&condition, sizeof(condition));
+         // Effect gain scales the coefficients, like it does on the device.
+         float gain = (float)set.gain[c] / DI_FFNOMINALMAX;
+         for (int i = 0; i < axisCount && i < MAX_FFB_AXES; i++)
+         {
+            const DICONDITION& di = set.conditions[c][i];
+            condition.offset[i] = (float)di.lOffset;
+            condition.deadband[i] = (float)di.lDeadBand;
+            condition.positiveCoefficient[i] = gain * di.lPositiveCoefficient;
+            // Devices without separate coefficients/saturations use the positive ones.
+            condition.negativeCoefficient[i] = gain * (di.lNegativeCoefficient != 0 ? di.lNegativeCoefficient : di.lPositiveCoefficient);
+            condition.positiveSaturation[i] = (float)(di.dwPositiveSaturation != 0 ? di.dwPositiveSaturation : DI_FFNOMINALMAX);
+            condition.negativeSaturation[i] = (float)(di.dwNegativeSaturation != 0 ? di.dwNegativeSaturation : condition.positiveSaturation[i]);
+         }
+      }
+   }
+
+   Axes& axes = m_axes;
+   for (int i = 0; i < SYNTH_LANES; i++)
+   {
+      axes.position[i] = i < axisCount ? (positions[i] - SYNTH_AXIS_CENTER) * SYNTH_AXIS_TO_NOMINAL : 0.0f;
+   }
+   if (!m_bPrimed)
+   {
+      memcpy(axes.previousPosition, axes.position, sizeof(axes.position));
+      m_bPrimed = true;
+   }
+
+   // Differentiate and low pass (one pole) position into velocity and
+   // velocity into acceleration.
+   float invDt = 1.0f / dt;
+   float velocityAlpha = 1.0f - expf(-2.0f * SYNTH_PI * m_config.velocityCutoffHz * dt);
+   float accelerationAlpha = 1.0f - expf(-2.0f * SYNTH_PI * m_config.accelerationCutoffHz * dt);
+   for (int i = 0; i < SYNTH_LANES; i++)
+   {
+      float velocity = (axes.position[i] - axes.previousPosition[i]) * invDt;
+      axes.velocity[i] += velocityAlpha * (velocity - axes.velocity[i]);
+      float acceleration = (axes.velocity[i] - axes.previousVelocity[i]) * invDt;
+      axes.acceleration[i] += accelerationAlpha * (acceleration - axes.acceleration[i]);
+      axes.previousPosition[i] = axes.position[i];
+      axes.previousVelocity[i] = axes.velocity[i];
+   }
+
+   // Each condition sees its own metric scaled to -10000 .. 10000.
+   alignas(32) float metric[SYNTH_CONDITION_COUNT][SYNTH_LANES];
+   float velocityScale = DI_FFNOMINALMAX / m_config.velocityFullScale;
+   float accelerationScale = DI_FFNOMINALMAX / m_config.accelerationFullScale;
+   float frictionScale = DI_FFNOMINALMAX / m_config.frictionVelocityThreshold;
+   for (int i = 0; i < SYNTH_LANES; i++)
+   {
+      metric[0][i] = axes.position[i];
+      metric[1][i] = axes.velocity[i] * velocityScale;
+      metric[2][i] = axes.acceleration[i] * accelerationScale;
+      metric[3][i] = std::min(std::max(axes.velocity[i] * frictionScale, -(float)DI_FFNOMINALMAX), (float)DI_FFNOMINALMAX);
+   }
+
+   alignas(32) float total[SYNTH_LANES] = { 0 };
+   for (int c = 0; c < SYNTH_CONDITION_COUNT; c++)
+   {
+      if (m_bEnabled[c])
+      {
+         EvaluateCondition(m_condition[c], metric[c], total);
+      }
+   }
+
+   for (int i = 0; i < axisCount && i < MAX_FFB_AXES; i++)
+   {
+      force[i] = total[i];
+      m_state.position[i] = axes.position[i];
+      m_state.velocity[i] = axes.velocity[i];
+      m_state.acceleration[i] = axes.acceleration[i];
+      m_state.force[i] = total[i];
+   }
+   m_state.axisCount = axisCount;
+   m_state.steps = ++m_dwSteps;
+   m_tbState.Write(m_state);
+}
+
+/**
+ * Latest estimator and output values, readable from the game thread.
+ */
+void ForceSynth::GetState(ForceSynthState& state)
+{
+   m_tbState.Read(m_published);
+   state = m_published;
+}
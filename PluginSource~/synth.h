@@ -0,0 +1,87 @@
+#pragma once
+#include "pch.h"
+#include "unity-ffb.h"
+#include "triple-buffer.h"
+
+// Axes are processed in fixed width lanes so the kernel vectorises.
+#define SYNTH_LANES     8
+
+/**
+ * The four condition effects the synthesizer can model, in Effects::Type
+ * order starting at Spring.
+ */
+static const int SYNTH_CONDITION_COUNT = 4;
+
+struct SynthConditionSet {
+   bool enabled[SYNTH_CONDITION_COUNT];
+   DWORD gain[SYNTH_CONDITION_COUNT];
+   DICONDITION conditions[SYNTH_CONDITION_COUNT][MAX_FFB_AXES];
+};
+
+/**
+ * Evaluates spring, damper, friction and inertia in software from the
+ * polled wheel position, for devices that implement condition effects
+ * poorly or with too much latency. The result is a force per axis that is
+ * sent through the constant force effect.
+ *
+ * Conditions are set from the game thread and picked up by the output
+ * thread through a triple buffer, Step is only called by the output thread.
+ */
+class ForceSynth
+{
+public:
+   ForceSynth();
+
+   void Configure(const ForceSynthConfig& config);
+   void Reset();
+   void ClearConditions();
+
+   bool IsSynthesized(Effects::Type effectType) const;
+   void SetEnabled(Effects::Type effectType, bool enabled);
+   bool IsEnabled(Effects::Type effectType) const;
+   void SetGain(Effects::Type effectType, DWORD gain);
+   void SetConditions(Effects::Type effectType, const DICONDITION* conditions, int axisCount);
+
+   /**
+    * Feed the latest axis positions (0 - 65535) and produce the synthesized
+    * force per axis in DirectInput units.
+    */
+   void Step(const LONG* positions, int axisCount, float dt, float* force);
+
+   void GetState(ForceSynthState& state);
+
+private:
+   ForceSynthConfig m_config;
+
+   // Owned by the game thread.
+   SynthConditionSet m_conditions;
+   TripleBuffer<SynthConditionSet> m_tbConditions;
+
+   // Owned by the output thread.
+   struct alignas(32) Condition {
+      float offset[SYNTH_LANES];
+      float deadband[SYNTH_LANES];
+      float positiveCoefficient[SYNTH_LANES];
+      float negativeCoefficient[SYNTH_LANES];
+      float positiveSaturation[SYNTH_LANES];
+      float negativeSaturation[SYNTH_LANES];
+   };
+   struct alignas(32) Axes {
+      float position[SYNTH_LANES];
+      float velocity[SYNTH_LANES];
+      float acceleration[SYNTH_LANES];
+      float previousPosition[SYNTH_LANES];
+      float previousVelocity[SYNTH_LANES];
+   };
+   bool m_bEnabled[SYNTH_CONDITION_COUNT];
+   Condition m_condition[SYNTH_CONDITION_COUNT];
+   Axes m_axes;
+   bool m_bPrimed;
+   DWORD m_dwSteps;
+
+   TripleBuffer<ForceSynthState> m_tbState;
+   ForceSynthState m_state;
+
+   // Last state seen by the game thread.
+   ForceSynthState m_published;
+};
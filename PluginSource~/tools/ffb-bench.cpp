@@ -0,0 +1,3389 @@
+// ffb-bench.cpp : Drives the exported plugin API headless and times it.
+//
+// Runs against the simulated backend, so it works on any platform and in CI.
+//
+//    ffb-bench [benchmark...] [--iterations N] [--latency US] [--axes N]
+//              [--rate HZ] [--seconds S] [--load THREADS] [--record-file PATH]
+//              [--producers THREADS] [--enum-delay US] [--cache-file PATH]
+//              [--download-delay US] [--sample-rate BYTES_PER_MS]
+//              [--firmware-rate HZ]
+//
+
+#include "pch.h"
+#include "unity-ffb.h"
+#include "../slot-map.h"
+#include "../force-dsp.h"
+#include "../keyframes.h"
+#include "../force-mixer.h"
+#include "../mpsc-queue.h"
+#include "../bridge-format.h"
+#include "../shared-memory.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <math.h>
+#include <new>
+#include <thread>
+
+struct BenchOptions
+{
+   int iterations;
+   int rateHz;
+   double seconds;
+   int loadThreads;
+   int producerThreads;
+   std::string recordPath;
+   std::string cachePath;
+   // Enumeration delay of the wheel in the startup-cache benchmark, the
+   // other benchmarks enumerate instantly.
+   DWORD enumDelayMicroseconds;
+   // Time the wheel takes to write a new effect into its memory in the
+   // effect-pool benchmark, the other benchmarks download instantly.
+   DWORD downloadDelayMicroseconds;
+   // Rate custom force samples reach the wheel at in the custom-force
+   // benchmark, the other benchmarks send them for free.
+   DWORD sampleBytesPerMillisecond;
+   // Updates per second the slow wheel's firmware takes in the governor
+   // benchmark, the other benchmarks' wheels take any rate.
+   DWORD firmwareUpdateHz;
+   SimulatedDeviceConfig device;
+};
+
+typedef std::chrono::steady_clock BenchClock;
+
+// Heap allocations made through operator new, aligned or not, how many
+// were freed again and the bytes still allocated. On ELF platforms the
+// plugin's own allocations resolve to the operators below too, a Windows
+// DLL keeps its own.
+static std::atomic<uint64_t> s_nAllocations(0);
+static std::atomic<uint64_t> s_nFrees(0);
+static std::atomic<int64_t> s_nLiveBytes(0);
+
+// What precedes each allocation: its size and how far past the start of
+// the block malloc returned it begins, the gap being what it took to align
+// it.
+struct AllocationHeader {
+   size_t size;
+   size_t offset;
+};
+
+static void* CountedAllocate(size_t size, size_t alignment) noexcept
+{
+   alignment = std::max(alignment, alignof(std::max_align_t));
+   uintptr_t block = (uintptr_t)malloc(size + sizeof(AllocationHeader) + alignment);
+   if (block == 0)
+   {
+      return NULL;
+   }
+   uintptr_t p = (block + sizeof(AllocationHeader) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+   AllocationHeader header = { size, p - block };
+   memcpy((void*)(p - sizeof(AllocationHeader)), &header, sizeof(header));
+   s_nAllocations.fetch_add(1, std::memory_order_relaxed);
+   s_nLiveBytes.fetch_add((int64_t)size, std::memory_order_relaxed);
+   return (void*)p;
+}
+
+static void CountedFree(void* p) noexcept
+{
+   if (p == NULL)
+   {
+      return;
+   }
+   AllocationHeader header;
+   memcpy(&header, (const void*)((uintptr_t)p - sizeof(AllocationHeader)), sizeof(header));
+   s_nFrees.fetch_add(1, std::memory_order_relaxed);
+   s_nLiveBytes.fetch_sub((int64_t)header.size, std::memory_order_relaxed);
+   free((void*)((uintptr_t)p - header.offset));
+}
+
+void* operator new(size_t size)
+{
+   void* p = CountedAllocate(size, alignof(std::max_align_t));
+   if (p == NULL)
+   {
+      throw std::bad_alloc();
+   }
+   return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+   return CountedAllocate(size, alignof(std::max_align_t));
+}
+
+// Over-aligned types, such as the device context and its effect arena.
+void* operator new(size_t size, std::align_val_t alignment)
+{
+   void* p = CountedAllocate(size, (size_t)alignment);
+   if (p == NULL)
+   {
+      throw std::bad_alloc();
+   }
+   return p;
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+   return CountedAllocate(size, (size_t)alignment);
+}
+
+void operator delete(void* p) noexcept
+{
+   CountedFree(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+   CountedFree(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+   CountedFree(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+   CountedFree(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept
+{
+   CountedFree(p);
+}
+
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+   CountedFree(p);
+}
+
+// Allocations not freed yet.
+static int64_t LiveAllocations()
+{
+   return (int64_t)(s_nAllocations.load() - s_nFrees.load());
+}
+
+static double ElapsedNs(BenchClock::time_point start)
+{
+   return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now() - start).count();
+}
+
+static void Report(const char* name, double totalNs, int calls)
+{
+   printf("%-32s %10d calls %12.1f ns/call\n", name, calls, calls > 0 ? totalNs / calls : 0.0);
+}
+
+static bool Check(HRESULT hr, const char* what)
+{
+   if (FAILED(hr))
+   {
+      fprintf(stderr, "%s failed: 0x%08x\n", what, (unsigned int)hr);
+      return false;
+   }
+   return true;
+}
+
+/**
+ * Start the simulated backend, select the first device and enumerate its axes.
+ */
+static bool OpenSimulatedDevice(const BenchOptions& options, int& axisCount)
+{
+   if (!Check(SelectFFBBackend(Backends::Type::Simulated), "SelectFFBBackend")
+      || !Check(ConfigureSimulatedDevice(&options.device), "ConfigureSimulatedDevice")
+      || !Check(StartDirectInput(), "StartDirectInput"))
+   {
+      return false;
+   }
+   int deviceCount = 0;
+   DeviceInfo* devices = EnumerateFFBDevices(deviceCount);
+   if (deviceCount == 0 || !Check(CreateFFBDevice(devices[0].guidInstance), "CreateFFBDevice"))
+   {
+      return false;
+   }
+   axisCount = 0;
+   EnumerateFFBAxes(axisCount);
+   return axisCount > 0;
+}
+
+/**
+ * Time every stage of the start up sequence UnityFFB runs on Awake.
+ */
+static void BenchStartup(const BenchOptions& options)
+{
+   BenchClock::time_point start;
+   int deviceCount = 0;
+   int axisCount = 0;
+
+   SelectFFBBackend(Backends::Type::Simulated);
+   ConfigureSimulatedDevice(&options.device);
+
+   start = BenchClock::now();
+   StartDirectInput();
+   Report("StartDirectInput", ElapsedNs(start), 1);
+
+   start = BenchClock::now();
+   DeviceInfo* devices = EnumerateFFBDevices(deviceCount);
+   Report("EnumerateFFBDevices", ElapsedNs(start), 1);
+   if (deviceCount == 0)
+   {
+      return;
+   }
+
+   start = BenchClock::now();
+   CreateFFBDevice(devices[0].guidInstance);
+   Report("CreateFFBDevice", ElapsedNs(start), 1);
+
+   start = BenchClock::now();
+   SetAutoCenter(false);
+   Report("SetAutoCenter", ElapsedNs(start), 1);
+
+   start = BenchClock::now();
+   EnumerateFFBAxes(axisCount);
+   Report("EnumerateFFBAxes", ElapsedNs(start), 1);
+
+   start = BenchClock::now();
+   AddFFBEffect(Effects::Type::ConstantForce);
+   AddFFBEffect(Effects::Type::Spring);
+   Report("AddFFBEffect", ElapsedNs(start), 2);
+
+   start = BenchClock::now();
+   StopDirectInput();
+   Report("StopDirectInput", ElapsedNs(start), 1);
+}
+
+static void BenchUpdateConstantForce(const BenchOptions& options)
+{
+   int axisCount;
+   if (OpenSimulatedDevice(options, axisCount) && Check(AddFFBEffect(Effects::Type::ConstantForce), "AddFFBEffect"))
+   {
+      std::vector<LONG> directions(axisCount, 1);
+      BenchClock::time_point start = BenchClock::now();
+      for (int i = 0; i < options.iterations; i++)
+      {
+         UpdateConstantForce((i % 2000) - 1000, &directions[0]);
+      }
+      Report("UpdateConstantForce", ElapsedNs(start), options.iterations);
+   }
+   StopDirectInput();
+}
+
+static void BenchUpdateSpring(const BenchOptions& options)
+{
+   int axisCount;
+   if (OpenSimulatedDevice(options, axisCount) && Check(AddFFBEffect(Effects::Type::Spring), "AddFFBEffect"))
+   {
+      std::vector<DICONDITION> conditions(axisCount);
+      ZeroMemory(&conditions[0], sizeof(DICONDITION) * axisCount);
+      BenchClock::time_point start = BenchClock::now();
+      for (int i = 0; i < options.iterations; i++)
+      {
+         conditions[0].lPositiveCoefficient = i % DI_FFNOMINALMAX;
+         conditions[0].lNegativeCoefficient = i % DI_FFNOMINALMAX;
+         UpdateSpring(&conditions[0]);
+      }
+      Report("UpdateSpring", ElapsedNs(start), options.iterations);
+   }
+   StopDirectInput();
+}
+
+static void BenchUpdateEffectGain(const BenchOptions& options)
+{
+   int axisCount;
+   if (OpenSimulatedDevice(options, axisCount) && Check(AddFFBEffect(Effects::Type::ConstantForce), "AddFFBEffect"))
+   {
+      BenchClock::time_point start = BenchClock::now();
+      for (int i = 0; i < options.iterations; i++)
+      {
+         UpdateEffectGain(Effects::Type::ConstantForce, (i % 100) / 100.0f);
+      }
+      Report("UpdateEffectGain", ElapsedNs(start), options.iterations);
+   }
+   StopDirectInput();
+}
+
+/**
+ * Replay the typical FixedUpdate pattern: the force only changes every few
+ * ticks and the gain is re-sent with the same value. Reports how many of
+ * the updates change detection kept away from the driver.
+ */
+static void BenchChangeDetection(const BenchOptions& options)
+{
+   int axisCount;
+   if (OpenSimulatedDevice(options, axisCount) && Check(AddFFBEffect(Effects::Type::ConstantForce), "AddFFBEffect"))
+   {
+      std::vector<LONG> directions(axisCount, 1);
+      ResetFFBUpdateCounters();
+      BenchClock::time_point start = BenchClock::now();
+      for (int i = 0; i < options.iterations; i++)
+      {
+         UpdateConstantForce(((i / 4) % 2000) - 1000, &directions[0]);
+         UpdateEffectGain(Effects::Type::ConstantForce, 0.8f);
+      }
+      Report("update + gain (per tick)", ElapsedNs(start), options.iterations);
+
+      FFBUpdateCounters counters;
+      GetFFBUpdateCounters(&counters);
+      printf("%-32s %u received, %u forwarded (%.1f%%), %u parameter bytes\n", "change detection",
+         counters.callsReceived, counters.callsForwarded,
+         counters.callsReceived > 0 ? 100.0 * counters.callsForwarded / counters.callsReceived : 0.0,
+         counters.parameterBytesSent);
+   }
+   StopDirectInput();
+}
+
+/**
+ * Drive constant force, spring and gain every tick, first with one export
+ * call each, then as a single SubmitFFBCommands batch.
+ */
+static void BenchCommandBatch(const BenchOptions& options)
+{
+   int axisCount;
+   if (OpenSimulatedDevice(options, axisCount) && Check(AddFFBEffect(Effects::Type::ConstantForce), "AddFFBEffect")
+      && Check(AddFFBEffect(Effects::Type::Spring), "AddFFBEffect"))
+   {
+      std::vector<LONG> directions(axisCount, 1);
+      std::vector<DICONDITION> conditions(axisCount);
+      ZeroMemory(&conditions[0], sizeof(DICONDITION) * axisCount);
+      SimulatedDeviceState before, after;
+
+      GetSimulatedDeviceState(0, &before);
+      BenchClock::time_point start = BenchClock::now();
+      for (int i = 0; i < options.iterations; i++)
+      {
+         conditions[0].lPositiveCoefficient = i % DI_FFNOMINALMAX;
+         UpdateConstantForce((i % 2000) - 1000, &directions[0]);
+         UpdateSpring(&conditions[0]);
+         UpdateEffectGain(Effects::Type::ConstantForce, (i % 100) / 100.0f);
+      }
+      double separateNs = ElapsedNs(start);
+      GetSimulatedDeviceState(0, &after);
+      Report("separate calls (per tick)", separateNs, options.iterations);
+      printf("%-32s %.2f driver calls/tick\n", "", (double)(after.setParametersCalls - before.setParametersCalls) / options.iterations);
+
+      FFBCommand commands[3];
+      HRESULT results[3];
+      ZeroMemory(commands, sizeof(commands));
+      commands[0].command = FFBCommands::Type::UpdateConstantForce;
+      commands[0].effectType = Effects::Type::ConstantForce;
+      commands[1].command = FFBCommands::Type::UpdateSpring;
+      commands[1].effectType = Effects::Type::Spring;
+      commands[2].command = FFBCommands::Type::SetGain;
+      commands[2].effectType = Effects::Type::ConstantForce;
+      for (int a = 0; a < axisCount; a++)
+      {
+         commands[0].constantForce.directions[a] = 1;
+      }
+
+      GetSimulatedDeviceState(0, &before);
+      start = BenchClock::now();
+      for (int i = 0; i < options.iterations; i++)
+      {
+         commands[0].constantForce.magnitude = (i % 2000) - 1000;
+         commands[1].conditions[0].lPositiveCoefficient = i % DI_FFNOMINALMAX;
+         commands[2].gainPercent = (i % 100) / 100.0f;
+         SubmitFFBCommands(commands, 3, results);
+      }
+      double batchNs = ElapsedNs(start);
+      GetSimulatedDeviceState(0, &after);
+      Report("SubmitFFBCommands (per tick)", batchNs, options.iterations);
+      printf("%-32s %.2f driver calls/tick\n", "", (double)(after.setParametersCalls - before.setParametersCalls) / options.iterations);
+   }
+   StopDirectInput();
+}
+
+/**
+ * Run the force output thread while the "game" publishes at 100 Hz,
+ * optionally with busy threads competing for the CPU, and report whether
+ * the loop held its period.
+ */
+static void BenchOutputThread(const BenchOptions& options)
+{
+   int axisCount;
+   if (OpenSimulatedDevice(options, axisCount) && Check(AddFFBEffect(Effects::Type::ConstantForce), "AddFFBEffect")
+      && Check(StartForceOutputThread(options.rateHz), "StartForceOutputThread"))
+   {
+      std::atomic<bool> loaded(true);
+      std::vector<std::thread> load;
+      for (int i = 0; i < options.loadThreads; i++)
+      {
+         load.push_back(std::thread([&loaded]() {
+            volatile uint64_t spin = 0;
+            while (loaded.load(std::memory_order_relaxed))
+            {
+               spin = spin + 1;
+            }
+         }));
+      }
+
+      std::vector<LONG> directions(axisCount, 1);
+      BenchClock::time_point start = BenchClock::now();
+      BenchClock::time_point end = start + std::chrono::microseconds((int64_t)(options.seconds * 1000000));
+      int published = 0;
+      double publishNs = 0;
+      for (BenchClock::time_point tick = start; tick < end; tick += std::chrono::milliseconds(10))
+      {
+         std::this_thread::sleep_until(tick);
+         BenchClock::time_point call = BenchClock::now();
+         UpdateConstantForce((published % 2000) - 1000, &directions[0]);
+         publishNs += ElapsedNs(call);
+         published++;
+      }
+
+      ForceOutputStats stats;
+      GetForceOutputStats(&stats);
+      loaded = false;
+      for (std::thread& thread : load)
+      {
+         thread.join();
+      }
+
+      Report("UpdateConstantForce (publish)", publishNs, published);
+      printf("%-32s %d Hz, %u ticks, %u overruns, %u applied, %u failed\n", "output thread",
+         stats.rateHz, stats.ticks, stats.overruns, stats.updatesApplied, stats.updatesFailed);
+      printf("%-32s mean %.1f us, max %.1f us\n", "output thread jitter",
+         stats.meanJitterMicroseconds, stats.maxJitterMicroseconds);
+   }
+   StopDirectInput();
+}
+
+/**
+ * Displace the simulated wheel and let a synthesized spring and damper pull
+ * it back to center through the constant force, on the output thread.
+ */
+static void BenchForceSynthesis(const BenchOptions& options)
+{
+   int axisCount;
+   if (OpenSimulatedDevice(options, axisCount) && Check(EnableForceSynthesis(NULL), "EnableForceSynthesis")
+      && Check(AddFFBEffect(Effects::Type::ConstantForce), "AddFFBEffect")
+      && Check(AddFFBEffect(Effects::Type::Spring), "AddFFBEffect")
+      && Check(AddFFBEffect(Effects::Type::Damper), "AddFFBEffect"))
+   {
+      std::vector<DICONDITION> spring(axisCount);
+      std::vector<DICONDITION> damper(axisCount);
+      for (int i = 0; i < axisCount; i++)
+      {
+         ZeroMemory(&spring[i], sizeof(DICONDITION));
+         spring[i].lPositiveCoefficient = DI_FFNOMINALMAX;
+         ZeroMemory(&damper[i], sizeof(DICONDITION));
+         damper[i].lPositiveCoefficient = DI_FFNOMINALMAX / 2;
+      }
+      UpdateCondition(Effects::Type::Spring, &spring[0]);
+      UpdateCondition(Effects::Type::Damper, &damper[0]);
+
+      const LONG displaced = 60000;
+      const LONG center = 32767;
+      SetSimulatedAxisPosition(0, 0, displaced);
+      if (Check(StartForceOutputThread(options.rateHz), "StartForceOutputThread"))
+      {
+         BenchClock::time_point start = BenchClock::now();
+         BenchClock::time_point end = start + std::chrono::microseconds((int64_t)(options.seconds * 1000000));
+         double settledMs = -1;
+         LONG peakOvershoot = 0;
+         SimulatedDeviceState wheel;
+         for (BenchClock::time_point tick = start; tick < end; tick += std::chrono::milliseconds(1))
+         {
+            std::this_thread::sleep_until(tick);
+            GetSimulatedDeviceState(0, &wheel);
+            LONG error = wheel.axisPosition[0] - center;
+            if (error < 0 && -error > peakOvershoot)
+            {
+               peakOvershoot = -error;
+            }
+            if (abs(error) > 500)
+            {
+               settledMs = -1;
+            }
+            else if (settledMs < 0)
+            {
+               settledMs = ElapsedNs(start) / 1000000.0;
+            }
+         }
+         StopForceOutputThread();
+
+         ForceOutputStats stats;
+         ForceSynthState synth;
+         GetForceOutputStats(&stats);
+         GetForceSynthState(&synth);
+         printf("%-32s %ld -> %ld, overshoot %ld, settled (+-500) after %.1f ms\n", "axis 0 position",
+            (long)displaced, (long)wheel.axisPosition[0], (long)peakOvershoot, settledMs);
+         printf("%-32s %u steps, %u ticks, %u overruns, %u failed, jitter mean %.1f us\n", "synthesis",
+            synth.steps, stats.ticks, stats.overruns, stats.updatesFailed, stats.meanJitterMicroseconds);
+      }
+   }
+   DisableForceSynthesis();
+   StopDirectInput();
+}
+
+/**
+ * Two wheels, the second one slow (--latency, at least 2 ms per driver
+ * call). Both are updated with one SubmitFFBDeviceCommands call per game
+ * frame, first synchronously and then through per-device output threads,
+ * to show the fast wheel keeps its rate when the slow one cannot.
+ */
+static void BenchMultiDevice(const BenchOptions& options)
+{
+   BenchOptions twoDevices = options;
+   twoDevices.device.deviceCount = 2;
+   twoDevices.device.latencyMicroseconds = 0;
+   DWORD slowLatency = options.device.latencyMicroseconds > 2000 ? options.device.latencyMicroseconds : 2000;
+
+   int axisCount;
+   FFBDeviceHandle handles[2] = { 0, 0 };
+   bool opened = OpenSimulatedDevice(twoDevices, axisCount);
+   int deviceCount = 0;
+   DeviceInfo* devices = EnumerateFFBDevices(deviceCount);
+   opened = opened && deviceCount == 2
+      && Check(OpenFFBDevice(devices[1].guidInstance, &handles[1]), "OpenFFBDevice")
+      && Check(SetSimulatedDeviceLatency(1, slowLatency), "SetSimulatedDeviceLatency");
+   if (opened)
+   {
+      // CreateFFBDevice opened the first wheel as the default device.
+      handles[0] = 1;
+      DeviceEnumerateFFBAxes(handles[1], axisCount);
+      opened = Check(DeviceAddFFBEffect(handles[0], Effects::Type::ConstantForce), "DeviceAddFFBEffect")
+         && Check(DeviceAddFFBEffect(handles[1], Effects::Type::ConstantForce), "DeviceAddFFBEffect");
+   }
+   if (opened)
+   {
+      FFBCommand commands[2];
+      ZeroMemory(commands, sizeof(commands));
+      for (int i = 0; i < 2; i++)
+      {
+         commands[i].command = FFBCommands::Type::UpdateConstantForce;
+         commands[i].effectType = Effects::Type::ConstantForce;
+         commands[i].constantForce.directions[0] = 1;
+      }
+      HRESULT results[2];
+
+      int frames = 200;
+      BenchClock::time_point start = BenchClock::now();
+      for (int i = 0; i < frames; i++)
+      {
+         commands[0].constantForce.magnitude = commands[1].constantForce.magnitude = (i % 2000) - 1000;
+         SubmitFFBDeviceCommands(handles, commands, 2, results);
+      }
+      Report("SubmitFFBDeviceCommands (sync)", ElapsedNs(start), frames);
+
+      for (int i = 0; i < 2; i++)
+      {
+         Check(DeviceStartForceOutputThread(handles[i], options.rateHz), "DeviceStartForceOutputThread");
+      }
+      start = BenchClock::now();
+      BenchClock::time_point end = start + std::chrono::microseconds((int64_t)(options.seconds * 1000000));
+      frames = 0;
+      double submitNs = 0;
+      for (BenchClock::time_point tick = start; tick < end; tick += std::chrono::milliseconds(10))
+      {
+         std::this_thread::sleep_until(tick);
+         BenchClock::time_point call = BenchClock::now();
+         commands[0].constantForce.magnitude = commands[1].constantForce.magnitude = (frames % 2000) - 1000;
+         SubmitFFBDeviceCommands(handles, commands, 2, results);
+         submitNs += ElapsedNs(call);
+         frames++;
+      }
+      Report("SubmitFFBDeviceCommands (thread)", submitNs, frames);
+
+      for (int i = 0; i < 2; i++)
+      {
+         ForceOutputStats stats;
+         DeviceGetForceOutputStats(handles[i], &stats);
+         DeviceStopForceOutputThread(handles[i]);
+         printf("%-32s %d Hz, %u ticks, %u overruns, %u applied, jitter mean %.1f us\n",
+            i == 0 ? "fast device" : "slow device", stats.rateHz, stats.ticks, stats.overruns,
+            stats.updatesApplied, stats.meanJitterMicroseconds);
+      }
+      CloseFFBDevice(handles[1]);
+   }
+   StopDirectInput();
+}
+
+struct QueueProbe
+{
+   uint32_t producer;
+   uint32_t sequence;
+};
+
+/**
+ * Stress the multiple producer queue: every producer thread pushes its own
+ * numbered items as fast as it can while one consumer pops, and checks each
+ * producer's items come out in order with none lost. Then run the same
+ * through EnqueueFFBCommands, each producer owning a simulated wheel and
+ * raising its constant force one step per command, and check after every
+ * DrainFFBCommandQueue that no wheel's force went backwards.
+ */
+static void BenchCommandQueue(const BenchOptions& options)
+{
+   int producers = options.producerThreads > 0 ? options.producerThreads : 1;
+   int perProducer = options.iterations / producers > 0 ? options.iterations / producers : 1;
+
+   static MpscQueue<QueueProbe, FFB_COMMAND_QUEUE_CAPACITY> queue;
+   QueueProbe probe = { 0, 0 };
+   BenchClock::time_point start = BenchClock::now();
+   for (int i = 0; i < options.iterations; i++)
+   {
+      queue.Push(probe);
+      queue.Pop(probe);
+   }
+   Report("MpscQueue Push+Pop uncontended", ElapsedNs(start), options.iterations);
+
+   std::atomic<int> ready(0);
+   std::atomic<bool> go(false);
+   std::atomic<uint64_t> fullRetries(0);
+   std::vector<std::thread> threads;
+   for (int p = 0; p < producers; p++)
+   {
+      threads.emplace_back([&, p]()
+      {
+         uint64_t retries = 0;
+         ready++;
+         while (!go)
+         {
+            std::this_thread::yield();
+         }
+         for (int i = 0; i < perProducer; i++)
+         {
+            QueueProbe probe = { (uint32_t)p, (uint32_t)i };
+            while (!queue.Push(probe))
+            {
+               retries++;
+               std::this_thread::yield();
+            }
+         }
+         fullRetries += retries;
+      });
+   }
+   while (ready < producers)
+   {
+      std::this_thread::yield();
+   }
+
+   std::vector<uint32_t> expected(producers, 0);
+   int outOfOrder = 0;
+   int popped = 0;
+   int total = producers * perProducer;
+   start = BenchClock::now();
+   go = true;
+   while (popped < total)
+   {
+      if (!queue.Pop(probe))
+      {
+         continue;
+      }
+      if (probe.producer >= (uint32_t)producers || probe.sequence != expected[probe.producer])
+      {
+         outOfOrder++;
+      }
+      else
+      {
+         expected[probe.producer]++;
+      }
+      popped++;
+   }
+   double totalNs = ElapsedNs(start);
+   for (std::thread& thread : threads)
+   {
+      thread.join();
+   }
+   threads.clear();
+   printf("%-32s %d producers, %.1f M items/s, %llu full retries, %d out of order\n", "MpscQueue push/pop",
+      producers, total / totalNs * 1000.0, (unsigned long long)fullRetries.load(), outOfOrder);
+
+   BenchOptions wheels = options;
+   wheels.device.deviceCount = producers;
+   wheels.device.latencyMicroseconds = 0;
+   int axisCount;
+   std::vector<FFBDeviceHandle> handles(producers, 0);
+   bool opened = OpenSimulatedDevice(wheels, axisCount);
+   int deviceCount = 0;
+   DeviceInfo* devices = EnumerateFFBDevices(deviceCount);
+   opened = opened && deviceCount == producers;
+   // CreateFFBDevice opened the first wheel as the default device.
+   handles[0] = 1;
+   for (int p = 0; opened && p < producers; p++)
+   {
+      opened = p == 0 || Check(OpenFFBDevice(devices[p].guidInstance, &handles[p]), "OpenFFBDevice");
+      DeviceEnumerateFFBAxes(handles[p], axisCount);
+      opened = opened && Check(DeviceAddFFBEffect(handles[p], Effects::Type::ConstantForce), "DeviceAddFFBEffect");
+      DeviceStartAllFFBEffects(handles[p]);
+   }
+   if (opened)
+   {
+      // Forces beyond DI_FFNOMINALMAX would be clamped and stop rising.
+      int steps = perProducer < DI_FFNOMINALMAX ? perProducer : DI_FFNOMINALMAX;
+      std::atomic<int> finished(0);
+      std::atomic<uint64_t> enqueueNs(0);
+      std::atomic<uint64_t> droppedRetries(0);
+      ready = 0;
+      go = false;
+      for (int p = 0; p < producers; p++)
+      {
+         threads.emplace_back([&, p]()
+         {
+            // Burst code would call through this pointer the same way.
+            FFBEnqueueCommandsFn enqueue = GetFFBEnqueueCommandsFunction();
+            FFBCommand command;
+            ZeroMemory(&command, sizeof(command));
+            command.command = FFBCommands::Type::UpdateConstantForce;
+            command.effectType = Effects::Type::ConstantForce;
+            command.constantForce.directions[0] = 1;
+            uint64_t retries = 0;
+            ready++;
+            while (!go)
+            {
+               std::this_thread::yield();
+            }
+            BenchClock::time_point begin = BenchClock::now();
+            for (int i = 1; i <= steps; i++)
+            {
+               command.constantForce.magnitude = i;
+               while (enqueue(handles[p], &command, 1) != S_OK)
+               {
+                  retries++;
+                  std::this_thread::yield();
+               }
+            }
+            enqueueNs += (uint64_t)ElapsedNs(begin);
+            droppedRetries += retries;
+            finished++;
+         });
+      }
+      while (ready < producers)
+      {
+         std::this_thread::yield();
+      }
+
+      std::vector<LONG> lastForce(producers, 0);
+      int backwards = 0;
+      int drains = 0;
+      double drainNs = 0;
+      go = true;
+      for (;;)
+      {
+         bool done = finished == producers;
+         BenchClock::time_point call = BenchClock::now();
+         int drained = 0;
+         DrainFFBCommandQueue(&drained);
+         if (drained > 0)
+         {
+            drainNs += ElapsedNs(call);
+            drains++;
+         }
+         for (int p = 0; p < producers; p++)
+         {
+            SimulatedDeviceState state;
+            GetSimulatedDeviceState(p, &state);
+            if (state.outputForce[0] < lastForce[p])
+            {
+               backwards++;
+            }
+            lastForce[p] = state.outputForce[0];
+         }
+         FFBCommandQueueStats queueStats;
+         GetFFBCommandQueueStats(&queueStats);
+         if (done && queueStats.pending == 0)
+         {
+            break;
+         }
+      }
+      for (std::thread& thread : threads)
+      {
+         thread.join();
+      }
+
+      int wrongFinal = 0;
+      for (int p = 0; p < producers; p++)
+      {
+         wrongFinal += lastForce[p] != steps ? 1 : 0;
+      }
+      FFBCommandQueueStats queueStats;
+      GetFFBCommandQueueStats(&queueStats);
+      Report("EnqueueFFBCommands", (double)enqueueNs.load(), producers * steps);
+      Report("DrainFFBCommandQueue", drainNs, drains);
+      printf("%-32s %u enqueued, %u drained, %u dropped (%llu retried), %u failed\n", "command queue",
+         queueStats.enqueued, queueStats.drained, queueStats.dropped, (unsigned long long)droppedRetries.load(), queueStats.failed);
+      printf("%-32s %d went backwards, %d wheels not at %d\n", "per wheel order", backwards, wrongFinal, steps);
+   }
+   StopDirectInput();
+}
+
+/**
+ * Compare looking effects up in a std::map, as the plugin did when effects
+ * were keyed by type, with the generation checked SlotMap, then time
+ * updating several layered constant forces through their handles and
+ * check a full device and a stale handle are refused.
+ */
+static void BenchEffectLookup(const BenchOptions& options)
+{
+   const int effectCount = 64;
+   std::map<uint32_t, void*> map;
+   SlotMap<void*> slots(effectCount);
+   std::vector<uint32_t> handles;
+   for (int i = 0; i < effectCount; i++)
+   {
+      map[(uint32_t)i] = &map;
+      handles.push_back(slots.Insert(&map));
+   }
+
+   // Sum the results so the lookups cannot be optimised away.
+   uintptr_t sum = 0;
+   BenchClock::time_point start = BenchClock::now();
+   for (int i = 0; i < options.iterations; i++)
+   {
+      auto it = map.find((uint32_t)(i % effectCount));
+      sum += it != map.end() ? (uintptr_t)it->second : 0;
+   }
+   Report("std::map find", ElapsedNs(start), options.iterations);
+
+   start = BenchClock::now();
+   for (int i = 0; i < options.iterations; i++)
+   {
+      void** value = slots.Get(handles[i % effectCount]);
+      sum += value != NULL ? (uintptr_t)*value : 0;
+   }
+   Report("SlotMap Get", ElapsedNs(start), options.iterations);
+   if (sum == 1)
+   {
+      printf("\n");
+   }
+
+   const int layerCount = 8;
+   BenchOptions limited = options;
+   limited.device.maxEffects = layerCount;
+   int axisCount;
+   if (OpenSimulatedDevice(limited, axisCount))
+   {
+      FFBEffectHandle layers[layerCount];
+      bool created = true;
+      for (int i = 0; i < layerCount; i++)
+      {
+         created = created && Check(CreateFFBEffect(Effects::Type::ConstantForce, &layers[i]), "CreateFFBEffect");
+      }
+      if (created)
+      {
+         std::vector<LONG> directions(axisCount, 1);
+         start = BenchClock::now();
+         for (int i = 0; i < options.iterations; i++)
+         {
+            UpdateConstantForce((i % 2000) - 1000, &directions[0]);
+         }
+         Report("UpdateConstantForce (by type)", ElapsedNs(start), options.iterations);
+
+         start = BenchClock::now();
+         for (int i = 0; i < options.iterations; i++)
+         {
+            UpdateFFBEffectConstantForce(layers[i % layerCount], (i % 2000) - 1000, &directions[0]);
+         }
+         Report("UpdateFFBEffectConstantForce", ElapsedNs(start), options.iterations);
+
+         FFBEffectHandle extra = 0;
+         HRESULT full = CreateFFBEffect(Effects::Type::ConstantForce, &extra);
+         DestroyFFBEffect(layers[0]);
+         // The type based functions move on to another constant force.
+         HRESULT byType = UpdateConstantForce(0, &directions[0]);
+         Check(CreateFFBEffect(Effects::Type::ConstantForce, &extra), "CreateFFBEffect");
+         HRESULT stale = UpdateFFBEffectConstantForce(layers[0], 0, &directions[0]);
+         printf("%-32s full device 0x%08x, stale handle 0x%08x, by type after destroy 0x%08x\n", "errors",
+            (unsigned int)full, (unsigned int)stale, (unsigned int)byType);
+      }
+   }
+   StopDirectInput();
+}
+
+/**
+ * Enumerate devices and axes repeatedly, through the DeviceInfo arrays
+ * (what UnityFFB marshals) and through the blittable snapshots, and count
+ * the heap allocations each makes once warmed up.
+ */
+static void BenchEnumeration(const BenchOptions& options)
+{
+   BenchOptions wheels = options;
+   wheels.device.deviceCount = 4;
+   int axisCount;
+   if (!OpenSimulatedDevice(wheels, axisCount))
+   {
+      StopDirectInput();
+      return;
+   }
+   int iterations = options.iterations / 10 > 0 ? options.iterations / 10 : 1;
+
+   int deviceCount = 0;
+   EnumerateFFBDevices(deviceCount);
+   EnumerateFFBAxes(axisCount);
+   uint64_t allocations = s_nAllocations.load();
+   BenchClock::time_point start = BenchClock::now();
+   for (int i = 0; i < iterations; i++)
+   {
+      EnumerateFFBDevices(deviceCount);
+      EnumerateFFBAxes(axisCount);
+   }
+   Report("DeviceInfo arrays", ElapsedNs(start), iterations);
+   printf("%-32s %.2f allocations per enumeration\n", "", (double)(s_nAllocations.load() - allocations) / iterations);
+
+   const FFBEnumSnapshot* devices = NULL;
+   const FFBEnumSnapshot* axes = NULL;
+   EnumerateFFBDeviceSnapshot(&devices);
+   EnumerateFFBAxisSnapshot(&axes);
+   allocations = s_nAllocations.load();
+   start = BenchClock::now();
+   for (int i = 0; i < iterations; i++)
+   {
+      EnumerateFFBDeviceSnapshot(&devices);
+      EnumerateFFBAxisSnapshot(&axes);
+   }
+   Report("snapshots", ElapsedNs(start), iterations);
+   printf("%-32s %.2f allocations per enumeration\n", "", (double)(s_nAllocations.load() - allocations) / iterations);
+
+   if (devices != NULL && devices->recordCount > 0)
+   {
+      const BYTE* base = (const BYTE*)devices;
+      const FFBDeviceRecord* first = (const FFBDeviceRecord*)(base + devices->recordOffset);
+      printf("%-32s %u devices, %u bytes, first \"%s\"\n", "device snapshot", devices->recordCount, devices->size,
+         (const char*)(base + devices->stringOffset + first->productName));
+   }
+   StopDirectInput();
+}
+
+static const char* DeviceEventName(FFBDeviceEvents::Type type)
+{
+   switch (type)
+   {
+   case FFBDeviceEvents::Type::Added:
+      return "added";
+   case FFBDeviceEvents::Type::Removed:
+      return "removed";
+   case FFBDeviceEvents::Type::Changed:
+      return "changed";
+   case FFBDeviceEvents::Type::Restored:
+      return "restored";
+   default:
+      return "?";
+   }
+}
+
+/**
+ * Poll for device events every 1 ms until one of the given type
+ * arrives or timeoutMs passes, printing every event seen. Returns the
+ * milliseconds waited, -1 on timeout.
+ */
+static double WaitForDeviceEvent(FFBDeviceEvents::Type type, int timeoutMs, FFBDeviceEvent& found)
+{
+   BenchClock::time_point start = BenchClock::now();
+   BenchClock::time_point end = start + std::chrono::milliseconds(timeoutMs);
+   while (BenchClock::now() < end)
+   {
+      // One at a time, so nothing after the awaited event is consumed.
+      FFBDeviceEvent event;
+      int eventCount = 0;
+      PollFFBDeviceEvents(&event, 1, &eventCount);
+      if (eventCount == 0)
+      {
+         std::this_thread::sleep_for(std::chrono::milliseconds(1));
+         continue;
+      }
+      printf("%-32s %s, device %d, result 0x%08x\n", "event", DeviceEventName(event.type),
+         event.device, (unsigned int)event.result);
+      if (event.type == type)
+      {
+         found = event;
+         return ElapsedNs(start) / 1000000.0;
+      }
+   }
+   return -1.0;
+}
+
+/**
+ * Script unplugging and replugging the open wheel of two while the device
+ * monitor runs, check the wheel is restored with the force it had, and
+ * compare the cost of polling for events each frame with enumerating.
+ * The monitor's rescan interval is long, so the events are driven by the
+ * backend's change notification.
+ */
+static void BenchHotPlug(const BenchOptions& options)
+{
+   BenchOptions wheels = options;
+   wheels.device.deviceCount = 2;
+   int axisCount;
+   if (!OpenSimulatedDevice(wheels, axisCount)
+      || !Check(AddFFBEffect(Effects::Type::ConstantForce), "AddFFBEffect")
+      || !Check(StartFFBDeviceMonitor(1000), "StartFFBDeviceMonitor"))
+   {
+      StopDirectInput();
+      return;
+   }
+   std::vector<LONG> directions(axisCount, 1);
+   UpdateConstantForce(4000, &directions[0]);
+   SetAutoCenter(false);
+   StartAllFFBEffects();
+   SimulatedDeviceState before;
+   GetSimulatedDeviceState(0, &before);
+
+   FFBDeviceEvent event;
+   // The first scan reports both wheels as added.
+   WaitForDeviceEvent(FFBDeviceEvents::Type::Added, 1000, event);
+   WaitForDeviceEvent(FFBDeviceEvents::Type::Added, 1000, event);
+
+   SetSimulatedDeviceAttached(0, false);
+   double removedMs = WaitForDeviceEvent(FFBDeviceEvents::Type::Removed, 500, event);
+   HRESULT lost = UpdateConstantForce(2000, &directions[0]);
+   UpdateConstantForce(4000, &directions[0]);
+   SetSimulatedDeviceAttached(0, true);
+   double restoredMs = WaitForDeviceEvent(FFBDeviceEvents::Type::Restored, 500, event);
+   SimulatedDeviceState after;
+   GetSimulatedDeviceState(0, &after);
+   printf("%-32s removed after %.2f ms, restored after %.2f ms, update while unplugged 0x%08x\n", "hot plug",
+      removedMs, restoredMs, (unsigned int)lost);
+   printf("%-32s force %d before, %d after, %s\n", "restore", before.outputForce[0], after.outputForce[0],
+      restoredMs >= 0 && SUCCEEDED(event.result) && before.outputForce[0] == after.outputForce[0] ? "ok" : "FAILED");
+
+   int iterations = options.iterations / 10 > 0 ? options.iterations / 10 : 1;
+   FFBDeviceEvent events[8];
+   int eventCount = 0;
+   BenchClock::time_point start = BenchClock::now();
+   for (int i = 0; i < iterations; i++)
+   {
+      PollFFBDeviceEvents(events, 8, &eventCount);
+   }
+   Report("PollFFBDeviceEvents", ElapsedNs(start), iterations);
+
+   int deviceCount = 0;
+   start = BenchClock::now();
+   for (int i = 0; i < iterations; i++)
+   {
+      EnumerateFFBDevices(deviceCount);
+   }
+   Report("EnumerateFFBDevices", ElapsedNs(start), iterations);
+
+   StopFFBDeviceMonitor();
+   StopDirectInput();
+}
+
+/**
+ * Start up with driver calls taking --latency (at least 2 ms) each, once
+ * synchronously like UnityFFB's Awake and once with StartFFBInitAsync
+ * polled every 16 ms frame, and compare how long the game thread is
+ * blocked. Prints the time each init stage took.
+ */
+static void BenchAsyncInit(const BenchOptions& options)
+{
+   static const char* stageNames[FFB_INIT_STAGE_COUNT] = {
+      "start backend", "enumerate devices", "open device", "set auto center", "enumerate axes", "add effects"
+   };
+   BenchOptions slow = options;
+   slow.device.latencyMicroseconds = options.device.latencyMicroseconds > 2000 ? options.device.latencyMicroseconds : 2000;
+
+   SelectFFBBackend(Backends::Type::Simulated);
+   ConfigureSimulatedDevice(&slow.device);
+   BenchClock::time_point start = BenchClock::now();
+   int deviceCount = 0;
+   int axisCount = 0;
+   StartDirectInput();
+   DeviceInfo* devices = EnumerateFFBDevices(deviceCount);
+   if (deviceCount > 0)
+   {
+      CreateFFBDevice(devices[0].guidInstance);
+      SetAutoCenter(false);
+      EnumerateFFBAxes(axisCount);
+      AddFFBEffect(Effects::Type::ConstantForce);
+      AddFFBEffect(Effects::Type::Spring);
+   }
+   printf("%-32s %10.2f ms blocked\n", "synchronous", ElapsedNs(start) / 1000000.0);
+   StopDirectInput();
+
+   FFBInitConfig config;
+   ZeroMemory(&config, sizeof(config));
+   config.deviceSelection = FFBInitDeviceSelection::Type::First;
+   config.autoCenter = 0;
+   config.effectCount = 2;
+   config.effects[0] = Effects::Type::ConstantForce;
+   config.effects[1] = Effects::Type::Spring;
+
+   SelectFFBBackend(Backends::Type::Simulated);
+   ConfigureSimulatedDevice(&slow.device);
+   start = BenchClock::now();
+   if (!Check(StartFFBInitAsync(&config), "StartFFBInitAsync"))
+   {
+      return;
+   }
+   double blockedNs = ElapsedNs(start);
+   double worstNs = blockedNs;
+   int frames = 0;
+   FFBInitStatus status;
+   for (BenchClock::time_point frame = start; ; frame += std::chrono::milliseconds(16))
+   {
+      std::this_thread::sleep_until(frame);
+      BenchClock::time_point poll = BenchClock::now();
+      GetFFBInitStatus(&status);
+      double pollNs = ElapsedNs(poll);
+      blockedNs += pollNs;
+      worstNs = pollNs > worstNs ? pollNs : worstNs;
+      frames++;
+      if (status.state != FFBInitStates::Type::Running)
+      {
+         break;
+      }
+   }
+   printf("%-32s %10.3f ms blocked, worst frame %.3f ms, done after %d frames\n", "asynchronous",
+      blockedNs / 1000000.0, worstNs / 1000000.0, frames);
+   for (int i = 0; i < FFB_INIT_STAGE_COUNT; i++)
+   {
+      printf("   %-29s %10.2f ms\n", stageNames[i], status.stageMilliseconds[i]);
+   }
+   printf("%-32s %10.2f ms total, %u stages, result 0x%08x, device %d\n", "init",
+      status.totalMilliseconds, status.stagesCompleted, (unsigned int)status.result, status.device);
+
+   std::vector<LONG> directions(1, 1);
+   Check(UpdateConstantForce(1000, &directions[0]), "UpdateConstantForce");
+   StopDirectInput();
+}
+
+static const char* CapabilitySourceName(FFBCapabilitySources::Type source)
+{
+   static const char* names[] = { "none", "cache", "validated", "refreshed", "device" };
+   return source >= 0 && source < (int)(sizeof(names) / sizeof(names[0])) ? names[source] : "?";
+}
+
+/**
+ * Start up as UnityFFB does with the capability cache enabled, until the
+ * device's capabilities are known and its effects added. Returns how long
+ * that took, the device stays open.
+ */
+static double RunCachedStartup(const BenchOptions& options, const SimulatedDeviceConfig& device, FFBDeviceCapabilities& capabilities)
+{
+   ZeroMemory(&capabilities, sizeof(capabilities));
+   SelectFFBBackend(Backends::Type::Simulated);
+   ConfigureSimulatedDevice(&device);
+   if (!Check(EnableFFBCapabilityCache(options.cachePath.c_str()), "EnableFFBCapabilityCache"))
+   {
+      return 0;
+   }
+
+   BenchClock::time_point start = BenchClock::now();
+   int deviceCount = 0;
+   int axisCount = 0;
+   StartDirectInput();
+   DeviceInfo* devices = EnumerateFFBDevices(deviceCount);
+   if (deviceCount == 0 || !Check(CreateFFBDevice(devices[0].guidInstance), "CreateFFBDevice"))
+   {
+      return 0;
+   }
+   EnumerateFFBAxes(axisCount);
+   Check(GetFFBDeviceCapabilities(&capabilities), "GetFFBDeviceCapabilities");
+   AddFFBEffect(Effects::Type::ConstantForce);
+   AddFFBEffect(Effects::Type::Spring);
+   return ElapsedNs(start);
+}
+
+/**
+ * Poll the cache status like a game would every frame until the background
+ * checks of the open device finished, false after a few seconds.
+ */
+static bool WaitForCapabilityCheck(FFBCapabilityCacheStatus& status)
+{
+   for (int frame = 0; frame < 300; frame++)
+   {
+      GetFFBCapabilityCacheStatus(&status);
+      if (status.validated + status.stale > 0)
+      {
+         return true;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+   }
+   return false;
+}
+
+/**
+ * Start up time of a wheel that takes --enum-delay to enumerate and to
+ * probe each effect type, without a capability cache file (cold), from the
+ * file the cold start wrote (warm), and from that file after the wheel got
+ * a second axis (stale), which has to be noticed and written back.
+ */
+static void BenchStartupCache(const BenchOptions& options)
+{
+   SimulatedDeviceConfig device = options.device;
+   device.enumerationMicroseconds = options.enumDelayMicroseconds;
+   device.axisCount = 1;
+   remove(options.cachePath.c_str());
+   int failures = 0;
+
+   FFBDeviceCapabilities capabilities;
+   double coldNs = RunCachedStartup(options, device, capabilities);
+   printf("%-32s %10.2f ms, %u axes, effect types 0x%03x, source %s\n", "cold", coldNs / 1000000.0,
+      capabilities.axisCount, capabilities.effectTypes, CapabilitySourceName(capabilities.source));
+   StopDirectInput();
+   FFBCapabilityCacheStatus status;
+   GetFFBCapabilityCacheStatus(&status);
+   failures += status.saveResult == S_OK ? 0 : 1;
+
+   double warmNs = RunCachedStartup(options, device, capabilities);
+   printf("%-32s %10.2f ms, %u axes, effect types 0x%03x, source %s\n", "warm", warmNs / 1000000.0,
+      capabilities.axisCount, capabilities.effectTypes, CapabilitySourceName(capabilities.source));
+   bool checked = WaitForCapabilityCheck(status);
+   printf("%-32s %10.2f ms load, %u hits, %u misses, %u validated, %u stale %s\n", "", status.loadMilliseconds,
+      status.hits, status.misses, status.validated, status.stale, checked && status.validated == 1 ? "ok" : "FAILED");
+   failures += checked && status.validated == 1 ? 0 : 1;
+   printf("%-32s %10.1fx\n", "speedup", warmNs > 0 ? coldNs / warmNs : 0.0);
+   StopDirectInput();
+
+   device.axisCount = 2;
+   double staleNs = RunCachedStartup(options, device, capabilities);
+   printf("%-32s %10.2f ms, %u axes from the cache\n", "stale", staleNs / 1000000.0, capabilities.axisCount);
+   checked = WaitForCapabilityCheck(status);
+   StopDirectInput();
+
+   // The next start sees the second axis.
+   EnableFFBCapabilityCache(options.cachePath.c_str());
+   const FFBEnumSnapshot* cache = NULL;
+   GetFFBCapabilityCacheSnapshot(&cache);
+   const FFBCapabilityRecord* record = cache != NULL && cache->recordCount == 1
+      ? (const FFBCapabilityRecord*)((const BYTE*)cache + cache->recordOffset) : NULL;
+   bool refreshed = checked && status.stale == 1 && record != NULL && record->axisCount == 2;
+   printf("%-32s %u stale, %u axes cached after saving %s\n", "", status.stale,
+      record != NULL ? record->axisCount : 0, refreshed ? "ok" : "FAILED");
+   failures += refreshed ? 0 : 1;
+   DisableFFBCapabilityCache();
+   remove(options.cachePath.c_str());
+
+   printf("%-32s %10d\n", "failures", failures);
+}
+
+/**
+ * Spawn and despawn a constant force and a spring, like a game does for a
+ * collision, on a wheel that takes --download-delay to write a new effect
+ * into its memory: without an effect pool and with one. Then check that a
+ * recycled effect comes back silent and still follows updates.
+ */
+static void BenchEffectPool(const BenchOptions& options)
+{
+   BenchOptions wheel = options;
+   wheel.device.downloadMicroseconds = options.downloadDelayMicroseconds;
+   wheel.device.maxEffects = 16;
+   const int spawns = std::min(options.iterations, 50);
+   int failures = 0;
+   double spawnNs[2] = { 0, 0 };
+
+   for (int pooled = 0; pooled < 2; pooled++)
+   {
+      FFBEffectPoolConfig pool;
+      ZeroMemory(&pool, sizeof(pool));
+      pool.effectsPerType[Effects::Type::ConstantForce] = 4;
+      pool.effectsPerType[Effects::Type::Spring] = 4;
+      ConfigureFFBEffectPool(pooled ? &pool : NULL);
+
+      int axisCount;
+      BenchClock::time_point start = BenchClock::now();
+      bool opened = OpenSimulatedDevice(wheel, axisCount);
+      double openNs = ElapsedNs(start);
+      if (!opened)
+      {
+         failures++;
+         StopDirectInput();
+         continue;
+      }
+      std::vector<LONG> directions(axisCount, 1);
+      SimulatedDeviceState before;
+      GetSimulatedDeviceState(0, &before);
+
+      double worstNs = 0;
+      bool spawned = true;
+      start = BenchClock::now();
+      for (int i = 0; i < spawns && spawned; i++)
+      {
+         BenchClock::time_point spawnStart = BenchClock::now();
+         FFBEffectHandle force, spring;
+         spawned = Check(CreateFFBEffect(Effects::Type::ConstantForce, &force), "CreateFFBEffect")
+            && Check(CreateFFBEffect(Effects::Type::Spring, &spring), "CreateFFBEffect");
+         worstNs = std::max(worstNs, ElapsedNs(spawnStart));
+         if (spawned)
+         {
+            UpdateFFBEffectConstantForce(force, 4000, &directions[0]);
+            DestroyFFBEffect(force);
+            DestroyFFBEffect(spring);
+         }
+      }
+      spawnNs[pooled] = ElapsedNs(start);
+      Report(pooled ? "spawn + despawn (pooled)" : "spawn + despawn", spawnNs[pooled], spawns);
+      failures += spawned ? 0 : 1;
+
+      SimulatedDeviceState after;
+      GetSimulatedDeviceState(0, &after);
+      FFBEffectPoolStats stats;
+      GetFFBEffectPoolStats(&stats);
+      printf("%-32s %10.2f ms open, %.2f ms worst spawn, %.1f downloads per spawn\n", "", openNs / 1000000.0,
+         worstNs / 1000000.0, (double)(after.downloads - before.downloads) / spawns);
+      printf("%-32s %u hits, %u misses, %u recycled, %u created (mean %.0f us, max %.0f us), fill %.2f ms\n", "",
+         stats.hits, stats.misses, stats.recycled, stats.created, stats.meanCreateMicroseconds,
+         stats.maxCreateMicroseconds, stats.fillMilliseconds);
+
+      if (pooled)
+      {
+         bool allHits = stats.hits == (DWORD)(2 * spawns) && stats.misses == 0;
+         FFBEffectHandle force = 0;
+         SimulatedDeviceState state;
+         bool created = SUCCEEDED(CreateFFBEffect(Effects::Type::ConstantForce, &force));
+         GetSimulatedDeviceState(0, &state);
+         bool silent = created && state.outputForce[0] == 0;
+         UpdateFFBEffectConstantForce(force, 3000, &directions[0]);
+         GetSimulatedDeviceState(0, &state);
+         bool follows = created && state.outputForce[0] == 3000;
+         printf("%-32s all hits %s, recycled effect silent %s, follows updates %s\n", "",
+            allHits ? "ok" : "FAILED", silent ? "ok" : "FAILED", follows ? "ok" : "FAILED");
+         failures += (allHits ? 0 : 1) + (silent ? 0 : 1) + (follows ? 0 : 1);
+      }
+      StopDirectInput();
+   }
+   ConfigureFFBEffectPool(NULL);
+
+   printf("%-32s %10.1fx\n", "speedup", spawnNs[1] > 0 ? spawnNs[0] / spawnNs[1] : 0.0);
+   printf("%-32s %10d\n", "failures", failures);
+}
+
+/**
+ * Upper bound of the bucket the given fraction of calls fall into.
+ */
+static double HistogramPercentileUs(const FFBStats& all, const FFBCallStats& stats, double fraction)
+{
+   DWORD target = (DWORD)(stats.calls * fraction);
+   DWORD seen = 0;
+   for (int i = 0; i < FFB_STAT_BUCKETS; i++)
+   {
+      seen += stats.histogram[i];
+      if (seen > target)
+      {
+         return (double)(2ull << i) * all.nanosecondsPerTick / 1000.0;
+      }
+   }
+   return (double)stats.maxNanoseconds / 1000.0;
+}
+
+/**
+ * Run the constant force hot path and a few calls on a device that is not
+ * open, then print the call statistics the plugin recorded.
+ * Build with -DUNITYFFB_STATS=OFF and compare the constant-force numbers
+ * to see the instrumentation's overhead.
+ */
+static void BenchStats(const BenchOptions& options)
+{
+   static const char* callNames[FFB_STAT_CALL_COUNT] = {
+      "StartDirectInput", "EnumerateDevices", "OpenDevice", "EnumerateAxes", "CreateEffect", "DestroyEffect",
+      "UpdateConstantForce", "UpdateCondition", "UpdateGain", "SubmitCommands", "SetAutoCenter", "StartEffects",
+      "StopEffects", "driver EnumDevices", "driver CreateDevice", "driver EnumAxes", "driver CreateEffect",
+      "driver SetParameters", "driver Start", "driver Stop", "driver SetProperty", "driver GetState",
+      "driver Download", "UpdatePeriodic", "UpdateCustomForce", "UpdateEffect"
+   };
+   ResetFFBStats();
+   int axisCount;
+   if (OpenSimulatedDevice(options, axisCount) && Check(AddFFBEffect(Effects::Type::ConstantForce), "AddFFBEffect"))
+   {
+      std::vector<LONG> directions(axisCount, 1);
+      StartAllFFBEffects();
+      BenchClock::time_point start = BenchClock::now();
+      for (int i = 0; i < options.iterations; i++)
+      {
+         UpdateConstantForce((i % 2000) - 1000, &directions[0]);
+      }
+      Report("UpdateConstantForce", ElapsedNs(start), options.iterations);
+      for (int i = 0; i < 3; i++)
+      {
+         DeviceUpdateConstantForce(99, 0, &directions[0]);
+      }
+
+      FFBStats stats;
+      start = BenchClock::now();
+      GetFFBStats(&stats);
+      Report("GetFFBStats", ElapsedNs(start), 1);
+      if (!stats.enabled)
+      {
+         printf("built without statistics\n");
+      }
+      for (DWORD i = 0; i < stats.callCount && stats.enabled; i++)
+      {
+         const FFBCallStats& call = stats.calls[i];
+         if (call.calls == 0)
+         {
+            continue;
+         }
+         printf("%-24s %8u calls %6u failed  mean %8.2f us  p50 < %8.2f us  p99 < %8.2f us  max %8.2f us\n",
+            callNames[i], call.calls, call.failures, (double)call.totalNanoseconds / call.calls / 1000.0,
+            HistogramPercentileUs(stats, call, 0.5), HistogramPercentileUs(stats, call, 0.99), (double)call.maxNanoseconds / 1000.0);
+         for (int r = 0; r < FFB_STAT_RESULTS && call.results[r].count > 0; r++)
+         {
+            printf("%-24s %8u x 0x%08x\n", "", call.results[r].count, (unsigned int)call.results[r].result);
+         }
+      }
+   }
+   StopDirectInput();
+}
+
+/**
+ * A game's force updates: a constant force every tick, the spring every
+ * 4th and a batch that also sets the gain every 16th. Returns how long
+ * the ticks took, leaving the recorder time to write between bursts.
+ */
+static double RunRecordWorkload(int iterations, int axisCount)
+{
+   // Ticks per burst, fewer records than fit in the recorder's ring.
+   static const int BURST_TICKS = 2048;
+   std::vector<LONG> directions(axisCount, 1);
+   std::vector<DICONDITION> conditions(axisCount);
+   ZeroMemory(&conditions[0], sizeof(DICONDITION) * axisCount);
+   FFBCommand commands[2];
+   ZeroMemory(commands, sizeof(commands));
+   commands[0].command = FFBCommands::Type::UpdateConstantForce;
+   commands[0].effectType = Effects::Type::ConstantForce;
+   commands[0].constantForce.directions[0] = 1;
+   commands[1].command = FFBCommands::Type::SetGain;
+   commands[1].effectType = Effects::Type::ConstantForce;
+
+   double totalNs = 0;
+   for (int burst = 0; burst < iterations; burst += BURST_TICKS)
+   {
+      int end = burst + BURST_TICKS < iterations ? burst + BURST_TICKS : iterations;
+      BenchClock::time_point start = BenchClock::now();
+      for (int i = burst; i < end; i++)
+      {
+         if (i % 16 == 0)
+         {
+            commands[0].constantForce.magnitude = (i % 2000) - 1000;
+            commands[1].gainPercent = (i % 100) / 100.0f;
+            SubmitFFBCommands(commands, 2, NULL);
+         }
+         else
+         {
+            UpdateConstantForce((i % 2000) - 1000, &directions[0]);
+         }
+         if (i % 4 == 0)
+         {
+            conditions[0].lPositiveCoefficient = i % DI_FFNOMINALMAX;
+            UpdateSpring(&conditions[0]);
+         }
+      }
+      totalNs += ElapsedNs(start);
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+   }
+   return totalNs;
+}
+
+/**
+ * Cost of recording the command stream on the calling thread, and a
+ * recording of the workload for ffb-replay.
+ */
+static void BenchRecord(const BenchOptions& options)
+{
+   int axisCount;
+   if (OpenSimulatedDevice(options, axisCount) && Check(AddFFBEffect(Effects::Type::ConstantForce), "AddFFBEffect")
+      && Check(AddFFBEffect(Effects::Type::Spring), "AddFFBEffect"))
+   {
+      StartAllFFBEffects();
+      Report("not recording (per tick)", RunRecordWorkload(options.iterations, axisCount), options.iterations);
+
+      if (Check(StartFFBRecording(options.recordPath.c_str()), "StartFFBRecording"))
+      {
+         Report("recording (per tick)", RunRecordWorkload(options.iterations, axisCount), options.iterations);
+         BenchClock::time_point start = BenchClock::now();
+         StopFFBRecording();
+         Report("StopFFBRecording", ElapsedNs(start), 1);
+
+         FFBRecorderStats stats;
+         GetFFBRecorderStats(&stats);
+         printf("%-32s %u records, %u dropped, %llu bytes to %s\n", "", stats.recordsWritten, stats.recordsDropped,
+            (unsigned long long)stats.bytesWritten, options.recordPath.c_str());
+      }
+   }
+   StopDirectInput();
+}
+
+static const double BENCH_PI = 3.14159265358979323846;
+
+/**
+ * Print a measured value next to its reference, counting it as failed
+ * when they differ by more than tolerance.
+ */
+static bool CheckAccuracy(const char* name, double measured, double reference, double tolerance, int& failures)
+{
+   bool ok = fabs(measured - reference) <= tolerance;
+   printf("%-32s %12.4f, reference %12.4f %s\n", name, measured, reference, ok ? "ok" : "FAILED");
+   failures += ok ? 0 : 1;
+   return ok;
+}
+
+/**
+ * Steady state gain of the chain for a sine at hz on axis 0, from the
+ * correlation of the output with the input over whole periods.
+ */
+static double MeasureGain(const ForceDspConfig& config, double hz, double sampleRateHz)
+{
+   ForceDsp dsp;
+   dsp.Configure(-1, &config);
+   const double amplitude = 1000.0;
+   const int settle = (int)sampleRateHz * 4;
+   const int measure = (int)sampleRateHz;
+   double sinSum = 0;
+   double cosSum = 0;
+   for (int n = 0; n < settle + measure; n++)
+   {
+      double phase = 2.0 * BENCH_PI * hz * n / sampleRateHz;
+      float input = (float)(amplitude * sin(phase));
+      float output;
+      dsp.Process(&input, 1, (float)sampleRateHz, &output);
+      if (n >= settle)
+      {
+         sinSum += output * sin(phase);
+         cosSum += output * cos(phase);
+      }
+   }
+   return 2.0 * sqrt(sinSum * sinSum + cosSum * cosSum) / measure / amplitude;
+}
+
+/**
+ * Magnitude of the analog prototype H(s) = 1 / (s^2 + s / Q + 1), or
+ * (s^2 + 1) / (s^2 + s / Q + 1) for a notch, at hz after the bilinear
+ * transform prewarped at cutoffHz.
+ */
+static double ReferenceGain(bool notch, double hz, double cutoffHz, double q, double sampleRateHz)
+{
+   double w = tan(BENCH_PI * hz / sampleRateHz) / tan(BENCH_PI * cutoffHz / sampleRateHz);
+   double real = 1.0 - w * w;
+   double imaginary = w / q;
+   return (notch ? fabs(real) : 1.0) / sqrt(real * real + imaginary * imaginary);
+}
+
+/**
+ * Per sample cost of the force DSP chain with every stage on, accuracy of
+ * each stage against its reference response, and the chain running on the
+ * output thread of a simulated wheel.
+ */
+static void BenchForceDsp(const BenchOptions& options)
+{
+   const double sampleRateHz = 1000.0;
+   ForceDspConfig config;
+   ZeroMemory(&config, sizeof(config));
+   int failures = 0;
+
+   config.lowPassHz = 30.0f;
+   const double lowPass[] = { 5.0, 20.0, 30.0, 60.0, 150.0 };
+   for (double hz : lowPass)
+   {
+      char name[64];
+      snprintf(name, sizeof(name), "low pass 30 Hz gain at %g Hz", hz);
+      CheckAccuracy(name, MeasureGain(config, hz, sampleRateHz), ReferenceGain(false, hz, 30.0, 0.70710678, sampleRateHz), 0.005, failures);
+   }
+
+   ZeroMemory(&config, sizeof(config));
+   config.notchHz = 50.0f;
+   config.notchQ = 2.0f;
+   const double notch[] = { 10.0, 40.0, 50.0, 60.0, 200.0 };
+   for (double hz : notch)
+   {
+      char name[64];
+      snprintf(name, sizeof(name), "notch 50 Hz gain at %g Hz", hz);
+      CheckAccuracy(name, MeasureGain(config, hz, sampleRateHz), ReferenceGain(true, hz, 50.0, 2.0, sampleRateHz), 0.005, failures);
+   }
+
+   // A full scale step limited to 20000 units/s moves 20 units a sample.
+   ZeroMemory(&config, sizeof(config));
+   config.slewRate = 20000.0f;
+   {
+      ForceDsp dsp;
+      dsp.Configure(-1, &config);
+      float step = (float)DI_FFNOMINALMAX;
+      float output = 0;
+      for (int n = 0; n < 250; n++)
+      {
+         dsp.Process(&step, 1, (float)sampleRateHz, &output);
+      }
+      CheckAccuracy("slew 20000/s after 250 samples", output, 5000.0, 0.01, failures);
+      for (int n = 250; n < 600; n++)
+      {
+         dsp.Process(&step, 1, (float)sampleRateHz, &output);
+      }
+      CheckAccuracy("slew 20000/s after 600 samples", output, DI_FFNOMINALMAX, 0.01, failures);
+   }
+
+   // Static curve: the input below the knee, across it and above it.
+   ZeroMemory(&config, sizeof(config));
+   config.compressorThreshold = 6000.0f;
+   config.compressorRatio = 4.0f;
+   config.kneeWidth = 2000.0f;
+   {
+      const double threshold = 6000.0;
+      const double ratio = 4.0;
+      const double knee = 2000.0;
+      const double levels[] = { 3000.0, 5500.0, 6000.0, 6800.0, 9000.0, -9000.0, 14000.0 };
+      ForceDsp dsp;
+      dsp.Configure(-1, &config);
+      for (double level : levels)
+      {
+         double magnitude = fabs(level);
+         double reference = magnitude;
+         if (magnitude > threshold + knee / 2)
+         {
+            reference = threshold + (magnitude - threshold) / ratio;
+         }
+         else if (magnitude > threshold - knee / 2)
+         {
+            double over = magnitude - threshold + knee / 2;
+            reference = magnitude + (1.0 / ratio - 1.0) * over * over / (2.0 * knee);
+         }
+         reference = level < 0 ? -reference : reference;
+         float input = (float)level;
+         float output;
+         dsp.Process(&input, 1, (float)sampleRateHz, &output);
+         char name[64];
+         snprintf(name, sizeof(name), "compressor 4:1 at %g", level);
+         CheckAccuracy(name, output, reference, 0.05, failures);
+      }
+   }
+
+   // A bypassed axis is only clipped, and each clipped sample is counted.
+   {
+      ForceDsp dsp;
+      float inputs[2] = { 15000.0f, -4000.0f };
+      float outputs[2];
+      for (int n = 0; n < 10; n++)
+      {
+         dsp.Process(inputs, 2, (float)sampleRateHz, outputs);
+      }
+      ForceDspState state;
+      dsp.GetState(state);
+      CheckAccuracy("clip 15000", outputs[0], DI_FFNOMINALMAX, 0, failures);
+      CheckAccuracy("clipped samples, axis 0", state.clippedSamples[0], 10, 0, failures);
+      CheckAccuracy("clipped samples, axis 1", state.clippedSamples[1], 0, 0, failures);
+   }
+   printf("%-32s %d failed\n", "accuracy", failures);
+
+   // Every stage on, on every lane the chain runs.
+   ZeroMemory(&config, sizeof(config));
+   config.lowPassHz = 40.0f;
+   config.notchHz = 12.0f;
+   config.compressorThreshold = 7000.0f;
+   config.compressorRatio = 3.0f;
+   config.kneeWidth = 1500.0f;
+   config.slewRate = 200000.0f;
+   {
+      ForceDsp dsp;
+      dsp.Configure(-1, &config);
+      int axisCount = options.device.axisCount < MAX_FFB_AXES ? options.device.axisCount : MAX_FFB_AXES;
+      float force[MAX_FFB_AXES] = { 0 };
+      float sum = 0;
+      BenchClock::time_point start = BenchClock::now();
+      for (int n = 0; n < options.iterations; n++)
+      {
+         for (int i = 0; i < axisCount; i++)
+         {
+            force[i] = (float)((n * 7919 + i * 104729) % 24000 - 12000);
+         }
+         dsp.Process(force, axisCount, (float)sampleRateHz, force);
+         sum += force[0];
+      }
+      double totalNs = ElapsedNs(start);
+      char name[64];
+      snprintf(name, sizeof(name), "Process, %d axes (per sample)", axisCount);
+      Report(name, totalNs, options.iterations);
+      if (sum == 12345.0f)
+      {
+         // Keeps the loop from being optimized away.
+         printf("\n");
+      }
+   }
+
+   // On the output thread: a full scale force slewed at 20000/s.
+   int axisCount;
+   if (OpenSimulatedDevice(options, axisCount) && Check(AddFFBEffect(Effects::Type::ConstantForce), "AddFFBEffect"))
+   {
+      ZeroMemory(&config, sizeof(config));
+      config.slewRate = 20000.0f;
+      std::vector<LONG> directions(axisCount, 0);
+      directions[0] = DI_FFNOMINALMAX;
+      if (Check(StartForceOutputThread(options.rateHz), "StartForceOutputThread")
+         && Check(ConfigureForceDsp(-1, &config), "ConfigureForceDsp"))
+      {
+         StartAllFFBEffects();
+         UpdateConstantForce(DI_FFNOMINALMAX, &directions[0]);
+         std::this_thread::sleep_for(std::chrono::milliseconds(200));
+         ForceDspState state;
+         GetForceDspState(&state);
+         StopForceOutputThread();
+         printf("%-32s %u samples at %.0f Hz, axis 0 %.0f -> %.0f\n", "output thread", state.samples,
+            state.sampleRateHz, state.input[0], state.output[0]);
+      }
+   }
+   DisableForceDsp();
+   StopDirectInput();
+}
+
+// Test force for the keyframe benchmark: two sines, in DirectInput units.
+static double KeyframeSignal(double seconds)
+{
+   return 6000.0 * sin(2.0 * BENCH_PI * 1.5 * seconds) + 2000.0 * sin(2.0 * BENCH_PI * 4.3 * seconds);
+}
+
+struct KeyframeRun {
+   double rmsError;
+   double maxError;
+   // Largest change of the force from one output sample to the next.
+   double maxStep;
+};
+
+/**
+ * Play KeyframeSignal as 60 Hz keyframes submitted 1 - 4 ms after their
+ * time, resampled at 1 kHz on a simulated clock, and compare the output
+ * with the signal at the time it stands for. A NULL config holds the
+ * newest keyframe, as UpdateConstantForce does. delayedFrom .. delayedTo
+ * are held back and submitted together 3 keyframes late.
+ */
+static KeyframeRun RunKeyframes(const FFBKeyframeConfig* config, int delayedFrom, int delayedTo)
+{
+   KeyframeResampler resampler;
+   FFBKeyframeConfig hold;
+   KeyframeResampler::DefaultConfig(hold);
+   resampler.Configure(config != NULL ? *config : hold);
+   resampler.Reset();
+
+   const int64_t origin = 1000000;
+   const int64_t intervalUs = 1000000 / 60;
+   const int64_t durationUs = 5000000;
+   int64_t offsetUs = 0;
+   if (config != NULL)
+   {
+      offsetUs = config->mode == FFBKeyframeModes::Type::Hermite ? -(int64_t)(config->delayMs * 1000) : (int64_t)(config->lookaheadMs * 1000);
+   }
+
+   KeyframeRun run = { 0, 0, 0 };
+   int next = 0;
+   int samples = 0;
+   float held = 0;
+   float previous = 0;
+   bool started = false;
+   uint32_t jitter = 12345;
+   for (int64_t now = origin; now < origin + durationUs; now += 1000)
+   {
+      // Keyframe n is due at origin + n * interval and submitted 1 - 4 ms later.
+      for (;;)
+      {
+         int64_t due = origin + next * intervalUs;
+         jitter = jitter * 1103515245 + 12345;
+         int64_t submitAt = due + 1000 + (int64_t)((jitter >> 16) % 3000);
+         if (next >= delayedFrom && next <= delayedTo)
+         {
+            submitAt = origin + (delayedTo + 3) * intervalUs;
+         }
+         if (submitAt > now)
+         {
+            break;
+         }
+         FFBForceKeyframe keyframe;
+         ZeroMemory(&keyframe, sizeof(keyframe));
+         keyframe.timeUs = due;
+         keyframe.force[0] = (float)KeyframeSignal((due - origin) * 1e-6);
+         resampler.Submit(keyframe, now);
+         held = keyframe.force[0];
+         next++;
+      }
+
+      float force = held;
+      if (config != NULL && !resampler.Sample(now, 1, &force))
+      {
+         continue;
+      }
+      // Skip the start, until the delayed output catches up with the signal.
+      if (now - origin < 100000)
+      {
+         previous = force;
+         continue;
+      }
+      double error = force - KeyframeSignal((now + offsetUs - origin) * 1e-6);
+      run.rmsError += error * error;
+      run.maxError = std::max(run.maxError, fabs(error));
+      if (started)
+      {
+         run.maxStep = std::max(run.maxStep, (double)fabsf(force - previous));
+      }
+      previous = force;
+      started = true;
+      samples++;
+   }
+   run.rmsError = sqrt(run.rmsError / (samples > 0 ? samples : 1));
+   return run;
+}
+
+/**
+ * How closely each keyframe mode follows a force submitted at 60 Hz, how
+ * smooth it is and how it copes with a late burst, what sampling costs,
+ * and the submit to apply latency on the output thread of a simulated
+ * wheel.
+ */
+static void BenchKeyframes(const BenchOptions& options)
+{
+   double maxSlope = 2.0 * BENCH_PI * (6000.0 * 1.5 + 2000.0 * 4.3);
+   printf("%-32s %10.1f (largest step of the signal itself at 1 kHz)\n", "signal", maxSlope / 1000.0);
+
+   FFBKeyframeConfig hermite;
+   KeyframeResampler::DefaultConfig(hermite);
+   FFBKeyframeConfig extrapolate = hermite;
+   extrapolate.mode = FFBKeyframeModes::Type::Extrapolate;
+
+   struct Mode {
+      const char* name;
+      const FFBKeyframeConfig* config;
+   };
+   const Mode modes[] = {
+      { "hold", NULL },
+      { "hermite 25 ms", &hermite },
+      { "extrapolate 1 ms", &extrapolate },
+   };
+   for (const Mode& mode : modes)
+   {
+      for (int late = 0; late < 2; late++)
+      {
+         KeyframeRun run = late ? RunKeyframes(mode.config, 120, 122) : RunKeyframes(mode.config, -1, -1);
+         char name[64];
+         snprintf(name, sizeof(name), "%s%s", mode.name, late ? ", late burst" : "");
+         printf("%-32s rms error %7.1f, max error %7.1f, max step %7.1f\n", name, run.rmsError, run.maxError, run.maxStep);
+      }
+   }
+
+   {
+      KeyframeResampler resampler;
+      resampler.Configure(hermite);
+      resampler.Reset();
+      int axisCount = options.device.axisCount < MAX_FFB_AXES ? options.device.axisCount : MAX_FFB_AXES;
+      FFBForceKeyframe keyframe;
+      ZeroMemory(&keyframe, sizeof(keyframe));
+      float force[MAX_FFB_AXES];
+      float sum = 0;
+      const int64_t origin = 1000000;
+      BenchClock::time_point start = BenchClock::now();
+      for (int n = 0; n < options.iterations; n++)
+      {
+         int64_t now = origin + n * 1000LL;
+         if (n % 16 == 0)
+         {
+            keyframe.timeUs = now;
+            for (int i = 0; i < axisCount; i++)
+            {
+               keyframe.force[i] = (float)((n * 7919 + i * 104729) % 20000 - 10000);
+            }
+            resampler.Submit(keyframe, now);
+         }
+         if (resampler.Sample(now, axisCount, force))
+         {
+            sum += force[0];
+         }
+      }
+      double totalNs = ElapsedNs(start);
+      char name[64];
+      snprintf(name, sizeof(name), "Sample, %d axes", axisCount);
+      Report(name, totalNs, options.iterations);
+      if (sum == 12345.0f)
+      {
+         // Keeps the loop from being optimized away.
+         printf("\n");
+      }
+   }
+
+   int axisCount;
+   if (OpenSimulatedDevice(options, axisCount) && Check(AddFFBEffect(Effects::Type::ConstantForce), "AddFFBEffect")
+      && Check(StartForceOutputThread(options.rateHz), "StartForceOutputThread")
+      && Check(EnableForceKeyframes(&hermite), "EnableForceKeyframes"))
+   {
+      StartAllFFBEffects();
+      BenchClock::time_point start = BenchClock::now();
+      BenchClock::time_point end = start + std::chrono::microseconds((int64_t)(options.seconds * 1000000));
+      FFBForceKeyframe keyframe;
+      ZeroMemory(&keyframe, sizeof(keyframe));
+      int64_t origin = GetFFBClockMicroseconds();
+      for (BenchClock::time_point frame = start; frame < end; frame += std::chrono::microseconds(1000000 / 60))
+      {
+         std::this_thread::sleep_until(frame);
+         keyframe.timeUs = GetFFBClockMicroseconds();
+         keyframe.force[0] = (float)KeyframeSignal((keyframe.timeUs - origin) * 1e-6);
+         SubmitForceKeyframes(&keyframe, 1);
+      }
+      StopForceOutputThread();
+
+      FFBKeyframeStats stats;
+      GetForceKeyframeStats(&stats);
+      printf("%-32s %u submitted, %u dropped, %u late, %u underruns\n", "output thread", stats.submitted,
+         stats.dropped, stats.late, stats.underruns);
+      printf("%-32s latency mean %.1f us, max %.1f us, lead mean %.1f us, min %.1f us\n", "", stats.meanLatencyMicroseconds,
+         stats.maxLatencyMicroseconds, stats.meanLeadMicroseconds, stats.minLeadMicroseconds);
+   }
+   DisableForceKeyframes();
+   StopDirectInput();
+}
+
+/**
+ * Mix ticks times at 1 kHz, the force of the last tick is left in force.
+ */
+static void MixTicks(ForceMixer& mixer, int64_t& nowUs, int ticks, int axisCount, float* force)
+{
+   for (int n = 0; n < ticks; n++)
+   {
+      nowUs += 1000;
+      for (int i = 0; i < axisCount; i++)
+      {
+         force[i] = 0;
+      }
+      mixer.Mix(nowUs, axisCount, force);
+   }
+}
+
+static FFBForceLayerConfig LayerConfig(float gainPercent, int priority, float duckPercent)
+{
+   FFBForceLayerConfig config;
+   ZeroMemory(&config, sizeof(config));
+   config.gainPercent = gainPercent;
+   config.priority = priority;
+   config.duckPercent = duckPercent;
+   return config;
+}
+
+/**
+ * Check the envelope, ducking, headroom and saturation of the force mixer
+ * against their closed form, time Mix for 1 to 64 layers, then mix two
+ * layers on the output thread.
+ */
+static void BenchForceMixer(const BenchOptions& options)
+{
+   int failures = 0;
+   float force[MAX_FFB_AXES] = { 0 };
+   FFBForceLayerState layerState;
+
+   // Gain, then an envelope rising over 20 ms, held 50 ms after the update
+   // and falling over 100 ms.
+   {
+      ForceMixer mixer;
+      int64_t now = 0;
+      FFBForceLayerHandle layer;
+      FFBForceLayerConfig config = LayerConfig(50, 0, 0);
+      mixer.CreateLayer("gain", config, &layer);
+      float value = 8000.0f;
+      mixer.UpdateLayer(layer, &value, 1);
+      MixTicks(mixer, now, 1, 1, force);
+      CheckAccuracy("gain 50%", force[0], 4000.0, 0.01, failures);
+
+      config = LayerConfig(100, 0, 0);
+      config.attackMs = 20.0f;
+      config.lifetimeMs = 50.0f;
+      config.decayMs = 100.0f;
+      FFBForceLayerHandle envelope;
+      mixer.DestroyLayer(layer);
+      mixer.CreateLayer("envelope", config, &envelope);
+      MixTicks(mixer, now, 5, 1, force);
+      CheckAccuracy("new layer is silent", force[0], 0.0, 0, failures);
+      mixer.UpdateLayer(envelope, &value, 1);
+      MixTicks(mixer, now, 10, 1, force);
+      CheckAccuracy("attack 20 ms after 10 ms", force[0], 4000.0, 1.0, failures);
+      MixTicks(mixer, now, 40, 1, force);
+      CheckAccuracy("held 50 ms", force[0], 8000.0, 1.0, failures);
+      // Updated on the first of the 50 ticks, so the hold ends with them.
+      MixTicks(mixer, now, 10, 1, force);
+      CheckAccuracy("decay 100 ms after 10 ms", force[0], 7200.0, 1.0, failures);
+      MixTicks(mixer, now, 100, 1, force);
+      CheckAccuracy("decayed", force[0], 0.0, 0, failures);
+   }
+
+   // A layer at half force ducking 50% lowers the one below it by 25%, and
+   // lets it recover once it is silent.
+   {
+      ForceMixer mixer;
+      int64_t now = 0;
+      FFBForceLayerHandle impulse, texture;
+      mixer.CreateLayer("impulse", LayerConfig(100, 10, 50), &impulse);
+      mixer.CreateLayer("texture", LayerConfig(100, 0, 0), &texture);
+      float value = 5000.0f;
+      mixer.UpdateLayer(impulse, &value, 1);
+      value = 4000.0f;
+      mixer.UpdateLayer(texture, &value, 1);
+      MixTicks(mixer, now, 200, 1, force);
+      mixer.GetLayerState(texture, layerState);
+      CheckAccuracy("ducked layer", layerState.output[0], 3000.0, 1.0, failures);
+      CheckAccuracy("ducked mix", force[0], 8000.0, 1.0, failures);
+      value = 0.0f;
+      mixer.UpdateLayer(impulse, &value, 1);
+      MixTicks(mixer, now, 1500, 1, force);
+      mixer.GetLayerState(texture, layerState);
+      CheckAccuracy("recovered layer", layerState.output[0], 4000.0, 1.0, failures);
+   }
+
+   // 10% headroom: the lower layer gets what is left under 9000, a single
+   // layer beyond it saturates along tanh.
+   {
+      ForceMixer mixer;
+      int64_t now = 0;
+      FFBForceLayerHandle high, low;
+      mixer.CreateLayer("high", LayerConfig(100, 1, 0), &high);
+      mixer.CreateLayer("low", LayerConfig(100, 0, 0), &low);
+      float highForce[2] = { 7000.0f, 0.0f };
+      float lowForce[2] = { 5000.0f, -3000.0f };
+      mixer.UpdateLayer(high, highForce, 2);
+      mixer.UpdateLayer(low, lowForce, 2);
+      MixTicks(mixer, now, 2, 2, force);
+      mixer.GetLayerState(low, layerState);
+      CheckAccuracy("headroom mix axis 0", force[0], 9000.0, 0.01, failures);
+      CheckAccuracy("squeezed layer keeps direction", force[1], -1200.0, 0.01, failures);
+      CheckAccuracy("squeezed layer gain", layerState.headroomGain, 0.4, 0.0001, failures);
+      lowForce[0] = -6000.0f;
+      mixer.UpdateLayer(low, lowForce, 2);
+      MixTicks(mixer, now, 1, 2, force);
+      CheckAccuracy("opposing layer fits", force[0], 1000.0, 0.01, failures);
+      highForce[0] = 12000.0f;
+      lowForce[0] = 0.0f;
+      lowForce[1] = 0.0f;
+      mixer.UpdateLayer(high, highForce, 2);
+      mixer.UpdateLayer(low, lowForce, 2);
+      MixTicks(mixer, now, 1, 2, force);
+      CheckAccuracy("saturated 12000", force[0], 9000.0 + 1000.0 * tanh(3.0), 0.05, failures);
+      FFBForceMixerState mixerState;
+      mixer.GetState(mixerState);
+      CheckAccuracy("squeezed ticks", mixerState.squeezedTicks, 2, 0, failures);
+      CheckAccuracy("saturated ticks", mixerState.saturatedTicks, 1, 0, failures);
+   }
+   printf("%-32s %d failed\n", "accuracy", failures);
+
+   // Layers spread over four priorities, ducking and with envelopes, each
+   // updated every 10 ticks the way physics would.
+   int axisCount = options.device.axisCount < MAX_FFB_AXES ? options.device.axisCount : MAX_FFB_AXES;
+   for (int layerCount = 1; layerCount <= FFB_MAX_FORCE_LAYERS; layerCount *= 2)
+   {
+      ForceMixer mixer;
+      std::vector<FFBForceLayerHandle> layers(layerCount);
+      for (int l = 0; l < layerCount; l++)
+      {
+         char name[FFB_FORCE_LAYER_NAME];
+         snprintf(name, sizeof(name), "layer %d", l);
+         FFBForceLayerConfig config = LayerConfig(80, l % 4, 20);
+         config.attackMs = 5.0f;
+         config.lifetimeMs = 30.0f;
+         config.decayMs = 50.0f;
+         mixer.CreateLayer(name, config, &layers[l]);
+      }
+      int64_t now = 0;
+      float sum = 0;
+      double mixNs = 0;
+      int ticks = options.iterations / 10 > 1000 ? options.iterations / 10 : 1000;
+      for (int n = 0; n < ticks; n++)
+      {
+         if (n % 10 == 0)
+         {
+            for (int l = 0; l < layerCount; l++)
+            {
+               float value[MAX_FFB_AXES];
+               for (int i = 0; i < MAX_FFB_AXES; i++)
+               {
+                  value[i] = (float)((n * 7919 + l * 104729 + i * 31) % 12000 - 6000);
+               }
+               mixer.UpdateLayer(layers[l], value, axisCount);
+            }
+         }
+         now += 1000;
+         for (int i = 0; i < axisCount; i++)
+         {
+            force[i] = 0;
+         }
+         BenchClock::time_point start = BenchClock::now();
+         mixer.Mix(now, axisCount, force);
+         mixNs += ElapsedNs(start);
+         sum += force[0];
+      }
+      char name[64];
+      snprintf(name, sizeof(name), "Mix, %d layers, %d axes", layerCount, axisCount);
+      Report(name, mixNs, ticks);
+      if (sum == 12345.0f)
+      {
+         // Keeps the loop from being optimized away.
+         printf("\n");
+      }
+   }
+
+   // On the output thread: a steady layer ducked by an impulse.
+   if (OpenSimulatedDevice(options, axisCount) && Check(AddFFBEffect(Effects::Type::ConstantForce), "AddFFBEffect"))
+   {
+      FFBForceLayerConfig impulseConfig = LayerConfig(100, 10, 100);
+      impulseConfig.lifetimeMs = 50.0f;
+      impulseConfig.decayMs = 50.0f;
+      FFBForceLayerConfig aligningConfig = LayerConfig(100, 0, 0);
+      FFBForceLayerHandle aligning, impulse;
+      std::vector<float> value(axisCount, 0.0f);
+      if (Check(StartForceOutputThread(options.rateHz), "StartForceOutputThread")
+         && Check(CreateForceLayer("aligning", &aligningConfig, &aligning), "CreateForceLayer")
+         && Check(CreateForceLayer("impulse", &impulseConfig, &impulse), "CreateForceLayer"))
+      {
+         StartAllFFBEffects();
+         value[0] = 3000.0f;
+         UpdateForceLayer(aligning, &value[0]);
+         std::this_thread::sleep_for(std::chrono::milliseconds(50));
+         SimulatedDeviceState before;
+         GetSimulatedDeviceState(0, &before);
+         value[0] = -5000.0f;
+         UpdateForceLayer(impulse, &value[0]);
+         std::this_thread::sleep_for(std::chrono::milliseconds(30));
+         SimulatedDeviceState during;
+         GetSimulatedDeviceState(0, &during);
+         std::this_thread::sleep_for(std::chrono::milliseconds(400));
+         SimulatedDeviceState after;
+         GetSimulatedDeviceState(0, &after);
+         FFBForceMixerState mixerState;
+         GetForceMixerState(&mixerState);
+         StopForceOutputThread();
+         printf("%-32s %u ticks, force %d, %d during the impulse, %d after\n", "output thread", mixerState.ticks,
+            before.outputForce[0], during.outputForce[0], after.outputForce[0]);
+      }
+   }
+   StopDirectInput();
+}
+
+/**
+ * Closed form of the force a periodic effect produces elapsedUs after it
+ * started: the shape at its phase, scaled by the envelope, plus the offset.
+ */
+static double ReferencePeriodic(Effects::Type type, const FFBPeriodicEffect& effect, double elapsedUs)
+{
+   const DIPERIODIC& wave = effect.periodic;
+   const DIENVELOPE& envelope = effect.envelope;
+   if (elapsedUs >= effect.duration)
+   {
+      return 0.0;
+   }
+   double cycles = elapsedUs / wave.dwPeriod + wave.dwPhase / 36000.0;
+   double p = cycles - floor(cycles);
+   double value;
+   switch (type)
+   {
+   case Effects::Type::Square:
+      value = p < 0.5 ? 1.0 : -1.0;
+      break;
+   case Effects::Type::Sine:
+      value = sin(2.0 * BENCH_PI * p);
+      break;
+   case Effects::Type::Triangle:
+      value = p < 0.25 ? 4.0 * p : (p < 0.75 ? 2.0 - 4.0 * p : 4.0 * p - 4.0);
+      break;
+   case Effects::Type::SawtoothUp:
+      value = 2.0 * p - 1.0;
+      break;
+   default:
+      value = 1.0 - 2.0 * p;
+      break;
+   }
+   double magnitude = wave.dwMagnitude;
+   double fadeStart = (double)effect.duration - envelope.dwFadeTime;
+   if (elapsedUs < envelope.dwAttackTime)
+   {
+      magnitude = envelope.dwAttackLevel + (magnitude - envelope.dwAttackLevel) * elapsedUs / envelope.dwAttackTime;
+   }
+   else if (elapsedUs > fadeStart)
+   {
+      magnitude += (envelope.dwFadeLevel - magnitude) * (elapsedUs - fadeStart) / envelope.dwFadeTime;
+   }
+   return wave.lOffset + magnitude * value;
+}
+
+/**
+ * Every periodic shape with an attack, a fade and a finite duration, as
+ * the simulated wheel plays it against its closed form, and what repeated
+ * periodic updates send to the device: nothing when they repeat, only the
+ * changed field when one changes.
+ */
+static void BenchPeriodic(const BenchOptions& options)
+{
+   static const Effects::Type shapes[] = {
+      Effects::Type::Square, Effects::Type::Sine, Effects::Type::Triangle,
+      Effects::Type::SawtoothUp, Effects::Type::SawtoothDown
+   };
+   static const char* shapeNames[] = { "square", "sine", "triangle", "sawtooth up", "sawtooth down" };
+
+   FFBPeriodicEffect effect;
+   ZeroMemory(&effect, sizeof(effect));
+   effect.periodic.dwMagnitude = 6000;
+   effect.periodic.lOffset = 1000;
+   effect.periodic.dwPhase = 9000;
+   effect.periodic.dwPeriod = 20000;
+   effect.envelope.dwAttackLevel = 0;
+   effect.envelope.dwAttackTime = 30000;
+   effect.envelope.dwFadeLevel = 2000;
+   effect.envelope.dwFadeTime = 40000;
+   effect.duration = 200000;
+
+   int failures = 0;
+   int axisCount;
+   if (OpenSimulatedDevice(options, axisCount))
+   {
+      std::vector<LONG> directions(axisCount, 0);
+      directions[0] = 1;
+      for (int s = 0; s < (int)(sizeof(shapes) / sizeof(shapes[0])); s++)
+      {
+         if (!Check(AddFFBEffect(shapes[s]), "AddFFBEffect")
+            || !Check(UpdatePeriodic(shapes[s], &effect, &directions[0]), "UpdatePeriodic"))
+         {
+            failures++;
+            continue;
+         }
+         // Sampled off the edges of the square wave, past the end of the
+         // effect.
+         double maxError = 0;
+         for (DWORD elapsedUs = 137; elapsedUs < effect.duration + 20000; elapsedUs += 250)
+         {
+            LONG force[MAX_FFB_AXES];
+            RenderSimulatedDeviceForce(0, elapsedUs, force);
+            double error = fabs(force[0] - ReferencePeriodic(shapes[s], effect, elapsedUs));
+            maxError = error > maxError ? error : maxError;
+         }
+         char name[64];
+         snprintf(name, sizeof(name), "%s max error", shapeNames[s]);
+         CheckAccuracy(name, maxError, 0.0, 1.0, failures);
+         RemoveFFBEffect(shapes[s]);
+      }
+
+      if (Check(AddFFBEffect(Effects::Type::Sine), "AddFFBEffect"))
+      {
+         ResetFFBUpdateCounters();
+         BenchClock::time_point start = BenchClock::now();
+         for (int i = 0; i < options.iterations; i++)
+         {
+            UpdatePeriodic(Effects::Type::Sine, &effect, &directions[0]);
+         }
+         Report("UpdatePeriodic (unchanged)", ElapsedNs(start), options.iterations);
+         FFBUpdateCounters counters;
+         GetFFBUpdateCounters(&counters);
+         printf("%-32s %u received, %u forwarded, %u parameter bytes\n", "unchanged updates",
+            counters.callsReceived, counters.callsForwarded, counters.parameterBytesSent);
+
+         ResetFFBUpdateCounters();
+         start = BenchClock::now();
+         for (int i = 0; i < options.iterations; i++)
+         {
+            effect.periodic.dwMagnitude = 4000 + (i % 2) * 2000;
+            UpdatePeriodic(Effects::Type::Sine, &effect, &directions[0]);
+         }
+         Report("UpdatePeriodic (magnitude)", ElapsedNs(start), options.iterations);
+         GetFFBUpdateCounters(&counters);
+         printf("%-32s %u forwarded, %.1f parameter bytes per update\n", "magnitude updates",
+            counters.callsForwarded, counters.callsForwarded > 0 ? (double)counters.parameterBytesSent / counters.callsForwarded : 0.0);
+      }
+   }
+   else
+   {
+      failures++;
+   }
+   StopDirectInput();
+   printf("%-32s %d failed\n", "accuracy", failures);
+}
+
+/**
+ * Custom force chunks on a wheel that takes --sample-rate to receive the
+ * samples: the upload time of each chunk size and the sample rate that
+ * sustains, whether the wheel plays back the samples it was sent, and a
+ * double-buffered stream on the force output thread for --seconds.
+ */
+static void BenchCustomForce(const BenchOptions& options)
+{
+   static const DWORD chunkSizes[] = { 16, 64, 256, 1024 };
+   const DWORD samplePeriod = 1000;
+   const int uploads = std::min(options.iterations, 200);
+
+   BenchOptions wheel = options;
+   wheel.device.sampleBytesPerMillisecond = options.sampleBytesPerMillisecond;
+   int failures = 0;
+   int axisCount;
+   FFBEffectHandle effect = 0;
+   if (!OpenSimulatedDevice(wheel, axisCount) || !Check(CreateFFBEffect(Effects::Type::CustomForce, &effect), "CreateFFBEffect"))
+   {
+      StopDirectInput();
+      printf("%-32s %d failed\n", "accuracy", 1);
+      return;
+   }
+   std::vector<LONG> directions(axisCount, 0);
+   directions[0] = 1;
+
+   std::vector<LONG> samples(chunkSizes[3]);
+   for (size_t i = 0; i < samples.size(); i++)
+   {
+      samples[i] = (LONG)(8000.0 * sin(2.0 * BENCH_PI * i / 64.0));
+   }
+   for (DWORD chunkSize : chunkSizes)
+   {
+      // A fresh effect for each size, so the stats are its own.
+      DestroyFFBEffect(effect);
+      CreateFFBEffect(Effects::Type::CustomForce, &effect);
+      FFBCustomForce chunk = { &samples[0], 1, chunkSize, samplePeriod, 0 };
+      for (int i = 0; i < uploads; i++)
+      {
+         if (FAILED(UpdateFFBEffectCustomForce(effect, &chunk, &directions[0])))
+         {
+            failures++;
+            break;
+         }
+      }
+      FFBCustomForceStats stats;
+      GetFFBCustomForceStats(effect, &stats);
+      char name[64];
+      snprintf(name, sizeof(name), "upload %u samples", chunkSize);
+      double sustained = stats.meanUploadMicroseconds > 0 ? chunkSize * 1000000.0 / stats.meanUploadMicroseconds : 0.0;
+      printf("%-32s %8.1f us mean %8.1f us max, %10.0f samples/s sustained\n", name,
+         stats.meanUploadMicroseconds, stats.maxUploadMicroseconds, sustained);
+   }
+
+   // Played back sample by sample, repeating, then once for a duration.
+   FFBCustomForce chunk = { &samples[0], 1, 64, samplePeriod, 0 };
+   double maxError = 0;
+   if (Check(UpdateFFBEffectCustomForce(effect, &chunk, &directions[0]), "UpdateFFBEffectCustomForce"))
+   {
+      for (DWORD elapsedUs = 137; elapsedUs < 3 * 64 * samplePeriod; elapsedUs += 250)
+      {
+         LONG force[MAX_FFB_AXES];
+         RenderSimulatedDeviceForce(0, elapsedUs, force);
+         double error = fabs((double)force[0] - samples[(elapsedUs / samplePeriod) % 64]);
+         maxError = error > maxError ? error : maxError;
+      }
+   }
+   CheckAccuracy("looped samples max error", maxError, 0.0, 0.5, failures);
+   chunk.duration = 32 * samplePeriod;
+   maxError = 0;
+   if (Check(UpdateFFBEffectCustomForce(effect, &chunk, &directions[0]), "UpdateFFBEffectCustomForce"))
+   {
+      for (DWORD elapsedUs = 137; elapsedUs < 64 * samplePeriod; elapsedUs += 250)
+      {
+         LONG force[MAX_FFB_AXES];
+         RenderSimulatedDeviceForce(0, elapsedUs, force);
+         double expected = elapsedUs < chunk.duration ? samples[elapsedUs / samplePeriod] : 0.0;
+         double error = fabs((double)force[0] - expected);
+         maxError = error > maxError ? error : maxError;
+      }
+   }
+   CheckAccuracy("timed samples max error", maxError, 0.0, 0.5, failures);
+
+   // Fill one buffer while the other plays.
+   DestroyFFBEffect(effect);
+   if (Check(CreateFFBEffect(Effects::Type::CustomForce, &effect), "CreateFFBEffect")
+      && Check(StartForceOutputThread(options.rateHz), "StartForceOutputThread"))
+   {
+      const DWORD streamChunk = 64;
+      std::vector<LONG> buffers[2] = { std::vector<LONG>(streamChunk), std::vector<LONG>(streamChunk) };
+      DWORD position = 0;
+      int current = 0;
+      uint64_t allocations = s_nAllocations.load();
+      BenchClock::time_point start = BenchClock::now();
+      BenchClock::time_point end = start + std::chrono::microseconds((int64_t)(options.seconds * 1000000.0));
+      while (BenchClock::now() < end)
+      {
+         std::vector<LONG>& buffer = buffers[current];
+         for (DWORD i = 0; i < streamChunk; i++, position++)
+         {
+            buffer[i] = (LONG)(8000.0 * sin(2.0 * BENCH_PI * position / 100.0));
+         }
+         FFBCustomForce next = { &buffer[0], 1, streamChunk, samplePeriod, 0 };
+         HRESULT hr;
+         while ((hr = UpdateFFBEffectCustomForce(effect, &next, &directions[0])) == E_PENDING)
+         {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+         }
+         if (FAILED(hr))
+         {
+            failures++;
+            break;
+         }
+         // Accepted, so the chunk before it was uploaded and its buffer is
+         // free.
+         current ^= 1;
+      }
+      StopForceOutputThread();
+      double seconds = ElapsedNs(start) / 1e9;
+      uint64_t streamAllocations = s_nAllocations.load() - allocations;
+
+      FFBCustomForceStats stats;
+      GetFFBCustomForceStats(effect, &stats);
+      printf("%-32s %u chunks, %u uploaded, %u underruns, %.0f samples/s\n", "double-buffered stream",
+         stats.chunksSubmitted, stats.chunksUploaded, stats.underruns, stats.samplesUploaded / seconds);
+      printf("%-32s %8.1f us mean %8.1f us max upload, %.2f allocations per chunk\n", "",
+         stats.meanUploadMicroseconds, stats.maxUploadMicroseconds,
+         stats.chunksSubmitted > 0 ? (double)streamAllocations / stats.chunksSubmitted : 0.0);
+      if (stats.chunksUploaded != stats.chunksSubmitted || stats.pendingChunks != 0)
+      {
+         failures++;
+      }
+   }
+   else
+   {
+      failures++;
+   }
+   StopDirectInput();
+   printf("%-32s %d failed\n", "accuracy", failures);
+}
+
+/**
+ * Take the records published since the last read out of the ring in place,
+ * the way the game reads it every frame.
+ */
+static void ReadInputRing(const FFBInputRing& ring, std::vector<FFBInputRecord>& records)
+{
+   uint32_t read = *ring.readIndex;
+   uint32_t write = *ring.writeIndex;
+   std::atomic_thread_fence(std::memory_order_acquire);
+   for (; read != write; read++)
+   {
+      records.push_back(ring.records[read & (ring.capacity - 1)]);
+   }
+   std::atomic_thread_fence(std::memory_order_release);
+   *ring.readIndex = read;
+}
+
+static bool WaitForInputRecord(const FFBInputRing& ring, std::vector<FFBInputRecord>& records, int timeoutMs)
+{
+   BenchClock::time_point end = BenchClock::now() + std::chrono::milliseconds(timeoutMs);
+   while (records.empty() && BenchClock::now() < end)
+   {
+      ReadInputRing(ring, records);
+      std::this_thread::yield();
+   }
+   return !records.empty();
+}
+
+static const char* InputModeName(FFBInputModes::Type mode)
+{
+   return mode == FFBInputModes::Type::Buffered ? "buffered" : "polled";
+}
+
+/**
+ * Input capture: how long after a wheel or button change the game reads its
+ * record from the ring, and that records arrive in order, with the right
+ * values and drops counted when the ring or the device buffer overflows.
+ */
+static void BenchInput(const BenchOptions& options)
+{
+   static const FFBInputModes::Type modes[] = { FFBInputModes::Type::Buffered, FFBInputModes::Type::Polled };
+   const int changes = std::min(options.iterations, 500);
+   int failures = 0;
+   std::vector<FFBInputRecord> records;
+   records.reserve(FFB_INPUT_RING_CAPACITY);
+
+   for (FFBInputModes::Type mode : modes)
+   {
+      int axisCount;
+      FFBInputCaptureConfig config = { mode, options.rateHz, 256 };
+      FFBInputRing ring;
+      if (!OpenSimulatedDevice(options, axisCount) || !Check(StartFFBInputCapture(&config), "StartFFBInputCapture")
+         || !Check(GetFFBInputRing(&ring), "GetFFBInputRing"))
+      {
+         failures++;
+         StopDirectInput();
+         continue;
+      }
+      // The first poll only takes the state to compare against.
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      records.clear();
+      ReadInputRing(ring, records);
+
+      double latencySumUs = 0;
+      double latencyMaxUs = 0;
+      double stampErrorSumUs = 0;
+      int received = 0;
+      int wrong = 0;
+      uint32_t lastSequence = 0;
+      for (int i = 0; i < changes; i++)
+      {
+         bool button = i % 4 == 3;
+         LONG value = button ? ((i / 4) % 2 == 0 ? 1 : 0) : 1000 + (i % 64) * 500;
+         int64_t changedUs = GetFFBClockMicroseconds();
+         if (button)
+         {
+            SetSimulatedButton(0, 5, value != 0);
+         }
+         else
+         {
+            SetSimulatedAxisPosition(0, 0, value);
+         }
+         records.clear();
+         if (!WaitForInputRecord(ring, records, 200))
+         {
+            wrong++;
+            continue;
+         }
+         double latencyUs = (double)(GetFFBClockMicroseconds() - changedUs);
+         const FFBInputRecord& record = records[0];
+         FFBInputKinds::Type kind = button ? FFBInputKinds::Type::Button : FFBInputKinds::Type::Axis;
+         if (records.size() != 1 || record.kind != kind || record.index != (button ? 5 : 0) || record.value != value
+            || (received > 0 && record.sequence != lastSequence + 1))
+         {
+            wrong++;
+         }
+         lastSequence = record.sequence;
+         received++;
+         latencySumUs += latencyUs;
+         latencyMaxUs = latencyUs > latencyMaxUs ? latencyUs : latencyMaxUs;
+         stampErrorSumUs += fabs((double)(record.timeUs - changedUs));
+      }
+      FFBInputCaptureStats stats;
+      GetFFBInputCaptureStats(&stats);
+      StopFFBInputCapture();
+      char name[64];
+      snprintf(name, sizeof(name), "%s input to game", InputModeName(mode));
+      printf("%-32s %8.1f us mean %8.1f us max, %d/%d changes, %d wrong\n", name,
+         received > 0 ? latencySumUs / received : 0.0, latencyMaxUs, received, changes, wrong);
+      printf("%-32s %8.1f us stamp error, %8.1f us mean %8.1f us max capture, %u reads\n", "",
+         received > 0 ? stampErrorSumUs / received : 0.0, stats.meanCaptureDelayMicroseconds,
+         stats.maxCaptureDelayMicroseconds, stats.reads);
+      if (wrong > 0 || stats.mode != mode || stats.droppedRecords != 0)
+      {
+         failures++;
+      }
+      StopDirectInput();
+   }
+
+   // A reader that stops reading loses the newest changes, counted.
+   int axisCount;
+   FFBInputCaptureConfig config = { FFBInputModes::Type::Buffered, options.rateHz, 65536 };
+   FFBInputRing ring;
+   if (OpenSimulatedDevice(options, axisCount) && Check(StartFFBInputCapture(&config), "StartFFBInputCapture")
+      && Check(GetFFBInputRing(&ring), "GetFFBInputRing"))
+   {
+      records.clear();
+      ReadInputRing(ring, records);
+      FFBInputCaptureStats before;
+      GetFFBInputCaptureStats(&before);
+      const int produced = FFB_INPUT_RING_CAPACITY + 1000;
+      for (int i = 0; i < produced; i++)
+      {
+         SetSimulatedButton(0, 0, i % 2 == 0);
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      FFBInputCaptureStats stats;
+      GetFFBInputCaptureStats(&stats);
+      records.clear();
+      ReadInputRing(ring, records);
+      bool ordered = true;
+      for (size_t i = 1; i < records.size(); i++)
+      {
+         ordered = ordered && records[i].sequence == records[i - 1].sequence + 1;
+      }
+      printf("%-32s %d changes, %u read, %u dropped\n", "stalled reader", produced, (uint32_t)records.size(), stats.droppedRecords);
+      if (records.size() != FFB_INPUT_RING_CAPACITY || stats.droppedRecords != (DWORD)(produced - FFB_INPUT_RING_CAPACITY) || !ordered)
+      {
+         failures++;
+      }
+
+      // A device buffer too small for the rate loses changes before they
+      // are read.
+      config.rateHz = 10;
+      config.bufferSize = 16;
+      StartFFBInputCapture(&config);
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      for (int i = 0; i < 100; i++)
+      {
+         SetSimulatedButton(0, 1, i % 2 == 0);
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(250));
+      GetFFBInputCaptureStats(&stats);
+      records.clear();
+      ReadInputRing(ring, records);
+      printf("%-32s %d changes, %u read, %u overflows\n", "small device buffer", 100, (uint32_t)records.size(), stats.deviceOverflows);
+      if (stats.deviceOverflows == 0 || records.size() > 16)
+      {
+         failures++;
+      }
+      StopFFBInputCapture();
+   }
+   else
+   {
+      failures++;
+   }
+   StopDirectInput();
+   printf("%-32s %d failed\n", "accuracy", failures);
+}
+
+/**
+ * Wait until the simulated wheel's first axis outputs force, the time it
+ * took in microseconds or -1 on timeout.
+ */
+static double WaitForDeviceForce(LONG force, int timeoutMs)
+{
+   BenchClock::time_point start = BenchClock::now();
+   BenchClock::time_point end = start + std::chrono::milliseconds(timeoutMs);
+   SimulatedDeviceState state;
+   while (BenchClock::now() < end)
+   {
+      if (SUCCEEDED(GetSimulatedDeviceState(0, &state)) && labs(state.outputForce[0] - force) <= 1)
+      {
+         return ElapsedNs(start) / 1000.0;
+      }
+      std::this_thread::yield();
+   }
+   return -1;
+}
+
+static const char* BridgeStateName(FFBBridgeStates::Type state)
+{
+   switch (state)
+   {
+   case FFBBridgeStates::Type::Detached: return "detached";
+   case FFBBridgeStates::Type::Waiting: return "waiting";
+   case FFBBridgeStates::Type::Live: return "live";
+   case FFBBridgeStates::Type::Stale: return "stale";
+   }
+   return "?";
+}
+
+/**
+ * The force bridge, with this process standing in for the writer: how long
+ * a frame takes from shared memory to the wheel, what a writer at 1 kHz
+ * gets through, and how fast the game's force takes over when the writer
+ * stops and the bridge takes over again when it restarts.
+ */
+static void BenchBridge(const BenchOptions& options)
+{
+   static const char* name = "ffb-bench-bridge";
+   FFBBridgeConfig config = { 50, 20 };
+   const LONG gameForce = 1234;
+   int failures = 0;
+   int axisCount;
+   std::vector<LONG> directions;
+   SharedMemory region;
+   if (!OpenSimulatedDevice(options, axisCount) || !Check(AddFFBEffect(Effects::Type::ConstantForce), "AddFFBEffect")
+      || !Check(StartForceOutputThread(options.rateHz), "StartForceOutputThread")
+      || !Check(AttachFFBBridge(name, &config), "AttachFFBBridge"))
+   {
+      StopDirectInput();
+      printf("%-32s %d failed\n", "accuracy", 1);
+      return;
+   }
+   StartAllFFBEffects();
+   directions.assign(axisCount, 0);
+   directions[0] = 1;
+   UpdateConstantForce(gameForce, &directions[0]);
+   // No region yet, the game's force holds.
+   FFBBridgeStats stats;
+   std::this_thread::sleep_for(std::chrono::milliseconds(30));
+   GetFFBBridgeStats(&stats);
+   if (stats.state != FFBBridgeStates::Type::Waiting || WaitForDeviceForce(gameForce, 200) < 0)
+   {
+      failures++;
+   }
+
+   FFBBridgeLayout* layout = NULL;
+   if (region.Create(name, sizeof(FFBBridgeLayout)))
+   {
+      layout = (FFBBridgeLayout*)region.Data();
+      InitBridge(layout);
+   }
+   else
+   {
+      failures++;
+   }
+
+   // Shared memory to wheel, one frame at a time.
+   double latencySumUs = 0;
+   double latencyMaxUs = 0;
+   int applied = 0;
+   const int steps = std::min(options.iterations, 200);
+   for (int i = 0; layout != NULL && i < steps; i++)
+   {
+      FFBBridgeFrame frame;
+      ZeroMemory(&frame, sizeof(frame));
+      frame.force[0] = (float)(-5000 + (i % 100) * 100 + 1);
+      WriteBridgeFrame(layout, frame);
+      double latencyUs = WaitForDeviceForce((LONG)frame.force[0], (int)config.staleMs / 2);
+      if (latencyUs >= 0)
+      {
+         applied++;
+         latencySumUs += latencyUs;
+         latencyMaxUs = latencyUs > latencyMaxUs ? latencyUs : latencyMaxUs;
+      }
+   }
+   printf("%-32s %8.1f us mean %8.1f us max, %d/%d frames\n", "frame to wheel",
+      applied > 0 ? latencySumUs / applied : 0.0, latencyMaxUs, applied, steps);
+   // The first frames arrive before the bridge saw the writer alive.
+   if (applied < steps - 2)
+   {
+      failures++;
+   }
+
+   // A writer at 1 kHz for a while.
+   uint64_t written = 0;
+   GetFFBBridgeStats(&stats);
+   uint64_t appliedBefore = stats.framesApplied;
+   uint64_t skippedBefore = stats.framesSkipped;
+   BenchClock::time_point start = BenchClock::now();
+   BenchClock::time_point end = start + std::chrono::microseconds((int64_t)(options.seconds * 1000000));
+   for (BenchClock::time_point tick = start; layout != NULL && tick < end; tick += std::chrono::milliseconds(1))
+   {
+      std::this_thread::sleep_until(tick);
+      FFBBridgeFrame frame;
+      ZeroMemory(&frame, sizeof(frame));
+      frame.force[0] = (float)(5000.0 * sin(2.0 * BENCH_PI * 2.0 * ElapsedNs(start) / 1e9));
+      WriteBridgeFrame(layout, frame);
+      written++;
+   }
+   GetFFBBridgeStats(&stats);
+   printf("%-32s %llu written, %llu applied, %llu skipped, %u torn reads\n", "1 kHz writer", (unsigned long long)written,
+      (unsigned long long)(stats.framesApplied - appliedBefore), (unsigned long long)(stats.framesSkipped - skippedBefore), stats.tornReads);
+   if (stats.state != FFBBridgeStates::Type::Live || stats.framesApplied - appliedBefore + stats.framesSkipped - skippedBefore > written)
+   {
+      failures++;
+   }
+
+   // The writer stops, the game's force takes over.
+   start = BenchClock::now();
+   double fallbackUs = WaitForDeviceForce(gameForce, 1000);
+   GetFFBBridgeStats(&stats);
+   printf("%-32s %8.1f ms to the game's force, %s, %u stale\n", "writer stopped",
+      fallbackUs >= 0 ? ElapsedNs(start) / 1e6 : -1.0, BridgeStateName(stats.state), stats.staleCount);
+   if (fallbackUs < 0 || stats.state != FFBBridgeStates::Type::Stale || stats.staleCount != 1)
+   {
+      failures++;
+   }
+
+   // A restarted writer with a region of its own.
+   region.Close();
+   if (region.Create(name, sizeof(FFBBridgeLayout)))
+   {
+      layout = (FFBBridgeLayout*)region.Data();
+      InitBridge(layout);
+      FFBBridgeFrame frame;
+      ZeroMemory(&frame, sizeof(frame));
+      frame.force[0] = -2468;
+      start = BenchClock::now();
+      double resumedUs = -1;
+      while (resumedUs < 0 && ElapsedNs(start) < 2e9)
+      {
+         WriteBridgeFrame(layout, frame);
+         resumedUs = WaitForDeviceForce((LONG)frame.force[0], 1);
+      }
+      GetFFBBridgeStats(&stats);
+      printf("%-32s %8.1f ms to its force, %s, %u opens\n", "writer restarted",
+         resumedUs >= 0 ? ElapsedNs(start) / 1e6 : -1.0, BridgeStateName(stats.state), stats.opens);
+      if (resumedUs < 0 || stats.state != FFBBridgeStates::Type::Live || stats.opens != 2)
+      {
+         failures++;
+      }
+   }
+   else
+   {
+      failures++;
+   }
+
+   DetachFFBBridge();
+   if (WaitForDeviceForce(gameForce, 200) < 0)
+   {
+      failures++;
+   }
+   StopForceOutputThread();
+   StopDirectInput();
+   printf("%-32s %d failed\n", "accuracy", failures);
+}
+
+/**
+ * Publish a force that changes every millisecond for seconds, the output
+ * rate averaged over the second half once the governor settled.
+ */
+static double DriveGovernedForce(double seconds, const std::vector<LONG>& directions)
+{
+   std::vector<LONG> sent(directions);
+   BenchClock::time_point start = BenchClock::now();
+   BenchClock::time_point settled = start + std::chrono::microseconds((int64_t)(seconds * 500000));
+   BenchClock::time_point end = start + std::chrono::microseconds((int64_t)(seconds * 1000000));
+   double rateSum = 0;
+   int samples = 0;
+   int i = 0;
+   for (BenchClock::time_point tick = start; tick < end; tick += std::chrono::milliseconds(1), i++)
+   {
+      std::this_thread::sleep_until(tick);
+      UpdateConstantForce((i % 2000) - 1000, &sent[0]);
+      if (tick >= settled)
+      {
+         FFBRateGovernorStats stats;
+         GetFFBRateGovernorStats(&stats);
+         rateSum += stats.rateHz;
+         samples++;
+      }
+   }
+   return samples > 0 ? rateSum / samples : 0;
+}
+
+static void PrintGovernorStats(const char* label, double meanRateHz, const ForceOutputStats& output)
+{
+   static const char* events[] = { "none", "increase", "busy", "overrun", "errors" };
+   FFBRateGovernorStats stats;
+   GetFFBRateGovernorStats(&stats);
+   printf("%-32s %6.0f Hz mean, %u overruns of %u ticks, %u up %u down, last %s %d -> %d Hz\n", label,
+      meanRateHz, output.overruns, output.ticks, stats.increases, stats.decreases,
+      events[stats.lastEvent], stats.lastEventFromHz, stats.lastEventToHz);
+   printf("%-32s p50 %.0f us p95 %.0f us p99 %.0f us max %.0f us, %.0f%% busy\n", "  SetParameters",
+      stats.p50Microseconds, stats.p95Microseconds, stats.p99Microseconds, stats.maxMicroseconds, stats.busyPercent);
+}
+
+/**
+ * Let the rate governor find what a wheel whose firmware takes
+ * --firmware-rate updates per second keeps up with, against a fixed rate,
+ * and climb back to --rate once the firmware is fast.
+ */
+static void BenchRateGovernor(const BenchOptions& options)
+{
+   FFBRateGovernorConfig config = { 50, options.rateHz, 50, 0.75f, 50, 50 };
+   int failures = 0;
+   int axisCount;
+   if (!OpenSimulatedDevice(options, axisCount) || !Check(AddFFBEffect(Effects::Type::ConstantForce), "AddFFBEffect")
+      || !Check(SetSimulatedDeviceFirmwareRate(0, options.firmwareUpdateHz), "SetSimulatedDeviceFirmwareRate")
+      || !Check(StartForceOutputThread(options.rateHz), "StartForceOutputThread"))
+   {
+      StopDirectInput();
+      printf("%-32s %d failed\n", "accuracy", 1);
+      return;
+   }
+   StartAllFFBEffects();
+   std::vector<LONG> directions(axisCount, 0);
+   directions[0] = 1;
+   ForceOutputStats output;
+
+   // What the wheel goes through at a fixed rate.
+   ResetForceOutputStats();
+   DriveGovernedForce(options.seconds / 2, directions);
+   GetForceOutputStats(&output);
+   printf("%-32s %6d Hz fixed, %u overruns of %u ticks\n", "slow firmware", options.rateHz, output.overruns, output.ticks);
+
+   if (!Check(EnableFFBRateGovernor(&config), "EnableFFBRateGovernor"))
+   {
+      failures++;
+   }
+   ResetForceOutputStats();
+   double slowRateHz = DriveGovernedForce(options.seconds, directions);
+   GetForceOutputStats(&output);
+   PrintGovernorStats("slow firmware, governed", slowRateHz, output);
+   // Settles under the firmware's rate, if not far under.
+   if (options.firmwareUpdateHz != 0 && (slowRateHz > options.firmwareUpdateHz * 1.1 || slowRateHz < options.firmwareUpdateHz * 0.5))
+   {
+      failures++;
+   }
+
+   SetSimulatedDeviceFirmwareRate(0, 0);
+   ResetForceOutputStats();
+   double fastRateHz = DriveGovernedForce(options.seconds, directions);
+   GetForceOutputStats(&output);
+   PrintGovernorStats("fast firmware, governed", fastRateHz, output);
+   FFBRateGovernorStats stats;
+   GetFFBRateGovernorStats(&stats);
+   if (stats.rateHz != config.ceilingHz)
+   {
+      failures++;
+   }
+
+   DisableFFBRateGovernor();
+   StopForceOutputThread();
+   StopDirectInput();
+   printf("%-32s %d failed\n", "accuracy", failures);
+}
+
+/**
+ * Time an update of each kind through the effect's own function and
+ * through UpdateFFBEffect. With sameCalls, both must send the device the
+ * same, which only holds when the game thread makes the driver calls.
+ */
+template <typename Direct, typename Generic>
+static void CompareUpdatePaths(const char* name, int iterations, bool sameCalls, Direct direct, Generic generic, int& failures)
+{
+   FFBUpdateCounters directCounters;
+   FFBUpdateCounters genericCounters;
+   char label[64];
+
+   // Both start from what the last update of the run sets, so neither
+   // pays for the parameters the other left behind.
+   generic(iterations - 1);
+   ResetFFBUpdateCounters();
+   BenchClock::time_point start = BenchClock::now();
+   for (int i = 0; i < iterations; i++)
+   {
+      direct(i);
+   }
+   snprintf(label, sizeof(label), "%s (own)", name);
+   Report(label, ElapsedNs(start), iterations);
+   GetFFBUpdateCounters(&directCounters);
+
+   direct(iterations - 1);
+   ResetFFBUpdateCounters();
+   start = BenchClock::now();
+   for (int i = 0; i < iterations; i++)
+   {
+      generic(i);
+   }
+   snprintf(label, sizeof(label), "%s (generic)", name);
+   Report(label, ElapsedNs(start), iterations);
+   GetFFBUpdateCounters(&genericCounters);
+
+   if (sameCalls && (genericCounters.callsForwarded != directCounters.callsForwarded
+      || genericCounters.parameterBytesSent != directCounters.parameterBytesSent))
+   {
+      printf("%-32s own %u/%u bytes, generic %u/%u bytes FAILED\n", name, directCounters.callsForwarded,
+         directCounters.parameterBytesSent, genericCounters.callsForwarded, genericCounters.parameterBytesSent);
+      failures++;
+   }
+}
+
+/**
+ * The update every effect type shares: a ramp played on the wheel against
+ * its reference, the flags of a partial update, the errors, and the cost
+ * of UpdateFFBEffect next to the functions of each kind.
+ */
+static void BenchGenericUpdate(const BenchOptions& options)
+{
+   static const DWORD paramsSizes[FFB_EFFECT_TYPE_COUNT] = {
+      sizeof(FFBConstantForceParams), sizeof(FFBRampForceParams),
+      sizeof(FFBPeriodicParams), sizeof(FFBPeriodicParams), sizeof(FFBPeriodicParams), sizeof(FFBPeriodicParams), sizeof(FFBPeriodicParams),
+      sizeof(FFBConditionParams), sizeof(FFBConditionParams), sizeof(FFBConditionParams), sizeof(FFBConditionParams),
+      sizeof(FFBCustomForceParams)
+   };
+   int failures = 0;
+   for (int type = 0; type < FFB_EFFECT_TYPE_COUNT; type++)
+   {
+      FFBEffectTypeInfo info;
+      if (FAILED(GetFFBEffectTypeInfo((Effects::Type)type, &info)) || info.paramsSize != paramsSizes[type] || info.parameterFlags == 0)
+      {
+         printf("%-32s type %d FAILED\n", "effect type info", type);
+         failures++;
+      }
+   }
+
+   int axisCount;
+   if (!OpenSimulatedDevice(options, axisCount))
+   {
+      StopDirectInput();
+      printf("%-32s %d failed\n", "accuracy", failures + 1);
+      return;
+   }
+
+   // A ramp from -5000 to 5000 over 100 ms, then only its end moved.
+   FFBEffectHandle ramp = 0;
+   FFBRampForceParams rampParams;
+   ZeroMemory(&rampParams, sizeof(rampParams));
+   rampParams.ramp.lStart = -5000;
+   rampParams.ramp.lEnd = 5000;
+   rampParams.duration = 100000;
+   rampParams.directions[0] = 1;
+   if (Check(CreateFFBEffect(Effects::Type::RampForce, &ramp), "CreateFFBEffect")
+      && Check(UpdateFFBEffect(ramp, &rampParams, 0), "UpdateFFBEffect"))
+   {
+      double maxError = 0;
+      for (DWORD elapsedUs = 0; elapsedUs < rampParams.duration + 20000; elapsedUs += 1000)
+      {
+         LONG force[MAX_FFB_AXES];
+         RenderSimulatedDeviceForce(0, elapsedUs, force);
+         double reference = elapsedUs < rampParams.duration ? -5000.0 + 10000.0 * elapsedUs / rampParams.duration : 0.0;
+         double error = fabs(force[0] - reference);
+         maxError = error > maxError ? error : maxError;
+      }
+      CheckAccuracy("ramp max error", maxError, 0.0, 1.0, failures);
+
+      ResetFFBUpdateCounters();
+      FFBRampForceParams moved = rampParams;
+      moved.ramp.lEnd = 0;
+      moved.duration = 1;
+      moved.directions[0] = -1;
+      Check(UpdateFFBEffect(ramp, &moved, DIEP_TYPESPECIFICPARAMS), "UpdateFFBEffect");
+      FFBUpdateCounters counters;
+      GetFFBUpdateCounters(&counters);
+      LONG force[MAX_FFB_AXES];
+      RenderSimulatedDeviceForce(0, rampParams.duration / 2, force);
+      // The duration and direction stay, the force ends at 0 instead.
+      CheckAccuracy("partial update bytes", counters.parameterBytesSent, sizeof(DIRAMPFORCE), 0.0, failures);
+      CheckAccuracy("partial update force", force[0], -2500.0, 1.0, failures);
+
+      HRESULT badFlags = UpdateFFBEffect(ramp, &rampParams, DIEP_ENVELOPE);
+      moved = rampParams;
+      moved.duration = INFINITE;
+      HRESULT endless = UpdateFFBEffect(ramp, &moved, 0);
+      DestroyFFBEffect(ramp);
+      HRESULT stale = UpdateFFBEffect(ramp, &rampParams, 0);
+      printf("%-32s flags 0x%08x, endless 0x%08x, stale handle 0x%08x\n", "errors",
+         (unsigned int)badFlags, (unsigned int)endless, (unsigned int)stale);
+      failures += badFlags == E_INVALIDARG && endless == E_INVALIDARG && stale == E_HANDLE ? 0 : 1;
+   }
+   else
+   {
+      failures++;
+   }
+
+   FFBEffectHandle constant = 0;
+   FFBEffectHandle sine = 0;
+   FFBEffectHandle spring = 0;
+   if (Check(CreateFFBEffect(Effects::Type::ConstantForce, &constant), "CreateFFBEffect")
+      && Check(CreateFFBEffect(Effects::Type::Sine, &sine), "CreateFFBEffect")
+      && Check(CreateFFBEffect(Effects::Type::Spring, &spring), "CreateFFBEffect"))
+   {
+      FFBConstantForceParams constantParams;
+      ZeroMemory(&constantParams, sizeof(constantParams));
+      for (int i = 0; i < axisCount; i++)
+      {
+         constantParams.directions[i] = 1;
+      }
+      CompareUpdatePaths("constant force", options.iterations, true,
+         [&](int i) { UpdateFFBEffectConstantForce(constant, (i % 2000) - 1000, constantParams.directions); },
+         [&](int i) { constantParams.magnitude = (i % 2000) - 1000; UpdateFFBEffect(constant, &constantParams, 0); },
+         failures);
+
+      FFBPeriodicParams periodicParams;
+      ZeroMemory(&periodicParams, sizeof(periodicParams));
+      periodicParams.effect.periodic.dwPeriod = 20000;
+      periodicParams.directions[0] = 1;
+      CompareUpdatePaths("periodic", options.iterations, true,
+         [&](int i) { periodicParams.effect.periodic.dwMagnitude = 4000 + (i % 2) * 2000; UpdateFFBEffectPeriodic(sine, &periodicParams.effect, periodicParams.directions); },
+         [&](int i) { periodicParams.effect.periodic.dwMagnitude = 4000 + (i % 2) * 2000; UpdateFFBEffect(sine, &periodicParams, 0); },
+         failures);
+
+      FFBConditionParams conditionParams;
+      ZeroMemory(&conditionParams, sizeof(conditionParams));
+      CompareUpdatePaths("condition", options.iterations, true,
+         [&](int i) { conditionParams.conditions[0].lPositiveCoefficient = i % DI_FFNOMINALMAX; UpdateFFBEffectCondition(spring, conditionParams.conditions); },
+         [&](int i) { conditionParams.conditions[0].lPositiveCoefficient = i % DI_FFNOMINALMAX; UpdateFFBEffect(spring, &conditionParams, 0); },
+         failures);
+
+      // Only publishing, the output thread sends.
+      if (Check(StartForceOutputThread(options.rateHz), "StartForceOutputThread"))
+      {
+         CompareUpdatePaths("threaded constant", options.iterations, false,
+            [&](int i) { UpdateFFBEffectConstantForce(constant, (i % 2000) - 1000, constantParams.directions); },
+            [&](int i) { constantParams.magnitude = (i % 2000) - 1000; UpdateFFBEffect(constant, &constantParams, 0); },
+            failures);
+         StopForceOutputThread();
+      }
+   }
+   else
+   {
+      failures++;
+   }
+   StopDirectInput();
+   printf("%-32s %d failed\n", "accuracy", failures);
+}
+
+/**
+ * One device open of the soak benchmark: enumerate, open, create two
+ * effects of every type, update them, destroy half and close the device
+ * with the rest. memory is the device's arena with the effects created.
+ */
+static bool SoakCycle(const std::string& guidInstance, FFBMemoryStats& memory)
+{
+   int deviceCount = 0;
+   EnumerateFFBDevices(deviceCount);
+   FFBDeviceHandle device = 0;
+   int axisCount = 0;
+   if (deviceCount == 0 || FAILED(OpenFFBDevice(guidInstance.c_str(), &device)))
+   {
+      return false;
+   }
+   DeviceEnumerateFFBAxes(device, axisCount);
+   bool ok = axisCount > 0;
+   FFBEffectHandle effects[FFB_EFFECT_TYPE_COUNT * 2];
+   int effectCount = 0;
+   for (int type = 0; type < FFB_EFFECT_TYPE_COUNT * 2 && ok; type++)
+   {
+      ok = SUCCEEDED(DeviceCreateFFBEffect(device, (Effects::Type)(type % FFB_EFFECT_TYPE_COUNT), &effects[effectCount]));
+      effectCount += ok ? 1 : 0;
+   }
+   LONG directions[MAX_FFB_AXES] = { 1 };
+   DICONDITION conditions[MAX_FFB_AXES] = {};
+   conditions[0].lPositiveCoefficient = 5000;
+   for (int i = 0; i < effectCount && ok; i++)
+   {
+      if (i % FFB_EFFECT_TYPE_COUNT == Effects::Type::ConstantForce)
+      {
+         ok = SUCCEEDED(DeviceUpdateFFBEffectConstantForce(device, effects[i], 2000, directions));
+      }
+      else if (i % FFB_EFFECT_TYPE_COUNT == Effects::Type::Spring)
+      {
+         ok = SUCCEEDED(DeviceUpdateFFBEffectCondition(device, effects[i], conditions));
+      }
+   }
+   DeviceGetFFBMemoryStats(device, &memory);
+   for (int i = 0; i < effectCount; i += 2)
+   {
+      ok = SUCCEEDED(DeviceDestroyFFBEffect(device, effects[i])) && ok;
+   }
+   return SUCCEEDED(CloseFFBDevice(device)) && ok;
+}
+
+/**
+ * Open and close the device and its effects thousands of times and check
+ * the heap ends where it started, then check updating effects and
+ * creating and destroying pooled ones allocates nothing at all. The
+ * allocations counted are the plugin's only where the operators above
+ * replace its own.
+ */
+static void BenchSoak(const BenchOptions& options)
+{
+   int failures = 0;
+   int axisCount = 0;
+   int deviceCount = 0;
+   SelectFFBBackend(Backends::Type::Simulated);
+   ConfigureSimulatedDevice(&options.device);
+   DeviceInfo* devices = Check(StartDirectInput(), "StartDirectInput") ? EnumerateFFBDevices(deviceCount) : NULL;
+   if (deviceCount == 0)
+   {
+      StopDirectInput();
+      printf("%-32s %d failed\n", "accuracy", 1);
+      return;
+   }
+   std::string guidInstance = devices[0].guidInstance;
+
+   // Containers that grow to a high water mark and keep it settle within
+   // the first cycles.
+   const int warmupCycles = 10;
+   int cycles = std::max(options.iterations / 50, 100);
+   FFBMemoryStats memory;
+   ZeroMemory(&memory, sizeof(memory));
+   for (int i = 0; i < warmupCycles; i++)
+   {
+      failures += SoakCycle(guidInstance, memory) ? 0 : 1;
+   }
+   int64_t liveBefore = LiveAllocations();
+   int64_t liveBytesBefore = s_nLiveBytes.load();
+   uint64_t allocationsBefore = s_nAllocations.load();
+   BenchClock::time_point start = BenchClock::now();
+   for (int i = 0; i < cycles; i++)
+   {
+      failures += SoakCycle(guidInstance, memory) ? 0 : 1;
+   }
+   Report("open, 24 effects, close", ElapsedNs(start), cycles);
+   int64_t leaked = LiveAllocations() - liveBefore;
+   int64_t grown = s_nLiveBytes.load() - liveBytesBefore;
+   printf("%-32s %.1f allocations per cycle, %lld not freed, %lld bytes more after %d cycles\n", "heap",
+      (double)(s_nAllocations.load() - allocationsBefore) / cycles, (long long)leaked, (long long)grown, cycles);
+   printf("%-32s %u slots, %u in use, %u blocks, %u bytes\n", "effect arena",
+      memory.effectSlots, memory.effectSlotsInUse, memory.arenaBlocks, memory.arenaBytes);
+   failures += leaked == 0 && grown == 0 && memory.arenaBlocks == 1 ? 0 : 1;
+
+   // Steady state on one device: updates with the output thread running,
+   // then effects created and destroyed from a pool.
+   FFBDeviceHandle device = 0;
+   FFBEffectPoolConfig pool;
+   ZeroMemory(&pool, sizeof(pool));
+   pool.effectsPerType[Effects::Type::ConstantForce] = 4;
+   if (Check(OpenFFBDevice(guidInstance.c_str(), &device), "OpenFFBDevice"))
+   {
+      DeviceEnumerateFFBAxes(device, axisCount);
+      FFBEffectHandle constant = 0;
+      FFBEffectHandle spring = 0;
+      LONG directions[MAX_FFB_AXES] = { 1 };
+      DICONDITION conditions[MAX_FFB_AXES] = {};
+      if (Check(DeviceFillFFBEffectPool(device, &pool), "DeviceFillFFBEffectPool")
+         && Check(DeviceCreateFFBEffect(device, Effects::Type::ConstantForce, &constant), "DeviceCreateFFBEffect")
+         && Check(DeviceCreateFFBEffect(device, Effects::Type::Spring, &spring), "DeviceCreateFFBEffect")
+         && Check(DeviceStartForceOutputThread(device, options.rateHz), "DeviceStartForceOutputThread"))
+      {
+         // The output thread's first ticks size what it keeps.
+         std::this_thread::sleep_for(std::chrono::milliseconds(20));
+         uint64_t allocations = s_nAllocations.load();
+         start = BenchClock::now();
+         for (int i = 0; i < options.iterations; i++)
+         {
+            conditions[0].lPositiveCoefficient = i % DI_FFNOMINALMAX;
+            DeviceUpdateFFBEffectConstantForce(device, constant, (i % 2000) - 1000, directions);
+            DeviceUpdateFFBEffectCondition(device, spring, conditions);
+         }
+         Report("updates, output thread", ElapsedNs(start), options.iterations * 2);
+         uint64_t updateAllocations = s_nAllocations.load() - allocations;
+         DeviceStopForceOutputThread(device);
+
+         allocations = s_nAllocations.load();
+         start = BenchClock::now();
+         int churn = options.iterations / 10;
+         for (int i = 0; i < churn; i++)
+         {
+            FFBEffectHandle effect = 0;
+            if (FAILED(DeviceCreateFFBEffect(device, Effects::Type::ConstantForce, &effect))
+               || FAILED(DeviceDestroyFFBEffect(device, effect)))
+            {
+               failures++;
+               break;
+            }
+         }
+         Report("pooled create + destroy", ElapsedNs(start), churn);
+         uint64_t churnAllocations = s_nAllocations.load() - allocations;
+         printf("%-32s %llu in updates, %llu in pooled create + destroy\n", "steady state allocations",
+            (unsigned long long)updateAllocations, (unsigned long long)churnAllocations);
+         failures += updateAllocations == 0 && churnAllocations == 0 ? 0 : 1;
+      }
+      else
+      {
+         failures++;
+      }
+      CloseFFBDevice(device);
+   }
+   else
+   {
+      failures++;
+   }
+   StopDirectInput();
+   printf("%-32s %d failed\n", "accuracy", failures);
+}
+
+struct Benchmark
+{
+   const char* name;
+   std::function<void(const BenchOptions&)> run;
+};
+
+static const Benchmark s_benchmarks[] = {
+   { "startup", BenchStartup },
+   { "constant-force", BenchUpdateConstantForce },
+   { "spring", BenchUpdateSpring },
+   { "periodic", BenchPeriodic },
+   { "custom-force", BenchCustomForce },
+   { "input", BenchInput },
+   { "bridge", BenchBridge },
+   { "governor", BenchRateGovernor },
+   { "generic-update", BenchGenericUpdate },
+   { "gain", BenchUpdateEffectGain },
+   { "change-detect", BenchChangeDetection },
+   { "batch", BenchCommandBatch },
+   { "output-thread", BenchOutputThread },
+   { "synth", BenchForceSynthesis },
+   { "dsp", BenchForceDsp },
+   { "keyframes", BenchKeyframes },
+   { "mixer", BenchForceMixer },
+   { "multi-device", BenchMultiDevice },
+   { "mpsc", BenchCommandQueue },
+   { "effect-lookup", BenchEffectLookup },
+   { "enumerate", BenchEnumeration },
+   { "hotplug", BenchHotPlug },
+   { "async-init", BenchAsyncInit },
+   { "startup-cache", BenchStartupCache },
+   { "effect-pool", BenchEffectPool },
+   { "stats", BenchStats },
+   { "record", BenchRecord },
+   { "soak", BenchSoak },
+};
+
+static void Usage()
+{
+   printf("usage: ffb-bench [benchmark...] [--iterations N] [--latency US] [--axes N] [--drop-every N]\n"
+      "                 [--rate HZ] [--seconds S] [--load THREADS] [--record-file PATH]\n"
+      "                 [--producers THREADS] [--enum-delay US] [--cache-file PATH]\n"
+      "                 [--download-delay US] [--sample-rate BYTES_PER_MS]\n"
+      "                 [--firmware-rate HZ]\n\nbenchmarks:");
+   for (const Benchmark& benchmark : s_benchmarks)
+   {
+      printf(" %s", benchmark.name);
+   }
+   printf("\n");
+}
+
+int main(int argc, char** argv)
+{
+   BenchOptions options;
+   options.iterations = 100000;
+   options.rateHz = 1000;
+   options.seconds = 2.0;
+   options.loadThreads = 0;
+   options.producerThreads = 8;
+   options.recordPath = "ffb-bench.ffbrec";
+   options.cachePath = "ffb-bench.ffbcache";
+   options.enumDelayMicroseconds = 20000;
+   options.downloadDelayMicroseconds = 10000;
+   options.sampleBytesPerMillisecond = 64;
+   options.firmwareUpdateHz = 250;
+   options.device.deviceCount = 1;
+   options.device.axisCount = 1;
+   options.device.maxForce = DI_FFNOMINALMAX;
+   options.device.forceResolution = 1;
+   options.device.latencyMicroseconds = 0;
+   options.device.dropEveryN = 0;
+   options.device.physicsStepMicroseconds = 0;
+   options.device.maxEffects = 0;
+   options.device.enumerationMicroseconds = 0;
+   options.device.downloadMicroseconds = 0;
+   options.device.sampleBytesPerMillisecond = 0;
+   options.device.firmwareUpdateHz = 0;
+
+   std::vector<std::string> selected;
+   for (int i = 1; i < argc; i++)
+   {
+      std::string arg = argv[i];
+      bool hasValue = i + 1 < argc;
+      if (arg == "--iterations" && hasValue)
+      {
+         options.iterations = atoi(argv[++i]);
+      }
+      else if (arg == "--latency" && hasValue)
+      {
+         options.device.latencyMicroseconds = (DWORD)atoi(argv[++i]);
+      }
+      else if (arg == "--axes" && hasValue)
+      {
+         options.device.axisCount = atoi(argv[++i]);
+      }
+      else if (arg == "--rate" && hasValue)
+      {
+         options.rateHz = atoi(argv[++i]);
+      }
+      else if (arg == "--seconds" && hasValue)
+      {
+         options.seconds = atof(argv[++i]);
+      }
+      else if (arg == "--load" && hasValue)
+      {
+         options.loadThreads = atoi(argv[++i]);
+      }
+      else if (arg == "--producers" && hasValue)
+      {
+         options.producerThreads = atoi(argv[++i]);
+      }
+      else if (arg == "--record-file" && hasValue)
+      {
+         options.recordPath = argv[++i];
+      }
+      else if (arg == "--enum-delay" && hasValue)
+      {
+         options.enumDelayMicroseconds = (DWORD)atoi(argv[++i]);
+      }
+      else if (arg == "--cache-file" && hasValue)
+      {
+         options.cachePath = argv[++i];
+      }
+      else if (arg == "--download-delay" && hasValue)
+      {
+         options.downloadDelayMicroseconds = (DWORD)atoi(argv[++i]);
+      }
+      else if (arg == "--sample-rate" && hasValue)
+      {
+         options.sampleBytesPerMillisecond = (DWORD)atoi(argv[++i]);
+      }
+      else if (arg == "--firmware-rate" && hasValue)
+      {
+         options.firmwareUpdateHz = (DWORD)atoi(argv[++i]);
+      }
+      else if (arg == "--drop-every" && hasValue)
+      {
+         options.device.dropEveryN = (DWORD)atoi(argv[++i]);
+      }
+      else if (arg.size() > 0 && arg[0] == '-')
+      {
+         Usage();
+         return arg == "--help" || arg == "-h" ? 0 : 1;
+      }
+      else
+      {
+         selected.push_back(arg);
+      }
+   }
+
+   int ran = 0;
+   for (const Benchmark& benchmark : s_benchmarks)
+   {
+      bool run = selected.empty();
+      for (const std::string& name : selected)
+      {
+         run = run || name == benchmark.name;
+      }
+      if (run)
+      {
+         printf("== %s\n", benchmark.name);
+         benchmark.run(options);
+         ran++;
+      }
+   }
+   if (ran == 0)
+   {
+      Usage();
+      return 1;
+   }
+   return 0;
+}
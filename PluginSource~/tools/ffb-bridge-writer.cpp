@@ -0,0 +1,144 @@
+// ffb-bridge-writer.cpp : Stands in for an out of process physics server
+// driving force feedback through the shared memory bridge, to test
+// AttachFFBBridge without one.
+//
+// Writes a sine force at a fixed rate into the region NAME. With
+// --stall-after the writer stops its heartbeat and frames after that many
+// seconds but keeps the region, so the plugin sees it go stale.
+//
+//    ffb-bridge-writer [NAME] [--rate HZ] [--seconds S] [--hz HZ]
+//                      [--amplitude N] [--axes N] [--stall-after S]
+//
+
+#include "pch.h"
+#include "../bridge-format.h"
+#include "../shared-memory.h"
+#include <chrono>
+#include <thread>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef std::chrono::steady_clock WriterClock;
+
+static const double WRITER_PI = 3.14159265358979323846;
+
+struct WriterOptions
+{
+   const char* name;
+   int rateHz;
+   double seconds;
+   double signalHz;
+   double amplitude;
+   int axisCount;
+   // Negative to never stall.
+   double stallAfterSeconds;
+};
+
+static void Usage()
+{
+   printf("usage: ffb-bridge-writer [NAME] [--rate HZ] [--seconds S] [--hz HZ]\n"
+      "                         [--amplitude N] [--axes N] [--stall-after S]\n");
+}
+
+int main(int argc, char** argv)
+{
+   WriterOptions options;
+   options.name = "unity-ffb-bridge";
+   options.rateHz = 1000;
+   options.seconds = 10;
+   options.signalHz = 2;
+   options.amplitude = 5000;
+   options.axisCount = 1;
+   options.stallAfterSeconds = -1;
+   for (int i = 1; i < argc; i++)
+   {
+      bool hasValue = i + 1 < argc;
+      if (strcmp(argv[i], "--rate") == 0 && hasValue)
+      {
+         options.rateHz = atoi(argv[++i]);
+      }
+      else if (strcmp(argv[i], "--seconds") == 0 && hasValue)
+      {
+         options.seconds = atof(argv[++i]);
+      }
+      else if (strcmp(argv[i], "--hz") == 0 && hasValue)
+      {
+         options.signalHz = atof(argv[++i]);
+      }
+      else if (strcmp(argv[i], "--amplitude") == 0 && hasValue)
+      {
+         options.amplitude = atof(argv[++i]);
+      }
+      else if (strcmp(argv[i], "--axes") == 0 && hasValue)
+      {
+         options.axisCount = atoi(argv[++i]);
+      }
+      else if (strcmp(argv[i], "--stall-after") == 0 && hasValue)
+      {
+         options.stallAfterSeconds = atof(argv[++i]);
+      }
+      else if (argv[i][0] != '-')
+      {
+         options.name = argv[i];
+      }
+      else
+      {
+         Usage();
+         return 1;
+      }
+   }
+   if (options.rateHz <= 0 || options.axisCount <= 0 || options.axisCount > MAX_FFB_AXES)
+   {
+      Usage();
+      return 1;
+   }
+
+   SharedMemory region;
+   if (!region.Create(options.name, sizeof(FFBBridgeLayout)))
+   {
+      printf("cannot create the bridge region %s\n", options.name);
+      return 1;
+   }
+   FFBBridgeLayout* layout = (FFBBridgeLayout*)region.Data();
+   InitBridge(layout);
+   printf("writing %s at %d Hz for %.1f s\n", options.name, options.rateHz, options.seconds);
+
+   WriterClock::time_point start = WriterClock::now();
+   WriterClock::duration period = std::chrono::nanoseconds(1000000000LL / options.rateHz);
+   WriterClock::time_point next = start;
+   uint64_t frames = 0;
+   bool stalled = false;
+   for (;;)
+   {
+      double elapsed = std::chrono::duration<double>(WriterClock::now() - start).count();
+      if (elapsed >= options.seconds)
+      {
+         break;
+      }
+      if (options.stallAfterSeconds >= 0 && elapsed >= options.stallAfterSeconds)
+      {
+         if (!stalled)
+         {
+            printf("stalled after %llu frames\n", (unsigned long long)frames);
+            stalled = true;
+         }
+      }
+      else
+      {
+         FFBBridgeFrame frame;
+         memset(&frame, 0, sizeof(frame));
+         for (int axis = 0; axis < options.axisCount; axis++)
+         {
+            // Each axis a quarter turn behind the one before.
+            frame.force[axis] = (float)(options.amplitude * sin(2.0 * WRITER_PI * options.signalHz * elapsed - axis * WRITER_PI / 2));
+         }
+         WriteBridgeFrame(layout, frame);
+         frames++;
+      }
+      next += period;
+      std::this_thread::sleep_until(next);
+   }
+   printf("wrote %llu frames\n", (unsigned long long)frames);
+   return 0;
+}
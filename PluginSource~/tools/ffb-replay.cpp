@@ -0,0 +1,668 @@
+// ffb-replay.cpp : Plays a recording made with StartFFBRecording back
+// against the plugin.
+//
+// Runs against the simulated backend unless --dinput is given (Windows
+// only). With --speed 0 the calls are made back to back instead of at
+// their recorded times, which makes it a throughput benchmark of the
+// native layer.
+//
+//    ffb-replay FILE [--speed X] [--loop N] [--latency US] [--dinput]
+//
+
+#include "pch.h"
+#include "unity-ffb.h"
+#include "../record-format.h"
+#include "../mapped-file.h"
+#include <chrono>
+#include <map>
+#include <thread>
+#include <stddef.h>
+#include <string.h>
+
+typedef std::chrono::steady_clock ReplayClock;
+
+static const char* s_callNames[FFB_RECORD_CALL_COUNT] = {
+   "OpenDevice", "CloseDevice", "AddEffect", "RemoveEffect", "CreateEffect", "DestroyEffect",
+   "UpdateConstantForce", "UpdateEffectConstantForce", "UpdateCondition", "UpdateEffectCondition",
+   "UpdateGain", "SetEffectGain", "StartEffect", "StopEffect", "StartAllEffects", "StopAllEffects",
+   "SetAutoCenter", "SubmitCommands", "StartOutputThread", "StopOutputThread", "SetOutputRate",
+   "EnableSynthesis", "DisableSynthesis", "SetEffectCapacity", "ConfigureForceDsp",
+   "DisableForceDsp", "EnableForceKeyframes", "DisableForceKeyframes", "SubmitForceKeyframe",
+   "ConfigureForceMixer", "CreateForceLayer", "ConfigureForceLayer", "UpdateForceLayer", "DestroyForceLayer",
+   "UpdatePeriodic", "UpdateEffectPeriodic", "UpdateCustomForce", "UpdateEffectCustomForce",
+   "UpdateEffect", "UpdateFFBEffect"
+};
+
+struct ReplayOptions
+{
+   const char* path;
+   double speed;
+   int loops;
+   bool directInput;
+   DWORD latencyMicroseconds;
+};
+
+/**
+ * Walks the records of a mapped recording. Stops at a record cut short,
+ * which is how a recording ends when the game crashed.
+ */
+class RecordReader
+{
+public:
+   RecordReader(const BYTE* data, size_t size, const FFBRecordFileHeader& header) :
+      m_pCurrent(data + header.headerSize),
+      m_pEnd(data + size),
+      m_recordHeaderSize(header.recordHeaderSize),
+      m_bTruncated(false)
+   {
+   }
+
+   bool Next(FFBRecordHeader& header, const BYTE*& payload)
+   {
+      if ((size_t)(m_pEnd - m_pCurrent) < m_recordHeaderSize)
+      {
+         m_bTruncated = m_pCurrent != m_pEnd;
+         return false;
+      }
+      memcpy(&header, m_pCurrent, sizeof(header));
+      if ((size_t)(m_pEnd - m_pCurrent) < m_recordHeaderSize + header.payloadBytes)
+      {
+         m_bTruncated = true;
+         return false;
+      }
+      payload = m_pCurrent + m_recordHeaderSize;
+      m_pCurrent = payload + header.payloadBytes;
+      return true;
+   }
+
+   bool Truncated() const { return m_bTruncated; }
+
+private:
+   const BYTE* m_pCurrent;
+   const BYTE* m_pEnd;
+   size_t m_recordHeaderSize;
+   bool m_bTruncated;
+};
+
+struct CallTotals
+{
+   uint64_t calls;
+   double totalNs;
+   // Calls whose success differed from the recording.
+   uint64_t mismatches;
+};
+
+/**
+ * Maps the device, effect and force layer handles of the recording to the
+ * ones the replay got, and gathers the batches of SubmitCommand records.
+ */
+struct ReplayState
+{
+   std::map<FFBDeviceHandle, FFBDeviceHandle> devices;
+   std::map<std::pair<FFBDeviceHandle, FFBEffectHandle>, FFBEffectHandle> effects;
+   std::map<std::pair<FFBDeviceHandle, FFBForceLayerHandle>, FFBForceLayerHandle> layers;
+   std::vector<FFBCommand> batch;
+   // arg of the last command added to batch.
+   uint32_t batchRemaining;
+   std::vector<HRESULT> batchResults;
+   // Silent samples standing in for the custom forces, by size. They are
+   // never freed or changed, the plugin may still read a chunk it queued.
+   std::map<size_t, std::vector<LONG> > silence;
+   CallTotals totals[FFB_RECORD_CALL_COUNT];
+   uint64_t unmapped;
+};
+
+static FFBDeviceHandle MapDevice(ReplayState& state, FFBDeviceHandle device)
+{
+   std::map<FFBDeviceHandle, FFBDeviceHandle>::const_iterator it = state.devices.find(device);
+   return it != state.devices.end() ? it->second : 0;
+}
+
+static FFBEffectHandle MapEffect(ReplayState& state, FFBDeviceHandle device, uint32_t effect)
+{
+   std::map<std::pair<FFBDeviceHandle, FFBEffectHandle>, FFBEffectHandle>::const_iterator it =
+      state.effects.find(std::make_pair(device, (FFBEffectHandle)effect));
+   return it != state.effects.end() ? it->second : 0;
+}
+
+static FFBForceLayerHandle MapLayer(ReplayState& state, FFBDeviceHandle device, uint32_t layer)
+{
+   std::map<std::pair<FFBDeviceHandle, FFBForceLayerHandle>, FFBForceLayerHandle>::const_iterator it =
+      state.layers.find(std::make_pair(device, (FFBForceLayerHandle)layer));
+   return it != state.layers.end() ? it->second : 0;
+}
+
+/**
+ * Open the recorded device, or the first device not open yet if it is not
+ * attached (e.g. replaying on another machine), and enumerate its axes.
+ */
+static HRESULT OpenReplayDevice(const GUID& guidInstance, FFBDeviceHandle* device)
+{
+   HRESULT hr = OpenFFBDeviceByGuid(&guidInstance, device);
+   if (FAILED(hr))
+   {
+      const FFBEnumSnapshot* snapshot;
+      if (FAILED(EnumerateFFBDeviceSnapshot(&snapshot)))
+      {
+         return hr;
+      }
+      const FFBDeviceRecord* records = (const FFBDeviceRecord*)((const BYTE*)snapshot + snapshot->recordOffset);
+      for (DWORD i = 0; i < snapshot->recordCount && FAILED(hr); i++)
+      {
+         hr = OpenFFBDeviceByGuid(&records[i].guidInstance, device);
+      }
+   }
+   if (SUCCEEDED(hr))
+   {
+      int axisCount;
+      DeviceEnumerateFFBAxes(*device, axisCount);
+   }
+   return hr;
+}
+
+template <typename T>
+static T PayloadAs(const BYTE* payload, size_t payloadBytes)
+{
+   T value;
+   memset(&value, 0, sizeof(value));
+   memcpy(&value, payload, payloadBytes < sizeof(value) ? payloadBytes : sizeof(value));
+   return value;
+}
+
+/**
+ * Make the call a record describes through the exported API.
+ */
+static HRESULT Dispatch(ReplayState& state, const FFBRecordHeader& record, const BYTE* payload)
+{
+   FFBDeviceHandle device = MapDevice(state, record.device);
+   Effects::Type effectType = (Effects::Type)record.arg;
+   FFBEffectHandle effect = MapEffect(state, device, record.arg);
+   LONG directions[MAX_FFB_AXES];
+   DICONDITION conditions[MAX_FFB_AXES];
+   memset(directions, 0, sizeof(directions));
+   memset(conditions, 0, sizeof(conditions));
+
+   switch (record.call)
+   {
+   case FFBRecordCalls::Type::OpenDevice:
+   {
+      FFBDeviceHandle opened = 0;
+      HRESULT hr = record.device != 0 ? OpenReplayDevice(PayloadAs<GUID>(payload, record.payloadBytes), &opened) : E_FAIL;
+      if (SUCCEEDED(hr))
+      {
+         state.devices[record.device] = opened;
+      }
+      return hr;
+   }
+   case FFBRecordCalls::Type::CloseDevice:
+      state.devices.erase(record.device);
+      return CloseFFBDevice(device);
+   case FFBRecordCalls::Type::AddEffect:
+      return DeviceAddFFBEffect(device, effectType);
+   case FFBRecordCalls::Type::RemoveEffect:
+      return DeviceRemoveFFBEffect(device, effectType);
+   case FFBRecordCalls::Type::CreateEffect:
+   {
+      FFBEffectHandle created = 0;
+      HRESULT hr = DeviceCreateFFBEffect(device, effectType, &created);
+      if (SUCCEEDED(hr) && record.payloadBytes >= sizeof(FFBEffectHandle))
+      {
+         state.effects[std::make_pair(device, PayloadAs<FFBEffectHandle>(payload, record.payloadBytes))] = created;
+      }
+      return hr;
+   }
+   case FFBRecordCalls::Type::DestroyEffect:
+      return DeviceDestroyFFBEffect(device, effect);
+   case FFBRecordCalls::Type::UpdateConstantForce:
+   case FFBRecordCalls::Type::UpdateEffectConstantForce:
+   {
+      LONG magnitude = PayloadAs<LONG>(payload, record.payloadBytes);
+      if (record.payloadBytes > sizeof(LONG))
+      {
+         memcpy(directions, payload + sizeof(LONG), record.payloadBytes - sizeof(LONG));
+      }
+      return record.call == FFBRecordCalls::Type::UpdateConstantForce
+         ? DeviceUpdateConstantForce(device, magnitude, directions)
+         : DeviceUpdateFFBEffectConstantForce(device, effect, magnitude, directions);
+   }
+   case FFBRecordCalls::Type::UpdateCondition:
+   case FFBRecordCalls::Type::UpdateEffectCondition:
+      memcpy(conditions, payload, record.payloadBytes < sizeof(conditions) ? record.payloadBytes : sizeof(conditions));
+      return record.call == FFBRecordCalls::Type::UpdateCondition
+         ? DeviceUpdateCondition(device, effectType, conditions)
+         : DeviceUpdateFFBEffectCondition(device, effect, conditions);
+   case FFBRecordCalls::Type::UpdatePeriodic:
+   case FFBRecordCalls::Type::UpdateEffectPeriodic:
+   {
+      FFBPeriodicEffect periodic = PayloadAs<FFBPeriodicEffect>(payload, record.payloadBytes);
+      if (record.payloadBytes > sizeof(FFBPeriodicEffect))
+      {
+         memcpy(directions, payload + sizeof(FFBPeriodicEffect), record.payloadBytes - sizeof(FFBPeriodicEffect));
+      }
+      return record.call == FFBRecordCalls::Type::UpdatePeriodic
+         ? DeviceUpdatePeriodic(device, effectType, &periodic, directions)
+         : DeviceUpdateFFBEffectPeriodic(device, effect, &periodic, directions);
+   }
+   case FFBRecordCalls::Type::UpdateCustomForce:
+   case FFBRecordCalls::Type::UpdateEffectCustomForce:
+   {
+      FFBRecordCustomForce recorded = PayloadAs<FFBRecordCustomForce>(payload, record.payloadBytes);
+      if (record.payloadBytes > sizeof(FFBRecordCustomForce))
+      {
+         memcpy(directions, payload + sizeof(FFBRecordCustomForce), record.payloadBytes - sizeof(FFBRecordCustomForce));
+      }
+      std::vector<LONG>& samples = state.silence[(size_t)recorded.channels * recorded.sampleCount];
+      samples.resize((size_t)recorded.channels * recorded.sampleCount);
+      FFBCustomForce customForce = { samples.empty() ? NULL : &samples[0], recorded.channels, recorded.sampleCount, recorded.samplePeriod, recorded.duration };
+      return record.call == FFBRecordCalls::Type::UpdateCustomForce
+         ? DeviceUpdateCustomForce(device, &customForce, directions)
+         : DeviceUpdateFFBEffectCustomForce(device, effect, &customForce, directions);
+   }
+   case FFBRecordCalls::Type::UpdateEffect:
+   case FFBRecordCalls::Type::UpdateFFBEffect:
+   {
+      FFBRecordEffectUpdate update = PayloadAs<FFBRecordEffectUpdate>(payload, record.payloadBytes);
+      const BYTE* params = payload + sizeof(update);
+      size_t paramsBytes = record.payloadBytes > sizeof(update) ? record.payloadBytes - sizeof(update) : 0;
+      union {
+         FFBConstantForceParams constantForce;
+         FFBRampForceParams rampForce;
+         FFBPeriodicParams periodic;
+         FFBConditionParams condition;
+         FFBCustomForceParams customForce;
+      } typed;
+      if (update.effectType == Effects::Type::CustomForce)
+      {
+         FFBRecordCustomForce recorded = PayloadAs<FFBRecordCustomForce>(params, paramsBytes);
+         std::vector<LONG>& samples = state.silence[(size_t)recorded.channels * recorded.sampleCount];
+         samples.resize((size_t)recorded.channels * recorded.sampleCount);
+         FFBCustomForce customForce = { samples.empty() ? NULL : &samples[0], recorded.channels, recorded.sampleCount, recorded.samplePeriod, recorded.duration };
+         memset(&typed, 0, sizeof(typed));
+         typed.customForce.customForce = customForce;
+         if (paramsBytes > sizeof(FFBRecordCustomForce))
+         {
+            size_t directionBytes = paramsBytes - sizeof(FFBRecordCustomForce);
+            memcpy(typed.customForce.directions, params + sizeof(FFBRecordCustomForce),
+               directionBytes < sizeof(typed.customForce.directions) ? directionBytes : sizeof(typed.customForce.directions));
+         }
+      }
+      else
+      {
+         typed = PayloadAs<decltype(typed)>(params, paramsBytes);
+      }
+      return record.call == FFBRecordCalls::Type::UpdateEffect
+         ? DeviceUpdateEffect(device, effectType, &typed, update.flags)
+         : DeviceUpdateFFBEffect(device, effect, &typed, update.flags);
+   }
+   case FFBRecordCalls::Type::UpdateGain:
+      return DeviceUpdateEffectGain(device, effectType, PayloadAs<float>(payload, record.payloadBytes));
+   case FFBRecordCalls::Type::SetEffectGain:
+      return DeviceSetFFBEffectGain(device, effect, PayloadAs<float>(payload, record.payloadBytes));
+   case FFBRecordCalls::Type::StartEffect:
+      return DeviceStartFFBEffect(device, effect);
+   case FFBRecordCalls::Type::StopEffect:
+      return DeviceStopFFBEffect(device, effect);
+   case FFBRecordCalls::Type::StartAllEffects:
+      DeviceStartAllFFBEffects(device);
+      return S_OK;
+   case FFBRecordCalls::Type::StopAllEffects:
+      DeviceStopAllFFBEffects(device);
+      return S_OK;
+   case FFBRecordCalls::Type::SetAutoCenter:
+      return DeviceSetAutoCenter(device, record.arg != 0);
+   case FFBRecordCalls::Type::SubmitCommand:
+   {
+      if (!state.batch.empty() && record.arg + 1 != state.batchRemaining)
+      {
+         // The rest of the previous batch was dropped by the recorder.
+         state.batch.clear();
+      }
+      state.batchRemaining = record.arg;
+      state.batch.push_back(PayloadAs<FFBCommand>(payload, record.payloadBytes));
+      if (record.arg != 0)
+      {
+         // More of the batch follows.
+         return S_FALSE;
+      }
+      state.batchResults.resize(state.batch.size());
+      HRESULT hr = DeviceSubmitFFBCommands(device, &state.batch[0], (int)state.batch.size(), &state.batchResults[0]);
+      state.batch.clear();
+      return hr;
+   }
+   case FFBRecordCalls::Type::StartOutputThread:
+      return DeviceStartForceOutputThread(device, (int)record.arg);
+   case FFBRecordCalls::Type::StopOutputThread:
+      DeviceStopForceOutputThread(device);
+      return S_OK;
+   case FFBRecordCalls::Type::SetOutputRate:
+      return DeviceSetForceOutputRate(device, (int)record.arg);
+   case FFBRecordCalls::Type::EnableSynthesis:
+   {
+      ForceSynthConfig config = PayloadAs<ForceSynthConfig>(payload, record.payloadBytes);
+      return DeviceEnableForceSynthesis(device, record.payloadBytes > 0 ? &config : NULL);
+   }
+   case FFBRecordCalls::Type::DisableSynthesis:
+      DeviceDisableForceSynthesis(device);
+      return S_OK;
+   case FFBRecordCalls::Type::SetEffectCapacity:
+      return DeviceSetFFBEffectCapacity(device, (int)record.arg);
+   case FFBRecordCalls::Type::ConfigureForceDsp:
+   {
+      ForceDspConfig config = PayloadAs<ForceDspConfig>(payload, record.payloadBytes);
+      return DeviceConfigureForceDsp(device, (int)record.arg, record.payloadBytes > 0 ? &config : NULL);
+   }
+   case FFBRecordCalls::Type::DisableForceDsp:
+      DeviceDisableForceDsp(device);
+      return S_OK;
+   case FFBRecordCalls::Type::EnableForceKeyframes:
+   {
+      FFBKeyframeConfig config = PayloadAs<FFBKeyframeConfig>(payload, record.payloadBytes);
+      return DeviceEnableForceKeyframes(device, record.payloadBytes > 0 ? &config : NULL);
+   }
+   case FFBRecordCalls::Type::DisableForceKeyframes:
+      DeviceDisableForceKeyframes(device);
+      return S_OK;
+   case FFBRecordCalls::Type::SubmitForceKeyframe:
+   {
+      FFBForceKeyframe keyframe = PayloadAs<FFBForceKeyframe>(payload, record.payloadBytes);
+      if (keyframe.timeUs != 0)
+      {
+         keyframe.timeUs += GetFFBClockMicroseconds();
+      }
+      return DeviceSubmitForceKeyframes(device, &keyframe, 1);
+   }
+   case FFBRecordCalls::Type::ConfigureForceMixer:
+   {
+      FFBForceMixerConfig config = PayloadAs<FFBForceMixerConfig>(payload, record.payloadBytes);
+      return DeviceConfigureForceMixer(device, record.payloadBytes > 0 ? &config : NULL);
+   }
+   case FFBRecordCalls::Type::CreateForceLayer:
+   {
+      FFBRecordForceLayer layer = PayloadAs<FFBRecordForceLayer>(payload, record.payloadBytes);
+      layer.name[FFB_FORCE_LAYER_NAME - 1] = '\0';
+      FFBForceLayerHandle created = 0;
+      HRESULT hr = DeviceCreateForceLayer(device, layer.name, &layer.config, &created);
+      if (SUCCEEDED(hr))
+      {
+         state.layers[std::make_pair(device, (FFBForceLayerHandle)record.arg)] = created;
+      }
+      return hr;
+   }
+   case FFBRecordCalls::Type::ConfigureForceLayer:
+   {
+      FFBForceLayerConfig config = PayloadAs<FFBForceLayerConfig>(payload, record.payloadBytes);
+      return DeviceConfigureForceLayer(device, MapLayer(state, device, record.arg), &config);
+   }
+   case FFBRecordCalls::Type::UpdateForceLayer:
+   {
+      float force[MAX_FFB_AXES];
+      memset(force, 0, sizeof(force));
+      memcpy(force, payload, record.payloadBytes < sizeof(force) ? record.payloadBytes : sizeof(force));
+      return DeviceUpdateForceLayer(device, MapLayer(state, device, record.arg), force);
+   }
+   case FFBRecordCalls::Type::DestroyForceLayer:
+   {
+      FFBForceLayerHandle layer = MapLayer(state, device, record.arg);
+      state.layers.erase(std::make_pair(device, (FFBForceLayerHandle)record.arg));
+      return DeviceDestroyForceLayer(device, layer);
+   }
+   default:
+      return E_NOTIMPL;
+   }
+}
+
+/**
+ * Directions or conditions a record carries, to size the simulated wheel.
+ */
+static int RecordAxes(const FFBRecordHeader& record, const BYTE* payload)
+{
+   switch (record.call)
+   {
+   case FFBRecordCalls::Type::UpdateConstantForce:
+   case FFBRecordCalls::Type::UpdateEffectConstantForce:
+      return record.payloadBytes / sizeof(LONG) - 1;
+   case FFBRecordCalls::Type::UpdateCondition:
+   case FFBRecordCalls::Type::UpdateEffectCondition:
+      return record.payloadBytes / sizeof(DICONDITION);
+   case FFBRecordCalls::Type::UpdatePeriodic:
+   case FFBRecordCalls::Type::UpdateEffectPeriodic:
+      return record.payloadBytes > sizeof(FFBPeriodicEffect) ? (record.payloadBytes - sizeof(FFBPeriodicEffect)) / sizeof(LONG) : 0;
+   case FFBRecordCalls::Type::UpdateCustomForce:
+   case FFBRecordCalls::Type::UpdateEffectCustomForce:
+      return record.payloadBytes > sizeof(FFBRecordCustomForce) ? (record.payloadBytes - sizeof(FFBRecordCustomForce)) / sizeof(LONG) : 0;
+   case FFBRecordCalls::Type::UpdateForceLayer:
+      return record.payloadBytes / sizeof(float);
+   case FFBRecordCalls::Type::SubmitCommand:
+   {
+      size_t header = offsetof(FFBCommand, gainPercent);
+      FFBCommand command = PayloadAs<FFBCommand>(payload, record.payloadBytes);
+      size_t bytes = record.payloadBytes > header ? record.payloadBytes - header : 0;
+      if (command.command == FFBCommands::Type::UpdateConstantForce)
+      {
+         return bytes / sizeof(LONG) - 1;
+      }
+      if (command.command == FFBCommands::Type::UpdateSpring || command.command == FFBCommands::Type::UpdateCondition)
+      {
+         return bytes / sizeof(DICONDITION);
+      }
+      if (command.command == FFBCommands::Type::UpdatePeriodic)
+      {
+         return bytes > sizeof(FFBPeriodicEffect) ? (bytes - sizeof(FFBPeriodicEffect)) / sizeof(LONG) : 0;
+      }
+      return 0;
+   }
+   default:
+      return 0;
+   }
+}
+
+static bool StartBackend(const ReplayOptions& options, const SimulatedDeviceConfig& device)
+{
+   if (options.directInput)
+   {
+      return SUCCEEDED(SelectFFBBackend(Backends::Type::DirectInput)) && SUCCEEDED(StartDirectInput());
+   }
+   return SUCCEEDED(SelectFFBBackend(Backends::Type::Simulated))
+      && SUCCEEDED(ConfigureSimulatedDevice(&device))
+      && SUCCEEDED(StartDirectInput());
+}
+
+static void Usage()
+{
+   printf("usage: ffb-replay FILE [--speed X] [--loop N] [--latency US] [--dinput]\n\n"
+      "  --speed X     play at X times the recorded speed, 0 for as fast as possible (1)\n"
+      "  --loop N      play the recording N times (1)\n"
+      "  --latency US  simulated driver call latency (0)\n"
+      "  --dinput      drive the attached devices instead of simulated ones (Windows)\n");
+}
+
+int main(int argc, char** argv)
+{
+   ReplayOptions options;
+   options.path = NULL;
+   options.speed = 1.0;
+   options.loops = 1;
+   options.directInput = false;
+   options.latencyMicroseconds = 0;
+   for (int i = 1; i < argc; i++)
+   {
+      std::string arg = argv[i];
+      bool hasValue = i + 1 < argc;
+      if (arg == "--speed" && hasValue)
+      {
+         options.speed = atof(argv[++i]);
+      }
+      else if (arg == "--loop" && hasValue)
+      {
+         options.loops = atoi(argv[++i]);
+      }
+      else if (arg == "--latency" && hasValue)
+      {
+         options.latencyMicroseconds = (DWORD)atoi(argv[++i]);
+      }
+      else if (arg == "--dinput")
+      {
+         options.directInput = true;
+      }
+      else if (arg.size() > 0 && arg[0] == '-')
+      {
+         Usage();
+         return arg == "--help" || arg == "-h" ? 0 : 1;
+      }
+      else
+      {
+         options.path = argv[i];
+      }
+   }
+   if (options.path == NULL || options.speed < 0 || options.loops < 1)
+   {
+      Usage();
+      return 1;
+   }
+
+   MappedFile file;
+   if (!file.Open(options.path, true))
+   {
+      fprintf(stderr, "cannot read %s\n", options.path);
+      return 1;
+   }
+   FFBRecordFileHeader header;
+   if (file.Size() < sizeof(header))
+   {
+      fprintf(stderr, "%s is not a recording\n", options.path);
+      return 1;
+   }
+   memcpy(&header, file.Data(), sizeof(header));
+   if (header.magic != FFB_RECORD_MAGIC || header.version != FFB_RECORD_VERSION
+      || header.headerSize < sizeof(header) || header.headerSize > file.Size()
+      || header.recordHeaderSize < sizeof(FFBRecordHeader))
+   {
+      fprintf(stderr, "%s is not a version %d recording\n", options.path, FFB_RECORD_VERSION);
+      return 1;
+   }
+
+   // Size the simulated wheels like the recorded devices.
+   SimulatedDeviceConfig device;
+   memset(&device, 0, sizeof(device));
+   device.deviceCount = 1;
+   device.axisCount = 1;
+   device.maxForce = DI_FFNOMINALMAX;
+   device.forceResolution = 1;
+   device.latencyMicroseconds = options.latencyMicroseconds;
+   uint64_t recordCount = 0;
+   uint64_t duration = 0;
+   std::map<FFBDeviceHandle, bool> recordedDevices;
+   FFBRecordHeader record;
+   const BYTE* payload;
+   RecordReader scan(file.Data(), file.Size(), header);
+   while (scan.Next(record, payload))
+   {
+      int axes = RecordAxes(record, payload);
+      device.axisCount = axes > device.axisCount ? (axes < MAX_FFB_AXES ? axes : MAX_FFB_AXES) : device.axisCount;
+      if (record.call == FFBRecordCalls::Type::OpenDevice && record.device != 0)
+      {
+         recordedDevices[record.device] = true;
+      }
+      duration = record.timestamp;
+      recordCount++;
+   }
+   device.deviceCount = recordedDevices.size() > 1 ? (int)recordedDevices.size() : 1;
+   printf("%s: %llu records over %.3f s, %d device(s), %d axes%s\n", options.path, (unsigned long long)recordCount,
+      duration / 1e9, device.deviceCount, device.axisCount, scan.Truncated() ? ", last record cut short" : "");
+
+   ReplayState state;
+   memset(state.totals, 0, sizeof(state.totals));
+   state.unmapped = 0;
+   double lateNs = 0;
+   double maxLateNs = 0;
+   uint64_t timedRecords = 0;
+   double replayNs = 0;
+   for (int loop = 0; loop < options.loops; loop++)
+   {
+      if (!StartBackend(options, device))
+      {
+         fprintf(stderr, "cannot start the backend\n");
+         return 1;
+      }
+      state.devices.clear();
+      state.effects.clear();
+      state.layers.clear();
+      state.batch.clear();
+
+      RecordReader reader(file.Data(), file.Size(), header);
+      ReplayClock::time_point start = ReplayClock::now();
+      while (reader.Next(record, payload))
+      {
+         if (record.call >= FFB_RECORD_CALL_COUNT)
+         {
+            continue;
+         }
+         if (options.speed > 0)
+         {
+            ReplayClock::time_point due = start + std::chrono::nanoseconds((int64_t)(record.timestamp / options.speed));
+            // Sleep most of the way, then spin for an accurate start.
+            std::this_thread::sleep_until(due - std::chrono::milliseconds(1));
+            while (ReplayClock::now() < due)
+            {
+            }
+            double late = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(ReplayClock::now() - due).count();
+            lateNs += late;
+            maxLateNs = late > maxLateNs ? late : maxLateNs;
+            timedRecords++;
+         }
+         if (record.device != 0 && record.call != FFBRecordCalls::Type::OpenDevice && MapDevice(state, record.device) == 0)
+         {
+            state.unmapped++;
+         }
+
+         ReplayClock::time_point callStart = ReplayClock::now();
+         HRESULT hr = Dispatch(state, record, payload);
+         double callNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(ReplayClock::now() - callStart).count();
+         CallTotals& totals = state.totals[record.call];
+         totals.totalNs += callNs;
+         if (hr == S_FALSE && record.call == FFBRecordCalls::Type::SubmitCommand)
+         {
+            // Counted with the last command of its batch.
+            continue;
+         }
+         totals.calls++;
+         totals.mismatches += SUCCEEDED(hr) != SUCCEEDED(record.result) ? 1 : 0;
+      }
+      replayNs += (double)std::chrono::duration_cast<std::chrono::nanoseconds>(ReplayClock::now() - start).count();
+
+      for (int i = 0; loop == options.loops - 1 && !options.directInput && i < device.deviceCount; i++)
+      {
+         SimulatedDeviceState sim;
+         if (SUCCEEDED(GetSimulatedDeviceState(i, &sim)))
+         {
+            printf("wheel %d: %u effects created, %u SetParameters, force %d\n", i, sim.effectsCreated, sim.setParametersCalls, sim.outputForce[0]);
+         }
+      }
+      StopDirectInput();
+   }
+
+   printf("%-26s %10s %12s %10s\n", "call", "calls", "ns/call", "mismatch");
+   uint64_t calls = 0;
+   for (int i = 0; i < FFB_RECORD_CALL_COUNT; i++)
+   {
+      const CallTotals& totals = state.totals[i];
+      if (totals.calls == 0)
+      {
+         continue;
+      }
+      printf("%-26s %10llu %12.1f %10llu\n", s_callNames[i], (unsigned long long)totals.calls,
+         totals.totalNs / totals.calls, (unsigned long long)totals.mismatches);
+      calls += totals.calls;
+   }
+   printf("%llu calls in %.3f s, %.0f calls/s", (unsigned long long)calls, replayNs / 1e9, replayNs > 0 ? calls / (replayNs / 1e9) : 0.0);
+   if (timedRecords > 0)
+   {
+      printf(", started %.1f us late on average, %.1f us at most", lateNs / timedRecords / 1000.0, maxLateNs / 1000.0);
+   }
+   printf("\n");
+   if (state.unmapped > 0)
+   {
+      printf("%llu records for devices the replay could not open\n", (unsigned long long)state.unmapped);
+   }
+   return 0;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <atomic>
+
+/**
+ * Wait-free single producer / single consumer "latest value" slot.
+ *
+ * The writer fills its private back buffer and swaps it with the shared
+ * middle buffer, the reader swaps the middle buffer into its private front
+ * buffer when something new was published. Neither side ever blocks or
+ * retries, and the reader always sees the most recent complete value.
+ */
+template <typename T>
+class TripleBuffer
+{
+public:
+   TripleBuffer() : m_middle(1), m_back(0), m_front(2)
+   {
+   }
+
+   /**
+    * Publish a new value. Only one thread may write.
+    */
+   void Write(const T& value)
+   {
+      m_buffers[m_back] = value;
+      m_back = m_middle.exchange(m_back | FRESH, std::memory_order_acq_rel) & INDEX;
+   }
+
+   /**
+    * Returns true and copies the latest value if one was published since
+    * the last read. Only one thread may read.
+    */
+   bool Read(T& value)
+   {
+      if ((m_middle.load(std::memory_order_relaxed) & FRESH) == 0)
+      {
+         return false;
+      }
+      m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & INDEX;
+      value = m_buffers[m_front];
+      return true;
+   }
+
+private:
+   static const int INDEX = 0x3;
+   static const int FRESH = 0x4;
+
+   T m_buffers[3];
+   std::atomic<int> m_middle;
+   int m_back;
+   int m_front;
+};
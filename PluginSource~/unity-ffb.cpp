@@ -5,540 +5,2453 @@
 #include "framework.h"
 #include "unity-ffb.h"
 #include "util.h"
-
+#include "backend.h"
+#include "device-context.h"
+#include "enum-snapshot.h"
+#include "device-monitor.h"
+#include "init-pipeline.h"
+#include "call-stats.h"
+#include "recorder.h"
+#include "mpsc-queue.h"
+#include "capability-cache.h"
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef _WIN32
+Backends::Type          g_eBackendType = Backends::Type::DirectInput;
+#else
+Backends::Type          g_eBackendType = Backends::Type::Simulated;
+#endif
+FFBBackend*             g_pBackend = NULL;
+
+EnumSnapshot<FFBDeviceRecord> g_deviceSnapshot;
+// DeviceInfo view of g_deviceSnapshot for EnumerateFFBDevices.
 std::vector<DeviceInfo> g_vDeviceInstances;
-std::vector<DeviceAxisInfo> g_vDeviceAxes;
-std::map<Effects::Type, LPDIRECTINPUTEFFECT> g_mEffects;
-std::map<Effects::Type, DIEFFECT> g_mDIEFFECTs;
+std::vector<GuidText>   g_vDeviceGuids;
 
 /**
- * This initializes the DirectInput 8 interface.
- * 
- * Once this is initialized, we can then enumerate devices
- * and select/create a Force Feedback device.
+ * Open devices, in the order they were opened. Handles count up from 1 and
+ * are never reused so a stale handle cannot address a device opened later,
+ * a closed device leaves no entry behind. Only touched from the game
+ * thread, each device's output thread only sees its own context.
  */
-HRESULT StartDirectInput()
-{
-   if (g_pDI != NULL)
-   {
-      return S_OK;
-   }
-   return DirectInput8Create(
-      GetModuleHandle(NULL),
-      DIRECTINPUT_VERSION,
-      IID_IDirectInput8,
-      (void**)&g_pDI,
-      NULL
-   );
-}
+struct DeviceEntry {
+   FFBDeviceHandle handle;
+   FFBDeviceContext* pContext;
+};
+std::vector<DeviceEntry> g_vDevices;
+FFBDeviceHandle         g_hLastDevice = 0;
+// The device the single device exports operate on.
+FFBDeviceHandle         g_hDefaultDevice = 0;
+DeviceMonitor*          g_pMonitor = NULL;
+InitPipeline*           g_pInit = NULL;
+Recorder*               g_pRecorder = NULL;
+CapabilityCache*        g_pCapabilityCache = NULL;
+// Since StartDirectInput, only the first enumeration is answered from the
+// capability cache.
+bool                    g_bDevicesEnumerated = false;
+// Effects pooled by the devices opened next, all zero for none.
+FFBEffectPoolConfig     g_effectPoolConfig = {};
+
+struct QueuedCommand {
+   FFBDeviceHandle device;
+   FFBCommand command;
+};
 
 /**
- * Returns an array of DeviceInfo's that has some basic information
- * about each force feedback device. To create a device, pass its
- * guidInstance to the CreateDevice function.
+ * Commands pushed by EnqueueFFBCommands from any thread, waiting for the
+ * game thread to drain them. Nothing else of the plugin is touched from the
+ * pushing threads, the device handle is only checked once drained.
  */
-DeviceInfo* EnumerateFFBDevices(int &deviceCount)
+MpscQueue<QueuedCommand, FFB_COMMAND_QUEUE_CAPACITY> g_commandQueue;
+std::atomic<DWORD>      g_nCommandsEnqueued(0);
+std::atomic<DWORD>      g_nCommandsDropped(0);
+DWORD                   g_nCommandsDrained = 0;
+DWORD                   g_nCommandsFailed = 0;
+// Reused by DrainFFBCommandQueue.
+std::vector<QueuedCommand> g_vDrainedCommands;
+std::vector<FFBDeviceHandle> g_vDrainDevices;
+std::vector<FFBCommand> g_vDrainCommands;
+std::vector<HRESULT>    g_vDrainResults;
+
+static FFBDeviceContext* GetDevice(FFBDeviceHandle device)
 {
-   if (g_pDI == NULL)
-   {
-      return NULL;
-   }
-   ClearDeviceInstances();
-   HRESULT hr = g_pDI->EnumDevices(
-      DI8DEVCLASS_GAMECTRL,
-      _cbEnumFFBDevices,
-      NULL,
-      DIEDFL_ATTACHEDONLY | DIEDFL_FORCEFEEDBACK
-   );
-   if (g_vDeviceInstances.size() > 0)
+   for (const DeviceEntry& entry : g_vDevices)
    {
-      deviceCount = (int)g_vDeviceInstances.size();
-      return &g_vDeviceInstances[0];
-   }
-   else {
-      deviceCount = 0;
+      if (entry.handle == device)
+      {
+         return entry.pContext;
+      }
    }
    return NULL;
 }
 
-/**
- * Called once for each enumerated force feedback device. Each found device is pushed
- * to an array that will be returned.
- */
-BOOL CALLBACK _cbEnumFFBDevices(const DIDEVICEINSTANCE* pInst, void* pContext)
+static FFBDeviceHandle AddDevice(FFBDeviceContext* pContext)
 {
-   DeviceInfo di = { 0 };
-
-   OLECHAR* guidInstance;
-   StringFromCLSID(pInst->guidInstance, &guidInstance);
-   OLECHAR* guidProduct;
-   StringFromCLSID(pInst->guidProduct, &guidProduct);
-
-   std::string strGuidInstance = utf16ToUTF8(guidInstance);
-   std::string strGuidProduct = utf16ToUTF8(guidProduct);
-   std::string strInstanceName = utf16ToUTF8(pInst->tszInstanceName);
-   std::string strProductName = utf16ToUTF8(pInst->tszProductName);
-
-   di.guidInstance = new char[strGuidInstance.length() + 1];
-   di.guidProduct = new char[strGuidProduct.length() + 1];
-   di.instanceName = new char[strInstanceName.length() + 1];
-   di.productName = new char[strProductName.length() + 1];
-
-   strcpy_s(di.guidInstance, strGuidInstance.length() + 1, strGuidInstance.c_str());
-   strcpy_s(di.guidProduct, strGuidProduct.length() + 1, strGuidProduct.c_str());
-   di.deviceType = pInst->dwDevType;
-   strcpy_s(di.instanceName, strInstanceName.length() + 1, strInstanceName.c_str());
-   strcpy_s(di.productName, strProductName.length() + 1, strProductName.c_str());
+   DeviceEntry entry = { ++g_hLastDevice, pContext };
+   g_vDevices.push_back(entry);
+   return entry.handle;
+}
 
-   g_vDeviceInstances.push_back(di);
+static FFBDeviceHandle FindOpenDevice(REFGUID guidInstance)
+{
+   for (const DeviceEntry& entry : g_vDevices)
+   {
+      if (entry.pContext->GetInstanceGuid() == guidInstance)
+      {
+         return entry.handle;
+      }
+   }
+   return 0;
+}
 
-   return DIENUM_CONTINUE;
+static bool InitPending()
+{
+   return g_pInit != NULL && g_pInit->IsRunning();
 }
 
 /**
- * Create a force feedback device. The guid of the device you want to create must
- * be passed in. The guid can be obtained by looking at the array of enumerated
- * devices.
+ * Take over the backend and device of a finished StartFFBInitAsync, the
+ * device becomes the default device.
  */
-HRESULT CreateFFBDevice(LPCSTR guidInstance)
+static void AdoptInit()
 {
-   if (g_pDevice) {
-      FreeFFBDevice();
+   if (g_pInit == NULL)
+   {
+      return;
    }
-   GUID deviceGuid;
-   int wcharCount = MultiByteToWideChar(CP_UTF8, 0, guidInstance, -1, NULL, 0);
-   WCHAR* wstrGuidInstance = new WCHAR[wcharCount];
-   MultiByteToWideChar(CP_UTF8, 0, guidInstance, -1, wstrGuidInstance, wcharCount);
-   CLSIDFromString(wstrGuidInstance, &deviceGuid);
-   delete[] wstrGuidInstance;
-
-   LPDIRECTINPUTDEVICE8 pDevice;
-
-   HRESULT hr = g_pDI->CreateDevice(deviceGuid, &pDevice, NULL);
-
-   if (FAILED(hr))
+   FFBBackend* pBackend;
+   FFBDeviceContext* pContext;
+   g_pInit->Adopt(&pBackend, &pContext);
+   if (pBackend != NULL)
    {
-      return hr;
+      g_pBackend = pBackend;
+      if (g_pCapabilityCache != NULL && g_pInit->UsedCachedDevices())
+      {
+         g_bDevicesEnumerated = true;
+         g_pCapabilityCache->StartDeviceCheck(g_pBackend);
+      }
    }
-
-   // Not sure if this is necessary.
-   if (FAILED(hr = pDevice->SetDataFormat(&c_dfDIJoystick)))
+   if (pContext != NULL)
    {
-      return hr;
+      g_hDefaultDevice = AddDevice(pContext);
+      g_pInit->SetDevice(g_hDefaultDevice);
+      if (g_pCapabilityCache != NULL)
+      {
+         g_pCapabilityCache->CountOpen(g_pInit->CacheHit());
+      }
    }
+}
 
-   // Find the main window associated with this process.
-   HWND hWnd = FindMainWindow(GetCurrentProcessId());
-   // Set the cooperative level to let DInput know how this device should
-   // interact with the system and with other DInput applications.
-   // Exclusive access is required in order to perform force feedback.
-   if (FAILED(hr = pDevice->SetCooperativeLevel(hWnd, DISCL_EXCLUSIVE | DISCL_BACKGROUND)))
+/**
+ * Keep what was learned about the device in the capability cache.
+ */
+static void RememberDevice(FFBDeviceContext* pContext)
+{
+   CapabilityEntry entry;
+   if (g_pCapabilityCache != NULL && pContext->DescribeCapabilities(entry) == S_OK)
    {
-      return hr;
+      g_pCapabilityCache->Update(entry);
    }
+}
 
-   if (FAILED(hr = pDevice->Acquire()))
+static void RememberDevices()
+{
+   for (const DeviceEntry& entry : g_vDevices)
    {
-      return hr;
+      RememberDevice(entry.pContext);
    }
+}
 
-   g_pDevice = pDevice;
-
-   return S_OK;
+static bool Recording()
+{
+   return g_pRecorder != NULL && g_pRecorder->IsRecording();
 }
 
 /**
- * This function will return info about Force Feedback Axes associate with
- * the currently selected device. For a steering wheel, there's typically
- * only 1 axis. This function 
+ * Passes hr through, recording the call while StartFFBRecording is on.
  */
-DeviceAxisInfo* EnumerateFFBAxes(int &axisCount)
+static HRESULT Recorded(HRESULT hr, FFBRecordCalls::Type call, FFBDeviceHandle device, uint32_t arg, const void* payload = NULL, size_t payloadBytes = 0)
 {
-   // For now assume only one active FFB device at a time.
-   if (g_pDevice == NULL)
+   if (Recording())
    {
-      return NULL;
+      g_pRecorder->Record(call, device, hr, arg, payload, payloadBytes);
    }
+   return hr;
+}
 
-   DWORD _axisCount = 0;
-   ClearDeviceAxes();
-   g_pDevice->EnumObjects(_cbEnumFFBAxes, (void*)&_axisCount, DIDFT_AXIS);
+// How many entries the direction and condition arrays passed for the
+// device hold, 0 if it is not open.
+static int RecordedAxes(FFBDeviceContext* pContext)
+{
+   return pContext != NULL ? pContext->EffectAxisCount() : 0;
+}
 
-   if (g_vDeviceAxes.size() > 0)
+static HRESULT RecordedConstantForce(HRESULT hr, FFBRecordCalls::Type call, FFBDeviceHandle device, uint32_t arg, FFBDeviceContext* pContext, LONG magnitude, const LONG* directions)
+{
+   if (Recording())
    {
-      axisCount = (int)g_vDeviceAxes.size();
-      return &g_vDeviceAxes[0];
-   }
-   else {
-      axisCount = 0;
+      FFBConstantForceParams target;
+      int axisCount = directions != NULL ? RecordedAxes(pContext) : 0;
+      target.magnitude = magnitude;
+      if (axisCount > 0)
+      {
+         memcpy(target.directions, directions, sizeof(LONG) * axisCount);
+      }
+      g_pRecorder->Record(call, device, hr, arg, &target, sizeof(LONG) * (1 + axisCount));
    }
-   return NULL;
+   return hr;
 }
 
-BOOL CALLBACK _cbEnumFFBAxes(const DIDEVICEOBJECTINSTANCE* pdidoi, void* pContext)
+static HRESULT RecordedConditions(HRESULT hr, FFBRecordCalls::Type call, FFBDeviceHandle device, uint32_t arg, FFBDeviceContext* pContext, const DICONDITION* conditions)
 {
-   if ((pdidoi->dwFlags & DIDOI_FFACTUATOR) != 0)
+   if (Recording())
    {
-      DWORD* axisCount = (DWORD*)pContext;
-      (*axisCount)++;
-
-      DeviceAxisInfo dai = { 0 };
-      int daiSize = sizeof(DeviceAxisInfo);
-      OLECHAR* guidType;
-      StringFromCLSID(pdidoi->guidType, &guidType);
-
-      std::string strGuidType = utf16ToUTF8(guidType);
-      std::string strName = utf16ToUTF8(pdidoi->tszName);
-      
-      dai.guidType = new char[strGuidType.length() + 1];
-      dai.name = new char[strName.length() + 1];
-
-      strcpy_s(dai.guidType, strGuidType.length() + 1, strGuidType.c_str());
-      strcpy_s(dai.name, strName.length() + 1, strName.c_str());
-
-      dai.offset = pdidoi->dwOfs;
-      dai.type = pdidoi->dwType;
-      dai.flags = pdidoi->dwFlags;
-      dai.ffMaxForce = pdidoi->dwFFMaxForce;
-      dai.ffForceResolution = pdidoi->dwFFForceResolution;
-      dai.collectionNumber = pdidoi->wCollectionNumber;
-      dai.designatorIndex = pdidoi->wDesignatorIndex;
-      dai.usagePage = pdidoi->wUsagePage;
-      dai.usage = pdidoi->wUsage;
-      dai.dimension = pdidoi->dwDimension;
-      dai.exponent = pdidoi->wExponent;
-      dai.reportId = pdidoi->wReportId;
-
-      g_vDeviceAxes.push_back(dai);
+      g_pRecorder->Record(call, device, hr, arg, conditions, conditions != NULL ? sizeof(DICONDITION) * RecordedAxes(pContext) : 0);
    }
-
-   return DIENUM_CONTINUE;
+   return hr;
 }
 
-/**
- * Add a Force Feedback Effect to the current device.
- * Currently only supports ConstantForce and Spring.
- * Only one of each effect can be added at a time.
- * Only supports up to 2 axes max.
- */
-HRESULT AddFFBEffect(Effects::Type effectType)
+static HRESULT RecordedPeriodic(HRESULT hr, FFBRecordCalls::Type call, FFBDeviceHandle device, uint32_t arg, FFBDeviceContext* pContext, const FFBPeriodicEffect* periodic, const LONG* directions)
 {
-   if (g_pDevice == NULL)
+   if (Recording() && periodic != NULL)
    {
-      return E_FAIL;
+      FFBPeriodicParams target;
+      int axisCount = directions != NULL ? RecordedAxes(pContext) : 0;
+      target.effect = *periodic;
+      if (axisCount > 0)
+      {
+         memcpy(target.directions, directions, sizeof(LONG) * axisCount);
+      }
+      g_pRecorder->Record(call, device, hr, arg, &target, sizeof(FFBPeriodicEffect) + sizeof(LONG) * axisCount);
    }
+   return hr;
+}
 
-   if (g_mEffects.find(effectType) != g_mEffects.end())
+static HRESULT RecordedCustomForce(HRESULT hr, FFBRecordCalls::Type call, FFBDeviceHandle device, uint32_t arg, FFBDeviceContext* pContext, const FFBCustomForce* customForce, const LONG* directions)
+{
+   if (Recording() && customForce != NULL)
    {
-      // You cannot add an effect that is already added.
-      return E_ABORT;
-   }
-
-   int axisCount = (int)g_vDeviceAxes.size();
-   if (axisCount == 0)
-   {
-      // Must run EnumerateAxes first.
-      return E_BOUNDS;
-   }
-   
-   DWORD* axes = new DWORD[axisCount];
-   LONG* directions = new LONG[axisCount];
-   
-   // Populate the rgdwAxes value using data
-   // from the Axis enumeration.
-   // This should make it so it can support up to 6 axes.
-   for (int i = 0; i < axisCount; i++)
-   {
-      DeviceAxisInfo axis = g_vDeviceAxes[i];
-
-      // This is ugly due to storing GUIDs as strings for C#
-      GUID axisTypeGuid;
-      int wcharCount = MultiByteToWideChar(CP_UTF8, 0, axis.guidType, -1, NULL, 0);
-      WCHAR* wstrGuidInstance = new WCHAR[wcharCount];
-      MultiByteToWideChar(CP_UTF8, 0, axis.guidType, -1, wstrGuidInstance, wcharCount);
-      CLSIDFromString(wstrGuidInstance, &axisTypeGuid);
-      delete[] wstrGuidInstance;
-      
-      axes[i] = GuidToDIJOFS(axisTypeGuid);
-      directions[i] = 0;
-   }
-
-   DIEFFECT effect = { 0 };
-   effect.dwSize = sizeof(DIEFFECT);
-   effect.dwFlags = DIEFF_CARTESIAN | DIEFF_OBJECTOFFSETS;
-   effect.dwDuration = INFINITE;
-   effect.dwSamplePeriod = 0;
-   effect.dwGain = DI_FFNOMINALMAX;
-   effect.dwTriggerButton = DIEB_NOTRIGGER;
-   effect.dwTriggerRepeatInterval = 0;
-   effect.cAxes = axisCount;
-   effect.rgdwAxes = axes;
-   effect.rglDirection = directions;
-   effect.lpEnvelope = NULL;
-   effect.dwStartDelay = 0;
-
-   GUID guidType = {};
-   ZeroMemory(&guidType, sizeof(GUID));
-
-   DICONSTANTFORCE* constantForce = NULL;
-   DICONDITION* conditions = NULL;
-   if (effectType == Effects::Type::ConstantForce)
-   {
-      constantForce = new DICONSTANTFORCE();
-      constantForce->lMagnitude = 0;
-      effect.cbTypeSpecificParams = sizeof(DICONSTANTFORCE);
-      effect.lpvTypeSpecificParams = constantForce;
-      guidType = GUID_ConstantForce;
-   }
-   else if (effectType == Effects::Type::Spring)
-   {
-      conditions = new DICONDITION[axisCount];
-      ZeroMemory(conditions, sizeof(DICONDITION) * axisCount);
-      effect.cbTypeSpecificParams = sizeof(DICONDITION) * axisCount;
-      effect.lpvTypeSpecificParams = conditions;
-      guidType = GUID_Spring;
-   }
-   
-   HRESULT hr = E_FAIL;
-   if (guidType != GUID_NULL)
-   {
-      LPDIRECTINPUTEFFECT pEffect;
-      hr = g_pDevice->CreateEffect(guidType, &effect, &pEffect, NULL);
-      if (!FAILED(hr))
+      BYTE payload[sizeof(FFBRecordCustomForce) + sizeof(LONG) * MAX_FFB_AXES];
+      FFBRecordCustomForce recorded = { customForce->channels, customForce->sampleCount, customForce->samplePeriod, customForce->duration };
+      int axisCount = directions != NULL ? RecordedAxes(pContext) : 0;
+      memcpy(payload, &recorded, sizeof(recorded));
+      if (axisCount > 0)
       {
-         hr = S_OK;
-         g_mEffects[effectType] = pEffect;
-         g_mDIEFFECTs[effectType] = effect;
-         pEffect->Start(1, 0);
+         memcpy(payload + sizeof(recorded), directions, sizeof(LONG) * axisCount);
       }
+      g_pRecorder->Record(call, device, hr, arg, payload, sizeof(recorded) + sizeof(LONG) * axisCount);
    }
-
    return hr;
 }
 
+static_assert(sizeof(FFBRecordEffectUpdate) + sizeof(FFBConditionParams) <= FFB_RECORD_MAX_PAYLOAD, "FFB_RECORD_MAX_PAYLOAD too small");
+
 /**
- * Remove a force feedback effect by type.
+ * Record an UpdateEffect of an effectType effect, its params whole but for
+ * a custom force's samples.
  */
-HRESULT RemoveFFBEffect(Effects::Type effectType)
+static HRESULT RecordedEffectUpdate(HRESULT hr, FFBRecordCalls::Type call, FFBDeviceHandle device, uint32_t arg, Effects::Type effectType, const void* params, DWORD flags)
 {
-   HRESULT hr = E_FAIL;
-
-   if (g_mEffects.find(effectType) != g_mEffects.end())
+   if (Recording() && params != NULL && effectType >= 0 && effectType < FFB_EFFECT_TYPE_COUNT)
    {
-      LPDIRECTINPUTEFFECT pEffect = g_mEffects[effectType];
-
-      pEffect->Stop();
-      pEffect->Release();
-      g_mEffects.erase(effectType);
-      g_mDIEFFECTs.erase(effectType);
-
-      hr = S_OK;
+      BYTE payload[FFB_RECORD_MAX_PAYLOAD];
+      FFBRecordEffectUpdate update = { (uint32_t)effectType, flags };
+      size_t payloadBytes = sizeof(update);
+      memcpy(payload, &update, sizeof(update));
+      if (effectType == Effects::Type::CustomForce)
+      {
+         const FFBCustomForceParams* customForce = (const FFBCustomForceParams*)params;
+         const FFBCustomForce& chunk = customForce->customForce;
+         FFBRecordCustomForce recorded = { chunk.channels, chunk.sampleCount, chunk.samplePeriod, chunk.duration };
+         memcpy(payload + payloadBytes, &recorded, sizeof(recorded));
+         payloadBytes += sizeof(recorded);
+         memcpy(payload + payloadBytes, customForce->directions, sizeof(customForce->directions));
+         payloadBytes += sizeof(customForce->directions);
+      }
+      else
+      {
+         DWORD paramsSize = EFFECT_TYPES[effectType].paramsSize;
+         memcpy(payload + payloadBytes, params, paramsSize);
+         payloadBytes += paramsSize;
+      }
+      g_pRecorder->Record(call, device, hr, arg, payload, payloadBytes);
    }
-
    return hr;
 }
 
 /**
- * This will start all force feedback effects.
+ * Record each command of a batch, cut after the parameters its command
+ * uses. results may be NULL, the commands then all get hr.
  */
-void StartAllFFBEffects()
+static void RecordCommands(HRESULT hr, FFBDeviceHandle device, FFBDeviceContext* pContext, const FFBCommand* commands, int commandCount, const HRESULT* results)
 {
-   for (auto const& effect : g_mEffects) {
-      if (effect.second != NULL) {
-         effect.second->Start(1, 0);
+   if (!Recording() || commands == NULL)
+   {
+      return;
+   }
+   int axisCount = RecordedAxes(pContext);
+   for (int i = 0; i < commandCount; i++)
+   {
+      const FFBCommand& command = commands[i];
+      size_t bytes = offsetof(FFBCommand, gainPercent);
+      switch (command.command)
+      {
+      case FFBCommands::Type::UpdateConstantForce:
+         bytes += sizeof(LONG) * (1 + axisCount);
+         break;
+      case FFBCommands::Type::UpdateSpring:
+      case FFBCommands::Type::UpdateCondition:
+         bytes += sizeof(DICONDITION) * axisCount;
+         break;
+      case FFBCommands::Type::UpdatePeriodic:
+         bytes += sizeof(FFBPeriodicEffect) + sizeof(LONG) * axisCount;
+         break;
+      case FFBCommands::Type::SetGain:
+         bytes += sizeof(float);
+         break;
+      default:
+         break;
       }
+      g_pRecorder->Record(FFBRecordCalls::Type::SubmitCommand, device, results != NULL ? results[i] : hr, commandCount - 1 - i, &command, bytes);
    }
 }
 
 /**
- * This will stop all force feedback effects.
+ * Describe a device that was set up before recording started as the calls
+ * that set it up: open, auto center, synthesis, an effect of each type it
+ * has and the output thread.
  */
-void StopAllFFBEffects()
+static void RecordDeviceState(FFBDeviceHandle device, FFBDeviceContext* pContext)
 {
-   for (auto const& effect : g_mEffects) {
-      if (effect.second != NULL) {
-         effect.second->Stop();
+   Recorded(S_OK, FFBRecordCalls::Type::OpenDevice, device, 0, &pContext->GetInstanceGuid(), sizeof(GUID));
+   if (pContext->GetAutoCenter() >= 0)
+   {
+      Recorded(S_OK, FFBRecordCalls::Type::SetAutoCenter, device, pContext->GetAutoCenter());
+   }
+   if (pContext->IsSynthEnabled())
+   {
+      Recorded(S_OK, FFBRecordCalls::Type::EnableSynthesis, device, 0);
+   }
+   if (pContext->IsKeyframesEnabled())
+   {
+      Recorded(S_OK, FFBRecordCalls::Type::EnableForceKeyframes, device, 0, &pContext->GetKeyframeConfig(), sizeof(FFBKeyframeConfig));
+   }
+   if (pContext->IsDspEnabled())
+   {
+      for (int axis = 0; axis < pContext->EffectAxisCount(); axis++)
+      {
+         ForceDspConfig config;
+         if (pContext->GetDspConfig(axis, config))
+         {
+            Recorded(S_OK, FFBRecordCalls::Type::ConfigureForceDsp, device, axis, &config, sizeof(config));
+         }
+         else
+         {
+            Recorded(S_OK, FFBRecordCalls::Type::ConfigureForceDsp, device, axis);
+         }
+      }
+   }
+   if (pContext->ForceLayerCount() > 0)
+   {
+      Recorded(S_OK, FFBRecordCalls::Type::ConfigureForceMixer, device, 0, &pContext->GetMixerConfig(), sizeof(FFBForceMixerConfig));
+      for (int i = 0; i < pContext->ForceLayerCount(); i++)
+      {
+         FFBRecordForceLayer layer;
+         ZeroMemory(&layer, sizeof(layer));
+         LPCSTR name;
+         FFBForceLayerHandle handle = pContext->ForceLayerAt(i, name, layer.config);
+         memcpy(layer.name, name, strlen(name));
+         Recorded(S_OK, FFBRecordCalls::Type::CreateForceLayer, device, handle, &layer, sizeof(layer));
+      }
+   }
+   bool anyRunning = false;
+   for (int type = 0; type < EFFECT_TYPE_COUNT; type++)
+   {
+      bool running;
+      if (pContext->GetTypeEffectState((Effects::Type)type, running))
+      {
+         Recorded(S_OK, FFBRecordCalls::Type::AddEffect, device, type);
+         anyRunning = anyRunning || running;
       }
    }
+   if (anyRunning)
+   {
+      Recorded(S_OK, FFBRecordCalls::Type::StartAllEffects, device, 0);
+   }
+   ForceOutputStats output;
+   pContext->GetOutputStats(output);
+   if (output.running)
+   {
+      Recorded(S_OK, FFBRecordCalls::Type::StartOutputThread, device, output.rateHz);
+   }
 }
 
 /**
- * Update the gain for the specified effect.
+ * Select which backend StartDirectInput creates. DirectInput is the default
+ * on Windows and the only choice that talks to real hardware, the simulated
+ * backend is the default (and only option) everywhere else.
  *
- * Takes gainPercent value between 0 - 1 and multiplies with
- * DI_FFNOMINALMAX (10000)
+ * Must be called before StartDirectInput.
  */
-HRESULT UpdateEffectGain(Effects::Type effectType, float gainPercent)
+HRESULT SelectFFBBackend(Backends::Type backend)
 {
-   HRESULT hr = E_FAIL;
-
-   if (g_mEffects.find(effectType) != g_mEffects.end())
+   if (g_pBackend != NULL || InitPending())
    {
-      LPDIRECTINPUTEFFECT pEffect = g_mEffects[effectType];
-      DIEFFECT effect = g_mDIEFFECTs[effectType];
-      effect.dwSize = sizeof(DIEFFECT);
-      effect.dwGain = (DWORD)(clamp(gainPercent, 0.0, 1.0) * DI_FFNOMINALMAX);
-
-      hr = pEffect->SetParameters(&effect, DIEP_GAIN | DIEP_START);
+      return E_ABORT;
    }
-
-   return hr;
+#ifndef _WIN32
+   if (backend == Backends::Type::DirectInput)
+   {
+      return E_NOTIMPL;
+   }
+#endif
+   if (backend != Backends::Type::DirectInput && backend != Backends::Type::Simulated)
+   {
+      return E_INVALIDARG;
+   }
+   g_eBackendType = backend;
+   return S_OK;
 }
 
 /**
- * Update the Constant Force Effect.
- * 
- * Magnitude is the magnitude of the force on all axes.
- * Directions is an array of directions for each axis on the device.
- * The size of the array must match the number of axes on the device.
+ * Keep what enumerating and probing devices finds in a file at path, so
+ * the next start can skip it: the first enumeration is answered from the
+ * file, and devices opened from it get their axes and capabilities without
+ * probing them. Both are checked against the devices in the background,
+ * devices that changed or were removed are updated in the file when it is
+ * saved. A missing or outdated file is written from scratch.
+ *
+ * Call it before StartDirectInput or StartFFBInitAsync, it replaces a
+ * cache enabled before. The file is saved by StopDirectInput.
  */
-HRESULT UpdateConstantForce(LONG magnitude, LONG* directions)
+HRESULT EnableFFBCapabilityCache(LPCSTR path)
 {
-   HRESULT hr = E_FAIL;
-
-   if (g_mEffects.find(Effects::Type::ConstantForce) != g_mEffects.end())
+   if (path == NULL)
    {
-      LPDIRECTINPUTEFFECT pEffect = g_mEffects[Effects::Type::ConstantForce];
-
-      DICONSTANTFORCE constantForce;
-
-      int axisCount = (int)g_vDeviceAxes.size();
-
-      constantForce.lMagnitude = magnitude;
-      
-      DIEFFECT effect = g_mDIEFFECTs[Effects::Type::ConstantForce];
-      effect.cAxes = axisCount;
-      for (int i = 0; i < axisCount; i++) {
-         effect.rglDirection[i] = directions[i];
-      }
-      effect.cbTypeSpecificParams = sizeof(DICONSTANTFORCE);
-      effect.lpvTypeSpecificParams = &constantForce;
-
-      hr = pEffect->SetParameters(&effect, DIEP_DIRECTION | DIEP_TYPESPECIFICPARAMS | DIEP_START);
+      return E_POINTER;
    }
-
-   return hr;
+   if (InitPending())
+   {
+      return E_PENDING;
+   }
+   DisableFFBCapabilityCache();
+   g_pCapabilityCache = new CapabilityCache();
+   return g_pCapabilityCache->Open(path);
 }
 
 /**
- * Updates the spring effect. You must pass an array of conditions that's
- * size matches the number of axes on the device.
+ * Save the capability cache and stop using it.
  */
-HRESULT UpdateSpring(DICONDITION* conditions)
+void DisableFFBCapabilityCache()
 {
-   HRESULT hr = E_FAIL;
+   if (g_pCapabilityCache == NULL)
+   {
+      return;
+   }
+   RememberDevices();
+   g_pCapabilityCache->StopDeviceCheck();
+   g_pCapabilityCache->Save();
+   SAFE_DELETE(g_pCapabilityCache);
+}
 
-   if (g_mEffects.find(Effects::Type::Spring) != g_mEffects.end())
+/**
+ * Write what was learned about the open devices so far, S_FALSE if the
+ * file is up to date. Snapshots of the cache are invalid afterwards.
+ */
+HRESULT SaveFFBCapabilityCache()
+{
+   if (g_pCapabilityCache == NULL)
    {
-      LPDIRECTINPUTEFFECT pEffect = g_mEffects[Effects::Type::Spring];
+      return E_FAIL;
+   }
+   RememberDevices();
+   return g_pCapabilityCache->Save();
+}
 
-      int axisCount = (int)g_vDeviceAxes.size();
+/**
+ * The cached devices as a snapshot of FFBCapabilityRecord's, NULL if
+ * nothing was loaded. Valid until the cache is saved or disabled.
+ */
+HRESULT GetFFBCapabilityCacheSnapshot(const FFBEnumSnapshot** snapshot)
+{
+   if (snapshot == NULL)
+   {
+      return E_POINTER;
+   }
+   *snapshot = NULL;
+   if (g_pCapabilityCache == NULL)
+   {
+      return E_FAIL;
+   }
+   *snapshot = g_pCapabilityCache->GetSnapshot();
+   return S_OK;
+}
 
-      DIEFFECT effect = g_mDIEFFECTs[Effects::Type::Spring];
-      effect.cAxes = axisCount;
-      effect.cbTypeSpecificParams = sizeof(DICONDITION) * axisCount;
-      for (int i = 0; i < axisCount; i++) {
-         ((DICONDITION*)effect.lpvTypeSpecificParams)[i].lOffset = conditions[i].lOffset;
-         ((DICONDITION*)effect.lpvTypeSpecificParams)[i].lPositiveCoefficient = conditions[i].lPositiveCoefficient;
-         ((DICONDITION*)effect.lpvTypeSpecificParams)[i].lNegativeCoefficient = conditions[i].lNegativeCoefficient;
-         ((DICONDITION*)effect.lpvTypeSpecificParams)[i].dwPositiveSaturation = conditions[i].dwPositiveSaturation;
-         ((DICONDITION*)effect.lpvTypeSpecificParams)[i].dwNegativeSaturation = conditions[i].dwNegativeSaturation;
+HRESULT GetFFBCapabilityCacheStatus(FFBCapabilityCacheStatus* status)
+{
+   if (status == NULL)
+   {
+      return E_POINTER;
+   }
+   ZeroMemory(status, sizeof(*status));
+   if (g_pCapabilityCache == NULL)
+   {
+      return S_OK;
+   }
+   g_pCapabilityCache->GetStatus(*status);
+   for (const DeviceEntry& entry : g_vDevices)
+   {
+      FFBCapabilitySources::Type source = entry.pContext->PollCapabilities();
+      if (source == FFBCapabilitySources::Type::Validated)
+      {
+         status->validated++;
+      }
+      else if (source == FFBCapabilitySources::Type::Refreshed)
+      {
+         status->stale++;
       }
-
-      hr = pEffect->SetParameters(&effect, DIEP_DIRECTION | DIEP_TYPESPECIFICPARAMS | DIEP_START);
    }
-
-   return hr;
+   return S_OK;
 }
 
 /**
- * Toggle the auto centering spring for the device.
+ * Have every device opened from now on create config->effectsPerType
+ * effects of each type up front, and keep destroyed ones for reuse, so
+ * creating an effect during play costs no driver round trip to create and
+ * download it. NULL stops pooling for devices opened later. Devices
+ * already open keep their pool, see DeviceFillFFBEffectPool.
  */
-HRESULT SetAutoCenter(bool autoCenter)
+HRESULT ConfigureFFBEffectPool(const FFBEffectPoolConfig* config)
 {
-   HRESULT hr = E_FAIL;
-
-   if (g_pDevice != NULL)
+   if (InitPending())
    {
-      DIPROPDWORD dipdw;
-      dipdw.diph.dwSize = sizeof(DIPROPDWORD);
-      dipdw.diph.dwHeaderSize = sizeof(DIPROPHEADER);
-      dipdw.diph.dwObj = 0;
-      dipdw.diph.dwHow = DIPH_DEVICE;
-      dipdw.dwData = autoCenter ? DIPROPAUTOCENTER_ON : DIPROPAUTOCENTER_OFF;
-
-      hr = g_pDevice->SetProperty(DIPROP_AUTOCENTER, &dipdw.diph);
+      return E_PENDING;
+   }
+   if (config == NULL)
+   {
+      ZeroMemory(&g_effectPoolConfig, sizeof(g_effectPoolConfig));
+      return S_OK;
+   }
+   HRESULT hr = FFBDeviceContext::ValidateEffectPool(*config);
+   if (SUCCEEDED(hr))
+   {
+      g_effectPoolConfig = *config;
    }
-
    return hr;
 }
 
 /**
- * Clean up the Force Feedback device and any effects.
+ * This initializes the selected backend, for DirectInput this creates the
+ * DirectInput 8 interface.
+ * 
+ * Once this is initialized, we can then enumerate devices
+ * and select/create a Force Feedback device.
  */
-void FreeFFBDevice()
-{     
-   for (auto const& effect : g_mEffects) {
-      if (effect.second != NULL) {
-         effect.second->Stop();
-         effect.second->Release();
-      }
+HRESULT StartDirectInput()
+{
+   if (InitPending())
+   {
+      return E_PENDING;
+   }
+   AdoptInit();
+   if (g_pBackend != NULL)
+   {
+      return S_OK;
    }
-   g_mEffects.clear();
-   if (g_pDevice) {
-      g_pDevice->Unacquire();
-      g_pDevice->Release();
-      g_pDevice = NULL;
+   if (g_eBackendType == Backends::Type::Simulated)
+   {
+      return FFB_STAT_CALL(FFBStatCalls::Type::StartDirectInput, CreateSimulatedBackend(&g_pBackend));
    }
+   return FFB_STAT_CALL(FFBStatCalls::Type::StartDirectInput, CreateDirectInputBackend(&g_pBackend));
 }
 
 /**
- * Clean-up DirectInput, device and any effects.
+ * Run StartDirectInput, device selection, CreateFFBDevice, SetAutoCenter,
+ * EnumerateFFBAxes and AddFFBEffect for each configured effect on a worker
+ * thread instead of the game's main thread. Returns immediately, follow
+ * the progress with GetFFBInitStatus.
+ *
+ * Fails with E_ABORT if the backend was already started or an init is in
+ * progress. Until it finishes StartDirectInput returns E_PENDING and the
+ * other functions behave as if it was not called.
  */
-void FreeDirectInput()
+HRESULT StartFFBInitAsync(const FFBInitConfig* config)
 {
-   FreeFFBDevice();
-   if (g_pDI) {
-      g_pDI->Release();
-      g_pDI = NULL;
+   if (config == NULL)
+   {
+      return E_POINTER;
+   }
+   AdoptInit();
+   if (g_pBackend != NULL || InitPending())
+   {
+      return E_ABORT;
    }
+   SAFE_DELETE(g_pInit);
+   g_pInit = new InitPipeline();
+   return g_pInit->Start(g_eBackendType, *config, g_pCapabilityCache, g_effectPoolConfig);
 }
 
 /**
- * Clear the global vector of enumerated force feedback devices.
+ * Progress of StartFFBInitAsync: the stage running, the time each stage
+ * took and, once finished, the result. When it succeeded the device is
+ * open and is the default device. Meant to be polled every frame.
  */
-void ClearDeviceInstances()
+HRESULT GetFFBInitStatus(FFBInitStatus* status)
 {
-   for (int i = 0; i < g_vDeviceInstances.size(); i++)
+   if (status == NULL)
    {
-      delete[] g_vDeviceInstances[i].guidInstance;
-      delete[] g_vDeviceInstances[i].guidProduct;
-      delete[] g_vDeviceInstances[i].instanceName;
-      delete[] g_vDeviceInstances[i].productName;
+      return E_POINTER;
    }
-   g_vDeviceInstances.clear();
+   if (g_pInit == NULL)
+   {
+      ZeroMemory(status, sizeof(*status));
+      status->state = FFBInitStates::Type::Idle;
+      return S_OK;
+   }
+   AdoptInit();
+   g_pInit->GetStatus(*status);
+   return S_OK;
 }
 
-/**
- * Clear the global vector of the selected device's axes.
- */
-void ClearDeviceAxes()
+static HRESULT EnumerateDevices(const FFBEnumSnapshot** snapshot)
 {
-   for (int i = 0; i < g_vDeviceAxes.size(); i++)
+   HRESULT hr = S_OK;
+   const FFBEnumSnapshot* cache = g_pCapabilityCache != NULL ? g_pCapabilityCache->GetSnapshot() : NULL;
+   g_deviceSnapshot.Begin();
+   if (!g_bDevicesEnumerated && cache != NULL && cache->recordCount > 0)
+   {
+      // The cache answers, the device check enumerates meanwhile to find
+      // devices that are gone.
+      AddCachedDevices(cache, g_deviceSnapshot);
+      g_pCapabilityCache->StartDeviceCheck(g_pBackend);
+   }
+   else
    {
-      delete[] g_vDeviceAxes[i].guidType;
-      delete[] g_vDeviceAxes[i].name;
+      hr = FFB_STAT_CALL(FFBStatCalls::Type::DriverEnumDevices, g_pBackend->EnumDevices(_cbEnumFFBDevices, &g_deviceSnapshot));
    }
-   g_vDeviceAxes.clear();
+   g_bDevicesEnumerated = true;
+   *snapshot = g_deviceSnapshot.Finish();
+   return hr;
 }
 
 /**
- * This will stop the DirectInput Force Feedback and
- * clean up all memory and references to devices and effects.
+ * Enumerate the force feedback devices into one blittable snapshot (see
+ * FFBEnumSnapshot) of FFBDeviceRecord's. The snapshot is valid until the
+ * next enumeration, pass a record's guidInstance to OpenFFBDeviceByGuid to
+ * open it.
+ *
+ * With the capability cache enabled the first enumeration returns the
+ * cached devices without asking the driver. One of them may have been
+ * removed since, opening it then fails and a second enumeration asks the
+ * driver.
  */
-void StopDirectInput()
+HRESULT EnumerateFFBDeviceSnapshot(const FFBEnumSnapshot** snapshot)
 {
-   FreeDirectInput();
-   ClearDeviceAxes();
-   ClearDeviceInstances();
-}
\ No newline at end of file
+   if (snapshot == NULL)
+   {
+      return E_POINTER;
+   }
+   *snapshot = NULL;
+   if (g_pBackend == NULL)
+   {
+      return E_FAIL;
+   }
+   return FFB_STAT_CALL(FFBStatCalls::Type::EnumerateDevices, EnumerateDevices(snapshot));
+}
+
+/**
+ * Returns an array of DeviceInfo's that has some basic information
+ * about each force feedback device. To create a device, pass its
+ * guidInstance to the CreateDevice function.
+ */
+DeviceInfo* EnumerateFFBDevices(int &deviceCount)
+{
+   deviceCount = 0;
+   const FFBEnumSnapshot* snapshot;
+   if (FAILED(EnumerateFFBDeviceSnapshot(&snapshot)))
+   {
+      return NULL;
+   }
+
+   // The strings point into the snapshot, only the GUIDs need formatting.
+   ClearDeviceInstances();
+   deviceCount = (int)g_deviceSnapshot.Count();
+   g_vDeviceInstances.resize(deviceCount);
+   g_vDeviceGuids.resize(deviceCount * 2);
+   for (int i = 0; i < deviceCount; i++)
+   {
+      const FFBDeviceRecord& device = g_deviceSnapshot[i];
+      DeviceInfo& di = g_vDeviceInstances[i];
+
+      formatGuid(device.guidInstance, g_vDeviceGuids[i * 2].text);
+      formatGuid(device.guidProduct, g_vDeviceGuids[i * 2 + 1].text);
+      di.guidInstance = g_vDeviceGuids[i * 2].text;
+      di.guidProduct = g_vDeviceGuids[i * 2 + 1].text;
+      di.deviceType = device.deviceType;
+      di.instanceName = (LPSTR)g_deviceSnapshot.String(device.instanceName);
+      di.productName = (LPSTR)g_deviceSnapshot.String(device.productName);
+   }
+   return deviceCount > 0 ? &g_vDeviceInstances[0] : NULL;
+}
+
+/**
+ * Called once for each enumerated force feedback device. Each found device is
+ * added to the snapshot passed as pContext.
+ */
+BOOL CALLBACK _cbEnumFFBDevices(const DIDEVICEINSTANCE* pInst, void* pContext)
+{
+   EnumSnapshot<FFBDeviceRecord>* snapshot = (EnumSnapshot<FFBDeviceRecord>*)pContext;
+
+   FFBDeviceRecord& device = snapshot->Add();
+   device.guidInstance = pInst->guidInstance;
+   device.guidProduct = pInst->guidProduct;
+   device.deviceType = pInst->dwDevType;
+   device.instanceName = snapshot->AddString(pInst->tszInstanceName);
+   device.productName = snapshot->AddString(pInst->tszProductName);
+
+   return DIENUM_CONTINUE;
+}
+
+/**
+ * Tell the device how it was enumerated: by the last enumeration or, if it
+ * was opened without one, by the capability cache.
+ */
+static void SetDeviceRecord(FFBDeviceContext* pContext, REFGUID deviceGuid)
+{
+   for (DWORD i = 0; i < g_deviceSnapshot.Count(); i++)
+   {
+      const FFBDeviceRecord& device = g_deviceSnapshot[i];
+      if (device.guidInstance == deviceGuid)
+      {
+         pContext->SetDeviceRecord(device, g_deviceSnapshot.String(device.instanceName), g_deviceSnapshot.String(device.productName));
+         return;
+      }
+   }
+   const FFBEnumSnapshot* cache = g_pCapabilityCache->GetSnapshot();
+   const FFBCapabilityRecord* record = FindCapabilityRecord(cache, deviceGuid);
+   if (record != NULL)
+   {
+      FFBDeviceRecord device;
+      ZeroMemory(&device, sizeof(device));
+      device.guidInstance = record->guidInstance;
+      device.guidProduct = record->guidProduct;
+      device.deviceType = record->deviceType;
+      pContext->SetDeviceRecord(device, SnapshotString(cache, record->instanceName), SnapshotString(cache, record->productName));
+   }
+}
+
+static HRESULT OpenDevice(REFGUID deviceGuid, FFBDeviceHandle* device)
+{
+   FFBDevice* pDevice;
+
+   HRESULT hr = FFB_STAT_CALL(FFBStatCalls::Type::DriverCreateDevice, g_pBackend->CreateDevice(deviceGuid, &pDevice));
+
+   if (FAILED(hr))
+   {
+      return hr;
+   }
+
+   FFBDeviceContext* pContext = new FFBDeviceContext(pDevice, deviceGuid);
+   if (g_pCapabilityCache != NULL)
+   {
+      SetDeviceRecord(pContext, deviceGuid);
+      g_pCapabilityCache->CountOpen(pContext->UseCapabilityCache(g_pCapabilityCache->GetSnapshot()));
+   }
+   // A device without room for the whole pool still opens.
+   pContext->FillEffectPool(g_effectPoolConfig);
+   *device = AddDevice(pContext);
+   if (GetDevice(g_hDefaultDevice) == NULL)
+   {
+      g_hDefaultDevice = *device;
+   }
+
+   return S_OK;
+}
+
+/**
+ * Open a force feedback device and return a handle to it. The guid of the
+ * device must be passed in, it can be obtained by looking at the array of
+ * enumerated devices. Any number of devices can be open at once, each has
+ * its own effects and force output thread.
+ *
+ * The first device opened becomes the device the single device exports
+ * (AddFFBEffect, UpdateConstantForce, ...) operate on.
+ */
+HRESULT OpenFFBDevice(LPCSTR guidInstance, FFBDeviceHandle* device)
+{
+   GUID deviceGuid;
+   if (!stringToGuid(guidInstance, deviceGuid))
+   {
+      return E_INVALIDARG;
+   }
+   return OpenFFBDeviceByGuid(&deviceGuid, device);
+}
+
+/**
+ * OpenFFBDevice taking the binary guidInstance of an FFBDeviceRecord.
+ */
+HRESULT OpenFFBDeviceByGuid(const GUID* guidInstance, FFBDeviceHandle* device)
+{
+   if (g_pBackend == NULL || device == NULL || guidInstance == NULL)
+   {
+      return E_INVALIDARG;
+   }
+   const GUID& deviceGuid = *guidInstance;
+   if (FindOpenDevice(deviceGuid) != 0)
+   {
+      // Already open, devices are acquired exclusively.
+      return E_ABORT;
+   }
+
+   HRESULT hr = FFB_STAT_CALL(FFBStatCalls::Type::OpenDevice, OpenDevice(deviceGuid, device));
+   return Recorded(hr, FFBRecordCalls::Type::OpenDevice, SUCCEEDED(hr) ? *device : 0, 0, &deviceGuid, sizeof(GUID));
+}
+
+/**
+ * Stop a device's output thread, release its effects and close it.
+ */
+HRESULT CloseFFBDevice(FFBDeviceHandle device)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   if (pContext == NULL)
+   {
+      return E_HANDLE;
+   }
+   RememberDevice(pContext);
+   delete pContext;
+   for (size_t i = 0; i < g_vDevices.size(); i++)
+   {
+      if (g_vDevices[i].handle == device)
+      {
+         g_vDevices.erase(g_vDevices.begin() + i);
+         break;
+      }
+   }
+   if (g_hDefaultDevice == device)
+   {
+      g_hDefaultDevice = 0;
+   }
+   return Recorded(S_OK, FFBRecordCalls::Type::CloseDevice, device, 0);
+}
+
+DeviceAxisInfo* DeviceEnumerateFFBAxes(FFBDeviceHandle device, int &axisCount)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   if (pContext == NULL)
+   {
+      axisCount = 0;
+      return NULL;
+   }
+   DeviceAxisInfo* axes = NULL;
+   FFB_STAT_CALL(FFBStatCalls::Type::EnumerateAxes, (axes = pContext->EnumerateAxes(axisCount), S_OK));
+   return axes;
+}
+
+/**
+ * Start watching for devices being attached and removed on a background
+ * thread, so the game never has to block on enumeration to notice. The
+ * monitor rescans when the backend reports a change and otherwise every
+ * intervalMs. Changes are collected with PollFFBDeviceEvents, the first
+ * poll reports every attached device as added.
+ */
+HRESULT StartFFBDeviceMonitor(DWORD intervalMs)
+{
+   if (g_pBackend == NULL)
+   {
+      return E_FAIL;
+   }
+   if (g_pMonitor == NULL)
+   {
+      g_pMonitor = new DeviceMonitor(g_pBackend);
+   }
+   return g_pMonitor->Start(intervalMs);
+}
+
+void StopFFBDeviceMonitor()
+{
+   if (g_pMonitor != NULL)
+   {
+      g_pMonitor->Stop();
+   }
+}
+
+/**
+ * Take up to maxEvents device events queued by the monitor, meant to be
+ * called every frame. Never blocks, eventCount receives how many were
+ * written to events.
+ *
+ * Open devices are followed across unplugging: when one is removed it is
+ * marked lost, when it is attached again it is reopened and its effects
+ * are recreated as they were, reported as a Restored event. If that fails
+ * (event result) the device stays lost until it is attached again.
+ */
+HRESULT PollFFBDeviceEvents(FFBDeviceEvent* events, int maxEvents, int* eventCount)
+{
+   if (eventCount == NULL || maxEvents < 0 || (maxEvents > 0 && events == NULL))
+   {
+      return E_INVALIDARG;
+   }
+   *eventCount = 0;
+   if (g_pMonitor == NULL)
+   {
+      return S_OK;
+   }
+
+   FFBDeviceEvent event;
+   while (*eventCount < maxEvents && g_pMonitor->Poll(event))
+   {
+      event.device = FindOpenDevice(event.guidInstance);
+      FFBDeviceContext* pContext = GetDevice(event.device);
+      if (pContext != NULL && event.type == FFBDeviceEvents::Type::Removed)
+      {
+         pContext->MarkLost();
+      }
+      else if (pContext != NULL && event.type == FFBDeviceEvents::Type::Added && pContext->IsLost())
+      {
+         FFBDevice* pDevice;
+         event.type = FFBDeviceEvents::Type::Restored;
+         event.result = FFB_STAT_CALL(FFBStatCalls::Type::DriverCreateDevice, g_pBackend->CreateDevice(event.guidInstance, &pDevice));
+         if (SUCCEEDED(event.result))
+         {
+            event.result = pContext->Restore(pDevice);
+         }
+      }
+      events[(*eventCount)++] = event;
+   }
+   return S_OK;
+}
+
+/**
+ * Enumerate the device's force feedback axes into one blittable snapshot
+ * (see FFBEnumSnapshot) of FFBAxisRecord's, valid until the device's axes
+ * are enumerated again or it is closed.
+ */
+HRESULT DeviceEnumerateFFBAxisSnapshot(FFBDeviceHandle device, const FFBEnumSnapshot** snapshot)
+{
+   if (snapshot == NULL)
+   {
+      return E_POINTER;
+   }
+   *snapshot = NULL;
+   FFBDeviceContext* pContext = GetDevice(device);
+   if (pContext == NULL)
+   {
+      return E_HANDLE;
+   }
+   return FFB_STAT_CALL(FFBStatCalls::Type::EnumerateAxes, (*snapshot = pContext->EnumerateAxisSnapshot(), S_OK));
+}
+
+/**
+ * The effect types the device can play, how many effects it holds, its
+ * axes and how long an effect update takes. Probes the device if that is
+ * not known yet, or waits for the probe of the capability cache's check;
+ * capabilities taken from the cache are returned while they are checked.
+ */
+HRESULT DeviceGetFFBDeviceCapabilities(FFBDeviceHandle device, FFBDeviceCapabilities* capabilities)
+{
+   if (capabilities == NULL)
+   {
+      return E_POINTER;
+   }
+   ZeroMemory(capabilities, sizeof(*capabilities));
+   FFBDeviceContext* pContext = GetDevice(device);
+   if (pContext == NULL)
+   {
+      return E_HANDLE;
+   }
+   return pContext->GetCapabilities(*capabilities);
+}
+
+/**
+ * Resize an open device's effect pool (see ConfigureFFBEffectPool), an
+ * all zero config releases it. S_FALSE if the device could not hold the
+ * whole pool.
+ */
+HRESULT DeviceFillFFBEffectPool(FFBDeviceHandle device, const FFBEffectPoolConfig* config)
+{
+   if (config == NULL)
+   {
+      return E_POINTER;
+   }
+   FFBDeviceContext* pContext = GetDevice(device);
+   if (pContext == NULL)
+   {
+      return E_HANDLE;
+   }
+   return pContext->FillEffectPool(*config);
+}
+
+HRESULT DeviceGetFFBEffectPoolStats(FFBDeviceHandle device, FFBEffectPoolStats* stats)
+{
+   if (stats == NULL)
+   {
+      return E_POINTER;
+   }
+   FFBDeviceContext* pContext = GetDevice(device);
+   if (pContext == NULL)
+   {
+      ZeroMemory(stats, sizeof(*stats));
+      return E_HANDLE;
+   }
+   pContext->GetEffectPoolStats(*stats);
+   return S_OK;
+}
+
+HRESULT DeviceGetFFBMemoryStats(FFBDeviceHandle device, FFBMemoryStats* stats)
+{
+   if (stats == NULL)
+   {
+      return E_POINTER;
+   }
+   FFBDeviceContext* pContext = GetDevice(device);
+   if (pContext == NULL)
+   {
+      ZeroMemory(stats, sizeof(*stats));
+      return E_HANDLE;
+   }
+   pContext->GetMemoryStats(*stats);
+   return S_OK;
+}
+
+HRESULT DeviceAddFFBEffect(FFBDeviceHandle device, Effects::Type effectType)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   return Recorded(FFB_STAT_CALL(FFBStatCalls::Type::CreateEffect, pContext != NULL ? pContext->AddEffect(effectType) : E_HANDLE),
+      FFBRecordCalls::Type::AddEffect, device, effectType);
+}
+
+HRESULT DeviceRemoveFFBEffect(FFBDeviceHandle device, Effects::Type effectType)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   return Recorded(FFB_STAT_CALL(FFBStatCalls::Type::DestroyEffect, pContext != NULL ? pContext->RemoveEffect(effectType) : E_HANDLE),
+      FFBRecordCalls::Type::RemoveEffect, device, effectType);
+}
+
+HRESULT DeviceUpdateEffectGain(FFBDeviceHandle device, Effects::Type effectType, float gainPercent)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   return Recorded(FFB_STAT_CALL(FFBStatCalls::Type::UpdateGain, pContext != NULL ? pContext->UpdateEffectGain(effectType, gainPercent) : E_HANDLE),
+      FFBRecordCalls::Type::UpdateGain, device, effectType, &gainPercent, sizeof(float));
+}
+
+HRESULT DeviceUpdateConstantForce(FFBDeviceHandle device, LONG magnitude, LONG* directions)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   return RecordedConstantForce(FFB_STAT_CALL(FFBStatCalls::Type::UpdateConstantForce, pContext != NULL ? pContext->UpdateConstantForce(magnitude, directions) : E_HANDLE),
+      FFBRecordCalls::Type::UpdateConstantForce, device, Effects::Type::ConstantForce, pContext, magnitude, directions);
+}
+
+HRESULT DeviceUpdateCondition(FFBDeviceHandle device, Effects::Type effectType, DICONDITION* conditions)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   return RecordedConditions(FFB_STAT_CALL(FFBStatCalls::Type::UpdateCondition, pContext != NULL ? pContext->UpdateCondition(effectType, conditions) : E_HANDLE),
+      FFBRecordCalls::Type::UpdateCondition, device, effectType, pContext, conditions);
+}
+
+HRESULT DeviceUpdatePeriodic(FFBDeviceHandle device, Effects::Type effectType, const FFBPeriodicEffect* periodic, LONG* directions)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   return RecordedPeriodic(FFB_STAT_CALL(FFBStatCalls::Type::UpdatePeriodic, pContext != NULL ? pContext->UpdatePeriodic(effectType, periodic, directions) : E_HANDLE),
+      FFBRecordCalls::Type::UpdatePeriodic, device, effectType, pContext, periodic, directions);
+}
+
+HRESULT DeviceUpdateCustomForce(FFBDeviceHandle device, const FFBCustomForce* customForce, LONG* directions)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   return RecordedCustomForce(FFB_STAT_CALL(FFBStatCalls::Type::UpdateCustomForce, pContext != NULL ? pContext->UpdateCustomForce(customForce, directions) : E_HANDLE),
+      FFBRecordCalls::Type::UpdateCustomForce, device, Effects::Type::CustomForce, pContext, customForce, directions);
+}
+
+HRESULT DeviceUpdateEffect(FFBDeviceHandle device, Effects::Type effectType, const void* params, DWORD flags)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   return RecordedEffectUpdate(FFB_STAT_CALL(FFBStatCalls::Type::UpdateEffect, pContext != NULL ? pContext->UpdateEffect(effectType, params, flags) : E_HANDLE),
+      FFBRecordCalls::Type::UpdateEffect, device, effectType, effectType, params, flags);
+}
+
+HRESULT DeviceSubmitFFBCommands(FFBDeviceHandle device, const FFBCommand* commands, int commandCount, HRESULT* results)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   HRESULT hr = FFB_STAT_CALL(FFBStatCalls::Type::SubmitCommands, pContext != NULL ? pContext->SubmitCommands(commands, commandCount, results) : E_HANDLE);
+   RecordCommands(hr, device, pContext, commands, commandCount, pContext != NULL ? results : NULL);
+   return hr;
+}
+
+/**
+ * Update several devices in one call. devices holds the handle each command
+ * is for. Consecutive commands for the same device are submitted together
+ * as one batch, so group commands by device to get at most one driver call
+ * per effect.
+ *
+ * results must hold commandCount entries (or be NULL), each receives
+ * E_HANDLE if its device is not open and otherwise the same result as from
+ * SubmitFFBCommands. Returns S_OK if every command succeeded, else the
+ * first failure.
+ */
+HRESULT SubmitFFBDeviceCommands(const FFBDeviceHandle* devices, const FFBCommand* commands, int commandCount, HRESULT* results)
+{
+   if (commandCount < 0 || (commandCount > 0 && (devices == NULL || commands == NULL)))
+   {
+      return E_INVALIDARG;
+   }
+
+   HRESULT hrBatch = S_OK;
+   int start = 0;
+   while (start < commandCount)
+   {
+      int end = start + 1;
+      while (end < commandCount && devices[end] == devices[start])
+      {
+         end++;
+      }
+
+      HRESULT hr;
+      FFBDeviceContext* pContext = GetDevice(devices[start]);
+      if (pContext != NULL)
+      {
+         hr = FFB_STAT_CALL(FFBStatCalls::Type::SubmitCommands,
+            pContext->SubmitCommands(&commands[start], end - start, results != NULL ? &results[start] : NULL));
+      }
+      else
+      {
+         hr = E_HANDLE;
+         for (int i = start; results != NULL && i < end; i++)
+         {
+            results[i] = E_HANDLE;
+         }
+      }
+      RecordCommands(hr, devices[start], pContext, &commands[start], end - start, results != NULL ? &results[start] : NULL);
+      if (FAILED(hr) && SUCCEEDED(hrBatch))
+      {
+         hrBatch = hr;
+      }
+      start = end;
+   }
+   return hrBatch;
+}
+
+/**
+ * Queue commands for device without blocking, callable from any thread at
+ * once, including jobs and Burst compiled code through
+ * GetFFBEnqueueCommandsFunction. Nothing is sent until the game thread
+ * calls DrainFFBCommandQueue; commands queued by one thread are applied in
+ * the order it queued them.
+ *
+ * Returns S_FALSE if the queue was full and some commands were dropped,
+ * the ones before them are queued.
+ */
+HRESULT EnqueueFFBCommands(FFBDeviceHandle device, const FFBCommand* commands, int commandCount)
+{
+   if (commandCount < 0 || (commandCount > 0 && commands == NULL))
+   {
+      return E_INVALIDARG;
+   }
+   QueuedCommand item;
+   item.device = device;
+   for (int i = 0; i < commandCount; i++)
+   {
+      item.command = commands[i];
+      if (!g_commandQueue.Push(item))
+      {
+         g_nCommandsEnqueued.fetch_add(i, std::memory_order_relaxed);
+         g_nCommandsDropped.fetch_add(commandCount - i, std::memory_order_relaxed);
+         return S_FALSE;
+      }
+   }
+   g_nCommandsEnqueued.fetch_add(commandCount, std::memory_order_relaxed);
+   return S_OK;
+}
+
+FFBEnqueueCommandsFn GetFFBEnqueueCommandsFunction()
+{
+   return &EnqueueFFBCommands;
+}
+
+/**
+ * Submit the commands queued by EnqueueFFBCommands, game thread only. The
+ * commands are grouped by device, keeping their order within each device,
+ * and go through SubmitFFBDeviceCommands so they are counted and recorded
+ * like any other batch. Only what was queued when the call started is
+ * drained, so producers that keep pushing cannot hold it up.
+ *
+ * commandCount (may be NULL) receives the number of commands drained.
+ * Returns S_OK if every drained command succeeded, else the first failure.
+ */
+HRESULT DrainFFBCommandQueue(int* commandCount)
+{
+   if (commandCount != NULL)
+   {
+      *commandCount = 0;
+   }
+   uint32_t pending = g_commandQueue.Size();
+   g_vDrainedCommands.clear();
+   QueuedCommand item;
+   while (g_vDrainedCommands.size() < pending && g_commandQueue.Pop(item))
+   {
+      g_vDrainedCommands.push_back(item);
+   }
+   if (g_vDrainedCommands.empty())
+   {
+      return S_OK;
+   }
+
+   std::stable_sort(g_vDrainedCommands.begin(), g_vDrainedCommands.end(),
+      [](const QueuedCommand& a, const QueuedCommand& b) { return a.device < b.device; });
+   int drained = (int)g_vDrainedCommands.size();
+   g_vDrainDevices.resize(drained);
+   g_vDrainCommands.resize(drained);
+   g_vDrainResults.resize(drained);
+   for (int i = 0; i < drained; i++)
+   {
+      g_vDrainDevices[i] = g_vDrainedCommands[i].device;
+      g_vDrainCommands[i] = g_vDrainedCommands[i].command;
+   }
+   HRESULT hr = SubmitFFBDeviceCommands(g_vDrainDevices.data(), g_vDrainCommands.data(), drained, g_vDrainResults.data());
+
+   g_nCommandsDrained += drained;
+   for (int i = 0; i < drained; i++)
+   {
+      if (FAILED(g_vDrainResults[i]))
+      {
+         g_nCommandsFailed++;
+      }
+   }
+   if (commandCount != NULL)
+   {
+      *commandCount = drained;
+   }
+   return hr;
+}
+
+/**
+ * Counters of the command queue, game thread only.
+ */
+HRESULT GetFFBCommandQueueStats(FFBCommandQueueStats* stats)
+{
+   if (stats == NULL)
+   {
+      return E_POINTER;
+   }
+   stats->enqueued = g_nCommandsEnqueued.load(std::memory_order_relaxed);
+   stats->dropped = g_nCommandsDropped.load(std::memory_order_relaxed);
+   stats->drained = g_nCommandsDrained;
+   stats->failed = g_nCommandsFailed;
+   stats->pending = g_commandQueue.Size();
+   return S_OK;
+}
+
+/**
+ * Drop whatever is queued, the devices it was for are going away.
+ */
+static void DiscardCommandQueue()
+{
+   QueuedCommand item;
+   while (g_commandQueue.Pop(item))
+   {
+   }
+}
+
+HRESULT DeviceSetAutoCenter(FFBDeviceHandle device, bool autoCenter)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   return Recorded(FFB_STAT_CALL(FFBStatCalls::Type::SetAutoCenter, pContext != NULL ? pContext->SetAutoCenter(autoCenter) : E_HANDLE),
+      FFBRecordCalls::Type::SetAutoCenter, device, autoCenter ? 1 : 0);
+}
+
+void DeviceStartAllFFBEffects(FFBDeviceHandle device)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   if (pContext != NULL)
+   {
+      FFB_STAT_CALL(FFBStatCalls::Type::StartEffects, (pContext->StartAllEffects(), S_OK));
+      Recorded(S_OK, FFBRecordCalls::Type::StartAllEffects, device, 0);
+   }
+}
+
+void DeviceStopAllFFBEffects(FFBDeviceHandle device)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   if (pContext != NULL)
+   {
+      FFB_STAT_CALL(FFBStatCalls::Type::StopEffects, (pContext->StopAllEffects(), S_OK));
+      Recorded(S_OK, FFBRecordCalls::Type::StopAllEffects, device, 0);
+   }
+}
+
+/**
+ * Start a native thread that sends force updates to the device at rateHz,
+ * decoupled from the rate UpdateConstantForce/UpdateCondition are called
+ * at. Every device has its own thread. Effects may be added before or after.
+ */
+HRESULT DeviceStartForceOutputThread(FFBDeviceHandle device, int rateHz)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   return Recorded(pContext != NULL ? pContext->StartOutputThread(rateHz) : E_HANDLE, FFBRecordCalls::Type::StartOutputThread, device, rateHz);
+}
+
+/**
+ * Stop the device's force output thread. Updates are sent synchronously
+ * again, the last published targets are flushed so they are not lost.
+ */
+void DeviceStopForceOutputThread(FFBDeviceHandle device)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   if (pContext != NULL)
+   {
+      pContext->StopOutputThread();
+      Recorded(S_OK, FFBRecordCalls::Type::StopOutputThread, device, 0);
+   }
+}
+
+/**
+ * Change the rate of the force output thread, takes effect on the next tick.
+ */
+HRESULT DeviceSetForceOutputRate(FFBDeviceHandle device, int rateHz)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   return Recorded(pContext != NULL ? pContext->SetOutputRate(rateHz) : E_HANDLE, FFBRecordCalls::Type::SetOutputRate, device, rateHz);
+}
+
+HRESULT DeviceGetForceOutputStats(FFBDeviceHandle device, ForceOutputStats* stats)
+{
+   if (stats == NULL)
+   {
+      return E_POINTER;
+   }
+   FFBDeviceContext* pContext = GetDevice(device);
+   if (pContext == NULL)
+   {
+      return E_HANDLE;
+   }
+   pContext->GetOutputStats(*stats);
+   return S_OK;
+}
+
+void DeviceResetForceOutputStats(FFBDeviceHandle device)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   if (pContext != NULL)
+   {
+      pContext->ResetOutputStats();
+   }
+}
+
+/**
+ * Evaluate condition effects (spring, damper, inertia, friction) in the
+ * plugin from the polled wheel position instead of on the device, for
+ * wheels whose own condition effects are missing, coarse or slow. The
+ * result is sent through the constant force effect by the force output
+ * thread, which must be running for anything to be synthesized.
+ *
+ * Must be enabled before condition effects are added, fails with E_ABORT
+ * if the device already has one. config may be NULL for the defaults.
+ */
+HRESULT DeviceEnableForceSynthesis(FFBDeviceHandle device, const ForceSynthConfig* config)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   return Recorded(pContext != NULL ? pContext->EnableSynthesis(config) : E_HANDLE,
+      FFBRecordCalls::Type::EnableSynthesis, device, 0, config, config != NULL ? sizeof(ForceSynthConfig) : 0);
+}
+
+/**
+ * Stop synthesizing, the constant force goes back to being exactly what the
+ * game sent. Synthesized effects have to be removed and added again to be
+ * created on the device.
+ */
+void DeviceDisableForceSynthesis(FFBDeviceHandle device)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   if (pContext != NULL)
+   {
+      pContext->DisableSynthesis();
+      Recorded(S_OK, FFBRecordCalls::Type::DisableSynthesis, device, 0);
+   }
+}
+
+HRESULT DeviceGetForceSynthState(FFBDeviceHandle device, ForceSynthState* state)
+{
+   if (state == NULL)
+   {
+      return E_POINTER;
+   }
+   FFBDeviceContext* pContext = GetDevice(device);
+   if (pContext == NULL)
+   {
+      return E_HANDLE;
+   }
+   pContext->GetSynthState(*state);
+   return S_OK;
+}
+
+/**
+ * Condition the constant force of one axis, or of every axis when axis is
+ * -1, before it is sent: filtering, compression, slew limiting and a
+ * counted clip to DI_FFNOMINALMAX (see ForceDspConfig). Like synthesis
+ * this runs on the force output thread at its rate, nothing is conditioned
+ * while it is stopped. A NULL config bypasses the axis, its force is only
+ * clipped.
+ */
+HRESULT DeviceConfigureForceDsp(FFBDeviceHandle device, int axis, const ForceDspConfig* config)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   return Recorded(pContext != NULL ? pContext->ConfigureDsp(axis, config) : E_HANDLE,
+      FFBRecordCalls::Type::ConfigureForceDsp, device, (uint32_t)axis, config, config != NULL ? sizeof(ForceDspConfig) : 0);
+}
+
+/**
+ * Stop conditioning, the constant force goes back to being exactly what
+ * the game sent (plus any synthesized force).
+ */
+void DeviceDisableForceDsp(FFBDeviceHandle device)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   if (pContext != NULL)
+   {
+      pContext->DisableDsp();
+      Recorded(S_OK, FFBRecordCalls::Type::DisableForceDsp, device, 0);
+   }
+}
+
+HRESULT DeviceGetForceDspState(FFBDeviceHandle device, ForceDspState* state)
+{
+   if (state == NULL)
+   {
+      return E_POINTER;
+   }
+   FFBDeviceContext* pContext = GetDevice(device);
+   if (pContext == NULL)
+   {
+      return E_HANDLE;
+   }
+   pContext->GetDspState(*state);
+   return S_OK;
+}
+
+/**
+ * The clock FFBForceKeyframe times are on, in microseconds. Monotonic, its
+ * origin is unspecified.
+ */
+int64_t GetFFBClockMicroseconds()
+{
+   return KeyframeClockUs();
+}
+
+/**
+ * Take the constant force from timestamped keyframes (SubmitForceKeyframes)
+ * instead of UpdateConstantForce, resampled by the force output thread to
+ * its rate so the force no longer steps at the game's physics rate. See
+ * FFBKeyframeModes for the trade off between the two modes, config may be
+ * NULL for the defaults. Enabling again drops the keyframes queued so far.
+ */
+HRESULT DeviceEnableForceKeyframes(FFBDeviceHandle device, const FFBKeyframeConfig* config)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   return Recorded(pContext != NULL ? pContext->EnableKeyframes(config) : E_HANDLE,
+      FFBRecordCalls::Type::EnableForceKeyframes, device, 0, config, config != NULL ? sizeof(FFBKeyframeConfig) : 0);
+}
+
+void DeviceDisableForceKeyframes(FFBDeviceHandle device)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   if (pContext != NULL)
+   {
+      pContext->DisableKeyframes();
+      Recorded(S_OK, FFBRecordCalls::Type::DisableForceKeyframes, device, 0);
+   }
+}
+
+static void RecordKeyframes(FFBDeviceHandle device, HRESULT hr, const FFBForceKeyframe* keyframes, int keyframeCount)
+{
+   if (!Recording() || keyframes == NULL)
+   {
+      return;
+   }
+   int64_t now = KeyframeClockUs();
+   for (int i = 0; i < keyframeCount; i++)
+   {
+      FFBForceKeyframe keyframe = keyframes[i];
+      if (keyframe.timeUs != 0)
+      {
+         keyframe.timeUs -= now;
+      }
+      g_pRecorder->Record(FFBRecordCalls::Type::SubmitForceKeyframe, device, hr, i, &keyframe, sizeof(keyframe));
+   }
+}
+
+/**
+ * Queue force keyframes for the output thread, in time order. Fails with
+ * E_ABORT unless keyframes were enabled, S_FALSE if some were dropped.
+ * While the output thread is stopped the newest one is applied right away.
+ */
+HRESULT DeviceSubmitForceKeyframes(FFBDeviceHandle device, const FFBForceKeyframe* keyframes, int keyframeCount)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   HRESULT hr = FFB_STAT_CALL(FFBStatCalls::Type::UpdateConstantForce,
+      pContext != NULL ? pContext->SubmitKeyframes(keyframes, keyframeCount) : E_HANDLE);
+   RecordKeyframes(device, hr, keyframes, keyframeCount);
+   return hr;
+}
+
+HRESULT DeviceGetForceKeyframeStats(FFBDeviceHandle device, FFBKeyframeStats* stats)
+{
+   if (stats == NULL)
+   {
+      return E_POINTER;
+   }
+   FFBDeviceContext* pContext = GetDevice(device);
+   if (pContext == NULL)
+   {
+      return E_HANDLE;
+   }
+   pContext->GetKeyframeStats(*stats);
+   return S_OK;
+}
+
+/**
+ * Set how much headroom the force layers saturate into and how fast
+ * ducking acts, NULL for the defaults (see FFBForceMixerConfig).
+ */
+HRESULT DeviceConfigureForceMixer(FFBDeviceHandle device, const FFBForceMixerConfig* config)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   return Recorded(pContext != NULL ? pContext->ConfigureMixer(config) : E_HANDLE,
+      FFBRecordCalls::Type::ConfigureForceMixer, device, 0, config, config != NULL ? sizeof(FFBForceMixerConfig) : 0);
+}
+
+/**
+ * Add a named force layer that one game system owns, e.g. road texture or
+ * kerb rumble. The force output thread mixes the layers into the constant
+ * force, ducking and making room for them by priority (see
+ * FFBForceLayerConfig), so the game no longer sums them itself. Like
+ * synthesis this needs the output thread, nothing is mixed while it is
+ * stopped.
+ *
+ * name must be unique on the device, fails with E_ABORT if it is taken
+ * and E_OUTOFMEMORY when FFB_MAX_FORCE_LAYERS layers exist.
+ */
+HRESULT DeviceCreateForceLayer(FFBDeviceHandle device, LPCSTR name, const FFBForceLayerConfig* config, FFBForceLayerHandle* layer)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   HRESULT hr = pContext != NULL ? pContext->CreateForceLayer(name, config, layer) : E_HANDLE;
+   if (Recording() && SUCCEEDED(hr))
+   {
+      FFBRecordForceLayer record;
+      ZeroMemory(&record, sizeof(record));
+      record.config = *config;
+      // The name fits, or the layer would not have been created.
+      memcpy(record.name, name, strlen(name));
+      Recorded(hr, FFBRecordCalls::Type::CreateForceLayer, device, *layer, &record, sizeof(record));
+   }
+   return hr;
+}
+
+/**
+ * The layer called name, E_FAIL if there is none.
+ */
+HRESULT DeviceFindForceLayer(FFBDeviceHandle device, LPCSTR name, FFBForceLayerHandle* layer)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   return pContext != NULL ? pContext->FindForceLayer(name, layer) : E_HANDLE;
+}
+
+HRESULT DeviceConfigureForceLayer(FFBDeviceHandle device, FFBForceLayerHandle layer, const FFBForceLayerConfig* config)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   return Recorded(pContext != NULL ? pContext->ConfigureForceLayer(layer, config) : E_HANDLE,
+      FFBRecordCalls::Type::ConfigureForceLayer, device, layer, config, config != NULL ? sizeof(FFBForceLayerConfig) : 0);
+}
+
+/**
+ * Set the force of a layer on each axis in DirectInput units, force holds
+ * an entry per device axis. Restarts the layer's lifetime. Layers are
+ * independent, updating one never waits for the output thread or another
+ * layer.
+ */
+HRESULT DeviceUpdateForceLayer(FFBDeviceHandle device, FFBForceLayerHandle layer, const float* force)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   HRESULT hr = FFB_STAT_CALL(FFBStatCalls::Type::UpdateConstantForce,
+      pContext != NULL ? pContext->UpdateForceLayer(layer, force) : E_HANDLE);
+   return Recorded(hr, FFBRecordCalls::Type::UpdateForceLayer, device, layer, force, force != NULL ? sizeof(float) * RecordedAxes(pContext) : 0);
+}
+
+/**
+ * Remove a layer at once. Once none are left the constant force is the
+ * game's own again.
+ */
+HRESULT DeviceDestroyForceLayer(FFBDeviceHandle device, FFBForceLayerHandle layer)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   return Recorded(pContext != NULL ? pContext->DestroyForceLayer(layer) : E_HANDLE,
+      FFBRecordCalls::Type::DestroyForceLayer, device, layer);
+}
+
+HRESULT DeviceGetForceLayerState(FFBDeviceHandle device, FFBForceLayerHandle layer, FFBForceLayerState* state)
+{
+   if (state == NULL)
+   {
+      return E_POINTER;
+   }
+   FFBDeviceContext* pContext = GetDevice(device);
+   if (pContext == NULL)
+   {
+      return E_HANDLE;
+   }
+   return pContext->GetForceLayerState(layer, *state);
+}
+
+HRESULT DeviceGetForceMixerState(FFBDeviceHandle device, FFBForceMixerState* state)
+{
+   if (state == NULL)
+   {
+      return E_POINTER;
+   }
+   FFBDeviceContext* pContext = GetDevice(device);
+   if (pContext == NULL)
+   {
+      return E_HANDLE;
+   }
+   pContext->GetMixerState(*state);
+   return S_OK;
+}
+
+/**
+ * Start capturing the device's input on a native thread into a ring the
+ * game reads in place (see GetFFBInputRing). NULL config captures buffered
+ * at 1 kHz. S_FALSE if the device cannot buffer its input and is polled
+ * instead. Not recorded, a replay has no input to capture.
+ */
+HRESULT DeviceStartFFBInputCapture(FFBDeviceHandle device, const FFBInputCaptureConfig* config)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   if (pContext == NULL)
+   {
+      return E_HANDLE;
+   }
+   FFBInputCaptureConfig defaults;
+   if (config == NULL)
+   {
+      defaults.mode = FFBInputModes::Type::Buffered;
+      defaults.rateHz = 1000;
+      defaults.bufferSize = 256;
+      config = &defaults;
+   }
+   return pContext->StartInputCapture(*config);
+}
+
+void DeviceStopFFBInputCapture(FFBDeviceHandle device)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   if (pContext != NULL)
+   {
+      pContext->StopInputCapture();
+   }
+}
+
+HRESULT DeviceGetFFBInputRing(FFBDeviceHandle device, FFBInputRing* ring)
+{
+   if (ring == NULL)
+   {
+      return E_POINTER;
+   }
+   FFBDeviceContext* pContext = GetDevice(device);
+   if (pContext == NULL)
+   {
+      return E_HANDLE;
+   }
+   pContext->GetInputRing(*ring);
+   return S_OK;
+}
+
+HRESULT DeviceGetFFBInputCaptureStats(FFBDeviceHandle device, FFBInputCaptureStats* stats)
+{
+   if (stats == NULL)
+   {
+      return E_POINTER;
+   }
+   FFBDeviceContext* pContext = GetDevice(device);
+   if (pContext == NULL)
+   {
+      return E_HANDLE;
+   }
+   pContext->GetInputCaptureStats(*stats);
+   return S_OK;
+}
+
+/**
+ * Take the device's force from another process through the shared memory
+ * region name (see bridge-format.h), read by the force output thread. The
+ * first constant force effect carries it. NULL config for the defaults.
+ * Not recorded, a replay has no writer to read.
+ */
+HRESULT DeviceAttachFFBBridge(FFBDeviceHandle device, LPCSTR name, const FFBBridgeConfig* config)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   return pContext != NULL ? pContext->AttachBridge(name, config) : E_HANDLE;
+}
+
+void DeviceDetachFFBBridge(FFBDeviceHandle device)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   if (pContext != NULL)
+   {
+      pContext->DetachBridge();
+   }
+}
+
+HRESULT DeviceGetFFBBridgeStats(FFBDeviceHandle device, FFBBridgeStats* stats)
+{
+   if (stats == NULL)
+   {
+      return E_POINTER;
+   }
+   FFBDeviceContext* pContext = GetDevice(device);
+   if (pContext == NULL)
+   {
+      return E_HANDLE;
+   }
+   pContext->GetBridgeStats(*stats);
+   return S_OK;
+}
+
+/**
+ * Adapt the rate of the device's force output thread to how fast the
+ * device takes updates, see FFBRateGovernorConfig. NULL config for the
+ * defaults. Not recorded, the rates it picks depend on the device it
+ * runs against.
+ */
+HRESULT DeviceEnableFFBRateGovernor(FFBDeviceHandle device, const FFBRateGovernorConfig* config)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   return pContext != NULL ? pContext->EnableRateGovernor(config) : E_HANDLE;
+}
+
+void DeviceDisableFFBRateGovernor(FFBDeviceHandle device)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   if (pContext != NULL)
+   {
+      pContext->DisableRateGovernor();
+   }
+}
+
+HRESULT DeviceGetFFBRateGovernorStats(FFBDeviceHandle device, FFBRateGovernorStats* stats)
+{
+   if (stats == NULL)
+   {
+      return E_POINTER;
+   }
+   FFBDeviceContext* pContext = GetDevice(device);
+   if (pContext == NULL)
+   {
+      return E_HANDLE;
+   }
+   pContext->GetRateGovernorStats(*stats);
+   return S_OK;
+}
+
+/**
+ * Set how many effects the device can hold at once, 32 by default. Limited
+ * to what the device reports it supports, returns S_FALSE when it was.
+ * Fails with E_BOUNDS if more effects than capacity already exist.
+ */
+HRESULT DeviceSetFFBEffectCapacity(FFBDeviceHandle device, int capacity)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   return Recorded(pContext != NULL ? pContext->SetEffectCapacity(capacity) : E_HANDLE, FFBRecordCalls::Type::SetEffectCapacity, device, capacity);
+}
+
+/**
+ * Create an effect and return its handle. Unlike DeviceAddFFBEffect any
+ * number of effects of a type can exist, they are summed by the device.
+ * Returns DIERR_DEVICEFULL once the capacity or the device is full.
+ *
+ * The first effect of each type is also the one the type based functions
+ * (DeviceUpdateConstantForce, ...) update. Once it is destroyed they
+ * update another effect of the type, if one is left.
+ */
+HRESULT DeviceCreateFFBEffect(FFBDeviceHandle device, Effects::Type effectType, FFBEffectHandle* effect)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   HRESULT hr = FFB_STAT_CALL(FFBStatCalls::Type::CreateEffect, pContext != NULL ? pContext->CreateEffect(effectType, effect) : E_HANDLE);
+   return Recorded(hr, FFBRecordCalls::Type::CreateEffect, device, effectType, SUCCEEDED(hr) ? effect : NULL, sizeof(FFBEffectHandle));
+}
+
+/**
+ * Release an effect. Its handle stays invalid, E_HANDLE is returned for it
+ * even after the slot is reused by another effect.
+ */
+HRESULT DeviceDestroyFFBEffect(FFBDeviceHandle device, FFBEffectHandle effect)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   return Recorded(FFB_STAT_CALL(FFBStatCalls::Type::DestroyEffect, pContext != NULL ? pContext->DestroyEffect(effect) : E_HANDLE),
+      FFBRecordCalls::Type::DestroyEffect, device, effect);
+}
+
+HRESULT DeviceUpdateFFBEffectConstantForce(FFBDeviceHandle device, FFBEffectHandle effect, LONG magnitude, LONG* directions)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   return RecordedConstantForce(FFB_STAT_CALL(FFBStatCalls::Type::UpdateConstantForce, pContext != NULL ? pContext->UpdateEffectConstantForce(effect, magnitude, directions) : E_HANDLE),
+      FFBRecordCalls::Type::UpdateEffectConstantForce, device, effect, pContext, magnitude, directions);
+}
+
+HRESULT DeviceUpdateFFBEffectCondition(FFBDeviceHandle device, FFBEffectHandle effect, DICONDITION* conditions)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   return RecordedConditions(FFB_STAT_CALL(FFBStatCalls::Type::UpdateCondition, pContext != NULL ? pContext->UpdateEffectCondition(effect, conditions) : E_HANDLE),
+      FFBRecordCalls::Type::UpdateEffectCondition, device, effect, pContext, conditions);
+}
+
+HRESULT DeviceUpdateFFBEffectPeriodic(FFBDeviceHandle device, FFBEffectHandle effect, const FFBPeriodicEffect* periodic, LONG* directions)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   return RecordedPeriodic(FFB_STAT_CALL(FFBStatCalls::Type::UpdatePeriodic, pContext != NULL ? pContext->UpdateEffectPeriodic(effect, periodic, directions) : E_HANDLE),
+      FFBRecordCalls::Type::UpdateEffectPeriodic, device, effect, pContext, periodic, directions);
+}
+
+HRESULT DeviceUpdateFFBEffectCustomForce(FFBDeviceHandle device, FFBEffectHandle effect, const FFBCustomForce* customForce, LONG* directions)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   return RecordedCustomForce(FFB_STAT_CALL(FFBStatCalls::Type::UpdateCustomForce, pContext != NULL ? pContext->UpdateEffectCustomForce(effect, customForce, directions) : E_HANDLE),
+      FFBRecordCalls::Type::UpdateEffectCustomForce, device, effect, pContext, customForce, directions);
+}
+
+HRESULT DeviceUpdateFFBEffect(FFBDeviceHandle device, FFBEffectHandle effect, const void* params, DWORD flags)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   Effects::Type effectType;
+   if (pContext == NULL || !pContext->GetEffectType(effect, effectType))
+   {
+      return Recorded(FFB_STAT_CALL(FFBStatCalls::Type::UpdateEffect, E_HANDLE), FFBRecordCalls::Type::UpdateFFBEffect, device, effect);
+   }
+   return RecordedEffectUpdate(FFB_STAT_CALL(FFBStatCalls::Type::UpdateEffect, pContext->UpdateFFBEffect(effect, params, flags)),
+      FFBRecordCalls::Type::UpdateFFBEffect, device, effect, effectType, params, flags);
+}
+
+/**
+ * Upload counts and times of a CustomForce effect's chunks.
+ */
+HRESULT DeviceGetFFBCustomForceStats(FFBDeviceHandle device, FFBEffectHandle effect, FFBCustomForceStats* stats)
+{
+   if (stats == NULL)
+   {
+      return E_POINTER;
+   }
+   FFBDeviceContext* pContext = GetDevice(device);
+   if (pContext == NULL)
+   {
+      ZeroMemory(stats, sizeof(*stats));
+      return E_HANDLE;
+   }
+   return pContext->GetCustomForceStats(effect, *stats);
+}
+
+HRESULT DeviceSetFFBEffectGain(FFBDeviceHandle device, FFBEffectHandle effect, float gainPercent)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   return Recorded(FFB_STAT_CALL(FFBStatCalls::Type::UpdateGain, pContext != NULL ? pContext->SetEffectGain(effect, gainPercent) : E_HANDLE),
+      FFBRecordCalls::Type::SetEffectGain, device, effect, &gainPercent, sizeof(float));
+}
+
+HRESULT DeviceStartFFBEffect(FFBDeviceHandle device, FFBEffectHandle effect)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   return Recorded(FFB_STAT_CALL(FFBStatCalls::Type::StartEffects, pContext != NULL ? pContext->StartEffect(effect) : E_HANDLE),
+      FFBRecordCalls::Type::StartEffect, device, effect);
+}
+
+HRESULT DeviceStopFFBEffect(FFBDeviceHandle device, FFBEffectHandle effect)
+{
+   FFBDeviceContext* pContext = GetDevice(device);
+   return Recorded(FFB_STAT_CALL(FFBStatCalls::Type::StopEffects, pContext != NULL ? pContext->StopEffect(effect) : E_HANDLE),
+      FFBRecordCalls::Type::StopEffect, device, effect);
+}
+
+/**
+ * Counters of effect updates received by the plugin vs. what was actually
+ * forwarded to the driver after change detection, over all devices.
+ */
+HRESULT GetFFBUpdateCounters(FFBUpdateCounters* counters)
+{
+   if (counters == NULL)
+   {
+      return E_POINTER;
+   }
+   counters->callsReceived = g_nCallsReceived.load();
+   counters->callsForwarded = g_nCallsForwarded.load();
+   counters->parameterBytesSent = g_nParameterBytesSent.load();
+   return S_OK;
+}
+
+void ResetFFBUpdateCounters()
+{
+   g_nCallsReceived = 0;
+   g_nCallsForwarded = 0;
+   g_nParameterBytesSent = 0;
+}
+
+/**
+ * Timing, call and failure counts of the exported functions and of the
+ * driver calls the plugin made (see FFBStatCalls), since the plugin was
+ * loaded or ResetFFBStats. enabled is FALSE and everything 0 when the
+ * plugin was built with UNITYFFB_NO_STATS.
+ *
+ * Histograms count clock ticks, nanosecondsPerTick converts them. The
+ * tick rate is measured, so the first call within 10 ms of the plugin
+ * loading waits for that long.
+ */
+HRESULT GetFFBStats(FFBStats* stats)
+{
+   if (stats == NULL)
+   {
+      return E_POINTER;
+   }
+   ZeroMemory(stats, sizeof(*stats));
+   stats->callCount = FFB_STAT_CALL_COUNT;
+#ifndef UNITYFFB_NO_STATS
+   double nanosecondsPerTick = StatNanosecondsPerTick();
+   stats->enabled = TRUE;
+   stats->nanosecondsPerTick = (float)nanosecondsPerTick;
+   for (int i = 0; i < FFB_STAT_CALL_COUNT; i++)
+   {
+      g_callStats[i].Read(stats->calls[i], nanosecondsPerTick);
+   }
+#endif
+   return S_OK;
+}
+
+void ResetFFBStats()
+{
+#ifndef UNITYFFB_NO_STATS
+   for (int i = 0; i < FFB_STAT_CALL_COUNT; i++)
+   {
+      g_callStats[i].Reset();
+   }
+#endif
+}
+
+/**
+ * Record the calls made to the device and effect functions into a file at
+ * path, replacing it, for ffb-replay to play back. Open devices and their
+ * effects reachable by type are described first, so recording can start
+ * at any time; effects created by handle before it started are not.
+ *
+ * The calling thread only copies each call into memory, a background
+ * thread writes the file. StopDirectInput stops recording.
+ */
+HRESULT StartFFBRecording(LPCSTR path)
+{
+   if (g_pRecorder == NULL)
+   {
+      g_pRecorder = new Recorder();
+   }
+   HRESULT hr = g_pRecorder->Start(path);
+   if (FAILED(hr))
+   {
+      return hr;
+   }
+   for (const DeviceEntry& entry : g_vDevices)
+   {
+      RecordDeviceState(entry.handle, entry.pContext);
+   }
+   return S_OK;
+}
+
+/**
+ * Stop recording and close the file, once everything recorded is written.
+ */
+void StopFFBRecording()
+{
+   if (g_pRecorder != NULL)
+   {
+      g_pRecorder->Stop();
+   }
+}
+
+HRESULT GetFFBRecorderStats(FFBRecorderStats* stats)
+{
+   if (stats == NULL)
+   {
+      return E_POINTER;
+   }
+   ZeroMemory(stats, sizeof(*stats));
+   if (g_pRecorder != NULL)
+   {
+      g_pRecorder->GetStats(*stats);
+   }
+   return S_OK;
+}
+
+/**
+ * Single device API. These predate device handles and operate on the
+ * default device: the one created by CreateFFBDevice, or else the first
+ * device opened with OpenFFBDevice.
+ */
+
+/**
+ * Create a force feedback device. The guid of the device you want to create must
+ * be passed in. The guid can be obtained by looking at the array of enumerated
+ * devices. Replaces the previous default device.
+ */
+HRESULT CreateFFBDevice(LPCSTR guidInstance)
+{
+   FreeFFBDevice();
+   FFBDeviceHandle device;
+   HRESULT hr = OpenFFBDevice(guidInstance, &device);
+   if (SUCCEEDED(hr))
+   {
+      g_hDefaultDevice = device;
+   }
+   return hr;
+}
+
+/**
+ * This function will return info about Force Feedback Axes associate with
+ * the currently selected device. For a steering wheel, there's typically
+ * only 1 axis.
+ */
+DeviceAxisInfo* EnumerateFFBAxes(int &axisCount)
+{
+   return DeviceEnumerateFFBAxes(g_hDefaultDevice, axisCount);
+}
+
+HRESULT EnumerateFFBAxisSnapshot(const FFBEnumSnapshot** snapshot)
+{
+   return DeviceEnumerateFFBAxisSnapshot(g_hDefaultDevice, snapshot);
+}
+
+HRESULT GetFFBDeviceCapabilities(FFBDeviceCapabilities* capabilities)
+{
+   return DeviceGetFFBDeviceCapabilities(g_hDefaultDevice, capabilities);
+}
+
+HRESULT GetFFBEffectPoolStats(FFBEffectPoolStats* stats)
+{
+   return DeviceGetFFBEffectPoolStats(g_hDefaultDevice, stats);
+}
+
+HRESULT GetFFBMemoryStats(FFBMemoryStats* stats)
+{
+   return DeviceGetFFBMemoryStats(g_hDefaultDevice, stats);
+}
+
+/**
+ * Add a Force Feedback Effect to the current device.
+ * Only one of each effect can be added at a time, use CreateFFBEffect to
+ * have several.
+ */
+HRESULT AddFFBEffect(Effects::Type effectType)
+{
+   return DeviceAddFFBEffect(g_hDefaultDevice, effectType);
+}
+
+/**
+ * Remove a force feedback effect by type.
+ */
+HRESULT RemoveFFBEffect(Effects::Type effectType)
+{
+   return DeviceRemoveFFBEffect(g_hDefaultDevice, effectType);
+}
+
+/**
+ * This will start all force feedback effects.
+ */
+void StartAllFFBEffects()
+{
+   DeviceStartAllFFBEffects(g_hDefaultDevice);
+}
+
+/**
+ * This will stop all force feedback effects.
+ */
+void StopAllFFBEffects()
+{
+   DeviceStopAllFFBEffects(g_hDefaultDevice);
+}
+
+/**
+ * Update the gain for the specified effect.
+ *
+ * Takes gainPercent value between 0 - 1 and multiplies with
+ * DI_FFNOMINALMAX (10000)
+ */
+HRESULT UpdateEffectGain(Effects::Type effectType, float gainPercent)
+{
+   return DeviceUpdateEffectGain(g_hDefaultDevice, effectType, gainPercent);
+}
+
+/**
+ * Update the Constant Force Effect.
+ * 
+ * Magnitude is the magnitude of the force on all axes.
+ * Directions is an array of directions for each axis on the device.
+ * The size of the array must match the number of axes on the device.
+ */
+HRESULT UpdateConstantForce(LONG magnitude, LONG* directions)
+{
+   return DeviceUpdateConstantForce(g_hDefaultDevice, magnitude, directions);
+}
+
+/**
+ * Updates the spring effect. You must pass an array of conditions that's
+ * size matches the number of axes on the device.
+ */
+HRESULT UpdateSpring(DICONDITION* conditions)
+{
+   return DeviceUpdateCondition(g_hDefaultDevice, Effects::Type::Spring, conditions);
+}
+
+HRESULT UpdateCondition(Effects::Type effectType, DICONDITION* conditions)
+{
+   return DeviceUpdateCondition(g_hDefaultDevice, effectType, conditions);
+}
+
+/**
+ * Updates a periodic effect, the device plays the waveform on its own.
+ * Directions must hold one entry per axis, see FFBPeriodicEffect.
+ */
+HRESULT UpdatePeriodic(Effects::Type effectType, const FFBPeriodicEffect* periodic, LONG* directions)
+{
+   return DeviceUpdatePeriodic(g_hDefaultDevice, effectType, periodic, directions);
+}
+
+/**
+ * Plays a chunk of samples on the CustomForce effect, read in place from
+ * the caller's buffer. With the force output thread running the chunk
+ * waits for the one playing to finish, E_PENDING while another chunk
+ * waits; see FFBCustomForce.
+ */
+HRESULT UpdateCustomForce(const FFBCustomForce* customForce, LONG* directions)
+{
+   return DeviceUpdateCustomForce(g_hDefaultDevice, customForce, directions);
+}
+
+/**
+ * Updates the effect of a type from the parameters of its kind
+ * (FFBConstantForceParams, FFBRampForceParams, FFBPeriodicParams,
+ * FFBConditionParams or FFBCustomForceParams), sending the DIEP_* fields
+ * in flags, every field the type has when 0. See GetFFBEffectTypeInfo.
+ */
+HRESULT UpdateEffect(Effects::Type effectType, const void* params, DWORD flags)
+{
+   return DeviceUpdateEffect(g_hDefaultDevice, effectType, params, flags);
+}
+
+/**
+ * How big the parameters UpdateEffect takes for a type are and the flags
+ * they have fields for, to check a binding's structures against.
+ */
+HRESULT GetFFBEffectTypeInfo(Effects::Type effectType, FFBEffectTypeInfo* info)
+{
+   if (info == NULL)
+   {
+      return E_POINTER;
+   }
+   if (effectType < 0 || effectType >= FFB_EFFECT_TYPE_COUNT)
+   {
+      ZeroMemory(info, sizeof(*info));
+      return E_INVALIDARG;
+   }
+   info->paramsSize = EFFECT_TYPES[effectType].paramsSize;
+   info->parameterFlags = EFFECT_TYPES[effectType].parameterFlags;
+   return S_OK;
+}
+
+HRESULT SubmitFFBCommands(const FFBCommand* commands, int commandCount, HRESULT* results)
+{
+   return DeviceSubmitFFBCommands(g_hDefaultDevice, commands, commandCount, results);
+}
+
+/**
+ * Toggle the auto centering spring for the device.
+ */
+HRESULT SetAutoCenter(bool autoCenter)
+{
+   return DeviceSetAutoCenter(g_hDefaultDevice, autoCenter);
+}
+
+HRESULT StartForceOutputThread(int rateHz)
+{
+   return DeviceStartForceOutputThread(g_hDefaultDevice, rateHz);
+}
+
+void StopForceOutputThread()
+{
+   DeviceStopForceOutputThread(g_hDefaultDevice);
+}
+
+HRESULT SetForceOutputRate(int rateHz)
+{
+   return DeviceSetForceOutputRate(g_hDefaultDevice, rateHz);
+}
+
+HRESULT GetForceOutputStats(ForceOutputStats* stats)
+{
+   return DeviceGetForceOutputStats(g_hDefaultDevice, stats);
+}
+
+void ResetForceOutputStats()
+{
+   DeviceResetForceOutputStats(g_hDefaultDevice);
+}
+
+HRESULT EnableForceSynthesis(const ForceSynthConfig* config)
+{
+   return DeviceEnableForceSynthesis(g_hDefaultDevice, config);
+}
+
+void DisableForceSynthesis()
+{
+   DeviceDisableForceSynthesis(g_hDefaultDevice);
+}
+
+HRESULT GetForceSynthState(ForceSynthState* state)
+{
+   return DeviceGetForceSynthState(g_hDefaultDevice, state);
+}
+
+HRESULT ConfigureForceDsp(int axis, const ForceDspConfig* config)
+{
+   return DeviceConfigureForceDsp(g_hDefaultDevice, axis, config);
+}
+
+void DisableForceDsp()
+{
+   DeviceDisableForceDsp(g_hDefaultDevice);
+}
+
+HRESULT GetForceDspState(ForceDspState* state)
+{
+   return DeviceGetForceDspState(g_hDefaultDevice, state);
+}
+
+HRESULT EnableForceKeyframes(const FFBKeyframeConfig* config)
+{
+   return DeviceEnableForceKeyframes(g_hDefaultDevice, config);
+}
+
+void DisableForceKeyframes()
+{
+   DeviceDisableForceKeyframes(g_hDefaultDevice);
+}
+
+HRESULT SubmitForceKeyframes(const FFBForceKeyframe* keyframes, int keyframeCount)
+{
+   return DeviceSubmitForceKeyframes(g_hDefaultDevice, keyframes, keyframeCount);
+}
+
+HRESULT GetForceKeyframeStats(FFBKeyframeStats* stats)
+{
+   return DeviceGetForceKeyframeStats(g_hDefaultDevice, stats);
+}
+
+HRESULT ConfigureForceMixer(const FFBForceMixerConfig* config)
+{
+   return DeviceConfigureForceMixer(g_hDefaultDevice, config);
+}
+
+HRESULT CreateForceLayer(LPCSTR name, const FFBForceLayerConfig* config, FFBForceLayerHandle* layer)
+{
+   return DeviceCreateForceLayer(g_hDefaultDevice, name, config, layer);
+}
+
+HRESULT FindForceLayer(LPCSTR name, FFBForceLayerHandle* layer)
+{
+   return DeviceFindForceLayer(g_hDefaultDevice, name, layer);
+}
+
+HRESULT ConfigureForceLayer(FFBForceLayerHandle layer, const FFBForceLayerConfig* config)
+{
+   return DeviceConfigureForceLayer(g_hDefaultDevice, layer, config);
+}
+
+HRESULT UpdateForceLayer(FFBForceLayerHandle layer, const float* force)
+{
+   return DeviceUpdateForceLayer(g_hDefaultDevice, layer, force);
+}
+
+HRESULT DestroyForceLayer(FFBForceLayerHandle layer)
+{
+   return DeviceDestroyForceLayer(g_hDefaultDevice, layer);
+}
+
+HRESULT GetForceLayerState(FFBForceLayerHandle layer, FFBForceLayerState* state)
+{
+   return DeviceGetForceLayerState(g_hDefaultDevice, layer, state);
+}
+
+HRESULT GetForceMixerState(FFBForceMixerState* state)
+{
+   return DeviceGetForceMixerState(g_hDefaultDevice, state);
+}
+
+HRESULT StartFFBInputCapture(const FFBInputCaptureConfig* config)
+{
+   return DeviceStartFFBInputCapture(g_hDefaultDevice, config);
+}
+
+void StopFFBInputCapture()
+{
+   DeviceStopFFBInputCapture(g_hDefaultDevice);
+}
+
+HRESULT GetFFBInputRing(FFBInputRing* ring)
+{
+   return DeviceGetFFBInputRing(g_hDefaultDevice, ring);
+}
+
+HRESULT GetFFBInputCaptureStats(FFBInputCaptureStats* stats)
+{
+   return DeviceGetFFBInputCaptureStats(g_hDefaultDevice, stats);
+}
+
+HRESULT AttachFFBBridge(LPCSTR name, const FFBBridgeConfig* config)
+{
+   return DeviceAttachFFBBridge(g_hDefaultDevice, name, config);
+}
+
+void DetachFFBBridge()
+{
+   DeviceDetachFFBBridge(g_hDefaultDevice);
+}
+
+HRESULT GetFFBBridgeStats(FFBBridgeStats* stats)
+{
+   return DeviceGetFFBBridgeStats(g_hDefaultDevice, stats);
+}
+
+HRESULT EnableFFBRateGovernor(const FFBRateGovernorConfig* config)
+{
+   return DeviceEnableFFBRateGovernor(g_hDefaultDevice, config);
+}
+
+void DisableFFBRateGovernor()
+{
+   DeviceDisableFFBRateGovernor(g_hDefaultDevice);
+}
+
+HRESULT GetFFBRateGovernorStats(FFBRateGovernorStats* stats)
+{
+   return DeviceGetFFBRateGovernorStats(g_hDefaultDevice, stats);
+}
+
+HRESULT SetFFBEffectCapacity(int capacity)
+{
+   return DeviceSetFFBEffectCapacity(g_hDefaultDevice, capacity);
+}
+
+HRESULT CreateFFBEffect(Effects::Type effectType, FFBEffectHandle* effect)
+{
+   return DeviceCreateFFBEffect(g_hDefaultDevice, effectType, effect);
+}
+
+HRESULT DestroyFFBEffect(FFBEffectHandle effect)
+{
+   return DeviceDestroyFFBEffect(g_hDefaultDevice, effect);
+}
+
+HRESULT UpdateFFBEffectConstantForce(FFBEffectHandle effect, LONG magnitude, LONG* directions)
+{
+   return DeviceUpdateFFBEffectConstantForce(g_hDefaultDevice, effect, magnitude, directions);
+}
+
+HRESULT UpdateFFBEffectCondition(FFBEffectHandle effect, DICONDITION* conditions)
+{
+   return DeviceUpdateFFBEffectCondition(g_hDefaultDevice, effect, conditions);
+}
+
+HRESULT UpdateFFBEffectPeriodic(FFBEffectHandle effect, const FFBPeriodicEffect* periodic, LONG* directions)
+{
+   return DeviceUpdateFFBEffectPeriodic(g_hDefaultDevice, effect, periodic, directions);
+}
+
+HRESULT UpdateFFBEffectCustomForce(FFBEffectHandle effect, const FFBCustomForce* customForce, LONG* directions)
+{
+   return DeviceUpdateFFBEffectCustomForce(g_hDefaultDevice, effect, customForce, directions);
+}
+
+HRESULT UpdateFFBEffect(FFBEffectHandle effect, const void* params, DWORD flags)
+{
+   return DeviceUpdateFFBEffect(g_hDefaultDevice, effect, params, flags);
+}
+
+HRESULT GetFFBCustomForceStats(FFBEffectHandle effect, FFBCustomForceStats* stats)
+{
+   return DeviceGetFFBCustomForceStats(g_hDefaultDevice, effect, stats);
+}
+
+HRESULT SetFFBEffectGain(FFBEffectHandle effect, float gainPercent)
+{
+   return DeviceSetFFBEffectGain(g_hDefaultDevice, effect, gainPercent);
+}
+
+HRESULT StartFFBEffect(FFBEffectHandle effect)
+{
+   return DeviceStartFFBEffect(g_hDefaultDevice, effect);
+}
+
+HRESULT StopFFBEffect(FFBEffectHandle effect)
+{
+   return DeviceStopFFBEffect(g_hDefaultDevice, effect);
+}
+
+/**
+ * Clean up the default Force Feedback device and any effects.
+ */
+void FreeFFBDevice()
+{
+   if (GetDevice(g_hDefaultDevice) != NULL)
+   {
+      CloseFFBDevice(g_hDefaultDevice);
+   }
+}
+
+/**
+ * Clean-up DirectInput, all devices and any effects.
+ */
+void FreeDirectInput()
+{
+   // The monitor uses the backend, an unfinished init is cancelled.
+   SAFE_DELETE(g_pMonitor);
+   SAFE_DELETE(g_pInit);
+   SAFE_DELETE(g_pRecorder);
+   if (g_pCapabilityCache != NULL)
+   {
+      // So is the device check.
+      RememberDevices();
+      g_pCapabilityCache->StopDeviceCheck();
+      g_pCapabilityCache->Save();
+   }
+   g_bDevicesEnumerated = false;
+   for (DeviceEntry& entry : g_vDevices)
+   {
+      SAFE_DELETE(entry.pContext);
+   }
+   g_vDevices.clear();
+   g_hLastDevice = 0;
+   g_hDefaultDevice = 0;
+   DiscardCommandQueue();
+   SAFE_DELETE(g_pBackend);
+}
+
+/**
+ * Clear the DeviceInfo's of the enumerated force feedback devices.
+ */
+void ClearDeviceInstances()
+{
+   g_vDeviceInstances.clear();
+   g_vDeviceGuids.clear();
+}
+
+/**
+ * This will stop the DirectInput Force Feedback and
+ * clean up all memory and references to devices and effects.
+ */
+void StopDirectInput()
+{
+   FreeDirectInput();
+   ClearDeviceInstances();
+   g_deviceSnapshot.Release();
+}
@@ -1,6 +1,9 @@
+#pragma once
 #include "pch.h"
 
-#ifdef UNITYFFB_EXPORTS
+#ifndef _WIN32
+#define UNITYFFB_API __attribute__((visibility("default")))
+#elif defined(UNITYFFB_EXPORTS)
 #define UNITYFFB_API __declspec(dllexport)
 #else
 #define UNITYFFB_API __declspec(dllimport)
@@ -8,21 +11,50 @@
 
 #define SAFE_DELETE(p)  { if(p) { delete (p);     (p)=NULL; } }
 
-LPDIRECTINPUT8          g_pDI = NULL;
-LPDIRECTINPUTDEVICE8    g_pDevice = NULL;
-BOOL                    g_bActive = TRUE;
-DWORD                   g_dwNumForceFeedbackAxis = 0;
+// DIJOYSTATE has 6 axes, the most an effect can address.
+#define MAX_FFB_AXES    6
+
+// Effects StartFFBInitAsync can add.
+#define MAX_FFB_INIT_EFFECTS  8
+#define FFB_INIT_STAGE_COUNT  6
+
+#define FFB_STAT_CALL_COUNT   26
+// Calls taking 2^i to 2^(i+1) clock ticks land in bucket i.
+#define FFB_STAT_BUCKETS      32
+// Distinct failure HRESULTs counted per call.
+#define FFB_STAT_RESULTS      4
+
+// Commands EnqueueFFBCommands can hold until they are drained.
+#define FFB_COMMAND_QUEUE_CAPACITY  1024
+
+// Effects::Type values.
+#define FFB_EFFECT_TYPE_COUNT 12
+
+// Force layers a device can mix, and the longest layer name + 1.
+#define FFB_MAX_FORCE_LAYERS  64
+#define FFB_FORCE_LAYER_NAME  32
+
+// Input records a device's capture ring holds, a power of two.
+#define FFB_INPUT_RING_CAPACITY  4096
+
+// Longest force bridge region name + 1.
+#define FFB_BRIDGE_NAME       64
 
 BOOL CALLBACK _cbEnumFFBDevices(const DIDEVICEINSTANCE* pInst, void* pContext);
-BOOL CALLBACK _cbEnumFFBAxes(const DIDEVICEOBJECTINSTANCE* pdidoi, void* pContext);
 
 void ClearDeviceInstances();
-void ClearDeviceAxes();
 void FreeFFBDevice();
 void FreeDirectInput();
 
 extern "C"
 {
+   // Identifies a device opened with OpenFFBDevice, 0 is never a valid handle.
+   typedef int FFBDeviceHandle;
+   // Identifies an effect created with CreateFFBEffect, 0 is never valid.
+   typedef uint32_t FFBEffectHandle;
+   // Identifies a force layer of a device, never 0.
+   typedef uint32_t FFBForceLayerHandle;
+
    struct DeviceInfo {
       DWORD deviceType;
       LPSTR guidInstance;
@@ -48,6 +80,79 @@ extern "C"
       LPSTR name;
    };
 
+   /**
+    * An enumeration result as one contiguous block of blittable data: this
+    * header, recordCount records of recordSize bytes at recordOffset and a
+    * pool of null terminated UTF-8 strings at stringOffset. Offsets are in
+    * bytes from the start of the snapshot, the string fields of a record are
+    * offsets into the pool.
+    *
+    * Owned by the plugin, valid until the next enumeration of the same kind
+    * or StopDirectInput.
+    */
+   struct FFBEnumSnapshot {
+      // Bytes in the whole snapshot, header included.
+      DWORD size;
+      DWORD recordCount;
+      DWORD recordSize;
+      DWORD recordOffset;
+      DWORD stringOffset;
+      DWORD stringBytes;
+   };
+
+   struct FFBDeviceRecord {
+      GUID guidInstance;
+      GUID guidProduct;
+      DWORD deviceType;
+      DWORD instanceName;
+      DWORD productName;
+      DWORD reserved;
+   };
+
+   struct FFBAxisRecord {
+      GUID guidType;
+      // Offset of the axis in DIJOYSTATE (DIJOFS_X, ...), how effects address it.
+      DWORD joystateOffset;
+      DWORD offset;
+      DWORD type;
+      DWORD flags;
+      DWORD ffMaxForce;
+      DWORD ffForceResolution;
+      DWORD collectionNumber;
+      DWORD designatorIndex;
+      DWORD usagePage;
+      DWORD usage;
+      DWORD dimension;
+      DWORD exponent;
+      DWORD reportId;
+      DWORD name;
+   };
+
+   struct FFBDeviceEvents {
+      typedef enum {
+         Added = 0,
+         Removed = 1,
+         // Same instance, different product, type or name.
+         Changed = 2,
+         // An open device was attached again and its effects recreated.
+         Restored = 3
+      } Type;
+   };
+
+   /**
+    * A change to the attached devices, reported by the device monitor.
+    */
+   struct FFBDeviceEvent {
+      FFBDeviceEvents::Type type;
+      DWORD deviceType;
+      GUID guidInstance;
+      GUID guidProduct;
+      // The open device the event is about, 0 if the device is not open.
+      FFBDeviceHandle device;
+      // For Restored, whether the device and its effects could be recreated.
+      HRESULT result;
+   };
+
    struct Effects {
       typedef enum {
          ConstantForce = 0,
@@ -65,16 +170,996 @@ extern "C"
       } Type;
    };
 
+   struct FFBCommands {
+      typedef enum {
+         UpdateConstantForce = 0,
+         UpdateSpring = 1,
+         SetGain = 2,
+         Start = 3,
+         Stop = 4,
+         UpdateCondition = 5,
+         UpdatePeriodic = 6
+      } Type;
+   };
+
+   /**
+    * A periodic effect (Square, Sine, Triangle, SawtoothUp, SawtoothDown)
+    * played by the device itself: once it is sent, the wheel generates the
+    * waveform and nothing more has to be sent until something changes.
+    */
+   struct FFBPeriodicEffect {
+      // dwMagnitude and lOffset 0 to 10000, dwPhase in hundredths of a
+      // degree, dwPeriod in microseconds.
+      DIPERIODIC periodic;
+      // Not sent when dwAttackTime and dwFadeTime are both 0, dwSize is
+      // set by the plugin.
+      DIENVELOPE envelope;
+      // Microseconds, 0 or INFINITE to play until stopped. A finite
+      // effect plays once, StartFFBEffect plays it again.
+      DWORD duration;
+   };
+
+   /**
+    * One entry of a SubmitFFBCommands batch. The payload is selected by
+    * command, constantForce.directions, periodic.directions and conditions
+    * hold one entry per device axis.
+    */
+   struct FFBCommand {
+      FFBCommands::Type command;
+      Effects::Type effectType;
+      union {
+         struct {
+            LONG magnitude;
+            LONG directions[MAX_FFB_AXES];
+         } constantForce;
+         DICONDITION conditions[MAX_FFB_AXES];
+         struct {
+            FFBPeriodicEffect effect;
+            LONG directions[MAX_FFB_AXES];
+         } periodic;
+         float gainPercent;
+      };
+   };
+
+   struct Backends {
+      typedef enum {
+         DirectInput = 0,
+         Simulated = 1
+      } Type;
+   };
+
+   /**
+    * Describes the wheel(s) modelled by the simulated backend.
+    */
+   struct SimulatedDeviceConfig {
+      int deviceCount;
+      int axisCount;
+      DWORD maxForce;
+      DWORD forceResolution;
+      // Busy-waited on every driver call to model USB round trips.
+      DWORD latencyMicroseconds;
+      // Every Nth SetParameters is acknowledged but not applied, 0 disables.
+      DWORD dropEveryN;
+      // Each GetState advances the wheel physics by this much, 0 uses
+      // the real time elapsed since the previous GetState.
+      DWORD physicsStepMicroseconds;
+      // Effects the wheel can hold at once, 0 for no limit.
+      DWORD maxEffects;
+      // Slept once by every EnumDevices, EnumAxes and GetEffectInfo, to
+      // model wheels that are slow to enumerate and probe.
+      DWORD enumerationMicroseconds;
+      // Busy-waited on top of the latency when an effect is first written
+      // into the wheel's memory, by CreateEffect or by the first Download,
+      // Start or SetParameters of an effect created without parameters.
+      // Changes held back with DIEP_NODOWNLOAD later go along with the
+      // effect's next call at no extra cost.
+      DWORD downloadMicroseconds;
+      // Rate custom force samples reach the wheel at, every upload is
+      // busy-waited for its samples on top of the latency. 0 sends them at
+      // no cost.
+      DWORD sampleBytesPerMillisecond;
+      // Updates per second the wheel's firmware processes. A SetParameters
+      // arriving before the previous update was processed busy-waits for
+      // it, like a driver blocked on a full endpoint. 0 for no limit.
+      DWORD firmwareUpdateHz;
+   };
+
+   struct SimulatedDeviceState {
+      DWORD effectsCreated;
+      DWORD setParametersCalls;
+      DWORD droppedUpdates;
+      DWORD startCalls;
+      DWORD stopCalls;
+      BOOL autoCenter;
+      LONG outputForce[6];
+      // Axis positions in c_dfDIJoystick range (0 - 65535).
+      LONG axisPosition[6];
+      // Effects written into the wheel's memory.
+      DWORD downloads;
+      // Custom force samples received, over all channels.
+      DWORD samplesReceived;
+   };
+
+   struct FFBUpdateCounters {
+      // Effect updates the plugin was asked to make.
+      DWORD callsReceived;
+      // Updates that reached the driver after dropping unchanged fields.
+      DWORD callsForwarded;
+      DWORD parameterBytesSent;
+   };
+
+   struct ForceOutputStats {
+      BOOL running;
+      int rateHz;
+      DWORD ticks;
+      // Ticks that ran past the following deadline.
+      DWORD overruns;
+      DWORD updatesApplied;
+      DWORD updatesFailed;
+      // How late the thread woke up relative to its schedule.
+      float meanJitterMicroseconds;
+      float maxJitterMicroseconds;
+   };
+
+   /**
+    * Tuning for the software condition effects. Positions are in
+    * DirectInput units (-10000 to 10000 across the axis range), velocity
+    * and acceleration in units per second (squared).
+    */
+   struct ForceSynthConfig {
+      // Low pass cutoffs applied to the differentiated position.
+      float velocityCutoffHz;
+      float accelerationCutoffHz;
+      // Velocity/acceleration that damper/inertia treat as full scale.
+      float velocityFullScale;
+      float accelerationFullScale;
+      // Velocity at which friction reaches its full coefficient.
+      float frictionVelocityThreshold;
+   };
+
+   struct ForceSynthState {
+      int axisCount;
+      DWORD steps;
+      float position[6];
+      float velocity[6];
+      float acceleration[6];
+      // Force the synthesizer added to each axis on its last step.
+      float force[6];
+   };
+
+   /**
+    * Conditioning of the force sent on one axis, applied at the output
+    * rate in this order: low pass, notch, compressor, slew limit, clip to
+    * DI_FFNOMINALMAX. Forces are in DirectInput units. A stage is off when
+    * its frequency, ratio or rate is 0, filters at or above half the output
+    * rate are off as well.
+    */
+   struct ForceDspConfig {
+      // Second order low pass, Q 0.707 (Butterworth) when 0.
+      float lowPassHz;
+      float lowPassQ;
+      // Notch for a resonance of the wheel, Q 2 when 0.
+      float notchHz;
+      float notchQ;
+      // Forces above threshold are reduced by ratio (4 for 4:1), eased in
+      // over kneeWidth centered on the threshold.
+      float compressorThreshold;
+      float compressorRatio;
+      float kneeWidth;
+      // Largest change of the force per second.
+      float slewRate;
+   };
+
+   struct ForceDspState {
+      int axisCount;
+      DWORD samples;
+      float sampleRateHz;
+      // Samples beyond DI_FFNOMINALMAX at the end of the chain, which were
+      // clipped, per axis.
+      DWORD clippedSamples[6];
+      // Force into and out of the chain on the last sample.
+      float input[6];
+      float output[6];
+   };
+
+   /**
+    * How the output thread turns keyframes into a force every tick.
+    */
+   struct FFBKeyframeModes {
+      typedef enum {
+         // Cubic Hermite between the keyframes around now - delayMs.
+         Hermite = 0,
+         // Linear from the newest keyframe to now + lookaheadMs.
+         Extrapolate = 1
+      } Type;
+   };
+
+   struct FFBKeyframeConfig {
+      FFBKeyframeModes::Type mode;
+      // Hermite: how far behind now the force is rendered. At least the
+      // keyframe interval plus its jitter, or the newest keyframe is held.
+      float delayMs;
+      // Extrapolate: how far ahead of now the force is predicted, to make
+      // up for the time until the device applies it.
+      float lookaheadMs;
+      // Extrapolate: longest the newest keyframe is extrapolated before
+      // the force is held.
+      float maxExtrapolationMs;
+   };
+
+   /**
+    * The force on every axis at one point in time, in DirectInput units.
+    */
+   struct FFBForceKeyframe {
+      // When the force is due, on the GetFFBClockMicroseconds clock. 0 for
+      // the time it is submitted.
+      int64_t timeUs;
+      // Whether derivative holds the slope, otherwise it is estimated from
+      // the neighbouring keyframes.
+      BOOL hasDerivative;
+      float force[6];
+      // Units per second.
+      float derivative[6];
+   };
+
+   struct FFBKeyframeStats {
+      DWORD submitted;
+      // Rejected because the queue was full or they were older than the
+      // previous keyframe.
+      DWORD dropped;
+      // Hermite: arrived after their time was already rendered, the force
+      // eases into them instead.
+      DWORD late;
+      // Hermite: ticks that ran out of keyframes and held the newest one.
+      DWORD underruns;
+      // From submitting a keyframe to the output thread sending the first
+      // force computed with it.
+      float meanLatencyMicroseconds;
+      float maxLatencyMicroseconds;
+      // How far ahead of the rendered time keyframes arrived, negative
+      // when late.
+      float meanLeadMicroseconds;
+      float minLeadMicroseconds;
+   };
+
+   /**
+    * One contribution to the force mixed on the output thread, e.g. road
+    * texture or a collision impulse. Its force is scaled by gainPercent and
+    * its envelope, and ducked by the layers of higher priority.
+    */
+   struct FFBForceLayerConfig {
+      float gainPercent;
+      // Higher priority layers duck the ones below them and keep their
+      // force when the mix runs out of room. Layers of equal priority are
+      // treated alike.
+      int priority;
+      // How much the layer lowers every layer of lower priority while at
+      // full force, 0 - 100. Scaled by the layer's current force.
+      float duckPercent;
+      // Envelope: the force rises over attackMs from silence, is held for
+      // lifetimeMs after each update (0 holds it until the layer is
+      // destroyed), then falls to nothing over decayMs.
+      float attackMs;
+      float lifetimeMs;
+      float decayMs;
+   };
+
+   struct FFBForceMixerConfig {
+      // Top of the force range, 0 - 100 percent, the mix saturates into
+      // softly instead of being clipped. Below it, layers of lower priority
+      // are turned down to make room for the ones above them.
+      float headroomPercent;
+      // How fast ducking takes hold and wears off.
+      float duckAttackMs;
+      float duckReleaseMs;
+   };
+
+   struct FFBForceLayerState {
+      char name[FFB_FORCE_LAYER_NAME];
+      int priority;
+      // 0 - 1 each.
+      float envelope;
+      float duckGain;
+      // Share of its force the layer kept when the mix ran out of room.
+      float headroomGain;
+      // What the layer added to the mix on the last tick, per axis.
+      float output[6];
+   };
+
+   struct FFBForceMixerState {
+      int layerCount;
+      // Layers whose envelope is not silent.
+      int activeLayers;
+      DWORD ticks;
+      // Ticks layers were turned down to fit under the headroom.
+      DWORD squeezedTicks;
+      // Ticks the mix went into the headroom.
+      DWORD saturatedTicks;
+      float output[6];
+   };
+
+   /**
+    * The calls GetFFBStats times: exported functions (the Device* variant
+    * and the default device function count as one) and the driver calls
+    * the plugin makes.
+    */
+   struct FFBStatCalls {
+      typedef enum {
+         StartDirectInput = 0,
+         EnumerateDevices = 1,
+         OpenDevice = 2,
+         EnumerateAxes = 3,
+         CreateEffect = 4,
+         DestroyEffect = 5,
+         UpdateConstantForce = 6,
+         UpdateCondition = 7,
+         UpdateGain = 8,
+         SubmitCommands = 9,
+         SetAutoCenter = 10,
+         StartEffects = 11,
+         StopEffects = 12,
+         DriverEnumDevices = 13,
+         DriverCreateDevice = 14,
+         DriverEnumAxes = 15,
+         DriverCreateEffect = 16,
+         DriverSetParameters = 17,
+         DriverStart = 18,
+         DriverStop = 19,
+         DriverSetProperty = 20,
+         DriverGetState = 21,
+         DriverDownload = 22,
+         UpdatePeriodic = 23,
+         UpdateCustomForce = 24,
+         UpdateEffect = 25
+      } Type;
+   };
+
+   struct FFBStatResult {
+      HRESULT result;
+      DWORD count;
+   };
+
+   struct FFBCallStats {
+      uint64_t totalNanoseconds;
+      uint64_t maxNanoseconds;
+      DWORD calls;
+      DWORD failures;
+      // Failures with an HRESULT that did not fit in results.
+      DWORD otherFailures;
+      FFBStatResult results[FFB_STAT_RESULTS];
+      DWORD histogram[FFB_STAT_BUCKETS];
+   };
+
+   struct FFBStats {
+      // FALSE when the plugin was built without statistics.
+      BOOL enabled;
+      DWORD callCount;
+      // Length of a histogram clock tick.
+      float nanosecondsPerTick;
+      DWORD reserved;
+      FFBCallStats calls[FFB_STAT_CALL_COUNT];
+   };
+
+   struct FFBInitDeviceSelection {
+      typedef enum {
+         // The first device enumerated.
+         First = 0,
+         // The device whose guidInstance is FFBInitConfig::guid.
+         Instance = 1,
+         // The first device whose guidProduct is FFBInitConfig::guid.
+         Product = 2
+      } Type;
+   };
+
+   /**
+    * What StartFFBInitAsync sets up: the backend selected with
+    * SelectFFBBackend, one device and its initial effects.
+    */
+   struct FFBInitConfig {
+      FFBInitDeviceSelection::Type deviceSelection;
+      GUID guid;
+      // -1 leaves auto center as it is, 0 disables and 1 enables it.
+      int autoCenter;
+      // Evaluate condition effects in the plugin (see EnableForceSynthesis).
+      BOOL synthesizeConditions;
+      int effectCount;
+      Effects::Type effects[MAX_FFB_INIT_EFFECTS];
+      BOOL startEffects;
+   };
+
+   struct FFBInitStages {
+      typedef enum {
+         StartBackend = 0,
+         EnumerateDevices = 1,
+         OpenDevice = 2,
+         SetAutoCenter = 3,
+         EnumerateAxes = 4,
+         AddEffects = 5
+      } Type;
+   };
+
+   struct FFBInitStates {
+      typedef enum {
+         // StartFFBInitAsync was not called.
+         Idle = 0,
+         Running = 1,
+         Succeeded = 2,
+         Failed = 3
+      } Type;
+   };
+
+   struct FFBInitStatus {
+      FFBInitStates::Type state;
+      // The stage running, or the last one that ran once finished.
+      FFBInitStages::Type stage;
+      DWORD stagesCompleted;
+      // The error that failed the stage, S_OK otherwise.
+      HRESULT result;
+      // Once Succeeded, the opened device. It is the default device.
+      FFBDeviceHandle device;
+      float stageMilliseconds[FFB_INIT_STAGE_COUNT];
+      float totalMilliseconds;
+   };
+
+   struct FFBRecorderStats {
+      BOOL recording;
+      DWORD recordsWritten;
+      // Records lost because the file could not be written fast enough.
+      DWORD recordsDropped;
+      // The first error writing the file, S_OK if none.
+      HRESULT writeResult;
+      uint64_t bytesWritten;
+   };
+
+   struct FFBCommandQueueStats {
+      // Commands accepted by EnqueueFFBCommands.
+      DWORD enqueued;
+      // Commands rejected because the queue was full.
+      DWORD dropped;
+      DWORD drained;
+      // Drained commands that failed, or whose device was closed.
+      DWORD failed;
+      // Waiting to be drained.
+      DWORD pending;
+   };
+
+   struct FFBCapabilitySources {
+      typedef enum {
+         // Not known yet.
+         None = 0,
+         // Read from the capability cache, not checked against the device
+         // yet.
+         Cache = 1,
+         // Read from the cache and confirmed by the device.
+         Validated = 2,
+         // The device differed from the cache, these are the device's.
+         Refreshed = 3,
+         // Probed on the device, it was not cached.
+         Device = 4
+      } Type;
+   };
+
+   struct FFBDeviceCapabilities {
+      // Bit 1 << Effects::Type for every effect type the device can play.
+      DWORD effectTypes;
+      // Effects the device holds at once, 0 if it does not say.
+      DWORD maxEffects;
+      DWORD axisCount;
+      // Mean time the driver took to apply an effect update, 0 until
+      // measured.
+      float updateLatencyMicroseconds;
+      FFBCapabilitySources::Type source;
+   };
+
+   /**
+    * One device of the capability cache, a record of the snapshot
+    * GetFFBCapabilityCacheSnapshot returns. The name fields are offsets
+    * into the snapshot's string pool, those of the axes too.
+    */
+   struct FFBCapabilityRecord {
+      GUID guidInstance;
+      GUID guidProduct;
+      DWORD deviceType;
+      DWORD instanceName;
+      DWORD productName;
+      DWORD effectTypes;
+      DWORD maxEffects;
+      float updateLatencyMicroseconds;
+      DWORD axisCount;
+      DWORD reserved;
+      FFBAxisRecord axes[MAX_FFB_AXES];
+   };
+
+   struct FFBCapabilityCacheStatus {
+      BOOL enabled;
+      // The file existed and was a valid cache of this version.
+      BOOL loaded;
+      // Devices in the file.
+      DWORD deviceCount;
+      // Devices opened with their axes and capabilities from the cache,
+      // and opened devices that were not in it.
+      DWORD hits;
+      DWORD misses;
+      // Opened devices the background check confirmed, and those it found
+      // different from the cache.
+      DWORD validated;
+      DWORD stale;
+      // The enumeration was answered from the cache and the background
+      // enumeration found other devices attached.
+      BOOL devicesChanged;
+      // Something changed that the next save writes.
+      BOOL dirty;
+      // Result of the last write of the file, S_OK if none.
+      HRESULT saveResult;
+      float loadMilliseconds;
+   };
+
+   struct FFBEffectPoolConfig {
+      // Effects of each type (indexed by Effects::Type) created and
+      // downloaded when a device is opened, for CreateFFBEffect and
+      // AddFFBEffect to hand out. Only ConstantForce, the periodic and the
+      // condition effects can be pooled.
+      int effectsPerType[FFB_EFFECT_TYPE_COUNT];
+   };
+
+   /**
+    * Samples for a CustomForce effect, read in place: the plugin keeps the
+    * pointer, not a copy, and the driver copies the samples when the chunk
+    * is uploaded. They must stay valid and unchanged until then, which is
+    * on return unless the force output thread is running (see
+    * UpdateFFBEffectCustomForce).
+    */
+   struct FFBCustomForce {
+      // channels * sampleCount forces from -10000 to 10000, interleaved by
+      // channel. A single channel plays along the directions, otherwise
+      // channel i drives axis i.
+      const LONG* samples;
+      DWORD channels;
+      DWORD sampleCount;
+      // Microseconds between samples.
+      DWORD samplePeriod;
+      // Microseconds, 0 or INFINITE to repeat the samples until the next
+      // chunk replaces them or the effect is stopped.
+      DWORD duration;
+   };
+
+   struct FFBCustomForceStats {
+      // Samples uploaded, over all channels.
+      uint64_t samplesUploaded;
+      // 1 while a chunk waits for the one playing to finish, its samples
+      // are still read.
+      DWORD pendingChunks;
+      DWORD chunksSubmitted;
+      DWORD chunksUploaded;
+      // Chunks that arrived after the previous chunk had played out.
+      DWORD underruns;
+      // How long uploading a chunk took.
+      float meanUploadMicroseconds;
+      float maxUploadMicroseconds;
+   };
+
+   /**
+    * What UpdateEffect and UpdateFFBEffect take, one struct for each kind
+    * of effect: ConstantForce, RampForce, the periodic effects, the
+    * condition effects and CustomForce. Directions and conditions hold an
+    * entry per device axis.
+    */
+   struct FFBConstantForceParams {
+      LONG magnitude;
+      LONG directions[MAX_FFB_AXES];
+   };
+
+   struct FFBRampForceParams {
+      // lStart and lEnd from -10000 to 10000.
+      DIRAMPFORCE ramp;
+      // Microseconds from lStart to lEnd, a ramp cannot be INFINITE. It
+      // plays once, StartFFBEffect plays it again.
+      DWORD duration;
+      LONG directions[MAX_FFB_AXES];
+   };
+
+   struct FFBPeriodicParams {
+      FFBPeriodicEffect effect;
+      LONG directions[MAX_FFB_AXES];
+   };
+
+   struct FFBConditionParams {
+      DICONDITION conditions[MAX_FFB_AXES];
+   };
+
+   struct FFBCustomForceParams {
+      FFBCustomForce customForce;
+      LONG directions[MAX_FFB_AXES];
+   };
+
+   struct FFBEffectTypeInfo {
+      // Size of the parameters UpdateEffect takes for the type.
+      DWORD paramsSize;
+      // The DIEP_* fields those parameters cover, what the flags of an
+      // update may select.
+      DWORD parameterFlags;
+   };
+
+   struct FFBEffectPoolStats {
+      // Effects waiting in the pool, by type.
+      DWORD available[FFB_EFFECT_TYPE_COUNT];
+      // Effects handed out from the pool, and effects of a pooled type
+      // created because its pool was empty.
+      DWORD hits;
+      DWORD misses;
+      // Destroyed effects that went back into the pool.
+      DWORD recycled;
+      // Effects created on the device, pooled or not, and how long
+      // creating and downloading one took.
+      DWORD created;
+      float meanCreateMicroseconds;
+      float maxCreateMicroseconds;
+      // How long the last fill of the pool took.
+      float fillMilliseconds;
+   };
+
+   struct FFBMemoryStats {
+      // Effect slots the device holds in its arena, in use and the most in
+      // use at once. A slot holds everything an effect needs, its axes,
+      // directions, parameters and published targets.
+      DWORD effectSlots;
+      DWORD effectSlotsInUse;
+      DWORD effectSlotsHighWater;
+      // Blocks the arena allocated and their size. It only grows when more
+      // effects exist at once than ever before on the device and is freed
+      // with the device.
+      DWORD arenaBlocks;
+      DWORD arenaBytes;
+   };
+
+   struct FFBInputModes {
+      typedef enum {
+         // The device buffers every change with its time (DIPROP_BUFFERSIZE)
+         // and the capture thread reads the buffer.
+         Buffered = 0,
+         // The capture thread polls the state and publishes what changed
+         // since the last poll, timed by the poll.
+         Polled = 1
+      } Type;
+   };
+
+   struct FFBInputKinds {
+      typedef enum {
+         // index 0 - 5: X, Y, Z, Rx, Ry, Rz, 6 - 7: the sliders.
+         Axis = 0,
+         // value 1 pressed, 0 released.
+         Button = 1,
+         // value in hundredths of a degree, -1 centered.
+         Pov = 2
+      } Type;
+   };
+
+   /**
+    * One change of an axis, button or POV.
+    */
+   struct FFBInputRecord {
+      // When it changed, on the GetFFBClockMicroseconds clock. The device
+      // times buffered changes to the millisecond.
+      int64_t timeUs;
+      // From timeUs until the record was published.
+      uint32_t captureDelayUs;
+      // Counts the records of the capture, gaps are records that were
+      // dropped.
+      uint32_t sequence;
+      uint16_t kind;
+      uint16_t index;
+      LONG value;
+   };
+
+   struct FFBInputCaptureConfig {
+      FFBInputModes::Type mode;
+      // Device reads per second, 10 - 4000.
+      int rateHz;
+      // Changes the device buffers between reads, Buffered only. The device
+      // drops changes beyond it.
+      DWORD bufferSize;
+   };
+
+   /**
+    * The capture's single producer / single consumer ring, read in place:
+    * records from readIndex up to writeIndex (loaded with acquire order)
+    * are published, record i is records[i & (capacity - 1)]. The reader
+    * stores the new readIndex (with release order) once it read them. Only
+    * one reader at a time. Valid until the device is closed, also across
+    * StopFFBInputCapture.
+    */
+   struct FFBInputRing {
+      const FFBInputRecord* records;
+      const volatile uint32_t* writeIndex;
+      volatile uint32_t* readIndex;
+      uint32_t capacity;
+      uint32_t recordSize;
+   };
+
+   struct FFBInputCaptureStats {
+      // The mode in use, Polled when buffering could not be enabled.
+      FFBInputModes::Type mode;
+      DWORD reads;
+      DWORD failedReads;
+      // Reads the device reported changes lost from its buffer, the rate
+      // is too low for the buffer size.
+      DWORD deviceOverflows;
+      uint64_t recordsPublished;
+      // Changes lost because the ring was full, the reader fell behind.
+      DWORD droppedRecords;
+      // From a change until its record was published.
+      float meanCaptureDelayMicroseconds;
+      float maxCaptureDelayMicroseconds;
+   };
+
+   struct FFBBridgeConfig {
+      // Longest the writer may go without a heartbeat or frame before its
+      // force is stale and the game's own force is used again.
+      float staleMs;
+      // How often a region that is missing, invalid or stale is opened
+      // again, e.g. after the writer restarted.
+      float reopenMs;
+   };
+
+   struct FFBBridgeStates {
+      typedef enum {
+         Detached = 0,
+         // The region does not exist yet or its header is not valid.
+         Waiting = 1,
+         // The writer is alive, its frames drive the device.
+         Live = 2,
+         // The writer stopped, the game's force is used until it is back.
+         Stale = 3
+      } Type;
+   };
+
+   struct FFBBridgeStats {
+      FFBBridgeStates::Type state;
+      // Distinct frames applied to the device.
+      uint64_t framesApplied;
+      // Frames the writer published between two reads, never seen.
+      uint64_t framesSkipped;
+      // Reads that caught the writer mid frame and were retried.
+      DWORD tornReads;
+      // Times the writer went stale.
+      DWORD staleCount;
+      // Times the region was opened.
+      DWORD opens;
+      // Since the writer was last seen alive.
+      float sinceHeartbeatMs;
+   };
+
+   struct FFBRateGovernorConfig {
+      // Range the output rate is kept in, 10 - 4000 Hz.
+      int floorHz;
+      int ceilingHz;
+      // Added to the rate after every window the device kept up with.
+      int increaseHz;
+      // The rate is multiplied by this, 0 - 1, after a window it did not.
+      float decreaseFactor;
+      // Share of its period a tick may spend in driver calls before the
+      // device counts as saturated.
+      float busyPercent;
+      // How long the rate is held before it is adapted again.
+      float windowMs;
+   };
+
+   struct FFBRateEvents {
+      typedef enum {
+         None = 0,
+         // The device kept up, the rate went up.
+         Increase = 1,
+         // Ticks spent more than busyPercent of their period in driver
+         // calls.
+         Busy = 2,
+         // Ticks ran past the next one's deadline.
+         Overrun = 3,
+         // Driver calls failed.
+         Errors = 4
+      } Type;
+   };
+
+   struct FFBRateGovernorStats {
+      BOOL enabled;
+      // The output rate the governor chose, updates are coalesced to the
+      // newest value over one period of it.
+      int rateHz;
+      // Driver calls made by the output thread and how many failed.
+      uint64_t updates;
+      DWORD errors;
+      DWORD increases;
+      DWORD decreases;
+      // Share of the last window spent in driver calls.
+      float busyPercent;
+      // Driver call latency since the governor was enabled, to within a
+      // quarter.
+      float p50Microseconds;
+      float p95Microseconds;
+      float p99Microseconds;
+      float maxMicroseconds;
+      // The latest change of rate, on the GetFFBClockMicroseconds clock.
+      FFBRateEvents::Type lastEvent;
+      int lastEventFromHz;
+      int lastEventToHz;
+      int64_t lastEventTimeUs;
+   };
+
+   /**
+    * EnqueueFFBCommands, for callers that can only reach the plugin through
+    * an unmanaged function pointer such as Burst compiled jobs.
+    */
+   typedef HRESULT (*FFBEnqueueCommandsFn)(FFBDeviceHandle device, const FFBCommand* commands, int commandCount);
+
+   UNITYFFB_API HRESULT SelectFFBBackend(Backends::Type backend);
+   UNITYFFB_API HRESULT ConfigureSimulatedDevice(const SimulatedDeviceConfig* config);
+   UNITYFFB_API HRESULT GetSimulatedDeviceState(int deviceIndex, SimulatedDeviceState* state);
+   UNITYFFB_API HRESULT SetSimulatedAxisPosition(int deviceIndex, int axis, LONG position);
+   UNITYFFB_API HRESULT SetSimulatedButton(int deviceIndex, int button, bool pressed);
+   UNITYFFB_API HRESULT SetSimulatedDeviceLatency(int deviceIndex, DWORD latencyMicroseconds);
+   UNITYFFB_API HRESULT SetSimulatedDeviceFirmwareRate(int deviceIndex, DWORD updateHz);
+   UNITYFFB_API HRESULT SetSimulatedDeviceAttached(int deviceIndex, bool attached);
+   UNITYFFB_API HRESULT RenderSimulatedDeviceForce(int deviceIndex, DWORD elapsedMicroseconds, LONG* force);
+   UNITYFFB_API HRESULT EnableFFBCapabilityCache(LPCSTR path);
+   UNITYFFB_API void DisableFFBCapabilityCache();
+   UNITYFFB_API HRESULT SaveFFBCapabilityCache();
+   UNITYFFB_API HRESULT GetFFBCapabilityCacheSnapshot(const FFBEnumSnapshot** snapshot);
+   UNITYFFB_API HRESULT GetFFBCapabilityCacheStatus(FFBCapabilityCacheStatus* status);
+   UNITYFFB_API HRESULT ConfigureFFBEffectPool(const FFBEffectPoolConfig* config);
    UNITYFFB_API HRESULT StartDirectInput();
+   UNITYFFB_API HRESULT StartFFBInitAsync(const FFBInitConfig* config);
+   UNITYFFB_API HRESULT GetFFBInitStatus(FFBInitStatus* status);
    UNITYFFB_API DeviceInfo* EnumerateFFBDevices(int &deviceCount);
    UNITYFFB_API HRESULT CreateFFBDevice(LPCSTR guidInstance);
    UNITYFFB_API DeviceAxisInfo* EnumerateFFBAxes(int &axisCount);
+   UNITYFFB_API HRESULT EnumerateFFBAxisSnapshot(const FFBEnumSnapshot** snapshot);
+   UNITYFFB_API HRESULT GetFFBDeviceCapabilities(FFBDeviceCapabilities* capabilities);
+   UNITYFFB_API HRESULT GetFFBEffectPoolStats(FFBEffectPoolStats* stats);
+   UNITYFFB_API HRESULT GetFFBMemoryStats(FFBMemoryStats* stats);
    UNITYFFB_API HRESULT AddFFBEffect(Effects::Type effectType);
    UNITYFFB_API HRESULT UpdateEffectGain(Effects::Type effectType, float gainPercent);
    UNITYFFB_API HRESULT UpdateConstantForce(LONG magnitude, LONG* directions);
    UNITYFFB_API HRESULT UpdateSpring(DICONDITION* conditions);
+   UNITYFFB_API HRESULT SubmitFFBCommands(const FFBCommand* commands, int commandCount, HRESULT* results);
+   UNITYFFB_API HRESULT GetFFBUpdateCounters(FFBUpdateCounters* counters);
+   UNITYFFB_API HRESULT GetFFBStats(FFBStats* stats);
+   UNITYFFB_API void ResetFFBStats();
+   UNITYFFB_API HRESULT StartFFBRecording(LPCSTR path);
+   UNITYFFB_API void StopFFBRecording();
+   UNITYFFB_API HRESULT GetFFBRecorderStats(FFBRecorderStats* stats);
+   UNITYFFB_API void ResetFFBUpdateCounters();
    UNITYFFB_API HRESULT SetAutoCenter(bool autoCenter);
    UNITYFFB_API void StartAllFFBEffects();
    UNITYFFB_API void StopAllFFBEffects();
    UNITYFFB_API void StopDirectInput();
+   UNITYFFB_API HRESULT StartForceOutputThread(int rateHz);
+   UNITYFFB_API void StopForceOutputThread();
+   UNITYFFB_API HRESULT SetForceOutputRate(int rateHz);
+   UNITYFFB_API HRESULT GetForceOutputStats(ForceOutputStats* stats);
+   UNITYFFB_API void ResetForceOutputStats();
+   UNITYFFB_API HRESULT EnableForceSynthesis(const ForceSynthConfig* config);
+   UNITYFFB_API void DisableForceSynthesis();
+   UNITYFFB_API HRESULT GetForceSynthState(ForceSynthState* state);
+   UNITYFFB_API HRESULT ConfigureForceDsp(int axis, const ForceDspConfig* config);
+   UNITYFFB_API void DisableForceDsp();
+   UNITYFFB_API HRESULT GetForceDspState(ForceDspState* state);
+   UNITYFFB_API int64_t GetFFBClockMicroseconds();
+   UNITYFFB_API HRESULT EnableForceKeyframes(const FFBKeyframeConfig* config);
+   UNITYFFB_API void DisableForceKeyframes();
+   UNITYFFB_API HRESULT SubmitForceKeyframes(const FFBForceKeyframe* keyframes, int keyframeCount);
+   UNITYFFB_API HRESULT GetForceKeyframeStats(FFBKeyframeStats* stats);
+   UNITYFFB_API HRESULT ConfigureForceMixer(const FFBForceMixerConfig* config);
+   UNITYFFB_API HRESULT CreateForceLayer(LPCSTR name, const FFBForceLayerConfig* config, FFBForceLayerHandle* layer);
+   UNITYFFB_API HRESULT FindForceLayer(LPCSTR name, FFBForceLayerHandle* layer);
+   UNITYFFB_API HRESULT ConfigureForceLayer(FFBForceLayerHandle layer, const FFBForceLayerConfig* config);
+   UNITYFFB_API HRESULT UpdateForceLayer(FFBForceLayerHandle layer, const float* force);
+   UNITYFFB_API HRESULT DestroyForceLayer(FFBForceLayerHandle layer);
+   UNITYFFB_API HRESULT GetForceLayerState(FFBForceLayerHandle layer, FFBForceLayerState* state);
+   UNITYFFB_API HRESULT GetForceMixerState(FFBForceMixerState* state);
+   UNITYFFB_API HRESULT StartFFBInputCapture(const FFBInputCaptureConfig* config);
+   UNITYFFB_API void StopFFBInputCapture();
+   UNITYFFB_API HRESULT GetFFBInputRing(FFBInputRing* ring);
+   UNITYFFB_API HRESULT GetFFBInputCaptureStats(FFBInputCaptureStats* stats);
+   UNITYFFB_API HRESULT AttachFFBBridge(LPCSTR name, const FFBBridgeConfig* config);
+   UNITYFFB_API void DetachFFBBridge();
+   UNITYFFB_API HRESULT GetFFBBridgeStats(FFBBridgeStats* stats);
+   UNITYFFB_API HRESULT EnableFFBRateGovernor(const FFBRateGovernorConfig* config);
+   UNITYFFB_API void DisableFFBRateGovernor();
+   UNITYFFB_API HRESULT GetFFBRateGovernorStats(FFBRateGovernorStats* stats);
+   UNITYFFB_API HRESULT UpdateCondition(Effects::Type effectType, DICONDITION* conditions);
+   UNITYFFB_API HRESULT UpdatePeriodic(Effects::Type effectType, const FFBPeriodicEffect* effect, LONG* directions);
+   UNITYFFB_API HRESULT UpdateCustomForce(const FFBCustomForce* customForce, LONG* directions);
+   UNITYFFB_API HRESULT UpdateEffect(Effects::Type effectType, const void* params, DWORD flags);
+   UNITYFFB_API HRESULT GetFFBEffectTypeInfo(Effects::Type effectType, FFBEffectTypeInfo* info);
+   UNITYFFB_API HRESULT RemoveFFBEffect(Effects::Type effectType);
+   UNITYFFB_API HRESULT SetFFBEffectCapacity(int capacity);
+   UNITYFFB_API HRESULT CreateFFBEffect(Effects::Type effectType, FFBEffectHandle* effect);
+   UNITYFFB_API HRESULT DestroyFFBEffect(FFBEffectHandle effect);
+   UNITYFFB_API HRESULT UpdateFFBEffectConstantForce(FFBEffectHandle effect, LONG magnitude, LONG* directions);
+   UNITYFFB_API HRESULT UpdateFFBEffectCondition(FFBEffectHandle effect, DICONDITION* conditions);
+   UNITYFFB_API HRESULT UpdateFFBEffectPeriodic(FFBEffectHandle effect, const FFBPeriodicEffect* periodic, LONG* directions);
+   UNITYFFB_API HRESULT UpdateFFBEffectCustomForce(FFBEffectHandle effect, const FFBCustomForce* customForce, LONG* directions);
+   UNITYFFB_API HRESULT UpdateFFBEffect(FFBEffectHandle effect, const void* params, DWORD flags);
+   UNITYFFB_API HRESULT GetFFBCustomForceStats(FFBEffectHandle effect, FFBCustomForceStats* stats);
+   UNITYFFB_API HRESULT SetFFBEffectGain(FFBEffectHandle effect, float gainPercent);
+   UNITYFFB_API HRESULT StartFFBEffect(FFBEffectHandle effect);
+   UNITYFFB_API HRESULT StopFFBEffect(FFBEffectHandle effect);
+
+   // Multiple device API, every call takes the handle from OpenFFBDevice.
+   UNITYFFB_API HRESULT OpenFFBDevice(LPCSTR guidInstance, FFBDeviceHandle* device);
+   UNITYFFB_API HRESULT CloseFFBDevice(FFBDeviceHandle device);
+   UNITYFFB_API HRESULT OpenFFBDeviceByGuid(const GUID* guidInstance, FFBDeviceHandle* device);
+   UNITYFFB_API HRESULT EnumerateFFBDeviceSnapshot(const FFBEnumSnapshot** snapshot);
+   UNITYFFB_API HRESULT DeviceEnumerateFFBAxisSnapshot(FFBDeviceHandle device, const FFBEnumSnapshot** snapshot);
+   UNITYFFB_API HRESULT StartFFBDeviceMonitor(DWORD intervalMs);
+   UNITYFFB_API void StopFFBDeviceMonitor();
+   UNITYFFB_API HRESULT PollFFBDeviceEvents(FFBDeviceEvent* events, int maxEvents, int* eventCount);
+   UNITYFFB_API DeviceAxisInfo* DeviceEnumerateFFBAxes(FFBDeviceHandle device, int &axisCount);
+   UNITYFFB_API HRESULT DeviceGetFFBDeviceCapabilities(FFBDeviceHandle device, FFBDeviceCapabilities* capabilities);
+   UNITYFFB_API HRESULT DeviceFillFFBEffectPool(FFBDeviceHandle device, const FFBEffectPoolConfig* config);
+   UNITYFFB_API HRESULT DeviceGetFFBEffectPoolStats(FFBDeviceHandle device, FFBEffectPoolStats* stats);
+   UNITYFFB_API HRESULT DeviceGetFFBMemoryStats(FFBDeviceHandle device, FFBMemoryStats* stats);
+   UNITYFFB_API HRESULT DeviceAddFFBEffect(FFBDeviceHandle device, Effects::Type effectType);
+   UNITYFFB_API HRESULT DeviceRemoveFFBEffect(FFBDeviceHandle device, Effects::Type effectType);
+   UNITYFFB_API HRESULT DeviceUpdateEffectGain(FFBDeviceHandle device, Effects::Type effectType, float gainPercent);
+   UNITYFFB_API HRESULT DeviceUpdateConstantForce(FFBDeviceHandle device, LONG magnitude, LONG* directions);
+   UNITYFFB_API HRESULT DeviceUpdateCondition(FFBDeviceHandle device, Effects::Type effectType, DICONDITION* conditions);
+   UNITYFFB_API HRESULT DeviceUpdatePeriodic(FFBDeviceHandle device, Effects::Type effectType, const FFBPeriodicEffect* effect, LONG* directions);
+   UNITYFFB_API HRESULT DeviceUpdateCustomForce(FFBDeviceHandle device, const FFBCustomForce* customForce, LONG* directions);
+   UNITYFFB_API HRESULT DeviceUpdateEffect(FFBDeviceHandle device, Effects::Type effectType, const void* params, DWORD flags);
+   UNITYFFB_API HRESULT DeviceSubmitFFBCommands(FFBDeviceHandle device, const FFBCommand* commands, int commandCount, HRESULT* results);
+   UNITYFFB_API HRESULT SubmitFFBDeviceCommands(const FFBDeviceHandle* devices, const FFBCommand* commands, int commandCount, HRESULT* results);
+   UNITYFFB_API HRESULT EnqueueFFBCommands(FFBDeviceHandle device, const FFBCommand* commands, int commandCount);
+   UNITYFFB_API FFBEnqueueCommandsFn GetFFBEnqueueCommandsFunction();
+   UNITYFFB_API HRESULT DrainFFBCommandQueue(int* commandCount);
+   UNITYFFB_API HRESULT GetFFBCommandQueueStats(FFBCommandQueueStats* stats);
+   UNITYFFB_API HRESULT DeviceSetAutoCenter(FFBDeviceHandle device, bool autoCenter);
+   UNITYFFB_API void DeviceStartAllFFBEffects(FFBDeviceHandle device);
+   UNITYFFB_API void DeviceStopAllFFBEffects(FFBDeviceHandle device);
+   UNITYFFB_API HRESULT DeviceStartForceOutputThread(FFBDeviceHandle device, int rateHz);
+   UNITYFFB_API void DeviceStopForceOutputThread(FFBDeviceHandle device);
+   UNITYFFB_API HRESULT DeviceSetForceOutputRate(FFBDeviceHandle device, int rateHz);
+   UNITYFFB_API HRESULT DeviceGetForceOutputStats(FFBDeviceHandle device, ForceOutputStats* stats);
+   UNITYFFB_API void DeviceResetForceOutputStats(FFBDeviceHandle device);
+   UNITYFFB_API HRESULT DeviceEnableForceSynthesis(FFBDeviceHandle device, const ForceSynthConfig* config);
+   UNITYFFB_API void DeviceDisableForceSynthesis(FFBDeviceHandle device);
+   UNITYFFB_API HRESULT DeviceGetForceSynthState(FFBDeviceHandle device, ForceSynthState* state);
+   UNITYFFB_API HRESULT DeviceConfigureForceDsp(FFBDeviceHandle device, int axis, const ForceDspConfig* config);
+   UNITYFFB_API void DeviceDisableForceDsp(FFBDeviceHandle device);
+   UNITYFFB_API HRESULT DeviceGetForceDspState(FFBDeviceHandle device, ForceDspState* state);
+   UNITYFFB_API HRESULT DeviceEnableForceKeyframes(FFBDeviceHandle device, const FFBKeyframeConfig* config);
+   UNITYFFB_API void DeviceDisableForceKeyframes(FFBDeviceHandle device);
+   UNITYFFB_API HRESULT DeviceSubmitForceKeyframes(FFBDeviceHandle device, const FFBForceKeyframe* keyframes, int keyframeCount);
+   UNITYFFB_API HRESULT DeviceGetForceKeyframeStats(FFBDeviceHandle device, FFBKeyframeStats* stats);
+   UNITYFFB_API HRESULT DeviceConfigureForceMixer(FFBDeviceHandle device, const FFBForceMixerConfig* config);
+   UNITYFFB_API HRESULT DeviceCreateForceLayer(FFBDeviceHandle device, LPCSTR name, const FFBForceLayerConfig* config, FFBForceLayerHandle* layer);
+   UNITYFFB_API HRESULT DeviceFindForceLayer(FFBDeviceHandle device, LPCSTR name, FFBForceLayerHandle* layer);
+   UNITYFFB_API HRESULT DeviceConfigureForceLayer(FFBDeviceHandle device, FFBForceLayerHandle layer, const FFBForceLayerConfig* config);
+   UNITYFFB_API HRESULT DeviceUpdateForceLayer(FFBDeviceHandle device, FFBForceLayerHandle layer, const float* force);
+   UNITYFFB_API HRESULT DeviceDestroyForceLayer(FFBDeviceHandle device, FFBForceLayerHandle layer);
+   UNITYFFB_API HRESULT DeviceGetForceLayerState(FFBDeviceHandle device, FFBForceLayerHandle layer, FFBForceLayerState* state);
+   UNITYFFB_API HRESULT DeviceGetForceMixerState(FFBDeviceHandle device, FFBForceMixerState* state);
+   UNITYFFB_API HRESULT DeviceStartFFBInputCapture(FFBDeviceHandle device, const FFBInputCaptureConfig* config);
+   UNITYFFB_API void DeviceStopFFBInputCapture(FFBDeviceHandle device);
+   UNITYFFB_API HRESULT DeviceGetFFBInputRing(FFBDeviceHandle device, FFBInputRing* ring);
+   UNITYFFB_API HRESULT DeviceGetFFBInputCaptureStats(FFBDeviceHandle device, FFBInputCaptureStats* stats);
+   UNITYFFB_API HRESULT DeviceAttachFFBBridge(FFBDeviceHandle device, LPCSTR name, const FFBBridgeConfig* config);
+   UNITYFFB_API void DeviceDetachFFBBridge(FFBDeviceHandle device);
+   UNITYFFB_API HRESULT DeviceGetFFBBridgeStats(FFBDeviceHandle device, FFBBridgeStats* stats);
+   UNITYFFB_API HRESULT DeviceEnableFFBRateGovernor(FFBDeviceHandle device, const FFBRateGovernorConfig* config);
+   UNITYFFB_API void DeviceDisableFFBRateGovernor(FFBDeviceHandle device);
+   UNITYFFB_API HRESULT DeviceGetFFBRateGovernorStats(FFBDeviceHandle device, FFBRateGovernorStats* stats);
+
+   // Effects addressed by handle, any number of each type per device.
+   UNITYFFB_API HRESULT DeviceSetFFBEffectCapacity(FFBDeviceHandle device, int capacity);
+   UNITYFFB_API HRESULT DeviceCreateFFBEffect(FFBDeviceHandle device, Effects::Type effectType, FFBEffectHandle* effect);
+   UNITYFFB_API HRESULT DeviceDestroyFFBEffect(FFBDeviceHandle device, FFBEffectHandle effect);
+   UNITYFFB_API HRESULT DeviceUpdateFFBEffectConstantForce(FFBDeviceHandle device, FFBEffectHandle effect, LONG magnitude, LONG* directions);
+   UNITYFFB_API HRESULT DeviceUpdateFFBEffectCondition(FFBDeviceHandle device, FFBEffectHandle effect, DICONDITION* conditions);
+   UNITYFFB_API HRESULT DeviceUpdateFFBEffectPeriodic(FFBDeviceHandle device, FFBEffectHandle effect, const FFBPeriodicEffect* periodic, LONG* directions);
+   UNITYFFB_API HRESULT DeviceUpdateFFBEffectCustomForce(FFBDeviceHandle device, FFBEffectHandle effect, const FFBCustomForce* customForce, LONG* directions);
+   UNITYFFB_API HRESULT DeviceUpdateFFBEffect(FFBDeviceHandle device, FFBEffectHandle effect, const void* params, DWORD flags);
+   UNITYFFB_API HRESULT DeviceGetFFBCustomForceStats(FFBDeviceHandle device, FFBEffectHandle effect, FFBCustomForceStats* stats);
+   UNITYFFB_API HRESULT DeviceSetFFBEffectGain(FFBDeviceHandle device, FFBEffectHandle effect, float gainPercent);
+   UNITYFFB_API HRESULT DeviceStartFFBEffect(FFBDeviceHandle device, FFBEffectHandle effect);
+   UNITYFFB_API HRESULT DeviceStopFFBEffect(FFBDeviceHandle device, FFBEffectHandle effect);
 }
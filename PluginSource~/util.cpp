@@ -2,18 +2,101 @@
 #include "util.h"
 
 /**
- * Helper function for converting wide strings to regular strings
+ * Appends s to out as null terminated UTF-8, converting in place so no
+ * temporary strings are allocated.
  */
-std::string utf16ToUTF8(const std::wstring &s)
+void appendUTF8(const WCHAR* s, std::vector<char>& out)
 {
-   const int size = ::WideCharToMultiByte(CP_UTF8, 0, s.c_str(), -1, NULL, 0, 0, NULL);
+#ifdef _WIN32
+   size_t start = out.size();
+   const int size = ::WideCharToMultiByte(CP_UTF8, 0, s, -1, NULL, 0, 0, NULL);
+   if (size <= 0)
+   {
+      out.push_back('\0');
+      return;
+   }
+   out.resize(start + size);
+   ::WideCharToMultiByte(CP_UTF8, 0, s, -1, &out[start], size, 0, NULL);
+#else
+   // wchar_t holds whole code points here, encode them directly.
+   for (; *s != 0; s++)
+   {
+      uint32_t c = (uint32_t)*s;
+      if (c < 0x80)
+      {
+         out.push_back((char)c);
+      }
+      else if (c < 0x800)
+      {
+         out.push_back((char)(0xC0 | (c >> 6)));
+         out.push_back((char)(0x80 | (c & 0x3F)));
+      }
+      else if (c < 0x10000)
+      {
+         out.push_back((char)(0xE0 | (c >> 12)));
+         out.push_back((char)(0x80 | ((c >> 6) & 0x3F)));
+         out.push_back((char)(0x80 | (c & 0x3F)));
+      }
+      else
+      {
+         out.push_back((char)(0xF0 | (c >> 18)));
+         out.push_back((char)(0x80 | ((c >> 12) & 0x3F)));
+         out.push_back((char)(0x80 | ((c >> 6) & 0x3F)));
+         out.push_back((char)(0x80 | (c & 0x3F)));
+      }
+   }
+   out.push_back('\0');
+#endif
+}
 
-   std::vector<char> buf(size);
-   ::WideCharToMultiByte(CP_UTF8, 0, s.c_str(), -1, &buf[0], size, 0, NULL);
+/**
+ * Formats a GUID into buf (GUID_STRING_LENGTH chars) the same way
+ * StringFromCLSID does, without the CoTaskMem allocation:
+ * {XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX}
+ */
+void formatGuid(const GUID& guid, char* buf)
+{
+   snprintf(buf, GUID_STRING_LENGTH, "{%08X-%04X-%04X-%02X%02X-%02X%02X%02X%02X%02X%02X}",
+      (unsigned int)guid.Data1, guid.Data2, guid.Data3,
+      guid.Data4[0], guid.Data4[1], guid.Data4[2], guid.Data4[3],
+      guid.Data4[4], guid.Data4[5], guid.Data4[6], guid.Data4[7]);
+}
 
-   return std::string(&buf[0]);
+std::string guidToString(const GUID& guid)
+{
+   char buf[GUID_STRING_LENGTH];
+   formatGuid(guid, buf);
+   return std::string(buf);
+}
+
+/**
+ * Parses a GUID formatted by guidToString (or StringFromCLSID).
+ * Returns false if the string is not a GUID.
+ */
+bool stringToGuid(const char* str, GUID& guid)
+{
+   if (str == NULL)
+   {
+      return false;
+   }
+   unsigned int d1, d2, d3, d4[8];
+   int n = sscanf(str, "{%8x-%4x-%4x-%2x%2x-%2x%2x%2x%2x%2x%2x}",
+      &d1, &d2, &d3, &d4[0], &d4[1], &d4[2], &d4[3], &d4[4], &d4[5], &d4[6], &d4[7]);
+   if (n != 11)
+   {
+      return false;
+   }
+   guid.Data1 = d1;
+   guid.Data2 = (unsigned short)d2;
+   guid.Data3 = (unsigned short)d3;
+   for (int i = 0; i < 8; i++)
+   {
+      guid.Data4[i] = (unsigned char)d4[i];
+   }
+   return true;
 }
 
+#ifdef _WIN32
 /**
  * Helper to find the main window handle for the given process ID.
  */
@@ -48,6 +131,7 @@ BOOL IsMainWindow(HWND handle)
 {
    return GetWindow(handle, GW_OWNER) == (HWND)0 && IsWindowVisible(handle);
 }
+#endif
 
 /**
  * Converts a DirectInput Axis GUID to a DIJOYSTATE axis
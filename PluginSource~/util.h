@@ -1,8 +1,19 @@
 #pragma once
 #include "pch.h"
 
-std::string utf16ToUTF8(const std::wstring &s);
+// Characters in a formatted GUID, including the null terminator.
+#define GUID_STRING_LENGTH    39
 
+struct GuidText {
+   char text[GUID_STRING_LENGTH];
+};
+
+void appendUTF8(const WCHAR* s, std::vector<char>& out);
+void formatGuid(const GUID& guid, char* buf);
+std::string guidToString(const GUID& guid);
+bool stringToGuid(const char* str, GUID& guid);
+
+#ifdef _WIN32
 struct handle_data {
    unsigned long process_id;
    HWND window_handle;
@@ -10,6 +21,7 @@ struct handle_data {
 HWND FindMainWindow(unsigned long process_id);
 BOOL CALLBACK _cbEnumWindows(HWND handle, LPARAM lParam);
 BOOL IsMainWindow(HWND handle);
+#endif
 
 DWORD GuidToDIJOFS(GUID axisType);
 
@@ -28,6 +28,68 @@ namespace UnityFFB
         /// Whether or not to automatically add a spring force to the device.
         /// </summary>
         public bool addSpringForce = false;
+        /// <summary>
+        /// Whether or not to send force updates from a native thread at
+        /// outputRateHz instead of synchronously from FixedUpdate.
+        /// </summary>
+        public bool useOutputThread = false;
+        public int outputRateHz = 1000;
+        /// <summary>
+        /// Whether or not to lower the output rate while the device does not
+        /// keep up with outputRateHz, and raise it again once it does. Only
+        /// takes effect together with useOutputThread.
+        /// </summary>
+        public bool adaptOutputRate = false;
+        /// <summary>
+        /// Whether or not to evaluate condition effects (spring etc.) in the
+        /// plugin from the wheel position instead of on the device. Only
+        /// takes effect together with useOutputThread.
+        /// </summary>
+        public bool synthesizeConditions = false;
+        /// <summary>
+        /// Whether or not to filter, compress and slew limit the force of
+        /// every axis with forceDsp before it is sent. Only takes effect
+        /// together with useOutputThread.
+        /// </summary>
+        public bool conditionForce = false;
+        public ForceDspConfig forceDsp;
+        /// <summary>
+        /// Whether or not to send the constant force as keyframes that the
+        /// output thread resamples to its rate, instead of holding each
+        /// FixedUpdate's force until the next. Only takes effect together
+        /// with useOutputThread.
+        /// </summary>
+        public bool smoothConstantForce = false;
+        /// <summary>
+        /// Whether or not to watch for devices being plugged in and out.
+        /// The active device is restored when it is plugged back in.
+        /// </summary>
+        public bool monitorDevices = false;
+        /// <summary>
+        /// Whether or not to start up (open the first device, disable auto
+        /// centering, add the effects) on a worker thread instead of
+        /// blocking Awake. Force feedback is enabled once it finished.
+        /// </summary>
+        public bool initializeAsync = false;
+        /// <summary>
+        /// Whether or not to keep the devices and their capabilities in a
+        /// file under Application.persistentDataPath, so the next start
+        /// skips enumerating and probing them. What was cached is checked
+        /// against the devices in the background.
+        /// </summary>
+        public bool cacheCapabilities = false;
+        /// <summary>
+        /// Constant forces and springs created up front when the device is
+        /// opened and reused once destroyed, so CreateFFBEffect during play
+        /// does not wait for the device. 0 creates them on demand.
+        /// </summary>
+        public int pooledEffectsPerType = 0;
+        public uint monitorIntervalMs = 1000;
+        /// <summary>
+        /// If set, the force feedback calls are recorded into this file,
+        /// which ffb-replay can play back to reproduce what the game sent.
+        /// </summary>
+        public string recordPath = "";
 
         // Constant force properties
         public int force = 0;
@@ -46,6 +108,14 @@ namespace UnityFFB
         public DICondition[] springConditions = new DICondition[0];
 
         protected bool nativeLibLoadFailed = false;
+        private bool keyframesEnabled = false;
+        private FFBForceKeyframe[] forceKeyframe = new FFBForceKeyframe[1];
+
+        // Bit 1 << EffectsType of every periodic effect UpdateVibration added.
+        private int vibrationTypes = 0;
+
+        private FFBDeviceEvent[] deviceEvents = new FFBDeviceEvent[16];
+        private bool initPending = false;
 
         void Awake()
         {
@@ -59,10 +129,36 @@ namespace UnityFFB
         }
 
 #if UNITY_STANDALONE_WIN
+        private void Update()
+        {
+            if (nativeLibLoadFailed) { return; }
+            if (initPending)
+            {
+                PollInitAsync();
+            }
+            if (!ffbEnabled || !monitorDevices) { return; }
+            int eventCount;
+            UnityFFBNative.PollFFBDeviceEvents(deviceEvents, deviceEvents.Length, out eventCount);
+            for (int i = 0; i < eventCount; i++)
+            {
+                FFBDeviceEvent deviceEvent = deviceEvents[i];
+                Debug.Log($"[UnityFFB] Device {deviceEvent.type}: {deviceEvent.guidInstance} (result 0x{deviceEvent.result:x8})");
+            }
+        }
+
         private void FixedUpdate()
         {
             if (nativeLibLoadFailed) { return; }
-            if (constantForceEnabled)
+            if (ffbEnabled)
+            {
+                // Commands queued from jobs since the last step.
+                UnityFFBNative.DrainFFBCommandQueue(out _);
+            }
+            if (constantForceEnabled && keyframesEnabled)
+            {
+                SubmitForceKeyframe((int)(force * sensitivity));
+            }
+            else if (constantForceEnabled)
             {
                 UnityFFBNative.UpdateConstantForce((int)(force * sensitivity), axisDirections);
             }
@@ -79,6 +175,20 @@ namespace UnityFFB
 
             try
             {
+                if (cacheCapabilities)
+                {
+                    EnableCapabilityCache();
+                }
+                if (pooledEffectsPerType > 0)
+                {
+                    ConfigureEffectPool();
+                }
+                if (initializeAsync)
+                {
+                    StartInitAsync();
+                    return;
+                }
+
                 if (UnityFFBNative.StartDirectInput() >= 0)
                 {
                     ffbEnabled = true;
@@ -88,29 +198,22 @@ namespace UnityFFB
                     ffbEnabled = false;
                 }
 
-                int deviceCount = 0;
-
-                IntPtr ptrDevices = UnityFFBNative.EnumerateFFBDevices(ref deviceCount);
-
-                Debug.Log($"[UnityFFB] Device count: {devices.Length}");
-                if (deviceCount > 0)
+                if (ffbEnabled && monitorDevices)
                 {
-                    devices = new DeviceInfo[deviceCount];
-
-                    int deviceSize = Marshal.SizeOf(typeof(DeviceInfo));
-                    for (int i = 0; i < deviceCount; i++)
-                    {
-                        IntPtr pCurrent = ptrDevices + i * deviceSize;
-                        devices[i] = Marshal.PtrToStructure<DeviceInfo>(pCurrent);
-                    }
-
-                    foreach (DeviceInfo device in devices)
-                    {
-                        string ffbAxis = UnityEngine.JsonUtility.ToJson(device, true);
-                        Debug.Log(ffbAxis);
-                    }
+                    UnityFFBNative.StartFFBDeviceMonitor(monitorIntervalMs);
+                }
+                if (ffbEnabled)
+                {
+                    StartRecording();
+                }
 
-                    if (autoSelectFirstDevice)
+                if (EnumerateDevices() && autoSelectFirstDevice)
+                {
+                    SelectDevice(devices[0].guidInstance);
+                    // The first enumeration came from the capability cache
+                    // and the cached device may be gone, the next one asks
+                    // the driver.
+                    if (activeDevice == null && cacheCapabilities && EnumerateDevices())
                     {
                         SelectDevice(devices[0].guidInstance);
                     }
@@ -136,11 +239,14 @@ namespace UnityFFB
                 LogMissingRuntimeError();
             }
             ffbEnabled = false;
+            initPending = false;
             constantForceEnabled = false;
+            keyframesEnabled = false;
             devices = new DeviceInfo[0];
             activeDevice = null;
             axes = new DeviceAxisInfo[0];
             springConditions = new DICondition[0];
+            vibrationTypes = 0;
 #endif
         }
 
@@ -165,85 +271,287 @@ namespace UnityFFB
                         }
                     }
 
-                    int axisCount = 0;
-                    IntPtr ptrAxes = UnityFFBNative.EnumerateFFBAxes(ref axisCount);
-                    if (axisCount > 0)
+                    SetupDevice(true);
+                }
+                else
+                {
+                    activeDevice = null;
+                    Debug.LogError($"[UnityFFB] 0x{hresult.ToString("x")} {WinErrors.GetSystemMessage(hresult)}");
+                }
+            }
+            catch (DllNotFoundException e)
+            {
+                LogMissingRuntimeError();
+            }
+#endif
+        }
+
+#if UNITY_STANDALONE_WIN
+        void StartInitAsync()
+        {
+            if (initPending) { return; }
+            FFBInitConfig config = new FFBInitConfig();
+            config.deviceSelection = FFBInitDeviceSelection.First;
+            config.autoCenter = disableAutoCenter ? 0 : -1;
+            config.synthesizeConditions = useOutputThread && synthesizeConditions ? 1 : 0;
+            config.effects = new EffectsType[8];
+            if (addConstantForce)
+            {
+                config.effects[config.effectCount++] = EffectsType.ConstantForce;
+            }
+            if (addSpringForce)
+            {
+                config.effects[config.effectCount++] = EffectsType.Spring;
+            }
+
+            int hresult = UnityFFBNative.StartFFBInitAsync(ref config);
+            if (hresult != 0)
+            {
+                Debug.LogError($"[UnityFFB] StartFFBInitAsync Failed: 0x{hresult.ToString("x")} {WinErrors.GetSystemMessage(hresult)}");
+                return;
+            }
+            initPending = true;
+        }
+
+        void PollInitAsync()
+        {
+            FFBInitStatus status;
+            UnityFFBNative.GetFFBInitStatus(out status);
+            if (status.state == FFBInitState.Running) { return; }
+
+            initPending = false;
+            Debug.Log($"[UnityFFB] Init {status.state} after {status.totalMilliseconds:F1} ms, stage times (ms): {string.Join(", ", status.stageMilliseconds)}");
+            if (status.state != FFBInitState.Succeeded)
+            {
+                Debug.LogError($"[UnityFFB] Init failed at {status.stage}: 0x{status.result.ToString("x")} {WinErrors.GetSystemMessage(status.result)}");
+                return;
+            }
+            ffbEnabled = true;
+            if (monitorDevices)
+            {
+                UnityFFBNative.StartFFBDeviceMonitor(monitorIntervalMs);
+            }
+            StartRecording();
+            SetupDevice(false);
+        }
+
+        bool EnumerateDevices()
+        {
+            int deviceCount = 0;
+
+            IntPtr ptrDevices = UnityFFBNative.EnumerateFFBDevices(ref deviceCount);
+
+            Debug.Log($"[UnityFFB] Device count: {devices.Length}");
+            if (deviceCount <= 0)
+            {
+                return false;
+            }
+            devices = new DeviceInfo[deviceCount];
+
+            int deviceSize = Marshal.SizeOf(typeof(DeviceInfo));
+            for (int i = 0; i < deviceCount; i++)
+            {
+                IntPtr pCurrent = ptrDevices + i * deviceSize;
+                devices[i] = Marshal.PtrToStructure<DeviceInfo>(pCurrent);
+            }
+
+            foreach (DeviceInfo device in devices)
+            {
+                string ffbAxis = UnityEngine.JsonUtility.ToJson(device, true);
+                Debug.Log(ffbAxis);
+            }
+            return true;
+        }
+
+        void EnableCapabilityCache()
+        {
+            string path = System.IO.Path.Combine(Application.persistentDataPath, "unity-ffb-capabilities.bin");
+            int hresult = UnityFFBNative.EnableFFBCapabilityCache(path);
+            if (hresult < 0)
+            {
+                Debug.LogError($"[UnityFFB] EnableFFBCapabilityCache Failed: 0x{hresult.ToString("x")} {WinErrors.GetSystemMessage(hresult)}");
+            }
+        }
+
+        void ConfigureEffectPool()
+        {
+            FFBEffectPoolConfig pool = FFBEffectPoolConfig.Create();
+            pool.effectsPerType[(int)EffectsType.ConstantForce] = pooledEffectsPerType;
+            pool.effectsPerType[(int)EffectsType.Spring] = pooledEffectsPerType;
+            int hresult = UnityFFBNative.ConfigureFFBEffectPool(ref pool);
+            if (hresult < 0)
+            {
+                Debug.LogError($"[UnityFFB] ConfigureFFBEffectPool Failed: 0x{hresult.ToString("x")} {WinErrors.GetSystemMessage(hresult)}");
+            }
+        }
+
+        void StartRecording()
+        {
+            if (string.IsNullOrEmpty(recordPath)) { return; }
+            int hresult = UnityFFBNative.StartFFBRecording(recordPath);
+            if (hresult != 0)
+            {
+                Debug.LogError($"[UnityFFB] StartFFBRecording Failed: 0x{hresult.ToString("x")} {WinErrors.GetSystemMessage(hresult)}");
+            }
+        }
+
+        /// <summary>
+        /// Read the axes of the opened device and set up its effects. Adds
+        /// the effects unless the async init already did.
+        /// </summary>
+        void SetupDevice(bool addEffects)
+        {
+            int hresult;
+            int axisCount = 0;
+            IntPtr ptrAxes = UnityFFBNative.EnumerateFFBAxes(ref axisCount);
+            if (axisCount > 0)
+            {
+                axes = new DeviceAxisInfo[axisCount];
+                axisDirections = new int[axisCount];
+                springConditions = new DICondition[axisCount];
+
+                int axisSize = Marshal.SizeOf(typeof(DeviceAxisInfo));
+                for (int i = 0; i < axisCount; i++)
+                {
+                    IntPtr pCurrent = ptrAxes + i * axisSize;
+                    axes[i] = Marshal.PtrToStructure<DeviceAxisInfo>(pCurrent);
+                    axisDirections[i] = 0;
+                    springConditions[i] = new DICondition();
+                }
+
+                if (addEffects)
+                {
+                    vibrationTypes = 0;
+                }
+
+                if (addEffects && useOutputThread && synthesizeConditions)
+                {
+                    hresult = UnityFFBNative.EnableForceSynthesis(IntPtr.Zero);
+                    if (hresult != 0)
+                    {
+                        Debug.LogError($"[UnityFFB] EnableForceSynthesis Failed: 0x{hresult.ToString("x")} {WinErrors.GetSystemMessage(hresult)}");
+                    }
+                }
+
+                if (useOutputThread && conditionForce)
+                {
+                    hresult = UnityFFBNative.ConfigureForceDsp(-1, ref forceDsp);
+                    if (hresult != 0)
                     {
-                        axes = new DeviceAxisInfo[axisCount];
-                        axisDirections = new int[axisCount];
-                        springConditions = new DICondition[axisCount];
+                        Debug.LogError($"[UnityFFB] ConfigureForceDsp Failed: 0x{hresult.ToString("x")} {WinErrors.GetSystemMessage(hresult)}");
+                    }
+                }
 
-                        int axisSize = Marshal.SizeOf(typeof(DeviceAxisInfo));
-                        for (int i = 0; i < axisCount; i++)
+                if (addConstantForce)
+                {
+                    hresult = addEffects ? UnityFFBNative.AddFFBEffect(EffectsType.ConstantForce) : 0;
+                    if (hresult == 0)
+                    {
+                        hresult = UnityFFBNative.UpdateConstantForce(0, axisDirections);
+                        if (hresult != 0)
                         {
-                            IntPtr pCurrent = ptrAxes + i * axisSize;
-                            axes[i] = Marshal.PtrToStructure<DeviceAxisInfo>(pCurrent);
-                            axisDirections[i] = 0;
-                            springConditions[i] = new DICondition();
+                            Debug.LogError($"[UnityFFB] UpdateConstantForce Failed: 0x{hresult.ToString("x")} {WinErrors.GetSystemMessage(hresult)}");
                         }
+                        constantForceEnabled = true;
+                    }
+                    else
+                    {
+                        Debug.LogError($"[UnityFFB] AddConstantForce Failed: 0x{hresult.ToString("x")} {WinErrors.GetSystemMessage(hresult)}");
+                    }
+                }
 
-                        if (addConstantForce)
+                if (addSpringForce)
+                {
+                    hresult = addEffects ? UnityFFBNative.AddFFBEffect(EffectsType.Spring) : 0;
+                    if (hresult == 0)
+                    {
+                        for (int i = 0; i < springConditions.Length; i++)
                         {
-                            hresult = UnityFFBNative.AddFFBEffect(EffectsType.ConstantForce);
-                            if (hresult == 0)
-                            {
-                                hresult = UnityFFBNative.UpdateConstantForce(0, axisDirections);
-                                if (hresult != 0)
-                                {
-                                    Debug.LogError($"[UnityFFB] UpdateConstantForce Failed: 0x{hresult.ToString("x")} {WinErrors.GetSystemMessage(hresult)}");
-                                }
-                                constantForceEnabled = true;
-                            }
-                            else
-                            {
-                                Debug.LogError($"[UnityFFB] AddConstantForce Failed: 0x{hresult.ToString("x")} {WinErrors.GetSystemMessage(hresult)}");
-                            }
+                            springConditions[i].deadband = 0;
+                            springConditions[i].offset = 0;
+                            springConditions[i].negativeCoefficient = 2000;
+                            springConditions[i].positiveCoefficient = 2000;
+                            springConditions[i].negativeSaturation = 10000;
+                            springConditions[i].positiveSaturation = 10000;
                         }
-
-                        if (addSpringForce)
+                        hresult = UnityFFBNative.UpdateSpring(springConditions);
+                        if (hresult != 0)
                         {
-                            hresult = UnityFFBNative.AddFFBEffect(EffectsType.Spring);
-                            if (hresult == 0)
-                            {
-                                for (int i = 0; i < springConditions.Length; i++)
-                                {
-                                    springConditions[i].deadband = 0;
-                                    springConditions[i].offset = 0;
-                                    springConditions[i].negativeCoefficient = 2000;
-                                    springConditions[i].positiveCoefficient = 2000;
-                                    springConditions[i].negativeSaturation = 10000;
-                                    springConditions[i].positiveSaturation = 10000;
-                                }
-                                hresult = UnityFFBNative.UpdateSpring(springConditions);
-                                if (hresult != 0)
-                                {
-                                    Debug.LogError($"[UnityFFB] UpdateSpringForce Failed: 0x{hresult.ToString("x")} {WinErrors.GetSystemMessage(hresult)}");
-                                }
-                            }
-                            else
-                            {
-                                Debug.LogError($"[UnityFFB] AddSpringForce Failed: 0x{hresult.ToString("x")} {WinErrors.GetSystemMessage(hresult)}");
-                            }
+                            Debug.LogError($"[UnityFFB] UpdateSpringForce Failed: 0x{hresult.ToString("x")} {WinErrors.GetSystemMessage(hresult)}");
                         }
                     }
-                    Debug.Log($"[UnityFFB] Axis count: {axes.Length}");
-                    foreach (DeviceAxisInfo axis in axes)
+                    else
                     {
-                        string ffbAxis = UnityEngine.JsonUtility.ToJson(axis, true);
-                        Debug.Log(ffbAxis);
+                        Debug.LogError($"[UnityFFB] AddSpringForce Failed: 0x{hresult.ToString("x")} {WinErrors.GetSystemMessage(hresult)}");
                     }
                 }
-                else
+            }
+            if (useOutputThread)
+            {
+                hresult = UnityFFBNative.StartForceOutputThread(outputRateHz);
+                if (hresult != 0)
                 {
-                    activeDevice = null;
-                    Debug.LogError($"[UnityFFB] 0x{hresult.ToString("x")} {WinErrors.GetSystemMessage(hresult)}");
+                    Debug.LogError($"[UnityFFB] StartForceOutputThread Failed: 0x{hresult.ToString("x")} {WinErrors.GetSystemMessage(hresult)}");
                 }
             }
-            catch (DllNotFoundException e)
+            if (useOutputThread && adaptOutputRate)
             {
-                LogMissingRuntimeError();
+                FFBRateGovernorConfig governor = new FFBRateGovernorConfig();
+                governor.floorHz = Math.Min(100, outputRateHz);
+                governor.ceilingHz = outputRateHz;
+                governor.increaseHz = 50;
+                governor.decreaseFactor = 0.75f;
+                governor.busyPercent = 50;
+                governor.windowMs = 100;
+                hresult = UnityFFBNative.EnableFFBRateGovernor(ref governor);
+                if (hresult != 0)
+                {
+                    Debug.LogError($"[UnityFFB] EnableFFBRateGovernor Failed: 0x{hresult.ToString("x")} {WinErrors.GetSystemMessage(hresult)}");
+                }
+            }
+            if (useOutputThread && smoothConstantForce)
+            {
+                forceKeyframe[0].force = new float[6];
+                forceKeyframe[0].derivative = new float[6];
+                hresult = UnityFFBNative.EnableForceKeyframes(IntPtr.Zero);
+                keyframesEnabled = hresult == 0;
+                if (hresult != 0)
+                {
+                    Debug.LogError($"[UnityFFB] EnableForceKeyframes Failed: 0x{hresult.ToString("x")} {WinErrors.GetSystemMessage(hresult)}");
+                }
+            }
+            Debug.Log($"[UnityFFB] Axis count: {axes.Length}");
+            foreach (DeviceAxisInfo axis in axes)
+            {
+                string ffbAxis = UnityEngine.JsonUtility.ToJson(axis, true);
+                Debug.Log(ffbAxis);
             }
+        }
 #endif
+
+        /// <summary>
+        /// Submit the force for now, split over the axes the same way the
+        /// device resolves axisDirections.
+        /// </summary>
+        void SubmitForceKeyframe(int magnitude)
+        {
+            FFBForceKeyframe keyframe = forceKeyframe[0];
+            double length = 0;
+            for (int i = 0; i < axisDirections.Length; i++)
+            {
+                length += (double)axisDirections[i] * axisDirections[i];
+            }
+            length = Math.Sqrt(length);
+            for (int i = 0; i < axisDirections.Length && i < keyframe.force.Length; i++)
+            {
+                double component = i == 0 ? 1.0 : 0.0;
+                if (length > 0)
+                {
+                    component = axisDirections[i] / length;
+                }
+                keyframe.force[i] = (float)(magnitude * component);
+            }
+            UnityFFBNative.SubmitForceKeyframes(forceKeyframe, 1);
         }
 
         public void SetConstantForceGain(float gainPercent)
@@ -261,6 +569,36 @@ namespace UnityFFB
 #endif
         }
 
+        /// <summary>
+        /// Play a periodic effect (Square, Sine, Triangle, SawtoothUp or
+        /// SawtoothDown) along axisDirections, e.g. engine vibration or a
+        /// rumble strip. The device generates the waveform and envelope
+        /// itself, call this again only when the vibration changes. The
+        /// effect of each waveform is added on first use.
+        /// </summary>
+        public void UpdateVibration(EffectsType waveform, FFBPeriodicEffect vibration)
+        {
+#if UNITY_STANDALONE_WIN
+            if (nativeLibLoadFailed || !ffbEnabled) { return; }
+            int hresult = 0;
+            if ((vibrationTypes & (1 << (int)waveform)) == 0)
+            {
+                hresult = UnityFFBNative.AddFFBEffect(waveform);
+                if (hresult != 0)
+                {
+                    Debug.LogError($"[UnityFFB] AddFFBEffect Failed: 0x{hresult.ToString("x")} {WinErrors.GetSystemMessage(hresult)}");
+                    return;
+                }
+                vibrationTypes |= 1 << (int)waveform;
+            }
+            hresult = UnityFFBNative.UpdatePeriodic(waveform, ref vibration, axisDirections);
+            if (hresult != 0)
+            {
+                Debug.LogError($"[UnityFFB] UpdatePeriodic Failed: 0x{hresult.ToString("x")} {WinErrors.GetSystemMessage(hresult)}");
+            }
+#endif
+        }
+
         public void StartFFBEffects()
         {
 #if UNITY_STANDALONE_WIN
@@ -7,9 +7,73 @@ namespace UnityFFB
     {
 #if UNITY_STANDALONE_WIN
 
+        [DllImport("UNITYFFB")]
+        public static extern int SelectFFBBackend(BackendType backend);
+
+        [DllImport("UNITYFFB")]
+        public static extern int ConfigureSimulatedDevice(ref SimulatedDeviceConfig config);
+
+        [DllImport("UNITYFFB")]
+        public static extern int GetSimulatedDeviceState(int deviceIndex, out SimulatedDeviceState state);
+
+        [DllImport("UNITYFFB")]
+        public static extern int SetSimulatedAxisPosition(int deviceIndex, int axis, int position);
+
+        [DllImport("UNITYFFB")]
+        public static extern int SetSimulatedButton(int deviceIndex, int button, bool pressed);
+
+        /// <summary>
+        /// Keep the devices and their capabilities in a file so the next
+        /// start skips enumerating and probing them. Call before
+        /// StartDirectInput or StartFFBInitAsync.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern int EnableFFBCapabilityCache(string path);
+
+        [DllImport("UNITYFFB")]
+        public static extern void DisableFFBCapabilityCache();
+
+        [DllImport("UNITYFFB")]
+        public static extern int SaveFFBCapabilityCache();
+
+        /// <summary>
+        /// The cached devices as a snapshot of FFBCapabilityRecord's, read it
+        /// with FFBSnapshot. Valid until the cache is saved.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern int GetFFBCapabilityCacheSnapshot(out IntPtr snapshot);
+
+        [DllImport("UNITYFFB")]
+        public static extern int GetFFBCapabilityCacheStatus(out FFBCapabilityCacheStatus status);
+
+        /// <summary>
+        /// Create effects up front on every device opened from now on and
+        /// reuse destroyed ones, so creating an effect during play does not
+        /// wait for the device. Call before StartDirectInput or
+        /// StartFFBInitAsync.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern int ConfigureFFBEffectPool(ref FFBEffectPoolConfig config);
+
+        /// <summary>
+        /// Pass IntPtr.Zero to stop pooling on devices opened later.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern int ConfigureFFBEffectPool(IntPtr config);
+
         [DllImport("UNITYFFB")]
         public static extern int StartDirectInput();
 
+        /// <summary>
+        /// Start the backend, open a device and add its effects on a worker
+        /// thread. Follow the progress with GetFFBInitStatus.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern int StartFFBInitAsync(ref FFBInitConfig config);
+
+        [DllImport("UNITYFFB")]
+        public static extern int GetFFBInitStatus(out FFBInitStatus status);
+
         [DllImport("UNITYFFB")]
         public static extern IntPtr EnumerateFFBDevices(ref int deviceCount);
 
@@ -28,9 +92,105 @@ namespace UnityFFB
         [DllImport("UNITYFFB")]
         public static extern int UpdateSpring(DICondition[] conditions);
 
+        [DllImport("UNITYFFB")]
+        public static extern int UpdateCondition(EffectsType effectType, DICondition[] conditions);
+
+        /// <summary>
+        /// Update a periodic effect, the device plays the waveform on its own.
+        /// directions holds one entry per axis.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern int UpdatePeriodic(EffectsType effectType, ref FFBPeriodicEffect effect, int[] directions);
+
+        /// <summary>
+        /// Play a chunk of samples on the CustomForce effect, read in place
+        /// from customForce.samples. With the force output thread running
+        /// the chunk waits for the one playing and the samples must stay
+        /// untouched until it was uploaded, E_PENDING while another chunk
+        /// waits.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern int UpdateCustomForce(ref FFBCustomForce customForce, int[] directions);
+
         [DllImport("UNITYFFB")]
         public static extern int UpdateEffectGain(EffectsType effectType, float gainPercent);
 
+        /// <summary>
+        /// Update any type of effect with the parameters struct of its kind.
+        /// flags selects the DIEP_* fields to send, 0 for all the type has.
+        /// </summary>
+        [DllImport("UNITYFFB", EntryPoint = "UpdateEffect")]
+        public static extern int UpdateEffect(EffectsType effectType, ref FFBConstantForceParams parameters, uint flags);
+
+        [DllImport("UNITYFFB", EntryPoint = "UpdateEffect")]
+        public static extern int UpdateEffect(EffectsType effectType, ref FFBRampForceParams parameters, uint flags);
+
+        [DllImport("UNITYFFB", EntryPoint = "UpdateEffect")]
+        public static extern int UpdateEffect(EffectsType effectType, ref FFBPeriodicParams parameters, uint flags);
+
+        [DllImport("UNITYFFB", EntryPoint = "UpdateEffect")]
+        public static extern int UpdateEffect(EffectsType effectType, ref FFBConditionParams parameters, uint flags);
+
+        [DllImport("UNITYFFB", EntryPoint = "UpdateEffect")]
+        public static extern int UpdateEffect(EffectsType effectType, ref FFBCustomForceParams parameters, uint flags);
+
+        [DllImport("UNITYFFB")]
+        public static extern int GetFFBEffectTypeInfo(EffectsType effectType, out FFBEffectTypeInfo info);
+
+        /// <summary>
+        /// Apply a batch of effect commands in one call. results receives the
+        /// status of each command and must be at least commandCount long.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern int SubmitFFBCommands(FFBCommand[] commands, int commandCount, int[] results);
+
+        [DllImport("UNITYFFB", EntryPoint = "SubmitFFBCommands")]
+        private static extern unsafe int SubmitFFBCommands(FFBCommand* commands, int commandCount, int* results);
+
+#if UNITY_2021_2_OR_NEWER
+        public static unsafe int SubmitFFBCommands(ReadOnlySpan<FFBCommand> commands, Span<int> results)
+        {
+            if (results.Length < commands.Length)
+            {
+                throw new ArgumentException("results must hold one entry per command", nameof(results));
+            }
+            fixed (FFBCommand* pCommands = commands)
+            fixed (int* pResults = results)
+            {
+                return SubmitFFBCommands(pCommands, commands.Length, pResults);
+            }
+        }
+#endif
+
+        [DllImport("UNITYFFB")]
+        public static extern int GetFFBUpdateCounters(out FFBUpdateCounters counters);
+
+        [DllImport("UNITYFFB")]
+        public static extern void ResetFFBUpdateCounters();
+
+        /// <summary>
+        /// Latency histograms and failure counts of the exported functions
+        /// and driver calls, see FFBStatCall.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern int GetFFBStats(out FFBStats stats);
+
+        [DllImport("UNITYFFB")]
+        public static extern void ResetFFBStats();
+
+        /// <summary>
+        /// Record the force feedback calls into a file that ffb-replay can
+        /// play back. The file is written by a background thread.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern int StartFFBRecording(string path);
+
+        [DllImport("UNITYFFB")]
+        public static extern void StopFFBRecording();
+
+        [DllImport("UNITYFFB")]
+        public static extern int GetFFBRecorderStats(out FFBRecorderStats stats);
+
         [DllImport("UNITYFFB")]
         public static extern int SetAutoCenter(bool autoCenter);
 
@@ -42,6 +202,549 @@ namespace UnityFFB
 
         [DllImport("UNITYFFB")]
         public static extern void StopDirectInput();
+
+        [DllImport("UNITYFFB")]
+        public static extern int StartForceOutputThread(int rateHz);
+
+        [DllImport("UNITYFFB")]
+        public static extern void StopForceOutputThread();
+
+        [DllImport("UNITYFFB")]
+        public static extern int SetForceOutputRate(int rateHz);
+
+        [DllImport("UNITYFFB")]
+        public static extern int GetForceOutputStats(out ForceOutputStats stats);
+
+        [DllImport("UNITYFFB")]
+        public static extern void ResetForceOutputStats();
+
+        [DllImport("UNITYFFB")]
+        public static extern int EnableForceSynthesis(ref ForceSynthConfig config);
+
+        /// <summary>
+        /// Pass IntPtr.Zero to enable synthesis with the default tuning.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern int EnableForceSynthesis(IntPtr config);
+
+        [DllImport("UNITYFFB")]
+        public static extern void DisableForceSynthesis();
+
+        [DllImport("UNITYFFB")]
+        public static extern int GetForceSynthState(out ForceSynthState state);
+
+        /// <summary>
+        /// Condition the force of one axis, or every axis when axis is -1,
+        /// on the force output thread.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern int ConfigureForceDsp(int axis, ref ForceDspConfig config);
+
+        /// <summary>
+        /// Pass IntPtr.Zero to bypass the axis, its force is only clipped.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern int ConfigureForceDsp(int axis, IntPtr config);
+
+        [DllImport("UNITYFFB")]
+        public static extern void DisableForceDsp();
+
+        [DllImport("UNITYFFB")]
+        public static extern int GetForceDspState(out ForceDspState state);
+
+        /// <summary>
+        /// The clock FFBForceKeyframe times are on, in microseconds.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern long GetFFBClockMicroseconds();
+
+        [DllImport("UNITYFFB")]
+        public static extern int EnableForceKeyframes(ref FFBKeyframeConfig config);
+
+        /// <summary>
+        /// Pass IntPtr.Zero for the default Hermite mode.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern int EnableForceKeyframes(IntPtr config);
+
+        [DllImport("UNITYFFB")]
+        public static extern void DisableForceKeyframes();
+
+        /// <summary>
+        /// Queue keyframes for the force output thread, in time order.
+        /// Returns 1 (S_FALSE) if some were dropped.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern int SubmitForceKeyframes([In] FFBForceKeyframe[] keyframes, int keyframeCount);
+
+        [DllImport("UNITYFFB")]
+        public static extern int GetForceKeyframeStats(out FFBKeyframeStats stats);
+
+        [DllImport("UNITYFFB")]
+        public static extern int ConfigureForceMixer(ref FFBForceMixerConfig config);
+
+        /// <summary>
+        /// Pass IntPtr.Zero for the defaults.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern int ConfigureForceMixer(IntPtr config);
+
+        /// <summary>
+        /// Add a layer to the force mix, silent until its first update. Needs
+        /// the force output thread. Names are unique, under 32 characters.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern int CreateForceLayer(string name, ref FFBForceLayerConfig config, out uint layer);
+
+        [DllImport("UNITYFFB")]
+        public static extern int FindForceLayer(string name, out uint layer);
+
+        [DllImport("UNITYFFB")]
+        public static extern int ConfigureForceLayer(uint layer, ref FFBForceLayerConfig config);
+
+        /// <summary>
+        /// The layer's force on every axis, force holds one value per axis.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern int UpdateForceLayer(uint layer, [In] float[] force);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DestroyForceLayer(uint layer);
+
+        [DllImport("UNITYFFB")]
+        public static extern int GetForceLayerState(uint layer, out FFBForceLayerState state);
+
+        [DllImport("UNITYFFB")]
+        public static extern int GetForceMixerState(out FFBForceMixerState state);
+
+        /// <summary>
+        /// Capture the device's input on a native thread into a ring read
+        /// in place with FFBInputReader. 1 (S_FALSE) if the device cannot
+        /// buffer its input and is polled instead.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern int StartFFBInputCapture(ref FFBInputCaptureConfig config);
+
+        [DllImport("UNITYFFB")]
+        public static extern void StopFFBInputCapture();
+
+        [DllImport("UNITYFFB")]
+        public static extern int GetFFBInputRing(out FFBInputRing ring);
+
+        [DllImport("UNITYFFB")]
+        public static extern int GetFFBInputCaptureStats(out FFBInputCaptureStats stats);
+
+        /// <summary>
+        /// Take the force from another process through the shared memory
+        /// region name, read by the force output thread, which must be
+        /// running. The game's force is used while the writer is stale.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern int AttachFFBBridge(string name, ref FFBBridgeConfig config);
+
+        [DllImport("UNITYFFB")]
+        public static extern void DetachFFBBridge();
+
+        [DllImport("UNITYFFB")]
+        public static extern int GetFFBBridgeStats(out FFBBridgeStats stats);
+
+        /// <summary>
+        /// Adapt the output thread's rate to how fast the device takes
+        /// updates, between floorHz and ceilingHz.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern int EnableFFBRateGovernor(ref FFBRateGovernorConfig config);
+
+        [DllImport("UNITYFFB")]
+        public static extern void DisableFFBRateGovernor();
+
+        [DllImport("UNITYFFB")]
+        public static extern int GetFFBRateGovernorStats(out FFBRateGovernorStats stats);
+
+        [DllImport("UNITYFFB")]
+        public static extern int SetSimulatedDeviceLatency(int deviceIndex, uint latencyMicroseconds);
+
+        [DllImport("UNITYFFB")]
+        public static extern int SetSimulatedDeviceFirmwareRate(int deviceIndex, uint updateHz);
+
+        /// <summary>
+        /// Unplug or replug a simulated wheel, to script hot plugging.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern int SetSimulatedDeviceAttached(int deviceIndex, bool attached);
+
+        /// <summary>
+        /// The force a simulated wheel produces elapsedMicroseconds after its
+        /// effects were started, one value per axis.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern int RenderSimulatedDeviceForce(int deviceIndex, uint elapsedMicroseconds, int[] force);
+
+        [DllImport("UNITYFFB")]
+        public static extern int RemoveFFBEffect(EffectsType effectType);
+
+        /// <summary>
+        /// Open a device and get a handle for the Device* functions. Any
+        /// number of devices can be open at once, each with its own effects
+        /// and force output thread.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern int OpenFFBDevice(string guidInstance, out int device);
+
+        [DllImport("UNITYFFB")]
+        public static extern int CloseFFBDevice(int device);
+
+        [DllImport("UNITYFFB")]
+        public static extern int OpenFFBDeviceByGuid(ref Guid guidInstance, out int device);
+
+        /// <summary>
+        /// Enumerate devices into a snapshot of FFBDeviceRecord's, read it
+        /// with FFBSnapshot. Valid until the next enumeration.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern int EnumerateFFBDeviceSnapshot(out IntPtr snapshot);
+
+        [DllImport("UNITYFFB")]
+        public static extern int EnumerateFFBAxisSnapshot(out IntPtr snapshot);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceEnumerateFFBAxisSnapshot(int device, out IntPtr snapshot);
+
+        [DllImport("UNITYFFB")]
+        public static extern int GetFFBDeviceCapabilities(out FFBDeviceCapabilities capabilities);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceGetFFBDeviceCapabilities(int device, out FFBDeviceCapabilities capabilities);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceFillFFBEffectPool(int device, ref FFBEffectPoolConfig config);
+
+        [DllImport("UNITYFFB")]
+        public static extern int GetFFBEffectPoolStats(out FFBEffectPoolStats stats);
+
+        [DllImport("UNITYFFB")]
+        public static extern int GetFFBMemoryStats(out FFBMemoryStats stats);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceGetFFBEffectPoolStats(int device, out FFBEffectPoolStats stats);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceGetFFBMemoryStats(int device, out FFBMemoryStats stats);
+
+        /// <summary>
+        /// Watch for devices being attached and removed on a background
+        /// thread. Collect the changes with PollFFBDeviceEvents, open
+        /// devices that are unplugged and attached again are restored
+        /// with their effects.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern int StartFFBDeviceMonitor(uint intervalMs);
+
+        [DllImport("UNITYFFB")]
+        public static extern void StopFFBDeviceMonitor();
+
+        [DllImport("UNITYFFB")]
+        public static extern int PollFFBDeviceEvents([Out] FFBDeviceEvent[] events, int maxEvents, out int eventCount);
+
+        [DllImport("UNITYFFB")]
+        public static extern IntPtr DeviceEnumerateFFBAxes(int device, ref int axisCount);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceAddFFBEffect(int device, EffectsType effectType);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceRemoveFFBEffect(int device, EffectsType effectType);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceUpdateEffectGain(int device, EffectsType effectType, float gainPercent);
+
+        [DllImport("UNITYFFB", EntryPoint = "DeviceUpdateEffect")]
+        public static extern int DeviceUpdateEffect(int device, EffectsType effectType, ref FFBConstantForceParams parameters, uint flags);
+
+        [DllImport("UNITYFFB", EntryPoint = "DeviceUpdateEffect")]
+        public static extern int DeviceUpdateEffect(int device, EffectsType effectType, ref FFBRampForceParams parameters, uint flags);
+
+        [DllImport("UNITYFFB", EntryPoint = "DeviceUpdateEffect")]
+        public static extern int DeviceUpdateEffect(int device, EffectsType effectType, ref FFBPeriodicParams parameters, uint flags);
+
+        [DllImport("UNITYFFB", EntryPoint = "DeviceUpdateEffect")]
+        public static extern int DeviceUpdateEffect(int device, EffectsType effectType, ref FFBConditionParams parameters, uint flags);
+
+        [DllImport("UNITYFFB", EntryPoint = "DeviceUpdateEffect")]
+        public static extern int DeviceUpdateEffect(int device, EffectsType effectType, ref FFBCustomForceParams parameters, uint flags);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceUpdateConstantForce(int device, int magnitude, int[] directions);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceUpdateCondition(int device, EffectsType effectType, DICondition[] conditions);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceUpdatePeriodic(int device, EffectsType effectType, ref FFBPeriodicEffect effect, int[] directions);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceUpdateCustomForce(int device, ref FFBCustomForce customForce, int[] directions);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceSubmitFFBCommands(int device, FFBCommand[] commands, int commandCount, int[] results);
+
+        /// <summary>
+        /// Update several devices in one call, devices holds the handle each
+        /// command is for. Consecutive commands for the same device are
+        /// applied as one batch.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern int SubmitFFBDeviceCommands(int[] devices, FFBCommand[] commands, int commandCount, int[] results);
+
+        /// <summary>
+        /// Queue commands for a device without blocking, from any thread,
+        /// jobs included. They are applied by the next DrainFFBCommandQueue,
+        /// in the order each thread queued them. Returns S_FALSE (1) if the
+        /// queue was full and some were dropped.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern int EnqueueFFBCommands(int device, FFBCommand[] commands, int commandCount);
+
+        [DllImport("UNITYFFB", EntryPoint = "EnqueueFFBCommands")]
+        public static extern unsafe int EnqueueFFBCommands(int device, FFBCommand* commands, int commandCount);
+
+        /// <summary>
+        /// EnqueueFFBCommands as an unmanaged function pointer, see
+        /// EnqueueFFBCommandsDelegate.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern IntPtr GetFFBEnqueueCommandsFunction();
+
+        /// <summary>
+        /// Apply the commands queued by EnqueueFFBCommands. Main thread only,
+        /// UnityFFB calls it every FixedUpdate.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern int DrainFFBCommandQueue(out int commandCount);
+
+        [DllImport("UNITYFFB")]
+        public static extern int GetFFBCommandQueueStats(out FFBCommandQueueStats stats);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceSetAutoCenter(int device, bool autoCenter);
+
+        [DllImport("UNITYFFB")]
+        public static extern void DeviceStartAllFFBEffects(int device);
+
+        [DllImport("UNITYFFB")]
+        public static extern void DeviceStopAllFFBEffects(int device);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceStartForceOutputThread(int device, int rateHz);
+
+        [DllImport("UNITYFFB")]
+        public static extern void DeviceStopForceOutputThread(int device);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceSetForceOutputRate(int device, int rateHz);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceGetForceOutputStats(int device, out ForceOutputStats stats);
+
+        [DllImport("UNITYFFB")]
+        public static extern void DeviceResetForceOutputStats(int device);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceEnableForceSynthesis(int device, ref ForceSynthConfig config);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceEnableForceSynthesis(int device, IntPtr config);
+
+        [DllImport("UNITYFFB")]
+        public static extern void DeviceDisableForceSynthesis(int device);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceGetForceSynthState(int device, out ForceSynthState state);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceConfigureForceDsp(int device, int axis, ref ForceDspConfig config);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceConfigureForceDsp(int device, int axis, IntPtr config);
+
+        [DllImport("UNITYFFB")]
+        public static extern void DeviceDisableForceDsp(int device);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceGetForceDspState(int device, out ForceDspState state);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceEnableForceKeyframes(int device, ref FFBKeyframeConfig config);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceEnableForceKeyframes(int device, IntPtr config);
+
+        [DllImport("UNITYFFB")]
+        public static extern void DeviceDisableForceKeyframes(int device);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceSubmitForceKeyframes(int device, [In] FFBForceKeyframe[] keyframes, int keyframeCount);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceGetForceKeyframeStats(int device, out FFBKeyframeStats stats);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceConfigureForceMixer(int device, ref FFBForceMixerConfig config);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceConfigureForceMixer(int device, IntPtr config);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceCreateForceLayer(int device, string name, ref FFBForceLayerConfig config, out uint layer);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceFindForceLayer(int device, string name, out uint layer);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceConfigureForceLayer(int device, uint layer, ref FFBForceLayerConfig config);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceUpdateForceLayer(int device, uint layer, [In] float[] force);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceDestroyForceLayer(int device, uint layer);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceGetForceLayerState(int device, uint layer, out FFBForceLayerState state);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceGetForceMixerState(int device, out FFBForceMixerState state);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceStartFFBInputCapture(int device, ref FFBInputCaptureConfig config);
+
+        [DllImport("UNITYFFB")]
+        public static extern void DeviceStopFFBInputCapture(int device);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceGetFFBInputRing(int device, out FFBInputRing ring);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceGetFFBInputCaptureStats(int device, out FFBInputCaptureStats stats);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceAttachFFBBridge(int device, string name, ref FFBBridgeConfig config);
+
+        [DllImport("UNITYFFB")]
+        public static extern void DeviceDetachFFBBridge(int device);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceGetFFBBridgeStats(int device, out FFBBridgeStats stats);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceEnableFFBRateGovernor(int device, ref FFBRateGovernorConfig config);
+
+        [DllImport("UNITYFFB")]
+        public static extern void DeviceDisableFFBRateGovernor(int device);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceGetFFBRateGovernorStats(int device, out FFBRateGovernorStats stats);
+
+        [DllImport("UNITYFFB")]
+        public static extern int SetFFBEffectCapacity(int capacity);
+
+        /// <summary>
+        /// Create an effect and get a handle to it. Any number of effects of
+        /// a type can exist, up to the effect capacity. Handles of destroyed
+        /// effects are refused with E_HANDLE.
+        /// </summary>
+        [DllImport("UNITYFFB")]
+        public static extern int CreateFFBEffect(EffectsType effectType, out uint effect);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DestroyFFBEffect(uint effect);
+
+        [DllImport("UNITYFFB")]
+        public static extern int UpdateFFBEffectConstantForce(uint effect, int magnitude, int[] directions);
+
+        [DllImport("UNITYFFB")]
+        public static extern int UpdateFFBEffectCondition(uint effect, DICondition[] conditions);
+
+        [DllImport("UNITYFFB")]
+        public static extern int UpdateFFBEffectPeriodic(uint effect, ref FFBPeriodicEffect periodic, int[] directions);
+
+        [DllImport("UNITYFFB")]
+        public static extern int UpdateFFBEffectCustomForce(uint effect, ref FFBCustomForce customForce, int[] directions);
+
+        [DllImport("UNITYFFB", EntryPoint = "UpdateFFBEffect")]
+        public static extern int UpdateFFBEffect(uint effect, ref FFBConstantForceParams parameters, uint flags);
+
+        [DllImport("UNITYFFB", EntryPoint = "UpdateFFBEffect")]
+        public static extern int UpdateFFBEffect(uint effect, ref FFBRampForceParams parameters, uint flags);
+
+        [DllImport("UNITYFFB", EntryPoint = "UpdateFFBEffect")]
+        public static extern int UpdateFFBEffect(uint effect, ref FFBPeriodicParams parameters, uint flags);
+
+        [DllImport("UNITYFFB", EntryPoint = "UpdateFFBEffect")]
+        public static extern int UpdateFFBEffect(uint effect, ref FFBConditionParams parameters, uint flags);
+
+        [DllImport("UNITYFFB", EntryPoint = "UpdateFFBEffect")]
+        public static extern int UpdateFFBEffect(uint effect, ref FFBCustomForceParams parameters, uint flags);
+
+        [DllImport("UNITYFFB")]
+        public static extern int GetFFBCustomForceStats(uint effect, out FFBCustomForceStats stats);
+
+        [DllImport("UNITYFFB")]
+        public static extern int SetFFBEffectGain(uint effect, float gainPercent);
+
+        [DllImport("UNITYFFB")]
+        public static extern int StartFFBEffect(uint effect);
+
+        [DllImport("UNITYFFB")]
+        public static extern int StopFFBEffect(uint effect);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceSetFFBEffectCapacity(int device, int capacity);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceCreateFFBEffect(int device, EffectsType effectType, out uint effect);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceDestroyFFBEffect(int device, uint effect);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceUpdateFFBEffectConstantForce(int device, uint effect, int magnitude, int[] directions);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceUpdateFFBEffectCondition(int device, uint effect, DICondition[] conditions);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceUpdateFFBEffectPeriodic(int device, uint effect, ref FFBPeriodicEffect periodic, int[] directions);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceUpdateFFBEffectCustomForce(int device, uint effect, ref FFBCustomForce customForce, int[] directions);
+
+        [DllImport("UNITYFFB", EntryPoint = "DeviceUpdateFFBEffect")]
+        public static extern int DeviceUpdateFFBEffect(int device, uint effect, ref FFBConstantForceParams parameters, uint flags);
+
+        [DllImport("UNITYFFB", EntryPoint = "DeviceUpdateFFBEffect")]
+        public static extern int DeviceUpdateFFBEffect(int device, uint effect, ref FFBRampForceParams parameters, uint flags);
+
+        [DllImport("UNITYFFB", EntryPoint = "DeviceUpdateFFBEffect")]
+        public static extern int DeviceUpdateFFBEffect(int device, uint effect, ref FFBPeriodicParams parameters, uint flags);
+
+        [DllImport("UNITYFFB", EntryPoint = "DeviceUpdateFFBEffect")]
+        public static extern int DeviceUpdateFFBEffect(int device, uint effect, ref FFBConditionParams parameters, uint flags);
+
+        [DllImport("UNITYFFB", EntryPoint = "DeviceUpdateFFBEffect")]
+        public static extern int DeviceUpdateFFBEffect(int device, uint effect, ref FFBCustomForceParams parameters, uint flags);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceGetFFBCustomForceStats(int device, uint effect, out FFBCustomForceStats stats);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceSetFFBEffectGain(int device, uint effect, float gainPercent);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceStartFFBEffect(int device, uint effect);
+
+        [DllImport("UNITYFFB")]
+        public static extern int DeviceStopFFBEffect(int device, uint effect);
 #endif
     }
 }
@@ -1,5 +1,7 @@
 ﻿using System;
 using System.Runtime.InteropServices;
+using Unity.Collections;
+using Unity.Collections.LowLevel.Unsafe;
 using UnityEngine;
 
 namespace UnityFFB
@@ -20,6 +22,195 @@ namespace UnityFFB
         CustomForce = 11
     }
 
+    public enum FFBCommandType
+    {
+        UpdateConstantForce = 0,
+        UpdateSpring = 1,
+        SetGain = 2,
+        Start = 3,
+        Stop = 4,
+        UpdateCondition = 5,
+        UpdatePeriodic = 6
+    }
+
+    /// <summary>
+    /// One entry of a SubmitFFBCommands batch. Blittable mirror of the native
+    /// FFBCommand, the payload holds either a constant force (magnitude plus
+    /// one direction per axis), one DICondition per axis, a periodic effect
+    /// (plus one direction per axis) or a gain.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public unsafe struct FFBCommand
+    {
+        public const int MaxAxes = 6;
+
+        public FFBCommandType command;
+        public EffectsType effectType;
+        private fixed int payload[MaxAxes * 6];
+
+        public static FFBCommand ConstantForce(int magnitude, int[] directions)
+        {
+            FFBCommand cmd = new FFBCommand();
+            cmd.command = FFBCommandType.UpdateConstantForce;
+            cmd.effectType = EffectsType.ConstantForce;
+            cmd.payload[0] = magnitude;
+            for (int i = 0; i < directions.Length && i < MaxAxes; i++)
+            {
+                cmd.payload[1 + i] = directions[i];
+            }
+            return cmd;
+        }
+
+        public static FFBCommand Spring(DICondition[] conditions)
+        {
+            FFBCommand cmd = new FFBCommand();
+            cmd.command = FFBCommandType.UpdateSpring;
+            cmd.effectType = EffectsType.Spring;
+            DICondition* pConditions = (DICondition*)cmd.payload;
+            for (int i = 0; i < conditions.Length && i < MaxAxes; i++)
+            {
+                pConditions[i] = conditions[i];
+            }
+            return cmd;
+        }
+
+        /// <summary>
+        /// Update any condition effect (Spring, Damper, Inertia or Friction).
+        /// </summary>
+        public static FFBCommand Condition(EffectsType effectType, DICondition[] conditions)
+        {
+            FFBCommand cmd = Spring(conditions);
+            cmd.command = FFBCommandType.UpdateCondition;
+            cmd.effectType = effectType;
+            return cmd;
+        }
+
+        /// <summary>
+        /// Update a periodic effect (Square, Sine, Triangle, SawtoothUp or
+        /// SawtoothDown).
+        /// </summary>
+        public static FFBCommand Periodic(EffectsType effectType, FFBPeriodicEffect effect, int[] directions)
+        {
+            FFBCommand cmd = new FFBCommand();
+            cmd.command = FFBCommandType.UpdatePeriodic;
+            cmd.effectType = effectType;
+            *(FFBPeriodicEffect*)cmd.payload = effect;
+            int* pDirections = cmd.payload + sizeof(FFBPeriodicEffect) / sizeof(int);
+            for (int i = 0; i < directions.Length && i < MaxAxes; i++)
+            {
+                pDirections[i] = directions[i];
+            }
+            return cmd;
+        }
+
+        public static FFBCommand Gain(EffectsType effectType, float gainPercent)
+        {
+            FFBCommand cmd = new FFBCommand();
+            cmd.command = FFBCommandType.SetGain;
+            cmd.effectType = effectType;
+            *(float*)cmd.payload = gainPercent;
+            return cmd;
+        }
+
+        public static FFBCommand Start(EffectsType effectType)
+        {
+            FFBCommand cmd = new FFBCommand();
+            cmd.command = FFBCommandType.Start;
+            cmd.effectType = effectType;
+            return cmd;
+        }
+
+        public static FFBCommand Stop(EffectsType effectType)
+        {
+            FFBCommand cmd = new FFBCommand();
+            cmd.command = FFBCommandType.Stop;
+            cmd.effectType = effectType;
+            return cmd;
+        }
+    }
+
+    public enum BackendType
+    {
+        DirectInput = 0,
+        Simulated = 1
+    }
+
+    /// <summary>
+    /// Describes the wheel(s) modelled by the simulated backend.
+    /// </summary>
+    [Serializable]
+    [StructLayout(LayoutKind.Sequential)]
+    public struct SimulatedDeviceConfig
+    {
+        public int deviceCount;
+        public int axisCount;
+        public uint maxForce;
+        public uint forceResolution;
+        /// <summary>
+        /// Busy-waited on every driver call to model USB round trips.
+        /// </summary>
+        public uint latencyMicroseconds;
+        /// <summary>
+        /// Every Nth SetParameters is acknowledged but not applied, 0 disables.
+        /// </summary>
+        public uint dropEveryN;
+        /// <summary>
+        /// Each GetState advances the wheel physics by this much, 0 uses
+        /// the real time elapsed since the previous GetState.
+        /// </summary>
+        public uint physicsStepMicroseconds;
+        /// <summary>
+        /// Effects the wheel can hold at once, 0 for no limit.
+        /// </summary>
+        public uint maxEffects;
+        /// <summary>
+        /// Slept once by every enumeration and effect probe, to model
+        /// wheels that are slow to enumerate.
+        /// </summary>
+        public uint enumerationMicroseconds;
+        /// <summary>
+        /// Busy-waited on top of the latency when an effect is first
+        /// written into the wheel's memory.
+        /// </summary>
+        public uint downloadMicroseconds;
+        /// <summary>
+        /// Rate custom force samples reach the wheel at, busy-waited for on
+        /// every upload. 0 sends them at no cost.
+        /// </summary>
+        public uint sampleBytesPerMillisecond;
+        /// <summary>
+        /// Updates per second the wheel's firmware processes, a faster
+        /// update waits for the previous one. 0 for no limit.
+        /// </summary>
+        public uint firmwareUpdateHz;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct SimulatedDeviceState
+    {
+        public uint effectsCreated;
+        public uint setParametersCalls;
+        public uint droppedUpdates;
+        public uint startCalls;
+        public uint stopCalls;
+        public int autoCenter;
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 6)]
+        public int[] outputForce;
+        /// <summary>
+        /// Axis positions in c_dfDIJoystick range (0 - 65535).
+        /// </summary>
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 6)]
+        public int[] axisPosition;
+        /// <summary>
+        /// Effects written into the wheel's memory.
+        /// </summary>
+        public uint downloads;
+        /// <summary>
+        /// Custom force samples received, over all channels.
+        /// </summary>
+        public uint samplesReceived;
+    }
+
     [Serializable]
     [StructLayout(LayoutKind.Sequential)]
     public struct DeviceInfo
@@ -58,53 +249,1410 @@ namespace UnityFFB
     };
 
     /// <summary>
-    /// See https://docs.microsoft.com/en-us/previous-versions/windows/desktop/ee416601(v=vs.85)
+    /// Header of a blittable enumeration snapshot. Offsets are in bytes from
+    /// the start of the snapshot.
     /// </summary>
     [StructLayout(LayoutKind.Sequential)]
-    public struct DICondition
+    public struct FFBEnumSnapshot
+    {
+        public uint size;
+        public uint recordCount;
+        public uint recordSize;
+        public uint recordOffset;
+        public uint stringOffset;
+        public uint stringBytes;
+    }
+
+    /// <summary>
+    /// A device in an EnumerateFFBDeviceSnapshot snapshot. The names are
+    /// offsets into the snapshot's string pool.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBDeviceRecord
+    {
+        public Guid guidInstance;
+        public Guid guidProduct;
+        public uint deviceType;
+        public uint instanceName;
+        public uint productName;
+        public uint reserved;
+    }
+
+    /// <summary>
+    /// An axis in an EnumerateFFBAxisSnapshot snapshot.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBAxisRecord
     {
+        public Guid guidType;
         /// <summary>
-        /// Offset for the condition, in the range from - 10,000 through 10,000.
+        /// Offset of the axis in DIJOYSTATE, how effects address it.
         /// </summary>
-        public int offset;
+        public uint joystateOffset;
+        public uint offset;
+        public uint type;
+        public uint flags;
+        public uint ffMaxForce;
+        public uint ffForceResolution;
+        public uint collectionNumber;
+        public uint designatorIndex;
+        public uint usagePage;
+        public uint usage;
+        public uint dimension;
+        public uint exponent;
+        public uint reportId;
+        public uint name;
+    }
+
+    public enum FFBDeviceEventType
+    {
+        Added = 0,
+        Removed = 1,
         /// <summary>
-        /// Coefficient constant on the positive side of the offset, in the range 
-        /// from - 10,000 through 10,000.
+        /// Same instance, different product, type or name.
         /// </summary>
-        public int positiveCoefficient;
+        Changed = 2,
         /// <summary>
-        /// Coefficient constant on the negative side of the offset, in the range 
-        /// from - 10,000 through 10,000. If the device does not support separate
-        /// positive and negative coefficients, the value of lNegativeCoefficient 
-        /// is ignored, and the value of lPositiveCoefficient is used as both the 
-        /// positive and negative coefficients.
+        /// An open device was attached again and its effects recreated.
         /// </summary>
-        public int negativeCoefficient;
+        Restored = 3
+    }
+
+    /// <summary>
+    /// A change to the attached devices, from PollFFBDeviceEvents.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBDeviceEvent
+    {
+        public FFBDeviceEventType type;
+        public uint deviceType;
+        public Guid guidInstance;
+        public Guid guidProduct;
         /// <summary>
-        /// Maximum force output on the positive side of the offset, in the range
-        /// from 0 through 10,000.
-        /// 
-        /// If the device does not support force saturation, the value of this
-        /// member is ignored.
+        /// The open device the event is about, 0 if the device is not open.
         /// </summary>
-        public uint positiveSaturation;
+        public int device;
         /// <summary>
-        /// Maximum force output on the negative side of the offset, in the range
-        /// from 0 through 10,000.
-        ///
-        /// If the device does not support force saturation, the value of this member
-        /// is ignored.
-        /// 
-        /// If the device does not support separate positive and negative saturation,
-        /// the value of dwNegativeSaturation is ignored, and the value of dwPositiveSaturation
-        /// is used as both the positive and negative saturation.
+        /// For Restored, whether the device and its effects could be recreated.
         /// </summary>
-        public uint negativeSaturation;
+        public int result;
+    }
+
+    public enum FFBInitDeviceSelection
+    {
         /// <summary>
-        /// Region around lOffset in which the condition is not active, in the range
-        /// from 0 through 10,000. In other words, the condition is not active between
-        /// lOffset minus lDeadBand and lOffset plus lDeadBand.
+        /// The first device enumerated.
         /// </summary>
-        public int deadband;
+        First = 0,
+        /// <summary>
+        /// The device whose guidInstance is FFBInitConfig.guid.
+        /// </summary>
+        Instance = 1,
+        /// <summary>
+        /// The first device whose guidProduct is FFBInitConfig.guid.
+        /// </summary>
+        Product = 2
+    }
+
+    public enum FFBInitStage
+    {
+        StartBackend = 0,
+        EnumerateDevices = 1,
+        OpenDevice = 2,
+        SetAutoCenter = 3,
+        EnumerateAxes = 4,
+        AddEffects = 5
+    }
+
+    public enum FFBInitState
+    {
+        Idle = 0,
+        Running = 1,
+        Succeeded = 2,
+        Failed = 3
+    }
+
+    /// <summary>
+    /// What StartFFBInitAsync sets up.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBInitConfig
+    {
+        public FFBInitDeviceSelection deviceSelection;
+        public Guid guid;
+        /// <summary>
+        /// -1 leaves auto center as it is, 0 disables and 1 enables it.
+        /// </summary>
+        public int autoCenter;
+        public int synthesizeConditions;
+        public int effectCount;
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 8)]
+        public EffectsType[] effects;
+        public int startEffects;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBInitStatus
+    {
+        public FFBInitState state;
+        /// <summary>
+        /// The stage running, or the last one that ran once finished.
+        /// </summary>
+        public FFBInitStage stage;
+        public uint stagesCompleted;
+        public int result;
+        /// <summary>
+        /// Once Succeeded, the opened device. It is the default device.
+        /// </summary>
+        public int device;
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 6)]
+        public float[] stageMilliseconds;
+        public float totalMilliseconds;
+    }
+
+#if UNITY_2021_2_OR_NEWER
+    /// <summary>
+    /// Reads an enumeration snapshot in place, without marshalling. Only
+    /// valid until the plugin enumerates the same kind again.
+    /// </summary>
+    public readonly unsafe struct FFBSnapshot<T> where T : unmanaged
+    {
+        private readonly byte* snapshot;
+
+        public FFBSnapshot(IntPtr snapshot)
+        {
+            this.snapshot = (byte*)snapshot;
+            if (snapshot != IntPtr.Zero && ((FFBEnumSnapshot*)snapshot)->recordSize != sizeof(T))
+            {
+                throw new ArgumentException($"snapshot does not hold {typeof(T).Name} records", nameof(snapshot));
+            }
+        }
+
+        public ReadOnlySpan<T> Records
+        {
+            get
+            {
+                if (snapshot == null)
+                {
+                    return ReadOnlySpan<T>.Empty;
+                }
+                FFBEnumSnapshot* header = (FFBEnumSnapshot*)snapshot;
+                return new ReadOnlySpan<T>(snapshot + header->recordOffset, (int)header->recordCount);
+            }
+        }
+
+        /// <summary>
+        /// The UTF-8 bytes of a string field, without the null terminator.
+        /// </summary>
+        public ReadOnlySpan<byte> GetUTF8(uint offset)
+        {
+            FFBEnumSnapshot* header = (FFBEnumSnapshot*)snapshot;
+            if (snapshot == null || offset >= header->stringBytes)
+            {
+                return ReadOnlySpan<byte>.Empty;
+            }
+            byte* start = snapshot + header->stringOffset + offset;
+            int length = 0;
+            while (start[length] != 0)
+            {
+                length++;
+            }
+            return new ReadOnlySpan<byte>(start, length);
+        }
+
+        public string GetString(uint offset)
+        {
+            ReadOnlySpan<byte> utf8 = GetUTF8(offset);
+            fixed (byte* p = utf8)
+            {
+                return System.Text.Encoding.UTF8.GetString(p, utf8.Length);
+            }
+        }
+    }
+#endif
+
+    /// <summary>
+    /// The calls GetFFBStats times, exported functions and driver calls.
+    /// </summary>
+    public enum FFBStatCall
+    {
+        StartDirectInput = 0,
+        EnumerateDevices = 1,
+        OpenDevice = 2,
+        EnumerateAxes = 3,
+        CreateEffect = 4,
+        DestroyEffect = 5,
+        UpdateConstantForce = 6,
+        UpdateCondition = 7,
+        UpdateGain = 8,
+        SubmitCommands = 9,
+        SetAutoCenter = 10,
+        StartEffects = 11,
+        StopEffects = 12,
+        DriverEnumDevices = 13,
+        DriverCreateDevice = 14,
+        DriverEnumAxes = 15,
+        DriverCreateEffect = 16,
+        DriverSetParameters = 17,
+        DriverStart = 18,
+        DriverStop = 19,
+        DriverSetProperty = 20,
+        DriverGetState = 21,
+        DriverDownload = 22,
+        UpdatePeriodic = 23,
+        UpdateCustomForce = 24,
+        UpdateEffect = 25
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBStatResult
+    {
+        public int result;
+        public uint count;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBCallStats
+    {
+        public ulong totalNanoseconds;
+        public ulong maxNanoseconds;
+        public uint calls;
+        public uint failures;
+        /// <summary>
+        /// Failures with an HRESULT that did not fit in results.
+        /// </summary>
+        public uint otherFailures;
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 4)]
+        public FFBStatResult[] results;
+        /// <summary>
+        /// Calls taking 2^i to 2^(i+1) clock ticks, see FFBStats.nanosecondsPerTick.
+        /// </summary>
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 32)]
+        public uint[] histogram;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBStats
+    {
+        /// <summary>
+        /// 0 when the plugin was built without statistics.
+        /// </summary>
+        public int enabled;
+        public uint callCount;
+        public float nanosecondsPerTick;
+        public uint reserved;
+        /// <summary>
+        /// Indexed by FFBStatCall.
+        /// </summary>
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 26)]
+        public FFBCallStats[] calls;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBRecorderStats
+    {
+        public int recording;
+        public uint recordsWritten;
+        /// <summary>
+        /// Records lost because the file could not be written fast enough.
+        /// </summary>
+        public uint recordsDropped;
+        /// <summary>
+        /// The first error writing the file, 0 if none.
+        /// </summary>
+        public int writeResult;
+        public ulong bytesWritten;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBCommandQueueStats
+    {
+        /// <summary>
+        /// Commands accepted by EnqueueFFBCommands.
+        /// </summary>
+        public uint enqueued;
+        /// <summary>
+        /// Commands rejected because the queue was full.
+        /// </summary>
+        public uint dropped;
+        public uint drained;
+        /// <summary>
+        /// Drained commands that failed, or whose device was closed.
+        /// </summary>
+        public uint failed;
+        /// <summary>
+        /// Waiting to be drained.
+        /// </summary>
+        public uint pending;
+    }
+
+    /// <summary>
+    /// The native EnqueueFFBCommands, returned by
+    /// UnityFFBNative.GetFFBEnqueueCommandsFunction. Burst compiled jobs can
+    /// call it through new FunctionPointer&lt;EnqueueFFBCommandsDelegate&gt;(pointer).
+    /// </summary>
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+    public unsafe delegate int EnqueueFFBCommandsDelegate(int device, FFBCommand* commands, int commandCount);
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBUpdateCounters
+    {
+        /// <summary>
+        /// Effect updates the plugin was asked to make.
+        /// </summary>
+        public uint callsReceived;
+        /// <summary>
+        /// Updates that reached the driver after dropping unchanged fields.
+        /// </summary>
+        public uint callsForwarded;
+        public uint parameterBytesSent;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct ForceOutputStats
+    {
+        public int running;
+        public int rateHz;
+        public uint ticks;
+        /// <summary>
+        /// Ticks that ran past the following deadline.
+        /// </summary>
+        public uint overruns;
+        public uint updatesApplied;
+        public uint updatesFailed;
+        /// <summary>
+        /// How late the thread woke up relative to its schedule.
+        /// </summary>
+        public float meanJitterMicroseconds;
+        public float maxJitterMicroseconds;
+    }
+
+    /// <summary>
+    /// Tuning for the software condition effects. Positions are in
+    /// DirectInput units (-10000 to 10000 across the axis range), velocity
+    /// and acceleration in units per second (squared).
+    /// </summary>
+    [Serializable]
+    [StructLayout(LayoutKind.Sequential)]
+    public struct ForceSynthConfig
+    {
+        /// <summary>
+        /// Low pass cutoffs applied to the differentiated position.
+        /// </summary>
+        public float velocityCutoffHz;
+        public float accelerationCutoffHz;
+        /// <summary>
+        /// Velocity/acceleration that damper/inertia treat as full scale.
+        /// </summary>
+        public float velocityFullScale;
+        public float accelerationFullScale;
+        /// <summary>
+        /// Velocity at which friction reaches its full coefficient.
+        /// </summary>
+        public float frictionVelocityThreshold;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct ForceSynthState
+    {
+        public int axisCount;
+        public uint steps;
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 6)]
+        public float[] position;
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 6)]
+        public float[] velocity;
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 6)]
+        public float[] acceleration;
+        /// <summary>
+        /// Force the synthesizer added to each axis on its last step.
+        /// </summary>
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 6)]
+        public float[] force;
+    }
+
+    /// <summary>
+    /// Conditioning of the force sent on one axis, applied at the output
+    /// rate in this order: low pass, notch, compressor, slew limit, clip to
+    /// 10000. Forces are in DirectInput units. A stage is off when its
+    /// frequency, ratio or rate is 0, filters at or above half the output
+    /// rate are off as well.
+    /// </summary>
+    [Serializable]
+    [StructLayout(LayoutKind.Sequential)]
+    public struct ForceDspConfig
+    {
+        /// <summary>
+        /// Second order low pass, Q 0.707 (Butterworth) when 0.
+        /// </summary>
+        public float lowPassHz;
+        public float lowPassQ;
+        /// <summary>
+        /// Notch for a resonance of the wheel, Q 2 when 0.
+        /// </summary>
+        public float notchHz;
+        public float notchQ;
+        /// <summary>
+        /// Forces above threshold are reduced by ratio (4 for 4:1), eased in
+        /// over kneeWidth centered on the threshold.
+        /// </summary>
+        public float compressorThreshold;
+        public float compressorRatio;
+        public float kneeWidth;
+        /// <summary>
+        /// Largest change of the force per second.
+        /// </summary>
+        public float slewRate;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct ForceDspState
+    {
+        public int axisCount;
+        public uint samples;
+        public float sampleRateHz;
+        /// <summary>
+        /// Samples beyond 10000 at the end of the chain, which were clipped,
+        /// per axis.
+        /// </summary>
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 6)]
+        public uint[] clippedSamples;
+        /// <summary>
+        /// Force into and out of the chain on the last sample.
+        /// </summary>
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 6)]
+        public float[] input;
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 6)]
+        public float[] output;
+    }
+
+    /// <summary>
+    /// How the output thread turns keyframes into a force every tick.
+    /// </summary>
+    public enum FFBKeyframeMode
+    {
+        /// <summary>
+        /// Cubic Hermite between the keyframes around now - delayMs.
+        /// </summary>
+        Hermite = 0,
+        /// <summary>
+        /// Linear from the newest keyframe to now + lookaheadMs.
+        /// </summary>
+        Extrapolate = 1
+    }
+
+    [Serializable]
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBKeyframeConfig
+    {
+        public FFBKeyframeMode mode;
+        /// <summary>
+        /// Hermite: how far behind now the force is rendered. At least the
+        /// keyframe interval plus its jitter, or the newest keyframe is held.
+        /// </summary>
+        public float delayMs;
+        /// <summary>
+        /// Extrapolate: how far ahead of now the force is predicted, to make
+        /// up for the time until the device applies it.
+        /// </summary>
+        public float lookaheadMs;
+        /// <summary>
+        /// Extrapolate: longest the newest keyframe is extrapolated before
+        /// the force is held.
+        /// </summary>
+        public float maxExtrapolationMs;
+    }
+
+    /// <summary>
+    /// The force on every axis at one point in time, in DirectInput units.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBForceKeyframe
+    {
+        /// <summary>
+        /// When the force is due, on the GetFFBClockMicroseconds clock. 0 for
+        /// the time it is submitted.
+        /// </summary>
+        public long timeUs;
+        /// <summary>
+        /// Whether derivative holds the slope, otherwise it is estimated from
+        /// the neighbouring keyframes.
+        /// </summary>
+        public int hasDerivative;
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 6)]
+        public float[] force;
+        /// <summary>
+        /// Units per second.
+        /// </summary>
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 6)]
+        public float[] derivative;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBKeyframeStats
+    {
+        public uint submitted;
+        /// <summary>
+        /// Rejected because the queue was full or they were older than the
+        /// previous keyframe.
+        /// </summary>
+        public uint dropped;
+        /// <summary>
+        /// Hermite: arrived after their time was already rendered, the force
+        /// eases into them instead.
+        /// </summary>
+        public uint late;
+        /// <summary>
+        /// Hermite: ticks that ran out of keyframes and held the newest one.
+        /// </summary>
+        public uint underruns;
+        /// <summary>
+        /// From submitting a keyframe to the output thread sending the first
+        /// force computed with it.
+        /// </summary>
+        public float meanLatencyMicroseconds;
+        public float maxLatencyMicroseconds;
+        /// <summary>
+        /// How far ahead of the rendered time keyframes arrived, negative
+        /// when late.
+        /// </summary>
+        public float meanLeadMicroseconds;
+        public float minLeadMicroseconds;
+    }
+
+    /// <summary>
+    /// One contribution to the force mixed on the output thread, e.g. road
+    /// texture or a collision impulse.
+    /// </summary>
+    [Serializable]
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBForceLayerConfig
+    {
+        public float gainPercent;
+        /// <summary>
+        /// Higher priority layers duck the ones below them and keep their
+        /// force when the mix runs out of room.
+        /// </summary>
+        public int priority;
+        /// <summary>
+        /// How much the layer lowers every layer of lower priority while at
+        /// full force, 0 - 100.
+        /// </summary>
+        public float duckPercent;
+        /// <summary>
+        /// The force rises over attackMs, is held for lifetimeMs after each
+        /// update (0 holds it until the layer is destroyed), then falls over
+        /// decayMs.
+        /// </summary>
+        public float attackMs;
+        public float lifetimeMs;
+        public float decayMs;
+    }
+
+    [Serializable]
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBForceMixerConfig
+    {
+        /// <summary>
+        /// Top of the force range, 0 - 100 percent, the mix saturates into
+        /// softly instead of being clipped.
+        /// </summary>
+        public float headroomPercent;
+        public float duckAttackMs;
+        public float duckReleaseMs;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBForceLayerState
+    {
+        [MarshalAs(UnmanagedType.ByValTStr, SizeConst = 32)]
+        public string name;
+        public int priority;
+        public float envelope;
+        public float duckGain;
+        /// <summary>
+        /// Share of its force the layer kept when the mix ran out of room.
+        /// </summary>
+        public float headroomGain;
+        /// <summary>
+        /// What the layer added to the mix on the last tick, per axis.
+        /// </summary>
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 6)]
+        public float[] output;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBForceMixerState
+    {
+        public int layerCount;
+        public int activeLayers;
+        public uint ticks;
+        /// <summary>
+        /// Ticks layers were turned down to fit under the headroom.
+        /// </summary>
+        public uint squeezedTicks;
+        /// <summary>
+        /// Ticks the mix went into the headroom.
+        /// </summary>
+        public uint saturatedTicks;
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 6)]
+        public float[] output;
+    }
+
+    public enum FFBCapabilitySource
+    {
+        None = 0,
+        /// <summary>
+        /// Read from the capability cache, not checked against the device
+        /// yet.
+        /// </summary>
+        Cache = 1,
+        /// <summary>
+        /// Read from the cache and confirmed by the device.
+        /// </summary>
+        Validated = 2,
+        /// <summary>
+        /// The device differed from the cache, these are the device's.
+        /// </summary>
+        Refreshed = 3,
+        /// <summary>
+        /// Probed on the device, it was not cached.
+        /// </summary>
+        Device = 4
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBDeviceCapabilities
+    {
+        /// <summary>
+        /// Bit 1 &lt;&lt; EffectsType for every effect type the device can play.
+        /// </summary>
+        public uint effectTypes;
+        /// <summary>
+        /// Effects the device holds at once, 0 if it does not say.
+        /// </summary>
+        public uint maxEffects;
+        public uint axisCount;
+        /// <summary>
+        /// Mean time the driver took to apply an effect update, 0 until
+        /// measured.
+        /// </summary>
+        public float updateLatencyMicroseconds;
+        public FFBCapabilitySource source;
+
+        public bool Supports(EffectsType effectType)
+        {
+            return (effectTypes & (1u << (int)effectType)) != 0;
+        }
+    }
+
+    /// <summary>
+    /// A device in the GetFFBCapabilityCacheSnapshot snapshot. The names are
+    /// offsets into the snapshot's string pool, those of the axes too. The
+    /// axes are separate fields so the record stays blittable.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBCapabilityRecord
+    {
+        public Guid guidInstance;
+        public Guid guidProduct;
+        public uint deviceType;
+        public uint instanceName;
+        public uint productName;
+        public uint effectTypes;
+        public uint maxEffects;
+        public float updateLatencyMicroseconds;
+        public uint axisCount;
+        public uint reserved;
+        public FFBAxisRecord axis0;
+        public FFBAxisRecord axis1;
+        public FFBAxisRecord axis2;
+        public FFBAxisRecord axis3;
+        public FFBAxisRecord axis4;
+        public FFBAxisRecord axis5;
+
+        public FFBAxisRecord GetAxis(int axis)
+        {
+            switch (axis)
+            {
+                case 0: return axis0;
+                case 1: return axis1;
+                case 2: return axis2;
+                case 3: return axis3;
+                case 4: return axis4;
+                case 5: return axis5;
+                default: throw new ArgumentOutOfRangeException(nameof(axis));
+            }
+        }
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBCapabilityCacheStatus
+    {
+        public int enabled;
+        /// <summary>
+        /// The file existed and was a valid cache of this version.
+        /// </summary>
+        public int loaded;
+        public uint deviceCount;
+        /// <summary>
+        /// Devices opened with their capabilities from the cache, and
+        /// opened devices that were not in it.
+        /// </summary>
+        public uint hits;
+        public uint misses;
+        /// <summary>
+        /// Open devices the background check confirmed, and those it found
+        /// different from the cache.
+        /// </summary>
+        public uint validated;
+        public uint stale;
+        /// <summary>
+        /// The enumeration was answered from the cache and the devices
+        /// attached differ from it, enumerate again to see them.
+        /// </summary>
+        public int devicesChanged;
+        public int dirty;
+        public int saveResult;
+        public float loadMilliseconds;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBEffectPoolConfig
+    {
+        public const int EffectTypeCount = 12;
+
+        /// <summary>
+        /// Effects of each type, indexed by EffectsType, created and
+        /// downloaded when a device is opened. Only ConstantForce, the
+        /// periodic and the condition effects can be pooled.
+        /// </summary>
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = EffectTypeCount)]
+        public int[] effectsPerType;
+
+        public static FFBEffectPoolConfig Create()
+        {
+            return new FFBEffectPoolConfig { effectsPerType = new int[EffectTypeCount] };
+        }
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBEffectPoolStats
+    {
+        /// <summary>
+        /// Effects waiting in the pool, indexed by EffectsType.
+        /// </summary>
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = FFBEffectPoolConfig.EffectTypeCount)]
+        public uint[] available;
+        /// <summary>
+        /// Effects handed out from the pool, and effects of a pooled type
+        /// created because its pool was empty.
+        /// </summary>
+        public uint hits;
+        public uint misses;
+        public uint recycled;
+        /// <summary>
+        /// Effects created on the device, pooled or not, and how long
+        /// creating and downloading one took.
+        /// </summary>
+        public uint created;
+        public float meanCreateMicroseconds;
+        public float maxCreateMicroseconds;
+        public float fillMilliseconds;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBMemoryStats
+    {
+        /// <summary>
+        /// Effect slots the device holds in its arena, in use and the most in
+        /// use at once. A slot holds everything an effect needs.
+        /// </summary>
+        public uint effectSlots;
+        public uint effectSlotsInUse;
+        public uint effectSlotsHighWater;
+        /// <summary>
+        /// Blocks the arena allocated and their size. It only grows when more
+        /// effects exist at once than ever before on the device and is freed
+        /// with the device.
+        /// </summary>
+        public uint arenaBlocks;
+        public uint arenaBytes;
+    }
+
+    /// <summary>
+    /// See https://docs.microsoft.com/en-us/previous-versions/windows/desktop/ee416601(v=vs.85)
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct DICondition
+    {
+        /// <summary>
+        /// Offset for the condition, in the range from - 10,000 through 10,000.
+        /// </summary>
+        public int offset;
+        /// <summary>
+        /// Coefficient constant on the positive side of the offset, in the range 
+        /// from - 10,000 through 10,000.
+        /// </summary>
+        public int positiveCoefficient;
+        /// <summary>
+        /// Coefficient constant on the negative side of the offset, in the range 
+        /// from - 10,000 through 10,000. If the device does not support separate
+        /// positive and negative coefficients, the value of lNegativeCoefficient 
+        /// is ignored, and the value of lPositiveCoefficient is used as both the 
+        /// positive and negative coefficients.
+        /// </summary>
+        public int negativeCoefficient;
+        /// <summary>
+        /// Maximum force output on the positive side of the offset, in the range
+        /// from 0 through 10,000.
+        /// 
+        /// If the device does not support force saturation, the value of this
+        /// member is ignored.
+        /// </summary>
+        public uint positiveSaturation;
+        /// <summary>
+        /// Maximum force output on the negative side of the offset, in the range
+        /// from 0 through 10,000.
+        ///
+        /// If the device does not support force saturation, the value of this member
+        /// is ignored.
+        /// 
+        /// If the device does not support separate positive and negative saturation,
+        /// the value of dwNegativeSaturation is ignored, and the value of dwPositiveSaturation
+        /// is used as both the positive and negative saturation.
+        /// </summary>
+        public uint negativeSaturation;
+        /// <summary>
+        /// Region around lOffset in which the condition is not active, in the range
+        /// from 0 through 10,000. In other words, the condition is not active between
+        /// lOffset minus lDeadBand and lOffset plus lDeadBand.
+        /// </summary>
+        public int deadband;
+    }
+
+    /// <summary>
+    /// See https://docs.microsoft.com/en-us/previous-versions/windows/desktop/ee416634(v=vs.85)
+    /// </summary>
+    [Serializable]
+    [StructLayout(LayoutKind.Sequential)]
+    public struct DIPeriodic
+    {
+        /// <summary>
+        /// Magnitude of the waveform, in the range from 0 through 10,000.
+        /// </summary>
+        public uint magnitude;
+        /// <summary>
+        /// Offset the waveform is centered on, in the range from - 10,000
+        /// through 10,000.
+        /// </summary>
+        public int offset;
+        /// <summary>
+        /// Position in the cycle the effect starts at, in hundredths of a
+        /// degree (0 through 35,999).
+        /// </summary>
+        public uint phase;
+        /// <summary>
+        /// Length of one cycle, in microseconds.
+        /// </summary>
+        public uint period;
+    }
+
+    /// <summary>
+    /// See https://docs.microsoft.com/en-us/previous-versions/windows/desktop/ee416628(v=vs.85)
+    /// </summary>
+    [Serializable]
+    [StructLayout(LayoutKind.Sequential)]
+    public struct DIEnvelope
+    {
+        /// <summary>
+        /// Set by the plugin.
+        /// </summary>
+        public uint size;
+        /// <summary>
+        /// Magnitude the effect starts at, ramping to its own magnitude over
+        /// attackTime microseconds.
+        /// </summary>
+        public uint attackLevel;
+        public uint attackTime;
+        /// <summary>
+        /// Magnitude the effect ends at, ramping from its own magnitude over
+        /// the last fadeTime microseconds of its duration.
+        /// </summary>
+        public uint fadeLevel;
+        public uint fadeTime;
+    }
+
+    /// <summary>
+    /// A periodic effect played by the device itself: once it is sent the
+    /// wheel generates the waveform, nothing more is sent until something
+    /// changes.
+    /// </summary>
+    [Serializable]
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBPeriodicEffect
+    {
+        public DIPeriodic periodic;
+        /// <summary>
+        /// Not sent when attackTime and fadeTime are both 0.
+        /// </summary>
+        public DIEnvelope envelope;
+        /// <summary>
+        /// Microseconds, 0 or uint.MaxValue to play until stopped. A finite
+        /// effect plays once, StartFFBEffect plays it again.
+        /// </summary>
+        public uint duration;
+    }
+    /// <summary>
+    /// Samples for a CustomForce effect. The plugin reads them in place
+    /// without copying, so they must live in memory that does not move,
+    /// e.g. a NativeArray, and stay untouched until the chunk is uploaded.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBCustomForce
+    {
+        /// <summary>
+        /// channels * sampleCount ints from -10,000 through 10,000,
+        /// interleaved by channel. A single channel plays along the
+        /// directions, otherwise channel i drives axis i.
+        /// </summary>
+        public IntPtr samples;
+        public uint channels;
+        public uint sampleCount;
+        /// <summary>
+        /// Microseconds between samples.
+        /// </summary>
+        public uint samplePeriod;
+        /// <summary>
+        /// Microseconds, 0 or uint.MaxValue to repeat the samples until the
+        /// next chunk or until stopped.
+        /// </summary>
+        public uint duration;
+
+        /// <summary>
+        /// A chunk reading every sample of a NativeArray, which must not be
+        /// disposed or written while the chunk is pending.
+        /// </summary>
+        public static unsafe FFBCustomForce FromNativeArray(NativeArray<int> samples, uint channels, uint samplePeriod, uint duration = 0)
+        {
+            FFBCustomForce customForce;
+            customForce.samples = (IntPtr)NativeArrayUnsafeUtility.GetUnsafeReadOnlyPtr(samples);
+            customForce.channels = channels;
+            customForce.sampleCount = channels != 0 ? (uint)samples.Length / channels : 0;
+            customForce.samplePeriod = samplePeriod;
+            customForce.duration = duration;
+            return customForce;
+        }
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct DIRampForce
+    {
+        /// <summary>
+        /// Magnitude at the start and at the end of the effect, in the range
+        /// from - 10,000 through 10,000.
+        /// </summary>
+        public int start;
+        public int end;
+    }
+
+    /// <summary>
+    /// What UpdateEffect and UpdateFFBEffect take, one struct for each kind
+    /// of effect: ConstantForce, RampForce, the periodic effects, the
+    /// condition effects and CustomForce. Directions and conditions hold an
+    /// entry per device axis.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBConstantForceParams
+    {
+        public int magnitude;
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 6)]
+        public int[] directions;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBRampForceParams
+    {
+        public DIRampForce ramp;
+        /// <summary>
+        /// Microseconds from start to end, a ramp cannot play until stopped.
+        /// It plays once, StartFFBEffect plays it again.
+        /// </summary>
+        public uint duration;
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 6)]
+        public int[] directions;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBPeriodicParams
+    {
+        public FFBPeriodicEffect effect;
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 6)]
+        public int[] directions;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBConditionParams
+    {
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 6)]
+        public DICondition[] conditions;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBCustomForceParams
+    {
+        public FFBCustomForce customForce;
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 6)]
+        public int[] directions;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBEffectTypeInfo
+    {
+        /// <summary>
+        /// Size of the parameters UpdateEffect takes for the type.
+        /// </summary>
+        public uint paramsSize;
+        /// <summary>
+        /// The DIEP_* fields those parameters cover, what the flags of an
+        /// update may select. 0 selects all of them.
+        /// </summary>
+        public uint parameterFlags;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBCustomForceStats
+    {
+        /// <summary>
+        /// Samples uploaded, over all channels.
+        /// </summary>
+        public ulong samplesUploaded;
+        /// <summary>
+        /// 1 while a chunk waits for the one playing to finish, its samples
+        /// are still read.
+        /// </summary>
+        public uint pendingChunks;
+        public uint chunksSubmitted;
+        public uint chunksUploaded;
+        /// <summary>
+        /// Chunks that arrived after the previous chunk had played out.
+        /// </summary>
+        public uint underruns;
+        public float meanUploadMicroseconds;
+        public float maxUploadMicroseconds;
+    }
+
+    public enum FFBInputMode
+    {
+        /// <summary>
+        /// The device buffers every change with its time and the capture
+        /// thread reads the buffer.
+        /// </summary>
+        Buffered = 0,
+        /// <summary>
+        /// The capture thread polls the state and publishes what changed
+        /// since the last poll, timed by the poll.
+        /// </summary>
+        Polled = 1
+    }
+
+    public enum FFBInputKind : ushort
+    {
+        /// <summary>
+        /// index 0 - 5: X, Y, Z, Rx, Ry, Rz, 6 - 7: the sliders.
+        /// </summary>
+        Axis = 0,
+        /// <summary>
+        /// value 1 pressed, 0 released.
+        /// </summary>
+        Button = 1,
+        /// <summary>
+        /// value in hundredths of a degree, -1 centered.
+        /// </summary>
+        Pov = 2
+    }
+
+    /// <summary>
+    /// One change of an axis, button or POV.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBInputRecord
+    {
+        /// <summary>
+        /// When it changed, on the GetFFBClockMicroseconds clock. The device
+        /// times buffered changes to the millisecond.
+        /// </summary>
+        public long timeUs;
+        /// <summary>
+        /// From timeUs until the record was published.
+        /// </summary>
+        public uint captureDelayUs;
+        /// <summary>
+        /// Counts the records of the capture, gaps are records that were
+        /// dropped.
+        /// </summary>
+        public uint sequence;
+        public FFBInputKind kind;
+        public ushort index;
+        public int value;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBInputCaptureConfig
+    {
+        public FFBInputMode mode;
+        /// <summary>
+        /// Device reads per second, 10 - 4000.
+        /// </summary>
+        public int rateHz;
+        /// <summary>
+        /// Changes the device buffers between reads, Buffered only.
+        /// </summary>
+        public uint bufferSize;
+    }
+
+    /// <summary>
+    /// Where a device's input capture ring lives, see FFBInputReader.
+    /// Valid until the device is closed.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBInputRing
+    {
+        public IntPtr records;
+        public IntPtr writeIndex;
+        public IntPtr readIndex;
+        public uint capacity;
+        public uint recordSize;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBInputCaptureStats
+    {
+        /// <summary>
+        /// The mode in use, Polled when buffering could not be enabled.
+        /// </summary>
+        public FFBInputMode mode;
+        public uint reads;
+        public uint failedReads;
+        /// <summary>
+        /// Reads the device reported changes lost from its buffer, the rate
+        /// is too low for the buffer size.
+        /// </summary>
+        public uint deviceOverflows;
+        public ulong recordsPublished;
+        /// <summary>
+        /// Changes lost because the ring was full, the reader fell behind.
+        /// </summary>
+        public uint droppedRecords;
+        public float meanCaptureDelayMicroseconds;
+        public float maxCaptureDelayMicroseconds;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBBridgeConfig
+    {
+        /// <summary>
+        /// Longest the writer may go without a heartbeat or frame before
+        /// its force is stale and the game's own force is used again.
+        /// </summary>
+        public float staleMs;
+        /// <summary>
+        /// How often a region that is missing, invalid or stale is opened
+        /// again, e.g. after the writer restarted.
+        /// </summary>
+        public float reopenMs;
+    }
+
+    public enum FFBBridgeState
+    {
+        Detached = 0,
+        /// <summary>
+        /// The region does not exist yet or its header is not valid.
+        /// </summary>
+        Waiting = 1,
+        /// <summary>
+        /// The writer is alive, its frames drive the device.
+        /// </summary>
+        Live = 2,
+        /// <summary>
+        /// The writer stopped, the game's force is used until it is back.
+        /// </summary>
+        Stale = 3
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBBridgeStats
+    {
+        public FFBBridgeState state;
+        /// <summary>
+        /// Distinct frames applied to the device.
+        /// </summary>
+        public ulong framesApplied;
+        /// <summary>
+        /// Frames the writer published between two reads, never seen.
+        /// </summary>
+        public ulong framesSkipped;
+        /// <summary>
+        /// Reads that caught the writer mid frame and were retried.
+        /// </summary>
+        public uint tornReads;
+        public uint staleCount;
+        public uint opens;
+        /// <summary>
+        /// Since the writer was last seen alive.
+        /// </summary>
+        public float sinceHeartbeatMs;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBRateGovernorConfig
+    {
+        /// <summary>
+        /// Range the output rate is kept in, 10 - 4000 Hz.
+        /// </summary>
+        public int floorHz;
+        public int ceilingHz;
+        /// <summary>
+        /// Added to the rate after every window the device kept up with.
+        /// </summary>
+        public int increaseHz;
+        /// <summary>
+        /// The rate is multiplied by this, 0 - 1, after a window it did not.
+        /// </summary>
+        public float decreaseFactor;
+        /// <summary>
+        /// Share of its period a tick may spend in driver calls before the
+        /// device counts as saturated.
+        /// </summary>
+        public float busyPercent;
+        /// <summary>
+        /// How long the rate is held before it is adapted again.
+        /// </summary>
+        public float windowMs;
+    }
+
+    public enum FFBRateEvent
+    {
+        None = 0,
+        /// <summary>
+        /// The device kept up, the rate went up.
+        /// </summary>
+        Increase = 1,
+        /// <summary>
+        /// Ticks spent more than busyPercent of their period in driver
+        /// calls.
+        /// </summary>
+        Busy = 2,
+        /// <summary>
+        /// Ticks ran past the next one's deadline.
+        /// </summary>
+        Overrun = 3,
+        /// <summary>
+        /// Driver calls failed.
+        /// </summary>
+        Errors = 4
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FFBRateGovernorStats
+    {
+        public int enabled;
+        /// <summary>
+        /// The output rate the governor chose, updates are coalesced to the
+        /// newest value over one period of it.
+        /// </summary>
+        public int rateHz;
+        /// <summary>
+        /// Driver calls made by the output thread and how many failed.
+        /// </summary>
+        public ulong updates;
+        public uint errors;
+        public uint increases;
+        public uint decreases;
+        /// <summary>
+        /// Share of the last window spent in driver calls.
+        /// </summary>
+        public float busyPercent;
+        /// <summary>
+        /// Driver call latency since the governor was enabled, to within a
+        /// quarter.
+        /// </summary>
+        public float p50Microseconds;
+        public float p95Microseconds;
+        public float p99Microseconds;
+        public float maxMicroseconds;
+        /// <summary>
+        /// The latest change of rate, on the GetFFBClockMicroseconds clock.
+        /// </summary>
+        public FFBRateEvent lastEvent;
+        public int lastEventFromHz;
+        public int lastEventToHz;
+        public long lastEventTimeUs;
+    }
+
+#if UNITY_2021_2_OR_NEWER
+    /// <summary>
+    /// Reads an input capture ring in place, without a call into the plugin
+    /// or marshalling. Read it once a frame and take the clock once to
+    /// get how long ago each change happened. Only one reader per ring.
+    /// </summary>
+    public unsafe struct FFBInputReader
+    {
+        private readonly FFBInputRecord* records;
+        private readonly uint* writeIndex;
+        private readonly uint* readIndex;
+        private readonly uint mask;
+        private uint nextSequence;
+        private bool started;
+        private uint missed;
+
+        public FFBInputReader(FFBInputRing ring)
+        {
+            if (ring.records != IntPtr.Zero && ring.recordSize != sizeof(FFBInputRecord))
+            {
+                throw new ArgumentException("ring does not hold FFBInputRecord records", nameof(ring));
+            }
+            records = (FFBInputRecord*)ring.records;
+            writeIndex = (uint*)ring.writeIndex;
+            readIndex = (uint*)ring.readIndex;
+            mask = ring.capacity - 1;
+            nextSequence = 0;
+            started = false;
+            missed = 0;
+        }
+
+        /// <summary>
+        /// Records seen missing from the sequence, dropped because the ring
+        /// was full.
+        /// </summary>
+        public uint Missed => missed;
+
+        /// <summary>
+        /// Copy up to output.Length published records into output, oldest
+        /// first, and free their slots. The number copied.
+        /// </summary>
+        public int Read(Span<FFBInputRecord> output)
+        {
+            if (records == null)
+            {
+                return 0;
+            }
+            uint read = *readIndex;
+            uint write = System.Threading.Volatile.Read(ref *writeIndex);
+            int count = (int)Math.Min(write - read, (uint)output.Length);
+            for (int i = 0; i < count; i++)
+            {
+                FFBInputRecord record = records[(read + (uint)i) & mask];
+                if (started && record.sequence != nextSequence)
+                {
+                    missed += record.sequence - nextSequence;
+                }
+                nextSequence = record.sequence + 1;
+                started = true;
+                output[i] = record;
+            }
+            System.Threading.Volatile.Write(ref *readIndex, read + (uint)count);
+            return count;
+        }
     }
+#endif
 }
\ No newline at end of file